@@ -71,6 +71,7 @@ if (NOT TARGET _rp2040_family_inclusion_marker)
 			${TOP}/src/portable/raspberrypi/rp2040/rp2040_usb.c
 			${TOP}/src/device/usbd.c
 			${TOP}/src/device/usbd_control.c
+			${TOP}/src/class/audio/audio_asrc.c
 			${TOP}/src/class/audio/audio_device.c
 			${TOP}/src/class/cdc/cdc_device.c
 			${TOP}/src/class/dfu/dfu_device.c
@@ -96,6 +97,7 @@ if (NOT TARGET _rp2040_family_inclusion_marker)
 			${TOP}/src/host/hub.c
 			${TOP}/src/class/cdc/cdc_host.c
 			${TOP}/src/class/hid/hid_host.c
+			${TOP}/src/class/hid/hid_parser.c
 			${TOP}/src/class/msc/msc_host.c
 			${TOP}/src/class/vendor/vendor_host.c
 			)
@@ -271,6 +273,8 @@ if (NOT TARGET _rp2040_family_inclusion_marker)
 					${PICO_TINYUSB_PATH}/src/class/cdc/cdc_host.c
 					${PICO_TINYUSB_PATH}/src/class/hid/hid_device.c
 					${PICO_TINYUSB_PATH}/src/class/hid/hid_host.c
+					${PICO_TINYUSB_PATH}/src/class/hid/hid_parser.c
+					${PICO_TINYUSB_PATH}/src/class/audio/audio_asrc.c
 					${PICO_TINYUSB_PATH}/src/class/audio/audio_device.c
 					${PICO_TINYUSB_PATH}/src/class/dfu/dfu_device.c
 					${PICO_TINYUSB_PATH}/src/class/dfu/dfu_rt_device.c
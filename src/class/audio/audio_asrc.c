@@ -0,0 +1,254 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+
+#if (CFG_TUD_ENABLED && CFG_TUD_AUDIO)
+
+#include "device/usbd.h"
+#include "device/usbd_pvt.h"
+
+#include "audio_device.h"
+
+// Used by the audio device driver, only built if CFG_TUD_AUDIO_ENABLE_ASRC is set
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+
+#include "audio_asrc.h"
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF
+//--------------------------------------------------------------------+
+
+// Fill level low-pass filter: lvl_avg += (lvl - lvl_avg) / 2^LPF_SHIFT on every read
+#define ASRC_LPF_SHIFT      5
+
+// PI controller, the relative level error (1.0 = level deviates by the target level) is in 8.24 format.
+// A relative error of 1.0 changes the ratio by 2^-P_SHIFT i.e. ~2000 ppm, the integral part accumulates 2^-I_SHIFT of it per read
+#define ASRC_P_SHIFT        9
+#define ASRC_I_SHIFT        16
+
+// The ratio never deviates by more than +/- 1/2^LIMIT_SHIFT (~1 %) from 1.0
+#define ASRC_LIMIT_SHIFT    7
+
+//--------------------------------------------------------------------+
+// Sample access
+//--------------------------------------------------------------------+
+
+TU_ATTR_ALWAYS_INLINE static inline int32_t asrc_sample_load(uint8_t const * src, uint8_t const n_bytes)
+{
+  switch (n_bytes)
+  {
+    case 2:  return (int32_t) (int16_t) tu_unaligned_read16(src) * 256;
+    case 3:  return (int32_t) ((((uint32_t) src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16)) ^ 0x800000UL) - 0x800000UL);
+    default: return (int32_t) tu_unaligned_read32(src) / 256;
+  }
+}
+
+TU_ATTR_ALWAYS_INLINE static inline void asrc_sample_store(uint8_t * dst, uint8_t const n_bytes, int32_t sample)
+{
+  // Cubic interpolation may overshoot, clip to 24 bit
+  if (sample > 0x7FFFFF) sample = 0x7FFFFF;
+  else if (sample < -0x800000) sample = -0x800000;
+
+  switch (n_bytes)
+  {
+    case 2:
+      tu_unaligned_write16(dst, (uint16_t) (((uint32_t) sample) >> 8));
+    break;
+
+    case 3:
+      dst[0] = (uint8_t) sample;
+      dst[1] = (uint8_t) (((uint32_t) sample) >> 8);
+      dst[2] = (uint8_t) (((uint32_t) sample) >> 16);
+    break;
+
+    default:
+      tu_unaligned_write32(dst, ((uint32_t) sample) << 8);
+    break;
+  }
+}
+
+// Shift history by one frame and append the frame at src
+static void asrc_push_frame(audio_asrc_t* asrc, uint8_t const * src)
+{
+  for (uint8_t ch = 0; ch < asrc->n_channels; ch++)
+  {
+    asrc->hist[0][ch] = asrc->hist[1][ch];
+    asrc->hist[1][ch] = asrc->hist[2][ch];
+    asrc->hist[2][ch] = asrc->hist[3][ch];
+    asrc->hist[3][ch] = asrc_sample_load(src, asrc->n_bytes_per_sample);
+    src += asrc->n_bytes_per_sample;
+  }
+}
+
+// 4-point cubic Hermite (Catmull-Rom) interpolation between hist[1] and hist[2], t is in 0.16 format
+// Coefficients are computed at twice their value to stay in integers, they are bound by 12 * 2^23 hence products need 64 bit
+static void asrc_interpolate(audio_asrc_t const* asrc, uint8_t * dst, int32_t const t)
+{
+  for (uint8_t ch = 0; ch < asrc->n_channels; ch++)
+  {
+    int32_t const xm1 = asrc->hist[0][ch];
+    int32_t const x0  = asrc->hist[1][ch];
+    int32_t const x1  = asrc->hist[2][ch];
+    int32_t const x2  = asrc->hist[3][ch];
+
+    int32_t const c1 = x1 - xm1;
+    int32_t const c2 = 2*xm1 - 5*x0 + 4*x1 - x2;
+    int32_t const c3 = (x2 - xm1) + 3*(x0 - x1);
+
+    int32_t y = (int32_t) (((int64_t) c3 * t) >> 16) + c2;
+    y = (int32_t) (((int64_t) y * t) >> 16) + c1;
+    y = (int32_t) (((int64_t) y * t) >> 16) + 2*x0;
+
+    asrc_sample_store(dst, asrc->n_bytes_per_sample, y / 2);
+    dst += asrc->n_bytes_per_sample;
+  }
+}
+
+//--------------------------------------------------------------------+
+// Fill level steering
+//--------------------------------------------------------------------+
+
+static void asrc_update_ratio(audio_asrc_t* asrc, uint16_t lvl)
+{
+  asrc->lvl_avg += (uint32_t) (((int32_t) ((uint32_t) lvl << 8) - (int32_t) asrc->lvl_avg) / (1 << ASRC_LPF_SHIFT));
+
+  // Relative level error in 8.24 format, positive if the FIFO fills up i.e. the host is faster
+  int32_t const err = (int32_t) (((int64_t) ((int32_t) asrc->lvl_avg - (int32_t) ((uint32_t) asrc->lvl_thr << 8)) * asrc->gain) / 256);
+
+  int32_t const limit = (int32_t) (AUDIO_ASRC_RATIO_ONE >> ASRC_LIMIT_SHIFT);
+
+  asrc->integral += err / (1 << ASRC_I_SHIFT);
+  if (asrc->integral > limit) asrc->integral = limit;
+  else if (asrc->integral < -limit) asrc->integral = -limit;
+
+  int32_t offset = asrc->integral + err / (1 << ASRC_P_SHIFT);
+  if (offset > limit) offset = limit;
+  else if (offset < -limit) offset = -limit;
+
+  asrc->ratio = (uint32_t) ((int32_t) AUDIO_ASRC_RATIO_ONE + offset);
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+bool audio_asrc_config(audio_asrc_t* asrc, uint8_t n_channels, uint8_t n_bytes_per_sample, uint16_t target_level)
+{
+  TU_VERIFY(n_channels && n_channels <= CFG_TUD_AUDIO_ASRC_N_CHANNELS_MAX);
+  TU_VERIFY(n_bytes_per_sample >= 2 && n_bytes_per_sample <= 4);
+  TU_VERIFY(target_level >= n_channels * n_bytes_per_sample);
+
+  asrc->n_channels = n_channels;
+  asrc->n_bytes_per_sample = n_bytes_per_sample;
+  asrc->lvl_thr = target_level;
+  asrc->gain = AUDIO_ASRC_RATIO_ONE / target_level;
+
+  audio_asrc_reset(asrc);
+
+  return true;
+}
+
+void audio_asrc_reset(audio_asrc_t* asrc)
+{
+  asrc->ratio = AUDIO_ASRC_RATIO_ONE;
+  asrc->phase = 3 * AUDIO_ASRC_RATIO_ONE;   // load three frames before the first output
+  asrc->lvl_avg = (uint32_t) asrc->lvl_thr << 8;
+  asrc->integral = 0;
+  asrc->running = false;
+  tu_memclr(asrc->hist, sizeof(asrc->hist));
+}
+
+uint16_t audio_asrc_read(audio_asrc_t* asrc, tu_fifo_t* ff, void* buffer, uint16_t n_frames)
+{
+  TU_VERIFY(asrc->n_channels, 0);
+
+  uint16_t const frame_size = (uint16_t) (asrc->n_channels * asrc->n_bytes_per_sample);
+  uint16_t const count = tu_fifo_count(ff);
+
+  // Wait until the target level is reached such that over- and underflow are equally far away
+  if (!asrc->running)
+  {
+    if (count < asrc->lvl_thr) return 0;
+    asrc->running = true;
+  }
+
+  asrc_update_ratio(asrc, count);
+
+  // Frames are read directly from the FIFO memory, the FIFO is advanced once at the end
+  tu_fifo_buffer_info_t info;
+  tu_fifo_get_read_info(ff, &info);
+
+  uint16_t const available = (uint16_t) ((info.len_lin + info.len_wrap) / frame_size * frame_size);
+  uint16_t consumed = 0;
+  uint8_t * dst = (uint8_t *) buffer;
+  uint16_t n;
+
+  for (n = 0; n < n_frames; n++)
+  {
+    while (asrc->phase >= AUDIO_ASRC_RATIO_ONE)
+    {
+      if (consumed + frame_size > available) goto done;
+
+      if (consumed + frame_size <= info.len_lin)
+      {
+        asrc_push_frame(asrc, (uint8_t const *) info.ptr_lin + consumed);
+      }
+      else if (consumed >= info.len_lin)
+      {
+        asrc_push_frame(asrc, (uint8_t const *) info.ptr_wrap + (consumed - info.len_lin));
+      }
+      else
+      {
+        // Frame is split by the wrap of the FIFO
+        uint8_t frame[CFG_TUD_AUDIO_ASRC_N_CHANNELS_MAX * 4];
+        uint16_t const n_lin = (uint16_t) (info.len_lin - consumed);
+        memcpy(frame, (uint8_t const *) info.ptr_lin + consumed, n_lin);
+        memcpy(frame + n_lin, info.ptr_wrap, frame_size - n_lin);
+        asrc_push_frame(asrc, frame);
+      }
+
+      consumed = (uint16_t) (consumed + frame_size);
+      asrc->phase -= AUDIO_ASRC_RATIO_ONE;
+    }
+
+    asrc_interpolate(asrc, dst, (int32_t) (asrc->phase >> 8));
+    dst += frame_size;
+    asrc->phase += asrc->ratio;
+  }
+
+done:
+  tu_fifo_advance_read_pointer(ff, consumed);
+
+  // FIFO ran empty - restart once the target level is reached again
+  if (n < n_frames) audio_asrc_reset(asrc);
+
+  return n;
+}
+
+#endif
+
+#endif
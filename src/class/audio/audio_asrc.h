@@ -0,0 +1,90 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_AUDIO_ASRC_H_
+#define _TUSB_AUDIO_ASRC_H_
+
+#include "common/tusb_common.h"
+#include "osal/osal.h"
+#include "common/tusb_fifo.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// Asynchronous sample rate converter (ASRC)
+//
+// Reads interleaved PCM frames from a FIFO which is filled at the sample rate of the host and outputs them at the rate
+// the application reads with, i.e. the rate of the local codec clock. The conversion ratio is steered by the fill level of
+// the FIFO: the level is low-pass filtered on every read and a PI controller keeps it at the target level. Hence, neither
+// a feedback endpoint nor any knowledge about the clocks is required and drifts of a few 1000 ppm are compensated.
+//
+// Samples are interpolated by a 4-point cubic Hermite interpolator in fixed point with 24 bit precision.
+// Supported sample sizes are 2, 3 and 4 bytes (signed little endian PCM).
+
+// Maximum number of interleaved channels
+#ifndef CFG_TUD_AUDIO_ASRC_N_CHANNELS_MAX
+#define CFG_TUD_AUDIO_ASRC_N_CHANNELS_MAX   2
+#endif
+
+#define AUDIO_ASRC_RATIO_ONE                (1UL << 24)   // Ratio is in 8.24 fixed point format
+
+typedef struct
+{
+  uint32_t ratio;         // input frames per output frame, 8.24 format
+  uint32_t phase;         // position of the next output frame relative to hist[1], 8.24 format
+  uint32_t lvl_avg;       // low-pass filtered FIFO fill level in bytes, 24.8 format
+  int32_t  integral;      // integral part of the PI controller, 8.24 format
+  uint32_t gain;          // proportional gain: (1 << 24) / lvl_thr
+  uint16_t lvl_thr;       // target FIFO fill level in bytes
+
+  uint8_t  n_channels;
+  uint8_t  n_bytes_per_sample;
+  bool     running;       // output starts once the target level was reached
+
+  int32_t  hist[4][CFG_TUD_AUDIO_ASRC_N_CHANNELS_MAX];   // last four input frames, 24 bit right-justified
+} audio_asrc_t;
+
+// Configure the converter, target_level is the desired fill level of the FIFO in bytes
+bool     audio_asrc_config (audio_asrc_t* asrc, uint8_t n_channels, uint8_t n_bytes_per_sample, uint16_t target_level);
+
+// Restart conversion e.g. once streaming is started, configuration is kept
+void     audio_asrc_reset  (audio_asrc_t* asrc);
+
+// Read up to n_frames resampled frames from ff into buffer, returns number of frames actually written
+uint16_t audio_asrc_read   (audio_asrc_t* asrc, tu_fifo_t* ff, void* buffer, uint16_t n_frames);
+
+// Current conversion ratio (input frames per output frame) in 8.24 format
+static inline uint32_t audio_asrc_get_ratio(audio_asrc_t const* asrc)
+{
+  return asrc->ratio;
+}
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_AUDIO_ASRC_H_ */
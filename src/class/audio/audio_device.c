@@ -308,6 +308,9 @@ typedef struct
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT
 #if !CFG_TUD_AUDIO_ENABLE_DECODING
   tu_fifo_t ep_out_ff;
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+  audio_asrc_t asrc;
+#endif
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
@@ -328,12 +331,13 @@ typedef struct
         uint32_t mclk_freq;
       }fixed;
 
-#if 0 // implement later
       struct {
-        uint32_t nominal_value;
-        uint32_t threshold_bytes;
+        uint32_t nominal_value; // nominal feedback value in 16.16 format
+        uint32_t fifo_lvl_avg;  // low-pass filtered FIFO fill level in bytes, 24.8 format
+        int32_t  integral;      // integral part of the PI controller in 16.16 format
+        uint32_t gain;          // proportional gain: (1 << 24) / fifo_lvl_thr
+        uint16_t fifo_lvl_thr;  // target FIFO fill level in bytes
       }fifo_count;
-#endif
     }compute;
 
   } feedback;
@@ -359,8 +363,17 @@ typedef struct
 #if CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING
   audio_data_format_type_I_t format_type_I_rx;
   uint8_t n_bytes_per_sampe_rx;
+  uint8_t n_bytes_per_sample_ff_rx;   // Sample size within the support FIFOs, differs from n_bytes_per_sampe_rx if a conversion is active
   uint8_t n_channels_per_ff_rx;
   uint8_t n_ff_used_rx;
+
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+  uint8_t ff_format_rx;               // audio_sample_format_t of the support FIFOs requested by the user
+  uint8_t ff_options_rx;              // Conversion options requested by the user
+  volatile bool ff_format_changed_rx; // Requested format is applied by the driver before the support FIFOs are accessed next
+  uint8_t ff_conv_format_rx;          // Format actually converted to for the active alternate setting, AUDIO_SAMPLE_FORMAT_NATIVE if no conversion is required
+  uint8_t ff_conv_options_rx;
+#endif
 #endif
 #endif
 
@@ -372,9 +385,22 @@ typedef struct
 #if CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
   audio_data_format_type_I_t format_type_I_tx;
   uint8_t n_bytes_per_sampe_tx;
+  uint8_t n_bytes_per_sample_ff_tx;   // Sample size within the support FIFOs, differs from n_bytes_per_sampe_tx if a conversion is active
   uint8_t n_channels_per_ff_tx;
   uint8_t n_ff_used_tx;
+
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+  uint8_t ff_format_tx;               // audio_sample_format_t of the support FIFOs requested by the user
+  uint8_t ff_options_tx;              // Conversion options requested by the user
+  volatile bool ff_format_changed_tx; // Requested format is applied by the driver before the support FIFOs are accessed next
+  uint8_t ff_conv_format_tx;          // Format actually converted from for the active alternate setting, AUDIO_SAMPLE_FORMAT_NATIVE if no conversion is required
+  uint8_t ff_conv_options_tx;
 #endif
+#endif
+#endif
+
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+  uint32_t dither_state;              // State of the pseudo random generator used for dithering
 #endif
 
   // Support FIFOs for software encoding and decoding
@@ -424,6 +450,9 @@ static bool audiod_rx_done_cb(uint8_t rhport, audiod_function_t* audio, uint16_t
 
 #if CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_ENABLE_EP_OUT
 static bool audiod_decode_type_I_pcm(uint8_t rhport, audiod_function_t* audio, uint16_t n_bytes_received);
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING
+static void audiod_config_rx_supp_ff(audiod_function_t* audio);
+#endif
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN
@@ -432,6 +461,9 @@ static bool audiod_tx_done_cb(uint8_t rhport, audiod_function_t* audio);
 
 #if CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_ENABLE_EP_IN
 static uint16_t audiod_encode_type_I_pcm(uint8_t rhport, audiod_function_t* audio);
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
+static void audiod_config_tx_supp_ff(audiod_function_t* audio);
+#endif
 #endif
 
 static bool audiod_get_interface(uint8_t rhport, tusb_control_request_t const * p_request);
@@ -455,6 +487,8 @@ static inline uint8_t tu_desc_subtype(void const* desc)
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
 static bool set_fb_params_freq(audiod_function_t* audio, uint32_t sample_freq, uint32_t mclk_freq);
+static bool set_fb_params_fifo_count(audiod_function_t* audio, uint32_t sample_freq, uint32_t frame_div, uint16_t threshold_bytes);
+static uint32_t audiod_fb_fifo_count_update(audiod_function_t* audio);
 #endif
 
 bool tud_audio_n_mounted(uint8_t func_id)
@@ -511,6 +545,25 @@ tu_fifo_t* tud_audio_n_get_ep_out_ff(uint8_t func_id)
   return NULL;
 }
 
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+bool tud_audio_n_asrc_config(uint8_t func_id, uint8_t n_channels, uint8_t n_bytes_per_sample, uint16_t target_level)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL);
+  audiod_function_t* audio = &_audiod_fct[func_id];
+
+  if (target_level == 0) target_level = audio->ep_out_ff.depth / 2;
+  TU_VERIFY(target_level < audio->ep_out_ff.depth);
+
+  return audio_asrc_config(&audio->asrc, n_channels, n_bytes_per_sample, target_level);
+}
+
+uint16_t tud_audio_n_read_asrc(uint8_t func_id, void* buffer, uint16_t n_frames)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL);
+  return audio_asrc_read(&_audiod_fct[func_id].asrc, &_audiod_fct[func_id].ep_out_ff, buffer, n_frames);
+}
+#endif
+
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_ENABLE_EP_OUT
@@ -538,6 +591,23 @@ tu_fifo_t* tud_audio_n_get_rx_support_ff(uint8_t func_id, uint8_t ff_idx)
   if(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL && ff_idx < _audiod_fct[func_id].n_rx_supp_ff) return &_audiod_fct[func_id].rx_supp_ff[ff_idx];
   return NULL;
 }
+
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING && CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+bool tud_audio_n_set_rx_support_ff_format(uint8_t func_id, audio_sample_format_t format, uint8_t options)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && format <= AUDIO_SAMPLE_FORMAT_FLOAT32);
+  audiod_function_t* audio = &_audiod_fct[func_id];
+
+  audio->ff_format_rx = (uint8_t) format;
+  audio->ff_options_rx = options;
+
+  // Support FIFOs need to be reconfigured for the new sample size. This is deferred to the driver which is the only one
+  // using the conversion parameters, see audiod_config_rx_supp_ff(). Done in set_interface if streaming is not active.
+  audio->ff_format_changed_rx = true;
+
+  return true;
+}
+#endif
 #endif
 
 // This function is called once an audio packet is received by the USB and is responsible for putting data from USB memory into EP_OUT_FIFO (or support FIFOs + decoding of received stream into audio channels).
@@ -625,88 +695,298 @@ static bool audiod_rx_done_cb(uint8_t rhport, audiod_function_t* audio, uint16_t
 
 #endif //CFG_TUD_AUDIO_ENABLE_EP_OUT
 
-// The following functions are used in case CFG_TUD_AUDIO_ENABLE_DECODING != 0
-#if CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_ENABLE_EP_OUT
+#if (CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_ENABLE_EP_OUT) || (CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_ENABLE_EP_IN)
 
-// Decoding according to 2.3.1.5 Audio Streams
+// Interleaving kernels used by the type I PCM coding
+// A block is the part of an audio frame which belongs to one support FIFO i.e. n_channels_per_ff * n_bytes_per_sample bytes.
+// Blocks are moved with the widest access their size allows. Within each kernel the block size is a compile time constant
+// such that the copy of a block gets unrolled, unusual block sizes fall back to memcpy() per block.
 
-// Helper function
-static inline uint8_t * audiod_interleaved_copy_bytes_fast_decode(uint16_t const nBytesToCopy, void * dst, uint8_t * dst_end, uint8_t * src, uint8_t const n_ff_used)
+TU_ATTR_ALWAYS_INLINE static inline void audiod_copy_block(uint8_t * dst, uint8_t const * src, uint16_t const nBytesPerBlock)
 {
+  uint16_t i = 0;
 
-  // This function is an optimized version of
-  //  while((uint8_t *)dst < dst_end)
-  //  {
-  //    memcpy(dst, src, nBytesToCopy);
-  //    dst = (uint8_t *)dst + nBytesToCopy;
-  //    src += nBytesToCopy * n_ff_used;
-  //  }
+  for (; i + 4 <= nBytesPerBlock; i += 4) tu_unaligned_write32(dst + i, tu_unaligned_read32(src + i));
 
-  // Optimize for fast half word copies
-  typedef struct{
-    uint16_t val;
-  } __attribute((__packed__)) unaligned_uint16_t;
+  if (i + 2 <= nBytesPerBlock)
+  {
+    tu_unaligned_write16(dst + i, tu_unaligned_read16(src + i));
+    i += 2;
+  }
 
-  // Optimize for fast word copies
-  typedef struct{
-    uint32_t val;
-  } __attribute((__packed__)) unaligned_uint32_t;
+  if (i < nBytesPerBlock) dst[i] = src[i];
+}
 
-  switch (nBytesToCopy)
+TU_ATTR_ALWAYS_INLINE static inline void audiod_copy_blocks(uint8_t * dst, uint16_t const dst_step, uint8_t const * src, uint16_t const src_step, uint16_t n_blocks, uint16_t const nBytesPerBlock)
+{
+  // Two blocks per iteration to reduce loop overhead
+  for (; n_blocks >= 2; n_blocks -= 2)
   {
-    case 1:
-      while((uint8_t *)dst < dst_end)
-      {
-        *(uint8_t *)dst++ = *src;
-        src += n_ff_used;
-      }
-      break;
+    audiod_copy_block(dst, src, nBytesPerBlock);
+    audiod_copy_block(dst + dst_step, src + src_step, nBytesPerBlock);
+    dst += 2 * dst_step;
+    src += 2 * src_step;
+  }
 
-    case 2:
-      while((uint8_t *)dst < dst_end)
+  if (n_blocks) audiod_copy_block(dst, src, nBytesPerBlock);
+}
+
+// Copy n_blocks blocks of nBytesPerBlock bytes, advancing dst and src by dst_step and src_step bytes per block
+static void audiod_interleaved_copy(uint8_t * dst, uint16_t const dst_step, uint8_t const * src, uint16_t const src_step, uint16_t const n_blocks, uint16_t const nBytesPerBlock)
+{
+  // Only one FIFO in use i.e. stream is not interleaved
+  if (dst_step == nBytesPerBlock && src_step == nBytesPerBlock)
+  {
+    memcpy(dst, src, (size_t) n_blocks * nBytesPerBlock);
+    return;
+  }
+
+  switch (nBytesPerBlock)
+  {
+    // 16 bit samples: 1, 2, 4 and 8 channels per FIFO (and 32 bit: 1, 2, 4 channels per FIFO)
+    case 2:  audiod_copy_blocks(dst, dst_step, src, src_step, n_blocks, 2);  break;
+    case 4:  audiod_copy_blocks(dst, dst_step, src, src_step, n_blocks, 4);  break;
+    case 8:  audiod_copy_blocks(dst, dst_step, src, src_step, n_blocks, 8);  break;
+    case 16: audiod_copy_blocks(dst, dst_step, src, src_step, n_blocks, 16); break;
+
+    // 24 bit samples: 1, 2, 4 and 8 channels per FIFO
+    case 3:  audiod_copy_blocks(dst, dst_step, src, src_step, n_blocks, 3);  break;
+    case 6:  audiod_copy_blocks(dst, dst_step, src, src_step, n_blocks, 6);  break;
+    case 12: audiod_copy_blocks(dst, dst_step, src, src_step, n_blocks, 12); break;
+    case 24: audiod_copy_blocks(dst, dst_step, src, src_step, n_blocks, 24); break;
+
+    // 32 bit samples: 8 channels per FIFO
+    case 32: audiod_copy_blocks(dst, dst_step, src, src_step, n_blocks, 32); break;
+
+    default:
+      for (uint16_t cnt = 0; cnt < n_blocks; cnt++)
       {
-        *(unaligned_uint16_t*)dst = *(unaligned_uint16_t*)src;
-        dst += 2;
-        src += 2 * n_ff_used;
+        memcpy(dst, src, nBytesPerBlock);
+        dst += dst_step;
+        src += src_step;
       }
-      break;
+    break;
+  }
+}
 
-    case 3:
-      while((uint8_t *)dst < dst_end)
-      {
-        //        memcpy(dst, src, 3);
-        //        dst = (uint8_t *)dst + 3;
-        //        src += 3 * n_ff_used;
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
 
-        // TODO: Is there a faster way to copy 3 bytes?
-        *(uint8_t *)dst++ = *src++;
-        *(uint8_t *)dst++ = *src++;
-        *(uint8_t *)dst++ = *src++;
+// Sample format conversion kernels used by the type I PCM coding
+// Samples are converted via a left-justified int32_t, i.e. the full scale of every format is mapped onto the full int32_t range.
+// The conversion is done while interleaving such that every sample is touched only once.
 
-        src += 3 * (n_ff_used - 1);
-      }
-      break;
+static inline uint8_t audiod_sample_size(uint8_t const format)
+{
+  switch (format)
+  {
+    case AUDIO_SAMPLE_FORMAT_INT16: return 2;
+    case AUDIO_SAMPLE_FORMAT_INT24: return 3;
+    default:                        return 4;
+  }
+}
+
+static inline uint8_t audiod_sample_bits(uint8_t const format)
+{
+  switch (format)
+  {
+    case AUDIO_SAMPLE_FORMAT_INT16:       return 16;
+    case AUDIO_SAMPLE_FORMAT_INT24:
+    case AUDIO_SAMPLE_FORMAT_INT24_IN_32: return 24;
+    default:                              return 32;
+  }
+}
+
+// Determine the format the support FIFOs need to be converted from/to, AUDIO_SAMPLE_FORMAT_NATIVE if samples can be copied as they are
+static uint8_t audiod_conv_format(uint8_t const ff_format, uint8_t const n_bytes_per_subslot)
+{
+  uint8_t usb_format;
+
+  switch (n_bytes_per_subslot)
+  {
+    case 2:  usb_format = AUDIO_SAMPLE_FORMAT_INT16; break;
+    case 3:  usb_format = AUDIO_SAMPLE_FORMAT_INT24; break;
+    case 4:  usb_format = AUDIO_SAMPLE_FORMAT_INT32; break;
+    default: return AUDIO_SAMPLE_FORMAT_NATIVE;       // 8 bit subslots are not converted
+  }
+
+  return (ff_format == usb_format) ? AUDIO_SAMPLE_FORMAT_NATIVE : ff_format;
+}
+
+TU_ATTR_ALWAYS_INLINE static inline int32_t audiod_sample_load(uint8_t const * src, uint8_t const format, uint8_t const options)
+{
+  switch (format)
+  {
+    case AUDIO_SAMPLE_FORMAT_INT16:
+      return (int32_t) ((uint32_t) tu_unaligned_read16(src) << 16);
+
+    case AUDIO_SAMPLE_FORMAT_INT24:
+      return (int32_t) (((uint32_t) src[0] << 8) | ((uint32_t) src[1] << 16) | ((uint32_t) src[2] << 24));
 
-    case 4:
-      while((uint8_t *)dst < dst_end)
+    case AUDIO_SAMPLE_FORMAT_INT24_IN_32:
+    {
+      int32_t sample = (int32_t) tu_unaligned_read32(src);
+      if (options & AUDIO_SAMPLE_CONVERSION_SATURATE)
       {
-        *(unaligned_uint32_t*)dst = *(unaligned_uint32_t*)src;
-        dst += 4;
-        src += 4 * n_ff_used;
+        if (sample > 0x7FFFFF) sample = 0x7FFFFF;
+        else if (sample < -0x800000) sample = -0x800000;
       }
-      break;
+      return (int32_t) ((uint32_t) sample << 8);
+    }
+
+    case AUDIO_SAMPLE_FORMAT_FLOAT32:
+    {
+      float sample;
+      memcpy(&sample, src, 4);
+      if (sample >= 1.0f) return INT32_MAX;
+      if (sample > -1.0f) return (int32_t) (sample * 2147483648.0f);
+      if (sample <= -1.0f) return INT32_MIN;
+      return 0; // NaN
+    }
+
+    default:
+      return (int32_t) tu_unaligned_read32(src);
+  }
+}
+
+TU_ATTR_ALWAYS_INLINE static inline void audiod_sample_store(uint8_t * dst, uint8_t const format, int32_t const sample)
+{
+  uint32_t const bits = (uint32_t) sample;
+
+  switch (format)
+  {
+    case AUDIO_SAMPLE_FORMAT_INT16:
+      tu_unaligned_write16(dst, (uint16_t) (bits >> 16));
+    break;
+
+    case AUDIO_SAMPLE_FORMAT_INT24:
+      dst[0] = (uint8_t) (bits >> 8);
+      dst[1] = (uint8_t) (bits >> 16);
+      dst[2] = (uint8_t) (bits >> 24);
+    break;
+
+    case AUDIO_SAMPLE_FORMAT_INT24_IN_32:
+      // Sign extend upper 24 bits
+      tu_unaligned_write32(dst, ((bits >> 8) ^ 0x800000UL) - 0x800000UL);
+    break;
+
+    case AUDIO_SAMPLE_FORMAT_FLOAT32:
+    {
+      // 24 bit are exactly representable by a float, hence +1.0 is never reached
+      float const value = (float) (int32_t) (((bits >> 8) ^ 0x800000UL) - 0x800000UL) * (1.0f / 8388608.0f);
+      memcpy(dst, &value, 4);
+    }
+    break;
+
+    default:
+      tu_unaligned_write32(dst, bits);
+    break;
+  }
+}
+
+// Add TPDF dither of 1 LSB of the target format with 2^shift being its LSB. The noise is offset by half an LSB such that the
+// truncation within audiod_sample_store() rounds to nearest. A xorshift32 generator provides both uniform random values.
+TU_ATTR_ALWAYS_INLINE static inline int32_t audiod_sample_dither(int32_t const sample, uint8_t const shift, uint32_t * state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+
+  uint32_t const mask = (1UL << shift) - 1;
+  int32_t const noise = (int32_t) ((x & mask) + ((x >> 16) & mask)) - (int32_t) (1UL << (shift - 1));
+
+  // Saturate
+  if (noise > 0 && sample > INT32_MAX - noise) return INT32_MAX;
+  if (noise < 0 && sample < INT32_MIN - noise) return INT32_MIN;
+  return sample + noise;
+}
+
+// Convert n_blocks blocks of n_channels samples from src_format to dst_format, advancing dst and src by dst_step and src_step bytes per block
+// The format of the USB side is a compile time constant within each caller such that the per sample dispatch only depends on the support FIFO format
+TU_ATTR_ALWAYS_INLINE static inline void audiod_convert_blocks(uint8_t * dst, uint16_t const dst_step, uint8_t const dst_format,
+                                                               uint8_t const * src, uint16_t const src_step, uint8_t const src_format,
+                                                               uint16_t const n_blocks, uint8_t const n_channels, uint8_t const options, uint32_t * dither_state)
+{
+  uint8_t const dst_size = audiod_sample_size(dst_format);
+  uint8_t const src_size = audiod_sample_size(src_format);
+  uint8_t const dst_bits = audiod_sample_bits(dst_format);
+  uint8_t const shift    = (uint8_t) (32 - dst_bits);
+  bool const dither      = (options & AUDIO_SAMPLE_CONVERSION_DITHER) && (dst_bits < audiod_sample_bits(src_format));
+
+  for (uint16_t cnt = 0; cnt < n_blocks; cnt++)
+  {
+    for (uint8_t ch = 0; ch < n_channels; ch++)
+    {
+      int32_t sample = audiod_sample_load(src + ch * src_size, src_format, options);
+      if (dither) sample = audiod_sample_dither(sample, shift, dither_state);
+      audiod_sample_store(dst + ch * dst_size, dst_format, sample);
+    }
+    dst += dst_step;
+    src += src_step;
+  }
+}
+
+#endif // CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+
+#endif
+
+// The following functions are used in case CFG_TUD_AUDIO_ENABLE_DECODING != 0
+#if CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_ENABLE_EP_OUT
+
+// Decoding according to 2.3.1.5 Audio Streams
+
+// Helper function
+static inline uint8_t * audiod_interleaved_copy_bytes_fast_decode(uint16_t const nBytesPerBlock, void * dst, uint8_t * dst_end, uint8_t * src, uint8_t const n_ff_used)
+{
+  // This function is an optimized version of
+  //  while((uint8_t *)dst < dst_end)
+  //  {
+  //    memcpy(dst, src, nBytesPerBlock);
+  //    dst = (uint8_t *)dst + nBytesPerBlock;
+  //    src += nBytesPerBlock * n_ff_used;
+  //  }
+  uint16_t const n_blocks = (uint16_t) ((dst_end - (uint8_t *) dst) / nBytesPerBlock);
+  audiod_interleaved_copy((uint8_t *) dst, nBytesPerBlock, src, (uint16_t) (nBytesPerBlock * n_ff_used), n_blocks, nBytesPerBlock);
+  return src + n_blocks * nBytesPerBlock * n_ff_used;
+}
+
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+// Same as above but samples are converted into the format of the support FIFOs
+static uint8_t * audiod_convert_bytes_decode(audiod_function_t * audio, uint8_t * dst, uint8_t * dst_end, uint8_t * src)
+{
+  uint8_t const n_channels  = audio->n_channels_per_ff_rx;
+  uint8_t const dst_format  = audio->ff_conv_format_rx;
+  uint8_t const options     = audio->ff_conv_options_rx;
+  uint16_t const dst_step   = (uint16_t) (n_channels * audio->n_bytes_per_sample_ff_rx);
+  uint16_t const src_step   = (uint16_t) (n_channels * audio->n_bytes_per_sampe_rx * audio->n_ff_used_rx);
+  uint16_t const n_blocks   = (uint16_t) ((dst_end - dst) / dst_step);
+
+  switch (audio->n_bytes_per_sampe_rx)
+  {
+    case 2:  audiod_convert_blocks(dst, dst_step, dst_format, src, src_step, AUDIO_SAMPLE_FORMAT_INT16, n_blocks, n_channels, options, &audio->dither_state); break;
+    case 3:  audiod_convert_blocks(dst, dst_step, dst_format, src, src_step, AUDIO_SAMPLE_FORMAT_INT24, n_blocks, n_channels, options, &audio->dither_state); break;
+    default: audiod_convert_blocks(dst, dst_step, dst_format, src, src_step, AUDIO_SAMPLE_FORMAT_INT32, n_blocks, n_channels, options, &audio->dither_state); break;
   }
 
-  return src;
+  return src + n_blocks * src_step;
 }
+#endif
 
 static bool audiod_decode_type_I_pcm(uint8_t rhport, audiod_function_t* audio, uint16_t n_bytes_received)
 {
   (void) rhport;
 
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+  // Apply a sample format change of the application before the support FIFOs are written
+  if (audio->ff_format_changed_rx) audiod_config_rx_supp_ff(audio);
+#endif
+
   // Determine amount of samples
   uint8_t const n_ff_used               = audio->n_ff_used_rx;
-  uint16_t const nBytesPerFFToRead      = n_bytes_received / n_ff_used;
+  uint16_t const nBytesPerBlock         = audio->n_channels_per_ff_rx * audio->n_bytes_per_sampe_rx;
+  uint16_t const nBytesPerBlockFF       = audio->n_channels_per_ff_rx * audio->n_bytes_per_sample_ff_rx;     // Differs from nBytesPerBlock if samples get converted
+  uint16_t const nBytesPerFFToRead      = (uint16_t) (n_bytes_received / n_ff_used / nBytesPerBlock * nBytesPerBlockFF);
   uint8_t cnt_ff;
 
   // Decode
@@ -724,14 +1004,32 @@ static bool audiod_decode_type_I_pcm(uint8_t rhport, audiod_function_t* audio, u
       info.len_lin = tu_min16(nBytesPerFFToRead, info.len_lin);
       src = &audio->lin_buf_out[cnt_ff*audio->n_channels_per_ff_rx * audio->n_bytes_per_sampe_rx];
       dst_end = info.ptr_lin + info.len_lin;
-      src = audiod_interleaved_copy_bytes_fast_decode(audio->n_bytes_per_sampe_rx, info.ptr_lin, dst_end, src, n_ff_used);
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+      if (audio->ff_conv_format_rx != AUDIO_SAMPLE_FORMAT_NATIVE)
+      {
+        src = audiod_convert_bytes_decode(audio, info.ptr_lin, dst_end, src);
+      }
+      else
+#endif
+      {
+        src = audiod_interleaved_copy_bytes_fast_decode(nBytesPerBlock, info.ptr_lin, dst_end, src, n_ff_used);
+      }
 
       // Handle wrapped part of FIFO
       info.len_wrap = tu_min16(nBytesPerFFToRead - info.len_lin, info.len_wrap);
       if (info.len_wrap != 0)
       {
         dst_end = info.ptr_wrap + info.len_wrap;
-        audiod_interleaved_copy_bytes_fast_decode(audio->n_bytes_per_sampe_rx, info.ptr_wrap, dst_end, src, n_ff_used);
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+        if (audio->ff_conv_format_rx != AUDIO_SAMPLE_FORMAT_NATIVE)
+        {
+          audiod_convert_bytes_decode(audio, info.ptr_wrap, dst_end, src);
+        }
+        else
+#endif
+        {
+          audiod_interleaved_copy_bytes_fast_decode(nBytesPerBlock, info.ptr_wrap, dst_end, src, n_ff_used);
+        }
       }
       tu_fifo_advance_write_pointer(&audio->rx_supp_ff[cnt_ff], info.len_lin + info.len_wrap);
     }
@@ -816,6 +1114,23 @@ tu_fifo_t* tud_audio_n_get_tx_support_ff(uint8_t func_id, uint8_t ff_idx)
   return NULL;
 }
 
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING && CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+bool tud_audio_n_set_tx_support_ff_format(uint8_t func_id, audio_sample_format_t format, uint8_t options)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && format <= AUDIO_SAMPLE_FORMAT_FLOAT32);
+  audiod_function_t* audio = &_audiod_fct[func_id];
+
+  audio->ff_format_tx = (uint8_t) format;
+  audio->ff_options_tx = options;
+
+  // Support FIFOs need to be reconfigured for the new sample size. This is deferred to the driver which is the only one
+  // using the conversion parameters, see audiod_config_tx_supp_ff(). Done in set_interface if streaming is not active.
+  audio->ff_format_changed_tx = true;
+
+  return true;
+}
+#endif
+
 #endif
 
 
@@ -944,65 +1259,41 @@ range [-1, +1)
  * */
 
 // Helper function
-static inline uint8_t * audiod_interleaved_copy_bytes_fast_encode(uint16_t const nBytesToCopy, uint8_t * src, uint8_t * src_end, uint8_t * dst, uint8_t const n_ff_used)
+static inline uint8_t * audiod_interleaved_copy_bytes_fast_encode(uint16_t const nBytesPerBlock, uint8_t * src, uint8_t * src_end, uint8_t * dst, uint8_t const n_ff_used)
 {
-  // Optimize for fast half word copies
-  typedef struct{
-    uint16_t val;
-  } __attribute((__packed__)) unaligned_uint16_t;
-
-  // Optimize for fast word copies
-  typedef struct{
-    uint32_t val;
-  } __attribute((__packed__)) unaligned_uint32_t;
+  // This function is an optimized version of
+  //  while(src < src_end)
+  //  {
+  //    memcpy(dst, src, nBytesPerBlock);
+  //    src += nBytesPerBlock;
+  //    dst += nBytesPerBlock * n_ff_used;
+  //  }
+  uint16_t const n_blocks = (uint16_t) ((src_end - src) / nBytesPerBlock);
+  audiod_interleaved_copy(dst, (uint16_t) (nBytesPerBlock * n_ff_used), src, nBytesPerBlock, n_blocks, nBytesPerBlock);
+  return dst + n_blocks * nBytesPerBlock * n_ff_used;
+}
 
-  switch (nBytesToCopy)
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+// Same as above but samples are converted from the format of the support FIFOs
+static uint8_t * audiod_convert_bytes_encode(audiod_function_t * audio, uint8_t * src, uint8_t * src_end, uint8_t * dst)
+{
+  uint8_t const n_channels  = audio->n_channels_per_ff_tx;
+  uint8_t const src_format  = audio->ff_conv_format_tx;
+  uint8_t const options     = audio->ff_conv_options_tx;
+  uint16_t const src_step   = (uint16_t) (n_channels * audio->n_bytes_per_sample_ff_tx);
+  uint16_t const dst_step   = (uint16_t) (n_channels * audio->n_bytes_per_sampe_tx * audio->n_ff_used_tx);
+  uint16_t const n_blocks   = (uint16_t) ((src_end - src) / src_step);
+
+  switch (audio->n_bytes_per_sampe_tx)
   {
-    case 1:
-      while(src < src_end)
-      {
-        *dst = *src++;
-        dst += n_ff_used;
-      }
-      break;
-
-    case 2:
-      while(src < src_end)
-      {
-        *(unaligned_uint16_t*)dst = *(unaligned_uint16_t*)src;
-        src += 2;
-        dst += 2 * n_ff_used;
-      }
-      break;
-
-    case 3:
-      while(src < src_end)
-      {
-        //        memcpy(dst, src, 3);
-        //        src = (uint8_t *)src + 3;
-        //        dst += 3 * n_ff_used;
-
-        // TODO: Is there a faster way to copy 3 bytes?
-        *dst++ = *src++;
-        *dst++ = *src++;
-        *dst++ = *src++;
-
-        dst += 3 * (n_ff_used - 1);
-      }
-      break;
-
-    case 4:
-      while(src < src_end)
-      {
-        *(unaligned_uint32_t*)dst = *(unaligned_uint32_t*)src;
-        src += 4;
-        dst += 4 * n_ff_used;
-      }
-      break;
+    case 2:  audiod_convert_blocks(dst, dst_step, AUDIO_SAMPLE_FORMAT_INT16, src, src_step, src_format, n_blocks, n_channels, options, &audio->dither_state); break;
+    case 3:  audiod_convert_blocks(dst, dst_step, AUDIO_SAMPLE_FORMAT_INT24, src, src_step, src_format, n_blocks, n_channels, options, &audio->dither_state); break;
+    default: audiod_convert_blocks(dst, dst_step, AUDIO_SAMPLE_FORMAT_INT32, src, src_step, src_format, n_blocks, n_channels, options, &audio->dither_state); break;
   }
 
-  return dst;
+  return dst + n_blocks * dst_step;
 }
+#endif
 
 static uint16_t audiod_encode_type_I_pcm(uint8_t rhport, audiod_function_t* audio)
 {
@@ -1012,10 +1303,16 @@ static uint16_t audiod_encode_type_I_pcm(uint8_t rhport, audiod_function_t* audi
   // We encode directly into IN EP's linear buffer - abort if previous transfer not complete
   TU_VERIFY(!usbd_edpt_busy(rhport, audio->ep_in));
 
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+  // Apply a sample format change of the application before the support FIFOs are read
+  if (audio->ff_format_changed_tx) audiod_config_tx_supp_ff(audio);
+#endif
+
   // Determine amount of samples
   uint8_t const n_ff_used               = audio->n_ff_used_tx;
   uint16_t const nBytesToCopy           = audio->n_channels_per_ff_tx * audio->n_bytes_per_sampe_tx;
-  uint16_t const capPerFF               = audio->ep_in_sz / n_ff_used;                                        // Sample capacity per FIFO in bytes
+  uint16_t const nBytesPerBlockFF       = audio->n_channels_per_ff_tx * audio->n_bytes_per_sample_ff_tx;     // Differs from nBytesToCopy if samples get converted
+  uint16_t const capPerFF               = (uint16_t) (audio->ep_in_sz / n_ff_used / nBytesToCopy * nBytesPerBlockFF); // Sample capacity per FIFO in bytes
   uint16_t nBytesPerFFToSend            = tu_fifo_count(&audio->tx_supp_ff[0]);
   uint8_t cnt_ff;
 
@@ -1035,7 +1332,7 @@ static uint16_t audiod_encode_type_I_pcm(uint8_t rhport, audiod_function_t* audi
   nBytesPerFFToSend = tu_min16(nBytesPerFFToSend, capPerFF);
 
   // Round to full number of samples (flooring)
-  nBytesPerFFToSend = (nBytesPerFFToSend / nBytesToCopy) * nBytesToCopy;
+  nBytesPerFFToSend = (nBytesPerFFToSend / nBytesPerBlockFF) * nBytesPerBlockFF;
 
   // Encode
   uint8_t * dst;
@@ -1053,7 +1350,16 @@ static uint16_t audiod_encode_type_I_pcm(uint8_t rhport, audiod_function_t* audi
     {
       info.len_lin = tu_min16(nBytesPerFFToSend, info.len_lin);       // Limit up to desired length
       src_end = (uint8_t *)info.ptr_lin + info.len_lin;
-      dst = audiod_interleaved_copy_bytes_fast_encode(audio->n_bytes_per_sampe_tx, info.ptr_lin, src_end, dst, n_ff_used);
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+      if (audio->ff_conv_format_tx != AUDIO_SAMPLE_FORMAT_NATIVE)
+      {
+        dst = audiod_convert_bytes_encode(audio, info.ptr_lin, src_end, dst);
+      }
+      else
+#endif
+      {
+        dst = audiod_interleaved_copy_bytes_fast_encode(nBytesToCopy, info.ptr_lin, src_end, dst, n_ff_used);
+      }
 
       // Limit up to desired length
       info.len_wrap = tu_min16(nBytesPerFFToSend - info.len_lin, info.len_wrap);
@@ -1062,14 +1368,23 @@ static uint16_t audiod_encode_type_I_pcm(uint8_t rhport, audiod_function_t* audi
       if (info.len_wrap != 0)
       {
         src_end = (uint8_t *)info.ptr_wrap + info.len_wrap;
-        audiod_interleaved_copy_bytes_fast_encode(audio->n_bytes_per_sampe_tx, info.ptr_wrap, src_end, dst, n_ff_used);
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+        if (audio->ff_conv_format_tx != AUDIO_SAMPLE_FORMAT_NATIVE)
+        {
+          audiod_convert_bytes_encode(audio, info.ptr_wrap, src_end, dst);
+        }
+        else
+#endif
+        {
+          audiod_interleaved_copy_bytes_fast_encode(nBytesToCopy, info.ptr_wrap, src_end, dst, n_ff_used);
+        }
       }
 
       tu_fifo_advance_read_pointer(&audio->tx_supp_ff[cnt_ff], info.len_lin + info.len_wrap);
     }
   }
 
-  return nBytesPerFFToSend * n_ff_used;
+  return (uint16_t) (nBytesPerFFToSend / nBytesPerBlockFF * nBytesToCopy * n_ff_used);
 }
 #endif //CFG_TUD_AUDIO_ENABLE_ENCODING
 
@@ -1093,6 +1408,10 @@ void audiod_init(void)
   {
     audiod_function_t* audio = &_audiod_fct[i];
 
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+    audio->dither_state = 0x12345678UL + i;   // Any non-zero seed
+#endif
+
     // Initialize control buffers
     switch (i)
     {
@@ -1413,6 +1732,9 @@ void audiod_reset(uint8_t rhport)
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT && !CFG_TUD_AUDIO_ENABLE_DECODING
     tu_fifo_clear(&audio->ep_out_ff);
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+    audio_asrc_reset(&audio->asrc);
+#endif
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING
@@ -1648,6 +1970,9 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
     // Clear FIFOs, since data is no longer valid
   #if !CFG_TUD_AUDIO_ENABLE_DECODING
     tu_fifo_clear(&audio->ep_out_ff);
+    #if CFG_TUD_AUDIO_ENABLE_ASRC
+    audio_asrc_reset(&audio->asrc);
+    #endif
   #else
     for (uint8_t cnt = 0; cnt < audio->n_rx_supp_ff; cnt++)
     {
@@ -1718,11 +2043,7 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
 
             // Reconfigure size of support FIFOs - this is necessary to avoid samples to get split in case of a wrap
     #if CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
-            const uint16_t active_fifo_depth = (uint16_t) ((audio->tx_supp_ff_sz_max / audio->n_bytes_per_sampe_tx) * audio->n_bytes_per_sampe_tx);
-            for (uint8_t cnt = 0; cnt < audio->n_tx_supp_ff; cnt++)
-            {
-              tu_fifo_config(&audio->tx_supp_ff[cnt], audio->tx_supp_ff[cnt].buffer, active_fifo_depth, 1, true);
-            }
+            audiod_config_tx_supp_ff(audio);
             audio->n_ff_used_tx = audio->n_channels_tx / audio->n_channels_per_ff_tx;
             TU_ASSERT( audio->n_ff_used_tx <= audio->n_tx_supp_ff );
     #endif
@@ -1748,11 +2069,7 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
 
             // Reconfigure size of support FIFOs - this is necessary to avoid samples to get split in case of a wrap
     #if CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING
-            const uint16_t active_fifo_depth = (audio->rx_supp_ff_sz_max / audio->n_bytes_per_sampe_rx) * audio->n_bytes_per_sampe_rx;
-            for (uint8_t cnt = 0; cnt < audio->n_rx_supp_ff; cnt++)
-            {
-              tu_fifo_config(&audio->rx_supp_ff[cnt], audio->rx_supp_ff[cnt].buffer, active_fifo_depth, 1, true);
-            }
+            audiod_config_rx_supp_ff(audio);
             audio->n_ff_used_rx = audio->n_channels_rx / audio->n_channels_per_ff_rx;
             TU_ASSERT( audio->n_ff_used_rx <= audio->n_rx_supp_ff );
     #endif
@@ -1810,17 +2127,14 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
             set_fb_params_freq(audio, fb_param.sample_freq, fb_param.frequency.mclk_freq);
           break;
 
-          #if 0 // implement later
           case AUDIO_FEEDBACK_METHOD_FIFO_COUNT:
-          {
-            uint64_t fb64 = ((uint64_t) fb_param.sample_freq) << 16;
-            audio->feedback.compute.fifo_count.nominal_value = (uint32_t) (fb64 / frame_div);
-            audio->feedback.compute.fifo_count.threshold_bytes = fb_param.fifo_count.threshold_bytes;
-
-            tud_audio_fb_set(audio->feedback.compute.fifo_count.nominal_value);
-          }
+            if ( set_fb_params_fifo_count(audio, fb_param.sample_freq, frame_div, fb_param.fifo_count.threshold_bytes) )
+            {
+              // Controller is evaluated within SOF ISR
+              usbd_sof_enable(rhport, true);
+              tud_audio_n_fb_set(func_id, audio->feedback.compute.fifo_count.nominal_value);
+            }
           break;
-          #endif
 
           // nothing to do
           default: break;
@@ -2152,6 +2466,7 @@ static bool set_fb_params_freq(audiod_function_t* audio, uint32_t sample_freq, u
 
   if ( (((1UL << k) * sample_freq / mclk_freq) + 1) > n_frame )
   {
+    audio->feedback.compute_method = AUDIO_FEEDBACK_METHOD_DISABLED;
     TU_LOG1("  UAC2 feedback interval too small\r\n"); TU_BREAKPOINT(); return false;
   }
 
@@ -2210,6 +2525,76 @@ uint32_t tud_audio_feedback_update(uint8_t func_id, uint32_t cycles)
 
   return feedback;
 }
+
+static bool set_fb_params_fifo_count(audiod_function_t* audio, uint32_t sample_freq, uint32_t frame_div, uint16_t threshold_bytes)
+{
+#if CFG_TUD_AUDIO_ENABLE_DECODING
+  // Support FIFOs are filled evenly, the first one is representative for all
+  uint16_t const fifo_depth = audio->n_rx_supp_ff ? audio->rx_supp_ff[0].depth : 0;
+#else
+  uint16_t const fifo_depth = audio->ep_out_ff.depth;
+#endif
+
+  if ( threshold_bytes == 0 ) threshold_bytes = fifo_depth / 2;
+
+  if ( threshold_bytes == 0 || threshold_bytes >= fifo_depth )
+  {
+    audio->feedback.compute_method = AUDIO_FEEDBACK_METHOD_DISABLED;
+    TU_LOG1("  UAC2 feedback FIFO threshold invalid\r\n"); TU_BREAKPOINT(); return false;
+  }
+
+  uint64_t const fb64 = ((uint64_t) sample_freq) << 16;
+  audio->feedback.compute.fifo_count.nominal_value = (uint32_t) (fb64 / frame_div);
+  audio->feedback.compute.fifo_count.fifo_lvl_thr  = threshold_bytes;
+  audio->feedback.compute.fifo_count.fifo_lvl_avg  = ((uint32_t) threshold_bytes) << 8;
+  audio->feedback.compute.fifo_count.integral      = 0;
+
+  // A deviation of threshold_bytes from the target level corrects the feedback value by one sample per (micro)frame
+  audio->feedback.compute.fifo_count.gain = (1UL << 24) / threshold_bytes;
+
+  return true;
+}
+
+// Time constants of the FIFO count controller as power of two, in units of SOF i.e. 1 ms
+#define AUDIO_FB_FIFO_COUNT_LPF_SHIFT   4   // low-pass filter of the fill level
+#define AUDIO_FB_FIFO_COUNT_INT_SHIFT   10  // integral part of the PI controller
+
+// Invoked every SOF. The fill level is low-pass filtered to get rid of the jitter caused by packet-wise writes of
+// the USB and block-wise reads of the application. A PI controller steers the feedback value such that the FIFO
+// is kept at the target level, the integral part compensates the constant drift between host and device clock.
+static uint32_t audiod_fb_fifo_count_update(audiod_function_t* audio)
+{
+#if CFG_TUD_AUDIO_ENABLE_DECODING
+  uint32_t const lvl = tu_fifo_count(&audio->rx_supp_ff[0]);
+#else
+  uint32_t const lvl = tu_fifo_count(&audio->ep_out_ff);
+#endif
+
+  // First order low-pass filter in 24.8 format
+  uint32_t avg = audio->feedback.compute.fifo_count.fifo_lvl_avg;
+  avg = avg - (avg >> AUDIO_FB_FIFO_COUNT_LPF_SHIFT) + ((lvl << 8) >> AUDIO_FB_FIFO_COUNT_LPF_SHIFT);
+  audio->feedback.compute.fifo_count.fifo_lvl_avg = avg;
+
+  // Positive error i.e. FIFO below target level -> host should send more samples
+  int32_t const err = (int32_t) (((uint32_t) audio->feedback.compute.fifo_count.fifo_lvl_thr) << 8) - (int32_t) avg;
+
+  // Proportional part in 16.16 format
+  int32_t const prop = (int32_t) (((int64_t) err * audio->feedback.compute.fifo_count.gain) / (1 << 16));
+
+  // Integral part with anti-windup, limited to one sample per (micro)frame
+  int32_t integral = audio->feedback.compute.fifo_count.integral + prop / (1 << AUDIO_FB_FIFO_COUNT_INT_SHIFT);
+  if ( integral >  (1 << 16) ) integral =  (1 << 16);
+  if ( integral < -(1 << 16) ) integral = -(1 << 16);
+  audio->feedback.compute.fifo_count.integral = integral;
+
+  int32_t feedback = (int32_t) audio->feedback.compute.fifo_count.nominal_value + prop + integral;
+
+  // Same limits as for the frequency methods, see tud_audio_feedback_update()
+  if ( feedback > (int32_t) audio->feedback.max_value ) feedback = (int32_t) audio->feedback.max_value;
+  if ( feedback < (int32_t) audio->feedback.min_value ) feedback = (int32_t) audio->feedback.min_value;
+
+  return (uint32_t) feedback;
+}
 #endif
 
 TU_ATTR_FAST_FUNC void audiod_sof_isr (uint8_t rhport, uint32_t frame_count)
@@ -2234,8 +2619,17 @@ TU_ATTR_FAST_FUNC void audiod_sof_isr (uint8_t rhport, uint32_t frame_count)
       // HS shift need to be adjusted since SOF event is generated for frame only
       uint8_t const hs_adjust = (TUSB_SPEED_HIGH == tud_speed_get()) ? 3 : 0;
       uint32_t const interval = 1UL << (audio->feedback.frame_shift - hs_adjust);
+
+      // FIFO count method needs to track the fill level every SOF, new value is only sent once per interval
+      uint32_t feedback = 0;
+      if ( audio->feedback.compute_method == AUDIO_FEEDBACK_METHOD_FIFO_COUNT )
+      {
+        feedback = audiod_fb_fifo_count_update(audio);
+      }
+
       if ( 0 == (frame_count & (interval-1)) )
       {
+        if ( feedback ) tud_audio_n_fb_set(i, feedback);
         if(tud_audio_feedback_interval_isr) tud_audio_feedback_interval_isr(i, frame_count, audio->feedback.frame_shift);
       }
     }
@@ -2518,6 +2912,49 @@ static void audiod_parse_for_AS_params(audiod_function_t* audio, uint8_t const *
 }
 #endif
 
+// Reconfigure size of support FIFOs to a multiple of a block i.e. n_channels_per_ff * (sample size within FIFO) - this is necessary to avoid samples to get split in case of a wrap
+#if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
+static void audiod_config_tx_supp_ff(audiod_function_t* audio)
+{
+  audio->n_bytes_per_sample_ff_tx = audio->n_bytes_per_sampe_tx;
+
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+  audio->ff_format_changed_tx = false;
+  audio->ff_conv_options_tx = audio->ff_options_tx;
+  audio->ff_conv_format_tx = audiod_conv_format(audio->ff_format_tx, audio->n_bytes_per_sampe_tx);
+  if (audio->ff_conv_format_tx != AUDIO_SAMPLE_FORMAT_NATIVE) audio->n_bytes_per_sample_ff_tx = audiod_sample_size(audio->ff_conv_format_tx);
+#endif
+
+  const uint16_t n_bytes_per_block = audio->n_channels_per_ff_tx * audio->n_bytes_per_sample_ff_tx;
+  const uint16_t active_fifo_depth = (uint16_t) ((audio->tx_supp_ff_sz_max / n_bytes_per_block) * n_bytes_per_block);
+  for (uint8_t cnt = 0; cnt < audio->n_tx_supp_ff; cnt++)
+  {
+    tu_fifo_config(&audio->tx_supp_ff[cnt], audio->tx_supp_ff[cnt].buffer, active_fifo_depth, 1, true);
+  }
+}
+#endif
+
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING
+static void audiod_config_rx_supp_ff(audiod_function_t* audio)
+{
+  audio->n_bytes_per_sample_ff_rx = audio->n_bytes_per_sampe_rx;
+
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+  audio->ff_format_changed_rx = false;
+  audio->ff_conv_options_rx = audio->ff_options_rx;
+  audio->ff_conv_format_rx = audiod_conv_format(audio->ff_format_rx, audio->n_bytes_per_sampe_rx);
+  if (audio->ff_conv_format_rx != AUDIO_SAMPLE_FORMAT_NATIVE) audio->n_bytes_per_sample_ff_rx = audiod_sample_size(audio->ff_conv_format_rx);
+#endif
+
+  const uint16_t n_bytes_per_block = audio->n_channels_per_ff_rx * audio->n_bytes_per_sample_ff_rx;
+  const uint16_t active_fifo_depth = (uint16_t) ((audio->rx_supp_ff_sz_max / n_bytes_per_block) * n_bytes_per_block);
+  for (uint8_t cnt = 0; cnt < audio->n_rx_supp_ff; cnt++)
+  {
+    tu_fifo_config(&audio->rx_supp_ff[cnt], audio->rx_supp_ff[cnt].buffer, active_fifo_depth, 1, true);
+  }
+}
+#endif
+
 #if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
 
 bool tud_audio_n_fb_set(uint8_t func_id, uint32_t feedback)
@@ -241,7 +241,7 @@
 // Enable encoding/decodings - for these to work, support FIFOs need to be setup in appropriate numbers and size
 // The actual coding parameters of active AS alternate interface is parsed from the descriptors
 
-// The item size of the FIFO is always fixed to one i.e. bytes! Furthermore, the actively used FIFO depth is reconfigured such that the depth is a multiple of the current sample size in order to avoid samples to get split up in case of a wrap in the FIFO ring buffer (depth = (max_depth / sampe_sz) * sampe_sz)!
+// The item size of the FIFO is always fixed to one i.e. bytes! Furthermore, the actively used FIFO depth is reconfigured such that the depth is a multiple of the current sample size times the number of channels per FIFO in order to avoid samples to get split up in case of a wrap in the FIFO ring buffer (depth = (max_depth / (sampe_sz * ch_per_ff)) * sampe_sz * ch_per_ff)!
 // This is important to remind in case you use DMAs! If the sample sizes changes, the DMA MUST BE RECONFIGURED just like the FIFOs for a different depth!!!
 
 // For PCM encoding/decoding
@@ -263,6 +263,23 @@
 #define CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING                0
 #endif
 
+// Sample format conversion for TYPE_I coding - the support FIFOs may hold samples in a different format than the subslot size used on USB
+// e.g. int32_t or float samples from a DSP. The conversion is done while interleaving, hence, audio data is only touched once. See tud_audio_n_set_tx_support_ff_format()
+#ifndef CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+#define CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION              0
+#endif
+
+// Asynchronous sample rate converter between the EP OUT FIFO and the application - see audio_asrc.h and tud_audio_n_read_asrc()
+// Compensates the drift between the host's sample clock and the local codec clock if no feedback EP is used or the host ignores it.
+// Only available if decoding is disabled i.e. interleaved samples are read from the EP OUT FIFO.
+#ifndef CFG_TUD_AUDIO_ENABLE_ASRC
+#define CFG_TUD_AUDIO_ENABLE_ASRC                           0
+#endif
+
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+#include "audio_asrc.h"
+#endif
+
 // Type I Coding parameters not given within UAC2 descriptors
 // It would be possible to allow for a more flexible setting and not fix this parameter as done below. However, this is most often not needed and kept for later if really necessary. The more flexible setting could be implemented within set_interface(), however, how the values are saved per alternate setting is to be determined!
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
@@ -366,6 +383,15 @@ uint16_t tud_audio_n_available                    (uint8_t func_id);
 uint16_t tud_audio_n_read                         (uint8_t func_id, void* buffer, uint16_t bufsize);
 bool     tud_audio_n_clear_ep_out_ff              (uint8_t func_id);                          // Delete all content in the EP OUT FIFO
 tu_fifo_t*   tud_audio_n_get_ep_out_ff            (uint8_t func_id);
+
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+// Configure the sample rate converter for the active alternate setting e.g. within tud_audio_set_itf_cb(). target_level is the EP OUT FIFO
+// fill level in bytes the converter steers to, 0 for half of the FIFO depth.
+bool     tud_audio_n_asrc_config                  (uint8_t func_id, uint8_t n_channels, uint8_t n_bytes_per_sample, uint16_t target_level);
+// Read n_frames frames converted to the rate this function is called with, returns the number of frames actually read.
+// Reading starts once the target level was reached. It must be called at a steady rate e.g. from the codec's DMA handler.
+uint16_t tud_audio_n_read_asrc                    (uint8_t func_id, void* buffer, uint16_t n_frames);
+#endif
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_DECODING
@@ -392,6 +418,36 @@ tu_fifo_t* tud_audio_n_get_tx_support_ff          (uint8_t func_id, uint8_t ff_i
 uint16_t    tud_audio_int_ctr_n_write             (uint8_t func_id, uint8_t const* buffer, uint16_t len);
 #endif
 
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+// Sample formats of the support FIFOs. Samples are converted to/from the subslot size (2, 3 or 4 bytes) of the active alternate setting.
+typedef enum
+{
+  AUDIO_SAMPLE_FORMAT_NATIVE = 0,   // Same as the subslot, no conversion (default)
+  AUDIO_SAMPLE_FORMAT_INT16,        // int16_t
+  AUDIO_SAMPLE_FORMAT_INT24,        // 3 bytes packed, only used for the subslot side
+  AUDIO_SAMPLE_FORMAT_INT24_IN_32,  // int32_t holding a right-justified i.e. sign extended 24 bit sample
+  AUDIO_SAMPLE_FORMAT_INT32,        // int32_t
+  AUDIO_SAMPLE_FORMAT_FLOAT32,      // float within [-1, +1), values outside are clipped
+} audio_sample_format_t;
+
+// Conversion options, may be or'ed
+enum
+{
+  AUDIO_SAMPLE_CONVERSION_DITHER   = 0x01, // Add TPDF dither when the bit depth is reduced, otherwise samples are truncated
+  AUDIO_SAMPLE_CONVERSION_SATURATE = 0x02, // Clip INT24_IN_32 samples exceeding 24 bit instead of wrapping around
+};
+
+// Set the sample format of the support FIFOs. If streaming is already active, the support FIFOs are reconfigured and cleared
+// by the driver before it decodes/encodes the next packet.
+#if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
+bool     tud_audio_n_set_tx_support_ff_format     (uint8_t func_id, audio_sample_format_t format, uint8_t options);
+#endif
+
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING
+bool     tud_audio_n_set_rx_support_ff_format     (uint8_t func_id, audio_sample_format_t format, uint8_t options);
+#endif
+#endif
+
 //--------------------------------------------------------------------+
 // Application API (Interface0)
 //--------------------------------------------------------------------+
@@ -467,6 +523,8 @@ TU_ATTR_WEAK void tud_audio_fb_done_cb(uint8_t func_id);
 
 // Feedback value is determined by the user by use of SOF interrupt. The user may use tud_audio_sof_isr() which is called every SOF (of course only invoked when an alternate interface other than zero was set). The number of frames used to determine the feedback value for the currently active alternate setting can be get by tud_audio_get_fb_n_frames(). The feedback value must be set by use of tud_audio_n_fb_set().
 
+// Feedback value is calculated within the audio driver from the fill level of the EP OUT FIFO (support RX FIFOs if decoding is used) - see AUDIO_FEEDBACK_METHOD_FIFO_COUNT. No master clock counter is required. The fill level is low-pass filtered every SOF and a PI controller steers the feedback value such that the FIFO is kept at the target level given in tud_audio_feedback_params_cb(). Advantage: works with any clock source, disadvantage: the FIFO must be able to absorb the regulation error i.e. it should hold at least a few frames (e.g. 4-8 frames), hence a larger delay is introduced.
+
 // This function is used to provide data rate feedback from an asynchronous sink. Feedback value will be sent at FB endpoint interval till it's changed.
 //
 // The feedback format is specified to be 16.16 for HS and 10.14 for FS devices (see Universal Serial Bus Specification Revision 2.0 5.12.4.2). By default,
@@ -498,9 +556,7 @@ enum {
   AUDIO_FEEDBACK_METHOD_FREQUENCY_FIXED,
   AUDIO_FEEDBACK_METHOD_FREQUENCY_FLOAT,
   AUDIO_FEEDBACK_METHOD_FREQUENCY_POWER_OF_2,
-
-  // impelemnt later
-  // AUDIO_FEEDBACK_METHOD_FIFO_COUNT
+  AUDIO_FEEDBACK_METHOD_FIFO_COUNT
 };
 
 typedef struct {
@@ -512,11 +568,9 @@ typedef struct {
       uint32_t mclk_freq; // Main clock frequency in Hz i.e. master clock to which sample clock is based on
     }frequency;
 
-#if 0 // implement later
     struct {
-      uint32_t threshold_bytes; // minimum number of bytes received to be considered as filled/ready
+      uint16_t threshold_bytes; // target fill level of the EP OUT FIFO in bytes, 0 for half of the FIFO depth
     }fifo_count;
-#endif
   };
 }audio_feedback_params_t;
 
@@ -592,6 +646,18 @@ static inline tu_fifo_t* tud_audio_get_ep_out_ff(void)
   return tud_audio_n_get_ep_out_ff(0);
 }
 
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+static inline bool tud_audio_asrc_config(uint8_t n_channels, uint8_t n_bytes_per_sample, uint16_t target_level)
+{
+  return tud_audio_n_asrc_config(0, n_channels, n_bytes_per_sample, target_level);
+}
+
+static inline uint16_t tud_audio_read_asrc(void* buffer, uint16_t n_frames)
+{
+  return tud_audio_n_read_asrc(0, buffer, n_frames);
+}
+#endif
+
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_DECODING
@@ -663,6 +729,22 @@ static inline tu_fifo_t* tud_audio_get_tx_support_ff(uint8_t ff_idx)
 
 #endif
 
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION
+#if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
+static inline bool tud_audio_set_tx_support_ff_format(audio_sample_format_t format, uint8_t options)
+{
+  return tud_audio_n_set_tx_support_ff_format(0, format, options);
+}
+#endif
+
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING
+static inline bool tud_audio_set_rx_support_ff_format(audio_sample_format_t format, uint8_t options)
+{
+  return tud_audio_n_set_rx_support_ff_format(0, format, options);
+}
+#endif
+#endif
+
 #if CFG_TUD_AUDIO_INT_CTR_EPSIZE_IN
 static inline uint16_t tud_audio_int_ctr_write(uint8_t const* buffer, uint16_t len)
 {
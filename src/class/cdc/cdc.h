@@ -389,6 +389,18 @@ static inline uint8_t cdc_functional_desc_typeof(uint8_t const * p_desc)
   return p_desc[2];
 }
 
+/// PSTN 6.5.4 SerialState notification data bitmap
+enum
+{
+  CDC_SERIAL_STATE_DCD     = TU_BIT(0), ///< bRxCarrier: Data Carrier Detect
+  CDC_SERIAL_STATE_DSR     = TU_BIT(1), ///< bTxCarrier: Data Set Ready
+  CDC_SERIAL_STATE_BREAK   = TU_BIT(2), ///< bBreak: break detected
+  CDC_SERIAL_STATE_RI      = TU_BIT(3), ///< bRingSignal: Ring Indicator
+  CDC_SERIAL_STATE_FRAMING = TU_BIT(4), ///< bFraming: framing error
+  CDC_SERIAL_STATE_PARITY  = TU_BIT(5), ///< bParity: parity error
+  CDC_SERIAL_STATE_OVERRUN = TU_BIT(6), ///< bOverRun: received data has been discarded due to overrun
+};
+
 //--------------------------------------------------------------------+
 // Requests
 //--------------------------------------------------------------------+
@@ -54,17 +54,25 @@ typedef struct {
   uint8_t line_state;                               // DTR (bit0), RTS (bit1)
   TU_ATTR_ALIGNED(4) cdc_line_coding_t line_coding; // Baudrate, stop bits, parity, data width
 
+  uint32_t requested_baud; // vendor serial: baudrate of pending request, divisor to baudrate is not easy
+  uint8_t serial_rev;      // vendor serial: chip version (CH34x) or type (PL2303)
+
+  uint16_t serial_state;         // CDC_SERIAL_STATE_* and TUH_CDC_SERIAL_STATE_CTS, errors are latched until reported
+  uint16_t serial_state_changed; // changes not yet reported to application
+  bool serial_state_pending;     // report is scheduled
+
+  // SerialState is 10 bytes, longer notifications are dropped
+  CFG_TUH_MEM_ALIGN uint8_t notif_buf[16];
+
   tuh_xfer_cb_t user_control_cb;
 
   struct {
     tu_edpt_stream_t tx;
     tu_edpt_stream_t rx;
 
+    // endpoint buffers are allocated from usbh buffer pool when opened
     uint8_t tx_ff_buf[CFG_TUH_CDC_TX_BUFSIZE];
-    CFG_TUH_MEM_ALIGN uint8_t tx_ep_buf[CFG_TUH_CDC_TX_EPSIZE];
-
-    uint8_t rx_ff_buf[CFG_TUH_CDC_TX_BUFSIZE];
-    CFG_TUH_MEM_ALIGN uint8_t rx_ep_buf[CFG_TUH_CDC_TX_EPSIZE];
+    uint8_t rx_ff_buf[CFG_TUH_CDC_RX_BUFSIZE];
   } stream;
 
 } cdch_interface_t;
@@ -92,9 +100,6 @@ enum {
   FTDI_PID_COUNT = sizeof(ftdi_pids) / sizeof(ftdi_pids[0])
 };
 
-// Store last request baudrate since divisor to baudrate is not easy
-static uint32_t _ftdi_requested_baud;
-
 static bool ftdi_open(uint8_t daddr, const tusb_desc_interface_t *itf_desc, uint16_t max_len);
 static void ftdi_process_config(tuh_xfer_t* xfer);
 
@@ -118,6 +123,39 @@ static bool cp210x_set_modem_ctrl(cdch_interface_t* p_cdc, uint16_t line_state,
 static bool cp210x_set_baudrate(cdch_interface_t* p_cdc, uint32_t baudrate, tuh_xfer_cb_t complete_cb, uintptr_t user_data);
 #endif
 
+//------------- CH34X prototypes -------------//
+#if CFG_TUH_CDC_CH34X
+#include "serial/ch34x.h"
+
+static uint16_t const ch34x_pids[] = { TU_CH34X_PID_LIST };
+enum {
+  CH34X_PID_COUNT = sizeof(ch34x_pids) / sizeof(ch34x_pids[0])
+};
+
+static bool ch34x_open(uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len);
+static void ch34x_process_config(tuh_xfer_t* xfer);
+
+static bool ch34x_set_modem_ctrl(cdch_interface_t* p_cdc, uint16_t line_state, tuh_xfer_cb_t complete_cb, uintptr_t user_data);
+static bool ch34x_set_baudrate(cdch_interface_t* p_cdc, uint32_t baudrate, tuh_xfer_cb_t complete_cb, uintptr_t user_data);
+static void ch34x_lcr_to_line_coding(uint8_t lcr, cdc_line_coding_t* line_coding);
+#endif
+
+//------------- PL2303 prototypes -------------//
+#if CFG_TUH_CDC_PL2303
+#include "serial/pl2303.h"
+
+static uint16_t const pl2303_pids[] = { TU_PL2303_PID_LIST };
+enum {
+  PL2303_PID_COUNT = sizeof(pl2303_pids) / sizeof(pl2303_pids[0])
+};
+
+static bool pl2303_open(uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len);
+static void pl2303_process_config(tuh_xfer_t* xfer);
+
+static bool pl2303_set_modem_ctrl(cdch_interface_t* p_cdc, uint16_t line_state, tuh_xfer_cb_t complete_cb, uintptr_t user_data);
+static bool pl2303_set_baudrate(cdch_interface_t* p_cdc, uint32_t baudrate, tuh_xfer_cb_t complete_cb, uintptr_t user_data);
+#endif
+
 enum {
   SERIAL_DRIVER_ACM = 0,
 
@@ -128,6 +166,14 @@ enum {
 #if CFG_TUH_CDC_CP210X
   SERIAL_DRIVER_CP210X,
 #endif
+
+#if CFG_TUH_CDC_CH34X
+  SERIAL_DRIVER_CH34X,
+#endif
+
+#if CFG_TUH_CDC_PL2303
+  SERIAL_DRIVER_PL2303,
+#endif
 };
 
 typedef struct {
@@ -156,6 +202,20 @@ static const cdch_serial_driver_t serial_drivers[] = {
     .set_baudrate           = cp210x_set_baudrate
   },
   #endif
+
+  #if CFG_TUH_CDC_CH34X
+  { .process_set_config     = ch34x_process_config,
+    .set_control_line_state = ch34x_set_modem_ctrl,
+    .set_baudrate           = ch34x_set_baudrate
+  },
+  #endif
+
+  #if CFG_TUH_CDC_PL2303
+  { .process_set_config     = pl2303_process_config,
+    .set_control_line_state = pl2303_set_modem_ctrl,
+    .set_baudrate           = pl2303_set_baudrate
+  },
+  #endif
 };
 
 enum {
@@ -189,6 +249,29 @@ static inline uint8_t get_idx_by_ep_addr(uint8_t daddr, uint8_t ep_addr)
   return TUSB_INDEX_INVALID_8;
 }
 
+// Interface of a control request is wIndex if recipient is interface. Vendor serial chips use device recipient and
+// may carry register data in wIndex, but have only one interface.
+static uint8_t get_idx_by_control_xfer(tuh_xfer_t const* xfer)
+{
+  tusb_control_request_t const* request = xfer->setup;
+
+  if ( request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_INTERFACE )
+  {
+    uint8_t const itf_num = (uint8_t) tu_le16toh(request->wIndex);
+    for(uint8_t i=0; i<CFG_TUH_CDC; i++)
+    {
+      if (cdch_data[i].daddr == xfer->daddr && cdch_data[i].bInterfaceNumber == itf_num) return i;
+    }
+  }else
+  {
+    for(uint8_t i=0; i<CFG_TUH_CDC; i++)
+    {
+      if (cdch_data[i].daddr == xfer->daddr) return i;
+    }
+  }
+
+  return TUSB_INDEX_INVALID_8;
+}
 
 static cdch_interface_t* make_new_itf(uint8_t daddr, tusb_desc_interface_t const *itf_desc)
 {
@@ -197,11 +280,30 @@ static cdch_interface_t* make_new_itf(uint8_t daddr, tusb_desc_interface_t const
     if (cdch_data[i].daddr == 0) {
       cdch_interface_t* p_cdc = &cdch_data[i];
 
+      uint8_t* tx_ep_buf = (uint8_t*) usbh_buf_alloc(daddr, CFG_TUH_CDC_TX_EPSIZE);
+      uint8_t* rx_ep_buf = (uint8_t*) usbh_buf_alloc(daddr, CFG_TUH_CDC_RX_EPSIZE);
+      TU_ASSERT(tx_ep_buf && rx_ep_buf, NULL); // not enough pool, try to increase CFG_TUH_MEM_POOL_SIZE
+
+      p_cdc->stream.tx.ep_buf = tx_ep_buf;
+      p_cdc->stream.rx.ep_buf = rx_ep_buf;
+
+      #if CFG_TUH_CDC_RX_DOUBLE_BUFFER
+      uint8_t* rx_ep_buf2 = (uint8_t*) usbh_buf_alloc(daddr, CFG_TUH_CDC_RX_EPSIZE);
+      TU_ASSERT(rx_ep_buf2, NULL);
+      tu_edpt_stream_set_rx_buf2(&p_cdc->stream.rx, rx_ep_buf2);
+      #endif
+
       p_cdc->daddr              = daddr;
       p_cdc->bInterfaceNumber   = itf_desc->bInterfaceNumber;
       p_cdc->bInterfaceSubClass = itf_desc->bInterfaceSubClass;
       p_cdc->bInterfaceProtocol = itf_desc->bInterfaceProtocol;
       p_cdc->line_state         = 0;
+      p_cdc->ep_notif           = 0;
+      p_cdc->serial_rev         = 0;
+      tu_memclr(&p_cdc->line_coding, sizeof(cdc_line_coding_t));
+      p_cdc->serial_state         = 0;
+      p_cdc->serial_state_changed = 0;
+      p_cdc->serial_state_pending = false;
       return p_cdc;
     }
   }
@@ -212,6 +314,7 @@ static cdch_interface_t* make_new_itf(uint8_t daddr, tusb_desc_interface_t const
 static bool open_ep_stream_pair(cdch_interface_t* p_cdc , tusb_desc_endpoint_t const *desc_ep);
 static void set_config_complete(cdch_interface_t * p_cdc, uint8_t idx, uint8_t itf_num);
 static void cdch_internal_control_complete(tuh_xfer_t* xfer);
+static void serial_state_report(void* param);
 
 //--------------------------------------------------------------------+
 // APPLICATION API
@@ -274,6 +377,14 @@ bool tuh_cdc_get_rts(uint8_t idx)
   return (p_cdc->line_state & CDC_CONTROL_LINE_STATE_RTS) ? true : false;
 }
 
+uint16_t tuh_cdc_get_serial_state(uint8_t idx)
+{
+  cdch_interface_t* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc, 0);
+
+  return p_cdc->serial_state;
+}
+
 bool tuh_cdc_get_local_line_coding(uint8_t idx, cdc_line_coding_t* line_coding)
 {
   cdch_interface_t* p_cdc = get_itf(idx);
@@ -365,8 +476,7 @@ bool tuh_cdc_read_clear (uint8_t idx)
 // internal control complete to update state such as line state, encoding
 static void cdch_internal_control_complete(tuh_xfer_t* xfer)
 {
-  uint8_t const itf_num = (uint8_t) tu_le16toh(xfer->setup->wIndex);
-  uint8_t idx = tuh_cdc_itf_get_index(xfer->daddr, itf_num);
+  uint8_t idx = get_idx_by_control_xfer(xfer);
   cdch_interface_t* p_cdc = get_itf(idx);
   TU_ASSERT(p_cdc, );
 
@@ -398,7 +508,7 @@ static void cdch_internal_control_complete(tuh_xfer_t* xfer)
 
           case FTDI_SIO_SET_BAUD_RATE:
             // convert from divisor to baudrate is not supported
-            p_cdc->line_coding.bit_rate = _ftdi_requested_baud;
+            p_cdc->line_coding.bit_rate = p_cdc->requested_baud;
             break;
 
           default: break;
@@ -423,6 +533,53 @@ static void cdch_internal_control_complete(tuh_xfer_t* xfer)
         break;
       #endif
 
+      #if CFG_TUH_CDC_CH34X
+      case SERIAL_DRIVER_CH34X:
+        switch (xfer->setup->bRequest) {
+          case CH34X_REQ_MODEM_CTRL: {
+            uint8_t const bits = (uint8_t) ~tu_le16toh(xfer->setup->wValue);
+            p_cdc->line_state = (uint8_t) (((bits & CH34X_BIT_DTR) ? CDC_CONTROL_LINE_STATE_DTR : 0) |
+                                           ((bits & CH34X_BIT_RTS) ? CDC_CONTROL_LINE_STATE_RTS : 0));
+          }
+            break;
+
+          case CH34X_REQ_WRITE_REG:
+            switch (tu_le16toh(xfer->setup->wValue)) {
+              case (CH34X_REG_DIVISOR << 8 | CH34X_REG_PRESCALER):
+                p_cdc->line_coding.bit_rate = p_cdc->requested_baud;
+                break;
+
+              case (CH34X_REG_LCR2 << 8 | CH34X_REG_LCR):
+                ch34x_lcr_to_line_coding((uint8_t) tu_le16toh(xfer->setup->wIndex), &p_cdc->line_coding);
+                break;
+
+              default: break;
+            }
+            break;
+
+          default: break;
+        }
+        break;
+      #endif
+
+      #if CFG_TUH_CDC_PL2303
+      case SERIAL_DRIVER_PL2303:
+        switch (xfer->setup->bRequest) {
+          case PL2303_SET_CONTROL_REQUEST:
+            p_cdc->line_state = (uint8_t) tu_le16toh(xfer->setup->wValue);
+            break;
+
+          case PL2303_SET_LINE_REQUEST:
+            // baudrate may be written as divisor
+            memcpy(&p_cdc->line_coding, xfer->buffer, sizeof(cdc_line_coding_t));
+            p_cdc->line_coding.bit_rate = p_cdc->requested_baud;
+            break;
+
+          default: break;
+        }
+        break;
+      #endif
+
       default: break;
     }
   }
@@ -519,13 +676,14 @@ void cdch_init(void)
   {
     cdch_interface_t* p_cdc = &cdch_data[i];
 
+    // endpoint buffers are set when interface is opened
     tu_edpt_stream_init(&p_cdc->stream.tx, true, true, false,
                           p_cdc->stream.tx_ff_buf, CFG_TUH_CDC_TX_BUFSIZE,
-                          p_cdc->stream.tx_ep_buf, CFG_TUH_CDC_TX_EPSIZE);
+                          NULL, CFG_TUH_CDC_TX_EPSIZE);
 
     tu_edpt_stream_init(&p_cdc->stream.rx, true, false, false,
                           p_cdc->stream.rx_ff_buf, CFG_TUH_CDC_RX_BUFSIZE,
-                          p_cdc->stream.rx_ep_buf, CFG_TUH_CDC_RX_EPSIZE);
+                          NULL, CFG_TUH_CDC_RX_EPSIZE);
   }
 }
 
@@ -541,6 +699,14 @@ void cdch_close(uint8_t daddr)
       // Invoke application callback
       if (tuh_cdc_umount_cb) tuh_cdc_umount_cb(idx);
 
+      // Drop serial state report which is still scheduled
+      if (p_cdc->serial_state_pending)
+      {
+        usbh_defer_func_cancel(serial_state_report, (void*) (uintptr_t) ((daddr << 8) | idx));
+        p_cdc->serial_state_pending = false;
+        p_cdc->serial_state_changed = 0;
+      }
+
       //tu_memclr(p_cdc, sizeof(cdch_interface_t));
       p_cdc->daddr = 0;
       p_cdc->bInterfaceNumber = 0;
@@ -550,14 +716,196 @@ void cdch_close(uint8_t daddr)
   }
 }
 
-bool cdch_xfer_cb(uint8_t daddr, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes) {
-  // TODO handle stall response, retry failed transfer ...
-  TU_ASSERT(event == XFER_RESULT_SUCCESS);
+//--------------------------------------------------------------------+
+// Serial State
+//--------------------------------------------------------------------+
+
+enum {
+  // signal levels, other bits are errors which are latched
+  SERIAL_STATE_LEVELS = CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_DSR | CDC_SERIAL_STATE_RI | TUH_CDC_SERIAL_STATE_CTS
+};
+
+// Report coalesced changes to application, param is device address (high byte) and index (low byte)
+static void serial_state_report(void* param)
+{
+  uint8_t const daddr = (uint8_t) (((uintptr_t) param) >> 8);
+  uint8_t const idx   = (uint8_t) ((uintptr_t) param);
+
+  cdch_interface_t* p_cdc = get_itf(idx);
+  TU_VERIFY(p_cdc && p_cdc->daddr == daddr, );
+
+  uint16_t const state   = p_cdc->serial_state;
+  uint16_t const changed = p_cdc->serial_state_changed;
+
+  p_cdc->serial_state_pending = false;
+  p_cdc->serial_state_changed = 0;
+  p_cdc->serial_state        &= SERIAL_STATE_LEVELS;
+
+  if ( changed && tuh_cdc_serial_state_cb ) tuh_cdc_serial_state_cb(idx, state, changed);
+}
+
+static void serial_state_update(cdch_interface_t* p_cdc, uint8_t idx, uint16_t state)
+{
+  uint16_t const errors  = state & (uint16_t) ~SERIAL_STATE_LEVELS;
+  uint16_t const changed = (uint16_t) (((state ^ p_cdc->serial_state) & SERIAL_STATE_LEVELS) | errors);
+
+  if ( !changed ) return;
+
+  p_cdc->serial_state          = (uint16_t) ((state & SERIAL_STATE_LEVELS) | (p_cdc->serial_state & ~SERIAL_STATE_LEVELS) | errors);
+  p_cdc->serial_state_changed |= changed;
+
+  if ( !p_cdc->serial_state_pending )
+  {
+    void* param = (void*) (uintptr_t) ((p_cdc->daddr << 8) | idx);
+
+    p_cdc->serial_state_pending = true;
+    if ( !usbh_defer_func_ms(serial_state_report, param, CFG_TUH_CDC_SERIAL_STATE_INTERVAL_MS) )
+    {
+      serial_state_report(param);
+    }
+  }
+}
+
+static bool notif_xfer(cdch_interface_t* p_cdc)
+{
+  TU_VERIFY(p_cdc->ep_notif);
+  TU_VERIFY(usbh_edpt_claim(p_cdc->daddr, p_cdc->ep_notif));
+
+  if ( !usbh_edpt_xfer(p_cdc->daddr, p_cdc->ep_notif, p_cdc->notif_buf, sizeof(p_cdc->notif_buf)) )
+  {
+    usbh_edpt_release(p_cdc->daddr, p_cdc->ep_notif);
+    return false;
+  }
+
+  return true;
+}
+
+static void notif_received(cdch_interface_t* p_cdc, uint8_t idx, uint32_t xferred_bytes)
+{
+  uint8_t const* buf = p_cdc->notif_buf;
+
+  switch (p_cdc->serial_drid) {
+    #if CFG_TUH_CDC_CH34X
+    case SERIAL_DRIVER_CH34X:
+      if ( xferred_bytes > CH34X_STATUS_INDEX )
+      {
+        uint8_t const status = (uint8_t) ~buf[CH34X_STATUS_INDEX];
+        uint16_t state = 0;
+
+        if ( status & CH34X_BIT_DCD ) state |= CDC_SERIAL_STATE_DCD;
+        if ( status & CH34X_BIT_DSR ) state |= CDC_SERIAL_STATE_DSR;
+        if ( status & CH34X_BIT_RI  ) state |= CDC_SERIAL_STATE_RI;
+        if ( status & CH34X_BIT_CTS ) state |= TUH_CDC_SERIAL_STATE_CTS;
+
+        serial_state_update(p_cdc, idx, state);
+      }
+      break;
+    #endif
+
+    #if CFG_TUH_CDC_PL2303
+    case SERIAL_DRIVER_PL2303:
+      // SerialState alike notification, with CTS in bit 7
+      if ( xferred_bytes > PL2303_UART_STATE_INDEX )
+      {
+        uint8_t const status = buf[PL2303_UART_STATE_INDEX];
+        uint16_t state = status & 0x7Fu;
+
+        if ( status & PL2303_UART_CTS ) state |= TUH_CDC_SERIAL_STATE_CTS;
+
+        serial_state_update(p_cdc, idx, state);
+      }
+      break;
+    #endif
+
+    default: {
+      tusb_control_request_t const* notif = (tusb_control_request_t const*) buf;
+
+      if ( xferred_bytes >= sizeof(tusb_control_request_t) + 2 && notif->bRequest == CDC_NOTIF_SERIAL_STATE )
+      {
+        uint16_t const state = tu_unaligned_read16(buf + sizeof(tusb_control_request_t));
+        serial_state_update(p_cdc, idx, tu_le16toh(state) & 0x7Fu);
+      }
+    }
+      break;
+  }
+}
+
+#if CFG_TUH_CDC_FTDI
+// Modem status (byte 0) and line status (byte 1) preceding data of FTDI
+static void ftdi_status_received(cdch_interface_t* p_cdc, uint8_t idx, uint8_t const status[2])
+{
+  uint16_t state = 0;
+
+  if ( status[0] & FTDI_RS0_RLSD ) state |= CDC_SERIAL_STATE_DCD;
+  if ( status[0] & FTDI_RS0_DSR  ) state |= CDC_SERIAL_STATE_DSR;
+  if ( status[0] & FTDI_RS0_RI   ) state |= CDC_SERIAL_STATE_RI;
+  if ( status[0] & FTDI_RS0_CTS  ) state |= TUH_CDC_SERIAL_STATE_CTS;
+
+  if ( status[1] & FTDI_RS_OE ) state |= CDC_SERIAL_STATE_OVERRUN;
+  if ( status[1] & FTDI_RS_PE ) state |= CDC_SERIAL_STATE_PARITY;
+  if ( status[1] & FTDI_RS_FE ) state |= CDC_SERIAL_STATE_FRAMING;
+  if ( status[1] & FTDI_RS_BI ) state |= CDC_SERIAL_STATE_BREAK;
+
+  serial_state_update(p_cdc, idx, state);
+}
+#endif
+
+// Resume stream once halt of its endpoint is cleared (data toggle is reset by usbh)
+static void cdch_clear_halt_complete(tuh_xfer_t* xfer) {
+  uint8_t const ep_addr = (uint8_t) tu_le16toh(xfer->setup->wIndex);
+  cdch_interface_t * p_cdc = get_itf((uint8_t) xfer->user_data);
+
+  TU_VERIFY(p_cdc && p_cdc->daddr == xfer->daddr, );
+  TU_VERIFY(xfer->result == XFER_RESULT_SUCCESS, );
+
+  if ( ep_addr == p_cdc->stream.tx.ep_addr ) {
+    tu_edpt_stream_write_xfer(&p_cdc->stream.tx);
+  }else if ( ep_addr == p_cdc->stream.rx.ep_addr ) {
+    tu_edpt_stream_read_xfer(&p_cdc->stream.rx);
+  }else if ( ep_addr == p_cdc->ep_notif ) {
+    notif_xfer(p_cdc);
+  }
+}
+
+static bool cdch_clear_halt(cdch_interface_t* p_cdc, uint8_t idx, uint8_t ep_addr) {
+  TU_LOG_DRV("CDCh clear halt EP %02X\r\n", ep_addr);
+
+  tusb_control_request_t const request = {
+    .bmRequestType_bit = {
+      .recipient = TUSB_REQ_RCPT_ENDPOINT,
+      .type      = TUSB_REQ_TYPE_STANDARD,
+      .direction = TUSB_DIR_OUT
+    },
+    .bRequest = TUSB_REQ_CLEAR_FEATURE,
+    .wValue   = tu_htole16(TUSB_REQ_FEATURE_EDPT_HALT),
+    .wIndex   = tu_htole16(ep_addr),
+    .wLength  = 0
+  };
+
+  tuh_xfer_t xfer = {
+    .daddr       = p_cdc->daddr,
+    .ep_addr     = 0,
+    .setup       = &request,
+    .buffer      = NULL,
+    .complete_cb = cdch_clear_halt_complete,
+    .user_data   = idx
+  };
+
+  return tuh_control_xfer(&xfer);
+}
 
+bool cdch_xfer_cb(uint8_t daddr, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes) {
   uint8_t const idx = get_idx_by_ep_addr(daddr, ep_addr);
   cdch_interface_t * p_cdc = get_itf(idx);
   TU_ASSERT(p_cdc);
 
+  // Stall, transaction error or timeout: data of the failed transfer is dropped, stream is resumed once the halt is
+  // cleared. Controller (e.g EHCI) leaves the endpoint halted on transaction error as well.
+  if ( event != XFER_RESULT_SUCCESS ) {
+    TU_LOG_DRV("CDCh EP %02X %s\r\n", ep_addr, tu_str_xfer_result[event]);
+    return cdch_clear_halt(p_cdc, idx, ep_addr);
+  }
+
   if ( ep_addr == p_cdc->stream.tx.ep_addr ) {
     // invoke tx complete callback to possibly refill tx fifo
     if (tuh_cdc_tx_complete_cb) tuh_cdc_tx_complete_cb(idx);
@@ -571,12 +919,8 @@ bool cdch_xfer_cb(uint8_t daddr, uint8_t ep_addr, xfer_result_t event, uint32_t
   else if ( ep_addr == p_cdc->stream.rx.ep_addr ) {
     #if CFG_TUH_CDC_FTDI
     if (p_cdc->serial_drid == SERIAL_DRIVER_FTDI) {
-      // FTDI reserve 2 bytes for status
-      // FTDI status
-//      uint8_t status[2] = {
-//        p_cdc->stream.rx.ep_buf[0],
-//        p_cdc->stream.rx.ep_buf[1]
-//      };
+      // FTDI reserve 2 bytes for status, must be read before buffer is swapped (double buffered)
+      if ( xferred_bytes >= 2 ) ftdi_status_received(p_cdc, idx, p_cdc->stream.rx.ep_buf);
       tu_edpt_stream_read_xfer_complete_offset(&p_cdc->stream.rx, xferred_bytes, 2);
     }else
     #endif
@@ -590,7 +934,8 @@ bool cdch_xfer_cb(uint8_t daddr, uint8_t ep_addr, xfer_result_t event, uint32_t
     // prepare for next transfer if needed
     tu_edpt_stream_read_xfer(&p_cdc->stream.rx);
   }else if ( ep_addr == p_cdc->ep_notif ) {
-    // TODO handle notification endpoint
+    notif_received(p_cdc, idx, xferred_bytes);
+    notif_xfer(p_cdc);
   }else {
     TU_ASSERT(false);
   }
@@ -627,6 +972,36 @@ static bool open_ep_stream_pair(cdch_interface_t* p_cdc, tusb_desc_endpoint_t co
   return true;
 }
 
+// Vendor serial interface: bulk endpoints are data streams, interrupt IN is modem status (if any)
+static bool open_ep_serial(cdch_interface_t* p_cdc, tusb_desc_interface_t const *itf_desc, uint16_t max_len)
+{
+  TU_VERIFY(sizeof(tusb_desc_interface_t) + itf_desc->bNumEndpoints*sizeof(tusb_desc_endpoint_t) <= max_len);
+  tusb_desc_endpoint_t const * desc_ep = (tusb_desc_endpoint_t const *) tu_desc_next(itf_desc);
+
+  for(uint8_t i=0; i<itf_desc->bNumEndpoints; i++)
+  {
+    TU_ASSERT(TUSB_DESC_ENDPOINT == desc_ep->bDescriptorType);
+    TU_ASSERT(tuh_edpt_open(p_cdc->daddr, desc_ep));
+
+    uint8_t const ep_addr = desc_ep->bEndpointAddress;
+
+    if ( TUSB_XFER_INTERRUPT == desc_ep->bmAttributes.xfer )
+    {
+      if ( tu_edpt_dir(ep_addr) == TUSB_DIR_IN ) p_cdc->ep_notif = ep_addr;
+    }else if ( tu_edpt_dir(ep_addr) == TUSB_DIR_IN )
+    {
+      tu_edpt_stream_open(&p_cdc->stream.rx, p_cdc->daddr, desc_ep);
+    }else
+    {
+      tu_edpt_stream_open(&p_cdc->stream.tx, p_cdc->daddr, desc_ep);
+    }
+
+    desc_ep = (tusb_desc_endpoint_t const*) tu_desc_next(desc_ep);
+  }
+
+  return true;
+}
+
 bool cdch_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len)
 {
   (void) rhport;
@@ -638,7 +1013,7 @@ bool cdch_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_d
   {
     return acm_open(daddr, itf_desc, max_len);
   }
-  #if CFG_TUH_CDC_FTDI || CFG_TUH_CDC_CP210X
+  #if CFG_TUH_CDC_FTDI || CFG_TUH_CDC_CP210X || CFG_TUH_CDC_CH34X || CFG_TUH_CDC_PL2303
   else if ( 0xff == itf_desc->bInterfaceClass )
   {
     uint16_t vid, pid;
@@ -663,6 +1038,26 @@ bool cdch_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_d
       }
     }
     #endif
+
+    #if CFG_TUH_CDC_CH34X
+    if (TU_CH34X_VID == vid) {
+      for (size_t i = 0; i < CH34X_PID_COUNT; i++) {
+        if (ch34x_pids[i] == pid) {
+          return ch34x_open(daddr, itf_desc, max_len);
+        }
+      }
+    }
+    #endif
+
+    #if CFG_TUH_CDC_PL2303
+    if (TU_PL2303_VID == vid) {
+      for (size_t i = 0; i < PL2303_PID_COUNT; i++) {
+        if (pl2303_pids[i] == pid) {
+          return pl2303_open(daddr, itf_desc, max_len);
+        }
+      }
+    }
+    #endif
   }
   #endif
 
@@ -672,8 +1067,9 @@ bool cdch_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *itf_d
 static void set_config_complete(cdch_interface_t * p_cdc, uint8_t idx, uint8_t itf_num) {
   if (tuh_cdc_mount_cb) tuh_cdc_mount_cb(idx);
 
-  // Prepare for incoming data
+  // Prepare for incoming data and notification
   tu_edpt_stream_read_xfer(&p_cdc->stream.rx);
+  if ( p_cdc->ep_notif ) notif_xfer(p_cdc);
 
   // notify usbh that driver enumeration is complete
   usbh_driver_set_config_complete(p_cdc->daddr, itf_num);
@@ -683,6 +1079,8 @@ static void set_config_complete(cdch_interface_t * p_cdc, uint8_t idx, uint8_t i
 bool cdch_set_config(uint8_t daddr, uint8_t itf_num)
 {
   tusb_control_request_t request;
+  request.bmRequestType = 0;
+  request.bmRequestType_bit.recipient = TUSB_REQ_RCPT_INTERFACE;
   request.wIndex = tu_htole16((uint16_t) itf_num);
 
   // fake transfer to kick-off process
@@ -848,7 +1246,7 @@ static bool acm_set_line_coding(cdch_interface_t* p_cdc, cdc_line_coding_t const
   };
 
   // use usbh enum buf to hold line coding since user line_coding variable does not live long enough
-  uint8_t* enum_buf = usbh_get_enum_buf();
+  uint8_t* enum_buf = usbh_get_enum_buf(p_cdc->daddr);
   memcpy(enum_buf, line_coding, sizeof(cdc_line_coding_t));
 
   p_cdc->user_control_cb = complete_cb;
@@ -976,7 +1374,7 @@ static bool ftdi_sio_set_baudrate(cdch_interface_t* p_cdc, uint32_t baudrate, tu
   TU_LOG_DRV("CDC FTDI Set BaudRate = %lu, divisor = 0x%04x\n", baudrate, divisor);
 
   p_cdc->user_control_cb = complete_cb;
-  _ftdi_requested_baud = baudrate;
+  p_cdc->requested_baud = baudrate;
   TU_ASSERT(ftdi_sio_set_request(p_cdc, FTDI_SIO_SET_BAUD_RATE, divisor,
                                  complete_cb ? cdch_internal_control_complete : NULL, user_data));
 
@@ -1087,7 +1485,7 @@ static bool cp210x_set_request(cdch_interface_t* p_cdc, uint8_t command, uint16_
   uint8_t* enum_buf = NULL;
 
   if (buffer && length > 0) {
-    enum_buf = usbh_get_enum_buf();
+    enum_buf = usbh_get_enum_buf(p_cdc->daddr);
     tu_memcpy_s(enum_buf, CFG_TUH_ENUMERATION_BUFSIZE, buffer, length);
   }
 
@@ -1173,4 +1571,416 @@ static void cp210x_process_config(tuh_xfer_t* xfer) {
 
 #endif
 
+//--------------------------------------------------------------------+
+// CH34x
+//--------------------------------------------------------------------+
+
+#if CFG_TUH_CDC_CH34X
+
+enum {
+  CONFIG_CH34X_READ_VERSION = 0,
+  CONFIG_CH34X_SERIAL_INIT,
+  CONFIG_CH34X_SET_BAUDRATE,
+  CONFIG_CH34X_SET_LCR,
+  CONFIG_CH34X_MODEM_CTRL,
+  CONFIG_CH34X_COMPLETE
+};
+
+enum {
+  CH34X_DEFAULT_BAUD = 9600,
+  CH34X_MIN_BAUD     = CH34X_CLKRATE / (CH34X_CLK_DIV(0, 1) * 512),
+  CH34X_MAX_BAUD     = CH34X_CLKRATE / (CH34X_CLK_DIV(3, 0) * 2),
+};
+
+static bool ch34x_open(uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len) {
+  // CH34x Interface includes 1 vendor interface + 2 bulk + 1 interrupt endpoints
+  TU_VERIFY(itf_desc->bNumEndpoints == 3);
+
+  cdch_interface_t * p_cdc = make_new_itf(daddr, itf_desc);
+  TU_VERIFY(p_cdc);
+
+  TU_LOG_DRV("CH34x opened\r\n");
+  p_cdc->serial_drid = SERIAL_DRIVER_CH34X;
+
+  return open_ep_serial(p_cdc, itf_desc, max_len);
+}
+
+// data stage (if any) of IN request is received into usbh enum buf
+static bool ch34x_request(cdch_interface_t* p_cdc, tusb_dir_t direction, uint8_t command, uint16_t value, uint16_t index,
+                          uint16_t length, tuh_xfer_cb_t complete_cb, uintptr_t user_data) {
+  tusb_control_request_t const request = {
+    .bmRequestType_bit = {
+      .recipient = TUSB_REQ_RCPT_DEVICE,
+      .type      = TUSB_REQ_TYPE_VENDOR,
+      .direction = direction
+    },
+    .bRequest = command,
+    .wValue   = tu_htole16(value),
+    .wIndex   = tu_htole16(index),
+    .wLength  = tu_htole16(length)
+  };
+
+  tuh_xfer_t xfer = {
+    .daddr       = p_cdc->daddr,
+    .ep_addr     = 0,
+    .setup       = &request,
+    .buffer      = length ? usbh_get_enum_buf(p_cdc->daddr) : NULL,
+    .complete_cb = complete_cb,
+    .user_data   = user_data
+  };
+
+  return tuh_control_xfer(&xfer);
+}
+
+static bool ch34x_write_reg(cdch_interface_t* p_cdc, uint16_t reg, uint16_t value, tuh_xfer_cb_t complete_cb, uintptr_t user_data) {
+  return ch34x_request(p_cdc, TUSB_DIR_OUT, CH34X_REQ_WRITE_REG, reg, value, 0, complete_cb, user_data);
+}
+
+// Divisor (high byte) and prescaler (low byte) register values of the closest supported baudrate
+static uint16_t ch34x_baud_to_divisor(uint32_t baud) {
+  baud = tu_max32(CH34X_MIN_BAUD, tu_min32(baud, CH34X_MAX_BAUD));
+
+  // highest base clock (fact = 1) that gives a divisor less than 512
+  uint8_t ps;
+  for (ps = 3; ps > 0; ps--) {
+    if (baud > CH34X_CLKRATE / (CH34X_CLK_DIV(ps, 1) * 512)) break;
+  }
+
+  uint8_t fact = 1;
+  uint32_t clk_div = CH34X_CLK_DIV(ps, fact);
+  uint32_t div = CH34X_CLKRATE / (clk_div * baud);
+
+  // halve base clock if divisor is out of range
+  if (div < 9 || div > 255) {
+    div /= 2;
+    clk_div *= 2;
+    fact = 0;
+  }
+
+  // round to the closest rate, scaled up to avoid rounding errors on low rates
+  if (16 * CH34X_CLKRATE / (clk_div * div) - 16 * baud >= 16 * baud - 16 * CH34X_CLKRATE / (clk_div * (div + 1))) {
+    div++;
+  }
+
+  // prefer lower base clock if divisor is even, receiver is more tolerant to errors
+  if (fact == 1 && (div % 2) == 0) {
+    div /= 2;
+    fact = 0;
+  }
+
+  return (uint16_t) (((0x100 - div) << 8) | ((uint32_t) fact << 2) | ps);
+}
+
+static uint8_t ch34x_line_coding_to_lcr(cdc_line_coding_t const* line_coding) {
+  uint8_t lcr = CH34X_LCR_ENABLE_RX | CH34X_LCR_ENABLE_TX;
+
+  uint8_t const data_bits = (line_coding->data_bits >= 5 && line_coding->data_bits <= 8) ? line_coding->data_bits : 8;
+  lcr |= (uint8_t) (data_bits - 5); // CH34X_LCR_CS5 to CH34X_LCR_CS8
+
+  switch (line_coding->parity) {
+    case CDC_LINE_CODING_PARITY_ODD:   lcr |= CH34X_LCR_ENABLE_PAR; break;
+    case CDC_LINE_CODING_PARITY_EVEN:  lcr |= CH34X_LCR_ENABLE_PAR | CH34X_LCR_PAR_EVEN; break;
+    case CDC_LINE_CODING_PARITY_MARK:  lcr |= CH34X_LCR_ENABLE_PAR | CH34X_LCR_MARK_SPACE; break;
+    case CDC_LINE_CODING_PARITY_SPACE: lcr |= CH34X_LCR_ENABLE_PAR | CH34X_LCR_MARK_SPACE | CH34X_LCR_PAR_EVEN; break;
+    default: break;
+  }
+
+  // 1.5 stop bits is not supported
+  if (line_coding->stop_bits != CDC_LINE_CONDING_STOP_BITS_1) lcr |= CH34X_LCR_STOP_BITS_2;
+
+  return lcr;
+}
+
+static void ch34x_lcr_to_line_coding(uint8_t lcr, cdc_line_coding_t* line_coding) {
+  line_coding->data_bits = (uint8_t) (5 + (lcr & CH34X_LCR_CS8));
+  line_coding->stop_bits = (lcr & CH34X_LCR_STOP_BITS_2) ? CDC_LINE_CONDING_STOP_BITS_2 : CDC_LINE_CONDING_STOP_BITS_1;
+
+  if ( !(lcr & CH34X_LCR_ENABLE_PAR) ) {
+    line_coding->parity = CDC_LINE_CODING_PARITY_NONE;
+  } else if (lcr & CH34X_LCR_MARK_SPACE) {
+    line_coding->parity = (lcr & CH34X_LCR_PAR_EVEN) ? CDC_LINE_CODING_PARITY_SPACE : CDC_LINE_CODING_PARITY_MARK;
+  } else {
+    line_coding->parity = (lcr & CH34X_LCR_PAR_EVEN) ? CDC_LINE_CODING_PARITY_EVEN : CDC_LINE_CODING_PARITY_ODD;
+  }
+}
+
+static bool ch34x_set_baudrate(cdch_interface_t* p_cdc, uint32_t baudrate, tuh_xfer_cb_t complete_cb, uintptr_t user_data) {
+  uint16_t value = ch34x_baud_to_divisor(baudrate);
+  TU_LOG_DRV("CDC CH34x Set BaudRate = %lu, divisor = 0x%04x\n", baudrate, value);
+
+  // Without this bit, received data is only sent once a full packet is buffered. Bit is inverted on version 0x27
+  // and earlier.
+  if (p_cdc->serial_rev > 0x27) value |= CH34X_PRESCALER_NO_BUFFER;
+
+  p_cdc->user_control_cb = complete_cb;
+  p_cdc->requested_baud = baudrate;
+  return ch34x_write_reg(p_cdc, CH34X_REG_DIVISOR << 8 | CH34X_REG_PRESCALER, value,
+                         complete_cb ? cdch_internal_control_complete : NULL, user_data);
+}
+
+static bool ch34x_set_lcr(cdch_interface_t* p_cdc, uint8_t lcr, tuh_xfer_cb_t complete_cb, uintptr_t user_data) {
+  p_cdc->user_control_cb = complete_cb;
+  return ch34x_write_reg(p_cdc, CH34X_REG_LCR2 << 8 | CH34X_REG_LCR, lcr,
+                         complete_cb ? cdch_internal_control_complete : NULL, user_data);
+}
+
+static bool ch34x_set_modem_ctrl(cdch_interface_t* p_cdc, uint16_t line_state, tuh_xfer_cb_t complete_cb, uintptr_t user_data) {
+  TU_LOG_DRV("CDC CH34x Set Control Line State\r\n");
+
+  uint8_t bits = 0;
+  if (line_state & CDC_CONTROL_LINE_STATE_DTR) bits |= CH34X_BIT_DTR;
+  if (line_state & CDC_CONTROL_LINE_STATE_RTS) bits |= CH34X_BIT_RTS;
+
+  p_cdc->user_control_cb = complete_cb;
+  return ch34x_request(p_cdc, TUSB_DIR_OUT, CH34X_REQ_MODEM_CTRL, (uint16_t) ~bits, 0, 0,
+                       complete_cb ? cdch_internal_control_complete : NULL, user_data);
+}
+
+static void ch34x_process_config(tuh_xfer_t* xfer) {
+  uintptr_t const state = xfer->user_data;
+  uint8_t const   idx   = get_idx_by_control_xfer(xfer);
+  cdch_interface_t *p_cdc = get_itf(idx);
+  TU_ASSERT(p_cdc,);
+
+  switch (state) {
+    case CONFIG_CH34X_READ_VERSION:
+      TU_ASSERT(ch34x_request(p_cdc, TUSB_DIR_IN, CH34X_REQ_READ_VERSION, 0, 0, 2, ch34x_process_config,
+                              CONFIG_CH34X_SERIAL_INIT),);
+      break;
+
+    case CONFIG_CH34X_SERIAL_INIT:
+      if (xfer->result == XFER_RESULT_SUCCESS && xfer->actual_len > 0) p_cdc->serial_rev = xfer->buffer[0];
+      TU_LOG_DRV("CH34x version = 0x%02x\r\n", p_cdc->serial_rev);
+
+      TU_ASSERT(ch34x_request(p_cdc, TUSB_DIR_OUT, CH34X_REQ_SERIAL_INIT, 0, 0, 0, ch34x_process_config,
+                              CONFIG_CH34X_SET_BAUDRATE),);
+      break;
+
+    case CONFIG_CH34X_SET_BAUDRATE: {
+      // always set since prescaler register also controls buffering of received data
+      #ifdef CFG_TUH_CDC_LINE_CODING_ON_ENUM
+      cdc_line_coding_t line_coding = CFG_TUH_CDC_LINE_CODING_ON_ENUM;
+      uint32_t const baudrate = line_coding.bit_rate;
+      #else
+      uint32_t const baudrate = CH34X_DEFAULT_BAUD;
+      #endif
+      TU_ASSERT(ch34x_set_baudrate(p_cdc, baudrate, ch34x_process_config, CONFIG_CH34X_SET_LCR),);
+      break;
+    }
+
+    case CONFIG_CH34X_SET_LCR:
+      // line control register is only available on version 0x30 and later
+      if (p_cdc->serial_rev >= 0x30) {
+        #ifdef CFG_TUH_CDC_LINE_CODING_ON_ENUM
+        cdc_line_coding_t line_coding = CFG_TUH_CDC_LINE_CODING_ON_ENUM;
+        #else
+        cdc_line_coding_t line_coding = { 0, CDC_LINE_CONDING_STOP_BITS_1, CDC_LINE_CODING_PARITY_NONE, 8 };
+        #endif
+        TU_ASSERT(ch34x_set_lcr(p_cdc, ch34x_line_coding_to_lcr(&line_coding), ch34x_process_config,
+                                CONFIG_CH34X_MODEM_CTRL),);
+        break;
+      }
+      TU_ATTR_FALLTHROUGH;
+
+    case CONFIG_CH34X_MODEM_CTRL:
+      #if CFG_TUH_CDC_LINE_CONTROL_ON_ENUM
+      TU_ASSERT(
+        ch34x_set_modem_ctrl(p_cdc, CFG_TUH_CDC_LINE_CONTROL_ON_ENUM, ch34x_process_config, CONFIG_CH34X_COMPLETE),);
+      break;
+      #else
+      TU_ATTR_FALLTHROUGH;
+      #endif
+
+    case CONFIG_CH34X_COMPLETE:
+      set_config_complete(p_cdc, idx, p_cdc->bInterfaceNumber);
+      break;
+
+    default: break;
+  }
+}
+
+#endif
+
+//--------------------------------------------------------------------+
+// PL2303
+//--------------------------------------------------------------------+
+
+#if CFG_TUH_CDC_PL2303
+
+enum {
+  PL2303_TYPE_HX = 0,
+  PL2303_TYPE_LEGACY // H, detected by device class or control endpoint size
+};
+
+// Vendor register initialization as done by vendor driver, reads are dummy. Value of register 2 depends on type.
+// Upstream data pipes are reset last.
+static const struct {
+  uint8_t  read;
+  uint16_t reg;
+  uint16_t value;
+} pl2303_init_seq[] = {
+  { 1, 0x8484, 0 }, { 0, 0x0404, 0 }, { 1, 0x8484, 0 }, { 1, 0x8383, 0 }, { 1, 0x8484, 0 },
+  { 0, 0x0404, 1 }, { 1, 0x8484, 0 }, { 1, 0x8383, 0 }, { 0, 0x0000, 1 }, { 0, 0x0001, 0 },
+  { 0, 0x0002, PL2303_REG2_HX },
+  { 0, 0x0008, 0 }, { 0, 0x0009, 0 }
+};
+
+enum {
+  PL2303_INIT_SEQ_COUNT = sizeof(pl2303_init_seq) / sizeof(pl2303_init_seq[0])
+};
+
+enum {
+  CONFIG_PL2303_DETECT_TYPE = 0,
+  CONFIG_PL2303_INIT, // one state per entry of pl2303_init_seq
+  CONFIG_PL2303_SET_BAUDRATE = CONFIG_PL2303_INIT + PL2303_INIT_SEQ_COUNT,
+  CONFIG_PL2303_SET_CONTROL,
+  CONFIG_PL2303_COMPLETE
+};
+
+static bool pl2303_open(uint8_t daddr, tusb_desc_interface_t const *itf_desc, uint16_t max_len) {
+  // PL2303 Interface includes 1 vendor interface + 1 interrupt + 2 bulk endpoints
+  TU_VERIFY(itf_desc->bNumEndpoints == 3);
+
+  cdch_interface_t * p_cdc = make_new_itf(daddr, itf_desc);
+  TU_VERIFY(p_cdc);
+
+  TU_LOG_DRV("PL2303 opened\r\n");
+  p_cdc->serial_drid = SERIAL_DRIVER_PL2303;
+
+  // line coding and control line state requests are the same as ACM
+  p_cdc->acm_capability.support_line_request = 1;
+
+  return open_ep_serial(p_cdc, itf_desc, max_len);
+}
+
+static bool pl2303_vendor_request(cdch_interface_t* p_cdc, uint8_t read, uint16_t reg, uint16_t value,
+                                  tuh_xfer_cb_t complete_cb, uintptr_t user_data) {
+  tusb_control_request_t const request = {
+    .bmRequestType_bit = {
+      .recipient = TUSB_REQ_RCPT_DEVICE,
+      .type      = TUSB_REQ_TYPE_VENDOR,
+      .direction = read ? TUSB_DIR_IN : TUSB_DIR_OUT
+    },
+    .bRequest = read ? PL2303_VENDOR_READ_REQUEST : PL2303_VENDOR_WRITE_REQUEST,
+    .wValue   = tu_htole16(reg),
+    .wIndex   = tu_htole16(value),
+    .wLength  = tu_htole16(read ? 1 : 0)
+  };
+
+  tuh_xfer_t xfer = {
+    .daddr       = p_cdc->daddr,
+    .ep_addr     = 0,
+    .setup       = &request,
+    .buffer      = read ? usbh_get_enum_buf(p_cdc->daddr) : NULL,
+    .complete_cb = complete_cb,
+    .user_data   = user_data
+  };
+
+  return tuh_control_xfer(&xfer);
+}
+
+// Encode baudrate for dwDTERate: standard rates are written directly, others as divisor
+static uint32_t pl2303_encode_baud(uint32_t baud, uint8_t type) {
+  static const uint32_t std_rates[] = {
+    75, 150, 300, 600, 1200, 1800, 2400, 3600, 4800, 7200, 9600, 14400, 19200, 28800, 38400, 57600, 115200,
+    230400, 460800, 614400, 921600, 1228800, 2457600, 3000000, 6000000
+  };
+
+  baud = tu_min32(baud, type == PL2303_TYPE_LEGACY ? PL2303_BAUD_MAX_LEGACY : PL2303_BAUD_MAX_HX);
+  if (baud == 0) baud = 1;
+
+  for (size_t i = 0; i < TU_ARRAY_SIZE(std_rates); i++) {
+    if (std_rates[i] == baud) return baud;
+  }
+
+  uint32_t mantissa = PL2303_BAUD_BASE / baud;
+  uint32_t exponent = 0;
+  if (mantissa == 0) mantissa = 1;
+
+  while (mantissa >= 512) {
+    if (exponent < 7) {
+      mantissa >>= 2;
+      exponent++;
+    } else {
+      mantissa = 511;
+      break;
+    }
+  }
+
+  return PL2303_BAUD_DIVISOR | (exponent << 9) | mantissa;
+}
+
+static bool pl2303_set_baudrate(cdch_interface_t* p_cdc, uint32_t baudrate, tuh_xfer_cb_t complete_cb, uintptr_t user_data) {
+  cdc_line_coding_t line_coding = p_cdc->line_coding;
+  if (line_coding.data_bits == 0) line_coding.data_bits = 8; // not configured yet
+
+  line_coding.bit_rate = pl2303_encode_baud(baudrate, p_cdc->serial_rev);
+  TU_LOG_DRV("CDC PL2303 Set BaudRate = %lu, encoded = 0x%08lx\n", baudrate, line_coding.bit_rate);
+
+  p_cdc->requested_baud = baudrate;
+  return acm_set_line_coding(p_cdc, &line_coding, complete_cb, user_data);
+}
+
+static bool pl2303_set_modem_ctrl(cdch_interface_t* p_cdc, uint16_t line_state, tuh_xfer_cb_t complete_cb, uintptr_t user_data) {
+  return acm_set_control_line_state(p_cdc, line_state, complete_cb, user_data);
+}
+
+static void pl2303_process_config(tuh_xfer_t* xfer) {
+  uintptr_t const state = xfer->user_data;
+  uint8_t const   idx   = get_idx_by_control_xfer(xfer);
+  cdch_interface_t *p_cdc = get_itf(idx);
+  TU_ASSERT(p_cdc,);
+
+  switch (state) {
+    case CONFIG_PL2303_DETECT_TYPE:
+      TU_ASSERT(tuh_descriptor_get_device(p_cdc->daddr, usbh_get_enum_buf(p_cdc->daddr), sizeof(tusb_desc_device_t),
+                                          pl2303_process_config, CONFIG_PL2303_INIT),);
+      break;
+
+    case CONFIG_PL2303_SET_BAUDRATE: {
+      #ifdef CFG_TUH_CDC_LINE_CODING_ON_ENUM
+      cdc_line_coding_t line_coding = CFG_TUH_CDC_LINE_CODING_ON_ENUM;
+      p_cdc->line_coding = line_coding;
+      TU_ASSERT(pl2303_set_baudrate(p_cdc, line_coding.bit_rate, pl2303_process_config, CONFIG_PL2303_SET_CONTROL),);
+      break;
+      #else
+      TU_ATTR_FALLTHROUGH;
+      #endif
+    }
+
+    case CONFIG_PL2303_SET_CONTROL:
+      #if CFG_TUH_CDC_LINE_CONTROL_ON_ENUM
+      TU_ASSERT(
+        pl2303_set_modem_ctrl(p_cdc, CFG_TUH_CDC_LINE_CONTROL_ON_ENUM, pl2303_process_config, CONFIG_PL2303_COMPLETE),);
+      break;
+      #else
+      TU_ATTR_FALLTHROUGH;
+      #endif
+
+    case CONFIG_PL2303_COMPLETE:
+      set_config_complete(p_cdc, idx, p_cdc->bInterfaceNumber);
+      break;
+
+    default:
+      if (state >= CONFIG_PL2303_INIT && state < CONFIG_PL2303_SET_BAUDRATE) {
+        if (state == CONFIG_PL2303_INIT && xfer->result == XFER_RESULT_SUCCESS) {
+          tusb_desc_device_t const* desc_dev = (tusb_desc_device_t const*) xfer->buffer;
+          p_cdc->serial_rev = (desc_dev->bDeviceClass == TUSB_CLASS_CDC || desc_dev->bMaxPacketSize0 != 64) ?
+                              PL2303_TYPE_LEGACY : PL2303_TYPE_HX;
+          TU_LOG_DRV("PL2303 type = %s\r\n", p_cdc->serial_rev == PL2303_TYPE_LEGACY ? "legacy" : "HX");
+        }
+
+        uint8_t const i = (uint8_t) (state - CONFIG_PL2303_INIT);
+        uint16_t value = pl2303_init_seq[i].value;
+        if (pl2303_init_seq[i].reg == 0x0002 && p_cdc->serial_rev == PL2303_TYPE_LEGACY) value = PL2303_REG2_LEGACY;
+
+        TU_ASSERT(pl2303_vendor_request(p_cdc, pl2303_init_seq[i].read, pl2303_init_seq[i].reg, value,
+                                        pl2303_process_config, state + 1),);
+      }
+      break;
+  }
+}
+
+#endif
+
 #endif
@@ -57,6 +57,18 @@
 #define CFG_TUH_CDC_RX_EPSIZE  USBH_EPSIZE_BULK_MAX
 #endif
 
+// Double buffered RX: a 2nd endpoint buffer (of CFG_TUH_CDC_RX_EPSIZE) is used so that the next IN transfer is
+// queued before received data is copied into fifo and consumed. Requires CFG_TUH_CDC_RX_BUFSIZE >= 2*CFG_TUH_CDC_RX_EPSIZE
+#ifndef CFG_TUH_CDC_RX_DOUBLE_BUFFER
+#define CFG_TUH_CDC_RX_DOUBLE_BUFFER 0
+#endif
+
+// Serial state changes (notification of ACM, status bytes of FTDI) occurring within this interval are coalesced
+// into one tuh_cdc_serial_state_cb()
+#ifndef CFG_TUH_CDC_SERIAL_STATE_INTERVAL_MS
+#define CFG_TUH_CDC_SERIAL_STATE_INTERVAL_MS 10
+#endif
+
 // TX FIFO size
 #ifndef CFG_TUH_CDC_TX_BUFSIZE
 #define CFG_TUH_CDC_TX_BUFSIZE USBH_EPSIZE_BULK_MAX
@@ -94,6 +106,17 @@ TU_ATTR_ALWAYS_INLINE static inline bool tuh_cdc_connected(uint8_t idx)
   return tuh_cdc_get_dtr(idx);
 }
 
+// Serial state bits in addition to CDC_SERIAL_STATE_* (not reported by CDC ACM)
+enum {
+  TUH_CDC_SERIAL_STATE_CTS = TU_BIT(8), ///< Clear To Send
+};
+
+// Get local (cached) serial state: DCD, DSR, RI, CTS and error bits (CDC_SERIAL_STATE_*) as reported by device with
+// SerialState notification (ACM) or status bytes of received data (FTDI). Error bits are latched until reported by
+// tuh_cdc_serial_state_cb().
+// NOTE: This function does not make any USB transfer request to device.
+uint16_t tuh_cdc_get_serial_state(uint8_t idx);
+
 // Get local (saved/cached) version of line coding.
 // This function should return correct values if tuh_cdc_set_line_coding() / tuh_cdc_get_line_coding()
 // are invoked previously or CFG_TUH_CDC_LINE_CODING_ON_ENUM is defined.
@@ -188,6 +211,10 @@ TU_ATTR_WEAK extern void tuh_cdc_rx_cb(uint8_t idx);
 // Invoked when a TX is complete and therefore space becomes available in TX buffer
 TU_ATTR_WEAK extern void tuh_cdc_tx_complete_cb(uint8_t idx);
 
+// Invoked when serial state changes, at most once per CFG_TUH_CDC_SERIAL_STATE_INTERVAL_MS.
+// changed: bits of state which changed since last invocation, error bits are set if error occurred in between
+TU_ATTR_WEAK extern void tuh_cdc_serial_state_cb(uint8_t idx, uint16_t state, uint16_t changed);
+
 //--------------------------------------------------------------------+
 // Internal Class Driver API
 //--------------------------------------------------------------------+
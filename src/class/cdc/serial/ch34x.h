@@ -0,0 +1,78 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (thach@tinyusb.org) for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef TUSB_CH34X_H
+#define TUSB_CH34X_H
+
+// There is no public protocol document, register usage follows the Linux ch341 driver
+
+#define TU_CH34X_VID 0x1A86
+#define TU_CH34X_PID_LIST \
+  0x7523, 0x7522, 0x5523, 0xE523
+
+/* Vendor request codes, Recipient is Device */
+#define CH34X_REQ_READ_VERSION   0x5F
+#define CH34X_REQ_READ_REG       0x95
+#define CH34X_REQ_WRITE_REG      0x9A // wValue = reg2 << 8 | reg1, wIndex = val2 << 8 | val1
+#define CH34X_REQ_SERIAL_INIT    0xA1
+#define CH34X_REQ_MODEM_CTRL     0xA4 // wValue = ~(DTR | RTS)
+
+/* Registers */
+#define CH34X_REG_BREAK          0x05
+#define CH34X_REG_PRESCALER      0x12
+#define CH34X_REG_DIVISOR        0x13
+#define CH34X_REG_LCR            0x18
+#define CH34X_REG_LCR2           0x25
+
+/* Prescaler register: bit 1:0 prescaler, bit 2 clock factor */
+#define CH34X_PRESCALER_NO_BUFFER 0x80 // send received data without waiting for a full packet
+
+/* Baudrate = CH34X_CLKRATE / (CH34X_CLK_DIV(prescaler, factor) * (256 - divisor register)) */
+#define CH34X_CLKRATE            48000000u
+#define CH34X_CLK_DIV(ps, fact)  (1u << (12 - 3 * (ps) - (fact)))
+
+/* Line control register */
+#define CH34X_LCR_ENABLE_RX      0x80
+#define CH34X_LCR_ENABLE_TX      0x40
+#define CH34X_LCR_MARK_SPACE     0x20
+#define CH34X_LCR_PAR_EVEN       0x10
+#define CH34X_LCR_ENABLE_PAR     0x08
+#define CH34X_LCR_STOP_BITS_2    0x04
+#define CH34X_LCR_CS8            0x03
+#define CH34X_LCR_CS7            0x02
+#define CH34X_LCR_CS6            0x01
+#define CH34X_LCR_CS5            0x00
+
+/* Modem control, written inverted */
+#define CH34X_BIT_DTR            0x20
+#define CH34X_BIT_RTS            0x40
+
+/* Modem status, byte 2 of interrupt packet (inverted) */
+#define CH34X_STATUS_INDEX       2
+#define CH34X_BIT_CTS            0x01
+#define CH34X_BIT_DSR            0x02
+#define CH34X_BIT_RI             0x04
+#define CH34X_BIT_DCD            0x08
+
+#endif //TUSB_CH34X_H
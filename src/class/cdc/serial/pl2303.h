@@ -0,0 +1,66 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (thach@tinyusb.org) for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef TUSB_PL2303_H
+#define TUSB_PL2303_H
+
+// Only the PL2303 H/HX/TA family is supported, the newer HXN (G series) uses a different register set
+
+#define TU_PL2303_VID 0x067B
+#define TU_PL2303_PID_LIST \
+  0x2303, 0x04BB
+
+/* Vendor request codes, Recipient is Device */
+#define PL2303_VENDOR_READ_REQUEST   0x01 // wValue = register, wLength = 1
+#define PL2303_VENDOR_WRITE_REQUEST  0x01 // wValue = register, wIndex = value
+
+/* Class request codes, same as CDC ACM */
+#define PL2303_SET_LINE_REQUEST      0x20
+#define PL2303_GET_LINE_REQUEST      0x21
+#define PL2303_SET_CONTROL_REQUEST   0x22
+#define PL2303_BREAK_REQUEST         0x23
+
+/* Value of vendor register 2 written during initialization */
+#define PL2303_REG2_LEGACY           0x24
+#define PL2303_REG2_HX               0x44
+
+/* Baudrate is either written directly to dwDTERate (standard rates only) or as a divisor:
+ * baudrate = PL2303_BAUD_BASE / (mantissa * 4^exponent), with mantissa = bit 8:0 and exponent = bit 11:9 */
+#define PL2303_BAUD_DIVISOR          0x80000000u
+#define PL2303_BAUD_BASE             (12000000u * 32)
+#define PL2303_BAUD_MAX_LEGACY       1228800u
+#define PL2303_BAUD_MAX_HX           12000000u
+
+/* UART state, byte 8 of interrupt packet. Bit 6:0 are the same as CDC SerialState */
+#define PL2303_UART_STATE_INDEX      8
+#define PL2303_UART_DCD              0x01
+#define PL2303_UART_DSR              0x02
+#define PL2303_UART_BREAK_ERROR      0x04
+#define PL2303_UART_RING             0x08
+#define PL2303_UART_FRAME_ERROR      0x10
+#define PL2303_UART_PARITY_ERROR     0x20
+#define PL2303_UART_OVERRUN_ERROR    0x40
+#define PL2303_UART_CTS              0x80
+
+#endif //TUSB_PL2303_H
@@ -58,8 +58,31 @@ typedef struct
   uint16_t epin_size;
   uint16_t epout_size;
 
-  CFG_TUH_MEM_ALIGN uint8_t epin_buf[CFG_TUH_HID_EPIN_BUFSIZE];
-  CFG_TUH_MEM_ALIGN uint8_t epout_buf[CFG_TUH_HID_EPOUT_BUFSIZE];
+  bool report_id_used; // report descriptor has Report ID item
+
+  #if CFG_TUH_HID_REPORT_FILTER
+  struct
+  {
+    bool enabled;
+    uint8_t next;         // slot to replace when a new report ID is seen
+    uint16_t field_count;
+    tuh_hid_field_t const* fields;
+
+    uint32_t received;
+    uint32_t suppressed;
+
+    struct
+    {
+      uint8_t  report_id;
+      uint16_t len;       // 0 if slot is not used
+      uint8_t  report[CFG_TUH_HID_EPIN_BUFSIZE];
+    } last[CFG_TUH_HID_REPORT_FILTER];
+  } filter;
+  #endif
+
+  // allocated from usbh buffer pool when opened
+  uint8_t* epin_buf;  // CFG_TUH_HID_EPIN_BUFSIZE
+  uint8_t* epout_buf; // CFG_TUH_HID_EPOUT_BUFSIZE
 } hidh_interface_t;
 
 CFG_TUH_MEM_SECTION
@@ -94,6 +117,31 @@ static uint8_t get_idx_by_epaddr(uint8_t daddr, uint8_t ep_addr)
   return TUSB_INDEX_INVALID_8;
 }
 
+// Check if report descriptor has Report ID item i.e reports are prefixed by their ID
+static bool desc_has_report_id(uint8_t const* desc_report, uint16_t desc_len)
+{
+  uint8_t const* desc_end = desc_report + desc_len;
+
+  while ( desc_report < desc_end )
+  {
+    uint8_t const header = *desc_report++;
+    uint8_t const size   = (header & 0x03) == 3 ? 4 : (header & 0x03);
+
+    if ( header == 0xFE )
+    {
+      // long item
+      if ( desc_report >= desc_end ) break;
+      desc_report += 2 + desc_report[0];
+    }else
+    {
+      if ( ((header >> 2) & 0x03) == RI_TYPE_GLOBAL && (header >> 4) == RI_GLOBAL_REPORT_ID ) return true;
+      desc_report += size;
+    }
+  }
+
+  return false;
+}
+
 static hidh_interface_t* find_new_itf(void)
 {
   for(uint8_t i=0; i<CFG_TUH_HID; i++)
@@ -414,6 +462,86 @@ bool tuh_hid_send_report(uint8_t daddr, uint8_t idx, uint8_t report_id, const vo
   return true;
 }
 
+//--------------------------------------------------------------------+
+// Report Filter
+//--------------------------------------------------------------------+
+
+#if CFG_TUH_HID_REPORT_FILTER
+
+bool tuh_hid_report_filter_enable(uint8_t daddr, uint8_t idx, tuh_hid_field_t const* fields, uint16_t field_count)
+{
+  hidh_interface_t* p_hid = get_hid_itf(daddr, idx);
+  TU_VERIFY(p_hid);
+
+  tu_memclr(&p_hid->filter, sizeof(p_hid->filter));
+  p_hid->filter.fields      = fields;
+  p_hid->filter.field_count = fields ? field_count : 0;
+  p_hid->filter.enabled     = true;
+
+  return true;
+}
+
+bool tuh_hid_report_filter_disable(uint8_t daddr, uint8_t idx)
+{
+  hidh_interface_t* p_hid = get_hid_itf(daddr, idx);
+  TU_VERIFY(p_hid);
+
+  p_hid->filter.enabled = false;
+
+  return true;
+}
+
+bool tuh_hid_report_filter_get_count(uint8_t daddr, uint8_t idx, uint32_t* received, uint32_t* suppressed)
+{
+  hidh_interface_t* p_hid = get_hid_itf(daddr, idx);
+  TU_VERIFY(p_hid);
+
+  if (received  ) *received   = p_hid->filter.received;
+  if (suppressed) *suppressed = p_hid->filter.suppressed;
+
+  return true;
+}
+
+// Return true if report should be delivered, last report of its ID is updated
+static bool report_filter(hidh_interface_t* p_hid, uint8_t const* report, uint16_t len)
+{
+  p_hid->filter.received++;
+
+  // Boot protocol reports have no ID, otherwise without ID all reports are compared with the last one
+  bool const boot_mode = (p_hid->itf_protocol != HID_ITF_PROTOCOL_NONE) && (p_hid->protocol_mode == HID_PROTOCOL_BOOT);
+  uint8_t const report_id = (p_hid->report_id_used && !boot_mode && len) ? report[0] : 0;
+
+  uint8_t slot = 0;
+  while ( slot < CFG_TUH_HID_REPORT_FILTER &&
+          !(p_hid->filter.last[slot].len && p_hid->filter.last[slot].report_id == report_id) )
+  {
+    slot++;
+  }
+
+  if ( slot < CFG_TUH_HID_REPORT_FILTER )
+  {
+    if ( p_hid->filter.last[slot].len == len &&
+         !tuh_hid_report_changed(p_hid->filter.fields, p_hid->filter.field_count, report, p_hid->filter.last[slot].report, len) )
+    {
+      p_hid->filter.suppressed++;
+      return false;
+    }
+  }else
+  {
+    // new report ID: replace slots in round robin
+    slot = p_hid->filter.next;
+    p_hid->filter.next = (uint8_t) ((slot + 1) % CFG_TUH_HID_REPORT_FILTER);
+  }
+
+  p_hid->filter.last[slot].report_id = report_id;
+  p_hid->filter.last[slot].len       = len;
+  memcpy(p_hid->filter.last[slot].report, report, len);
+
+  return true;
+}
+
+#endif
+
 //--------------------------------------------------------------------+
 // USBH API
 //--------------------------------------------------------------------+
@@ -436,6 +564,17 @@ bool hidh_xfer_cb(uint8_t daddr, uint8_t ep_addr, xfer_result_t result, uint32_t
   {
     TU_LOG_DRV("  Get Report callback (%u, %u)\r\n", daddr, idx);
     TU_LOG3_MEM(p_hid->epin_buf, xferred_bytes, 2);
+
+    #if CFG_TUH_HID_REPORT_FILTER
+    if ( p_hid->filter.enabled && result == XFER_RESULT_SUCCESS && xferred_bytes &&
+         !report_filter(p_hid, p_hid->epin_buf, (uint16_t) xferred_bytes) )
+    {
+      // unchanged report: receive next one on behalf of application
+      TU_ASSERT( tuh_hid_receive_report(daddr, idx) );
+      return true;
+    }
+    #endif
+
     tuh_hid_report_received_cb(daddr, idx, p_hid->epin_buf, (uint16_t) xferred_bytes);
   }else
   {
@@ -486,6 +625,12 @@ bool hidh_open(uint8_t rhport, uint8_t daddr, tusb_desc_interface_t const *desc_
 
   hidh_interface_t* p_hid = find_new_itf();
   TU_ASSERT(p_hid); // not enough interface, try to increase CFG_TUH_HID
+  tu_memclr(p_hid, sizeof(hidh_interface_t));
+
+  p_hid->epin_buf  = (uint8_t*) usbh_buf_alloc(daddr, CFG_TUH_HID_EPIN_BUFSIZE);
+  p_hid->epout_buf = (uint8_t*) usbh_buf_alloc(daddr, CFG_TUH_HID_EPOUT_BUFSIZE);
+  TU_ASSERT(p_hid->epin_buf && p_hid->epout_buf); // not enough pool, try to increase CFG_TUH_MEM_POOL_SIZE
+
   p_hid->daddr = daddr;
 
   //------------- Endpoint Descriptors -------------//
@@ -603,13 +748,13 @@ static void process_set_config(tuh_xfer_t* xfer)
         config_driver_mount_complete(daddr, idx, NULL, 0);
       }else
       {
-        tuh_descriptor_get_hid_report(daddr, itf_num, p_hid->report_desc_type, 0, usbh_get_enum_buf(), p_hid->report_desc_len, process_set_config, CONFIG_COMPLETE);
+        tuh_descriptor_get_hid_report(daddr, itf_num, p_hid->report_desc_type, 0, usbh_get_enum_buf(daddr), p_hid->report_desc_len, process_set_config, CONFIG_COMPLETE);
       }
       break;
 
     case CONFIG_COMPLETE:
     {
-      uint8_t const* desc_report = usbh_get_enum_buf();
+      uint8_t const* desc_report = usbh_get_enum_buf(daddr);
       uint16_t const desc_len    = tu_le16toh(xfer->setup->wLength);
 
       config_driver_mount_complete(daddr, idx, desc_report, desc_len);
@@ -625,6 +770,8 @@ static void config_driver_mount_complete(uint8_t daddr, uint8_t idx, uint8_t con
   hidh_interface_t* p_hid = get_hid_itf(daddr, idx);
   TU_VERIFY(p_hid, );
 
+  p_hid->report_id_used = desc_has_report_id(desc_report, desc_len);
+
   // enumeration is complete
   if (tuh_hid_mount_cb) tuh_hid_mount_cb(daddr, idx, desc_report, desc_len);
 
@@ -28,6 +28,7 @@
 #define _TUSB_HID_HOST_H_
 
 #include "hid.h"
+#include "hid_parser.h"
 
 #ifdef __cplusplus
  extern "C" {
@@ -46,6 +47,12 @@
 #define CFG_TUH_HID_EPOUT_BUFSIZE 64
 #endif
 
+// Report filter: number of report IDs per interface whose last Input report is kept (each of CFG_TUH_HID_EPIN_BUFSIZE)
+// to drop unchanged reports, 0 to disable. See tuh_hid_report_filter_enable()
+#ifndef CFG_TUH_HID_REPORT_FILTER
+#define CFG_TUH_HID_REPORT_FILTER 0
+#endif
+
 
 typedef struct
 {
@@ -124,6 +131,20 @@ bool tuh_hid_send_ready(uint8_t dev_addr, uint8_t idx);
 // If report_id > 0 (composite), it will be sent as 1st byte, then report contents. Otherwise only report content is sent.
 bool tuh_hid_send_report(uint8_t dev_addr, uint8_t idx, uint8_t report_id, const void* report, uint16_t len);
 
+#if CFG_TUH_HID_REPORT_FILTER
+// Only invoke tuh_hid_report_received_cb() for reports that differ from the last one with the same report ID.
+// Unchanged reports are dropped and the next one is received automatically.
+// If fields is not NULL (compiled by tuh_hid_report_compile(), must stay valid while enabled) only their Input elements
+// are compared e.g to ignore a sequence counter or timestamp. Reports without any of these fields are compared entirely.
+bool tuh_hid_report_filter_enable(uint8_t dev_addr, uint8_t idx, tuh_hid_field_t const* fields, uint16_t field_count);
+
+// Deliver all reports again
+bool tuh_hid_report_filter_disable(uint8_t dev_addr, uint8_t idx);
+
+// Get number of received and suppressed (unchanged) reports since the filter is enabled
+bool tuh_hid_report_filter_get_count(uint8_t dev_addr, uint8_t idx, uint32_t* received, uint32_t* suppressed);
+#endif
+
 //--------------------------------------------------------------------+
 // Callbacks (Weak is optional)
 //--------------------------------------------------------------------+
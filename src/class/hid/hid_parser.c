@@ -0,0 +1,501 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+// This file does not depend on any configuration other than CFG_TUH_HID_PARSER_*, it can be used by application
+// with any HID report descriptor. Unused functions are dropped by the linker.
+
+#include "hid_parser.h"
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF
+//--------------------------------------------------------------------+
+
+enum { HID_PARSER_STACK_MAX = 4 }; // nesting of Push/Pop
+
+// Global items, HID 1.11 section 6.2.2.7
+typedef struct
+{
+  int32_t  logical_min;
+  int32_t  logical_max;
+  uint32_t logical_max_raw; // as encoded, for unsigned maximum e.g Logical Maximum (255) in 1 byte
+  uint16_t usage_page;
+  uint16_t report_count;
+  uint8_t  report_size;
+  uint8_t  report_id;
+} hid_global_t;
+
+// Local items, HID 1.11 section 6.2.2.8. Usages have their page in the upper 16 bits if it is given (extended usage)
+typedef struct
+{
+  uint32_t usages[CFG_TUH_HID_PARSER_USAGE_MAX];
+  uint32_t usage_min;
+  uint32_t usage_max;
+  uint8_t  usage_count;
+  bool     has_range;
+  uint8_t  delimiter_set;   // number of closed delimiter sets, only the first set of aliases is used
+  bool     in_delimiter;
+} hid_local_t;
+
+typedef struct
+{
+  hid_global_t global;
+  hid_local_t  local;
+
+  hid_global_t stack[HID_PARSER_STACK_MAX];
+  uint8_t      stack_depth;
+  uint8_t      collection_depth;
+
+  // bit offset of the next element of each report ID and type
+  struct
+  {
+    uint8_t  id;
+    uint16_t offset[3];
+  } reports[CFG_TUH_HID_PARSER_REPORT_ID_MAX];
+  uint8_t report_count;
+
+  tuh_hid_field_t* fields;
+  uint16_t max_fields;
+  uint16_t field_count;
+} hid_parser_t;
+
+//--------------------------------------------------------------------+
+// Compiler
+//--------------------------------------------------------------------+
+
+static uint16_t* report_offset(hid_parser_t* p, uint8_t report_type)
+{
+  uint8_t const id = p->global.report_id;
+
+  for(uint8_t i=0; i<p->report_count; i++)
+  {
+    if ( p->reports[i].id == id ) return &p->reports[i].offset[report_type-1];
+  }
+
+  TU_VERIFY(p->report_count < CFG_TUH_HID_PARSER_REPORT_ID_MAX, NULL);
+
+  tu_memclr(&p->reports[p->report_count], sizeof(p->reports[0]));
+  p->reports[p->report_count].id = id;
+  return &p->reports[p->report_count++].offset[report_type-1];
+}
+
+// Usage of element i of a variable item
+static uint32_t local_usage(hid_local_t const* local, uint16_t i)
+{
+  if ( local->usage_count )
+  {
+    // last usage applies to the remaining elements
+    return local->usages[tu_min16(i, (uint16_t) (local->usage_count-1))];
+  }
+
+  if ( local->has_range )
+  {
+    return tu_min32(local->usage_min + i, local->usage_max);
+  }
+
+  return 0;
+}
+
+static tuh_hid_field_t* field_new(hid_parser_t* p, uint8_t report_type, uint8_t flags, uint16_t bit_offset, uint32_t usage)
+{
+  // dropped if there is no space left, offset of the following fields is still correct
+  if ( p->field_count >= p->max_fields ) return NULL;
+
+  tuh_hid_field_t* field = &p->fields[p->field_count++];
+
+  field->usage_page  = tu_u32_high16(usage);
+  field->usage_min   = tu_u32_low16(usage);
+  field->usage_max   = tu_u32_low16(usage);
+  field->bit_offset  = bit_offset;
+  field->count       = 0;
+  field->bit_size    = p->global.report_size;
+  field->report_id   = p->global.report_id;
+  field->report_type = report_type;
+  field->flags       = flags;
+  field->logical_min = p->global.logical_min;
+  field->logical_max = (p->global.logical_min >= 0 && p->global.logical_max < 0) ? (int32_t) p->global.logical_max_raw
+                                                                                  : p->global.logical_max;
+
+  return field;
+}
+
+static bool main_item(hid_parser_t* p, uint8_t report_type, uint8_t flags)
+{
+  hid_global_t const* global = &p->global;
+  hid_local_t* local = &p->local;
+
+  uint16_t* offset = report_offset(p, report_type);
+  TU_VERIFY(offset);
+
+  uint32_t const bits = (uint32_t) global->report_size * global->report_count;
+  TU_VERIFY(*offset + bits <= UINT16_MAX);
+
+  bool const has_usage = local->usage_count || local->has_range;
+
+  // apply usage page to usages without one
+  uint32_t const page = ((uint32_t) global->usage_page) << 16;
+  for(uint8_t i=0; i<local->usage_count; i++)
+  {
+    if ( local->usages[i] <= UINT16_MAX ) local->usages[i] |= page;
+  }
+  if ( local->usage_min <= UINT16_MAX ) local->usage_min |= page;
+  if ( local->usage_max <= UINT16_MAX ) local->usage_max |= page;
+
+  if ( bits == 0 || ((flags & HID_CONSTANT) && !has_usage) )
+  {
+    // padding
+  }
+  else if ( !(flags & HID_VARIABLE) )
+  {
+    // array: one field for all elements, its values are indices into the usage range
+    uint32_t const first = local->usage_count ? local->usages[0] : local->usage_min;
+    uint32_t const last  = local->usage_count ? local->usages[local->usage_count-1] : local->usage_max;
+
+    tuh_hid_field_t* field = field_new(p, report_type, flags, *offset, first);
+    if ( field )
+    {
+      field->usage_max = tu_u32_low16(last);
+      field->count     = global->report_count;
+    }
+  }
+  else
+  {
+    // variable: one field per run of consecutive (or repeated last) usages
+    tuh_hid_field_t* field = NULL;
+    uint32_t prev = 0;
+
+    for(uint16_t i=0; i<global->report_count; i++)
+    {
+      uint32_t const usage = local_usage(local, i);
+
+      if ( field && (usage == prev || (usage == prev+1 && field->usage_min + field->count == tu_u32_low16(usage))) )
+      {
+        field->usage_max = tu_u32_low16(usage);
+        field->count++;
+      }
+      else
+      {
+        field = field_new(p, report_type, flags, (uint16_t) (*offset + i*global->report_size), usage);
+        if ( !field ) break;
+        field->count = 1;
+      }
+
+      prev = usage;
+    }
+  }
+
+  *offset = (uint16_t) (*offset + bits);
+
+  return true;
+}
+
+uint16_t tuh_hid_report_compile(tuh_hid_field_t* fields, uint16_t max_fields, uint8_t const* desc_report, uint16_t desc_len)
+{
+  hid_parser_t parser;
+  hid_parser_t* p = &parser;
+
+  tu_memclr(p, sizeof(hid_parser_t));
+  p->fields     = fields;
+  p->max_fields = max_fields;
+
+  uint8_t const* desc_end = desc_report + desc_len;
+
+  while ( desc_report < desc_end )
+  {
+    uint8_t const header = *desc_report++;
+
+    // Long item (6.2.2.3) is not used by any defined tag, skip it
+    if ( header == 0xFE )
+    {
+      TU_VERIFY(desc_report + 2 <= desc_end, 0);
+      desc_report += 2 + desc_report[0];
+      continue;
+    }
+
+    // Short item (6.2.2.2): size 3 means 4 bytes of data
+    uint8_t const size = (header & 0x03) == 3 ? 4 : (header & 0x03);
+    uint8_t const type = (header >> 2) & 0x03;
+    uint8_t const tag  = header >> 4;
+
+    TU_VERIFY(desc_report + size <= desc_end, 0);
+
+    uint32_t udata = 0;
+    for(uint8_t i=0; i<size; i++) udata |= ((uint32_t) desc_report[i]) << (8*i);
+
+    int32_t sdata = (int32_t) udata;
+    if ( size == 1 ) sdata = (int8_t) udata;
+    if ( size == 2 ) sdata = (int16_t) udata;
+
+    desc_report += size;
+
+    switch(type)
+    {
+      case RI_TYPE_MAIN:
+        switch (tag)
+        {
+          case RI_MAIN_INPUT:   TU_VERIFY(main_item(p, HID_REPORT_TYPE_INPUT  , (uint8_t) udata), 0); break;
+          case RI_MAIN_OUTPUT:  TU_VERIFY(main_item(p, HID_REPORT_TYPE_OUTPUT , (uint8_t) udata), 0); break;
+          case RI_MAIN_FEATURE: TU_VERIFY(main_item(p, HID_REPORT_TYPE_FEATURE, (uint8_t) udata), 0); break;
+
+          case RI_MAIN_COLLECTION:
+            p->collection_depth++;
+          break;
+
+          case RI_MAIN_COLLECTION_END:
+            TU_VERIFY(p->collection_depth, 0);
+            p->collection_depth--;
+          break;
+
+          default: break;
+        }
+
+        // local items only apply to the next main item
+        tu_memclr(&p->local, sizeof(hid_local_t));
+      break;
+
+      case RI_TYPE_GLOBAL:
+        switch(tag)
+        {
+          case RI_GLOBAL_USAGE_PAGE  : p->global.usage_page   = (uint16_t) udata; break;
+          case RI_GLOBAL_LOGICAL_MIN : p->global.logical_min  = sdata; break;
+          case RI_GLOBAL_LOGICAL_MAX :
+            p->global.logical_max     = sdata;
+            p->global.logical_max_raw = udata;
+          break;
+
+          case RI_GLOBAL_REPORT_SIZE : p->global.report_size  = (uint8_t) tu_min32(udata, UINT8_MAX); break;
+          case RI_GLOBAL_REPORT_COUNT: p->global.report_count = (uint16_t) tu_min32(udata, UINT16_MAX); break;
+
+          case RI_GLOBAL_REPORT_ID:
+            // report ID 0 is reserved
+            TU_VERIFY(udata && udata <= UINT8_MAX, 0);
+            p->global.report_id = (uint8_t) udata;
+          break;
+
+          case RI_GLOBAL_PUSH:
+            TU_VERIFY(p->stack_depth < HID_PARSER_STACK_MAX, 0);
+            p->stack[p->stack_depth++] = p->global;
+          break;
+
+          case RI_GLOBAL_POP:
+            TU_VERIFY(p->stack_depth, 0);
+            p->global = p->stack[--p->stack_depth];
+          break;
+
+          // physical range, unit and exponent are not needed to extract values
+          default: break;
+        }
+      break;
+
+      case RI_TYPE_LOCAL:
+      {
+        hid_local_t* local = &p->local;
+
+        // only the first usage of a set of aliases is used
+        if ( local->delimiter_set && tag != RI_LOCAL_DELIMITER ) break;
+
+        switch(tag)
+        {
+          case RI_LOCAL_USAGE:
+            if ( local->usage_count < CFG_TUH_HID_PARSER_USAGE_MAX ) local->usages[local->usage_count++] = udata;
+          break;
+
+          case RI_LOCAL_USAGE_MIN:
+            local->usage_min = udata;
+            local->has_range = true;
+          break;
+
+          case RI_LOCAL_USAGE_MAX:
+            local->usage_max = udata;
+            local->has_range = true;
+          break;
+
+          case RI_LOCAL_DELIMITER:
+            // close set
+            if ( local->in_delimiter && !udata ) local->delimiter_set++;
+            local->in_delimiter = (udata != 0);
+          break;
+
+          // designator and string are not needed to extract values
+          default: break;
+        }
+      }
+      break;
+
+      // reserved
+      default: break;
+    }
+  }
+
+  // unbalanced collection
+  TU_VERIFY(p->collection_depth == 0, 0);
+
+  return p->field_count;
+}
+
+//--------------------------------------------------------------------+
+// Extractor
+//--------------------------------------------------------------------+
+
+// Get bit_size (1-32) bits starting at bit_offset, caller must make sure they are within data
+TU_ATTR_ALWAYS_INLINE static inline uint32_t get_bits(uint8_t const* data, uint32_t bit_offset, uint8_t bit_size)
+{
+  uint8_t const* p = data + (bit_offset >> 3);
+  uint8_t const shift = bit_offset & 7;
+
+  // byte aligned
+  if ( shift == 0 )
+  {
+    if ( bit_size == 8  ) return p[0];
+    if ( bit_size == 16 ) return p[0] | ((uint32_t) p[1] << 8);
+  }
+
+  uint32_t const nbytes = ((uint32_t) shift + bit_size + 7) >> 3;
+  uint32_t value = 0;
+
+  if ( nbytes <= 4 )
+  {
+    for(uint32_t i=0; i<nbytes; i++) value |= ((uint32_t) p[i]) << (8*i);
+    value >>= shift;
+  }else
+  {
+    // 5 bytes: 32 bit unaligned element
+    value = (p[0] >> shift) | ((uint32_t) p[1] << (8-shift)) | ((uint32_t) p[2] << (16-shift)) |
+            ((uint32_t) p[3] << (24-shift)) | ((uint32_t) p[4] << (32-shift));
+  }
+
+  return (bit_size < 32) ? (value & ((1ul << bit_size) - 1)) : value;
+}
+
+TU_ATTR_ALWAYS_INLINE static inline int32_t element_value(tuh_hid_field_t const* field, uint8_t const* data, uint16_t len, uint16_t index)
+{
+  uint8_t const bit_size = field->bit_size;
+  uint32_t const bit_offset = field->bit_offset + (uint32_t) index * bit_size;
+
+  if ( bit_size == 0 || bit_size > 32 || bit_offset + bit_size > 8ul*len ) return 0;
+
+  uint32_t const raw = get_bits(data, bit_offset, bit_size);
+
+  // sign extend
+  if ( field->logical_min < 0 && bit_size < 32 && (raw & (1ul << (bit_size-1))) )
+  {
+    return (int32_t) (raw | ~((1ul << bit_size) - 1));
+  }
+
+  return (int32_t) raw;
+}
+
+int32_t tuh_hid_field_value(tuh_hid_field_t const* field, uint8_t const* report, uint16_t len, uint16_t index)
+{
+  TU_VERIFY(index < field->count && tuh_hid_field_in_report(field, report, len), 0);
+
+  uint8_t const id_len = field->report_id ? 1 : 0;
+  return element_value(field, report + id_len, (uint16_t) (len - id_len), index);
+}
+
+uint16_t tuh_hid_report_decode(tuh_hid_field_t const* fields, uint16_t field_count, uint8_t const* report, uint16_t len,
+                               int32_t* values, uint16_t max_values)
+{
+  uint16_t n = 0;
+
+  for(uint16_t i=0; i<field_count; i++)
+  {
+    tuh_hid_field_t const* field = &fields[i];
+    if ( field->report_type != HID_REPORT_TYPE_INPUT || !tuh_hid_field_in_report(field, report, len) ) continue;
+
+    uint8_t const id_len = field->report_id ? 1 : 0;
+    uint8_t const* data = report + id_len;
+    uint16_t const data_len = (uint16_t) (len - id_len);
+
+    for(uint16_t e=0; e<field->count && n<max_values; e++)
+    {
+      values[n++] = element_value(field, data, data_len, e);
+    }
+  }
+
+  return n;
+}
+
+// Check if bits [bit_start, bit_start + bit_count) of a and b differ, clamped to len bytes
+static bool bits_differ(uint8_t const* a, uint8_t const* b, uint32_t bit_start, uint32_t bit_count, uint16_t len)
+{
+  uint32_t const bit_end = tu_min32(bit_start + bit_count, 8ul*len);
+  if ( bit_start >= bit_end ) return false;
+
+  uint32_t const first = bit_start >> 3;
+  uint32_t const last  = (bit_end - 1) >> 3;
+
+  uint8_t const first_mask = (uint8_t) (0xFFu << (bit_start & 7));
+  uint8_t const last_mask  = (uint8_t) (0xFFu >> (7 - ((bit_end - 1) & 7)));
+
+  if ( first == last ) return ((a[first] ^ b[first]) & first_mask & last_mask) != 0;
+
+  if ( (a[first] ^ b[first]) & first_mask ) return true;
+  if ( (a[last ] ^ b[last ]) & last_mask  ) return true;
+
+  return (last - first > 1) && (0 != memcmp(a + first + 1, b + first + 1, last - first - 1));
+}
+
+bool tuh_hid_report_changed(tuh_hid_field_t const* fields, uint16_t field_count, uint8_t const* report,
+                            uint8_t const* prev, uint16_t len)
+{
+  bool found = false;
+
+  for(uint16_t i=0; i<field_count; i++)
+  {
+    tuh_hid_field_t const* field = &fields[i];
+    if ( field->report_type != HID_REPORT_TYPE_INPUT || !tuh_hid_field_in_report(field, report, len) ) continue;
+
+    uint8_t const id_len = field->report_id ? 1 : 0;
+    if ( bits_differ(report + id_len, prev + id_len, field->bit_offset, (uint32_t) field->count * field->bit_size,
+                     (uint16_t) (len - id_len)) )
+    {
+      return true;
+    }
+
+    found = true;
+  }
+
+  return found ? false : (0 != memcmp(report, prev, len));
+}
+
+tuh_hid_field_t const* tuh_hid_field_find(tuh_hid_field_t const* fields, uint16_t field_count, uint8_t report_type,
+                                          uint16_t usage_page, uint16_t usage, uint16_t* index)
+{
+  for(uint16_t i=0; i<field_count; i++)
+  {
+    tuh_hid_field_t const* field = &fields[i];
+
+    if ( (report_type == HID_REPORT_TYPE_INVALID || report_type == field->report_type) &&
+         field->usage_page == usage_page && field->usage_min <= usage && usage <= field->usage_max )
+    {
+      // index of element for variable field, array elements can report any usage
+      if ( index ) *index = (field->flags & HID_VARIABLE) ? (uint16_t) (usage - field->usage_min) : 0;
+      return field;
+    }
+  }
+
+  return NULL;
+}
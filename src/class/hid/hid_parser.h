@@ -0,0 +1,106 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_HID_PARSER_H_
+#define _TUSB_HID_PARSER_H_
+
+#include "hid.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// Report descriptor compiler
+//
+// A report descriptor is compiled once (e.g in tuh_hid_mount_cb()) into a table of fields, each describes a run of
+// report count elements of an Input, Output or Feature main item: report ID, bit offset, bit size, usage and logical
+// range. Received reports are then decoded with the table only, without parsing the descriptor again.
+//
+// - Variable field: element i has usage min(usage_min + i, usage_max), consecutive usages of a main item are merged
+//   into a single field, hence e.g X, Y, Z or Button 1-16 are one field each.
+// - Array field: element value v (if within logical range) reports usage usage_min + v - logical_min. Usages of an
+//   array must be a range (Usage Minimum/Maximum) or consecutive.
+// - Constant elements without usage (padding) only advance the bit offset and are not listed.
+
+// Max number of local usages (excluding ranges) before a main item, additional ones are ignored
+#ifndef CFG_TUH_HID_PARSER_USAGE_MAX
+#define CFG_TUH_HID_PARSER_USAGE_MAX       16
+#endif
+
+// Max number of distinct report IDs
+#ifndef CFG_TUH_HID_PARSER_REPORT_ID_MAX
+#define CFG_TUH_HID_PARSER_REPORT_ID_MAX   16
+#endif
+
+typedef struct
+{
+  uint16_t usage_page;
+  uint16_t usage_min;
+  uint16_t usage_max;
+  uint16_t bit_offset;   // offset of the first element, excluding report ID byte
+  uint16_t count;        // number of elements
+  uint8_t  bit_size;     // size of each element, 1-32
+  uint8_t  report_id;    // 0 if report ID is not used
+  uint8_t  report_type;  // hid_report_type_t
+  uint8_t  flags;        // data of main item e.g HID_VARIABLE, HID_RELATIVE, HID_CONSTANT
+  int32_t  logical_min;
+  int32_t  logical_max;
+} tuh_hid_field_t;
+
+// Compile report descriptor into fields, return number of fields or 0 if descriptor is malformed.
+// Fields which do not fit into max_fields are dropped.
+uint16_t tuh_hid_report_compile(tuh_hid_field_t* fields, uint16_t max_fields, uint8_t const* desc_report, uint16_t desc_len);
+
+// Find field (and its element) of a usage, report_type = HID_REPORT_TYPE_INVALID matches any type
+tuh_hid_field_t const* tuh_hid_field_find(tuh_hid_field_t const* fields, uint16_t field_count, uint8_t report_type,
+                                          uint16_t usage_page, uint16_t usage, uint16_t* index);
+
+// Check if report (as received, with report ID as first byte if used) contains field
+TU_ATTR_ALWAYS_INLINE static inline
+bool tuh_hid_field_in_report(tuh_hid_field_t const* field, uint8_t const* report, uint16_t len)
+{
+  return (field->report_id == 0) || (len && report[0] == field->report_id);
+}
+
+// Value of element index of field in report (as received, with report ID as first byte if used).
+// Value is sign extended if logical minimum is negative, 0 if element is not within report.
+int32_t tuh_hid_field_value(tuh_hid_field_t const* field, uint8_t const* report, uint16_t len, uint16_t index);
+
+// Decode all elements of Input fields of a report (as received, with report ID as first byte if used) in order of fields.
+// Return number of values written.
+uint16_t tuh_hid_report_decode(tuh_hid_field_t const* fields, uint16_t field_count, uint8_t const* report, uint16_t len,
+                               int32_t* values, uint16_t max_values);
+
+// Check if report differs from previous one (both as received, with the same length and report ID). Only elements
+// of Input fields of the report ID are compared, or all bytes if fields has none of them.
+bool tuh_hid_report_changed(tuh_hid_field_t const* fields, uint16_t field_count, uint8_t const* report,
+                            uint8_t const* prev, uint16_t len);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_HID_PARSER_H_ */
@@ -53,19 +53,35 @@ typedef struct
   uint8_t ep_in;
   uint8_t ep_out;
 
+#if CFG_TUD_MIDI_CABLE_MAX > 1
+  uint8_t tx_cable; // cable served next by write_flush()
+  uint8_t rx_cable; // cable served next by tud_midi_n_packet_read()
+#endif
+
   // For Stream read()/write() API
   // Messages are always 4 bytes long, queue them for reading and writing so the
   // callers can use the Stream interface with single-byte read/write calls.
-  midid_stream_t stream_write;
-  midid_stream_t stream_read;
+  // Each cable has its own state since messages of different cables are interleaved.
+  midid_stream_t stream_write[CFG_TUD_MIDI_CABLE_MAX];
+  midid_stream_t stream_read[CFG_TUD_MIDI_CABLE_MAX];
 
   /*------------- From this point, data is not cleared by bus reset -------------*/
-  // FIFO
-  tu_fifo_t rx_ff;
-  tu_fifo_t tx_ff;
-  uint8_t rx_ff_buf[CFG_TUD_MIDI_RX_BUFSIZE];
-  uint8_t tx_ff_buf[CFG_TUD_MIDI_TX_BUFSIZE];
+  // FIFO, one per cable
+  tu_fifo_t rx_ff[CFG_TUD_MIDI_CABLE_MAX];
+  tu_fifo_t tx_ff[CFG_TUD_MIDI_CABLE_MAX];
+  uint8_t rx_ff_buf[CFG_TUD_MIDI_CABLE_MAX][CFG_TUD_MIDI_CABLE_RX_BUFSIZE];
+  uint8_t tx_ff_buf[CFG_TUD_MIDI_CABLE_MAX][CFG_TUD_MIDI_CABLE_TX_BUFSIZE];
+
+#if CFG_TUD_MIDI_REALTIME_PRIORITY
+  // Real-time messages bypass the cable FIFOs. Received ones are queued per cable,
+  // sent ones of all cables share a FIFO which is always flushed first.
+  tu_fifo_t rx_rt_ff[CFG_TUD_MIDI_CABLE_MAX];
+  tu_fifo_t tx_rt_ff;
+  uint8_t rx_rt_ff_buf[CFG_TUD_MIDI_CABLE_MAX][CFG_TUD_MIDI_REALTIME_BUFSIZE];
+  uint8_t tx_rt_ff_buf[CFG_TUD_MIDI_REALTIME_BUFSIZE];
+#endif
 
+  // All RX FIFOs share one mutex, all TX FIFOs share another one
   #if CFG_FIFO_MUTEX
   osal_mutex_def_t rx_ff_mutex;
   osal_mutex_def_t tx_ff_mutex;
@@ -79,6 +95,9 @@ typedef struct
 
 #define ITF_MEM_RESET_SIZE   offsetof(midid_interface_t, rx_ff)
 
+TU_VERIFY_STATIC(CFG_TUD_MIDI_CABLE_RX_BUFSIZE >= CFG_TUD_MIDI_EP_BUFSIZE, "RX FIFO of a cable must hold a full endpoint buffer");
+TU_VERIFY_STATIC(CFG_TUD_MIDI_CABLE_TX_BUFSIZE >= 4, "TX FIFO of a cable must hold at least one packet");
+
 //--------------------------------------------------------------------+
 // INTERNAL OBJECT & FUNCTION DECLARATION
 //--------------------------------------------------------------------+
@@ -90,10 +109,41 @@ bool tud_midi_n_mounted (uint8_t itf)
   return midi->ep_in && midi->ep_out;
 }
 
+// Index of FIFOs and stream states of a cable. All cables share index 0 if only one cable is configured.
+TU_ATTR_ALWAYS_INLINE static inline uint8_t _cable_idx(uint8_t cable_num)
+{
+#if CFG_TUD_MIDI_CABLE_MAX > 1
+  return cable_num;
+#else
+  (void) cable_num;
+  return 0;
+#endif
+}
+
+// Real-time messages (clock, start/stop, active sensing ...) are single byte messages 0xF8 - 0xFF
+TU_ATTR_ALWAYS_INLINE static inline bool _is_realtime(uint8_t const packet[4])
+{
+  uint8_t const code_index = packet[0] & 0x0f;
+  return (code_index == MIDI_CIN_1BYTE_DATA || code_index == MIDI_CIN_SYSEX_END_1BYTE) && packet[1] >= MIDI_STATUS_SYSREAL_TIMING_CLOCK;
+}
+
+// Minimum free space over all RX FIFOs
+static uint16_t _rx_remaining(midid_interface_t* p_midi)
+{
+  uint16_t available = tu_fifo_remaining(&p_midi->rx_ff[0]);
+
+  for(uint8_t i=1; i<CFG_TUD_MIDI_CABLE_MAX; i++)
+  {
+    available = tu_min16(available, tu_fifo_remaining(&p_midi->rx_ff[i]));
+  }
+
+  return available;
+}
+
 static void _prep_out_transaction (midid_interface_t* p_midi)
 {
   uint8_t const rhport = 0;
-  uint16_t available = tu_fifo_remaining(&p_midi->rx_ff);
+  uint16_t available = _rx_remaining(p_midi);
 
   // Prepare for incoming data but only allow what we can store in the ring buffer.
   // TODO Actually we can still carry out the transfer, keeping count of received bytes
@@ -105,7 +155,7 @@ static void _prep_out_transaction (midid_interface_t* p_midi)
   TU_VERIFY(usbd_edpt_claim(rhport, p_midi->ep_out), );
 
   // fifo can be changed before endpoint is claimed
-  available = tu_fifo_remaining(&p_midi->rx_ff);
+  available = _rx_remaining(p_midi);
 
   if ( available >= sizeof(p_midi->epout_buf) )  {
     usbd_edpt_xfer(rhport, p_midi->ep_out, p_midi->epout_buf, sizeof(p_midi->epout_buf));
@@ -116,29 +166,70 @@ static void _prep_out_transaction (midid_interface_t* p_midi)
   }
 }
 
+// Dispatch received packets to the FIFOs of their cables
+static void _rx_dispatch(midid_interface_t* p_midi, uint16_t xferred_bytes)
+{
+#if CFG_TUD_MIDI_CABLE_MAX > 1 || CFG_TUD_MIDI_REALTIME_PRIORITY
+  for(uint16_t i=0; i + 4 <= xferred_bytes; i += 4)
+  {
+    uint8_t const* packet = &p_midi->epout_buf[i];
+    uint8_t const idx = _cable_idx(packet[0] >> 4);
+
+    // Drop packets of cables which are not configured
+    if (idx >= CFG_TUD_MIDI_CABLE_MAX) continue;
+
+#if CFG_TUD_MIDI_REALTIME_PRIORITY
+    // Fall back to the cable FIFO if real-time FIFO is full
+    if (_is_realtime(packet) && tu_fifo_write_n(&p_midi->rx_rt_ff[idx], packet, 4) == 4) continue;
+#endif
+
+    tu_fifo_write_n(&p_midi->rx_ff[idx], packet, 4);
+  }
+#else
+  tu_fifo_write_n(&p_midi->rx_ff[0], p_midi->epout_buf, xferred_bytes);
+#endif
+}
+
+// Read a packet of a cable, real-time messages first
+static bool _rx_packet_read(midid_interface_t* midi, uint8_t idx, uint8_t packet[4])
+{
+#if CFG_TUD_MIDI_REALTIME_PRIORITY
+  if (tu_fifo_read_n(&midi->rx_rt_ff[idx], packet, 4) == 4) return true;
+#endif
+
+  return tu_fifo_read_n(&midi->rx_ff[idx], packet, 4) == 4;
+}
+
 //--------------------------------------------------------------------+
 // READ API
 //--------------------------------------------------------------------+
 uint32_t tud_midi_n_available(uint8_t itf, uint8_t cable_num)
 {
-  (void) cable_num;
+  uint8_t const idx = _cable_idx(cable_num);
+  TU_VERIFY(idx < CFG_TUD_MIDI_CABLE_MAX, 0);
 
   midid_interface_t* midi = &_midid_itf[itf];
-  midid_stream_t const* stream = &midi->stream_read;
+  midid_stream_t const* stream = &midi->stream_read[idx];
+
+  uint32_t count = tu_fifo_count(&midi->rx_ff[idx]);
+#if CFG_TUD_MIDI_REALTIME_PRIORITY
+  count += tu_fifo_count(&midi->rx_rt_ff[idx]);
+#endif
 
   // when using with packet API stream total & index are both zero
-  return tu_fifo_count(&midi->rx_ff) + (uint8_t) (stream->total - stream->index);
+  return count + (uint8_t) (stream->total - stream->index);
 }
 
 uint32_t tud_midi_n_stream_read(uint8_t itf, uint8_t cable_num, void* buffer, uint32_t bufsize)
 {
-  (void) cable_num;
-  TU_VERIFY(bufsize, 0);
+  uint8_t const idx = _cable_idx(cable_num);
+  TU_VERIFY(bufsize && idx < CFG_TUD_MIDI_CABLE_MAX, 0);
 
   uint8_t* buf8 = (uint8_t*) buffer;
 
   midid_interface_t* midi = &_midid_itf[itf];
-  midid_stream_t* stream = &midi->stream_read;
+  TU_VERIFY(midi->ep_out, 0);
+  midid_stream_t* stream = &midi->stream_read[idx];
 
   uint32_t total_read = 0;
   while( bufsize )
@@ -147,7 +238,9 @@ uint32_t tud_midi_n_stream_read(uint8_t itf, uint8_t cable_num, void* buffer, ui
     if ( stream->total == 0 )
     {
       // return if there is no more data from fifo
-      if ( !tud_midi_n_packet_read(itf, stream->buffer) ) return total_read;
+      bool const has_packet = _rx_packet_read(midi, idx, stream->buffer);
+      _prep_out_transaction(midi);
+      if ( !has_packet ) return total_read;
 
       uint8_t const code_index = stream->buffer[0] & 0x0f;
 
@@ -157,7 +250,7 @@ uint32_t tud_midi_n_stream_read(uint8_t itf, uint8_t cable_num, void* buffer, ui
         case MIDI_CIN_MISC:
         case MIDI_CIN_CABLE_EVENT:
           // These are reserved and unused, possibly issue somewhere, skip this packet
-          return 0;
+          return total_read;
         break;
 
         case MIDI_CIN_SYSEX_END_1BYTE:
@@ -205,26 +298,98 @@ bool tud_midi_n_packet_read (uint8_t itf, uint8_t packet[4])
   midid_interface_t* midi = &_midid_itf[itf];
   TU_VERIFY(midi->ep_out);
 
-  uint32_t const num_read = tu_fifo_read_n(&midi->rx_ff, packet, 4);
+  bool found = false;
+
+#if CFG_TUD_MIDI_REALTIME_PRIORITY
+  // Real-time messages of all cables first
+  for(uint8_t i=0; i<CFG_TUD_MIDI_CABLE_MAX && !found; i++)
+  {
+    found = (tu_fifo_read_n(&midi->rx_rt_ff[i], packet, 4) == 4);
+  }
+#endif
+
+#if CFG_TUD_MIDI_CABLE_MAX > 1
+  // Serve cables in round robin such that a long SysEx on one cable does not block the others
+  for(uint8_t i=0; i<CFG_TUD_MIDI_CABLE_MAX && !found; i++)
+  {
+    uint8_t const idx = midi->rx_cable;
+    midi->rx_cable = (uint8_t) ((idx + 1) % CFG_TUD_MIDI_CABLE_MAX);
+    found = (tu_fifo_read_n(&midi->rx_ff[idx], packet, 4) == 4);
+  }
+#else
+  if (!found) found = (tu_fifo_read_n(&midi->rx_ff[0], packet, 4) == 4);
+#endif
+
   _prep_out_transaction(midi);
-  return (num_read == 4);
+  return found;
 }
 
 //--------------------------------------------------------------------+
 // WRITE API
 //--------------------------------------------------------------------+
 
+static bool _tx_pending(midid_interface_t* midi)
+{
+#if CFG_TUD_MIDI_REALTIME_PRIORITY
+  if ( tu_fifo_count(&midi->tx_rt_ff) ) return true;
+#endif
+
+  for(uint8_t i=0; i<CFG_TUD_MIDI_CABLE_MAX; i++)
+  {
+    if ( tu_fifo_count(&midi->tx_ff[i]) ) return true;
+  }
+
+  return false;
+}
+
+// Queue a packet for sending, real-time messages bypass pending packets of all cables
+static bool _tx_packet_write(midid_interface_t* midi, uint8_t idx, uint8_t const packet[4])
+{
+#if CFG_TUD_MIDI_REALTIME_PRIORITY
+  // Fall back to the cable FIFO if real-time FIFO is full
+  if ( _is_realtime(packet) && tu_fifo_write_n(&midi->tx_rt_ff, packet, 4) == 4 ) return true;
+#endif
+
+  if ( tu_fifo_remaining(&midi->tx_ff[idx]) < 4 ) return false;
+  return tu_fifo_write_n(&midi->tx_ff[idx], packet, 4) == 4;
+}
+
 static uint32_t write_flush(midid_interface_t* midi)
 {
   // No data to send
-  if ( !tu_fifo_count(&midi->tx_ff) ) return 0;
+  if ( !_tx_pending(midi) ) return 0;
 
   uint8_t const rhport = 0;
 
   // skip if previous transfer not complete
   TU_VERIFY( usbd_edpt_claim(rhport, midi->ep_in), 0 );
 
-  uint16_t count = tu_fifo_read_n(&midi->tx_ff, midi->epin_buf, CFG_TUD_MIDI_EP_BUFSIZE);
+  uint16_t count = 0;
+
+#if CFG_TUD_MIDI_REALTIME_PRIORITY
+  count = tu_fifo_read_n(&midi->tx_rt_ff, midi->epin_buf, CFG_TUD_MIDI_EP_BUFSIZE);
+#endif
+
+#if CFG_TUD_MIDI_CABLE_MAX > 1
+  // Serve cables packet by packet in round robin such that a long SysEx on one cable does not block the others
+  uint8_t idle = 0;
+  while ( (count + 4 <= CFG_TUD_MIDI_EP_BUFSIZE) && (idle < CFG_TUD_MIDI_CABLE_MAX) )
+  {
+    tu_fifo_t* ff = &midi->tx_ff[midi->tx_cable];
+    midi->tx_cable = (uint8_t) ((midi->tx_cable + 1) % CFG_TUD_MIDI_CABLE_MAX);
+
+    if ( tu_fifo_read_n(ff, midi->epin_buf + count, 4) == 4 )
+    {
+      count += 4;
+      idle = 0;
+    }else
+    {
+      idle++;
+    }
+  }
+#else
+  count += tu_fifo_read_n(&midi->tx_ff[0], midi->epin_buf + count, (uint16_t) (CFG_TUD_MIDI_EP_BUFSIZE - count));
+#endif
 
   if (count)
   {
@@ -243,12 +408,28 @@ uint32_t tud_midi_n_stream_write(uint8_t itf, uint8_t cable_num, uint8_t const*
   midid_interface_t* midi = &_midid_itf[itf];
   TU_VERIFY(midi->ep_in, 0);
 
-  midid_stream_t* stream = &midi->stream_write;
+  uint8_t const idx = _cable_idx(cable_num);
+  TU_VERIFY(idx < CFG_TUD_MIDI_CABLE_MAX, 0);
+
+  midid_stream_t* stream = &midi->stream_write[idx];
 
   uint32_t i = 0;
-  while ( (i < bufsize) && (tu_fifo_remaining(&midi->tx_ff) >= 4) )
+  while ( i < bufsize )
   {
     uint8_t const data = buffer[i];
+
+    if ( data >= MIDI_STATUS_SYSREAL_TIMING_CLOCK )
+    {
+      //------------- Real-time message -------------//
+      // These may be interleaved anywhere, even within SysEx, and are sent right away without touching the ongoing packet
+      uint8_t const packet[4] = { (uint8_t) ((cable_num << 4) | MIDI_CIN_1BYTE_DATA), data, 0, 0 };
+      if ( !_tx_packet_write(midi, idx, packet) ) break;
+
+      i++;
+      continue;
+    }
+
+    if ( tu_fifo_remaining(&midi->tx_ff[idx]) < 4 ) break;
     i++;
 
     if ( stream->index == 0 )
@@ -340,15 +521,15 @@ uint32_t tud_midi_n_stream_write(uint8_t itf, uint8_t cable_num, uint8_t const*
     if ( stream->index == stream->total )
     {
       // zeroes unused bytes
-      for(uint8_t idx = stream->total; idx < 4; idx++) stream->buffer[idx] = 0;
+      for(uint8_t b = stream->total; b < 4; b++) stream->buffer[b] = 0;
 
-      uint16_t const count = tu_fifo_write_n(&midi->tx_ff, stream->buffer, 4);
+      bool const queued = _tx_packet_write(midi, idx, stream->buffer);
 
       // complete current event packet, reset stream
       stream->index = stream->total = 0;
 
       // FIFO overflown, since we already check fifo remaining. It is probably race condition
-      TU_ASSERT(count == 4, i);
+      TU_ASSERT(queued, i);
     }
   }
 
@@ -362,9 +543,10 @@ bool tud_midi_n_packet_write (uint8_t itf, uint8_t const packet[4])
   midid_interface_t* midi = &_midid_itf[itf];
   TU_VERIFY(midi->ep_in);
 
-  if (tu_fifo_remaining(&midi->tx_ff) < 4) return false;
+  uint8_t const idx = _cable_idx(packet[0] >> 4);
+  TU_VERIFY(idx < CFG_TUD_MIDI_CABLE_MAX);
 
-  tu_fifo_write_n(&midi->tx_ff, packet, 4);
+  if ( !_tx_packet_write(midi, idx, packet) ) return false;
   write_flush(midi);
 
   return true;
@@ -381,13 +563,35 @@ void midid_init(void)
   {
     midid_interface_t* midi = &_midid_itf[i];
 
+    #if CFG_FIFO_MUTEX
+    osal_mutex_t const rx_mutex = osal_mutex_create(&midi->rx_ff_mutex);
+    osal_mutex_t const tx_mutex = osal_mutex_create(&midi->tx_ff_mutex);
+    #endif
+
     // config fifo
-    tu_fifo_config(&midi->rx_ff, midi->rx_ff_buf, CFG_TUD_MIDI_RX_BUFSIZE, 1, false); // true, true
-    tu_fifo_config(&midi->tx_ff, midi->tx_ff_buf, CFG_TUD_MIDI_TX_BUFSIZE, 1, false); // OBVS.
+    for(uint8_t cable=0; cable<CFG_TUD_MIDI_CABLE_MAX; cable++)
+    {
+      tu_fifo_config(&midi->rx_ff[cable], midi->rx_ff_buf[cable], CFG_TUD_MIDI_CABLE_RX_BUFSIZE, 1, false); // true, true
+      tu_fifo_config(&midi->tx_ff[cable], midi->tx_ff_buf[cable], CFG_TUD_MIDI_CABLE_TX_BUFSIZE, 1, false); // OBVS.
+
+      #if CFG_TUD_MIDI_REALTIME_PRIORITY
+      tu_fifo_config(&midi->rx_rt_ff[cable], midi->rx_rt_ff_buf[cable], CFG_TUD_MIDI_REALTIME_BUFSIZE, 1, false);
+      #endif
+
+      #if CFG_FIFO_MUTEX
+      tu_fifo_config_mutex(&midi->rx_ff[cable], NULL, rx_mutex);
+      tu_fifo_config_mutex(&midi->tx_ff[cable], tx_mutex, NULL);
+      #if CFG_TUD_MIDI_REALTIME_PRIORITY
+      tu_fifo_config_mutex(&midi->rx_rt_ff[cable], NULL, rx_mutex);
+      #endif
+      #endif
+    }
 
+    #if CFG_TUD_MIDI_REALTIME_PRIORITY
+    tu_fifo_config(&midi->tx_rt_ff, midi->tx_rt_ff_buf, CFG_TUD_MIDI_REALTIME_BUFSIZE, 1, false);
     #if CFG_FIFO_MUTEX
-    tu_fifo_config_mutex(&midi->rx_ff, NULL, osal_mutex_create(&midi->rx_ff_mutex));
-    tu_fifo_config_mutex(&midi->tx_ff, osal_mutex_create(&midi->tx_ff_mutex), NULL);
+    tu_fifo_config_mutex(&midi->tx_rt_ff, tx_mutex, NULL);
+    #endif
     #endif
   }
 }
@@ -400,8 +604,19 @@ void midid_reset(uint8_t rhport)
   {
     midid_interface_t* midi = &_midid_itf[i];
     tu_memclr(midi, ITF_MEM_RESET_SIZE);
-    tu_fifo_clear(&midi->rx_ff);
-    tu_fifo_clear(&midi->tx_ff);
+
+    for(uint8_t cable=0; cable<CFG_TUD_MIDI_CABLE_MAX; cable++)
+    {
+      tu_fifo_clear(&midi->rx_ff[cable]);
+      tu_fifo_clear(&midi->tx_ff[cable]);
+      #if CFG_TUD_MIDI_REALTIME_PRIORITY
+      tu_fifo_clear(&midi->rx_rt_ff[cable]);
+      #endif
+    }
+
+    #if CFG_TUD_MIDI_REALTIME_PRIORITY
+    tu_fifo_clear(&midi->tx_rt_ff);
+    #endif
   }
 }
 
@@ -514,7 +729,7 @@ bool midid_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32
   // receive new data
   if ( ep_addr == p_midi->ep_out )
   {
-    tu_fifo_write_n(&p_midi->rx_ff, p_midi->epout_buf, (uint16_t) xferred_bytes);
+    _rx_dispatch(p_midi, (uint16_t) xferred_bytes);
 
     // invoke receive callback if available
     if (tud_midi_rx_cb) tud_midi_rx_cb(itf);
@@ -530,7 +745,7 @@ bool midid_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32
     {
       // If there is no data left, a ZLP should be sent if
       // xferred_bytes is multiple of EP size and not zero
-      if ( !tu_fifo_count(&p_midi->tx_ff) && xferred_bytes && (0 == (xferred_bytes % CFG_TUD_MIDI_EP_BUFSIZE)) )
+      if ( !_tx_pending(p_midi) && xferred_bytes && (0 == (xferred_bytes % CFG_TUD_MIDI_EP_BUFSIZE)) )
       {
         if ( usbd_edpt_claim(rhport, p_midi->ep_in) )
         {
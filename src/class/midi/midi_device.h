@@ -43,6 +43,37 @@
   #define CFG_TUD_MIDI_EP_BUFSIZE     (TUD_OPT_HIGH_SPEED ? 512 : 64)
 #endif
 
+// Number of virtual cables with their own RX/TX FIFOs (each of CFG_TUD_MIDI_CABLE_RX/TX_BUFSIZE), at most 16.
+// With 1, all cables share one FIFO per direction as before. With more, cables are served in round robin
+// such that e.g. a long SysEx on one cable does not stall the others.
+#ifndef CFG_TUD_MIDI_CABLE_MAX
+  #define CFG_TUD_MIDI_CABLE_MAX      1
+#endif
+
+TU_VERIFY_STATIC(CFG_TUD_MIDI_CABLE_MAX >= 1 && CFG_TUD_MIDI_CABLE_MAX <= 16, "CFG_TUD_MIDI_CABLE_MAX must be 1 - 16");
+
+// FIFO size of each cable in bytes (4 bytes per packet), FIFO RAM is CFG_TUD_MIDI_CABLE_MAX times of it.
+// Size them down if several cables are used. Since a received transfer may carry packets of a single cable only,
+// the next one is only started while every RX FIFO has room for CFG_TUD_MIDI_EP_BUFSIZE bytes.
+#ifndef CFG_TUD_MIDI_CABLE_RX_BUFSIZE
+  #define CFG_TUD_MIDI_CABLE_RX_BUFSIZE   CFG_TUD_MIDI_RX_BUFSIZE
+#endif
+
+#ifndef CFG_TUD_MIDI_CABLE_TX_BUFSIZE
+  #define CFG_TUD_MIDI_CABLE_TX_BUFSIZE   CFG_TUD_MIDI_TX_BUFSIZE
+#endif
+
+// Queue real-time messages (clock, start, stop ...) separately and send/deliver them ahead of
+// all other pending packets to minimize clock jitter.
+#ifndef CFG_TUD_MIDI_REALTIME_PRIORITY
+  #define CFG_TUD_MIDI_REALTIME_PRIORITY  0
+#endif
+
+// Size of the real-time FIFOs in bytes (4 bytes per message)
+#ifndef CFG_TUD_MIDI_REALTIME_BUFSIZE
+  #define CFG_TUD_MIDI_REALTIME_BUFSIZE   32
+#endif
+
 #ifdef __cplusplus
  extern "C" {
 #endif
@@ -57,6 +57,10 @@ typedef struct {
   // TODO xfer_fifo can skip this buffer
   uint8_t* ep_buf;
 
+  // Optional 2nd buffer of rx stream (same size as ep_buf), buffers are swapped on completion so that the next
+  // transfer is queued before received data is copied into fifo.
+  uint8_t* ep_buf2;
+
   tu_fifo_t ff;
 
   // mutex: read if ep rx, write if e tx
@@ -109,6 +113,14 @@ void tu_edpt_stream_close(tu_edpt_stream_t* s)
   s->ep_addr = 0;
 }
 
+// Enable double buffering for rx stream with 2nd endpoint buffer of ep_bufsize. It only takes effect if fifo can hold
+// at least 2 transfers i.e ff_bufsize >= 2*ep_bufsize
+TU_ATTR_ALWAYS_INLINE static inline
+void tu_edpt_stream_set_rx_buf2(tu_edpt_stream_t* s, uint8_t* ep_buf2)
+{
+  s->ep_buf2 = ep_buf2;
+}
+
 // Clear fifo
 TU_ATTR_ALWAYS_INLINE static inline
 bool tu_edpt_stream_clear(tu_edpt_stream_t* s)
@@ -146,18 +158,13 @@ uint32_t tu_edpt_stream_read(tu_edpt_stream_t* s, void* buffer, uint32_t bufsize
 // Start an usb transfer if endpoint is not busy
 uint32_t tu_edpt_stream_read_xfer(tu_edpt_stream_t* s);
 
-// Must be called in the transfer complete callback
-TU_ATTR_ALWAYS_INLINE static inline
-void tu_edpt_stream_read_xfer_complete(tu_edpt_stream_t* s, uint32_t xferred_bytes) {
-  tu_fifo_write_n(&s->ff, s->ep_buf, (uint16_t) xferred_bytes);
-}
-
 // Same as tu_edpt_stream_read_xfer_complete but skip the first n bytes
+void tu_edpt_stream_read_xfer_complete_offset(tu_edpt_stream_t* s, uint32_t xferred_bytes, uint32_t skip_offset);
+
+// Must be called in the transfer complete callback. If double buffered, the next transfer is also queued.
 TU_ATTR_ALWAYS_INLINE static inline
-void tu_edpt_stream_read_xfer_complete_offset(tu_edpt_stream_t* s, uint32_t xferred_bytes, uint32_t skip_offset) {
-  if (skip_offset < xferred_bytes) {
-    tu_fifo_write_n(&s->ff, s->ep_buf + skip_offset, (uint16_t) (xferred_bytes - skip_offset));
-  }
+void tu_edpt_stream_read_xfer_complete(tu_edpt_stream_t* s, uint32_t xferred_bytes) {
+  tu_edpt_stream_read_xfer_complete_offset(s, xferred_bytes, 0);
 }
 
 // Get the number of bytes available for reading
@@ -104,6 +104,9 @@ typedef struct
   uint8_t speed;
 } hcd_devtree_info_t;
 
+// defined in usbh.h
+struct tuh_iso_packet_s;
+
 //--------------------------------------------------------------------+
 // Memory API
 //--------------------------------------------------------------------+
@@ -168,7 +171,8 @@ void hcd_device_close(uint8_t rhport, uint8_t dev_addr);
 // Open an endpoint
 bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc);
 
-// Submit a transfer, when complete hcd_event_xfer_complete() must be invoked
+// Submit a transfer, when complete hcd_event_xfer_complete() must be invoked. With CFG_TUH_HCD_EDPT_QUEUE, transfers
+// can be submitted while previous ones of the endpoint are in progress and must complete in submission order.
 bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t buflen);
 
 // Submit a special transfer to send 8-byte Setup Packet, when complete hcd_event_xfer_complete() must be invoked
@@ -177,6 +181,18 @@ bool hcd_setup_send(uint8_t rhport, uint8_t dev_addr, uint8_t const setup_packet
 // clear stall, data toggle is also reset to DATA0
 bool hcd_edpt_clear_stall(uint8_t daddr, uint8_t ep_addr);
 
+// Abort submitted transfers of an endpoint (optional), hcd_event_xfer_complete() must not be invoked for them afterwards.
+// Required for transfer timeouts, data toggle of the endpoint is kept.
+bool hcd_edpt_abort_xfer(uint8_t rhport, uint8_t daddr, uint8_t ep_addr) TU_ATTR_WEAK;
+
+// Submit an isochronous transfer of count packets (optional), one packet per service interval. Packet data is
+// contiguous in buffer, each packet occupies its length. Transfers are queued: a transfer continues in the service
+// interval right after the previous one, or as soon as possible if the endpoint is idle.
+// actual_length and result of every packet are updated before hcd_event_xfer_complete() is invoked with the total
+// number of bytes and XFER_RESULT_SUCCESS.
+bool hcd_edpt_iso_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t* buffer,
+                       struct tuh_iso_packet_s* packets, uint16_t count) TU_ATTR_WEAK;
+
 //--------------------------------------------------------------------+
 // USBH implemented API
 //--------------------------------------------------------------------+
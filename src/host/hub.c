@@ -45,12 +45,20 @@ typedef struct
   uint8_t itf_num;
   uint8_t ep_in;
   uint8_t port_count;
-  uint8_t status_change; // data from status change interrupt endpoint
 
-  CFG_TUH_MEM_ALIGN hub_port_status_response_t port_status;
+  // bit 0 is the hub, bit n is port n
+  uint32_t port_pending; // change reported, status is to be read
+  uint32_t port_busy;    // status is being read or its changes cleared
+  uint8_t port_clearing[CFG_TUH_HUB_PORT_MAX+1]; // number of clear feature requests in progress
+
+  CFG_TUH_MEM_ALIGN uint8_t status_change[(CFG_TUH_HUB_PORT_MAX+1+7)/8]; // data from status change interrupt endpoint
   CFG_TUH_MEM_ALIGN hub_status_response_t hub_status;
+  CFG_TUH_MEM_ALIGN hub_port_status_response_t port_status[CFG_TUH_HUB_PORT_MAX];
 } hub_interface_t;
 
+TU_VERIFY_STATIC(CFG_TUH_HUB_PORT_MAX < 32, "CFG_TUH_HUB_PORT_MAX must be less than 32");
+TU_VERIFY_STATIC(sizeof(hub_status_response_t) == sizeof(hub_port_status_response_t), "size mismatched");
+
 CFG_TUH_MEM_SECTION static hub_interface_t hub_data[CFG_TUH_HUB];
 CFG_TUH_MEM_SECTION CFG_TUH_MEM_ALIGN static uint8_t _hub_buffer[sizeof(descriptor_hub_desc_t)];
 
@@ -111,7 +119,7 @@ bool hub_port_clear_feature(uint8_t hub_addr, uint8_t hub_port, uint8_t feature,
   };
 
   TU_LOG2("HUB Clear Feature: %s, addr = %u port = %u\r\n", _hub_feature_str[feature], hub_addr, hub_port);
-  TU_ASSERT( tuh_control_xfer(&xfer) );
+  TU_VERIFY( tuh_control_xfer(&xfer) );
   return true;
 }
 
@@ -231,7 +239,7 @@ void hub_close(uint8_t dev_addr)
 bool hub_edpt_status_xfer(uint8_t dev_addr)
 {
   hub_interface_t* hub_itf = get_itf(dev_addr);
-  return usbh_edpt_xfer(dev_addr, hub_itf->ep_in, &hub_itf->status_change, 1);
+  return usbh_edpt_xfer(dev_addr, hub_itf->ep_in, hub_itf->status_change, sizeof(hub_itf->status_change));
 }
 
 
@@ -284,9 +292,9 @@ static void config_set_port_power (tuh_xfer_t* xfer)
   uint8_t const daddr = xfer->daddr;
   hub_interface_t* p_hub = get_itf(daddr);
 
-  // only use number of ports in hub descriptor
+  // only use number of ports in hub descriptor, additional ports are left unpowered
   descriptor_hub_desc_t const* desc_hub = (descriptor_hub_desc_t const*) _hub_buffer;
-  p_hub->port_count = desc_hub->bNbrPorts;
+  p_hub->port_count = tu_min8(desc_hub->bNbrPorts, CFG_TUH_HUB_PORT_MAX);
 
   // May need to GET_STATUS
 
@@ -306,7 +314,7 @@ static void config_port_power_complete (tuh_xfer_t* xfer)
   {
     // All ports are power -> queue notification status endpoint and
     // complete the SET CONFIGURATION
-    TU_ASSERT( usbh_edpt_xfer(daddr, p_hub->ep_in, &p_hub->status_change, 1), );
+    TU_ASSERT( hub_edpt_status_xfer(daddr), );
 
     usbh_driver_set_config_complete(daddr, p_hub->itf_num);
   }else
@@ -320,178 +328,148 @@ static void config_port_power_complete (tuh_xfer_t* xfer)
 //--------------------------------------------------------------------+
 // Connection Changes
 //--------------------------------------------------------------------+
+// Each port (and the hub itself as port 0) has its own state: pending once reported by the status change endpoint,
+// busy while its status is read and all of its changes are cleared. Requests of different ports are queued back to
+// back and the status endpoint is re-armed right away, hence a change reported while a port is busy is picked up
+// once the port is done.
 
-static void hub_port_get_status_complete (tuh_xfer_t* xfer);
-static void hub_get_status_complete (tuh_xfer_t* xfer);
-static void connection_clear_conn_change_complete (tuh_xfer_t* xfer);
-static void connection_port_reset_complete (tuh_xfer_t* xfer);
-
-// callback as response of interrupt endpoint polling
-bool hub_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes) {
-  (void) xferred_bytes; // TODO can be more than 1 for hub with lots of ports
-  (void) ep_addr;
-  TU_ASSERT(result == XFER_RESULT_SUCCESS);
+static void port_get_status_complete (tuh_xfer_t* xfer);
+static void port_clear_change_complete (tuh_xfer_t* xfer);
 
-  hub_interface_t* p_hub = get_itf(dev_addr);
+static inline void* port_status_buf(hub_interface_t* p_hub, uint8_t port)
+{
+  return port ? (void*) &p_hub->port_status[port-1] : (void*) &p_hub->hub_status;
+}
 
-  uint8_t const status_change = p_hub->status_change;
-  TU_LOG2("  Hub Status Change = 0x%02X\r\n", status_change);
+// Get status of all pending ports which are not busy
+static void port_process(uint8_t daddr)
+{
+  hub_interface_t* p_hub = get_itf(daddr);
 
-  if ( status_change == 0 ) {
-    // The status change event was neither for the hub, nor for any of its ports.
-    // This shouldn't happen, but it does with some devices.
-    // Initiate the next interrupt poll here.
-    return hub_edpt_status_xfer(dev_addr);
-  }
+  for (uint8_t port = 0; port <= p_hub->port_count; port++)
+  {
+    if ( tu_bit_test(p_hub->port_pending, port) && !tu_bit_test(p_hub->port_busy, port) )
+    {
+      // no free control transfer: retried once another port is done, or on next status change
+      // since changes are reported until cleared
+      TU_VERIFY(hub_port_get_status(daddr, port, port_status_buf(p_hub, port), port_get_status_complete, 0), );
 
-  if (tu_bit_test(status_change, 0)) {
-    // Hub bit 0 is for the hub device events
-    if (hub_port_get_status(dev_addr, 0, &p_hub->hub_status, hub_get_status_complete, 0) == false) {
-      //Hub status control transfer failed, retry
-      hub_edpt_status_xfer(dev_addr);
+      p_hub->port_pending = tu_bit_clear(p_hub->port_pending, port);
+      p_hub->port_busy    = tu_bit_set(p_hub->port_busy, port);
     }
   }
-  else {
-    // Hub bits 1 to n are hub port events
-    for (uint8_t port=1; port <= p_hub->port_count; port++) {
-      if ( tu_bit_test(status_change, port) ) {
-        if (hub_port_get_status(dev_addr, port, &p_hub->port_status, hub_port_get_status_complete, 0) == false) {
-          //Hub status control transfer failed, retry
-          hub_edpt_status_xfer(dev_addr);
-        }
-        break;
-      }
-    }
-  }
-
-  // NOTE: next status transfer is queued by usbh.c after handling this request
-  return true;
 }
 
-static void hub_clear_feature_complete_stub(tuh_xfer_t* xfer)
+static void port_done(uint8_t daddr, uint8_t port)
 {
-  TU_ASSERT(xfer->result == XFER_RESULT_SUCCESS, );
-  hub_edpt_status_xfer(xfer->daddr);
+  hub_interface_t* p_hub = get_itf(daddr);
+  p_hub->port_busy = tu_bit_clear(p_hub->port_busy, port);
+  port_process(daddr);
 }
 
-static void hub_get_status_complete (tuh_xfer_t* xfer)
-{
-  TU_ASSERT(xfer->result == XFER_RESULT_SUCCESS, );
-
-  uint8_t const daddr = xfer->daddr;
-  hub_interface_t* p_hub = get_itf(daddr);
-  uint8_t const port_num = (uint8_t) tu_le16toh(xfer->setup->wIndex);
-  TU_ASSERT(port_num == 0 , );
+// callback as response of interrupt endpoint polling
+bool hub_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes) {
+  (void) ep_addr;
+  TU_ASSERT(result == XFER_RESULT_SUCCESS);
 
-  TU_LOG2("HUB Got hub status, addr = %u, status = %04x\r\n", daddr, p_hub->hub_status.change.value);
+  hub_interface_t* p_hub = get_itf(dev_addr);
 
-  if (p_hub->hub_status.change.local_power_source)
+  // bit 0 is the hub, bit n is port n
+  uint32_t status_change = 0;
+  xferred_bytes = tu_min32(xferred_bytes, sizeof(p_hub->status_change));
+  for (uint32_t i = 0; i < xferred_bytes; i++)
   {
-    TU_LOG2("HUB Local Power Change, addr = %u\r\n", daddr);
-    hub_port_clear_feature(daddr, port_num, HUB_FEATURE_HUB_LOCAL_POWER_CHANGE, hub_clear_feature_complete_stub, 0);
+    status_change |= ((uint32_t) p_hub->status_change[i]) << (8*i);
   }
-  else if (p_hub->hub_status.change.over_current)
-  {
-    TU_LOG1("HUB Over Current, addr = %u\r\n", daddr);
-    hub_port_clear_feature(daddr, port_num, HUB_FEATURE_HUB_OVER_CURRENT_CHANGE, hub_clear_feature_complete_stub, 0);
-  }
-}
-
-static void hub_port_get_status_complete (tuh_xfer_t* xfer)
-{
-  TU_ASSERT(xfer->result == XFER_RESULT_SUCCESS, );
+  status_change &= UINT32_MAX >> (31 - p_hub->port_count);
 
-  uint8_t const daddr = xfer->daddr;
-  hub_interface_t* p_hub = get_itf(daddr);
-  uint8_t const port_num = (uint8_t) tu_le16toh(xfer->setup->wIndex);
+  TU_LOG2("  Hub Status Change = 0x%02lX\r\n", (unsigned long) status_change);
 
-  // Connection change
-  if (p_hub->port_status.change.connection)
-  {
-    // Port is powered and enabled
-    //TU_VERIFY(port_status.status_current.port_power && port_status.status_current.port_enable, );
+  // Buffer is copied, prepare for next changes while these are processed. Some hubs report a status change
+  // which is neither for the hub, nor for any of its ports: nothing to process.
+  hub_edpt_status_xfer(dev_addr);
 
-    // Acknowledge Port Connection Change
-    hub_port_clear_feature(daddr, port_num, HUB_FEATURE_PORT_CONNECTION_CHANGE, connection_clear_conn_change_complete, 0);
-  }else
-  {
-    // Clear other port status change interrupts. TODO Not currently handled - just cleared.
-    if (p_hub->port_status.change.port_enable)
-    {
-      hub_port_clear_feature(daddr, port_num, HUB_FEATURE_PORT_ENABLE_CHANGE, hub_clear_feature_complete_stub, 0);
-    }
-    else if (p_hub->port_status.change.suspend)
-    {
-      hub_port_clear_feature(daddr, port_num, HUB_FEATURE_PORT_SUSPEND_CHANGE, hub_clear_feature_complete_stub, 0);
-    }
-    else if (p_hub->port_status.change.over_current)
-    {
-      hub_port_clear_feature(daddr, port_num, HUB_FEATURE_PORT_OVER_CURRENT_CHANGE, hub_clear_feature_complete_stub, 0);
-    }
-    else if (p_hub->port_status.change.reset)
-    {
-      hub_port_clear_feature(daddr, port_num, HUB_FEATURE_PORT_RESET_CHANGE, hub_clear_feature_complete_stub, 0);
-    }
-    // Other changes are: L1 state
-    // TODO clear change
+  p_hub->port_pending |= status_change;
+  port_process(dev_addr);
 
-    // prepare for next hub status
-    // TODO continue with status_change, or maybe we can do it again with status
-    hub_edpt_status_xfer(daddr);
-  }
+  return true;
 }
 
-static void connection_clear_conn_change_complete (tuh_xfer_t* xfer)
+static void port_get_status_complete (tuh_xfer_t* xfer)
 {
-  TU_ASSERT(xfer->result == XFER_RESULT_SUCCESS, );
-
   uint8_t const daddr = xfer->daddr;
   hub_interface_t* p_hub = get_itf(daddr);
-  uint8_t const port_num = (uint8_t) tu_le16toh(xfer->setup->wIndex);
+  uint8_t const port = (uint8_t) tu_le16toh(xfer->setup->wIndex);
 
-  if ( p_hub->port_status.status.connection )
-  {
-    // Reset port if attach event
-    hub_port_reset(daddr, port_num, connection_port_reset_complete, 0);
-  }else
+  TU_VERIFY(p_hub->ep_in, ); // hub is closed
+
+  if ( xfer->result == XFER_RESULT_SUCCESS )
   {
-    // submit detach event
-    hcd_event_t event =
+    // hub_status_response_t and hub_port_status_response_t have the same layout
+    uint16_t const change = ((hub_port_status_response_t const*) port_status_buf(p_hub, port))->change.value;
+    TU_LOG2("HUB Got status, addr = %u port = %u, change = %04x\r\n", daddr, port, change);
+
+    // Acknowledge all changes at once. Hub: local power and over current, port: connection, enable, suspend,
+    // over current and reset (started by enumeration, which does not depend on it being cleared here).
+    // Other changes e.g L1 state are not handled.
+    uint8_t const count = port ? 5 : 2;
+    uint8_t const feature_base = port ? HUB_FEATURE_PORT_CONNECTION_CHANGE : HUB_FEATURE_HUB_LOCAL_POWER_CHANGE;
+
+    for (uint8_t i = 0; i < count; i++)
     {
-      .rhport     = usbh_get_rhport(daddr),
-      .event_id   = HCD_EVENT_DEVICE_REMOVE,
-      .connection =
-       {
-         .hub_addr = daddr,
-         .hub_port = port_num
-       }
-    };
-
-    hcd_event_handler(&event, false);
+      if ( tu_bit_test(change, i) && hub_port_clear_feature(daddr, port, (uint8_t) (feature_base + i), port_clear_change_complete, 0) )
+      {
+        p_hub->port_clearing[port]++;
+      }
+    }
   }
+
+  if ( p_hub->port_clearing[port] == 0 ) port_done(daddr, port);
 }
 
-static void connection_port_reset_complete (tuh_xfer_t* xfer)
+static void port_clear_change_complete (tuh_xfer_t* xfer)
 {
-  TU_ASSERT(xfer->result == XFER_RESULT_SUCCESS, );
-
   uint8_t const daddr = xfer->daddr;
-  // hub_interface_t* p_hub = get_itf(daddr);
-  uint8_t const port_num = (uint8_t) tu_le16toh(xfer->setup->wIndex);
+  hub_interface_t* p_hub = get_itf(daddr);
+  uint8_t const port = (uint8_t) tu_le16toh(xfer->setup->wIndex);
+  uint16_t const feature = tu_le16toh(xfer->setup->wValue);
+
+  TU_VERIFY(p_hub->ep_in, ); // hub is closed
 
-  // submit attach event
-  hcd_event_t event =
+  if ( xfer->result == XFER_RESULT_SUCCESS )
   {
-    .rhport     = usbh_get_rhport(daddr),
-    .event_id   = HCD_EVENT_DEVICE_ATTACH,
-    .connection =
+    if ( port == 0 )
     {
-      .hub_addr = daddr,
-      .hub_port = port_num
+      if ( feature == HUB_FEATURE_HUB_OVER_CURRENT_CHANGE )
+      {
+        TU_LOG1("HUB Over Current, addr = %u\r\n", daddr);
+      }
     }
-  };
+    else if ( feature == HUB_FEATURE_PORT_OVER_CURRENT_CHANGE )
+    {
+      TU_LOG1("HUB Over Current, addr = %u port = %u\r\n", daddr, port);
+    }
+    else if ( feature == HUB_FEATURE_PORT_CONNECTION_CHANGE )
+    {
+      // submit attach event (port is reset by usbh once the device is stable and address 0 is available) or
+      // detach event. Status is not overwritten until all changes of this port are cleared.
+      hcd_event_t event =
+      {
+        .rhport     = usbh_get_rhport(daddr),
+        .event_id   = p_hub->port_status[port-1].status.connection ? HCD_EVENT_DEVICE_ATTACH : HCD_EVENT_DEVICE_REMOVE,
+        .connection =
+        {
+          .hub_addr = daddr,
+          .hub_port = port
+        }
+      };
+
+      hcd_event_handler(&event, false);
+    }
+  }
 
-  hcd_event_handler(&event, false);
+  p_hub->port_clearing[port]--;
+  if ( p_hub->port_clearing[port] == 0 ) port_done(daddr, port);
 }
 
 #endif
@@ -42,6 +42,11 @@
  extern "C" {
 #endif
 
+// Max number of downstream ports per hub, additional ports are not used
+#ifndef CFG_TUH_HUB_PORT_MAX
+#define CFG_TUH_HUB_PORT_MAX  7
+#endif
+
 //D1...D0: Logical Power Switching Mode
 //00:  Ganged power switching (all ports’power at
 //once)
@@ -45,6 +45,79 @@
 #define CFG_TUH_INTERFACE_MAX   8
 #endif
 
+// Controllers having a queue head/endpoint descriptor per device (EHCI, OHCI) can carry out control transfers
+// of different devices concurrently. Others share a single control pipe, their control transfers are executed one by one.
+#ifndef CFG_TUH_CONTROL_CONCURRENT
+  #if defined(TUP_USBIP_EHCI) || defined(TUP_USBIP_OHCI)
+    #define CFG_TUH_CONTROL_CONCURRENT  1
+  #else
+    #define CFG_TUH_CONTROL_CONCURRENT  0
+  #endif
+#endif
+
+// Max number of transfers submitted to a non-control endpoint at a time, completed in submission order. Keeping the
+// next transfers queued avoids idling the bus between a completion and the next submission.
+#ifndef CFG_TUH_EDPT_XFER_MAX
+#define CFG_TUH_EDPT_XFER_MAX   1
+#endif
+
+// Controllers chaining transfer descriptors of an endpoint (EHCI, OHCI) accept transfers while previous ones of the
+// same endpoint are in progress and complete them in order. Otherwise queued transfers are kept by usbh, each one is
+// submitted as soon as the previous one completes.
+#ifndef CFG_TUH_HCD_EDPT_QUEUE
+  #if defined(TUP_USBIP_EHCI) || defined(TUP_USBIP_OHCI)
+    #define CFG_TUH_HCD_EDPT_QUEUE  1
+  #else
+    #define CFG_TUH_HCD_EDPT_QUEUE  0
+  #endif
+#endif
+
+#define USBH_EDPT_QUEUE      (CFG_TUH_EDPT_XFER_MAX > 1)
+#define USBH_EDPT_QUEUE_SW   (USBH_EDPT_QUEUE && !CFG_TUH_HCD_EDPT_QUEUE)
+#define USBH_EDPT_XFER_ENTRY (CFG_TUH_API_EDPT_XFER || USBH_EDPT_QUEUE_SW)
+
+// Alignment and granularity of buffers allocated by usbh_buf_alloc(). Should be a multiple of the data cache line size
+// so that cache maintenance of a buffer never affects data next to it.
+#ifndef CFG_TUH_MEM_POOL_ALIGN
+#define CFG_TUH_MEM_POOL_ALIGN  32
+#endif
+
+#define USBH_POOL_ROUNDUP(_size)  ((((_size) + CFG_TUH_MEM_POOL_ALIGN - 1) / CFG_TUH_MEM_POOL_ALIGN) * CFG_TUH_MEM_POOL_ALIGN)
+
+#if CFG_TUH_HID
+  #define USBH_POOL_HID  (CFG_TUH_HID * (USBH_POOL_ROUNDUP(CFG_TUH_HID_EPIN_BUFSIZE) + USBH_POOL_ROUNDUP(CFG_TUH_HID_EPOUT_BUFSIZE)))
+#else
+  #define USBH_POOL_HID  0
+#endif
+
+#if CFG_TUH_CDC
+  #define USBH_POOL_CDC  (CFG_TUH_CDC * (USBH_POOL_ROUNDUP(CFG_TUH_CDC_TX_EPSIZE) + \
+                          (1 + CFG_TUH_CDC_RX_DOUBLE_BUFFER) * USBH_POOL_ROUNDUP(CFG_TUH_CDC_RX_EPSIZE)))
+#else
+  #define USBH_POOL_CDC  0
+#endif
+
+// Memory pool for endpoint buffers of class drivers, buffers are allocated when an interface is opened and released
+// when its device is removed. Default keeps the worst case of all class interfaces (CFG_TUH_HID, CFG_TUH_CDC ...)
+// opened at once, same footprint as dedicated buffers. See tusb_option.h for sizing it down.
+#ifndef CFG_TUH_MEM_POOL_SIZE
+  #define CFG_TUH_MEM_POOL_SIZE  (USBH_POOL_HID + USBH_POOL_CDC)
+  #define USBH_POOL_ENABLED      (CFG_TUH_HID || CFG_TUH_CDC)
+#else
+  #define USBH_POOL_ENABLED      (CFG_TUH_MEM_POOL_SIZE > 0)
+#endif
+
+// Number of device models whose configuration, string (except serial number) and HID report descriptors are kept to
+// skip requesting them again when a device with the same device descriptor is attached, 0 to disable
+#ifndef CFG_TUH_DESC_CACHE
+#define CFG_TUH_DESC_CACHE  0
+#endif
+
+// Bytes of descriptors kept per device model, descriptors not fitting are requested from device as usual
+#ifndef CFG_TUH_DESC_CACHE_BUFSIZE
+#define CFG_TUH_DESC_CACHE_BUFSIZE  (2*CFG_TUH_ENUMERATION_BUFSIZE)
+#endif
+
 // Debug level, TUSB_CFG_DEBUG must be at least this level for debug message
 #define USBH_DEBUG   2
 
@@ -62,7 +135,7 @@ typedef struct
   uint8_t hub_port;
   uint8_t speed;
 
-  // enumeration is in progress, done when all interfaces are configured
+  // address 0 is in use, done once the address is set
   volatile uint8_t enumerating;
 
 //  struct TU_ATTR_PACKED {
@@ -72,6 +145,29 @@ typedef struct
 //  };
 } usbh_dev0_t;
 
+#if USBH_EDPT_XFER_ENTRY
+// Submitted transfer of a non-control endpoint
+typedef struct {
+#if CFG_TUH_API_EDPT_XFER
+  tuh_xfer_cb_t complete_cb;
+  uintptr_t user_data;
+  uint32_t deadline;  // frame number, only valid if has_deadline is set
+  bool has_deadline;
+#endif
+
+#if USBH_EDPT_QUEUE_SW
+  uint8_t* buffer;    // submitted to controller once the previous transfer is complete
+  uint16_t buflen;
+#endif
+} usbh_edpt_xfer_t;
+#endif
+
+// Callback of a completed transfer of a non-control endpoint
+typedef struct {
+  tuh_xfer_cb_t complete_cb;
+  uintptr_t user_data;
+} usbh_edpt_cb_t;
+
 typedef struct {
   // port, must be same layout as usbh_dev0_t
   uint8_t rhport;
@@ -85,6 +181,7 @@ typedef struct {
     volatile uint8_t addressed  : 1; // After SET_ADDR
     volatile uint8_t configured : 1; // After SET_CONFIG and all drivers are configured
     volatile uint8_t suspended  : 1; // Bus suspended
+    volatile uint8_t enum_wait  : 1; // After SET_ADDR, waiting for an enumeration buffer
 
     // volatile uint8_t removing : 1; // Physically disconnected, waiting to be processed by usbh
   };
@@ -99,6 +196,10 @@ typedef struct {
   uint8_t  i_product;
   uint8_t  i_serial;
 
+#if CFG_TUH_DESC_CACHE
+  uint8_t  desc_cache; // index + 1 of descriptor cache entry, 0 if none
+#endif
+
   // Configuration Descriptor
   // uint8_t interface_count; // bNumInterfaces alias
 
@@ -108,12 +209,17 @@ typedef struct {
 
   tu_edpt_state_t ep_status[CFG_TUH_ENDPOINT_MAX][2];
 
-#if CFG_TUH_API_EDPT_XFER
+#if USBH_EDPT_XFER_ENTRY
   // TODO array can be CFG_TUH_ENDPOINT_MAX-1
+  usbh_edpt_xfer_t ep_xfer[CFG_TUH_ENDPOINT_MAX][2][CFG_TUH_EDPT_XFER_MAX]; // ring of submitted transfers
+#endif
+
+#if USBH_EDPT_QUEUE
+  // submitted transfers of an endpoint, oldest (in progress) first. busy is set while there is any
   struct {
-    tuh_xfer_cb_t complete_cb;
-    uintptr_t user_data;
-  }ep_callback[CFG_TUH_ENDPOINT_MAX][2];
+    uint8_t head;
+    uint8_t count;
+  } ep_queue[CFG_TUH_ENDPOINT_MAX][2];
 #endif
 
 } usbh_device_t;
@@ -189,6 +295,9 @@ enum { USBH_CLASS_DRIVER_COUNT = TU_ARRAY_SIZE(usbh_class_drivers) };
 
 enum { RESET_DELAY = 500 };  // 200 USB specs say only 50ms but many devices require much longer
 
+// Port reset duration and recovery time before the device must respond at address 0 (USB 2.0 7.1.7.5)
+enum { PORT_RESET_DELAY = 50, RESET_RECOVERY_DELAY = 10 };
+
 enum { CONFIG_NUM = 1 }; // default to use configuration 1
 
 
@@ -199,6 +308,40 @@ enum { CONFIG_NUM = 1 }; // default to use configuration 1
 // sum of end device + hub
 #define TOTAL_DEVICES   (CFG_TUH_DEVICE_MAX + CFG_TUH_HUB)
 
+// Max number of submitted (queued or in progress) control transfers, default to one per device including address 0
+#ifndef CFG_TUH_CONTROL_XFER_MAX
+#define CFG_TUH_CONTROL_XFER_MAX   (TOTAL_DEVICES + 1)
+#endif
+
+// Control transfers not completed within this time are aborted with XFER_RESULT_TIMEOUT unless the transfer specifies
+// its own timeout_ms (USB 2.0 9.2.6.4: standard requests must complete within 5 seconds).
+// Timeouts require the controller to support hcd_edpt_abort_xfer().
+#ifndef CFG_TUH_CONTROL_TIMEOUT_MS
+#define CFG_TUH_CONTROL_TIMEOUT_MS       5000
+#endif
+
+// Number of times a control transfer is retried after a transaction error or timeout, stalled ones are never retried
+#ifndef CFG_TUH_CONTROL_RETRY_MAX
+#define CFG_TUH_CONTROL_RETRY_MAX        0
+#endif
+
+// Delay before retrying a failed control transfer, other devices can use the control pipe in the meantime
+#ifndef CFG_TUH_CONTROL_RETRY_DELAY_MS
+#define CFG_TUH_CONTROL_RETRY_DELAY_MS   10
+#endif
+
+// Max number of devices enumerated concurrently once their address is set, each one uses an enumeration
+// buffer of CFG_TUH_ENUMERATION_BUFSIZE. Address 0 is always used by one device at a time.
+#ifndef CFG_TUH_ENUMERATION_MAX
+#define CFG_TUH_ENUMERATION_MAX    1
+#endif
+
+// Max number of pending delayed function calls e.g debouncing of attached devices, enumeration and its retries,
+// serial state reporting of CDC interfaces
+#ifndef CFG_TUH_TIMER_MAX
+#define CFG_TUH_TIMER_MAX          (TOTAL_DEVICES + CFG_TUH_ENUMERATION_MAX + CFG_TUH_CDC + 1)
+#endif
+
 static uint8_t _usbh_controller = TUSB_INDEX_INVALID_8;
 
 // Device with address = 0 for enumeration
@@ -222,23 +365,119 @@ static usbh_device_t _usbh_devices[TOTAL_DEVICES];
 OSAL_QUEUE_DEF(usbh_int_set, _usbh_qdef, CFG_TUH_TASK_QUEUE_SZ, hcd_event_t);
 static osal_queue_t _usbh_q;
 
+// Enumeration buffers of addressed devices, device at address 0 only needs its first 8 bytes of device descriptor.
+// Its buffer still holds a whole device descriptor to be accessed as one, and is padded to the data cache line size
+// since it is a DMA target.
+CFG_TUH_MEM_SECTION CFG_TUH_MEM_ALIGN
+static uint8_t _usbh_ctrl_buf[CFG_TUH_ENUMERATION_MAX][CFG_TUH_ENUMERATION_BUFSIZE];
+
+CFG_TUH_MEM_SECTION CFG_TUH_MEM_ALIGN TU_ATTR_ALIGNED(CFG_TUH_MEM_POOL_ALIGN)
+static uint8_t _dev0_buf[USBH_POOL_ROUNDUP(sizeof(tusb_desc_device_t))];
+
+// Buffer for control transfers of class drivers of devices which are not enumerating e.g. mounted ones, since the
+// enumeration buffers may be in use by other devices at the same time
 CFG_TUH_MEM_SECTION CFG_TUH_MEM_ALIGN
-static uint8_t _usbh_ctrl_buf[CFG_TUH_ENUMERATION_BUFSIZE];
+static uint8_t _usbh_mounted_buf[CFG_TUH_ENUMERATION_BUFSIZE];
+
+#if USBH_POOL_ENABLED
+enum { USBH_POOL_BLOCKS = USBH_POOL_ROUNDUP(CFG_TUH_MEM_POOL_SIZE) / CFG_TUH_MEM_POOL_ALIGN };
+
+CFG_TUH_MEM_SECTION TU_ATTR_ALIGNED(CFG_TUH_MEM_POOL_ALIGN)
+static uint8_t _usbh_pool[USBH_POOL_BLOCKS][CFG_TUH_MEM_POOL_ALIGN];
+
+// Address of the device owning each pool block, 0 if free
+static uint8_t _usbh_pool_owner[USBH_POOL_BLOCKS];
+#endif
 
-// Control transfers: since most controllers do not support multiple control transfers
-// on multiple devices concurrently and control transfers are not used much except for
-// enumeration, we will only execute control transfers one at a time.
-CFG_TUH_MEM_SECTION struct
+// Control transfers are submitted to a pool and executed in submission order. Each device has only one control
+// pipe, therefore at most one transfer per device is in progress. If the controller does not support concurrent
+// control transfers (CFG_TUH_CONTROL_CONCURRENT = 0), only one transfer of all devices is in progress.
+enum
+{
+  CTRL_XFER_FREE = 0,
+  CTRL_XFER_QUEUED,
+  CTRL_XFER_ACTIVE,
+  CTRL_XFER_RETRY  // failed, waiting to be queued again. Control pipe of the device is kept to preserve order
+};
+
+typedef struct
 {
   CFG_TUH_MEM_ALIGN tusb_control_request_t request;
   uint8_t* buffer;
   tuh_xfer_cb_t complete_cb;
   uintptr_t user_data;
 
+  uint32_t timeout_ms;
+  uint32_t deadline;    // frame number: timeout if active, retry if failed
+
   uint8_t daddr;
+  uint8_t state;
+  uint8_t retry_count;
   volatile uint8_t stage;
   volatile uint16_t actual_len;
-}_ctrl_xfer;
+} usbh_ctrl_xfer_t;
+
+CFG_TUH_MEM_SECTION static usbh_ctrl_xfer_t _ctrl_xfer[CFG_TUH_CONTROL_XFER_MAX];
+
+// Submission queue: index of queued transfers in _ctrl_xfer, oldest first
+static uint8_t _ctrl_queue[CFG_TUH_CONTROL_XFER_MAX];
+static uint8_t _ctrl_queue_count;
+
+#if CFG_TUH_API_EDPT_XFER
+// Upper bound of endpoint transfers with a deadline, devices are only scanned for timeouts if not zero
+static uint16_t _edpt_deadline_count;
+#endif
+
+// Delayed function calls, invoked by tuh_task() once the frame number reaches the deadline
+typedef struct
+{
+  osal_task_func_t func; // NULL if not used
+  void* param;
+  uint32_t deadline;
+} usbh_timer_t;
+
+static usbh_timer_t _usbh_timer[CFG_TUH_TIMER_MAX];
+
+#if CFG_TUH_ISO_STREAM_MAX
+// Running isochronous streams, completions of their endpoint are handled by the stream
+static tuh_iso_stream_t* _iso_stream[CFG_TUH_ISO_STREAM_MAX];
+#endif
+
+// Attached devices which are not addressed yet: they are debounced concurrently then wait for address 0
+enum
+{
+  ATTACH_FREE = 0,
+  ATTACH_DEBOUNCE,
+  ATTACH_READY
+};
+
+typedef struct
+{
+  uint8_t rhport;
+  uint8_t hub_addr;
+  uint8_t hub_port;
+  uint8_t state;
+} usbh_attach_t;
+
+static usbh_attach_t _usbh_attach[TOTAL_DEVICES];
+
+// Enumeration context, the first CFG_TUH_ENUMERATION_MAX are bound to addressed devices (with the same index of
+// _usbh_ctrl_buf), the last one to the device at address 0
+enum { ENUM_IDX_DEV0 = CFG_TUH_ENUMERATION_MAX };
+
+typedef struct
+{
+  uint8_t daddr;        // addressed device, 0 if not used
+  uint8_t gen;          // incremented for each device, completion of a previous one is ignored
+  uint8_t failed_count;
+  uint8_t delay_state;
+
+  // failed transfer to be retried
+  tusb_control_request_t retry_request;
+  tuh_xfer_t retry_xfer;
+} usbh_enum_t;
+
+static usbh_enum_t _usbh_enum[CFG_TUH_ENUMERATION_MAX + 1];
 
 //------------- Helper Function -------------//
 
@@ -249,10 +488,61 @@ static inline usbh_device_t* get_device(uint8_t dev_addr)
   return &_usbh_devices[dev_addr-1];
 }
 
-static bool enum_new_device(hcd_event_t* event);
+// Number of submitted transfers of a non-control endpoint
+TU_ATTR_ALWAYS_INLINE
+static inline uint8_t edpt_queue_count(usbh_device_t const* dev, uint8_t epnum, uint8_t dir)
+{
+#if USBH_EDPT_QUEUE
+  return dev->ep_queue[epnum][dir].count;
+#else
+  return dev->ep_status[epnum][dir].busy;
+#endif
+}
+
+#if USBH_EDPT_XFER_ENTRY
+// i-th oldest submitted transfer of a non-control endpoint
+TU_ATTR_ALWAYS_INLINE
+static inline usbh_edpt_xfer_t* edpt_queue_at(usbh_device_t* dev, uint8_t epnum, uint8_t dir, uint8_t i)
+{
+#if USBH_EDPT_QUEUE
+  return &dev->ep_xfer[epnum][dir][(dev->ep_queue[epnum][dir].head + i) % CFG_TUH_EDPT_XFER_MAX];
+#else
+  (void) i;
+  return &dev->ep_xfer[epnum][dir][0];
+#endif
+}
+#endif
+
+static void enum_attach(hcd_event_t const* event);
+static void enum_remove_port(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port);
+static void enum_abort_device(uint8_t daddr);
+static void enum_schedule(void);
 static void process_removing_device(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port);
+static uint32_t _xfer_timeout_process(void);
 static bool usbh_edpt_control_open(uint8_t dev_addr, uint8_t max_packet_size);
 static bool usbh_control_xfer_cb (uint8_t daddr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+static void _edpt_xfer_complete(uint8_t daddr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+static uint8_t _edpt_queue_flush(usbh_device_t* dev, uint8_t epnum, uint8_t dir, usbh_edpt_cb_t* cb);
+static bool _edpt_xfer_notify(uint8_t daddr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes,
+                              usbh_edpt_cb_t const* cb);
+
+#if CFG_TUH_DESC_CACHE
+static void desc_cache_reset(void);
+static void desc_cache_bind(uint8_t daddr, tusb_desc_device_t const* desc_device);
+static bool desc_cache_get(uint8_t daddr, tusb_control_request_t const* request, uint8_t* buffer, uint16_t* len);
+static void desc_cache_put(uint8_t daddr, tusb_control_request_t const* request, uint8_t const* data, uint16_t len);
+#endif
+
+#if CFG_TUH_STRINGS_FETCH_MAX
+static void strings_reset(void);
+static void strings_schedule(void);
+static void strings_remove_device(uint8_t daddr);
+#endif
+
+#if CFG_TUH_ISO_STREAM_MAX
+static bool iso_stream_xfer_cb(uint8_t daddr, uint8_t ep_addr);
+static void iso_stream_remove_device(uint8_t daddr);
+#endif
 
 #if CFG_TUSB_OS == OPT_OS_NONE
 // TODO rework time-related function later
@@ -324,7 +614,7 @@ bool tuh_init(uint8_t controller_id)
   TU_LOG_USBH("USBH init on controller %u\r\n", controller_id);
   TU_LOG_INT(USBH_DEBUG, sizeof(usbh_device_t));
   TU_LOG_INT(USBH_DEBUG, sizeof(hcd_event_t));
-  TU_LOG_INT(USBH_DEBUG, sizeof(_ctrl_xfer));
+  TU_LOG_INT(USBH_DEBUG, sizeof(usbh_ctrl_xfer_t));
   TU_LOG_INT(USBH_DEBUG, sizeof(tuh_xfer_t));
   TU_LOG_INT(USBH_DEBUG, sizeof(tu_fifo_t));
   TU_LOG_INT(USBH_DEBUG, sizeof(tu_edpt_stream_t));
@@ -342,7 +632,23 @@ bool tuh_init(uint8_t controller_id)
   // Device
   tu_memclr(&_dev0, sizeof(_dev0));
   tu_memclr(_usbh_devices, sizeof(_usbh_devices));
-  tu_memclr(&_ctrl_xfer, sizeof(_ctrl_xfer));
+  tu_memclr(_ctrl_xfer, sizeof(_ctrl_xfer));
+  _ctrl_queue_count = 0;
+#if CFG_TUH_API_EDPT_XFER
+  _edpt_deadline_count = 0;
+#endif
+  tu_memclr(_usbh_timer, sizeof(_usbh_timer));
+  tu_memclr(_usbh_attach, sizeof(_usbh_attach));
+  tu_memclr(_usbh_enum, sizeof(_usbh_enum));
+#if USBH_POOL_ENABLED
+  tu_memclr(_usbh_pool_owner, sizeof(_usbh_pool_owner));
+#endif
+#if CFG_TUH_DESC_CACHE
+  desc_cache_reset();
+#endif
+#if CFG_TUH_STRINGS_FETCH_MAX
+  strings_reset();
+#endif
 
   for(uint8_t i=0; i<TOTAL_DEVICES; i++)
   {
@@ -372,6 +678,113 @@ bool tuh_task_event_ready(void)
   return !osal_queue_empty(_usbh_q);
 }
 
+//--------------------------------------------------------------------+
+// Timer
+//--------------------------------------------------------------------+
+
+// Wake up usbh task to re-calculate its waiting time after a new deadline is set
+static void _usbh_task_wakeup(void)
+{
+#if CFG_TUSB_OS != OPT_OS_NONE && CFG_TUSB_OS != OPT_OS_PICO
+  hcd_event_t event =
+  {
+    .rhport   = _usbh_controller,
+    .event_id = USBH_EVENT_FUNC_CALL,
+  };
+  event.func_call.func  = NULL;
+  event.func_call.param = NULL;
+
+  osal_queue_send(_usbh_q, &event, false);
+#endif
+}
+
+bool usbh_defer_func_ms(osal_task_func_t func, void* param, uint32_t delay_ms)
+{
+  TU_ASSERT(func);
+
+  bool found = false;
+
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+
+  for(uint8_t i=0; i<CFG_TUH_TIMER_MAX; i++)
+  {
+    usbh_timer_t* timer = &_usbh_timer[i];
+    if ( timer->func == NULL )
+    {
+      timer->func     = func;
+      timer->param    = param;
+      timer->deadline = hcd_frame_number(_usbh_controller) + delay_ms;
+      found = true;
+      break;
+    }
+  }
+
+  (void) osal_mutex_unlock(_usbh_mutex);
+
+  TU_ASSERT(found);
+
+  _usbh_task_wakeup();
+
+  return true;
+}
+
+// Invoke expired timers, return milliseconds until the next deadline (UINT32_MAX if there is none)
+static uint32_t _timer_process(void)
+{
+  uint32_t wait_ms = UINT32_MAX;
+
+  for(uint8_t i=0; i<CFG_TUH_TIMER_MAX; i++)
+  {
+    (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+
+    usbh_timer_t const timer = _usbh_timer[i];
+    int32_t const remaining = (int32_t) (timer.deadline - hcd_frame_number(_usbh_controller));
+
+    // release before invoking since func can start a timer again
+    if ( timer.func && remaining <= 0 ) _usbh_timer[i].func = NULL;
+
+    (void) osal_mutex_unlock(_usbh_mutex);
+
+    if ( timer.func )
+    {
+      if ( remaining <= 0 )
+      {
+        timer.func(timer.param);
+      }else
+      {
+        wait_ms = tu_min32(wait_ms, (uint32_t) remaining);
+      }
+    }
+  }
+
+  return wait_ms;
+}
+
+// Cancel all pending calls with param
+static void _timer_cancel(void const* param)
+{
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+
+  for(uint8_t i=0; i<CFG_TUH_TIMER_MAX; i++)
+  {
+    if ( _usbh_timer[i].param == param ) _usbh_timer[i].func = NULL;
+  }
+
+  (void) osal_mutex_unlock(_usbh_mutex);
+}
+
+void usbh_defer_func_cancel(osal_task_func_t func, void* param)
+{
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+
+  for(uint8_t i=0; i<CFG_TUH_TIMER_MAX; i++)
+  {
+    if ( _usbh_timer[i].func == func && _usbh_timer[i].param == param ) _usbh_timer[i].func = NULL;
+  }
+
+  (void) osal_mutex_unlock(_usbh_mutex);
+}
+
 /* USB Host Driver task
  * This top level thread manages all host controller event and delegates events to class-specific drivers.
  * This should be called periodically within the mainloop or rtos thread.
@@ -400,38 +813,33 @@ void tuh_task_ext(uint32_t timeout_ms, bool in_isr)
   // Loop until there is no more events in the queue
   while (1)
   {
+    // Invoke expired timers, abort timed out transfers and wait for events no longer than until the next deadline
+    uint32_t const wait_ms = tu_min32(timeout_ms, tu_min32(_timer_process(), _xfer_timeout_process()));
+
     hcd_event_t event;
-    if ( !osal_queue_receive(_usbh_q, &event, timeout_ms) ) return;
+    if ( !osal_queue_receive(_usbh_q, &event, wait_ms) )
+    {
+#if CFG_TUSB_OS != OPT_OS_NONE && CFG_TUSB_OS != OPT_OS_PICO
+      // woken up for a timer
+      if ( wait_ms < timeout_ms )
+      {
+        if ( timeout_ms != OSAL_TIMEOUT_WAIT_FOREVER ) timeout_ms -= wait_ms;
+        continue;
+      }
+#endif
+      return;
+    }
 
     switch (event.event_id)
     {
       case HCD_EVENT_DEVICE_ATTACH:
-        // due to the shared _usbh_ctrl_buf, we must complete enumerating
-        // one device before enumerating another one.
-        if ( _dev0.enumerating )
-        {
-          TU_LOG_USBH("[%u:] USBH Defer Attach until current enumeration complete\r\n", event.rhport);
-          osal_queue_send(_usbh_q, &event, in_isr);
-        }else
-        {
-          TU_LOG_USBH("[%u:] USBH DEVICE ATTACH\r\n", event.rhport);
-          _dev0.enumerating = 1;
-          enum_new_device(&event);
-        }
+        TU_LOG_USBH("[%u:%u:%u] USBH DEVICE ATTACH\r\n", event.rhport, event.connection.hub_addr, event.connection.hub_port);
+        enum_attach(&event);
       break;
 
       case HCD_EVENT_DEVICE_REMOVE:
         TU_LOG_USBH("[%u:%u:%u] USBH DEVICE REMOVED\r\n", event.rhport, event.connection.hub_addr, event.connection.hub_port);
         process_removing_device(event.rhport, event.connection.hub_addr, event.connection.hub_port);
-
-        #if CFG_TUH_HUB
-        // TODO remove
-        if ( event.connection.hub_addr != 0)
-        {
-          // done with hub, waiting for next data on status pipe
-          (void) hub_edpt_status_xfer( event.connection.hub_addr );
-        }
-        #endif
       break;
 
       case HCD_EVENT_XFER_COMPLETE:
@@ -454,47 +862,22 @@ void tuh_task_ext(uint32_t timeout_ms, bool in_isr)
           usbh_device_t* dev = get_device(event.dev_addr);
           TU_VERIFY(dev && dev->connected, );
 
-          dev->ep_status[epnum][ep_dir].busy    = 0;
-          dev->ep_status[epnum][ep_dir].claimed = 0;
-
           if ( 0 == epnum )
           {
             usbh_control_xfer_cb(event.dev_addr, ep_addr, (xfer_result_t) event.xfer_complete.result, event.xfer_complete.len);
-          }else
+          }
+#if CFG_TUH_ISO_STREAM_MAX
+          else if ( iso_stream_xfer_cb(event.dev_addr, ep_addr) )
           {
-            uint8_t drv_id = dev->ep2drv[epnum][ep_dir];
-            if(drv_id < USBH_CLASS_DRIVER_COUNT)
-            {
-              TU_LOG_USBH("%s xfer callback\r\n", usbh_class_drivers[drv_id].name);
-              usbh_class_drivers[drv_id].xfer_cb(event.dev_addr, ep_addr, (xfer_result_t) event.xfer_complete.result, event.xfer_complete.len);
-            }
-            else
-            {
-#if CFG_TUH_API_EDPT_XFER
-              tuh_xfer_cb_t complete_cb = dev->ep_callback[epnum][ep_dir].complete_cb;
-              if ( complete_cb )
-              {
-                tuh_xfer_t xfer =
-                {
-                  .daddr       = event.dev_addr,
-                  .ep_addr     = ep_addr,
-                  .result      = event.xfer_complete.result,
-                  .actual_len  = event.xfer_complete.len,
-                  .buflen      = 0,    // not available
-                  .buffer      = NULL, // not available
-                  .complete_cb = complete_cb,
-                  .user_data   = dev->ep_callback[epnum][ep_dir].user_data
-                };
-
-                complete_cb(&xfer);
-              }else
-#endif
-              {
-                // no driver/callback responsible for this transfer
-                TU_ASSERT(false, );
-              }
+            // batch of an isochronous stream, already resubmitted
+          }
+#endif
+          else
+          {
+            // transfer was aborted or timed out after its completion had been queued
+            TU_VERIFY(dev->ep_status[epnum][ep_dir].busy, );
 
-            }
+            _edpt_xfer_complete(event.dev_addr, ep_addr, (xfer_result_t) event.xfer_complete.result, event.xfer_complete.len);
           }
         }
       }
@@ -518,115 +901,281 @@ void tuh_task_ext(uint32_t timeout_ms, bool in_isr)
 // Control transfer
 //--------------------------------------------------------------------+
 
-static void _control_blocking_complete_cb(tuh_xfer_t* xfer)
+// Find the control transfer in progress of a device
+static usbh_ctrl_xfer_t* _ctrl_xfer_get_active(uint8_t daddr)
 {
-  // update result
-  *((xfer_result_t*) xfer->user_data) = xfer->result;
+  for(uint8_t i=0; i<CFG_TUH_CONTROL_XFER_MAX; i++)
+  {
+    usbh_ctrl_xfer_t* ctrl = &_ctrl_xfer[i];
+    if ( ctrl->state == CTRL_XFER_ACTIVE && ctrl->daddr == daddr ) return ctrl;
+  }
+
+  return NULL;
 }
 
-// TODO timeout_ms is not supported yet
-bool tuh_control_xfer (tuh_xfer_t* xfer)
+// Check if the control pipe used by a device is available, must be called with mutex locked
+static bool _ctrl_pipe_available(uint8_t daddr)
 {
-  // EP0 with setup packet
-  TU_VERIFY(xfer->ep_addr == 0 && xfer->setup);
+  for(uint8_t i=0; i<CFG_TUH_CONTROL_XFER_MAX; i++)
+  {
+    usbh_ctrl_xfer_t const* ctrl = &_ctrl_xfer[i];
+    if ( ctrl->state == CTRL_XFER_ACTIVE && (!CFG_TUH_CONTROL_CONCURRENT || ctrl->daddr == daddr) ) return false;
 
-  // pre-check to help reducing mutex lock
-  TU_VERIFY(_ctrl_xfer.stage == CONTROL_STAGE_IDLE);
+    // transfer waiting for retry keeps its place but does not occupy a shared pipe
+    if ( ctrl->state == CTRL_XFER_RETRY && ctrl->daddr == daddr ) return false;
+  }
 
-  uint8_t const daddr = xfer->daddr;
+  return true;
+}
 
-  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+static void _xfer_complete(usbh_ctrl_xfer_t* ctrl, xfer_result_t result);
 
-  bool const is_idle = (_ctrl_xfer.stage == CONTROL_STAGE_IDLE);
-  if (is_idle)
+// Start queued control transfers whose control pipe is available, in submission order
+static void _ctrl_xfer_schedule(void)
+{
+  while(1)
   {
-    _ctrl_xfer.stage       = CONTROL_STAGE_SETUP;
-    _ctrl_xfer.daddr       = daddr;
-    _ctrl_xfer.actual_len  = 0;
-
-    _ctrl_xfer.request     = (*xfer->setup);
-    _ctrl_xfer.buffer      = xfer->buffer;
-    _ctrl_xfer.complete_cb = xfer->complete_cb;
-    _ctrl_xfer.user_data   = xfer->user_data;
-  }
+    usbh_ctrl_xfer_t* ctrl = NULL;
 
-  (void) osal_mutex_unlock(_usbh_mutex);
+    (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
 
-  TU_VERIFY(is_idle);
-  const uint8_t rhport = usbh_get_rhport(daddr);
+    for(uint8_t i=0; i<_ctrl_queue_count; i++)
+    {
+      usbh_ctrl_xfer_t* queued = &_ctrl_xfer[_ctrl_queue[i]];
+      if ( _ctrl_pipe_available(queued->daddr) )
+      {
+        ctrl = queued;
+        ctrl->state    = CTRL_XFER_ACTIVE;
+        ctrl->stage    = CONTROL_STAGE_SETUP;
+        ctrl->deadline = hcd_frame_number(_usbh_controller) + ctrl->timeout_ms;
+
+        // remove from queue
+        _ctrl_queue_count--;
+        memmove(&_ctrl_queue[i], &_ctrl_queue[i+1], _ctrl_queue_count - i);
+        break;
+      }
+    }
 
-  TU_LOG_USBH("[%u:%u] %s: ", rhport, daddr,
-              (xfer->setup->bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD && xfer->setup->bRequest <= TUSB_REQ_SYNCH_FRAME) ?
-                  tu_str_std_request[xfer->setup->bRequest] : "Class Request");
-  TU_LOG_PTR(USBH_DEBUG, xfer->setup);
-  TU_LOG_USBH("\r\n");
+    (void) osal_mutex_unlock(_usbh_mutex);
 
-  if (xfer->complete_cb)
-  {
-    TU_ASSERT( hcd_setup_send(rhport, daddr, (uint8_t const*) &_ctrl_xfer.request) );
-  }else
-  {
-    // blocking if complete callback is not provided
-    // change callback to internal blocking, and result as user argument
-    volatile xfer_result_t result = XFER_RESULT_INVALID;
+    if ( !ctrl ) return;
 
-    // use user_data to point to xfer_result_t
-    _ctrl_xfer.user_data   = (uintptr_t) &result;
-    _ctrl_xfer.complete_cb = _control_blocking_complete_cb;
+    uint8_t const daddr = ctrl->daddr;
+    const uint8_t rhport = usbh_get_rhport(daddr);
 
-    TU_ASSERT( hcd_setup_send(rhport, daddr, (uint8_t*) &_ctrl_xfer.request) );
+    TU_LOG_USBH("[%u:%u] %s: ", rhport, daddr,
+                (ctrl->request.bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD && ctrl->request.bRequest <= TUSB_REQ_SYNCH_FRAME) ?
+                    tu_str_std_request[ctrl->request.bRequest] : "Class Request");
+    TU_LOG_PTR(USBH_DEBUG, &ctrl->request);
+    TU_LOG_USBH("\r\n");
 
-    while (result == XFER_RESULT_INVALID) {
-      // Note: this can be called within an callback ie. part of tuh_task()
-      // therefore event with RTOS tuh_task() still need to be invoked
-      if (tuh_task_event_ready()) {
-        tuh_task();
-      }
-      // TODO probably some timeout to prevent hanged
+#if CFG_TUH_DESC_CACHE
+    uint16_t cached_len;
+    if ( desc_cache_get(daddr, &ctrl->request, ctrl->buffer, &cached_len) )
+    {
+      // complete as if status stage is done, callback is invoked by usbh task as for a transfer on the bus
+      TU_LOG_USBH("[%u:%u] Descriptor from cache\r\n", rhport, daddr);
+      ctrl->actual_len = cached_len;
+      ctrl->stage      = CONTROL_STAGE_ACK;
+      hcd_event_xfer_complete(daddr, 0x80, 0, XFER_RESULT_SUCCESS, false);
+      continue;
     }
+#endif
 
-    // update transfer result, user_data is expected to point to xfer_result_t
-    if (xfer->user_data != 0) {
-      *((xfer_result_t*) xfer->user_data) = result;
+    if ( !hcd_setup_send(rhport, daddr, (uint8_t const*) &ctrl->request) )
+    {
+      TU_LOG1("[%u:%u] Control setup failed\r\n", rhport, daddr);
+      _xfer_complete(ctrl, XFER_RESULT_FAILED);
     }
-    xfer->result     = result;
-    xfer->actual_len = _ctrl_xfer.actual_len;
   }
-
-  return true;
 }
 
-TU_ATTR_ALWAYS_INLINE static inline void _set_control_xfer_stage(uint8_t stage)
+static void _control_blocking_complete_cb(tuh_xfer_t* xfer)
 {
-  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
-  _ctrl_xfer.stage = stage;
-  (void) osal_mutex_unlock(_usbh_mutex);
+  // update result and length of the original transfer
+  tuh_xfer_t* orig = (tuh_xfer_t*) xfer->user_data;
+  orig->actual_len = xfer->actual_len;
+  orig->result     = xfer->result;
 }
 
-static void _xfer_complete(uint8_t daddr, xfer_result_t result)
+bool tuh_control_xfer (tuh_xfer_t* xfer)
 {
-  TU_LOG_USBH("\r\n");
+  // EP0 with setup packet
+  TU_VERIFY(xfer->ep_addr == 0 && xfer->setup);
 
-  // duplicate xfer since user can execute control transfer within callback
-  tusb_control_request_t const request = _ctrl_xfer.request;
-  tuh_xfer_t xfer_temp =
+  bool const blocking = (xfer->complete_cb == NULL);
+  if ( blocking ) xfer->result = XFER_RESULT_INVALID;
+
+  // Allocate a free slot and append it to the submission queue
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+
+  usbh_ctrl_xfer_t* ctrl = NULL;
+  for(uint8_t i=0; i<CFG_TUH_CONTROL_XFER_MAX; i++)
   {
-    .daddr       = daddr,
-    .ep_addr     = 0,
+    if ( _ctrl_xfer[i].state == CTRL_XFER_FREE )
+    {
+      ctrl = &_ctrl_xfer[i];
+
+      ctrl->state       = CTRL_XFER_QUEUED;
+      ctrl->stage       = CONTROL_STAGE_IDLE;
+      ctrl->daddr       = xfer->daddr;
+      ctrl->actual_len  = 0;
+      ctrl->retry_count = 0;
+      ctrl->timeout_ms  = xfer->timeout_ms ? xfer->timeout_ms : CFG_TUH_CONTROL_TIMEOUT_MS;
+
+      ctrl->request     = (*xfer->setup);
+      ctrl->buffer      = xfer->buffer;
+
+      // blocking if complete callback is not provided: change callback to internal blocking
+      // with the original transfer as user argument
+      ctrl->complete_cb = blocking ? _control_blocking_complete_cb : xfer->complete_cb;
+      ctrl->user_data   = blocking ? (uintptr_t) xfer : xfer->user_data;
+
+      _ctrl_queue[_ctrl_queue_count++] = i;
+      break;
+    }
+  }
+
+  (void) osal_mutex_unlock(_usbh_mutex);
+
+  // all slots are in use
+  TU_VERIFY(ctrl);
+
+  _ctrl_xfer_schedule();
+  if ( hcd_edpt_abort_xfer ) _usbh_task_wakeup();
+
+  if ( blocking )
+  {
+    while ( ((tuh_xfer_t volatile*) xfer)->result == XFER_RESULT_INVALID )
+    {
+      // Note: this can be called within an callback ie. part of tuh_task()
+      // therefore event with RTOS tuh_task() still need to be invoked
+      if (tuh_task_event_ready()) {
+        tuh_task();
+      }else {
+        // transfer is aborted with XFER_RESULT_TIMEOUT if the device does not respond
+        (void) _xfer_timeout_process();
+      }
+    }
+
+    // update transfer result, user_data is expected to point to xfer_result_t
+    if (xfer->user_data != 0) {
+      *((xfer_result_t*) xfer->user_data) = xfer->result;
+    }
+  }
+
+  return true;
+}
+
+TU_ATTR_ALWAYS_INLINE static inline void _set_control_xfer_stage(usbh_ctrl_xfer_t* ctrl, uint8_t stage)
+{
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+  ctrl->stage = stage;
+  (void) osal_mutex_unlock(_usbh_mutex);
+}
+
+static void _xfer_complete(usbh_ctrl_xfer_t* ctrl, xfer_result_t result)
+{
+  TU_LOG_USBH("\r\n");
+
+#if CFG_TUH_CONTROL_RETRY_MAX
+  // retry after transaction error or timeout, a stalled request will not succeed anyway
+  if ( (result == XFER_RESULT_FAILED || result == XFER_RESULT_TIMEOUT) && ctrl->retry_count < CFG_TUH_CONTROL_RETRY_MAX )
+  {
+    (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+    ctrl->retry_count++;
+    ctrl->actual_len = 0;
+    ctrl->stage      = CONTROL_STAGE_IDLE;
+    ctrl->state      = CTRL_XFER_RETRY;
+    ctrl->deadline   = hcd_frame_number(_usbh_controller) + CFG_TUH_CONTROL_RETRY_DELAY_MS;
+    (void) osal_mutex_unlock(_usbh_mutex);
+
+    TU_LOG_USBH("[%u] Control retry %u\r\n", ctrl->daddr, ctrl->retry_count);
+
+    // shared control pipe is available to other devices until then
+    _ctrl_xfer_schedule();
+    return;
+  }
+#endif
+
+  // duplicate xfer since the slot is freed before invoking callback, user can execute control transfer within callback
+  tusb_control_request_t const request = ctrl->request;
+  tuh_xfer_t xfer_temp =
+  {
+    .daddr       = ctrl->daddr,
+    .ep_addr     = 0,
     .result      = result,
     .setup       = &request,
-    .actual_len  = (uint32_t) _ctrl_xfer.actual_len,
-    .buffer      = _ctrl_xfer.buffer,
-    .complete_cb = _ctrl_xfer.complete_cb,
-    .user_data   = _ctrl_xfer.user_data
+    .actual_len  = (uint32_t) ctrl->actual_len,
+    .buffer      = ctrl->buffer,
+    .complete_cb = ctrl->complete_cb,
+    .user_data   = ctrl->user_data
   };
 
-  _set_control_xfer_stage(CONTROL_STAGE_IDLE);
+#if CFG_TUH_DESC_CACHE
+  if ( result == XFER_RESULT_SUCCESS ) desc_cache_put(ctrl->daddr, &request, ctrl->buffer, ctrl->actual_len);
+#endif
+
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+  ctrl->stage = CONTROL_STAGE_IDLE;
+  ctrl->state = CTRL_XFER_FREE;
+  (void) osal_mutex_unlock(_usbh_mutex);
+
+  // halt is cleared by device: resume endpoint in controller with data toggle reset to DATA0
+  if ( result == XFER_RESULT_SUCCESS &&
+       request.bmRequestType_bit.recipient == TUSB_REQ_RCPT_ENDPOINT &&
+       request.bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD &&
+       request.bRequest == TUSB_REQ_CLEAR_FEATURE && tu_le16toh(request.wValue) == TUSB_REQ_FEATURE_EDPT_HALT &&
+       tu_edpt_number((uint8_t) request.wIndex) != 0 )
+  {
+    (void) hcd_edpt_clear_stall(xfer_temp.daddr, (uint8_t) tu_le16toh(request.wIndex));
+  }
 
   if (xfer_temp.complete_cb)
   {
     xfer_temp.complete_cb(&xfer_temp);
   }
+
+  // control pipe is available for the next one
+  _ctrl_xfer_schedule();
+}
+
+// Abort all queued and on-going control transfers of a device without invoking callbacks, blocking transfers
+// return with XFER_RESULT_FAILED. Return true if any transfer was aborted.
+static bool _ctrl_xfer_abort_device(uint8_t daddr)
+{
+  bool aborted = false;
+
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+
+  uint8_t count = 0;
+  for(uint8_t i=0; i<_ctrl_queue_count; i++)
+  {
+    if ( _ctrl_xfer[_ctrl_queue[i]].daddr != daddr ) _ctrl_queue[count++] = _ctrl_queue[i];
+  }
+  _ctrl_queue_count = count;
+
+  for(uint8_t i=0; i<CFG_TUH_CONTROL_XFER_MAX; i++)
+  {
+    usbh_ctrl_xfer_t* ctrl = &_ctrl_xfer[i];
+    if ( ctrl->state != CTRL_XFER_FREE && ctrl->daddr == daddr )
+    {
+      if ( ctrl->complete_cb == _control_blocking_complete_cb )
+      {
+        tuh_xfer_t* orig = (tuh_xfer_t*) ctrl->user_data;
+        orig->actual_len = 0;
+        orig->result     = XFER_RESULT_FAILED;
+      }
+
+      ctrl->stage = CONTROL_STAGE_IDLE;
+      ctrl->state = CTRL_XFER_FREE;
+      aborted = true;
+    }
+  }
+
+  (void) osal_mutex_unlock(_usbh_mutex);
+
+  return aborted;
 }
 
 static bool usbh_control_xfer_cb (uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
@@ -634,7 +1183,11 @@ static bool usbh_control_xfer_cb (uint8_t dev_addr, uint8_t ep_addr, xfer_result
   (void) ep_addr;
 
   const uint8_t rhport = usbh_get_rhport(dev_addr);
-  tusb_control_request_t const * request = &_ctrl_xfer.request;
+
+  usbh_ctrl_xfer_t* ctrl = _ctrl_xfer_get_active(dev_addr);
+  TU_VERIFY(ctrl); // aborted e.g device is removed
+
+  tusb_control_request_t const * request = &ctrl->request;
 
   if (XFER_RESULT_SUCCESS != result)
   {
@@ -645,17 +1198,20 @@ static bool usbh_control_xfer_cb (uint8_t dev_addr, uint8_t ep_addr, xfer_result
     #endif
 
     // terminate transfer if any stage failed
-    _xfer_complete(dev_addr, result);
+    _xfer_complete(ctrl, result);
   }else
   {
-    switch(_ctrl_xfer.stage)
+    switch(ctrl->stage)
     {
       case CONTROL_STAGE_SETUP:
         if (request->wLength)
         {
           // DATA stage: initial data toggle is always 1
-          _set_control_xfer_stage(CONTROL_STAGE_DATA);
-          TU_ASSERT( hcd_edpt_xfer(rhport, dev_addr, tu_edpt_addr(0, request->bmRequestType_bit.direction), _ctrl_xfer.buffer, request->wLength) );
+          _set_control_xfer_stage(ctrl, CONTROL_STAGE_DATA);
+          if ( !hcd_edpt_xfer(rhport, dev_addr, tu_edpt_addr(0, request->bmRequestType_bit.direction), ctrl->buffer, request->wLength) )
+          {
+            _xfer_complete(ctrl, XFER_RESULT_FAILED);
+          }
           return true;
         }
         TU_ATTR_FALLTHROUGH;
@@ -664,18 +1220,21 @@ static bool usbh_control_xfer_cb (uint8_t dev_addr, uint8_t ep_addr, xfer_result
         if (request->wLength)
         {
           TU_LOG_USBH("[%u:%u] Control data:\r\n", rhport, dev_addr);
-          TU_LOG_MEM(USBH_DEBUG, _ctrl_xfer.buffer, xferred_bytes, 2);
+          TU_LOG_MEM(USBH_DEBUG, ctrl->buffer, xferred_bytes, 2);
         }
 
-        _ctrl_xfer.actual_len = (uint16_t) xferred_bytes;
+        ctrl->actual_len = (uint16_t) xferred_bytes;
 
         // ACK stage: toggle is always 1
-        _set_control_xfer_stage(CONTROL_STAGE_ACK);
-        TU_ASSERT( hcd_edpt_xfer(rhport, dev_addr, tu_edpt_addr(0, 1-request->bmRequestType_bit.direction), NULL, 0) );
+        _set_control_xfer_stage(ctrl, CONTROL_STAGE_ACK);
+        if ( !hcd_edpt_xfer(rhport, dev_addr, tu_edpt_addr(0, 1-request->bmRequestType_bit.direction), NULL, 0) )
+        {
+          _xfer_complete(ctrl, XFER_RESULT_FAILED);
+        }
       break;
 
       case CONTROL_STAGE_ACK:
-        _xfer_complete(dev_addr, result);
+        _xfer_complete(ctrl, result);
       break;
 
       default: return false;
@@ -685,10 +1244,151 @@ static bool usbh_control_xfer_cb (uint8_t dev_addr, uint8_t ep_addr, xfer_result
   return true;
 }
 
+//--------------------------------------------------------------------+
+// Transfer timeout
+//--------------------------------------------------------------------+
+
+#if CFG_TUH_API_EDPT_XFER
+static void _edpt_xfer_timeout(uint8_t daddr, uint8_t ep_addr)
+{
+  usbh_device_t* dev = get_device(daddr);
+  uint8_t const epnum = tu_edpt_number(ep_addr);
+  uint8_t const dir   = tu_edpt_dir(ep_addr);
+
+  TU_LOG1("[%u] Timeout on EP %02X\r\n", daddr, ep_addr);
+
+  // keep the endpoint busy if the controller could not take back the transfer
+  TU_VERIFY(hcd_edpt_abort_xfer(dev->rhport, daddr, ep_addr), );
+
+  // transfers queued after the timed out one are aborted along with it
+  usbh_edpt_cb_t cb[CFG_TUH_EDPT_XFER_MAX];
+  uint8_t const count = _edpt_queue_flush(dev, epnum, dir, cb);
+
+  for(uint8_t i=0; i<count; i++)
+  {
+    (void) _edpt_xfer_notify(daddr, ep_addr, i ? XFER_RESULT_FAILED : XFER_RESULT_TIMEOUT, 0, &cb[i]);
+  }
+}
+#endif
+
+// Abort transfers which reached their deadline and re-queue failed control transfers due for retry.
+// Return milliseconds until the next deadline (UINT32_MAX if there is none)
+static uint32_t _xfer_timeout_process(void)
+{
+  uint32_t wait_ms = UINT32_MAX;
+  bool requeued = false;
+
+  //------------- Control transfer -------------//
+  for(uint8_t i=0; i<CFG_TUH_CONTROL_XFER_MAX; i++)
+  {
+    usbh_ctrl_xfer_t* ctrl = &_ctrl_xfer[i];
+    bool timeout = false;
+
+    (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+
+    uint32_t const frame = hcd_frame_number(_usbh_controller);
+    bool const expired = ((int32_t) (ctrl->deadline - frame)) <= 0;
+
+    if ( ctrl->state == CTRL_XFER_RETRY && expired )
+    {
+      // ahead of other queued transfers
+      memmove(&_ctrl_queue[1], &_ctrl_queue[0], _ctrl_queue_count);
+      _ctrl_queue[0] = i;
+      _ctrl_queue_count++;
+
+      ctrl->state = CTRL_XFER_QUEUED;
+      requeued = true;
+    }
+    else if ( ctrl->state == CTRL_XFER_ACTIVE && expired && hcd_edpt_abort_xfer )
+    {
+      // mark as failed first: completion of the controller is ignored and it is not timed out twice
+      ctrl->state    = CTRL_XFER_RETRY;
+      ctrl->deadline = frame + CFG_TUH_CONTROL_RETRY_DELAY_MS;
+      timeout = true;
+    }
+
+    (void) osal_mutex_unlock(_usbh_mutex);
+
+    if ( timeout )
+    {
+      TU_LOG1("[%u] Control timeout\r\n", ctrl->daddr);
+      (void) hcd_edpt_abort_xfer(usbh_get_rhport(ctrl->daddr), ctrl->daddr, 0);
+      _xfer_complete(ctrl, XFER_RESULT_TIMEOUT);
+    }
+  }
+
+  if ( requeued ) _ctrl_xfer_schedule();
+
+  for(uint8_t i=0; i<CFG_TUH_CONTROL_XFER_MAX; i++)
+  {
+    usbh_ctrl_xfer_t const* ctrl = &_ctrl_xfer[i];
+    if ( ctrl->state == CTRL_XFER_RETRY || (ctrl->state == CTRL_XFER_ACTIVE && hcd_edpt_abort_xfer) )
+    {
+      int32_t const remaining = (int32_t) (ctrl->deadline - hcd_frame_number(_usbh_controller));
+      wait_ms = tu_min32(wait_ms, remaining > 0 ? (uint32_t) remaining : 0);
+    }
+  }
+
+  //------------- Endpoint transfer -------------//
+#if CFG_TUH_API_EDPT_XFER
+  if ( _edpt_deadline_count && hcd_edpt_abort_xfer )
+  {
+    // recounted while scanning, deadlines set in the meantime are counted at least once
+    (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+    _edpt_deadline_count = 0;
+    (void) osal_mutex_unlock(_usbh_mutex);
+
+    for(uint8_t dev_id=0; dev_id<TOTAL_DEVICES; dev_id++)
+    {
+      usbh_device_t* dev = &_usbh_devices[dev_id];
+      if ( !dev->connected ) continue;
+
+      for(uint8_t epnum=1; epnum<CFG_TUH_ENDPOINT_MAX; epnum++)
+      {
+        for(uint8_t dir=0; dir<2; dir++)
+        {
+          bool timeout = false;
+
+          (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+
+          // deadline of a queued transfer is counted from its submission but only enforced once it is in progress
+          uint8_t const count = edpt_queue_count(dev, epnum, dir);
+          for(uint8_t i=0; i<count; i++)
+          {
+            usbh_edpt_xfer_t* xfer = edpt_queue_at(dev, epnum, dir, i);
+            if ( !xfer->has_deadline ) continue;
+
+            int32_t const remaining = (int32_t) (xfer->deadline - hcd_frame_number(_usbh_controller));
+            if ( i == 0 && remaining <= 0 )
+            {
+              xfer->has_deadline = false;
+              timeout = true;
+            }else
+            {
+              _edpt_deadline_count++;
+              wait_ms = tu_min32(wait_ms, remaining > 0 ? (uint32_t) remaining : 0);
+            }
+          }
+
+          (void) osal_mutex_unlock(_usbh_mutex);
+
+          if ( timeout ) _edpt_xfer_timeout(dev_id+1, tu_edpt_addr(epnum, dir));
+        }
+      }
+    }
+  }
+#endif
+
+  return wait_ms;
+}
+
 //--------------------------------------------------------------------+
 //
 //--------------------------------------------------------------------+
 
+static bool _edpt_xfer(uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes,
+                       tuh_xfer_cb_t complete_cb, uintptr_t user_data, uint32_t timeout_ms);
+
 bool tuh_edpt_xfer(tuh_xfer_t* xfer)
 {
   uint8_t const daddr   = xfer->daddr;
@@ -698,7 +1398,7 @@ bool tuh_edpt_xfer(tuh_xfer_t* xfer)
 
   TU_VERIFY(usbh_edpt_claim(daddr, ep_addr));
 
-  if ( !usbh_edpt_xfer_with_callback(daddr, ep_addr, xfer->buffer, (uint16_t) xfer->buflen, xfer->complete_cb, xfer->user_data) )
+  if ( !_edpt_xfer(daddr, ep_addr, xfer->buffer, (uint16_t) xfer->buflen, xfer->complete_cb, xfer->user_data, xfer->timeout_ms) )
   {
     usbh_edpt_release(daddr, ep_addr);
     return false;
@@ -707,6 +1407,172 @@ bool tuh_edpt_xfer(tuh_xfer_t* xfer)
   return true;
 }
 
+bool tuh_edpt_abort_xfer(uint8_t daddr, uint8_t ep_addr)
+{
+  usbh_device_t* dev = get_device(daddr);
+  TU_VERIFY(dev && dev->connected);
+
+  uint8_t const epnum = tu_edpt_number(ep_addr);
+  uint8_t const dir   = tu_edpt_dir(ep_addr);
+
+  if ( 0 == epnum )
+  {
+    // the on-going one must be taken back from the controller first
+    if ( _ctrl_xfer_get_active(daddr) )
+    {
+      TU_VERIFY(hcd_edpt_abort_xfer && hcd_edpt_abort_xfer(dev->rhport, daddr, 0));
+    }
+
+    bool const aborted = _ctrl_xfer_abort_device(daddr);
+
+    // shared control pipe is available to other devices
+    _ctrl_xfer_schedule();
+
+    return aborted;
+  }
+
+  TU_VERIFY(dev->ep_status[epnum][dir].busy);
+  TU_VERIFY(hcd_edpt_abort_xfer && hcd_edpt_abort_xfer(dev->rhport, daddr, ep_addr));
+
+  // queued transfers are dropped as well
+  usbh_edpt_cb_t cb[CFG_TUH_EDPT_XFER_MAX];
+  (void) _edpt_queue_flush(dev, epnum, dir, cb);
+
+  TU_LOG_USBH("[%u] Aborted EP 0x%02x\r\n", daddr, ep_addr);
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Isochronous Stream
+//--------------------------------------------------------------------+
+#if CFG_TUH_ISO_STREAM_MAX
+
+static tuh_iso_stream_t** iso_stream_slot(uint8_t daddr, uint8_t ep_addr)
+{
+  for(uint8_t i=0; i<CFG_TUH_ISO_STREAM_MAX; i++)
+  {
+    tuh_iso_stream_t* stream = _iso_stream[i];
+    if ( stream && stream->daddr == daddr && stream->ep_addr == ep_addr ) return &_iso_stream[i];
+  }
+  return NULL;
+}
+
+static bool iso_stream_submit(tuh_iso_stream_t* stream, uint8_t batch)
+{
+  uint32_t const first = (uint32_t) batch * stream->batch_packets;
+
+  return hcd_edpt_iso_xfer(usbh_get_rhport(stream->daddr), stream->daddr, stream->ep_addr,
+                           stream->buffer + first * stream->packet_size, stream->packets + first, stream->batch_packets);
+}
+
+// Invoke callback of the completed batch then queue it again
+static bool iso_stream_xfer_cb(uint8_t daddr, uint8_t ep_addr)
+{
+  tuh_iso_stream_t** slot = iso_stream_slot(daddr, ep_addr);
+  TU_VERIFY(slot);
+
+  tuh_iso_stream_t* stream = *slot;
+  uint8_t const batch = stream->next_batch;
+  uint32_t const first = (uint32_t) batch * stream->batch_packets;
+
+  stream->next_batch = (uint8_t) ((batch + 1) % stream->batch_count);
+
+  if ( stream->complete_cb )
+  {
+    stream->complete_cb(stream, stream->buffer + first * stream->packet_size, stream->packets + first, stream->batch_packets);
+  }
+
+  // callback may have stopped the stream
+  if ( stream->running && !iso_stream_submit(stream, batch) )
+  {
+    TU_LOG_USBH("[%u] ISO stream EP 0x%02x: failed to resubmit\r\n", daddr, ep_addr);
+    (void) tuh_iso_stream_stop(stream);
+  }
+
+  return true;
+}
+
+static void iso_stream_remove_device(uint8_t daddr)
+{
+  for(uint8_t i=0; i<CFG_TUH_ISO_STREAM_MAX; i++)
+  {
+    if ( _iso_stream[i] && _iso_stream[i]->daddr == daddr )
+    {
+      _iso_stream[i]->running = false;
+      _iso_stream[i] = NULL;
+    }
+  }
+}
+
+bool tuh_iso_stream_start(tuh_iso_stream_t* stream)
+{
+  TU_VERIFY(hcd_edpt_iso_xfer && !stream->running);
+  TU_VERIFY(stream->batch_count && stream->batch_packets && stream->buffer && stream->packets);
+
+  usbh_device_t* dev = get_device(stream->daddr);
+  TU_VERIFY(dev && dev->connected);
+  TU_VERIFY(iso_stream_slot(stream->daddr, stream->ep_addr) == NULL);
+
+  tuh_iso_stream_t** slot = NULL;
+  for(uint8_t i=0; i<CFG_TUH_ISO_STREAM_MAX && !slot; i++)
+  {
+    if ( _iso_stream[i] == NULL ) slot = &_iso_stream[i];
+  }
+  TU_VERIFY(slot);
+
+  if ( tu_edpt_dir(stream->ep_addr) == TUSB_DIR_IN )
+  {
+    uint32_t const total = (uint32_t) stream->batch_count * stream->batch_packets;
+    for(uint32_t i=0; i<total; i++) stream->packets[i].length = stream->packet_size;
+  }
+
+  stream->next_batch = 0;
+  stream->running    = true;
+  *slot = stream;
+
+  for(uint8_t batch=0; batch<stream->batch_count; batch++)
+  {
+    if ( !iso_stream_submit(stream, batch) )
+    {
+      (void) tuh_iso_stream_stop(stream);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool tuh_iso_stream_stop(tuh_iso_stream_t* stream)
+{
+  tuh_iso_stream_t** slot = iso_stream_slot(stream->daddr, stream->ep_addr);
+  TU_VERIFY(slot && *slot == stream);
+
+  stream->running = false;
+  *slot = NULL;
+
+  // completions already queued are dropped since the endpoint is not busy
+  if ( hcd_edpt_abort_xfer ) (void) hcd_edpt_abort_xfer(usbh_get_rhport(stream->daddr), stream->daddr, stream->ep_addr);
+
+  return true;
+}
+
+#else
+
+bool tuh_iso_stream_start(tuh_iso_stream_t* stream)
+{
+  (void) stream;
+  return false;
+}
+
+bool tuh_iso_stream_stop(tuh_iso_stream_t* stream)
+{
+  (void) stream;
+  return false;
+}
+
+#endif
+
 //--------------------------------------------------------------------+
 // USBH API For Class Driver
 //--------------------------------------------------------------------+
@@ -717,9 +1583,57 @@ uint8_t usbh_get_rhport(uint8_t dev_addr)
   return dev ? dev->rhport : _dev0.rhport;
 }
 
-uint8_t* usbh_get_enum_buf(void)
+uint8_t* usbh_get_enum_buf(uint8_t dev_addr)
 {
-  return _usbh_ctrl_buf;
+  for(uint8_t idx=0; idx<CFG_TUH_ENUMERATION_MAX; idx++)
+  {
+    if ( dev_addr && _usbh_enum[idx].daddr == dev_addr ) return _usbh_ctrl_buf[idx];
+  }
+
+  // device is not enumerating e.g mounted device
+  return _usbh_mounted_buf;
+}
+
+void* usbh_buf_alloc(uint8_t dev_addr, uint16_t size)
+{
+#if USBH_POOL_ENABLED
+  TU_ASSERT(dev_addr && size, NULL);
+
+  uint16_t const count = (uint16_t) USBH_POOL_ROUNDUP(size) / CFG_TUH_MEM_POOL_ALIGN;
+  uint16_t free_count = 0;
+
+  // first fit
+  for(uint16_t i=0; i<USBH_POOL_BLOCKS; i++)
+  {
+    free_count = _usbh_pool_owner[i] ? 0 : (uint16_t) (free_count + 1);
+
+    if ( free_count == count )
+    {
+      uint16_t const first = (uint16_t) (i + 1 - count);
+      memset(&_usbh_pool_owner[first], dev_addr, count);
+      return _usbh_pool[first];
+    }
+  }
+
+  TU_LOG_USBH("[%u] Buffer pool exhausted, %u bytes requested\r\n", dev_addr, size);
+#else
+  (void) dev_addr; (void) size;
+#endif
+
+  return NULL;
+}
+
+// Release all buffers of a removed device
+static void buf_free_device(uint8_t dev_addr)
+{
+#if USBH_POOL_ENABLED
+  for(uint16_t i=0; i<USBH_POOL_BLOCKS; i++)
+  {
+    if ( _usbh_pool_owner[i] == dev_addr ) _usbh_pool_owner[i] = 0;
+  }
+#else
+  (void) dev_addr;
+#endif
 }
 
 void usbh_int_set(bool enabled)
@@ -738,78 +1652,285 @@ void usbh_int_set(bool enabled)
 // Endpoint API
 //--------------------------------------------------------------------+
 
-// TODO has some duplication code with device, refactor later
-bool usbh_edpt_claim(uint8_t dev_addr, uint8_t ep_addr)
+// TODO has some duplication code with device, refactor later
+bool usbh_edpt_claim(uint8_t dev_addr, uint8_t ep_addr)
+{
+  // Note: addr0 only use tuh_control_xfer
+  usbh_device_t* dev = get_device(dev_addr);
+  TU_ASSERT(dev && dev->connected);
+
+  uint8_t const epnum = tu_edpt_number(ep_addr);
+  uint8_t const dir   = tu_edpt_dir(ep_addr);
+
+#if USBH_EDPT_QUEUE
+  // endpoint can be claimed while its queue has room, it is only claimed until the transfer is submitted
+  tu_edpt_state_t* ep_state = &dev->ep_status[epnum][dir];
+
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+  bool const available = !ep_state->claimed && edpt_queue_count(dev, epnum, dir) < CFG_TUH_EDPT_XFER_MAX;
+  if ( available ) ep_state->claimed = 1;
+  (void) osal_mutex_unlock(_usbh_mutex);
+
+  TU_VERIFY(available);
+#else
+  TU_VERIFY(tu_edpt_claim(&dev->ep_status[epnum][dir], _usbh_mutex));
+#endif
+  TU_LOG_USBH("[%u] Claimed EP 0x%02x\r\n", dev_addr, ep_addr);
+
+  return true;
+}
+
+// TODO has some duplication code with device, refactor later
+bool usbh_edpt_release(uint8_t dev_addr, uint8_t ep_addr)
+{
+  // Note: addr0 only use tuh_control_xfer
+  usbh_device_t* dev = get_device(dev_addr);
+  TU_VERIFY(dev && dev->connected);
+
+  uint8_t const epnum = tu_edpt_number(ep_addr);
+  uint8_t const dir   = tu_edpt_dir(ep_addr);
+
+#if USBH_EDPT_QUEUE
+  // other transfers may still be in progress
+  tu_edpt_state_t* ep_state = &dev->ep_status[epnum][dir];
+
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+  bool const claimed = ep_state->claimed;
+  ep_state->claimed = 0;
+  (void) osal_mutex_unlock(_usbh_mutex);
+
+  TU_VERIFY(claimed);
+#else
+  TU_VERIFY(tu_edpt_release(&dev->ep_status[epnum][dir], _usbh_mutex));
+#endif
+  TU_LOG_USBH("[%u] Released EP 0x%02x\r\n", dev_addr, ep_addr);
+
+  return true;
+}
+
+bool usbh_edpt_xfer_with_callback(uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes,
+                                  tuh_xfer_cb_t complete_cb, uintptr_t user_data)
+{
+  return _edpt_xfer(dev_addr, ep_addr, buffer, total_bytes, complete_cb, user_data, 0);
+}
+
+// TODO has some duplication code with device, refactor later
+static bool _edpt_xfer(uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes,
+                       tuh_xfer_cb_t complete_cb, uintptr_t user_data, uint32_t timeout_ms)
+{
+  (void) complete_cb;
+  (void) user_data;
+  (void) timeout_ms;
+
+  usbh_device_t* dev = get_device(dev_addr);
+  TU_VERIFY(dev);
+
+  uint8_t const epnum = tu_edpt_number(ep_addr);
+  uint8_t const dir   = tu_edpt_dir(ep_addr);
+  tu_edpt_state_t* ep_state = &dev->ep_status[epnum][dir];
+
+  TU_LOG_USBH("  Queue EP %02X with %u bytes ... ", ep_addr, total_bytes);
+
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+
+  uint8_t const queued = edpt_queue_count(dev, epnum, dir);
+  bool const available = (queued < CFG_TUH_EDPT_XFER_MAX);
+
+  if ( available )
+  {
+#if USBH_EDPT_XFER_ENTRY
+    // entry is set before submitting since the transfer can complete before hcd_edpt_xfer() returns
+    usbh_edpt_xfer_t* xfer = edpt_queue_at(dev, epnum, dir, queued);
+  #if CFG_TUH_API_EDPT_XFER
+    xfer->complete_cb  = complete_cb;
+    xfer->user_data    = user_data;
+    xfer->has_deadline = (timeout_ms != 0);
+    if ( timeout_ms )
+    {
+      xfer->deadline = hcd_frame_number(_usbh_controller) + timeout_ms;
+      _edpt_deadline_count++;
+    }
+  #endif
+  #if USBH_EDPT_QUEUE_SW
+    xfer->buffer = buffer;
+    xfer->buflen = total_bytes;
+  #endif
+#endif
+
+    // Set busy first since the actual transfer can be complete before hcd_edpt_xfer()
+    // could return and USBH task can preempt and clear the busy
+    ep_state->busy = 1;
+
+#if USBH_EDPT_QUEUE
+    dev->ep_queue[epnum][dir].count++;
+    ep_state->claimed = 0;
+#endif
+  }
+
+  (void) osal_mutex_unlock(_usbh_mutex);
+
+  // Attempt to transfer on a busy endpoint (all queue slots in use), sound like an race condition !
+  TU_ASSERT(available);
+
+#if USBH_EDPT_QUEUE_SW
+  if ( queued )
+  {
+    // submitted once the previous transfers are complete
+    TU_LOG_USBH("Queued\r\n");
+    return true;
+  }
+#endif
+
+  if ( hcd_edpt_xfer(dev->rhport, dev_addr, ep_addr, buffer, total_bytes) )
+  {
+    TU_LOG_USBH("OK\r\n");
+    if ( timeout_ms && hcd_edpt_abort_xfer ) _usbh_task_wakeup();
+    return true;
+  }else
+  {
+    // HCD error, drop the transfer to allow next one
+    (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+#if CFG_TUH_API_EDPT_XFER
+    edpt_queue_at(dev, epnum, dir, queued)->has_deadline = false;
+#endif
+#if USBH_EDPT_QUEUE
+    if ( --dev->ep_queue[epnum][dir].count == 0 ) ep_state->busy = 0;
+#else
+    ep_state->busy = 0;
+#endif
+    ep_state->claimed = 0;
+    (void) osal_mutex_unlock(_usbh_mutex);
+
+    TU_LOG1("Failed\r\n");
+    TU_BREAKPOINT();
+    return false;
+  }
+}
+
+// Remove all submitted transfers of an endpoint and release it. Callbacks of the removed transfers are saved to cb
+// (up to CFG_TUH_EDPT_XFER_MAX) in submission order, return their count.
+static uint8_t _edpt_queue_flush(usbh_device_t* dev, uint8_t epnum, uint8_t dir, usbh_edpt_cb_t* cb)
 {
-  // Note: addr0 only use tuh_control_xfer
-  usbh_device_t* dev = get_device(dev_addr);
-  TU_ASSERT(dev && dev->connected);
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
 
-  uint8_t const epnum = tu_edpt_number(ep_addr);
-  uint8_t const dir   = tu_edpt_dir(ep_addr);
+  uint8_t const count = edpt_queue_count(dev, epnum, dir);
+  for(uint8_t i=0; i<count; i++)
+  {
+#if CFG_TUH_API_EDPT_XFER
+    usbh_edpt_xfer_t* xfer = edpt_queue_at(dev, epnum, dir, i);
+    xfer->has_deadline = false;
+    cb[i].complete_cb  = xfer->complete_cb;
+    cb[i].user_data    = xfer->user_data;
+#else
+    cb[i].complete_cb  = NULL;
+    cb[i].user_data    = 0;
+#endif
+  }
 
-  TU_VERIFY(tu_edpt_claim(&dev->ep_status[epnum][dir], _usbh_mutex));
-  TU_LOG_USBH("[%u] Claimed EP 0x%02x\r\n", dev_addr, ep_addr);
+#if USBH_EDPT_QUEUE
+  dev->ep_queue[epnum][dir].head  = 0;
+  dev->ep_queue[epnum][dir].count = 0;
+#endif
+  dev->ep_status[epnum][dir].busy    = 0;
+  dev->ep_status[epnum][dir].claimed = 0;
 
-  return true;
+  (void) osal_mutex_unlock(_usbh_mutex);
+
+  return count;
 }
 
-// TODO has some duplication code with device, refactor later
-bool usbh_edpt_release(uint8_t dev_addr, uint8_t ep_addr)
+// Invoke class driver or application callback of a transfer on a non-control endpoint, false if there is none
+static bool _edpt_xfer_notify(uint8_t daddr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes,
+                              usbh_edpt_cb_t const* cb)
 {
-  // Note: addr0 only use tuh_control_xfer
-  usbh_device_t* dev = get_device(dev_addr);
-  TU_VERIFY(dev && dev->connected);
+  usbh_device_t const* dev = get_device(daddr);
+  TU_VERIFY(dev);
 
-  uint8_t const epnum = tu_edpt_number(ep_addr);
-  uint8_t const dir   = tu_edpt_dir(ep_addr);
+  uint8_t const drv_id = dev->ep2drv[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
 
-  TU_VERIFY(tu_edpt_release(&dev->ep_status[epnum][dir], _usbh_mutex));
-  TU_LOG_USBH("[%u] Released EP 0x%02x\r\n", dev_addr, ep_addr);
+  if ( drv_id < USBH_CLASS_DRIVER_COUNT )
+  {
+    TU_LOG_USBH("%s xfer callback\r\n", usbh_class_drivers[drv_id].name);
+    usbh_class_drivers[drv_id].xfer_cb(daddr, ep_addr, result, xferred_bytes);
+    return true;
+  }
+
+  TU_VERIFY(cb->complete_cb);
+
+  tuh_xfer_t xfer =
+  {
+    .daddr       = daddr,
+    .ep_addr     = ep_addr,
+    .result      = result,
+    .actual_len  = xferred_bytes,
+    .buflen      = 0,    // not available
+    .buffer      = NULL, // not available
+    .complete_cb = cb->complete_cb,
+    .user_data   = cb->user_data
+  };
 
+  cb->complete_cb(&xfer);
   return true;
 }
 
-// TODO has some duplication code with device, refactor later
-bool usbh_edpt_xfer_with_callback(uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes,
-                                  tuh_xfer_cb_t complete_cb, uintptr_t user_data)
+// Oldest transfer of an endpoint is complete. The next queued one is started before invoking callback, those queued
+// after a failed transfer are aborted and complete with XFER_RESULT_FAILED since the endpoint is halted or unresponsive.
+static void _edpt_xfer_complete(uint8_t daddr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
 {
-  (void) complete_cb;
-  (void) user_data;
-
-  usbh_device_t* dev = get_device(dev_addr);
-  TU_VERIFY(dev);
-
+  usbh_device_t* dev = get_device(daddr);
   uint8_t const epnum = tu_edpt_number(ep_addr);
   uint8_t const dir   = tu_edpt_dir(ep_addr);
-  tu_edpt_state_t* ep_state = &dev->ep_status[epnum][dir];
-
-  TU_LOG_USBH("  Queue EP %02X with %u bytes ... ", ep_addr, total_bytes);
 
-  // Attempt to transfer on a busy endpoint, sound like an race condition !
-  TU_ASSERT(ep_state->busy == 0);
+  // completed one then the aborted ones, more may be queued by other tasks in the meantime
+  usbh_edpt_cb_t cb[1 + CFG_TUH_EDPT_XFER_MAX] = { { NULL, 0 } };
 
-  // Set busy first since the actual transfer can be complete before hcd_edpt_xfer()
-  // could return and USBH task can preempt and clear the busy
-  ep_state->busy = 1;
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
 
 #if CFG_TUH_API_EDPT_XFER
-  dev->ep_callback[epnum][dir].complete_cb = complete_cb;
-  dev->ep_callback[epnum][dir].user_data   = user_data;
+  usbh_edpt_xfer_t* xfer = edpt_queue_at(dev, epnum, dir, 0);
+  xfer->has_deadline = false;
+  cb[0].complete_cb  = xfer->complete_cb;
+  cb[0].user_data    = xfer->user_data;
 #endif
 
-  if ( hcd_edpt_xfer(dev->rhport, dev_addr, ep_addr, buffer, total_bytes) )
+#if USBH_EDPT_QUEUE
+  dev->ep_queue[epnum][dir].head = (uint8_t) ((dev->ep_queue[epnum][dir].head + 1) % CFG_TUH_EDPT_XFER_MAX);
+  uint8_t const remaining = --dev->ep_queue[epnum][dir].count;
+#else
+  uint8_t const remaining = 0;
+#endif
+
+  if ( remaining == 0 )
   {
-    TU_LOG_USBH("OK\r\n");
-    return true;
-  }else
+    dev->ep_status[epnum][dir].busy = 0;
+#if !USBH_EDPT_QUEUE
+    dev->ep_status[epnum][dir].claimed = 0;
+#endif
+  }
+
+  (void) osal_mutex_unlock(_usbh_mutex);
+
+  bool abort = (remaining > 0) && (result != XFER_RESULT_SUCCESS);
+
+#if USBH_EDPT_QUEUE_SW
+  if ( remaining && !abort )
   {
-    // HCD error, mark endpoint as ready to allow next transfer
-    ep_state->busy    = 0;
-    ep_state->claimed = 0;
-    TU_LOG1("Failed\r\n");
-    TU_BREAKPOINT();
-    return false;
+    usbh_edpt_xfer_t const* next = edpt_queue_at(dev, epnum, dir, 0);
+    abort = !hcd_edpt_xfer(dev->rhport, daddr, ep_addr, next->buffer, next->buflen);
+  }
+#else
+  // take back transfers chained after the failed one, they stay queued if the controller cannot abort
+  if ( abort ) abort = hcd_edpt_abort_xfer && hcd_edpt_abort_xfer(dev->rhport, daddr, ep_addr);
+#endif
+
+  uint8_t const aborted = abort ? _edpt_queue_flush(dev, epnum, dir, &cb[1]) : 0;
+
+  // no driver/callback responsible for this transfer
+  TU_ASSERT(_edpt_xfer_notify(daddr, ep_addr, result, xferred_bytes, &cb[0]), );
+
+  for(uint8_t i=1; i<=aborted; i++)
+  {
+    (void) _edpt_xfer_notify(daddr, ep_addr, XFER_RESULT_FAILED, 0, &cb[i]);
   }
 }
 
@@ -885,6 +2006,218 @@ TU_ATTR_FAST_FUNC void hcd_event_handler(hcd_event_t const* event, bool in_isr)
   }
 }
 
+//--------------------------------------------------------------------+
+// Descriptor Cache
+// Descriptors read by GET_DESCRIPTOR requests are kept as records per device model, keyed by its device descriptor
+// (VID, PID, bcdDevice, number of configurations ...) which is always read from the device. Serial number string
+// differs between devices of the same model and is never cached.
+//--------------------------------------------------------------------+
+#if CFG_TUH_DESC_CACHE
+
+enum { DESC_CACHE_SIGNATURE = 0x43445554 }; // "TUDC"
+
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  type;
+  uint8_t  index;
+  uint16_t w_index;  // language ID (string) or interface number (HID report)
+  uint16_t len;
+  uint8_t  complete; // len is the whole descriptor, request with a larger wLength can be served as well
+  uint8_t  reserved;
+} desc_cache_record_t;
+
+typedef struct
+{
+  tusb_desc_device_t desc_device; // key, bLength = 0 if free
+  uint16_t used;                  // bytes of records
+  uint32_t last_bound;            // least recently bound entry is replaced first
+  uint8_t  records[CFG_TUH_DESC_CACHE_BUFSIZE];
+} desc_cache_entry_t;
+
+// Image reported to tuh_descriptor_cache_updated_cb(), signature and sizes reject image of another configuration
+typedef struct
+{
+  uint32_t signature;
+  uint16_t entry_count;
+  uint16_t bufsize;
+  uint32_t bind_count;
+  desc_cache_entry_t entry[CFG_TUH_DESC_CACHE];
+} desc_cache_t;
+
+static desc_cache_t _usbh_desc_cache;
+
+static void desc_cache_reset(void)
+{
+  tu_memclr(&_usbh_desc_cache, sizeof(_usbh_desc_cache));
+}
+
+static desc_cache_entry_t* desc_cache_get_entry(uint8_t daddr)
+{
+  usbh_device_t const* dev = get_device(daddr);
+  return (dev && dev->desc_cache) ? &_usbh_desc_cache.entry[dev->desc_cache-1] : NULL;
+}
+
+// Key of a cacheable GET_DESCRIPTOR request: configuration and string (device), HID report (interface)
+static bool desc_cache_key(uint8_t daddr, tusb_control_request_t const* request, desc_cache_record_t* key)
+{
+  TU_VERIFY(request->bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD &&
+            request->bmRequestType_bit.direction == TUSB_DIR_IN &&
+            request->bRequest == TUSB_REQ_GET_DESCRIPTOR);
+
+  key->type    = tu_u16_high(tu_le16toh(request->wValue));
+  key->index   = tu_u16_low(tu_le16toh(request->wValue));
+  key->w_index = tu_le16toh(request->wIndex);
+
+  if ( request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_DEVICE )
+  {
+    if ( key->type == TUSB_DESC_CONFIGURATION ) return true;
+
+    usbh_device_t const* dev = get_device(daddr);
+    return key->type == TUSB_DESC_STRING && !(dev && key->index && key->index == dev->i_serial);
+  }
+
+  return request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_INTERFACE && key->type == HID_DESC_TYPE_REPORT;
+}
+
+static desc_cache_record_t* desc_cache_find(desc_cache_entry_t* entry, desc_cache_record_t const* key)
+{
+  uint16_t offset = 0;
+  while ( offset < entry->used )
+  {
+    desc_cache_record_t* rec = (desc_cache_record_t*) (entry->records + offset);
+    if ( rec->type == key->type && rec->index == key->index && rec->w_index == key->w_index ) return rec;
+    offset += (uint16_t) (sizeof(desc_cache_record_t) + rec->len);
+  }
+  return NULL;
+}
+
+// Bind device to the cache entry of its device descriptor, entry is (re)created if there is none
+static void desc_cache_bind(uint8_t daddr, tusb_desc_device_t const* desc_device)
+{
+  usbh_device_t* dev = get_device(daddr);
+  desc_cache_entry_t* entry = NULL;
+
+  for(uint8_t i=0; i<CFG_TUH_DESC_CACHE; i++)
+  {
+    desc_cache_entry_t* cur = &_usbh_desc_cache.entry[i];
+    if ( 0 == memcmp(&cur->desc_device, desc_device, sizeof(tusb_desc_device_t)) )
+    {
+      entry = cur;
+      break;
+    }
+
+    if ( !entry || cur->last_bound < entry->last_bound ) entry = cur;
+  }
+
+  if ( 0 != memcmp(&entry->desc_device, desc_device, sizeof(tusb_desc_device_t)) )
+  {
+    uint8_t const id = (uint8_t) (entry - _usbh_desc_cache.entry + 1);
+
+    // replaced entry is no longer valid for devices bound to it
+    for(uint8_t i=0; i<TOTAL_DEVICES; i++)
+    {
+      if ( _usbh_devices[i].desc_cache == id ) _usbh_devices[i].desc_cache = 0;
+    }
+
+    memcpy(&entry->desc_device, desc_device, sizeof(tusb_desc_device_t));
+    entry->used = 0;
+  }
+
+  entry->last_bound = ++_usbh_desc_cache.bind_count;
+  dev->desc_cache = (uint8_t) (entry - _usbh_desc_cache.entry + 1);
+}
+
+// Copy cached descriptor of a request to buffer, return false if it is not cached
+static bool desc_cache_get(uint8_t daddr, tusb_control_request_t const* request, uint8_t* buffer, uint16_t* len)
+{
+  desc_cache_entry_t* entry = desc_cache_get_entry(daddr);
+  desc_cache_record_t key;
+  TU_VERIFY(entry && desc_cache_key(daddr, request, &key));
+
+  desc_cache_record_t const* rec = desc_cache_find(entry, &key);
+  uint16_t const wlength = tu_le16toh(request->wLength);
+  TU_VERIFY(rec && (rec->complete || rec->len >= wlength));
+
+  *len = tu_min16(rec->len, wlength);
+  memcpy(buffer, rec + 1, *len);
+
+  return true;
+}
+
+// Add descriptor read from device, a shorter record of the same descriptor is replaced
+static void desc_cache_put(uint8_t daddr, tusb_control_request_t const* request, uint8_t const* data, uint16_t len)
+{
+  desc_cache_entry_t* entry = desc_cache_get_entry(daddr);
+  desc_cache_record_t key;
+  TU_VERIFY(entry && len && desc_cache_key(daddr, request, &key), );
+
+  // whole descriptor if device returned less than requested or length in descriptor is reached
+  uint16_t desc_len = len;
+  if ( key.type == TUSB_DESC_CONFIGURATION && len >= sizeof(tusb_desc_configuration_t) )
+  {
+    desc_len = tu_le16toh(tu_unaligned_read16(data + offsetof(tusb_desc_configuration_t, wTotalLength)));
+  }else if ( key.type == TUSB_DESC_STRING )
+  {
+    desc_len = data[0];
+  }
+  key.complete = (len < tu_le16toh(request->wLength) || len >= desc_len) ? 1 : 0;
+  key.len      = len;
+  key.reserved = 0;
+
+  desc_cache_record_t* rec = desc_cache_find(entry, &key);
+  if ( rec )
+  {
+    if ( rec->complete || rec->len >= len ) return;
+
+    // remove shorter one
+    uint16_t const rec_size = (uint16_t) (sizeof(desc_cache_record_t) + rec->len);
+    uint8_t* const next = ((uint8_t*) rec) + rec_size;
+    memmove(rec, next, (size_t) (entry->records + entry->used - next));
+    entry->used = (uint16_t) (entry->used - rec_size);
+  }
+
+  // skip descriptor not fitting into cache
+  TU_VERIFY(entry->used + sizeof(desc_cache_record_t) + len <= CFG_TUH_DESC_CACHE_BUFSIZE, );
+
+  memcpy(entry->records + entry->used, &key, sizeof(desc_cache_record_t));
+  memcpy(entry->records + entry->used + sizeof(desc_cache_record_t), data, len);
+  entry->used = (uint16_t) (entry->used + sizeof(desc_cache_record_t) + len);
+
+  if ( tuh_descriptor_cache_updated_cb )
+  {
+    _usbh_desc_cache.signature   = DESC_CACHE_SIGNATURE;
+    _usbh_desc_cache.entry_count = CFG_TUH_DESC_CACHE;
+    _usbh_desc_cache.bufsize     = CFG_TUH_DESC_CACHE_BUFSIZE;
+    tuh_descriptor_cache_updated_cb(&_usbh_desc_cache, sizeof(_usbh_desc_cache));
+  }
+}
+
+bool tuh_descriptor_cache_restore(void const* cache, uint32_t size)
+{
+  desc_cache_t const* image = (desc_cache_t const*) cache;
+  TU_VERIFY(size == sizeof(desc_cache_t) && image->signature == DESC_CACHE_SIGNATURE &&
+            image->entry_count == CFG_TUH_DESC_CACHE && image->bufsize == CFG_TUH_DESC_CACHE_BUFSIZE);
+
+  for(uint8_t i=0; i<CFG_TUH_DESC_CACHE; i++) TU_VERIFY(image->entry[i].used <= CFG_TUH_DESC_CACHE_BUFSIZE);
+
+  memcpy(&_usbh_desc_cache, image, sizeof(desc_cache_t));
+
+  // devices bound to entries before are now unbound
+  for(uint8_t i=0; i<TOTAL_DEVICES; i++) _usbh_devices[i].desc_cache = 0;
+
+  return true;
+}
+
+#else
+
+bool tuh_descriptor_cache_restore(void const* cache, uint32_t size)
+{
+  (void) cache; (void) size;
+  return false;
+}
+
+#endif
+
 //--------------------------------------------------------------------+
 // Descriptors Async
 //--------------------------------------------------------------------+
@@ -1059,68 +2392,325 @@ bool tuh_interface_set(uint8_t daddr, uint8_t itf_num, uint8_t itf_alt,
     .wLength  = 0
   };
 
-  tuh_xfer_t xfer =
+  tuh_xfer_t xfer =
+  {
+    .daddr       = daddr,
+    .ep_addr     = 0,
+    .setup       = &request,
+    .buffer      = NULL,
+    .complete_cb = complete_cb,
+    .user_data   = user_data
+  };
+
+  return tuh_control_xfer(&xfer);
+}
+
+//--------------------------------------------------------------------+
+// Descriptor Sync
+//--------------------------------------------------------------------+
+
+#define _CONTROL_SYNC_API(_async_func, ...) \
+  xfer_result_t result = XFER_RESULT_INVALID;\
+  TU_VERIFY(_async_func(__VA_ARGS__, NULL, (uintptr_t) &result), XFER_RESULT_TIMEOUT); \
+  return (uint8_t) result
+
+uint8_t tuh_descriptor_get_sync(uint8_t daddr, uint8_t type, uint8_t index, void* buffer, uint16_t len)
+{
+  _CONTROL_SYNC_API(tuh_descriptor_get, daddr, type, index, buffer, len);
+}
+
+uint8_t tuh_descriptor_get_device_sync(uint8_t daddr, void* buffer, uint16_t len)
+{
+  _CONTROL_SYNC_API(tuh_descriptor_get_device, daddr, buffer, len);
+}
+
+uint8_t tuh_descriptor_get_configuration_sync(uint8_t daddr, uint8_t index, void* buffer, uint16_t len)
+{
+  _CONTROL_SYNC_API(tuh_descriptor_get_configuration, daddr, index, buffer, len);
+}
+
+uint8_t tuh_descriptor_get_hid_report_sync(uint8_t daddr, uint8_t itf_num, uint8_t desc_type, uint8_t index, void* buffer, uint16_t len)
+{
+  _CONTROL_SYNC_API(tuh_descriptor_get_hid_report, daddr, itf_num, desc_type, index, buffer, len);
+}
+
+uint8_t tuh_descriptor_get_string_sync(uint8_t daddr, uint8_t index, uint16_t language_id, void* buffer, uint16_t len)
+{
+  _CONTROL_SYNC_API(tuh_descriptor_get_string, daddr, index, language_id, buffer, len);
+}
+
+uint8_t tuh_descriptor_get_manufacturer_string_sync(uint8_t daddr, uint16_t language_id, void* buffer, uint16_t len)
+{
+  _CONTROL_SYNC_API(tuh_descriptor_get_manufacturer_string, daddr, language_id, buffer, len);
+}
+
+uint8_t tuh_descriptor_get_product_string_sync(uint8_t daddr, uint16_t language_id, void* buffer, uint16_t len)
+{
+  _CONTROL_SYNC_API(tuh_descriptor_get_product_string, daddr, language_id, buffer, len);
+}
+
+uint8_t tuh_descriptor_get_serial_string_sync(uint8_t daddr, uint16_t language_id, void* buffer, uint16_t len)
+{
+  _CONTROL_SYNC_API(tuh_descriptor_get_serial_string, daddr, language_id, buffer, len);
+}
+
+//--------------------------------------------------------------------+
+// String Fetch
+// Language IDs then manufacturer, product and serial strings of a device are read one after another by a fetch
+// context holding the buffer for UTF-16 descriptors. Strings are converted to UTF-8 and kept until device is unplugged.
+//--------------------------------------------------------------------+
+#if CFG_TUH_STRINGS_FETCH_MAX
+
+// a string of CFG_TUH_STRING_MAXLEN-1 UTF-8 bytes has at most as many UTF-16 code units
+TU_VERIFY_STATIC(2*CFG_TUH_STRING_MAXLEN <= 255, "CFG_TUH_STRING_MAXLEN too large");
+
+enum
+{
+  STRINGS_NONE = 0,
+  STRINGS_PENDING,   // waiting for a fetch context
+  STRINGS_FETCHING,
+  STRINGS_READY
+};
+
+enum
+{
+  STRINGS_STEP_LANGID = 0,
+  STRINGS_STEP_MANUFACTURER,
+  STRINGS_STEP_PRODUCT,
+  STRINGS_STEP_SERIAL,
+  STRINGS_STEP_COUNT
+};
+
+typedef struct
+{
+  tuh_strings_t strings;
+  tuh_strings_cb_t complete_cb;
+  uintptr_t user_data;
+  uint8_t state;
+} usbh_strings_t;
+
+typedef struct
+{
+  uint8_t daddr; // 0 if free
+  uint8_t step;
+} usbh_strings_fetch_t;
+
+static usbh_strings_t _usbh_strings[TOTAL_DEVICES];
+static usbh_strings_fetch_t _strings_fetch[CFG_TUH_STRINGS_FETCH_MAX];
+
+CFG_TUH_MEM_SECTION CFG_TUH_MEM_ALIGN
+static uint8_t _strings_buf[CFG_TUH_STRINGS_FETCH_MAX][2*CFG_TUH_STRING_MAXLEN];
+
+static void strings_reset(void)
+{
+  tu_memclr(_usbh_strings, sizeof(_usbh_strings));
+  tu_memclr(_strings_fetch, sizeof(_strings_fetch));
+}
+
+// Convert UTF-16LE string descriptor of len bytes to null-terminated UTF-8, truncated at a character boundary to fit
+// bufsize. Unpaired surrogates are replaced by U+FFFD.
+static void strings_utf16_to_utf8(uint8_t const* desc, uint32_t len, char* utf8, uint16_t bufsize)
+{
+  static uint8_t const lead_byte[] = { 0x00, 0x00, 0xC0, 0xE0, 0xF0 };
+  uint16_t count = 0;
+
+  for (uint32_t i = 2; i + 1 < len; i += 2)
   {
-    .daddr       = daddr,
-    .ep_addr     = 0,
-    .setup       = &request,
-    .buffer      = NULL,
-    .complete_cb = complete_cb,
-    .user_data   = user_data
-  };
+    uint32_t cp = tu_u16(desc[i+1], desc[i]);
 
-  return tuh_control_xfer(&xfer);
-}
+    if ( 0xD800 <= cp && cp < 0xDC00 && i + 3 < len )
+    {
+      uint16_t const low = tu_u16(desc[i+3], desc[i+2]);
+      if ( 0xDC00 <= low && low < 0xE000 )
+      {
+        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00u);
+        i += 2;
+      }
+    }
+    if ( 0xD800 <= cp && cp < 0xE000 ) cp = 0xFFFD;
 
-//--------------------------------------------------------------------+
-// Descriptor Sync
-//--------------------------------------------------------------------+
+    uint8_t const size = (cp < 0x80) ? 1 : (cp < 0x800) ? 2 : (cp < 0x10000) ? 3 : 4;
+    if ( count + size >= bufsize ) break;
 
-#define _CONTROL_SYNC_API(_async_func, ...) \
-  xfer_result_t result = XFER_RESULT_INVALID;\
-  TU_VERIFY(_async_func(__VA_ARGS__, NULL, (uintptr_t) &result), XFER_RESULT_TIMEOUT); \
-  return (uint8_t) result
+    if ( size == 1 )
+    {
+      utf8[count++] = (char) cp;
+    }
+    else
+    {
+      utf8[count++] = (char) (lead_byte[size] | (cp >> (6*(size-1))));
+      for (uint8_t k = (uint8_t) (size-1); k > 0; k--)
+      {
+        utf8[count++] = (char) (0x80 | ((cp >> (6*(k-1))) & 0x3F));
+      }
+    }
+  }
 
-uint8_t tuh_descriptor_get_sync(uint8_t daddr, uint8_t type, uint8_t index, void* buffer, uint16_t len)
+  utf8[count] = 0;
+}
+
+static uint8_t strings_index(usbh_device_t const* dev, uint8_t step)
 {
-  _CONTROL_SYNC_API(tuh_descriptor_get, daddr, type, index, buffer, len);
+  switch (step)
+  {
+    case STRINGS_STEP_MANUFACTURER: return dev->i_manufacturer;
+    case STRINGS_STEP_PRODUCT     : return dev->i_product;
+    case STRINGS_STEP_SERIAL      : return dev->i_serial;
+    default                       : return 0;
+  }
 }
 
-uint8_t tuh_descriptor_get_device_sync(uint8_t daddr, void* buffer, uint16_t len)
+static char* strings_target(tuh_strings_t* strings, uint8_t step)
 {
-  _CONTROL_SYNC_API(tuh_descriptor_get_device, daddr, buffer, len);
+  switch (step)
+  {
+    case STRINGS_STEP_MANUFACTURER: return strings->manufacturer;
+    case STRINGS_STEP_PRODUCT     : return strings->product;
+    default                       : return strings->serial;
+  }
 }
 
-uint8_t tuh_descriptor_get_configuration_sync(uint8_t daddr, uint8_t index, void* buffer, uint16_t len)
+static void strings_xfer_cb(tuh_xfer_t* xfer);
+
+// Request the next string of the fetched device, complete the fetch if there is none left
+static void strings_fetch_next(void* param)
 {
-  _CONTROL_SYNC_API(tuh_descriptor_get_configuration, daddr, index, buffer, len);
+  usbh_strings_fetch_t* fetch = (usbh_strings_fetch_t*) param;
+  uint8_t const idx   = (uint8_t) (fetch - _strings_fetch);
+  uint8_t const daddr = fetch->daddr;
+  usbh_strings_t* str = &_usbh_strings[daddr-1];
+
+  for ( ; fetch->step < STRINGS_STEP_COUNT; fetch->step++)
+  {
+    uint8_t const index = strings_index(get_device(daddr), fetch->step);
+    if ( fetch->step != STRINGS_STEP_LANGID && index == 0 ) continue;
+
+    uint16_t const langid = (fetch->step == STRINGS_STEP_LANGID) ? 0 : str->strings.langid;
+    if ( tuh_descriptor_get_string(daddr, index, langid, _strings_buf[idx], sizeof(_strings_buf[idx]),
+                                   strings_xfer_cb, idx) )
+    {
+      return;
+    }
+
+    // all control transfer slots are in use, try again later. The string is left empty if no timer is available.
+    if ( usbh_defer_func_ms(strings_fetch_next, fetch, 1) ) return;
+  }
+
+  fetch->daddr = 0;
+  str->state   = STRINGS_READY;
+
+  tuh_strings_cb_t const complete_cb = str->complete_cb;
+  str->complete_cb = NULL;
+  complete_cb(daddr, &str->strings, str->user_data);
 }
 
-uint8_t tuh_descriptor_get_hid_report_sync(uint8_t daddr, uint8_t itf_num, uint8_t desc_type, uint8_t index, void* buffer, uint16_t len)
+static void strings_xfer_cb(tuh_xfer_t* xfer)
 {
-  _CONTROL_SYNC_API(tuh_descriptor_get_hid_report, daddr, itf_num, desc_type, index, buffer, len);
+  usbh_strings_fetch_t* fetch = &_strings_fetch[xfer->user_data];
+  TU_VERIFY(fetch->daddr == xfer->daddr, );
+
+  uint8_t const* desc = _strings_buf[xfer->user_data];
+  tuh_strings_t* strings = &_usbh_strings[xfer->daddr-1].strings;
+
+  // a failed string is left empty
+  uint32_t len = 0;
+  if ( xfer->result == XFER_RESULT_SUCCESS && xfer->actual_len >= 2 && desc[1] == TUSB_DESC_STRING )
+  {
+    len = tu_min32(xfer->actual_len, desc[0]);
+  }
+
+  if ( fetch->step == STRINGS_STEP_LANGID )
+  {
+    // preferred language if supported otherwise the first one, devices failing the request mostly support English
+    strings->langid = CFG_TUH_STRING_LANGID;
+    for (uint32_t i = 2; i + 1 < len; i += 2)
+    {
+      uint16_t const langid = tu_u16(desc[i+1], desc[i]);
+      if ( i == 2 || langid == CFG_TUH_STRING_LANGID ) strings->langid = langid;
+      if ( langid == CFG_TUH_STRING_LANGID ) break;
+    }
+  }
+  else
+  {
+    strings_utf16_to_utf8(desc, len, strings_target(strings, fetch->step), CFG_TUH_STRING_MAXLEN);
+  }
+
+  fetch->step++;
+  strings_fetch_next(fetch);
+  strings_schedule();
 }
 
-uint8_t tuh_descriptor_get_string_sync(uint8_t daddr, uint8_t index, uint16_t language_id, void* buffer, uint16_t len)
+// Start fetching pending devices while there are free contexts
+static void strings_schedule(void)
 {
-  _CONTROL_SYNC_API(tuh_descriptor_get_string, daddr, index, language_id, buffer, len);
+  for (uint8_t i = 0; i < CFG_TUH_STRINGS_FETCH_MAX; i++)
+  {
+    usbh_strings_fetch_t* fetch = &_strings_fetch[i];
+
+    for (uint8_t dev_id = 0; dev_id < TOTAL_DEVICES && fetch->daddr == 0; dev_id++)
+    {
+      if ( _usbh_strings[dev_id].state == STRINGS_PENDING )
+      {
+        _usbh_strings[dev_id].state = STRINGS_FETCHING;
+        fetch->daddr = (uint8_t) (dev_id + 1);
+        fetch->step  = STRINGS_STEP_LANGID;
+        strings_fetch_next(fetch);
+      }
+    }
+  }
 }
 
-uint8_t tuh_descriptor_get_manufacturer_string_sync(uint8_t daddr, uint16_t language_id, void* buffer, uint16_t len)
+// Drop strings of an unplugged device, its control transfers are already aborted
+static void strings_remove_device(uint8_t daddr)
 {
-  _CONTROL_SYNC_API(tuh_descriptor_get_manufacturer_string, daddr, language_id, buffer, len);
+  for (uint8_t i = 0; i < CFG_TUH_STRINGS_FETCH_MAX; i++)
+  {
+    usbh_strings_fetch_t* fetch = &_strings_fetch[i];
+    if ( fetch->daddr == daddr )
+    {
+      _timer_cancel(fetch);
+      fetch->daddr = 0;
+    }
+  }
+
+  tu_memclr(&_usbh_strings[daddr-1], sizeof(usbh_strings_t));
 }
 
-uint8_t tuh_descriptor_get_product_string_sync(uint8_t daddr, uint16_t language_id, void* buffer, uint16_t len)
+bool tuh_strings_get(uint8_t daddr, tuh_strings_cb_t complete_cb, uintptr_t user_data)
 {
-  _CONTROL_SYNC_API(tuh_descriptor_get_product_string, daddr, language_id, buffer, len);
+  TU_VERIFY(complete_cb && tuh_mounted(daddr));
+
+  usbh_device_t const* dev = get_device(daddr);
+  usbh_strings_t* str = &_usbh_strings[daddr-1];
+  TU_VERIFY(str->state == STRINGS_NONE || str->state == STRINGS_READY);
+
+  if ( str->state == STRINGS_NONE && (dev->i_manufacturer || dev->i_product || dev->i_serial) )
+  {
+    str->complete_cb = complete_cb;
+    str->user_data   = user_data;
+    str->state       = STRINGS_PENDING;
+    strings_schedule();
+  }
+  else
+  {
+    // already fetched, or device without strings whose langid and strings are left empty
+    str->state = STRINGS_READY;
+    complete_cb(daddr, &str->strings, user_data);
+  }
+
+  return true;
 }
 
-uint8_t tuh_descriptor_get_serial_string_sync(uint8_t daddr, uint16_t language_id, void* buffer, uint16_t len)
+#else
+
+bool tuh_strings_get(uint8_t daddr, tuh_strings_cb_t complete_cb, uintptr_t user_data)
 {
-  _CONTROL_SYNC_API(tuh_descriptor_get_serial_string, daddr, language_id, buffer, len);
+  (void) daddr; (void) complete_cb; (void) user_data;
+  return false;
 }
 
+#endif
+
 //--------------------------------------------------------------------+
 // Detaching
 //--------------------------------------------------------------------+
@@ -1154,8 +2744,11 @@ static inline bool is_hub_addr(uint8_t daddr)
 // a device unplugged from rhport:hub_addr:hub_port
 static void process_removing_device(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port)
 {
+  // attached devices which are not addressed yet
+  enum_remove_port(rhport, hub_addr, hub_port);
+
   //------------- find the all devices (star-network) under port that is unplugged -------------//
-  // TODO mark as disconnected in ISR, also handle dev0
+  // TODO mark as disconnected in ISR
 
 #if 0
   // index as hub addr, value is hub port (0xFF for invalid)
@@ -1200,27 +2793,46 @@ static void process_removing_device(uint8_t rhport, uint8_t hub_addr, uint8_t hu
         usbh_class_drivers[drv_id].close(daddr);
       }
 
+#if CFG_TUH_ISO_STREAM_MAX
+      iso_stream_remove_device(daddr);
+#endif
+
       hcd_device_close(rhport, daddr);
+      buf_free_device(daddr);
       clear_device(dev);
-      // abort on-going control xfer if any
-      if (_ctrl_xfer.daddr == daddr) _set_control_xfer_stage(CONTROL_STAGE_IDLE);
+      // abort on-going and queued control xfer if any
+      (void) _ctrl_xfer_abort_device(daddr);
+      enum_abort_device(daddr);
+#if CFG_TUH_STRINGS_FETCH_MAX
+      strings_remove_device(daddr);
+#endif
     }
   }
+
+  // control pipe, enumeration buffers and string fetch contexts may be available for other devices
+  _ctrl_xfer_schedule();
+  enum_schedule();
+#if CFG_TUH_STRINGS_FETCH_MAX
+  strings_schedule();
+#endif
 }
 
 //--------------------------------------------------------------------+
 // Enumeration Process
 // is a lengthy process with a series of control transfer to configure
 // newly attached device.
-// NOTE: due to the shared _usbh_ctrl_buf, we must complete enumerating
-// one device before enumerating another one.
+// Attached devices are debounced concurrently, then reset and addressed one at a time since only one device can
+// respond to address 0. Once addressed, up to CFG_TUH_ENUMERATION_MAX devices are enumerated concurrently, each
+// with its own enumeration buffer.
 //--------------------------------------------------------------------+
 
 enum {
   ENUM_IDLE,
   ENUM_RESET_1,         // 1st reset when attached
-  //ENUM_HUB_GET_STATUS_1,
+  ENUM_HUB_RESET_1,
+  ENUM_HUB_GET_STATUS_1,
   ENUM_HUB_CLEAR_RESET_1,
+  ENUM_RESET_RECOVERY,
   ENUM_ADDR0_DEVICE_DESC,
   ENUM_RESET_2,         // 2nd reset before set address (not used)
   ENUM_HUB_GET_STATUS_2,
@@ -1236,94 +2848,152 @@ enum {
 
 static bool enum_request_set_addr(void);
 static bool _parse_configuration_descriptor (uint8_t dev_addr, tusb_desc_configuration_t const* desc_cfg);
-static void enum_full_complete(void);
+static void enum_full_complete(uint8_t idx);
+static void process_enumeration(tuh_xfer_t* xfer);
 
-// process device enumeration
-static void process_enumeration(tuh_xfer_t* xfer)
+// user_data of enumeration transfers: generation of the context, its index and the next state
+TU_ATTR_ALWAYS_INLINE static inline uintptr_t enum_user_data(uint8_t idx, uint8_t state)
 {
-  // Retry a few times with transfers in enumeration since device can be unstable when starting up
-  enum {
-    ATTEMPT_COUNT_MAX = 3,
-    ATTEMPT_DELAY_MS = 100
-  };
-  static uint8_t failed_count = 0;
+  return ((uintptr_t) _usbh_enum[idx].gen << 16) | ((uintptr_t) idx << 8) | state;
+}
 
-  if (XFER_RESULT_SUCCESS != xfer->result)
+TU_ATTR_ALWAYS_INLINE static inline bool enum_port_match(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port,
+                                                         uint8_t dev_rhport, uint8_t dev_hub_addr, uint8_t dev_hub_port)
+{
+  // hub_addr = 0 means roothub, hub_port = 0 means all devices of downstream hub
+  return (dev_rhport == rhport) && (hub_addr == 0 || dev_hub_addr == hub_addr) && (hub_port == 0 || dev_hub_port == hub_port);
+}
+
+static void enum_retry(void* param)
+{
+  usbh_enum_t* ctx = (usbh_enum_t*) param;
+  TU_LOG1("Enumeration attempt %u\r\n", ctx->failed_count);
+  if ( !tuh_control_xfer(&ctx->retry_xfer) ) enum_full_complete((uint8_t) (ctx - _usbh_enum));
+}
+
+// Continue enumeration with a state once its delay has elapsed
+static void enum_delay_complete(void* param)
+{
+  usbh_enum_t* ctx = (usbh_enum_t*) param;
+  uint8_t const idx = (uint8_t) (ctx - _usbh_enum);
+
+  // fake transfer to continue the enumeration process
+  tuh_xfer_t xfer;
+  xfer.daddr     = ctx->daddr;
+  xfer.result    = XFER_RESULT_SUCCESS;
+  xfer.setup     = NULL;
+  xfer.user_data = enum_user_data(idx, ctx->delay_state);
+
+  process_enumeration(&xfer);
+}
+
+// Wait without blocking usbh task, other devices can still communicate meanwhile
+static void enum_delay(uint8_t idx, uint8_t state, uint32_t delay_ms)
+{
+  usbh_enum_t* ctx = &_usbh_enum[idx];
+  ctx->delay_state = state;
+  if ( !usbh_defer_func_ms(enum_delay_complete, ctx, delay_ms) ) enum_full_complete(idx);
+}
+
+// Get full device descriptor of an addressed device, which is now bound to enumeration buffer idx
+static void enum_get_device_desc(uint8_t idx, uint8_t daddr)
+{
+  usbh_enum_t* ctx = &_usbh_enum[idx];
+  ctx->daddr = daddr;
+  ctx->failed_count = 0;
+
+  TU_LOG_USBH("Get Device Descriptor\r\n");
+  if ( !tuh_descriptor_get_device(daddr, _usbh_ctrl_buf[idx], sizeof(tusb_desc_device_t),
+                                  process_enumeration, enum_user_data(idx, ENUM_GET_9BYTE_CONFIG_DESC)) )
   {
-    // retry if not reaching max attempt
-    if ( failed_count < ATTEMPT_COUNT_MAX )
-    {
-      failed_count++;
-      osal_task_delay(ATTEMPT_DELAY_MS); // delay a bit
-      TU_LOG1("Enumeration attempt %u\r\n", failed_count);
-      TU_ASSERT(tuh_control_xfer(xfer), );
-    }else
-    {
-      enum_full_complete();
-    }
-    return;
+    enum_full_complete(idx);
   }
-  failed_count = 0;
+}
 
-  uint8_t const daddr = xfer->daddr;
-  uintptr_t const state = xfer->user_data;
+// process a state of device enumeration, return false if enumeration failed
+static bool enum_process_state(uint8_t idx, uint8_t state, tuh_xfer_t* xfer)
+{
+  uint8_t const daddr = _usbh_enum[idx].daddr;
+  uint8_t* enum_buf = (idx == ENUM_IDX_DEV0) ? _dev0_buf : _usbh_ctrl_buf[idx];
 
   switch(state)
   {
+    case ENUM_RESET_1:
+      // port reset on roothub is complete
+      hcd_port_reset_end(_dev0.rhport);
+
+      // device unplugged while resetting
+      TU_VERIFY( hcd_port_connect_status(_dev0.rhport) );
+
+      _dev0.speed = hcd_port_speed_get(_dev0.rhport);
+      TU_LOG_USBH("%s Speed\r\n", tu_str_speed[_dev0.speed]);
+
+      enum_delay(idx, ENUM_ADDR0_DEVICE_DESC, RESET_RECOVERY_DELAY);
+    break;
+
 #if CFG_TUH_HUB
-    //case ENUM_HUB_GET_STATUS_1: break;
+    case ENUM_HUB_RESET_1:
+      // port reset is started by hub, wait until complete
+      enum_delay(idx, ENUM_HUB_GET_STATUS_1, PORT_RESET_DELAY);
+    break;
+
+    case ENUM_HUB_GET_STATUS_1:
+      TU_ASSERT( hub_port_get_status(_dev0.hub_addr, _dev0.hub_port, enum_buf, process_enumeration, enum_user_data(idx, ENUM_HUB_CLEAR_RESET_1)) );
+    break;
 
     case ENUM_HUB_CLEAR_RESET_1:
     {
       hub_port_status_response_t port_status;
-      memcpy(&port_status, _usbh_ctrl_buf, sizeof(hub_port_status_response_t));
+      memcpy(&port_status, enum_buf, sizeof(hub_port_status_response_t));
 
-      if ( !port_status.status.connection )
-      {
-        // device unplugged while delaying, nothing else to do
-        enum_full_complete();
-        return;
-      }
+      // device unplugged while resetting, nothing else to do
+      TU_VERIFY( port_status.status.connection );
 
       _dev0.speed = (port_status.status.high_speed) ? TUSB_SPEED_HIGH :
                     (port_status.status.low_speed ) ? TUSB_SPEED_LOW  : TUSB_SPEED_FULL;
 
-      // Acknowledge Port Reset Change
+      // Acknowledge Port Reset Change, hub driver may already have done so while polling its status
       if (port_status.change.reset)
       {
-        hub_port_clear_reset_change(_dev0.hub_addr, _dev0.hub_port, process_enumeration, ENUM_ADDR0_DEVICE_DESC);
+        TU_ASSERT( hub_port_clear_reset_change(_dev0.hub_addr, _dev0.hub_port, process_enumeration, enum_user_data(idx, ENUM_RESET_RECOVERY)) );
+      }else
+      {
+        enum_delay(idx, ENUM_ADDR0_DEVICE_DESC, RESET_RECOVERY_DELAY);
       }
     }
     break;
 
     case ENUM_HUB_GET_STATUS_2:
-      osal_task_delay(RESET_DELAY);
-      TU_ASSERT( hub_port_get_status(_dev0.hub_addr, _dev0.hub_port, _usbh_ctrl_buf, process_enumeration, ENUM_HUB_CLEAR_RESET_2), );
+      TU_ASSERT( hub_port_get_status(_dev0.hub_addr, _dev0.hub_port, enum_buf, process_enumeration, enum_user_data(idx, ENUM_HUB_CLEAR_RESET_2)) );
     break;
 
     case ENUM_HUB_CLEAR_RESET_2:
     {
       hub_port_status_response_t port_status;
-      memcpy(&port_status, _usbh_ctrl_buf, sizeof(hub_port_status_response_t));
+      memcpy(&port_status, enum_buf, sizeof(hub_port_status_response_t));
 
       // Acknowledge Port Reset Change if Reset Successful
       if (port_status.change.reset)
       {
-        TU_ASSERT( hub_port_clear_reset_change(_dev0.hub_addr, _dev0.hub_port, process_enumeration, ENUM_SET_ADDR), );
+        TU_ASSERT( hub_port_clear_reset_change(_dev0.hub_addr, _dev0.hub_port, process_enumeration, enum_user_data(idx, ENUM_SET_ADDR)) );
       }
     }
     break;
 #endif
 
+    case ENUM_RESET_RECOVERY:
+      enum_delay(idx, ENUM_ADDR0_DEVICE_DESC, RESET_RECOVERY_DELAY);
+    break;
+
     case ENUM_ADDR0_DEVICE_DESC:
     {
       // TODO probably doesn't need to open/close each enumeration
       uint8_t const addr0 = 0;
-      TU_ASSERT( usbh_edpt_control_open(addr0, 8), );
+      TU_ASSERT( usbh_edpt_control_open(addr0, 8) );
 
       // Get first 8 bytes of device descriptor for Control Endpoint size
       TU_LOG_USBH("Get 8 byte of Device Descriptor\r\n");
-      TU_ASSERT(tuh_descriptor_get_device(addr0, _usbh_ctrl_buf, 8, process_enumeration, ENUM_SET_ADDR), );
+      TU_ASSERT( tuh_descriptor_get_device(addr0, enum_buf, 8, process_enumeration, enum_user_data(idx, ENUM_SET_ADDR)) );
     }
     break;
 
@@ -1345,7 +3015,7 @@ static void process_enumeration(tuh_xfer_t* xfer)
       else
       {
         // after RESET_DELAY the hub_port_reset() already complete
-        TU_ASSERT( hub_port_reset(_dev0.hub_addr, _dev0.hub_port, process_enumeration, ENUM_HUB_GET_STATUS_2), );
+        TU_ASSERT( hub_port_reset(_dev0.hub_addr, _dev0.hub_port, process_enumeration, enum_user_data(idx, ENUM_HUB_GET_STATUS_2)) );
         break;
       }
       #endif
@@ -1353,7 +3023,7 @@ static void process_enumeration(tuh_xfer_t* xfer)
 #endif
 
     case ENUM_SET_ADDR:
-      enum_request_set_addr();
+      TU_ASSERT( enum_request_set_addr() );
     break;
 
     case ENUM_GET_DEVICE_DESC:
@@ -1361,26 +3031,26 @@ static void process_enumeration(tuh_xfer_t* xfer)
       uint8_t const new_addr = (uint8_t) tu_le16toh(xfer->setup->wValue);
 
       usbh_device_t* new_dev = get_device(new_addr);
-      TU_ASSERT(new_dev, );
+      TU_ASSERT(new_dev);
       new_dev->addressed = 1;
 
       // Close device 0
       hcd_device_close(_dev0.rhport, 0);
 
       // open control pipe for new address
-      TU_ASSERT( usbh_edpt_control_open(new_addr, new_dev->ep0_size), );
+      TU_ASSERT( usbh_edpt_control_open(new_addr, new_dev->ep0_size) );
 
-      // Get full device descriptor
-      TU_LOG_USBH("Get Device Descriptor\r\n");
-      TU_ASSERT(tuh_descriptor_get_device(new_addr, _usbh_ctrl_buf, sizeof(tusb_desc_device_t), process_enumeration, ENUM_GET_9BYTE_CONFIG_DESC), );
+      // Address 0 is available for the next device. This one continues once an enumeration buffer is available
+      new_dev->enum_wait = 1;
+      enum_full_complete(idx);
     }
     break;
 
     case ENUM_GET_9BYTE_CONFIG_DESC:
     {
-      tusb_desc_device_t const * desc_device = (tusb_desc_device_t const*) _usbh_ctrl_buf;
+      tusb_desc_device_t const * desc_device = (tusb_desc_device_t const*) enum_buf;
       usbh_device_t* dev = get_device(daddr);
-      TU_ASSERT(dev, );
+      TU_ASSERT(dev);
 
       dev->vid            = desc_device->idVendor;
       dev->pid            = desc_device->idProduct;
@@ -1388,45 +3058,50 @@ static void process_enumeration(tuh_xfer_t* xfer)
       dev->i_product      = desc_device->iProduct;
       dev->i_serial       = desc_device->iSerialNumber;
 
-    //  if (tuh_attach_cb) tuh_attach_cb((tusb_desc_device_t*) _usbh_ctrl_buf);
+#if CFG_TUH_DESC_CACHE
+      // descriptors below are served from cache if a device with the same device descriptor was attached before
+      desc_cache_bind(daddr, desc_device);
+#endif
+
+    //  if (tuh_attach_cb) tuh_attach_cb((tusb_desc_device_t*) enum_buf);
 
       // Get 9-byte for total length
       uint8_t const config_idx = CONFIG_NUM - 1;
       TU_LOG_USBH("Get Configuration[0] Descriptor (9 bytes)\r\n");
-      TU_ASSERT( tuh_descriptor_get_configuration(daddr, config_idx, _usbh_ctrl_buf, 9, process_enumeration, ENUM_GET_FULL_CONFIG_DESC), );
+      TU_ASSERT( tuh_descriptor_get_configuration(daddr, config_idx, enum_buf, 9, process_enumeration, enum_user_data(idx, ENUM_GET_FULL_CONFIG_DESC)) );
     }
     break;
 
     case ENUM_GET_FULL_CONFIG_DESC:
     {
-      uint8_t const * desc_config = _usbh_ctrl_buf;
+      uint8_t const * desc_config = enum_buf;
 
       // Use offsetof to avoid pointer to the odd/misaligned address
       uint16_t const total_len = tu_le16toh( tu_unaligned_read16(desc_config + offsetof(tusb_desc_configuration_t, wTotalLength)) );
 
       // TODO not enough buffer to hold configuration descriptor
-      TU_ASSERT(total_len <= CFG_TUH_ENUMERATION_BUFSIZE, );
+      TU_ASSERT(total_len <= CFG_TUH_ENUMERATION_BUFSIZE);
 
       // Get full configuration descriptor
       uint8_t const config_idx = CONFIG_NUM - 1;
       TU_LOG_USBH("Get Configuration[0] Descriptor\r\n");
-      TU_ASSERT( tuh_descriptor_get_configuration(daddr, config_idx, _usbh_ctrl_buf, total_len, process_enumeration, ENUM_SET_CONFIG), );
+      TU_ASSERT( tuh_descriptor_get_configuration(daddr, config_idx, enum_buf, total_len, process_enumeration, enum_user_data(idx, ENUM_SET_CONFIG)) );
     }
     break;
 
     case ENUM_SET_CONFIG:
       // Parse configuration & set up drivers
       // Driver open aren't allowed to make any usb transfer yet
-      TU_ASSERT( _parse_configuration_descriptor(daddr, (tusb_desc_configuration_t*) _usbh_ctrl_buf), );
+      TU_ASSERT( _parse_configuration_descriptor(daddr, (tusb_desc_configuration_t*) enum_buf) );
 
-      TU_ASSERT( tuh_configuration_set(daddr, CONFIG_NUM, process_enumeration, ENUM_CONFIG_DRIVER), );
+      TU_ASSERT( tuh_configuration_set(daddr, CONFIG_NUM, process_enumeration, enum_user_data(idx, ENUM_CONFIG_DRIVER)) );
     break;
 
     case ENUM_CONFIG_DRIVER:
     {
       TU_LOG_USBH("Device configured\r\n");
       usbh_device_t* dev = get_device(daddr);
-      TU_ASSERT(dev, );
+      TU_ASSERT(dev);
 
       dev->configured = 1;
 
@@ -1440,55 +3115,205 @@ static void process_enumeration(tuh_xfer_t* xfer)
 
     default:
       // stop enumeration if unknown state
-      enum_full_complete();
-    break;
+      return false;
   }
+
+  return true;
 }
 
-static bool enum_new_device(hcd_event_t* event)
+// process device enumeration
+static void process_enumeration(tuh_xfer_t* xfer)
 {
-  _dev0.rhport   = event->rhport;
-  _dev0.hub_addr = event->connection.hub_addr;
-  _dev0.hub_port = event->connection.hub_port;
+  // Retry a few times with transfers in enumeration since device can be unstable when starting up
+  enum {
+    ATTEMPT_COUNT_MAX = 3,
+    ATTEMPT_DELAY_MS = 100
+  };
 
-  if (_dev0.hub_addr == 0)
+  uint8_t const idx   = (uint8_t) (xfer->user_data >> 8);
+  uint8_t const state = (uint8_t) xfer->user_data;
+  TU_VERIFY(idx <= ENUM_IDX_DEV0, );
+
+  usbh_enum_t* ctx = &_usbh_enum[idx];
+
+  // device is unplugged or its enumeration failed meanwhile
+  if ( ctx->gen != (uint8_t) (xfer->user_data >> 16) ) return;
+
+  if (XFER_RESULT_SUCCESS != xfer->result)
   {
-    // connected/disconnected directly with roothub
-    // wait until device is stable TODO non blocking
-    hcd_port_reset(_dev0.rhport);
-    osal_task_delay(RESET_DELAY); // TODO may not work for no-OS on MCU that require reset_end() since
-                                  // sof of controller may not running while resetting
-    hcd_port_reset_end( _dev0.rhport);
+    // retry if not reaching max attempt
+    if ( ctx->failed_count < ATTEMPT_COUNT_MAX )
+    {
+      ctx->failed_count++;
+
+      // delay a bit, xfer is only valid within this callback
+      ctx->retry_request    = *xfer->setup;
+      ctx->retry_xfer       = *xfer;
+      ctx->retry_xfer.setup = &ctx->retry_request;
+
+      if ( !usbh_defer_func_ms(enum_retry, ctx, ATTEMPT_DELAY_MS) ) enum_full_complete(idx);
+    }else
+    {
+      enum_full_complete(idx);
+    }
+    return;
+  }
+  ctx->failed_count = 0;
 
-    // device unplugged while delaying
-    if ( !hcd_port_connect_status(_dev0.rhport) ) return true;
+  if ( !enum_process_state(idx, state, xfer) ) enum_full_complete(idx);
+}
 
-    _dev0.speed = hcd_port_speed_get(_dev0.rhport );
-    TU_LOG_USBH("%s Speed\r\n", tu_str_speed[_dev0.speed]);
+// Reset the attached device and continue enumerating with address 0
+static void enum_new_device(usbh_attach_t* attach)
+{
+  uint8_t const idx = ENUM_IDX_DEV0;
 
-    // fake transfer to kick-off the enumeration process
-    tuh_xfer_t xfer;
-    xfer.daddr     = 0;
-    xfer.result    = XFER_RESULT_SUCCESS;
-    xfer.user_data = ENUM_ADDR0_DEVICE_DESC;
+  _dev0.rhport      = attach->rhport;
+  _dev0.hub_addr    = attach->hub_addr;
+  _dev0.hub_port    = attach->hub_port;
+  _dev0.enumerating = 1;
 
-    process_enumeration(&xfer);
+  attach->state = ATTACH_FREE;
 
+  if (_dev0.hub_addr == 0)
+  {
+    // connected/disconnected directly with roothub, continue with ENUM_RESET_1 once reset is complete
+    hcd_port_reset(_dev0.rhport);
+    enum_delay(idx, ENUM_RESET_1, PORT_RESET_DELAY); // TODO may not work for no-OS on MCU that require reset_end() since
+                                                     // sof of controller may not running while resetting
   }
 #if CFG_TUH_HUB
   else
   {
     // connected/disconnected via external hub
-    // wait until device is stable
-    osal_task_delay(RESET_DELAY);
-
-    // ENUM_HUB_GET_STATUS
-    //TU_ASSERT( hub_port_get_status(_dev0.hub_addr, _dev0.hub_port, _usbh_ctrl_buf, enum_hub_get_status0_complete, 0) );
-    TU_ASSERT( hub_port_get_status(_dev0.hub_addr, _dev0.hub_port, _usbh_ctrl_buf, process_enumeration, ENUM_HUB_CLEAR_RESET_1) );
+    if ( !hub_port_reset(_dev0.hub_addr, _dev0.hub_port, process_enumeration, enum_user_data(idx, ENUM_HUB_RESET_1)) )
+    {
+      enum_full_complete(idx);
+    }
   }
 #endif // hub
+}
 
-  return true;
+// Device is stable after attached, it can be reset once address 0 is available
+static void enum_attach_stable(void* param)
+{
+  usbh_attach_t* attach = (usbh_attach_t*) param;
+  attach->state = ATTACH_READY;
+  enum_schedule();
+}
+
+static void enum_attach(hcd_event_t const* event)
+{
+  usbh_attach_t* attach = NULL;
+
+  for(uint8_t i=0; i<TOTAL_DEVICES; i++)
+  {
+    usbh_attach_t* cur = &_usbh_attach[i];
+    if ( cur->state == ATTACH_FREE )
+    {
+      if ( !attach ) attach = cur;
+    }
+    else if ( cur->rhport == event->rhport && cur->hub_addr == event->connection.hub_addr && cur->hub_port == event->connection.hub_port )
+    {
+      // attached again (bouncing) before it is addressed: restart debouncing
+      attach = cur;
+      break;
+    }
+  }
+
+  if ( !attach )
+  {
+    TU_LOG1("[%u:%u:%u] Too many attached devices\r\n", event->rhport, event->connection.hub_addr, event->connection.hub_port);
+    return;
+  }
+
+  _timer_cancel(attach);
+
+  attach->rhport   = event->rhport;
+  attach->hub_addr = event->connection.hub_addr;
+  attach->hub_port = event->connection.hub_port;
+  attach->state    = ATTACH_DEBOUNCE;
+
+  // wait until device is stable, other attached devices are debounced concurrently
+  if ( !usbh_defer_func_ms(enum_attach_stable, attach, RESET_DELAY) ) attach->state = ATTACH_FREE;
+}
+
+// Stop enumeration of context idx without continuing with waiting devices
+static void enum_release(uint8_t idx)
+{
+  usbh_enum_t* ctx = &_usbh_enum[idx];
+
+  // cancel pending delay or retry, ignore completion of on-going transfers
+  _timer_cancel(ctx);
+  ctx->gen++;
+  ctx->daddr = 0;
+  ctx->failed_count = 0;
+
+  if ( idx == ENUM_IDX_DEV0 ) _dev0.enumerating = 0;
+}
+
+// Stop enumerating devices which are not addressed yet and unplugged from rhport:hub_addr:hub_port
+static void enum_remove_port(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port)
+{
+  for(uint8_t i=0; i<TOTAL_DEVICES; i++)
+  {
+    usbh_attach_t* attach = &_usbh_attach[i];
+    if ( attach->state != ATTACH_FREE && enum_port_match(rhport, hub_addr, hub_port, attach->rhport, attach->hub_addr, attach->hub_port) )
+    {
+      _timer_cancel(attach);
+      attach->state = ATTACH_FREE;
+    }
+  }
+
+  if ( _dev0.enumerating && enum_port_match(rhport, hub_addr, hub_port, _dev0.rhport, _dev0.hub_addr, _dev0.hub_port) )
+  {
+    TU_LOG_USBH("Device at address 0 unplugged\r\n");
+    (void) _ctrl_xfer_abort_device(0);
+    hcd_device_close(rhport, 0);
+    enum_release(ENUM_IDX_DEV0);
+  }
+}
+
+// Stop enumerating an addressed device which is unplugged
+static void enum_abort_device(uint8_t daddr)
+{
+  for(uint8_t idx=0; idx<CFG_TUH_ENUMERATION_MAX; idx++)
+  {
+    if ( _usbh_enum[idx].daddr == daddr ) enum_release(idx);
+  }
+}
+
+// Continue with addressed devices waiting for an enumeration buffer and with the next device waiting for address 0
+static void enum_schedule(void)
+{
+  for(uint8_t idx=0; idx<CFG_TUH_ENUMERATION_MAX; idx++)
+  {
+    if ( _usbh_enum[idx].daddr ) continue;
+
+    for(uint8_t daddr=1; daddr<=TOTAL_DEVICES; daddr++)
+    {
+      usbh_device_t* dev = get_device(daddr);
+      if ( dev->enum_wait )
+      {
+        dev->enum_wait = 0;
+        enum_get_device_desc(idx, daddr);
+        break;
+      }
+    }
+  }
+
+  if ( !_dev0.enumerating )
+  {
+    for(uint8_t i=0; i<TOTAL_DEVICES; i++)
+    {
+      if ( _usbh_attach[i].state == ATTACH_READY )
+      {
+        TU_LOG_USBH("[%u:%u:%u] Enumerate new device\r\n", _usbh_attach[i].rhport, _usbh_attach[i].hub_addr, _usbh_attach[i].hub_port);
+        enum_new_device(&_usbh_attach[i]);
+        break;
+      }
+    }
+  }
 }
 
 static uint8_t get_new_address(bool is_hub)
@@ -1516,7 +3341,8 @@ static uint8_t get_new_address(bool is_hub)
 
 static bool enum_request_set_addr(void)
 {
-  tusb_desc_device_t const * desc_device = (tusb_desc_device_t const*) _usbh_ctrl_buf;
+  // only the first 8 bytes are received, which include bDeviceClass and bMaxPacketSize0
+  tusb_desc_device_t const * desc_device = (tusb_desc_device_t const*) _dev0_buf;
 
   // Get new address
   uint8_t const new_addr = get_new_address(desc_device->bDeviceClass == TUSB_CLASS_HUB);
@@ -1554,7 +3380,7 @@ static bool enum_request_set_addr(void)
     .setup       = &request,
     .buffer      = NULL,
     .complete_cb = process_enumeration,
-    .user_data   = ENUM_GET_DEVICE_DESC
+    .user_data   = enum_user_data(ENUM_IDX_DEV0, ENUM_GET_DEVICE_DESC)
   };
 
   TU_ASSERT( tuh_control_xfer(&xfer) );
@@ -1681,7 +3507,10 @@ void usbh_driver_set_config_complete(uint8_t dev_addr, uint8_t itf_num)
   // all interface are configured
   if (itf_num == CFG_TUH_INTERFACE_MAX)
   {
-    enum_full_complete();
+    for(uint8_t idx=0; idx<CFG_TUH_ENUMERATION_MAX; idx++)
+    {
+      if ( _usbh_enum[idx].daddr == dev_addr ) enum_full_complete(idx);
+    }
 
     if (is_hub_addr(dev_addr))
     {
@@ -1694,16 +3523,11 @@ void usbh_driver_set_config_complete(uint8_t dev_addr, uint8_t itf_num)
   }
 }
 
-static void enum_full_complete(void)
+// Enumeration of context idx is complete or failed, continue with waiting devices
+static void enum_full_complete(uint8_t idx)
 {
-  // mark enumeration as complete
-  _dev0.enumerating = 0;
-
-#if CFG_TUH_HUB
-  // get next hub status
-  if (_dev0.hub_addr) hub_edpt_status_xfer(_dev0.hub_addr);
-#endif
-
+  enum_release(idx);
+  enum_schedule();
 }
 
 #endif
@@ -66,7 +66,7 @@ struct tuh_xfer_s
   tuh_xfer_cb_t complete_cb;
   uintptr_t user_data;
 
-  // uint32_t timeout_ms;    // place holder, not supported yet
+  uint32_t timeout_ms;       // 0: default (CFG_TUH_CONTROL_TIMEOUT_MS) for control transfer, no timeout otherwise
 };
 
 // Subject to change
@@ -76,6 +76,53 @@ typedef struct
   tusb_desc_interface_t desc;
 } tuh_itf_info_t;
 
+// Isochronous packet, data of the packets of a transfer is contiguous in its buffer
+typedef struct tuh_iso_packet_s
+{
+  uint16_t length;          // bytes to send (OUT) or space in buffer (IN)
+  uint16_t actual_length;   // updated on completion
+  xfer_result_t result;     // updated on completion
+} tuh_iso_packet_t;
+
+typedef struct tuh_iso_stream_s tuh_iso_stream_t;
+
+// Invoked when a batch of a stream completes. Packets (lengths and data for OUT) can be updated before the batch is
+// resubmitted when the callback returns.
+typedef void (*tuh_iso_stream_cb_t)(tuh_iso_stream_t* stream, uint8_t* buffer, tuh_iso_packet_t* packets, uint16_t count);
+
+// Continuous isochronous stream: batch_count batches of batch_packets packets are kept queued in the controller, each
+// completed batch is handed to complete_cb then resubmitted. Batch i uses the batch_packets * packet_size bytes of
+// buffer at offset i * batch_packets * packet_size and the batch_packets entries of packets at i * batch_packets.
+struct tuh_iso_stream_s
+{
+  uint8_t daddr;
+  uint8_t ep_addr;
+  uint16_t packet_size;
+  uint8_t batch_count;
+  uint16_t batch_packets;
+
+  uint8_t* buffer;
+  tuh_iso_packet_t* packets;
+  tuh_iso_stream_cb_t complete_cb;
+  uintptr_t user_data;
+
+  // internal
+  uint8_t next_batch;
+  bool running;
+};
+
+// Strings of a device in UTF-8 (tuh_strings_get), empty if device does not have or fails to return a string
+typedef struct
+{
+  uint16_t langid; // language of strings, 0 if device has none
+  char manufacturer[CFG_TUH_STRING_MAXLEN];
+  char product[CFG_TUH_STRING_MAXLEN];
+  char serial[CFG_TUH_STRING_MAXLEN];
+} tuh_strings_t;
+
+// Invoked when all strings of a device are fetched
+typedef void (*tuh_strings_cb_t)(uint8_t daddr, tuh_strings_t const* strings, uintptr_t user_data);
+
 // ConfigID for tuh_config()
 enum
 {
@@ -97,6 +144,10 @@ TU_ATTR_WEAK void tuh_mount_cb (uint8_t daddr);
 /// Invoked when a device is unmounted (detached)
 TU_ATTR_WEAK void tuh_umount_cb(uint8_t daddr);
 
+// Invoked when descriptor cache (CFG_TUH_DESC_CACHE) is updated. Cache can be saved to non-volatile memory and restored
+// with tuh_descriptor_cache_restore() so that devices attached after a power cycle are enumerated from it.
+TU_ATTR_WEAK void tuh_descriptor_cache_updated_cb(void const* cache, uint32_t size);
+
 //--------------------------------------------------------------------+
 // APPLICATION API
 //--------------------------------------------------------------------+
@@ -139,6 +190,10 @@ bool tuh_vid_pid_get(uint8_t daddr, uint16_t* vid, uint16_t* pid);
 
 tusb_speed_t tuh_speed_get(uint8_t daddr);
 
+// Restore descriptor cache reported by tuh_descriptor_cache_updated_cb(), must be called after tuh_init().
+// Return false if cache is not enabled or was saved by a different configuration.
+bool tuh_descriptor_cache_restore(void const* cache, uint32_t size);
+
 // Check if device is connected and configured
 bool tuh_mounted(uint8_t daddr);
 
@@ -165,16 +220,30 @@ bool tuh_ready(uint8_t daddr)
 // Submit a control transfer
 //  - async: complete callback invoked when finished.
 //  - sync : blocking if complete callback is NULL.
+// Transfer is queued if the control pipe is busy, false if all CFG_TUH_CONTROL_XFER_MAX slots are in use
 bool tuh_control_xfer(tuh_xfer_t* xfer);
 
 // Submit a bulk/interrupt transfer
 //  - async: complete callback invoked when finished.
 //  - sync : blocking if complete callback is NULL.
+// Up to CFG_TUH_EDPT_XFER_MAX transfers can be submitted to an endpoint, they complete in submission order.
 bool tuh_edpt_xfer(tuh_xfer_t* xfer);
 
+// Abort submitted transfers of an endpoint without invoking their complete callback, for EP0 all queued and on-going
+// control transfers of the device are aborted (blocking ones return with XFER_RESULT_FAILED).
+// Return false if there is no transfer to abort or the controller does not support it.
+bool tuh_edpt_abort_xfer(uint8_t daddr, uint8_t ep_addr);
+
 // Open an non-control endpoint
 bool tuh_edpt_open(uint8_t dev_addr, tusb_desc_endpoint_t const * desc_ep);
 
+// Start an isochronous stream on an opened endpoint, all batches are submitted. IN packets are set to packet_size,
+// OUT packets must be prepared by application. Requires CFG_TUH_ISO_STREAM_MAX and controller support.
+bool tuh_iso_stream_start(tuh_iso_stream_t* stream);
+
+// Stop a stream, queued batches are aborted without invoking complete_cb
+bool tuh_iso_stream_stop(tuh_iso_stream_t* stream);
+
 // Set Configuration (control transfer)
 // config_num = 0 will un-configure device. Note: config_num = config_descriptor_index + 1
 // true on success, false if there is on-going control transfer or incorrect parameters
@@ -233,6 +302,12 @@ bool tuh_descriptor_get_product_string(uint8_t daddr, uint16_t language_id, void
 bool tuh_descriptor_get_serial_string(uint8_t daddr, uint16_t language_id, void* buffer, uint16_t len,
                                       tuh_xfer_cb_t complete_cb, uintptr_t user_data);
 
+// Fetch manufacturer, product and serial strings of a device in the preferred language (CFG_TUH_STRING_LANGID)
+// and convert them to UTF-8. complete_cb is invoked once all strings are ready, before returning if they are already
+// fetched. Devices are fetched concurrently up to CFG_TUH_STRINGS_FETCH_MAX, others wait for their turn.
+// false if device is not mounted or a fetch is already pending for it
+bool tuh_strings_get(uint8_t daddr, tuh_strings_cb_t complete_cb, uintptr_t user_data);
+
 //--------------------------------------------------------------------+
 // Descriptors Synchronous (blocking)
 //--------------------------------------------------------------------+
@@ -60,10 +60,24 @@ void usbh_driver_set_config_complete(uint8_t dev_addr, uint8_t itf_num);
 
 uint8_t usbh_get_rhport(uint8_t dev_addr);
 
-uint8_t* usbh_get_enum_buf(void);
+// Enumeration buffer (CFG_TUH_ENUMERATION_BUFSIZE) of a device, devices are enumerated concurrently therefore each
+// one must use its own buffer while it is configured. Devices which are not enumerating share a separate buffer.
+uint8_t* usbh_get_enum_buf(uint8_t dev_addr);
+
+// Allocate a DMA-capable endpoint buffer from the host memory pool (CFG_TUH_MEM_POOL_SIZE): placed in
+// CFG_TUH_MEM_SECTION, aligned and padded to CFG_TUH_MEM_POOL_ALIGN. Buffer is owned by the device and released
+// when it is removed. Return NULL if pool is exhausted.
+void* usbh_buf_alloc(uint8_t dev_addr, uint16_t size);
 
 void usbh_int_set(bool enabled);
 
+// Invoke func(param) within tuh_task() once delay_ms has elapsed, time is based on the frame number of the controller.
+// Should be used instead of osal_task_delay() to wait without blocking other devices.
+bool usbh_defer_func_ms(osal_task_func_t func, void* param, uint32_t delay_ms);
+
+// Cancel func(param) deferred by usbh_defer_func_ms() which has not been invoked yet
+void usbh_defer_func_cancel(osal_task_func_t func, void* param);
+
 //--------------------------------------------------------------------+
 // USBH Endpoint API
 //--------------------------------------------------------------------+
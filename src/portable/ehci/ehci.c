@@ -34,6 +34,7 @@
 #include "osal/osal.h"
 
 #include "host/hcd.h"
+#include "host/usbh.h"
 #include "ehci_api.h"
 #include "ehci.h"
 
@@ -58,27 +59,203 @@
 
 #define FRAMELIST_SIZE                  (1024 >> FRAMELIST_SIZE_BIT_VALUE)
 
+// Interrupt queue heads are linked to a tree of dummy queue heads with one node per polling interval (1, 2, 4 ..
+// PERIOD_INTERVAL_MAX frames) and phase. Frame f visits node (interval, f % interval) of every interval from the
+// longest one down to 1 ms. Endpoints with a longer interval are polled every PERIOD_INTERVAL_MAX frames.
+#ifndef CFG_TUH_EHCI_PERIOD_INTERVAL_MAX
+  #define CFG_TUH_EHCI_PERIOD_INTERVAL_MAX  8
+#endif
+
+#define PERIOD_INTERVAL_MAX  TU_MIN(CFG_TUH_EHCI_PERIOD_INTERVAL_MAX, FRAMELIST_SIZE)
+#define PERIOD_NODE_COUNT    (2*PERIOD_INTERVAL_MAX - 1)
+
+TU_VERIFY_STATIC((PERIOD_INTERVAL_MAX & (PERIOD_INTERVAL_MAX-1)) == 0 && PERIOD_INTERVAL_MAX <= 256,
+                 "period interval must be power of 2 up to 256");
+
+// Periodic bandwidth in high speed byte times: at most 80% of a micro frame (USB 2.0 5.7.4), transaction overhead is
+// approximated. Full/low speed transactions of all transaction translators share a frame budget (90% of a frame).
+enum {
+  BW_UFRAME_MAX   = 6000,
+  BW_HS_OVERHEAD  = 38,
+  BW_SPLIT_DATA   = 188, // full speed bytes per micro frame
+  BW_TT_FRAME_MAX = 1350,
+  BW_FS_OVERHEAD  = 16,
+};
+
 // Total queue head pool. TODO should be user configurable and more optimize memory usage in the future
 #define QHD_MAX      (CFG_TUH_DEVICE_MAX*CFG_TUH_ENDPOINT_MAX + CFG_TUH_HUB)
-#define QTD_MAX      QHD_MAX
+#define QHD_CONTROL_MAX (CFG_TUH_DEVICE_MAX+CFG_TUH_HUB+1)
+
+// Queue head of a non-control endpoint is looked up by device address (1 to QHD_CONTROL_MAX-1) and endpoint
+// (1-15 IN/OUT) with a table of pool indexes, 0 for not opened.
+#define QHD_INDEX_DEV   (QHD_CONTROL_MAX-1)
+#define QHD_INDEX_EP    30
+
+#if QHD_MAX < 255
+typedef uint8_t qhd_index_t;
+#else
+typedef uint16_t qhd_index_t;
+#endif
+
+// Total TD pool shared by all queue heads. Each opened queue head holds a dummy TD, a transfer takes one TD per
+// 16 KB (up to 20 KB depending on buffer alignment). Default allows one transfer of up to 16 KB queued per endpoint,
+// increase for larger transfers or deeper queues.
+#ifndef CFG_TUH_EHCI_QTD_MAX
+  #define CFG_TUH_EHCI_QTD_MAX  (2*(QHD_MAX + QHD_CONTROL_MAX))
+#endif
+
+#define QTD_MAX      CFG_TUH_EHCI_QTD_MAX
+
+TU_VERIFY_STATIC(QHD_MAX < UINT16_MAX && QTD_MAX < UINT16_MAX, "QHD/qTD pool is indexed by uint16_t");
+
+// TD management data, hardware qTD has no spare bytes
+typedef struct
+{
+  union {
+    uint32_t buffer;    // initial buffer for dcache invalidate since buffer pointer is advanced by HC
+    uint32_t free_next; // index of next free TD when unused
+  };
+  uint16_t length;   // initial total bytes
+  uint8_t  used;
+  uint8_t  xfer_end : 1; // last TD of a transfer
+  uint8_t  aborted  : 1; // on aborted list, controller may still access it
+}ehci_qtd_info_t;
+
+// Aborted queue head is unlinked from its list until the controller no longer caches it: a doorbell rung after the
+// unlink is acknowledged by async advance (and for periodic queue head, the frame of the unlink has passed)
+enum {
+  QHD_ABORT_UNLINKED = 1,
+  QHD_ABORT_DOORBELL = 2,
+};
+
+// Isochronous endpoints, 0 to disable. High speed endpoints are served by iTDs (one per frame), full speed endpoints
+// behind a hub by siTDs (one per packet). TDs are scheduled at most ISO_FRAMES_AHEAD frames in advance.
+#ifndef CFG_TUH_EHCI_ISO_EP_MAX
+  #define CFG_TUH_EHCI_ISO_EP_MAX  0
+#endif
+
+#if CFG_TUH_EHCI_ISO_EP_MAX
+
+// TDs are linked in the frame list no earlier than ISO_FRAME_MARGIN frames from the current one, which covers the
+// isochronous scheduling threshold of the controller
+#define ISO_FRAME_MARGIN   2u
+#define ISO_FRAMES_AHEAD   TU_MIN(FRAMELIST_SIZE - 1u, 8u)
+
+// TDs per endpoint: scheduled ahead plus completed or aborted ones waiting for their frame to pass
+#define ISO_TD_PER_EP      (ISO_FRAMES_AHEAD + 2u)
+
+// Queued transfers per endpoint
+#define ISO_XFER_MAX       4u
+
+#ifndef CFG_TUH_EHCI_ITD_MAX
+  #define CFG_TUH_EHCI_ITD_MAX   (CFG_TUH_EHCI_ISO_EP_MAX*ISO_TD_PER_EP)
+#endif
+
+#ifndef CFG_TUH_EHCI_SITD_MAX
+  #define CFG_TUH_EHCI_SITD_MAX  (CFG_TUH_EHCI_ISO_EP_MAX*ISO_TD_PER_EP)
+#endif
+
+#define ITD_MAX   CFG_TUH_EHCI_ITD_MAX
+#define SITD_MAX  CFG_TUH_EHCI_SITD_MAX
+
+TU_VERIFY_STATIC(ITD_MAX > 0 && ITD_MAX < 256 && SITD_MAX > 0 && SITD_MAX < 256, "iTD/siTD pool size is not correct");
+
+// iTD/siTD management data
+typedef struct
+{
+  uint32_t frame;     // frame number the TD is scheduled in
+  uint8_t  used;
+  uint8_t  reported;
+  uint8_t  slot_mask; // iTD: micro frames with a transaction
+  uint8_t  unlinked;  // removed while the controller may still access it, released once its frame has passed
+}ehci_iso_td_info_t;
+
+typedef struct
+{
+  uint8_t* buffer;
+  tuh_iso_packet_t* packets;
+  uint16_t count;
+}ehci_iso_xfer_t;
+
+typedef struct
+{
+  uint8_t  dev_addr;
+  uint8_t  ep_addr;      // 0 if not opened
+  uint8_t  high_speed;   // iTD if high speed, siTD otherwise
+  uint8_t  mult;
+  uint16_t mps;
+  uint8_t  hub_addr;
+  uint8_t  hub_port;
+  uint32_t interval;     // service interval in micro frames
+  uint8_t  phase;        // micro frame of the (first) transaction in a frame
+  uint8_t  smask;
+  uint8_t  cmask;
+  uint8_t  next_valid;
+  uint32_t next_uframe;  // micro frame of the next packet to schedule, invalid if idle
+
+  // Queued transfers from xfer_rd: packets are scheduled from xfer[xfer_rd + sched_xfer] and completed in xfer[xfer_rd]
+  ehci_iso_xfer_t xfer[ISO_XFER_MAX];
+  uint8_t  xfer_rd;
+  uint8_t  xfer_count;
+  uint8_t  sched_xfer;
+  uint16_t sched_pkt;
+  uint32_t sched_offset;
+  uint16_t done_pkt;
+  uint32_t done_offset;
+  uint32_t done_bytes;
+
+  // Pool index of linked TDs in frame order
+  uint8_t td[ISO_TD_PER_EP];
+  uint8_t td_rd;
+  uint8_t td_count;
+}ehci_iso_ep_t;
+
+#endif
 
 typedef struct
 {
   ehci_link_t period_framelist[FRAMELIST_SIZE];
 
-  // TODO only implement 1 ms & 2 ms & 4 ms, 8 ms (framelist)
-  // [0] : 1ms, [1] : 2ms, [2] : 4ms, [3] : 8 ms
+  // Interval tree: node of interval i (power of 2) and phase p is [i - 1 + p], 1 ms node is the root
   // TODO better implementation without dummy head to save SRAM
-  ehci_qhd_t period_head_arr[4];
+  ehci_qhd_t period_head_arr[PERIOD_NODE_COUNT];
+
+  // Reserved periodic bandwidth of frames f with f % PERIOD_INTERVAL_MAX == slot
+  uint16_t uframe_load[PERIOD_INTERVAL_MAX][8]; // per micro frame
+  uint16_t tt_load[PERIOD_INTERVAL_MAX];        // full/low speed
+
+  // Head of async list, always halted. Control qhd of dev0 is always on the list next to it.
+  ehci_qhd_t async_head;
 
-  // Note control qhd of dev0 is used as head of async list
   struct {
     ehci_qhd_t qhd;
-    ehci_qtd_t qtd;
-  }control[CFG_TUH_DEVICE_MAX+CFG_TUH_HUB+1];
+  }control[QHD_CONTROL_MAX];
 
   ehci_qhd_t qhd_pool[QHD_MAX];
   ehci_qtd_t qtd_pool[QTD_MAX] TU_ATTR_ALIGNED(32);
+  ehci_qtd_info_t qtd_info[QTD_MAX];
+
+  qhd_index_t qhd_index[QHD_INDEX_DEV][QHD_INDEX_EP]; // pool index + 1 of opened endpoint
+
+  // Head of free lists linked through qhd free_next and qtd_info free_next, pool size if empty
+  uint16_t qhd_free;
+  uint16_t qtd_free;
+
+  // TDs of aborted transfers, released once no queue head is aborting
+  uint16_t qtd_abort;
+  uint32_t abort_frame; // frame of the last unlinked periodic queue head
+
+  // Always inactive: alternate next of all but last TD of an IN transfer, queue head stops here on short packet
+  // until the transfer is reported and the queue is restarted with the next transfer.
+  ehci_qtd_t qtd_stop TU_ATTR_ALIGNED(32);
+
+#if CFG_TUH_EHCI_ISO_EP_MAX
+  ehci_itd_t  itd_pool[ITD_MAX];
+  ehci_sitd_t sitd_pool[SITD_MAX];
+  ehci_iso_td_info_t itd_info[ITD_MAX];
+  ehci_iso_td_info_t sitd_info[SITD_MAX];
+  ehci_iso_ep_t iso_ep[CFG_TUH_EHCI_ISO_EP_MAX];
+#endif
 
   ehci_registers_t* regs;         // operational register
   ehci_cap_registers_t* cap_regs; // capability register
@@ -126,10 +303,23 @@ static inline void print_intr(uint32_t intr) {
 //--------------------------------------------------------------------+
 // PROTOTYPE
 //--------------------------------------------------------------------+
-static inline ehci_link_t* get_period_head(uint8_t rhport, uint32_t interval_ms)
+// Interval of the tree an endpoint is polled at: power of 2 not greater than its interval
+static inline uint32_t period_interval(uint32_t interval_ms)
+{
+  return 1u << tu_log2( tu_min32(PERIOD_INTERVAL_MAX, tu_max32(1, interval_ms)) );
+}
+
+static inline ehci_link_t* get_period_head(uint8_t rhport, uint32_t interval_ms, uint32_t phase)
 {
   (void) rhport;
-  return (ehci_link_t*) &ehci_data.period_head_arr[ tu_log2( tu_min32(FRAMELIST_SIZE, interval_ms) ) ];
+  uint32_t const interval = period_interval(interval_ms);
+  return (ehci_link_t*) &ehci_data.period_head_arr[interval - 1 + (phase % interval)];
+}
+
+static inline bool is_period_head(uintptr_t addr)
+{
+  return (addr >= (uintptr_t) &ehci_data.period_head_arr[0]) &&
+         (addr <= (uintptr_t) &ehci_data.period_head_arr[PERIOD_NODE_COUNT-1]);
 }
 
 static inline ehci_qhd_t* qhd_control(uint8_t dev_addr)
@@ -140,28 +330,42 @@ static inline ehci_qhd_t* qhd_control(uint8_t dev_addr)
 static inline ehci_qhd_t* qhd_async_head(uint8_t rhport)
 {
   (void) rhport;
-  // control qhd of dev0 is used as async head
-  return qhd_control(0);
-}
-
-static inline ehci_qtd_t* qtd_control(uint8_t dev_addr)
-{
-  return &ehci_data.control[dev_addr].qtd;
+  return &ehci_data.async_head;
 }
 
 
 static inline ehci_qhd_t* qhd_next (ehci_qhd_t const * p_qhd);
-static inline ehci_qhd_t* qhd_find_free (void);
+static inline ehci_qhd_t* qhd_alloc (uint8_t dev_addr, uint8_t ep_addr);
+static inline void qhd_free (ehci_qhd_t* qhd);
 static inline ehci_qhd_t* qhd_get_from_addr (uint8_t dev_addr, uint8_t ep_addr);
-static void qhd_init(ehci_qhd_t *p_qhd, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc);
-static void qhd_attach_qtd(ehci_qhd_t *qhd, ehci_qtd_t *qtd);
-
-static inline ehci_qtd_t* qtd_find_free (void);
+static inline qhd_index_t* qhd_index_entry (uint8_t dev_addr, uint8_t ep_addr);
+static bool qhd_init(ehci_qhd_t *p_qhd, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc);
+static bool qhd_queue_xfer(ehci_qhd_t *qhd, uint8_t pid, uint8_t data_toggle, void const* buffer, uint16_t total_bytes);
+static void qhd_free_qtd(ehci_qhd_t *qhd);
+static inline void qhd_restart(ehci_qhd_t *qhd, uint32_t qtd_addr);
+static bool qhd_abort(uint8_t rhport, ehci_qhd_t* qhd);
+static bool qhd_abort_isr(uint8_t rhport, ehci_qhd_t* qhd, uint32_t frame);
+
+static inline ehci_qtd_t* qtd_alloc (void);
+static inline void qtd_free (ehci_qtd_t* qtd);
+static inline ehci_qtd_t* qtd_next (ehci_qtd_t const* qtd);
+static inline ehci_qtd_info_t* qtd_get_info (ehci_qtd_t const* qtd);
 static void qtd_init (ehci_qtd_t* qtd, void const* buffer, uint16_t total_bytes);
 
+static bool qhd_bw_reserve(ehci_qhd_t* qhd, uint8_t b_interval);
+static void qhd_bw_release(ehci_qhd_t const* qhd);
+
 static inline void list_insert (ehci_link_t *current, ehci_link_t *new, uint8_t new_type);
 static inline ehci_link_t* list_next (ehci_link_t const *p_link);
 
+#if CFG_TUH_EHCI_ISO_EP_MAX
+static ehci_iso_ep_t* iso_ep_find(uint8_t dev_addr, uint8_t ep_addr);
+static bool iso_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc);
+static bool iso_edpt_abort(ehci_iso_ep_t* ep);
+static void iso_edpt_close(ehci_iso_ep_t* ep);
+static void iso_xfer_complete_isr(void);
+#endif
+
 TU_ATTR_WEAK void hcd_dcache_clean(void* addr, uint32_t data_size) {
   (void) addr; (void) data_size;
 }
@@ -234,8 +438,8 @@ static void list_remove_qhd_by_daddr(ehci_link_t* list_head, uint8_t dev_addr) {
   while (prev && !prev->terminate) {
     ehci_qhd_t* qhd = (ehci_qhd_t*) (uintptr_t) list_next(prev);
 
-    // done if loop back to head
-    if ( (uintptr_t) qhd == (uintptr_t) list_head) {
+    // done if loop back to head, or reached next node of the interval tree
+    if ( (uintptr_t) qhd == (uintptr_t) list_head || is_period_head((uintptr_t) qhd)) {
       break;
     }
 
@@ -244,12 +448,17 @@ static void list_remove_qhd_by_daddr(ehci_link_t* list_head, uint8_t dev_addr) {
       prev->address = qhd->next.address;
 
       // EHCI 4.8.2 link the removed qhd's next to async head (which always reachable by Host Controller)
-      qhd->next.address = ((uint32_t) list_head) | (EHCI_QTYPE_QHD << 1);
+      qhd->next.address = ((uint32_t) (uintptr_t) list_head) | (EHCI_QTYPE_QHD << 1);
+
+      // no longer found by address, an endpoint of a new device with same address can be opened
+      qhd_index_t* index = qhd_index_entry(qhd->dev_addr, tu_edpt_addr(qhd->ep_number, qhd->pid == EHCI_PID_IN));
+      if ( index && *index == (qhd - ehci_data.qhd_pool) + 1 ) *index = 0;
 
       if ( qhd->int_smask )
       {
         // period list queue element is guarantee to be free in the next frame (1 ms)
-        qhd->used = 0;
+        qhd_bw_release(qhd);
+        qhd_free(qhd);
       }else
       {
         // async list use async advance handshake
@@ -273,11 +482,36 @@ void hcd_device_close(uint8_t rhport, uint8_t daddr)
     return;
   }
 
+#if CFG_TUH_EHCI_ISO_EP_MAX
+  hcd_int_disable(rhport);
+  for (uint8_t i = 0; i < CFG_TUH_EHCI_ISO_EP_MAX; i++) {
+    ehci_iso_ep_t* ep = &ehci_data.iso_ep[i];
+    if (ep->ep_addr && ep->dev_addr == daddr) {
+      iso_edpt_close(ep);
+    }
+  }
+  hcd_int_enable(rhport);
+#endif
+
+  // Aborting queue heads are not on any list: released once abort completes
+  hcd_int_disable(rhport);
+  for (uint32_t i = 0; i < QHD_MAX; i++) {
+    ehci_qhd_t* qhd = &ehci_data.qhd_pool[i];
+    if (qhd->used && qhd->aborting && qhd->dev_addr == daddr) {
+      qhd_index_t* index = qhd_index_entry(qhd->dev_addr, tu_edpt_addr(qhd->ep_number, qhd->pid == EHCI_PID_IN));
+      if ( index && *index == i + 1 ) *index = 0;
+      if ( qhd->int_smask ) qhd_bw_release(qhd);
+      qhd->removing = 1;
+    }
+  }
+  if (qhd_control(daddr)->aborting) qhd_control(daddr)->removing = 1;
+  hcd_int_enable(rhport);
+
   // Remove from async list
   list_remove_qhd_by_daddr((ehci_link_t *) qhd_async_head(rhport), daddr);
 
-  // Remove from all interval period list
-  for(uint8_t i = 0; i < TU_ARRAY_SIZE(ehci_data.period_head_arr); i++) {
+  // Remove from all nodes of the interval tree
+  for(uint32_t i = 0; i < TU_ARRAY_SIZE(ehci_data.period_head_arr); i++) {
     list_remove_qhd_by_daddr((ehci_link_t *) &ehci_data.period_head_arr[i], daddr);
   }
 
@@ -286,45 +520,45 @@ void hcd_device_close(uint8_t rhport, uint8_t daddr)
 }
 
 static void init_periodic_list(uint8_t rhport) {
-  // Build the polling interval tree with 1 ms, 2 ms, 4 ms and 8 ms (framesize) only
   for ( uint32_t i = 0; i < TU_ARRAY_SIZE(ehci_data.period_head_arr); i++ ) {
     ehci_data.period_head_arr[i].int_smask          = 1; // queue head in period list must have smask non-zero
     ehci_data.period_head_arr[i].qtd_overlay.halted = 1; // dummy node, always inactive
   }
 
-  ehci_link_t * const framelist  = ehci_data.period_framelist;
-  ehci_link_t * const period_1ms = get_period_head(rhport, 1u);
+  // node (interval, phase) --> node (interval/2, phase % (interval/2)) ... --> 1 ms node
+  for ( uint32_t interval = PERIOD_INTERVAL_MAX; interval > 1; interval /= 2 ) {
+    for ( uint32_t phase = 0; phase < interval; phase++ ) {
+      ehci_link_t* node = get_period_head(rhport, interval, phase);
+      node->address = (uint32_t) (uintptr_t) get_period_head(rhport, interval/2, phase);
+      node->type    = EHCI_QTYPE_QHD;
+    }
+  }
 
-  // all links --> period_head_arr[0] (1ms)
-  // 0, 2, 4, 6 etc --> period_head_arr[1] (2ms)
-  // 1, 5 --> period_head_arr[2] (4ms)
-  // 3 --> period_head_arr[3] (8ms)
+  get_period_head(rhport, 1u, 0)->terminate = 1;
 
-  // TODO EHCI_FRAMELIST_SIZE with other size than 8
+  // frame f --> node (longest interval, f % longest interval)
+  ehci_link_t * const framelist = ehci_data.period_framelist;
   for (uint32_t i = 0; i < FRAMELIST_SIZE; i++) {
-    framelist[i].address = (uint32_t) period_1ms;
+    framelist[i].address = (uint32_t) (uintptr_t) get_period_head(rhport, PERIOD_INTERVAL_MAX, i);
     framelist[i].type = EHCI_QTYPE_QHD;
   }
-
-  for (uint32_t i = 0; i < FRAMELIST_SIZE; i += 2) {
-    list_insert(framelist + i, get_period_head(rhport, 2u), EHCI_QTYPE_QHD);
-  }
-
-  for (uint32_t i = 1; i < FRAMELIST_SIZE; i += 4) {
-    list_insert(framelist + i, get_period_head(rhport, 4u), EHCI_QTYPE_QHD);
-  }
-
-  list_insert(framelist + 3, get_period_head(rhport, 8u), EHCI_QTYPE_QHD);
-
-  period_1ms->terminate    = 1;
 }
 
 bool ehci_init(uint8_t rhport, uint32_t capability_reg, uint32_t operatial_reg)
 {
   tu_memclr(&ehci_data, sizeof(ehci_data_t));
 
-  ehci_data.regs = (ehci_registers_t*) operatial_reg;
-  ehci_data.cap_regs = (ehci_cap_registers_t*) capability_reg;
+  // free lists: all queue heads and TDs in order
+  for (uint16_t i = 0; i < QHD_MAX; i++) {
+    ehci_data.qhd_pool[i].free_next = i + 1;
+  }
+
+  for (uint16_t i = 0; i < QTD_MAX; i++) {
+    ehci_data.qtd_info[i].free_next = i + 1;
+  }
+
+  ehci_data.regs = (ehci_registers_t*) (uintptr_t) operatial_reg;
+  ehci_data.cap_regs = (ehci_cap_registers_t*) (uintptr_t) capability_reg;
 
   ehci_registers_t* regs = ehci_data.regs;
 
@@ -344,21 +578,32 @@ bool ehci_init(uint8_t rhport, uint32_t capability_reg, uint32_t operatial_reg)
   regs->inten  = EHCI_INT_MASK_ERROR | EHCI_INT_MASK_PORT_CHANGE | EHCI_INT_MASK_ASYNC_ADVANCE |
                  EHCI_INT_MASK_NXP_PERIODIC | EHCI_INT_MASK_NXP_ASYNC | EHCI_INT_MASK_FRAMELIST_ROLLOVER;
 
+  ehci_data.qtd_abort = QTD_MAX;
+
   //------------- Asynchronous List -------------//
   ehci_qhd_t * const async_head = qhd_async_head(rhport);
   tu_memclr(async_head, sizeof(ehci_qhd_t));
 
-  async_head->next.address                    = (uint32_t) async_head; // circular list, next is itself
+  async_head->next.address                    = (uint32_t) (uintptr_t) async_head; // circular list, next is itself
   async_head->next.type                       = EHCI_QTYPE_QHD;
   async_head->head_list_flag                  = 1;
-  async_head->qtd_overlay.halted              = 1; // inactive most of time
-  async_head->qtd_overlay.next.terminate      = 1; // TODO removed if verified
+  async_head->qtd_overlay.halted              = 1; // always inactive
+  async_head->qtd_overlay.next.terminate      = 1;
+
+  // control of dev0 is linked once, halted until opened
+  ehci_qhd_t * const qhd_dev0 = qhd_control(0);
+  qhd_dev0->qtd_overlay.halted         = 1;
+  qhd_dev0->qtd_overlay.next.terminate = 1;
+  list_insert((ehci_link_t*) async_head, (ehci_link_t*) qhd_dev0, EHCI_QTYPE_QHD);
 
-  regs->async_list_addr = (uint32_t) async_head;
+  ehci_data.qtd_stop.next.terminate      = 1;
+  ehci_data.qtd_stop.alternate.terminate = 1;
+
+  regs->async_list_addr = (uint32_t) (uintptr_t) async_head;
 
   //------------- Periodic List -------------//
   init_periodic_list(rhport);
-  regs->periodic_list_base = (uint32_t) ehci_data.period_framelist;
+  regs->periodic_list_base = (uint32_t) (uintptr_t) ehci_data.period_framelist;
 
   hcd_dcache_clean(&ehci_data, sizeof(ehci_data_t));
 
@@ -405,18 +650,29 @@ static void ehci_stop(uint8_t rhport)
 
 bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc)
 {
-  (void) rhport;
-
-  // TODO not support ISO yet
-  TU_ASSERT (ep_desc->bmAttributes.xfer != TUSB_XFER_ISOCHRONOUS);
+  if (ep_desc->bmAttributes.xfer == TUSB_XFER_ISOCHRONOUS) {
+#if CFG_TUH_EHCI_ISO_EP_MAX
+    return iso_edpt_open(rhport, dev_addr, ep_desc);
+#else
+    TU_LOG1("EHCI: isochronous endpoint requires CFG_TUH_EHCI_ISO_EP_MAX\r\n");
+    return false;
+#endif
+  }
 
   //------------- Prepare Queue Head -------------//
-  ehci_qhd_t *p_qhd = (ep_desc->bEndpointAddress == 0) ? qhd_control(dev_addr) : qhd_find_free();
+  ehci_qhd_t *p_qhd = (ep_desc->bEndpointAddress == 0) ? qhd_control(dev_addr) :
+                                                          qhd_alloc(dev_addr, ep_desc->bEndpointAddress);
   TU_ASSERT(p_qhd);
 
-  qhd_init(p_qhd, dev_addr, ep_desc);
+  if ( !qhd_init(p_qhd, dev_addr, ep_desc) ) {
+    if ( ep_desc->bEndpointAddress != 0 ) {
+      *qhd_index_entry(dev_addr, ep_desc->bEndpointAddress) = 0;
+      qhd_free(p_qhd);
+    }
+    return false;
+  }
 
-  // control of dev0 is always present as async head
+  // control of dev0 is always on the async list
   if ( dev_addr == 0 ) return true;
 
   // Insert to list
@@ -430,11 +686,7 @@ bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const
     break;
 
     case TUSB_XFER_INTERRUPT:
-      list_head = get_period_head(rhport, p_qhd->interval_ms);
-    break;
-
-    case TUSB_XFER_ISOCHRONOUS:
-      // TODO iso is not supported
+      list_head = get_period_head(rhport, p_qhd->interval_ms, p_qhd->interval_phase);
     break;
 
     default: break;
@@ -455,18 +707,10 @@ bool hcd_setup_send(uint8_t rhport, uint8_t dev_addr, uint8_t const setup_packet
 {
   (void) rhport;
 
-  ehci_qhd_t* qhd = &ehci_data.control[dev_addr].qhd;
-  ehci_qtd_t* td  = &ehci_data.control[dev_addr].qtd;
-
-  qtd_init(td, setup_packet, 8);
-  td->pid = EHCI_PID_SETUP;
-
   hcd_dcache_clean((void *) setup_packet, 8);
 
-  // attach TD to QHD -> start transferring
-  qhd_attach_qtd(qhd, td);
-
-  return true;
+  // queue TD to QHD -> start transferring
+  return qhd_queue_xfer(qhd_control(dev_addr), EHCI_PID_SETUP, 0, setup_packet, 8);
 }
 
 bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t buflen)
@@ -476,26 +720,8 @@ bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *
   uint8_t const epnum = tu_edpt_number(ep_addr);
   uint8_t const dir   = tu_edpt_dir(ep_addr);
 
-  ehci_qhd_t* qhd;
-  ehci_qtd_t* qtd;
-
-  if (epnum == 0) {
-    qhd = qhd_control(dev_addr);
-    qtd = qtd_control(dev_addr);
-
-    qtd_init(qtd, buffer, buflen);
-
-    // first data toggle is always 1 (data & setup stage)
-    qtd->data_toggle = 1;
-    qtd->pid = dir ? EHCI_PID_IN : EHCI_PID_OUT;
-  } else {
-    qhd = qhd_get_from_addr(dev_addr, ep_addr);
-    qtd = qtd_find_free();
-    TU_ASSERT(qtd);
-
-    qtd_init(qtd, buffer, buflen);
-    qtd->pid = qhd->pid;
-  }
+  ehci_qhd_t* qhd = (epnum == 0) ? qhd_control(dev_addr) : qhd_get_from_addr(dev_addr, ep_addr);
+  TU_ASSERT(qhd);
 
   // IN transfer: invalidate buffer, OUT transfer: clean buffer
   if (dir) {
@@ -504,251 +730,994 @@ bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *
     hcd_dcache_clean(buffer, buflen);
   }
 
-  // attach TD to QHD -> start transferring
-  qhd_attach_qtd(qhd, qtd);
-
-  return true;
+  // queue TDs to QHD -> start transferring, appended after on-going transfers of this endpoint.
+  // Control: first data toggle is always 1 (data & status stage), others: toggle is maintained by QHD
+  uint8_t const pid = dir ? EHCI_PID_IN : EHCI_PID_OUT;
+  return qhd_queue_xfer(qhd, pid, (epnum == 0) ? 1 : 0, buffer, buflen);
 }
 
 bool hcd_edpt_clear_stall(uint8_t daddr, uint8_t ep_addr)
 {
   ehci_qhd_t *qhd = qhd_get_from_addr(daddr, ep_addr);
-  qhd->qtd_overlay.halted = 0;
+  TU_VERIFY(qhd);
+
+  // device resets its data toggle on ClearFeature(ENDPOINT_HALT)
+  qhd->qtd_overlay.halted      = 0;
+  qhd->qtd_overlay.data_toggle = 0;
   hcd_dcache_clean_invalidate(qhd, sizeof(ehci_qhd_t));
-  // TODO reset data toggle ?
   return true;
 }
 
+bool hcd_edpt_abort_xfer(uint8_t rhport, uint8_t daddr, uint8_t ep_addr)
+{
+  (void) rhport;
+
+#if CFG_TUH_EHCI_ISO_EP_MAX
+  ehci_iso_ep_t* iso_ep = iso_ep_find(daddr, ep_addr);
+  if (iso_ep) {
+    hcd_int_disable(rhport);
+    bool const aborted = iso_edpt_abort(iso_ep);
+    hcd_int_enable(rhport);
+    return aborted;
+  }
+#endif
+
+  ehci_qhd_t *qhd = (0 == tu_edpt_number(ep_addr)) ? qhd_control(daddr) : qhd_get_from_addr(daddr, ep_addr);
+  TU_VERIFY(qhd && !qhd->removing);
+
+  hcd_int_disable(rhport);
+  bool const aborted = qhd_abort(rhport, qhd);
+  hcd_int_enable(rhport);
+
+  return aborted;
+}
+
 //--------------------------------------------------------------------+
-// EHCI Interrupt Handler
+// Periodic Bandwidth
 //--------------------------------------------------------------------+
 
-// async_advance is handshake between usb stack & ehci controller.
-// This isr mean it is safe to modify previously removed queue head from async list.
-// In tinyusb, queue head is only removed when device is unplugged.
-TU_ATTR_ALWAYS_INLINE static inline
-void async_advance_isr(uint8_t rhport)
+// Highest micro frame load if cost is added to frames of the interval at phase, UINT32_MAX if full/low speed budget
+// is exceeded.
+static uint32_t period_bw_peak(uint32_t interval, uint32_t phase, uint16_t const cost[8], uint16_t tt_cost)
 {
-  (void) rhport;
+  uint32_t peak = 0;
+  for (uint32_t slot = phase; slot < PERIOD_INTERVAL_MAX; slot += interval) {
+    if (ehci_data.tt_load[slot] + tt_cost > BW_TT_FRAME_MAX) return UINT32_MAX;
 
-  ehci_qhd_t *qhd_pool = ehci_data.qhd_pool;
-  for (uint32_t i = 0; i < QHD_MAX; i++) {
-    if (qhd_pool[i].removing) {
-      qhd_pool[i].removing = 0;
-      qhd_pool[i].used = 0;
+    for (uint8_t u = 0; u < 8; u++) {
+      if (cost[u]) {
+        peak = tu_max32(peak, (uint32_t) ehci_data.uframe_load[slot][u] + cost[u]);
+      }
     }
   }
+  return peak;
 }
 
-TU_ATTR_ALWAYS_INLINE static inline
-void port_connect_status_change_isr(uint8_t rhport)
+// Total load of frames of the interval at phase, used to balance endpoints across frames
+static uint32_t period_bw_total(uint32_t interval, uint32_t phase)
 {
-  // NOTE There is an sequence plug->unplug->…..-> plug if device is powering with pre-plugged device
-  if (ehci_data.regs->portsc_bm.current_connect_status)
-  {
-    hcd_port_reset(rhport);
-    hcd_event_device_attach(rhport, true);
-  }else // device unplugged
-  {
-    hcd_event_device_remove(rhport, true);
+  uint32_t total = 0;
+  for (uint32_t slot = phase; slot < PERIOD_INTERVAL_MAX; slot += interval) {
+    for (uint8_t u = 0; u < 8; u++) {
+      total += ehci_data.uframe_load[slot][u];
+    }
   }
+  return total;
 }
 
-TU_ATTR_ALWAYS_INLINE static inline
-void qhd_xfer_complete_isr(ehci_qhd_t * qhd) {
-  // examine TD attached to queue head
-  ehci_qtd_t * volatile qtd = (ehci_qtd_t * volatile) qhd->attached_qtd;
-  if (qtd == NULL) return; // no TD attached
-  hcd_dcache_invalidate(qtd, sizeof(ehci_qtd_t));
-
-  // TD is still active, no need to process
-  if (qtd->active) {
-    return;
+static void period_bw_update(uint32_t interval, uint32_t phase, uint16_t const cost[8], uint16_t tt_cost, bool reserve)
+{
+  for (uint32_t slot = phase; slot < PERIOD_INTERVAL_MAX; slot += interval) {
+    for (uint8_t u = 0; u < 8; u++) {
+      ehci_data.uframe_load[slot][u] = reserve ? (uint16_t) (ehci_data.uframe_load[slot][u] + cost[u])
+                                               : (uint16_t) (ehci_data.uframe_load[slot][u] - cost[u]);
+    }
+    ehci_data.tt_load[slot] = reserve ? (uint16_t) (ehci_data.tt_load[slot] + tt_cost)
+                                      : (uint16_t) (ehci_data.tt_load[slot] - tt_cost);
   }
+}
 
-  uint8_t dir = (qtd->pid == EHCI_PID_IN) ? 1 : 0;
-  uint32_t const xferred_bytes = qtd->expected_bytes - qtd->total_bytes;
+// Bus time of an interrupt queue head in each micro frame of a frame it is polled in, derived from its S-mask and
+// C-mask. Split: data is carried by the start split (OUT) or by one of the complete splits (IN), each complete split
+// is charged since the data can come in any of them. Return full/low speed time used on the transaction translator.
+static uint16_t qhd_bw_cost(ehci_qhd_t const* qhd, uint16_t cost[8])
+{
+  uint16_t const mps = qhd->max_packet_size;
 
-  // invalidate dcache if IN transfer
-  if (dir == 1 && qhd->attached_buffer != 0 && xferred_bytes > 0) {
-    hcd_dcache_invalidate((void*) qhd->attached_buffer, xferred_bytes);
+  if (TUSB_SPEED_HIGH == qhd->ep_speed) {
+    for (uint8_t u = 0; u < 8; u++) {
+      cost[u] = tu_bit_test(qhd->int_smask, u) ? (uint16_t) (mps*qhd->mult + BW_HS_OVERHEAD) : 0;
+    }
+    return 0;
   }
 
-  // remove and free TD before invoking callback
-  qhd->attached_qtd = NULL;
-  qhd->attached_buffer = 0;
-  qtd->used = 0; // free QTD
+  uint16_t const data = tu_min16(mps, BW_SPLIT_DATA);
+  bool const is_in = (qhd->pid == EHCI_PID_IN);
+
+  for (uint8_t u = 0; u < 8; u++) {
+    if (tu_bit_test(qhd->int_smask, u)) {
+      cost[u] = (uint16_t) ((is_in ? 0 : data) + BW_HS_OVERHEAD);
+    } else if (tu_bit_test(qhd->fl_int_cmask, u)) {
+      cost[u] = (uint16_t) ((is_in ? data : 0) + BW_HS_OVERHEAD);
+    } else {
+      cost[u] = 0;
+    }
+  }
 
-  // notify usbh
-  uint8_t const ep_addr = tu_edpt_addr(qhd->ep_number, dir);
-  hcd_event_xfer_complete(qhd->dev_addr, ep_addr, xferred_bytes, XFER_RESULT_SUCCESS, true);
+  // low speed bit time is 8 full speed bit times
+  uint16_t const fs_time = (uint16_t) (mps + BW_FS_OVERHEAD);
+  return (TUSB_SPEED_LOW == qhd->ep_speed) ? (uint16_t) (8*fs_time) : fs_time;
 }
 
-TU_ATTR_ALWAYS_INLINE static inline
-void async_list_xfer_complete_isr(ehci_qhd_t * const async_head)
+// Assign interval tree phase, S-mask and C-mask of an interrupt queue head to the least loaded frames and micro frames
+// and reserve its bandwidth. Candidates (USB 2.0 11.18, EHCI 4.12.2):
+// - High speed sub millisecond: every 1, 2 or 4 micro frames at each offset
+// - High speed: one micro frame
+// - Full/Low speed: start split in micro frame 0-3, complete splits in the following 2nd to 4th micro frames
+static bool qhd_bw_reserve(ehci_qhd_t* qhd, uint8_t b_interval)
 {
-  ehci_qhd_t *p_qhd = async_head;
-  do
-  {
-    hcd_dcache_invalidate(p_qhd, sizeof(ehci_qhd_t));
+  uint32_t const interval = period_interval(qhd->interval_ms);
+
+  uint8_t smask_arr[8];
+  uint8_t cmask_arr[8];
+  uint8_t count = 0;
+
+  if (TUSB_SPEED_HIGH == qhd->ep_speed) {
+    if (qhd->interval_ms == 0) {
+      uint8_t const step = (uint8_t) (1u << (b_interval - 1));
+      uint8_t const base = (step == 1) ? TU_BIN8(11111111) : (step == 2) ? TU_BIN8(01010101) : TU_BIN8(00010001);
+      for (uint8_t off = 0; off < step; off++) {
+        smask_arr[count] = (uint8_t) (base << off);
+        cmask_arr[count] = 0;
+        count++;
+      }
+    } else {
+      for (uint8_t u = 0; u < 8; u++) {
+        smask_arr[count] = (uint8_t) TU_BIT(u);
+        cmask_arr[count] = 0;
+        count++;
+      }
+    }
+  } else {
+    for (uint8_t u = 0; u < 4; u++) {
+      smask_arr[count] = (uint8_t) TU_BIT(u);
+      cmask_arr[count] = (uint8_t) (TU_BIN8(111) << (u + 2));
+      count++;
+    }
+  }
 
-    // halted or error is processed in error isr
-    if ( !p_qhd->qtd_overlay.halted ) {
-      qhd_xfer_complete_isr(p_qhd);
+  uint32_t best_peak  = UINT32_MAX;
+  uint32_t best_total = UINT32_MAX;
+  uint8_t  best_phase = 0;
+  uint8_t  best_idx   = 0;
+
+  for (uint8_t phase = 0; phase < interval; phase++) {
+    uint32_t const total = period_bw_total(interval, phase);
+
+    for (uint8_t i = 0; i < count; i++) {
+      uint16_t cost[8];
+      qhd->int_smask    = smask_arr[i];
+      qhd->fl_int_cmask = cmask_arr[i];
+      uint16_t const tt_cost = qhd_bw_cost(qhd, cost);
+
+      uint32_t const peak = period_bw_peak(interval, phase, cost, tt_cost);
+      if (peak < best_peak || (peak == best_peak && total < best_total)) {
+        best_peak  = peak;
+        best_total = total;
+        best_phase = phase;
+        best_idx   = i;
+      }
     }
+  }
 
-    p_qhd = qhd_next(p_qhd);
-  }while(p_qhd != async_head); // async list traversal, stop if loop around
+  if (best_peak > BW_UFRAME_MAX) {
+    TU_LOG1("EHCI: not enough periodic bandwidth for EP %02X\r\n", qhd->ep_number);
+    return false;
+  }
+
+  qhd->int_smask      = smask_arr[best_idx];
+  qhd->fl_int_cmask   = cmask_arr[best_idx];
+  qhd->interval_phase = best_phase;
+
+  uint16_t cost[8];
+  uint16_t const tt_cost = qhd_bw_cost(qhd, cost);
+  period_bw_update(interval, best_phase, cost, tt_cost, true);
+
+  TU_LOG2("EHCI: EP %u interval %u phase %u smask %02X cmask %02X, peak micro frame load %u\r\n", qhd->ep_number,
+          (unsigned) interval, best_phase, qhd->int_smask, qhd->fl_int_cmask, (unsigned) best_peak);
+
+  return true;
 }
 
-TU_ATTR_ALWAYS_INLINE static inline
-void period_list_xfer_complete_isr(uint8_t rhport, uint32_t interval_ms)
+static void qhd_bw_release(ehci_qhd_t const* qhd)
 {
-  uint32_t const period_1ms_addr = (uint32_t) get_period_head(rhport, 1u);
-  ehci_link_t next_link = * get_period_head(rhport, interval_ms);
+  uint16_t cost[8];
+  uint16_t const tt_cost = qhd_bw_cost(qhd, cost);
+  period_bw_update(period_interval(qhd->interval_ms), qhd->interval_phase, cost, tt_cost, false);
+}
 
-  while (!next_link.terminate) {
-    if (interval_ms > 1 && period_1ms_addr == tu_align32(next_link.address)) {
-      // 1ms period list is end of list for all larger interval
-      break;
+void ehci_period_bandwidth_get(uint8_t rhport, ehci_period_bandwidth_t* bw)
+{
+  (void) rhport;
+  tu_memclr(bw, sizeof(ehci_period_bandwidth_t));
+
+  for (uint32_t slot = 0; slot < PERIOD_INTERVAL_MAX; slot++) {
+    for (uint8_t u = 0; u < 8; u++) {
+      bw->uframe_load_max = tu_max16(bw->uframe_load_max, ehci_data.uframe_load[slot][u]);
     }
+    bw->tt_load_max = tu_max16(bw->tt_load_max, ehci_data.tt_load[slot]);
+  }
 
-    uintptr_t const entry_addr = tu_align32(next_link.address);
+  bw->uframe_budget = BW_UFRAME_MAX;
+  bw->tt_budget     = BW_TT_FRAME_MAX;
+}
 
-    switch (next_link.type) {
-      case EHCI_QTYPE_QHD: {
-        ehci_qhd_t *qhd = (ehci_qhd_t *) entry_addr;
-        hcd_dcache_invalidate(qhd, sizeof(ehci_qhd_t));
+//--------------------------------------------------------------------+
+// Isochronous
+//--------------------------------------------------------------------+
+#if CFG_TUH_EHCI_ISO_EP_MAX
 
-        if (!qhd->qtd_overlay.halted) {
-          qhd_xfer_complete_isr(qhd);
-        }
-      }
-        break;
+static ehci_iso_ep_t* iso_ep_find(uint8_t dev_addr, uint8_t ep_addr)
+{
+  for (uint8_t i = 0; i < CFG_TUH_EHCI_ISO_EP_MAX; i++) {
+    ehci_iso_ep_t* ep = &ehci_data.iso_ep[i];
+    if (ep->ep_addr && ep->ep_addr == ep_addr && ep->dev_addr == dev_addr) {
+      return ep;
+    }
+  }
+  return NULL;
+}
 
-      case EHCI_QTYPE_ITD:
-        // TODO support hs ISO
-        break;
+static inline ehci_iso_td_info_t* iso_td_info(ehci_iso_ep_t const* ep, uint8_t idx)
+{
+  return ep->high_speed ? &ehci_data.itd_info[idx] : &ehci_data.sitd_info[idx];
+}
 
-      case EHCI_QTYPE_SITD:
-        // TODO support split ISO
-        break;
+static inline ehci_link_t* iso_td_link(ehci_iso_ep_t const* ep, uint8_t idx)
+{
+  return ep->high_speed ? (ehci_link_t*) &ehci_data.itd_pool[idx] : (ehci_link_t*) &ehci_data.sitd_pool[idx];
+}
 
-      case EHCI_QTYPE_FSTN:
-      default:
-        break;
+static uint8_t iso_td_alloc(ehci_iso_td_info_t* info, uint8_t max)
+{
+  uint32_t const now = hcd_frame_number(0);
+
+  for (uint8_t i = 0; i < max; i++) {
+    if (info[i].unlinked && (int32_t) (info[i].frame - now) < 0) {
+      info[i].used = 0;
     }
 
-    next_link = *list_next(&next_link);
+    if (!info[i].used) {
+      tu_memclr(&info[i], sizeof(ehci_iso_td_info_t));
+      info[i].used = 1;
+      return i;
+    }
   }
+  return max;
 }
 
-// TODO merge with qhd_xfer_complete_isr()
-TU_ATTR_ALWAYS_INLINE static inline
-void qhd_xfer_error_isr(ehci_qhd_t * qhd)
-{
-  volatile ehci_qtd_t *qtd_overlay = &qhd->qtd_overlay;
+//------------- Bandwidth -------------//
 
-  // TD has error
-  if (qtd_overlay->halted) {
-    xfer_result_t xfer_result;
+// Bus time used by the endpoint in each micro frame of a frame if its (first) transaction is in micro frame phase.
+// Split IN: start split in phase, complete splits from phase+2 for every 188 bytes plus one. Split OUT: one start split
+// per 188 bytes from phase. Complete splits are not wrapped into the next frame (siTD back pointer).
+// Return false if the endpoint cannot be scheduled at this phase.
+static bool iso_bw_cost(ehci_iso_ep_t const* ep, uint8_t phase, uint16_t cost[8])
+{
+  tu_memclr(cost, 8*sizeof(uint16_t));
+  uint16_t const size = (uint16_t) (ep->mps * ep->mult);
+
+  if (ep->high_speed) {
+    uint8_t const step = (uint8_t) tu_min32(ep->interval, 8);
+    TU_VERIFY(phase < step);
+    for (uint8_t u = phase; u < 8; u += step) {
+      cost[u] = size + BW_HS_OVERHEAD;
+    }
+  } else {
+    uint8_t const n = (uint8_t) tu_max16(1, tu_div_ceil(size, BW_SPLIT_DATA));
 
-    if (qtd_overlay->xact_err || qtd_overlay->err_count == 0 || qtd_overlay->buffer_err || qtd_overlay->babble_err) {
-      // Error count = 0 often occurs when device disconnected, or other bus-related error
-      xfer_result = XFER_RESULT_FAILED;
-    }else {
-      // no error bits are set, endpoint is halted due to STALL
-      xfer_result = XFER_RESULT_STALLED;
+    if (tu_edpt_dir(ep->ep_addr) == TUSB_DIR_IN) {
+      TU_VERIFY(phase + 2 + n <= 7);
+      cost[phase] = BW_HS_OVERHEAD;
+      for (uint8_t u = phase + 2; u <= phase + 2 + n; u++) {
+        cost[u] = BW_SPLIT_DATA + BW_HS_OVERHEAD;
+      }
+    } else {
+      TU_VERIFY(phase + n <= 7);
+      for (uint8_t u = phase; u < phase + n; u++) {
+        cost[u] = BW_SPLIT_DATA + BW_HS_OVERHEAD;
+      }
     }
+  }
 
-//    if (XFER_RESULT_FAILED == xfer_result ) {
-//      TU_LOG1("  QHD xfer err count: %d\n", qtd_overlay->err_count);
-//      TU_BREAKPOINT(); // TODO skip unplugged device
-//    }
+  return true;
+}
 
-    ehci_qtd_t * volatile qtd = (ehci_qtd_t * volatile) qhd->attached_qtd;
-    TU_ASSERT(qtd, ); // No TD yet, probably a race condition or cache issue !?
+// Pick the least loaded micro frame for the endpoint and reserve its bandwidth in every frame
+static bool iso_bw_reserve(ehci_iso_ep_t* ep)
+{
+  uint16_t const tt_cost = ep->high_speed ? 0 : (uint16_t) (ep->mps + BW_FS_OVERHEAD);
 
-    hcd_dcache_invalidate(qtd, sizeof(ehci_qtd_t));
+  uint8_t  best_phase = 0xff;
+  uint32_t best_peak  = UINT32_MAX;
 
-    uint8_t dir = (qtd->pid == EHCI_PID_IN) ? 1 : 0;
-    uint32_t const xferred_bytes = qtd->expected_bytes - qtd->total_bytes;
+  for (uint8_t phase = 0; phase < 8; phase++) {
+    uint16_t cost[8];
+    if (!iso_bw_cost(ep, phase, cost)) continue;
 
-    // invalidate dcache if IN transfer
-    if (dir == 1 && qhd->attached_buffer != 0 && xferred_bytes > 0) {
-      hcd_dcache_invalidate((void*) qhd->attached_buffer, xferred_bytes);
+    uint32_t const peak = period_bw_peak(1, 0, cost, tt_cost);
+    if (peak < best_peak) {
+      best_peak  = peak;
+      best_phase = phase;
     }
+  }
 
-    // remove and free TD before invoking callback
-    qhd->attached_qtd = NULL;
-    qhd->attached_buffer = 0;
-    qtd->used = 0; // free QTD
+  if (best_peak > BW_UFRAME_MAX) {
+    TU_LOG1("EHCI: not enough periodic bandwidth for EP %02X\r\n", ep->ep_addr);
+    return false;
+  }
 
-    if (0 == qhd->ep_number ) {
-      // control cannot be halted
-      qhd->qtd_overlay.next.terminate      = 1;
-      qhd->qtd_overlay.alternate.terminate = 1;
-      qhd->qtd_overlay.halted              = 0;
+  uint16_t cost[8];
+  (void) iso_bw_cost(ep, best_phase, cost);
+  period_bw_update(1, 0, cost, tt_cost, true);
 
-      hcd_dcache_clean(qhd, sizeof(ehci_qhd_t));
-    }
+  ep->phase = best_phase;
 
-    // notify usbh
-    uint8_t const ep_addr = tu_edpt_addr(qhd->ep_number, dir);
-    hcd_event_xfer_complete(qhd->dev_addr, ep_addr, xferred_bytes, xfer_result, true);
+  if (!ep->high_speed) {
+    uint8_t const n = (uint8_t) tu_max16(1, tu_div_ceil(ep->mps, BW_SPLIT_DATA));
+    if (tu_edpt_dir(ep->ep_addr) == TUSB_DIR_IN) {
+      ep->smask = (uint8_t) TU_BIT(best_phase);
+      ep->cmask = (uint8_t) (((1u << (n + 1)) - 1) << (best_phase + 2));
+    } else {
+      ep->smask = (uint8_t) (((1u << n) - 1) << best_phase);
+      ep->cmask = 0;
+    }
   }
+
+  return true;
 }
 
-TU_ATTR_ALWAYS_INLINE static inline
-void xfer_error_isr(uint8_t rhport)
+static void iso_bw_release(ehci_iso_ep_t const* ep)
 {
-  //------------- async list -------------//
-  ehci_qhd_t * const async_head = qhd_async_head(rhport);
-  ehci_qhd_t *p_qhd = async_head;
-  do
-  {
-    hcd_dcache_invalidate(p_qhd, sizeof(ehci_qhd_t));
-    qhd_xfer_error_isr( p_qhd );
-    p_qhd = qhd_next(p_qhd);
-  }while(p_qhd != async_head); // async list traversal, stop if loop around
+  uint16_t cost[8];
+  (void) iso_bw_cost(ep, ep->phase, cost);
+  period_bw_update(1, 0, cost, ep->high_speed ? 0 : (uint16_t) (ep->mps + BW_FS_OVERHEAD), false);
+}
+//------------- Schedule -------------//
 
-  //------------- TODO refractor period list -------------//
-  uint32_t const period_1ms_addr = (uint32_t) get_period_head(rhport, 1u);
-  for (uint32_t interval_ms=1; interval_ms <= FRAMELIST_SIZE; interval_ms *= 2)
-  {
-    ehci_link_t next_item = * get_period_head(rhport, interval_ms);
+// Advance to the next packet to schedule
+static void iso_sched_advance(ehci_iso_ep_t* ep, uint16_t len)
+{
+  ehci_iso_xfer_t const* xfer = &ep->xfer[(ep->xfer_rd + ep->sched_xfer) % ISO_XFER_MAX];
+
+  ep->sched_offset += len;
+  ep->sched_pkt++;
+  if (ep->sched_pkt == xfer->count) {
+    ep->sched_xfer++;
+    ep->sched_pkt    = 0;
+    ep->sched_offset = 0;
+  }
 
-    // TODO abstract max loop guard for period
-    while( !next_item.terminate &&
-           !(interval_ms > 1 && period_1ms_addr == tu_align32(next_item.address)) )
-    {
-      switch ( next_item.type )
-      {
-        case EHCI_QTYPE_QHD:
-        {
-          ehci_qhd_t *p_qhd_int = (ehci_qhd_t *) tu_align32(next_item.address);
-          hcd_dcache_invalidate(p_qhd_int, sizeof(ehci_qhd_t));
+  ep->next_uframe += ep->interval;
+}
 
-          qhd_xfer_error_isr(p_qhd_int);
-        }
-        break;
+// Link TD to the frame list, isochronous TDs precede the interrupt queue heads of a frame
+static void iso_td_insert(ehci_iso_ep_t* ep, uint8_t idx)
+{
+  ehci_link_t* td = iso_td_link(ep, idx);
+  ehci_link_t* entry = &ehci_data.period_framelist[iso_td_info(ep, idx)->frame % FRAMELIST_SIZE];
 
-				// TODO support hs/fs ISO
-        case EHCI_QTYPE_ITD:
-        case EHCI_QTYPE_SITD:
-        case EHCI_QTYPE_FSTN:
-        default: break;
-      }
+  hcd_dcache_clean(td, ep->high_speed ? sizeof(ehci_itd_t) : sizeof(ehci_sitd_t));
+  list_insert(entry, td, ep->high_speed ? EHCI_QTYPE_ITD : EHCI_QTYPE_SITD);
+  hcd_dcache_clean(entry, sizeof(ehci_link_t));
+
+  ep->td[(ep->td_rd + ep->td_count) % ISO_TD_PER_EP] = idx;
+  ep->td_count++;
+}
 
-      next_item = *list_next(&next_item);
+// Unlink TD from the frame list. A TD of the current frame or within ISO_FRAME_MARGIN frames (aborted) may still be
+// accessed by the controller, it is kept allocated until its frame has passed and released by iso_td_alloc().
+static void iso_td_remove(ehci_iso_ep_t const* ep, uint8_t idx)
+{
+  ehci_iso_td_info_t* info = iso_td_info(ep, idx);
+  ehci_link_t* const td = iso_td_link(ep, idx);
+  ehci_link_t* prev = &ehci_data.period_framelist[info->frame % FRAMELIST_SIZE];
+
+  while (!prev->terminate && prev->type != EHCI_QTYPE_QHD) {
+    ehci_link_t* next = list_next(prev);
+    if (next == td) {
+      prev->address = td->address;
+      hcd_dcache_clean(prev, sizeof(ehci_link_t));
+      break;
     }
+    prev = next;
+  }
+
+  int32_t const ahead = (int32_t) (info->frame - hcd_frame_number(0));
+  if (ahead < 0 || ahead >= (int32_t) ISO_FRAME_MARGIN) {
+    info->used = 0;
+  } else {
+    info->unlinked = 1;
   }
 }
 
-//------------- Host Controller Driver's Interrupt Handler -------------//
-void hcd_int_handler(uint8_t rhport)
+// Fill an iTD with the packets of a frame, one transaction per slot (micro frame). Packets of queued transfers can
+// share a TD, the 7 page pointers are allocated as packets are added.
+static bool itd_fill(ehci_iso_ep_t* ep, uint32_t frame)
 {
-  ehci_registers_t* regs = ehci_data.regs;
+  uint8_t const idx = iso_td_alloc(ehci_data.itd_info, ITD_MAX);
+  TU_VERIFY(idx < ITD_MAX);
+
+  ehci_itd_t* itd = &ehci_data.itd_pool[idx];
+  tu_memclr(itd, sizeof(ehci_itd_t));
+
+  uint32_t page[7];
+  uint8_t page_count = 0;
+  uint8_t slot_mask = 0;
+  uint8_t last_slot = 0;
+
+  while ((ep->next_uframe >> 3) == frame && ep->sched_xfer < ep->xfer_count) {
+    ehci_iso_xfer_t const* xfer = &ep->xfer[(ep->xfer_rd + ep->sched_xfer) % ISO_XFER_MAX];
+    uint16_t const len = xfer->packets[ep->sched_pkt].length;
+    uint32_t const addr = (uint32_t) (uintptr_t) (xfer->buffer + ep->sched_offset);
+
+    // a packet (at most 3 KB) crosses at most one page boundary, its pages must be consecutive pointers
+    uint32_t const pg_first = tu_align4k(addr);
+    uint32_t const pg_last  = tu_align4k(addr + (len ? len - 1u : 0));
+    bool const same_page = page_count && (page[page_count-1] == pg_first);
+    uint8_t const new_pages = (uint8_t) ((same_page ? 0 : 1) + (pg_last != pg_first ? 1 : 0));
+
+    if (page_count + new_pages > 7) break;
+    if (!same_page) page[page_count++] = pg_first;
+    uint8_t const pg_idx = (uint8_t) (page_count - 1);
+    if (pg_last != pg_first) page[page_count++] = pg_last;
+
+    uint8_t const slot = (uint8_t) (ep->next_uframe & 7);
+    itd->xact[slot].offset      = tu_offset4k(addr);
+    itd->xact[slot].page_select = pg_idx;
+    itd->xact[slot].length      = len;
+    itd->xact[slot].active      = 1;
+
+    slot_mask |= (uint8_t) TU_BIT(slot);
+    last_slot = slot;
+
+    iso_sched_advance(ep, len);
+  }
+
+  if (!slot_mask) {
+    ehci_data.itd_info[idx].used = 0;
+    return false;
+  }
+
+  itd->xact[last_slot].int_on_complete = 1;
+
+  // endpoint info is in the low bits of the first 3 page pointers
+  for (uint8_t i = 0; i < page_count; i++) {
+    itd->BufferPointer[i] = page[i];
+  }
+  itd->BufferPointer[0] |= (uint32_t) ep->dev_addr | ((uint32_t) tu_edpt_number(ep->ep_addr) << 8);
+  itd->BufferPointer[1] |= (uint32_t) ep->mps | ((uint32_t) tu_edpt_dir(ep->ep_addr) << 11);
+  itd->BufferPointer[2] |= ep->mult;
+
+  ehci_data.itd_info[idx].frame     = frame;
+  ehci_data.itd_info[idx].slot_mask = slot_mask;
+  iso_td_insert(ep, idx);
+
+  return true;
+}
+
+// Fill a siTD with the next packet
+static bool sitd_fill(ehci_iso_ep_t* ep, uint32_t frame)
+{
+  uint8_t const idx = iso_td_alloc(ehci_data.sitd_info, SITD_MAX);
+  TU_VERIFY(idx < SITD_MAX);
+
+  ehci_sitd_t* sitd = &ehci_data.sitd_pool[idx];
+  tu_memclr(sitd, sizeof(ehci_sitd_t));
+
+  ehci_iso_xfer_t const* xfer = &ep->xfer[(ep->xfer_rd + ep->sched_xfer) % ISO_XFER_MAX];
+  uint16_t const len = xfer->packets[ep->sched_pkt].length;
+  uint32_t const addr = (uint32_t) (uintptr_t) (xfer->buffer + ep->sched_offset);
+  uint8_t const dir = tu_edpt_dir(ep->ep_addr);
+
+  sitd->dev_addr     = ep->dev_addr;
+  sitd->ep_number    = tu_edpt_number(ep->ep_addr);
+  sitd->hub_addr     = ep->hub_addr;
+  sitd->port_number  = ep->hub_port;
+  sitd->direction    = dir;
+  sitd->int_smask    = ep->smask;
+  sitd->fl_int_cmask = ep->cmask;
+
+  sitd->buffer[0] = addr;
+  sitd->buffer[1] = tu_align4k(addr) + 4096;
+
+  if (dir == TUSB_DIR_OUT) {
+    // Transaction position (all or begin) and count of start splits
+    uint32_t const tcount = tu_max32(1, tu_div_ceil(len, BW_SPLIT_DATA));
+    sitd->buffer[1] |= ((tcount > 1 ? 1u : 0u) << 3) | tcount;
+  }
+
+  sitd->back.terminate   = 1;
+  sitd->total_bytes      = len;
+  sitd->int_on_complete  = 1;
+  sitd->active           = 1;
+
+  iso_sched_advance(ep, len);
+
+  ehci_data.sitd_info[idx].frame = frame;
+  iso_td_insert(ep, idx);
+
+  return true;
+}
+
+// Schedule queued packets up to ISO_FRAMES_AHEAD frames in advance. A stream continues in the service interval after
+// its last packet, if that is already too late (underrun) it is moved forward keeping its micro frame phase.
+static void iso_schedule(ehci_iso_ep_t* ep)
+{
+  uint32_t const now = hcd_frame_number(0);
+  uint32_t const earliest = (now + ISO_FRAME_MARGIN) << 3;
+
+  while (ep->sched_xfer < ep->xfer_count && ep->td_count < ISO_TD_PER_EP) {
+    if (!ep->next_valid) {
+      ep->next_uframe = earliest + ep->phase;
+      ep->next_valid  = 1;
+    } else if ((int32_t) (ep->next_uframe - earliest) < 0) {
+      uint32_t const late = earliest - ep->next_uframe;
+      ep->next_uframe += tu_div_ceil(late, ep->interval) * ep->interval;
+    }
+
+    uint32_t const frame = ep->next_uframe >> 3;
+    if ((int32_t) (frame - now) > (int32_t) ISO_FRAMES_AHEAD) {
+      break;
+    }
+
+    if (!(ep->high_speed ? itd_fill(ep, frame) : sitd_fill(ep, frame))) {
+      break;
+    }
+  }
+}
+
+//------------- Completion -------------//
+
+static void iso_packet_complete(ehci_iso_ep_t* ep, bool success, uint16_t actual)
+{
+  ehci_iso_xfer_t* xfer = &ep->xfer[ep->xfer_rd];
+  tuh_iso_packet_t* packet = &xfer->packets[ep->done_pkt];
+
+  packet->actual_length = success ? actual : 0;
+  packet->result        = success ? XFER_RESULT_SUCCESS : XFER_RESULT_FAILED;
+
+  if (tu_edpt_dir(ep->ep_addr) == TUSB_DIR_IN && packet->actual_length) {
+    hcd_dcache_invalidate(xfer->buffer + ep->done_offset, packet->actual_length);
+  }
+
+  ep->done_bytes  += packet->actual_length;
+  ep->done_offset += packet->length;
+  ep->done_pkt++;
+
+  if (ep->done_pkt == xfer->count) {
+    hcd_event_xfer_complete(ep->dev_addr, ep->ep_addr, ep->done_bytes, XFER_RESULT_SUCCESS, true);
+
+    ep->xfer_rd = (uint8_t) ((ep->xfer_rd + 1) % ISO_XFER_MAX);
+    ep->xfer_count--;
+    ep->sched_xfer--;
+    ep->done_pkt    = 0;
+    ep->done_offset = 0;
+    ep->done_bytes  = 0;
+  }
+}
+
+// Report packets of a TD once all its transactions are done or its frame has passed (missed transactions fail).
+// Return false if the TD is still in progress.
+static bool iso_td_retire(ehci_iso_ep_t* ep, uint8_t idx, bool frame_passed)
+{
+  ehci_iso_td_info_t* info = iso_td_info(ep, idx);
+  uint8_t const dir = tu_edpt_dir(ep->ep_addr);
+
+  if (ep->high_speed) {
+    ehci_itd_t* itd = &ehci_data.itd_pool[idx];
+    hcd_dcache_invalidate(itd, sizeof(ehci_itd_t));
+
+    if (!frame_passed) {
+      for (uint8_t slot = 0; slot < 8; slot++) {
+        if ((info->slot_mask & TU_BIT(slot)) && itd->xact[slot].active) return false;
+      }
+    }
+
+    for (uint8_t slot = 0; slot < 8; slot++) {
+      if (info->slot_mask & TU_BIT(slot)) {
+        bool const success = !(itd->xact[slot].active || itd->xact[slot].error || itd->xact[slot].babble_err ||
+                               itd->xact[slot].buffer_err);
+        // IN: length is written back with received bytes
+        uint16_t const actual = (dir == TUSB_DIR_IN) ? (uint16_t) itd->xact[slot].length :
+                                ep->xfer[ep->xfer_rd].packets[ep->done_pkt].length;
+        iso_packet_complete(ep, success, actual);
+      }
+    }
+  } else {
+    ehci_sitd_t* sitd = &ehci_data.sitd_pool[idx];
+    hcd_dcache_invalidate(sitd, sizeof(ehci_sitd_t));
+
+    if (sitd->active && !frame_passed) return false;
+
+    bool const success = !(sitd->active || sitd->error || sitd->xact_err || sitd->babble_err || sitd->buffer_err ||
+                           sitd->missed_uframe);
+    uint16_t const len = ep->xfer[ep->xfer_rd].packets[ep->done_pkt].length;
+    uint16_t const actual = (dir == TUSB_DIR_IN) ? (uint16_t) (len - sitd->total_bytes) : len;
+    iso_packet_complete(ep, success, actual);
+  }
+
+  info->reported = 1;
+  return true;
+}
+
+static void iso_edpt_isr(ehci_iso_ep_t* ep)
+{
+  uint32_t const now = hcd_frame_number(0);
+
+  // report TDs in frame order
+  for (uint8_t i = 0; i < ep->td_count; i++) {
+    uint8_t const idx = ep->td[(ep->td_rd + i) % ISO_TD_PER_EP];
+    ehci_iso_td_info_t const* info = iso_td_info(ep, idx);
+
+    if (!info->reported && !iso_td_retire(ep, idx, (int32_t) (info->frame - now) < 0)) {
+      break;
+    }
+  }
+
+  // controller no longer accesses TDs of passed frames
+  while (ep->td_count) {
+    uint8_t const idx = ep->td[ep->td_rd];
+    ehci_iso_td_info_t const* info = iso_td_info(ep, idx);
+    if (!info->reported || (int32_t) (info->frame - now) >= 0) break;
+
+    iso_td_remove(ep, idx);
+    ep->td_rd = (uint8_t) ((ep->td_rd + 1) % ISO_TD_PER_EP);
+    ep->td_count--;
+  }
+
+  iso_schedule(ep);
+}
+
+static void iso_xfer_complete_isr(void)
+{
+  for (uint8_t i = 0; i < CFG_TUH_EHCI_ISO_EP_MAX; i++) {
+    ehci_iso_ep_t* ep = &ehci_data.iso_ep[i];
+    if (ep->ep_addr && (ep->td_count || ep->xfer_count)) {
+      iso_edpt_isr(ep);
+    }
+  }
+}
+
+//------------- Endpoint -------------//
+
+static bool iso_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc)
+{
+  // re-opened e.g by selecting another alternate setting
+  ehci_iso_ep_t* ep = iso_ep_find(dev_addr, ep_desc->bEndpointAddress);
+  if (ep) {
+    hcd_int_disable(rhport);
+    iso_edpt_close(ep);
+    hcd_int_enable(rhport);
+  }
+
+  ep = NULL;
+  for (uint8_t i = 0; i < CFG_TUH_EHCI_ISO_EP_MAX && !ep; i++) {
+    if (!ehci_data.iso_ep[i].ep_addr) ep = &ehci_data.iso_ep[i];
+  }
+  TU_ASSERT(ep);
+
+  hcd_devtree_info_t devtree_info;
+  hcd_devtree_get_info(dev_addr, &devtree_info);
+
+  uint16_t const max_packet_size = tu_le16toh(ep_desc->wMaxPacketSize);
+  uint8_t const interval = (uint8_t) tu_max16(1, tu_min16(ep_desc->bInterval, 16));
+
+  tu_memclr(ep, sizeof(ehci_iso_ep_t));
+  ep->dev_addr   = dev_addr;
+  ep->ep_addr    = ep_desc->bEndpointAddress;
+  ep->high_speed = (devtree_info.speed == TUSB_SPEED_HIGH) ? 1 : 0;
+  ep->mps        = tu_edpt_packet_size(ep_desc);
+  ep->mult       = ep->high_speed ? (uint8_t) (((max_packet_size >> 11) & 0x3) + 1) : 1;
+  ep->hub_addr   = devtree_info.hub_addr;
+  ep->hub_port   = devtree_info.hub_port;
+
+  // 2^(bInterval-1) micro frames for high speed, frames for full speed
+  ep->interval = (1u << (interval - 1)) * (ep->high_speed ? 1u : 8u);
+
+  if (!iso_bw_reserve(ep)) {
+    ep->ep_addr = 0;
+    return false;
+  }
+
+  return true;
+}
+
+// Unlink all TDs and drop queued transfers. Return false if there was no transfer.
+static bool iso_edpt_abort(ehci_iso_ep_t* ep)
+{
+  bool const queued = ep->xfer_count > 0;
+
+  while (ep->td_count) {
+    iso_td_remove(ep, ep->td[ep->td_rd]);
+    ep->td_rd = (uint8_t) ((ep->td_rd + 1) % ISO_TD_PER_EP);
+    ep->td_count--;
+  }
+
+  ep->xfer_count   = 0;
+  ep->sched_xfer   = 0;
+  ep->sched_pkt    = 0;
+  ep->sched_offset = 0;
+  ep->done_pkt     = 0;
+  ep->done_offset  = 0;
+  ep->done_bytes   = 0;
+  ep->next_valid   = 0;
+
+  return queued;
+}
+
+static void iso_edpt_close(ehci_iso_ep_t* ep)
+{
+  (void) iso_edpt_abort(ep);
+  iso_bw_release(ep);
+  ep->ep_addr = 0;
+}
+
+bool hcd_edpt_iso_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t* buffer,
+                       tuh_iso_packet_t* packets, uint16_t count)
+{
+  ehci_iso_ep_t* ep = iso_ep_find(dev_addr, ep_addr);
+  TU_ASSERT(ep && count);
+  TU_VERIFY(ep->xfer_count < ISO_XFER_MAX);
+
+  uint32_t total_bytes = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    TU_ASSERT(packets[i].length <= ep->mps * ep->mult);
+    packets[i].actual_length = 0;
+    packets[i].result        = XFER_RESULT_INVALID;
+    total_bytes += packets[i].length;
+  }
+
+  // IN transfer: invalidate buffer, OUT transfer: clean buffer
+  if (tu_edpt_dir(ep_addr)) {
+    hcd_dcache_invalidate(buffer, total_bytes);
+  } else {
+    hcd_dcache_clean(buffer, total_bytes);
+  }
+
+  hcd_int_disable(rhport);
+
+  ehci_iso_xfer_t* xfer = &ep->xfer[(ep->xfer_rd + ep->xfer_count) % ISO_XFER_MAX];
+  xfer->buffer  = buffer;
+  xfer->packets = packets;
+  xfer->count   = count;
+  ep->xfer_count++;
+
+  iso_schedule(ep);
+
+  hcd_int_enable(rhport);
+
+  return true;
+}
+
+#endif
+
+//--------------------------------------------------------------------+
+// EHCI Interrupt Handler
+//--------------------------------------------------------------------+
+
+// async_advance is handshake between usb stack & ehci controller.
+// This isr mean it is safe to modify previously removed queue head from async list.
+// In tinyusb, queue head is removed when device is unplugged, or unlinked while its transfers are aborted.
+TU_ATTR_ALWAYS_INLINE static inline
+void async_advance_isr(uint8_t rhport)
+{
+  uint32_t const frame = hcd_frame_number(rhport);
+  bool abort_pending = false;
+
+  // aborting queue heads first, the ones also removed are released by abort completion
+  ehci_qhd_t *qhd_pool = ehci_data.qhd_pool;
+  for (uint32_t i = 0; i < QHD_MAX; i++) {
+    if (qhd_pool[i].aborting && qhd_abort_isr(rhport, &qhd_pool[i], frame)) {
+      abort_pending = true;
+    }
+  }
+
+  for (uint8_t daddr = 0; daddr < QHD_CONTROL_MAX; daddr++) {
+    ehci_qhd_t* qhd = qhd_control(daddr);
+    if (qhd->aborting && qhd_abort_isr(rhport, qhd, frame)) {
+      abort_pending = true;
+    }
+  }
+
+  if (abort_pending) {
+    ehci_data.regs->command_bm.async_adv_doorbell = 1;
+  } else {
+    // no queue head is aborting: controller no longer accesses aborted TDs
+    while (ehci_data.qtd_abort < QTD_MAX) {
+      ehci_qtd_t* qtd = &ehci_data.qtd_pool[ehci_data.qtd_abort];
+      ehci_qtd_info_t* info = qtd_get_info(qtd);
+
+      ehci_data.qtd_abort = (uint16_t) info->free_next;
+      info->aborted = 0;
+      qtd_free(qtd);
+    }
+  }
+
+  for (uint32_t i = 0; i < QHD_MAX; i++) {
+    if (qhd_pool[i].removing && !qhd_pool[i].aborting) {
+      qhd_pool[i].removing = 0;
+      qhd_free(&qhd_pool[i]);
+    }
+  }
+
+  // control of closed devices
+  for (uint8_t daddr = 1; daddr < QHD_CONTROL_MAX; daddr++) {
+    ehci_qhd_t* qhd = qhd_control(daddr);
+    if (qhd->removing && !qhd->aborting) {
+      qhd->removing = 0;
+      qhd_free(qhd);
+    }
+  }
+}
+
+TU_ATTR_ALWAYS_INLINE static inline
+void port_connect_status_change_isr(uint8_t rhport)
+{
+  // NOTE There is an sequence plug->unplug->…..-> plug if device is powering with pre-plugged device
+  if (ehci_data.regs->portsc_bm.current_connect_status)
+  {
+    hcd_port_reset(rhport);
+    hcd_event_device_attach(rhport, true);
+  }else // device unplugged
+  {
+    hcd_event_device_remove(rhport, true);
+  }
+}
+
+// Report completed transfers of a queue head in queued order, stop at the first one still in progress.
+// A transfer is completed when its last TD is retired, or one of its TDs ends with a short packet or halts.
+static void qhd_xfer_complete_isr(ehci_qhd_t * qhd) {
+  while (qhd->qtd_head != qhd->qtd_tail) {
+    ehci_qtd_t * const first = (ehci_qtd_t *) (uintptr_t) qhd->qtd_head;
+    ehci_qtd_t * qtd = first;
+    uint32_t xferred_bytes = 0;
+
+    // buffer of a transfer is contiguous across its TDs
+    void* const buffer = (void*) (uintptr_t) qtd_get_info(first)->buffer;
+
+    // find the TD ending the transfer
+    while (1) {
+      hcd_dcache_invalidate(qtd, sizeof(ehci_qtd_t));
+
+      // TD is still active, transfer is in progress
+      if (qtd->active) {
+        return;
+      }
+
+      ehci_qtd_info_t const * info = qtd_get_info(qtd);
+      xferred_bytes += (uint16_t) (info->length - qtd->total_bytes);
+
+      if (info->xfer_end || qtd->halted || qtd->total_bytes) {
+        break;
+      }
+
+      qtd = qtd_next(qtd);
+    }
+
+    xfer_result_t xfer_result = XFER_RESULT_SUCCESS;
+    uint8_t const dir = (qtd->pid == EHCI_PID_IN) ? 1 : 0;
+
+    // invalidate dcache of received data once for the whole transfer
+    if (dir && xferred_bytes > 0) {
+      hcd_dcache_invalidate(buffer, xferred_bytes);
+    }
+
+    // skip remaining TDs of the transfer (short packet)
+    ehci_qtd_t * last = qtd;
+    while (!qtd_get_info(last)->xfer_end) {
+      last = qtd_next(last);
+    }
+    uint32_t const next_addr = last->next.address;
+
+    if (qtd->halted) {
+      if (qtd->xact_err || qtd->err_count == 0 || qtd->buffer_err || qtd->babble_err) {
+        // Error count = 0 often occurs when device disconnected, or other bus-related error
+        xfer_result = XFER_RESULT_FAILED;
+      }else {
+        // no error bits are set, endpoint is halted due to STALL
+        xfer_result = XFER_RESULT_STALLED;
+      }
+
+      // continue with next transfer once halted is cleared, control cannot be halted
+      qhd_restart(qhd, next_addr);
+      if (0 == qhd->ep_number) {
+        qhd->qtd_overlay.halted = 0;
+        hcd_dcache_clean(qhd, sizeof(ehci_qhd_t));
+      }
+    } else if (qtd != last) {
+      // short packet: queue head is parked at qtd_stop
+      qhd_restart(qhd, next_addr);
+    }
+
+    // remove and free TDs before invoking callback
+    qhd->qtd_head = next_addr;
+
+    qtd = first;
+    while (1) {
+      ehci_qtd_t * const next = qtd_next(qtd);
+      qtd_free(qtd);
+      if (qtd == last) break;
+      qtd = next;
+    }
+
+    // notify usbh
+    uint8_t const ep_addr = tu_edpt_addr(qhd->ep_number, dir);
+    hcd_event_xfer_complete(qhd->dev_addr, ep_addr, xferred_bytes, xfer_result, true);
+  }
+}
+
+TU_ATTR_ALWAYS_INLINE static inline
+void async_list_xfer_complete_isr(ehci_qhd_t * const async_head)
+{
+  ehci_qhd_t *p_qhd = async_head;
+  do
+  {
+    hcd_dcache_invalidate(p_qhd, sizeof(ehci_qhd_t));
+    qhd_xfer_complete_isr(p_qhd);
+    p_qhd = qhd_next(p_qhd);
+  }while(p_qhd != async_head); // async list traversal, stop if loop around
+}
+
+// Queue heads linked to a node of the interval tree, up to the next node
+TU_ATTR_ALWAYS_INLINE static inline
+void period_list_xfer_complete_isr(ehci_link_t const* node)
+{
+  ehci_link_t next_link = *node;
+
+  while (!next_link.terminate && !is_period_head(tu_align32(next_link.address))) {
+    uintptr_t const entry_addr = tu_align32(next_link.address);
+
+    switch (next_link.type) {
+      case EHCI_QTYPE_QHD: {
+        ehci_qhd_t *qhd = (ehci_qhd_t *) entry_addr;
+        hcd_dcache_invalidate(qhd, sizeof(ehci_qhd_t));
+        qhd_xfer_complete_isr(qhd);
+      }
+        break;
+
+      case EHCI_QTYPE_ITD:
+      case EHCI_QTYPE_SITD:
+        // isochronous TDs are linked before the interval tree, processed by iso_xfer_complete_isr()
+      case EHCI_QTYPE_FSTN:
+      default:
+        break;
+    }
+
+    next_link = *list_next(&next_link);
+  }
+}
+
+// Halted TD is reported by qhd_xfer_complete_isr() as well, together with transfers completed before it
+TU_ATTR_ALWAYS_INLINE static inline
+void xfer_error_isr(uint8_t rhport)
+{
+  async_list_xfer_complete_isr(qhd_async_head(rhport));
+
+  for (uint32_t i=0; i < PERIOD_NODE_COUNT; i++)
+  {
+    period_list_xfer_complete_isr((ehci_link_t*) &ehci_data.period_head_arr[i]);
+  }
+
+#if CFG_TUH_EHCI_ISO_EP_MAX
+  iso_xfer_complete_isr();
+#endif
+}
+
+//------------- Host Controller Driver's Interrupt Handler -------------//
+void hcd_int_handler(uint8_t rhport)
+{
+  ehci_registers_t* regs = ehci_data.regs;
   uint32_t const int_status = regs->status;
 
   if (int_status & EHCI_INT_MASK_HC_HALTED) {
@@ -789,10 +1758,14 @@ void hcd_int_handler(uint8_t rhport)
 
   if (int_status & EHCI_INT_MASK_NXP_PERIODIC)
   {
-    for (uint32_t i=1; i <= FRAMELIST_SIZE; i *= 2)
+    for (uint32_t i=0; i < PERIOD_NODE_COUNT; i++)
     {
-      period_list_xfer_complete_isr(rhport, i);
+      period_list_xfer_complete_isr((ehci_link_t*) &ehci_data.period_head_arr[i]);
     }
+
+#if CFG_TUH_EHCI_ISO_EP_MAX
+    iso_xfer_complete_isr();
+#endif
     regs->status = EHCI_INT_MASK_NXP_PERIODIC; // Acknowledge
   }
 
@@ -815,40 +1788,57 @@ void hcd_int_handler(uint8_t rhport)
 
 
 //------------- queue head helper -------------//
-static inline ehci_qhd_t* qhd_find_free (void)
+// Take a queue head from the free list for an endpoint
+static inline ehci_qhd_t* qhd_alloc(uint8_t dev_addr, uint8_t ep_addr)
 {
-  for (uint32_t i=0; i<QHD_MAX; i++)
-  {
-    if ( !ehci_data.qhd_pool[i].used ) return &ehci_data.qhd_pool[i];
+  qhd_index_t* index = qhd_index_entry(dev_addr, ep_addr);
+  TU_VERIFY(index && ehci_data.qhd_free < QHD_MAX, NULL);
+
+  uint16_t const idx = ehci_data.qhd_free;
+  ehci_qhd_t* qhd = &ehci_data.qhd_pool[idx];
+  ehci_data.qhd_free = qhd->free_next;
+
+  *index = (qhd_index_t) (idx + 1);
+  return qhd;
+}
+
+// Release queue head and its TDs, queue head must be off the schedule. Control queue heads are not pooled.
+static inline void qhd_free(ehci_qhd_t* qhd)
+{
+  qhd->used = 0;
+  qhd_free_qtd(qhd);
+
+  if ( qhd >= ehci_data.qhd_pool && qhd < ehci_data.qhd_pool + QHD_MAX ) {
+    qhd->free_next = ehci_data.qhd_free;
+    ehci_data.qhd_free = (uint16_t) (qhd - ehci_data.qhd_pool);
   }
+}
 
-  return NULL;
+static inline qhd_index_t* qhd_index_entry(uint8_t dev_addr, uint8_t ep_addr)
+{
+  uint8_t const epnum = tu_edpt_number(ep_addr);
+  if ( dev_addr == 0 || dev_addr > QHD_INDEX_DEV || epnum == 0 ) return NULL;
+
+  return &ehci_data.qhd_index[dev_addr-1][2*(epnum-1) + tu_edpt_dir(ep_addr)];
 }
 
 static inline ehci_qhd_t* qhd_next(ehci_qhd_t const * p_qhd)
 {
-  return (ehci_qhd_t*) tu_align32(p_qhd->next.address);
+  return (ehci_qhd_t*) (uintptr_t) tu_align32(p_qhd->next.address);
 }
 
 static inline ehci_qhd_t* qhd_get_from_addr(uint8_t dev_addr, uint8_t ep_addr)
 {
-  ehci_qhd_t* qhd_pool = ehci_data.qhd_pool;
-
-  for(uint32_t i=0; i<QHD_MAX; i++)
-  {
-    if ( (qhd_pool[i].dev_addr == dev_addr) &&
-          ep_addr == tu_edpt_addr(qhd_pool[i].ep_number, qhd_pool[i].pid) )
-    {
-      return &qhd_pool[i];
-    }
-  }
-
-  return NULL;
+  qhd_index_t const* index = qhd_index_entry(dev_addr, ep_addr);
+  return (index && *index) ? &ehci_data.qhd_pool[*index - 1] : NULL;
 }
 
-static void qhd_init(ehci_qhd_t *p_qhd, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc)
+static bool qhd_init(ehci_qhd_t *p_qhd, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc)
 {
-  // address 0 is used as async head, which always on the list --> cannot be cleared (ehci halted otherwise)
+  // control endpoint is re-opened without closing e.g dev0 for each enumeration
+  qhd_free_qtd(p_qhd);
+
+  // control of dev0 is always on the async list --> its link (and abort state) cannot be cleared
   if (dev_addr != 0) {
     tu_memclr(p_qhd, sizeof(ehci_qhd_t));
   }
@@ -864,101 +1854,326 @@ static void qhd_init(ehci_qhd_t *p_qhd, uint8_t dev_addr, tusb_desc_endpoint_t c
   p_qhd->ep_number          = tu_edpt_number(ep_desc->bEndpointAddress);
   p_qhd->ep_speed           = devtree_info.speed;
   p_qhd->data_toggle_control= (xfer_type == TUSB_XFER_CONTROL) ? 1 : 0;
-  p_qhd->head_list_flag     = (dev_addr == 0) ? 1 : 0; // addr0's endpoint is the static asyn list head
+  p_qhd->head_list_flag     = 0;
   p_qhd->max_packet_size    = tu_edpt_packet_size(ep_desc);
   p_qhd->fl_ctrl_ep_flag    = ((xfer_type == TUSB_XFER_CONTROL) && (p_qhd->ep_speed != TUSB_SPEED_HIGH))  ? 1 : 0;
   p_qhd->nak_reload         = 0;
 
+  p_qhd->fl_hub_addr  = devtree_info.hub_addr;
+  p_qhd->fl_hub_port  = devtree_info.hub_port;
+  p_qhd->mult         = 1; // TODO not use high bandwidth/park mode yet
+  p_qhd->pid = tu_edpt_dir(ep_desc->bEndpointAddress) ? EHCI_PID_IN : EHCI_PID_OUT; // PID for TD under this endpoint
+
   // Bulk/Control -> smask = cmask = 0
-  // TODO Isochronous
   if (TUSB_XFER_INTERRUPT == xfer_type)
   {
     if (TUSB_SPEED_HIGH == p_qhd->ep_speed)
     {
-      TU_ASSERT( interval <= 16, );
-      if ( interval < 4) // sub millisecond interval
-      {
-        p_qhd->interval_ms = 0;
-        p_qhd->int_smask   = (interval == 1) ? TU_BIN8(11111111) :
-                             (interval == 2) ? TU_BIN8(10101010) : TU_BIN8(01000100);
-      }else
-      {
-        p_qhd->interval_ms = (uint8_t) tu_min16( 1 << (interval-4), 255 );
-        p_qhd->int_smask = TU_BIT(interval % 8);
-      }
+      TU_ASSERT( interval >= 1 && interval <= 16 );
+      // 2^(bInterval-1) micro frames, 0 for sub millisecond interval
+      p_qhd->interval_ms = (interval < 4) ? 0 : (uint8_t) tu_min16( 1 << (interval-4), 255 );
     }else
     {
-      TU_ASSERT( 0 != interval, );
-      // Full/Low: 4.12.2.1 (EHCI) case 1 schedule start split at 1 us & complete split at 2,3,4 uframes
-      p_qhd->int_smask    = 0x01;
-      p_qhd->fl_int_cmask = TU_BIN8(11100);
+      TU_ASSERT( 0 != interval );
       p_qhd->interval_ms  = interval;
     }
+
+    // smask, cmask and phase are assigned by periodic scheduler
+    TU_VERIFY(qhd_bw_reserve(p_qhd, interval));
   }else
   {
     p_qhd->int_smask = p_qhd->fl_int_cmask = 0;
   }
 
-  p_qhd->fl_hub_addr  = devtree_info.hub_addr;
-  p_qhd->fl_hub_port  = devtree_info.hub_port;
-  p_qhd->mult         = 1; // TODO not use high bandwidth/park mode yet
-
   //------------- HCD Management Data -------------//
   p_qhd->used         = 1;
   p_qhd->removing     = 0;
-  p_qhd->attached_qtd = NULL;
-  p_qhd->pid = tu_edpt_dir(ep_desc->bEndpointAddress) ? EHCI_PID_IN : EHCI_PID_OUT; // PID for TD under this endpoint
 
-  //------------- active, but no TD list -------------//
+  // dummy TD: first TD of the next queued transfer
+  ehci_qtd_t* dummy = qtd_alloc();
+  if (dummy == NULL) {
+    if (TUSB_XFER_INTERRUPT == xfer_type) qhd_bw_release(p_qhd);
+    TU_ASSERT(false);
+  }
+  qtd_init(dummy, NULL, 0);
+  hcd_dcache_clean(dummy, sizeof(ehci_qtd_t));
+
+  p_qhd->qtd_head = p_qhd->qtd_tail = (uint32_t) (uintptr_t) dummy;
+
+  //------------- active, TD list with inactive dummy -------------//
   p_qhd->qtd_overlay.halted              = 0;
-  p_qhd->qtd_overlay.next.terminate      = 1;
+  p_qhd->qtd_overlay.active              = 0;
+  p_qhd->qtd_overlay.next.address        = (uint32_t) (uintptr_t) dummy;
   p_qhd->qtd_overlay.alternate.terminate = 1;
 
   if (TUSB_XFER_BULK == xfer_type && p_qhd->ep_speed == TUSB_SPEED_HIGH && p_qhd->pid == EHCI_PID_OUT)
   {
     p_qhd->qtd_overlay.ping_err = 1; // do PING for Highspeed Bulk OUT, EHCI section 4.11
   }
+
+  return true;
 }
 
-static void qhd_attach_qtd(ehci_qhd_t *qhd, ehci_qtd_t *qtd) {
-  qhd->attached_qtd = qtd;
-  qhd->attached_buffer = qtd->buffer[0];
+// Queue a transfer to the queue head. Buffer is split into a chain of TDs starting with the current dummy and ending
+// with a new dummy. Dummy is activated last so that HC either sees the whole chain or nothing (EHCI 4.10.2)
+// TDs are written back with a single dcache clean of the pool range they span: TDs owned by HC in between have no
+// dirty cache line (CPU always cleans after writing a TD) and are not affected.
+static bool qhd_queue_xfer(ehci_qhd_t *qhd, uint8_t pid, uint8_t data_toggle, void const* buffer, uint16_t total_bytes)
+{
+  ehci_qtd_t* const first = (ehci_qtd_t*) (uintptr_t) qhd->qtd_tail;
+  TU_ASSERT(first);
+
+  uint16_t const mps = (uint16_t) qhd->max_packet_size;
+  uint32_t addr = (uint32_t) (uintptr_t) buffer;
+  uint32_t remaining = total_bytes;
+
+  ehci_qtd_t* qtd = first;
+  ehci_qtd_t* qtd_lo = first;
+  ehci_qtd_t* qtd_hi = first;
+  while (1) {
+    // up to 5 pages, TD followed by another must end at packet boundary
+    uint32_t len = 5*4096u - tu_offset4k(addr);
+    if (remaining > len) {
+      len -= len % mps;
+    }else {
+      len = remaining;
+    }
+    remaining -= len;
+
+    // next TD of this transfer, or new dummy
+    ehci_qtd_t* next = qtd_alloc();
+    if (next == NULL) {
+      // not enough TDs: free allocated ones and leave dummy as it was
+      while (qtd != first) {
+        ehci_qtd_t* p = first;
+        while (qtd_next(p) != qtd) p = qtd_next(p);
+        qtd_free(qtd);
+        qtd = p;
+      }
+      qtd_init(first, NULL, 0);
+      hcd_dcache_clean(first, sizeof(ehci_qtd_t));
+      return false;
+    }
 
-  // clean and invalidate cache before physically write
-  hcd_dcache_clean_invalidate(qtd, sizeof(ehci_qtd_t));
+    if (next < qtd_lo) qtd_lo = next;
+    if (next > qtd_hi) qtd_hi = next;
 
-  qhd->qtd_overlay.next.address = (uint32_t) qtd;
-  hcd_dcache_clean_invalidate(qhd, sizeof(ehci_qhd_t));
+    qtd_init(qtd, (void const*) (uintptr_t) addr, (uint16_t) len);
+    qtd->pid            = pid;
+    qtd->data_toggle    = data_toggle;
+    qtd->next.address   = (uint32_t) (uintptr_t) next;
+    qtd->next.terminate = 0;
+    if (qtd != first) qtd->active = 1;
+
+    // control uses toggle from TD: continue after packets of this TD
+    data_toggle ^= (uint8_t) (((len + mps - 1) / mps) & 1);
+    addr += len;
+
+    if (remaining == 0) {
+      qtd_init(next, NULL, 0);
+
+      qtd->int_on_complete = 1;
+      qtd_get_info(qtd)->xfer_end = 1;
+      hcd_dcache_clean(qtd_lo, (uint32_t) ((uintptr_t) (qtd_hi + 1) - (uintptr_t) qtd_lo));
+
+      // activate chain (dcache clean also keeps write order)
+      first->active = 1;
+      hcd_dcache_clean(first, sizeof(ehci_qtd_t));
+
+      qhd->qtd_tail = (uint32_t) (uintptr_t) next;
+      return true;
+    }
+
+    // short packet: stop queue until transfer is reported
+    if (pid == EHCI_PID_IN) {
+      qtd->alternate.address = (uint32_t) (uintptr_t) &ehci_data.qtd_stop;
+    }
+
+    qtd = next;
+  }
 }
 
+// Free all TDs including dummy, queue head must not be on the list or halted
+static void qhd_free_qtd(ehci_qhd_t *qhd)
+{
+  if (qhd->qtd_tail == 0) return;
 
-//------------- TD helper -------------//
-static inline ehci_qtd_t *qtd_find_free(void) {
-  for (uint32_t i = 0; i < QTD_MAX; i++) {
-    if (!ehci_data.qtd_pool[i].used) return &ehci_data.qtd_pool[i];
+  ehci_qtd_t* qtd = (ehci_qtd_t*) (uintptr_t) qhd->qtd_head;
+  ehci_qtd_t* const dummy = (ehci_qtd_t*) (uintptr_t) qhd->qtd_tail;
+
+  while (qtd != dummy) {
+    ehci_qtd_t* next = qtd_next(qtd);
+    qtd_free(qtd);
+    qtd = next;
   }
-  return NULL;
+  qtd_free(dummy);
+
+  qhd->qtd_head = qhd->qtd_tail = 0;
+}
+
+// Continue queue head with TD: alternate is updated first since HC follows it with remaining bytes (short packet)
+static inline void qhd_restart(ehci_qhd_t *qhd, uint32_t qtd_addr)
+{
+  qhd->qtd_overlay.alternate.address = qtd_addr;
+  qhd->qtd_overlay.next.address      = qtd_addr;
+  hcd_dcache_clean(qhd, sizeof(ehci_qhd_t));
 }
 
+// Unlink queue head from its list, the controller may still access it until async advance (end of frame for periodic)
+static void qhd_unlink(uint8_t rhport, ehci_qhd_t* qhd)
+{
+  ehci_link_t* const head = qhd->int_smask ? get_period_head(rhport, qhd->interval_ms, qhd->interval_phase) :
+                                             (ehci_link_t*) qhd_async_head(rhport);
+  ehci_link_t* prev = head;
+
+  while (!prev->terminate) {
+    ehci_link_t* next = list_next(prev);
+
+    if (next == (ehci_link_t*) qhd) {
+      prev->address = qhd->next.address;
+      hcd_dcache_clean(prev, sizeof(ehci_link_t));
+      return;
+    }
+
+    // not found: loop back to head, or reached next node of the interval tree
+    if (next == head || is_period_head((uintptr_t) next)) return;
+    prev = next;
+  }
+}
+
+// Detach queued TDs and unlink queue head. TDs are kept on the aborted list and queue head is put back by
+// qhd_abort_isr() once the controller no longer caches it, transfers queued meanwhile start then.
+// Return false if there is no transfer.
+static bool qhd_abort(uint8_t rhport, ehci_qhd_t* qhd)
+{
+  hcd_dcache_invalidate(qhd, sizeof(ehci_qhd_t));
+
+  // All queued transfers are already completed (and reported) or there is no transfer
+  uint32_t const dummy_addr = qhd->qtd_tail;
+  TU_VERIFY(qhd->qtd_tail && qhd->qtd_head != dummy_addr);
+
+  // deactivate TDs so that the controller does not advance to them, they are no longer reported by isr
+  ehci_qtd_t* qtd = (ehci_qtd_t*) (uintptr_t) qhd->qtd_head;
+  while ((uintptr_t) qtd != dummy_addr) {
+    ehci_qtd_t* next = qtd_next(qtd);
+
+    qtd->active = 0;
+    hcd_dcache_clean(qtd, sizeof(ehci_qtd_t));
+
+    ehci_qtd_info_t* info = qtd_get_info(qtd);
+    info->aborted   = 1;
+    info->free_next = ehci_data.qtd_abort;
+    ehci_data.qtd_abort = (uint16_t) (qtd - ehci_data.qtd_pool);
+
+    qtd = next;
+  }
+  qhd->qtd_head = dummy_addr;
+
+  // already unlinked if abort is pending, doorbell must be rung after the TDs are detached anyway
+  if (!qhd->aborting) {
+    qhd_unlink(rhport, qhd);
+  }
+  qhd->aborting = QHD_ABORT_UNLINKED;
+
+  if (qhd->int_smask) {
+    ehci_data.abort_frame = hcd_frame_number(rhport);
+  }
+
+  ehci_data.regs->command_bm.async_adv_doorbell = 1;
+  return true;
+}
+
+// Called by async advance isr for an aborting queue head. The first async advance may be of a doorbell rung before the
+// unlink, the queue head is put back on the next one. Return true if another doorbell is needed.
+static bool qhd_abort_isr(uint8_t rhport, ehci_qhd_t* qhd, uint32_t frame)
+{
+  if (qhd->aborting == QHD_ABORT_UNLINKED || (qhd->int_smask && (int32_t) (frame - ehci_data.abort_frame) <= 0)) {
+    qhd->aborting = QHD_ABORT_DOORBELL;
+    return true;
+  }
+
+  hcd_dcache_invalidate(qhd, sizeof(ehci_qhd_t));
+  qhd->aborting = 0;
+
+  // device is closed meanwhile
+  if (qhd->removing) {
+    qhd->removing = 0;
+    qhd_free(qhd);
+    return false;
+  }
+
+  // Overlay is restarted unless the controller already went on with a transfer queued after the abort
+  ehci_qtd_t const* current = (ehci_qtd_t const*) (uintptr_t) qhd->qtd_addr;
+  bool const current_queued = current >= ehci_data.qtd_pool && current < ehci_data.qtd_pool + QTD_MAX &&
+                              !qtd_get_info(current)->aborted;
+  if (!(qhd->qtd_overlay.active && current_queued)) {
+    qhd->qtd_overlay.active = 0;
+    qhd_restart(qhd, qhd->qtd_head);
+  }
+
+  ehci_link_t* const list_head = qhd->int_smask ? get_period_head(rhport, qhd->interval_ms, qhd->interval_phase) :
+                                                  (ehci_link_t*) qhd_async_head(rhport);
+  list_insert(list_head, (ehci_link_t*) qhd, EHCI_QTYPE_QHD);
+  hcd_dcache_clean(qhd, sizeof(ehci_qhd_t));
+  hcd_dcache_clean(list_head, sizeof(ehci_link_t));
+
+  // report transfers completed while unlinked
+  qhd_xfer_complete_isr(qhd);
+
+  return false;
+}
+
+//------------- TD helper -------------//
+static inline ehci_qtd_t* qtd_alloc(void) {
+  uint16_t const idx = ehci_data.qtd_free;
+  if (idx >= QTD_MAX) return NULL;
+
+  ehci_qtd_info_t* info = &ehci_data.qtd_info[idx];
+  ehci_data.qtd_free = (uint16_t) info->free_next;
+  info->used = 1;
+
+  return &ehci_data.qtd_pool[idx];
+}
+
+static inline void qtd_free(ehci_qtd_t* qtd) {
+  ehci_qtd_info_t* info = qtd_get_info(qtd);
+  if (!info->used) return; // already free, must not be linked twice
+
+  info->used = 0;
+  info->free_next = ehci_data.qtd_free;
+  ehci_data.qtd_free = (uint16_t) (qtd - ehci_data.qtd_pool);
+}
+
+static inline ehci_qtd_t* qtd_next(ehci_qtd_t const* qtd) {
+  return (ehci_qtd_t*) (uintptr_t) tu_align32(qtd->next.address);
+}
+
+static inline ehci_qtd_info_t* qtd_get_info(ehci_qtd_t const* qtd) {
+  return &ehci_data.qtd_info[qtd - ehci_data.qtd_pool];
+}
+
+// Init an inactive TD
 static void qtd_init(ehci_qtd_t* qtd, void const* buffer, uint16_t total_bytes)
 {
   tu_memclr(qtd, sizeof(ehci_qtd_t));
-  qtd->used                = 1;
 
   qtd->next.terminate      = 1; // init to null
-  qtd->alternate.terminate = 1; // not used, always set to terminated
-  qtd->active              = 1;
+  qtd->alternate.terminate = 1;
   qtd->err_count           = 3; // TODO 3 consecutive errors tolerance
   qtd->data_toggle         = 0;
-  qtd->int_on_complete     = 1;
   qtd->total_bytes         = total_bytes;
-  qtd->expected_bytes      = total_bytes;
 
-  qtd->buffer[0] = (uint32_t) buffer;
+  qtd->buffer[0] = (uint32_t) (uintptr_t) buffer;
   for(uint8_t i=1; i<5; i++)
   {
     qtd->buffer[i] |= tu_align4k(qtd->buffer[i - 1] ) + 4096;
   }
+
+  ehci_qtd_info_t* info = qtd_get_info(qtd);
+  info->buffer   = qtd->buffer[0];
+  info->length   = total_bytes;
+  info->xfer_end = 0;
+  info->aborted  = 0;
 }
 
 //------------- List Managing Helper -------------//
@@ -967,12 +2182,12 @@ static void qtd_init(ehci_qtd_t* qtd, void const* buffer, uint16_t total_bytes)
 static inline void list_insert(ehci_link_t *current, ehci_link_t *new, uint8_t new_type)
 {
   new->address = current->address;
-  current->address = ((uint32_t) new) | (new_type << 1);
+  current->address = ((uint32_t) (uintptr_t) new) | (new_type << 1);
 }
 
 static inline ehci_link_t* list_next(ehci_link_t const *p_link)
 {
-  return (ehci_link_t*) tu_align32(p_link->address);
+  return (ehci_link_t*) (uintptr_t) tu_align32(p_link->address);
 }
 
 #endif
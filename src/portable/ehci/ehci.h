@@ -90,16 +90,8 @@ typedef struct
 	// Word 0: Next QTD Pointer
 	ehci_link_t next;
 
-	// Word 1: Alternate Next QTD Pointer (not used)
-	union{
-	  ehci_link_t alternate;
-	  struct {
-	    uint32_t                : 5;
-	    uint32_t used           : 1;
-	    uint32_t                : 10;
-	    uint32_t expected_bytes : 16;
-	  };
-	};
+	// Word 1: Alternate Next QTD Pointer, followed instead of Next QTD Pointer on short packet
+	ehci_link_t alternate;
 
 	// Word 2: qTQ Token
 	volatile uint32_t ping_err             : 1  ; ///< For Highspeed: 0 Out, 1 Ping. Full/Slow used as error indicator
@@ -164,12 +156,15 @@ typedef struct TU_ATTR_ALIGNED(32)
 	uint8_t pid;
 	uint8_t interval_ms; // polling interval in frames (or millisecond)
 
-	uint8_t TU_RESERVED[4];
+  // Attached TD queue: transfers are chained from qtd_head (oldest) to qtd_tail which is always an inactive dummy TD,
+  // a new transfer is queued by filling the dummy so that it can be appended while the HC is running.
+  // Physical addresses (32-bit) of TDs, 0 if queue head has no TD.
+  uint32_t qtd_head;
+  uint32_t volatile qtd_tail;
 
-  // Attached TD management, note usbh will only queue 1 TD per QHD.
-  // buffer for dcache invalidate since td's buffer is modified by HC and finding initial buffer address is not trivial
-  uint32_t attached_buffer;
-	ehci_qtd_t * volatile attached_qtd;
+  uint8_t interval_phase; // node of interval tree: frames with frame % interval == phase
+  uint8_t aborting; // unlinked to abort transfers, put back once controller no longer caches it
+  uint16_t free_next; // index of next free queue head in pool when unused
 } ehci_qhd_t;
 
 TU_VERIFY_STATIC( sizeof(ehci_qhd_t) == 64, "size is not correct" );
@@ -38,6 +38,17 @@
 // Initialize EHCI driver
 bool ehci_init(uint8_t rhport, uint32_t capability_reg, uint32_t operatial_reg);
 
+// Periodic bandwidth committed to opened interrupt and isochronous endpoints
+typedef struct {
+  uint16_t uframe_load_max; // highest load of a micro frame in high speed byte times
+  uint16_t uframe_budget;   // periodic budget of a micro frame (80%)
+  uint16_t tt_load_max;     // highest full/low speed load of a frame in full speed byte times
+  uint16_t tt_budget;       // full/low speed budget of a frame (90%)
+} ehci_period_bandwidth_t;
+
+// Get periodic bandwidth committed by the scheduler
+void ehci_period_bandwidth_get(uint8_t rhport, ehci_period_bandwidth_t* bw);
+
 #ifdef __cplusplus
  }
 #endif
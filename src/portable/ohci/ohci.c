@@ -38,6 +38,7 @@
 #include "osal/osal.h"
 
 #include "host/hcd.h"
+#include "host/usbh.h"
 #include "ohci.h"
 
 // TODO remove
@@ -152,11 +153,25 @@ static ohci_ed_t * const p_ed_head[] =
     [TUSB_XFER_CONTROL]     = &ohci_data.control[0].ed,
     [TUSB_XFER_BULK   ]     = &ohci_data.bulk_head_ed,
     [TUSB_XFER_INTERRUPT]   = &ohci_data.period_head_ed,
-    [TUSB_XFER_ISOCHRONOUS] = NULL // TODO Isochronous
+    [TUSB_XFER_ISOCHRONOUS] = &ohci_data.period_head_ed // isochronous EDs are at the end of periodic list
 };
 
 static void ed_list_insert(ohci_ed_t * p_pre, ohci_ed_t * p_ed);
 static void ed_list_remove_by_addr(ohci_ed_t * p_head, uint8_t dev_addr);
+static void ed_free(ohci_ed_t * ed);
+static void td_queue_release(ohci_ed_t* ed, bool keep_dummy);
+
+TU_ATTR_WEAK void hcd_dcache_clean(void* addr, uint32_t data_size) {
+  (void) addr; (void) data_size;
+}
+
+TU_ATTR_WEAK void hcd_dcache_invalidate(void* addr, uint32_t data_size) {
+  (void) addr; (void) data_size;
+}
+
+TU_ATTR_WEAK void hcd_dcache_clean_invalidate(void* addr, uint32_t data_size) {
+  (void) addr; (void) data_size;
+}
 
 //--------------------------------------------------------------------+
 // USBH-HCD API
@@ -185,13 +200,35 @@ bool hcd_init(uint8_t rhport)
   tu_memclr(&ohci_data, sizeof(ohci_data_t));
   for(uint8_t i=0; i<32; i++)
   { // assign all interrupt pointers to period head ed
-    ohci_data.hcca.interrupt_table[i] = (uint32_t) _phys_addr(&ohci_data.period_head_ed);
+    ohci_data.hcca.interrupt_table[i] = (uint32_t) (uintptr_t) _phys_addr(&ohci_data.period_head_ed);
   }
 
   ohci_data.control[0].ed.skip  = 1;
   ohci_data.bulk_head_ed.skip   = 1;
   ohci_data.period_head_ed.skip = 1;
 
+  // free lists: all EDs and TDs in order
+  for(uint32_t i=0; i<ED_MAX; i++)
+  {
+    ohci_data.ed_pool[i].skip    = 1;
+    ohci_data.ed_pool[i].td_tail = (i+1 < ED_MAX) ? (uint32_t) (uintptr_t) &ohci_data.ed_pool[i+1] : 0;
+  }
+  ohci_data.ed_free = &ohci_data.ed_pool[0];
+
+  for(uint32_t i=0; i<GTD_MAX; i++)
+  {
+    ohci_data.gtd_pool[i].next = (i+1 < GTD_MAX) ? (uint32_t) (uintptr_t) &ohci_data.gtd_pool[i+1] : 0;
+  }
+  ohci_data.gtd_free = &ohci_data.gtd_pool[0];
+
+#if ITD_MAX
+  for(uint32_t i=0; i<ITD_MAX; i++)
+  {
+    ohci_data.itd_pool[i].next = (i+1 < ITD_MAX) ? (uint32_t) (uintptr_t) &ohci_data.itd_pool[i+1] : 0;
+  }
+  ohci_data.itd_free = &ohci_data.itd_pool[0];
+#endif
+
   //If OHCI hardware is in SMM mode, gain ownership (Ref OHCI spec 5.1.1.3.3)
   if (OHCI_REG->control_bit.interrupt_routing == 1)
   {
@@ -219,9 +256,9 @@ bool hcd_init(uint8_t rhport)
   while( OHCI_REG->command_status_bit.controller_reset ) {} // should not take longer than 10 us
 
   //------------- init ohci registers -------------//
-  OHCI_REG->control_head_ed = (uint32_t) _phys_addr(&ohci_data.control[0].ed);
-  OHCI_REG->bulk_head_ed    = (uint32_t) _phys_addr(&ohci_data.bulk_head_ed);
-  OHCI_REG->hcca            = (uint32_t) _phys_addr(&ohci_data.hcca);
+  OHCI_REG->control_head_ed = (uint32_t) (uintptr_t) _phys_addr(&ohci_data.control[0].ed);
+  OHCI_REG->bulk_head_ed    = (uint32_t) (uintptr_t) _phys_addr(&ohci_data.bulk_head_ed);
+  OHCI_REG->hcca            = (uint32_t) (uintptr_t) _phys_addr(&ohci_data.hcca);
 
   OHCI_REG->interrupt_disable = OHCI_REG->interrupt_enable; // disable all interrupts
   OHCI_REG->interrupt_status  = OHCI_REG->interrupt_status; // clear current set bits
@@ -230,10 +267,11 @@ bool hcd_init(uint8_t rhport)
       OHCI_INT_MASTER_ENABLE_MASK;
 
   OHCI_REG->control = OHCI_CONTROL_CONTROL_BULK_RATIO | OHCI_CONTROL_LIST_CONTROL_ENABLE_MASK |
-       OHCI_CONTROL_LIST_BULK_ENABLE_MASK | OHCI_CONTROL_LIST_PERIODIC_ENABLE_MASK; // TODO Isochronous
+       OHCI_CONTROL_LIST_BULK_ENABLE_MASK | OHCI_CONTROL_LIST_PERIODIC_ENABLE_MASK |
+       (ITD_MAX ? OHCI_CONTROL_LIST_ISOCHRONOUS_ENABLE_MASK : 0);
 
   OHCI_REG->frame_interval = (OHCI_FMINTERVAL_FSMPS << 16) | OHCI_FMINTERVAL_FI;
-  OHCI_REG->frame_interval ^= (1 << 31); //Must toggle when frame_interval is updated.
+  OHCI_REG->frame_interval ^= TU_BIT(31); //Must toggle when frame_interval is updated.
   OHCI_REG->periodic_start = (OHCI_FMINTERVAL_FI * 9) / 10; // Periodic start is 90% of frame interval
 
   OHCI_REG->control_bit.hc_functional_state = OHCI_CONTROL_FUNCSTATE_OPERATIONAL; // make HC's state to operational state TODO use this to suspend (save power)
@@ -281,9 +319,6 @@ tusb_speed_t hcd_port_speed_get(uint8_t hostid)
 // thus there is no need to make sure ED is not in HC's cahed as it will not for sure
 void hcd_device_close(uint8_t rhport, uint8_t dev_addr)
 {
-  // TODO OHCI
-  (void) rhport;
-
   // addr0 serves as static head --> only set skip bit
   if ( dev_addr == 0 )
   {
@@ -296,10 +331,18 @@ void hcd_device_close(uint8_t rhport, uint8_t dev_addr)
     // remove bulk
     ed_list_remove_by_addr(p_ed_head[TUSB_XFER_BULK], dev_addr);
 
-    // remove interrupt
+    // remove interrupt and isochronous (end of periodic list)
     ed_list_remove_by_addr(p_ed_head[TUSB_XFER_INTERRUPT], dev_addr);
 
-    // TODO remove ISO
+    // removed EDs are skipped, their TDs are released once HC is done with the current frame
+    uint32_t const frame = hcd_frame_number(rhport);
+    while ( frame == hcd_frame_number(rhport) ) {}
+
+    for(uint32_t i=0; i<ED_MAX; i++)
+    {
+      ohci_ed_t* ed = &ohci_data.ed_pool[i];
+      if ( ed->used && ed->dev_addr == dev_addr ) ed_free(ed);
+    }
   }
 }
 
@@ -352,53 +395,76 @@ static void gtd_init(ohci_gtd_t* p_td, uint8_t* data_ptr, uint16_t total_bytes)
   p_td->delay_interrupt        = OHCI_INT_ON_COMPLETE_NO;
   p_td->condition_code         = OHCI_CCODE_NOT_ACCESSED;
 
-  p_td->current_buffer_pointer = _phys_addr(data_ptr);
-  p_td->buffer_end             = total_bytes ? (_phys_addr(data_ptr + total_bytes - 1)) : (uint8_t *)p_td->current_buffer_pointer;
+  p_td->current_buffer_pointer = (uint32_t) (uintptr_t) _phys_addr(data_ptr);
+  p_td->buffer_end             = total_bytes ? (uint32_t) (uintptr_t) _phys_addr(data_ptr + total_bytes - 1) : p_td->current_buffer_pointer;
+}
+
+static ohci_ed_index_t* ed_index_entry(uint8_t dev_addr, uint8_t ep_addr)
+{
+  uint8_t const epnum = tu_edpt_number(ep_addr);
+  if ( dev_addr == 0 || dev_addr > ED_INDEX_DEV || epnum == 0 ) return NULL;
+
+  return &ohci_data.ed_index[dev_addr-1][2*(epnum-1) + tu_edpt_dir(ep_addr)];
 }
 
 static ohci_ed_t * ed_from_addr(uint8_t dev_addr, uint8_t ep_addr)
 {
   if ( tu_edpt_number(ep_addr) == 0 ) return &ohci_data.control[dev_addr].ed;
 
-  ohci_ed_t* ed_pool = ohci_data.ed_pool;
+  ohci_ed_index_t const* index = ed_index_entry(dev_addr, ep_addr);
+  return (index && *index) ? &ohci_data.ed_pool[*index - 1] : NULL;
+}
 
-  for(uint32_t i=0; i<ED_MAX; i++)
-  {
-    if ( (ed_pool[i].dev_addr == dev_addr) &&
-          ep_addr == tu_edpt_addr(ed_pool[i].ep_number, ed_pool[i].pid == PID_IN) )
-    {
-      return &ed_pool[i];
-    }
-  }
+static inline bool ed_is_pool(ohci_ed_t const * ed)
+{
+  return (ed >= ohci_data.ed_pool) && (ed < ohci_data.ed_pool + ED_MAX);
+}
+
+// Take an ED from the free list for an endpoint
+static ohci_ed_t * ed_alloc(uint8_t dev_addr, uint8_t ep_addr)
+{
+  ohci_ed_index_t* index = ed_index_entry(dev_addr, ep_addr);
+  ohci_ed_t* ed = ohci_data.ed_free;
+  if ( !(index && ed) ) return NULL;
 
-  return NULL;
+  ohci_data.ed_free = (ohci_ed_t*) (uintptr_t) ed->td_tail;
+  *index = (ohci_ed_index_t) (ed - ohci_data.ed_pool + 1);
+
+  return ed;
 }
 
-static ohci_ed_t * ed_find_free(void)
+// ED is no longer found by address, an endpoint of a new device with same address can be opened
+static void ed_index_clear(ohci_ed_t const * ed)
 {
-  ohci_ed_t* ed_pool = ohci_data.ed_pool;
+  ohci_ed_index_t* index = ed_index_entry(ed->dev_addr, tu_edpt_addr(ed->ep_number, ed->pid == PID_IN));
+  if ( index && *index == (ed - ohci_data.ed_pool) + 1 ) *index = 0;
+}
 
-  for(uint8_t i = 0; i < ED_MAX; i++)
-  {
-    if ( !ed_pool[i].used ) return &ed_pool[i];
-  }
+// Release all TDs and return unlinked ED to free list, it is kept skipped since HC may still visit it
+static void ed_free(ohci_ed_t * ed)
+{
+  ed->skip = 1;
+  td_queue_release(ed, false);
 
-  return NULL;
+  ed->used = 0;
+  ed->td_tail = (uint32_t) (uintptr_t) ohci_data.ed_free;
+  ohci_data.ed_free = ed;
 }
 
 static void ed_list_insert(ohci_ed_t * p_pre, ohci_ed_t * p_ed)
 {
   p_ed->next = p_pre->next;
-  p_pre->next = (uint32_t) _phys_addr(p_ed);
+  p_pre->next = (uint32_t) (uintptr_t) _phys_addr(p_ed);
 }
 
+// Unlink EDs of a device, pooled EDs are released by hcd_device_close()
 static void ed_list_remove_by_addr(ohci_ed_t * p_head, uint8_t dev_addr)
 {
   ohci_ed_t* p_prev = p_head;
 
   while( p_prev->next )
   {
-    ohci_ed_t* ed = (ohci_ed_t*) _virt_addr((void *)p_prev->next);
+    ohci_ed_t* ed = (ohci_ed_t*) _virt_addr((void *) (uintptr_t) p_prev->next);
 
     if (ed->dev_addr == dev_addr)
     {
@@ -409,37 +475,217 @@ static void ed_list_remove_by_addr(ohci_ed_t * p_head, uint8_t dev_addr)
       p_prev->next = ed->next;
 
       // point the removed ED's next pointer to list head to make sure HC can always safely move away from this ED
-      ed->next = (uint32_t) _phys_addr(p_head);
-      ed->used = 0;
-      ed->skip = 0;
+      ed->next = (uint32_t) (uintptr_t) _phys_addr(p_head);
+
+      ed_index_clear(ed);
+      if ( !ed_is_pool(ed) ) ed->used = 0; // control ED has no pooled TD
     }else
     {
-      p_prev = (ohci_ed_t*) _virt_addr((void *)p_prev->next);
+      p_prev = (ohci_ed_t*) _virt_addr((void *) (uintptr_t) p_prev->next);
     }
   }
 }
 
-static ohci_gtd_t * gtd_find_free(void)
+//------------- TD helper -------------//
+
+static ohci_gtd_t * gtd_alloc(void)
 {
-  for(uint8_t i=0; i < GTD_MAX; i++)
+  ohci_gtd_t* gtd = ohci_data.gtd_free;
+  if ( gtd )
   {
-    if ( !ohci_data.gtd_pool[i].used ) return &ohci_data.gtd_pool[i];
+    ohci_data.gtd_free = (ohci_gtd_t*) (uintptr_t) gtd->next;
+    gtd->used = 1;
   }
+  return gtd;
+}
 
-  return NULL;
+// Return TD to free list, control TDs are reserved per device and not pooled
+static void gtd_free(ohci_gtd_t* gtd)
+{
+  if ( !gtd->used ) return; // already free, must not be linked twice
+  gtd->used = 0;
+
+  if ( (gtd >= ohci_data.gtd_pool) && (gtd < ohci_data.gtd_pool + GTD_MAX) )
+  {
+    gtd->next = (uint32_t) (uintptr_t) ohci_data.gtd_free;
+    ohci_data.gtd_free = gtd;
+  }
 }
 
-static void td_insert_to_ed(ohci_ed_t* p_ed, ohci_gtd_t * p_gtd)
+// Check if count TDs can be allocated
+static bool gtd_available(uint32_t count)
 {
-  // tail is always NULL
-  if ( tu_align16(p_ed->td_head.address) == 0 )
-  { // TD queue is empty --> head = TD
-    p_ed->td_head.address |= (uint32_t) _phys_addr(p_gtd);
+  ohci_gtd_t const* gtd = ohci_data.gtd_free;
+  while ( count && gtd )
+  {
+    count--;
+    gtd = (ohci_gtd_t const*) (uintptr_t) gtd->next;
   }
-  else
-  { // TODO currently only support queue up to 2 TD each endpoint at a time
-    ((ohci_gtd_t*) tu_align16((uint32_t)_virt_addr((void *)p_ed->td_head.address)))->next = (uint32_t) _phys_addr(p_gtd);
+  return count == 0;
+}
+
+#if ITD_MAX
+static inline bool itd_is_pool(void const * td)
+{
+  return ((uintptr_t) td >= (uintptr_t) ohci_data.itd_pool) &&
+         ((uintptr_t) td <  (uintptr_t) (ohci_data.itd_pool + ITD_MAX));
+}
+
+static ochi_itd_t * itd_alloc(void)
+{
+  ochi_itd_t* itd = ohci_data.itd_free;
+  if ( itd )
+  {
+    ohci_data.itd_free = (ochi_itd_t*) (uintptr_t) itd->next;
+    itd->used = 1;
   }
+  return itd;
+}
+
+static void itd_free(ochi_itd_t* itd)
+{
+  if ( !itd->used ) return;
+  itd->used = 0;
+
+  itd->next = (uint32_t) (uintptr_t) ohci_data.itd_free;
+  ohci_data.itd_free = itd;
+}
+
+static bool itd_available(uint32_t count)
+{
+  ochi_itd_t const* itd = ohci_data.itd_free;
+  while ( count && itd )
+  {
+    count--;
+    itd = (ochi_itd_t const*) (uintptr_t) itd->next;
+  }
+  return count == 0;
+}
+#endif
+
+static void td_free(ohci_td_item_t* td)
+{
+#if ITD_MAX
+  if ( itd_is_pool(td) )
+  {
+    itd_free((ochi_itd_t*) td);
+    return;
+  }
+#endif
+
+  gtd_free((ohci_gtd_t*) td);
+}
+
+// Queue of a non-control ED always ends with an inactive dummy TD (next is NULL): HC stops when head reaches tail.
+// Tail pointer of a halted ED is moved to its head (see done_queue_isr), the dummy is found by walking the queue.
+static ohci_td_item_t* td_queue_tail(ohci_ed_t const * ed)
+{
+  ohci_td_item_t* td = (ohci_td_item_t*) _virt_addr((void *) (uintptr_t) tu_align16(ed->td_tail));
+  while ( td->next ) td = (ohci_td_item_t*) _virt_addr((void *) (uintptr_t) td->next);
+  return td;
+}
+
+// Release TDs queued on a non-control ED which is skipped or halted, dummy TD is kept for further transfers unless
+// the ED is closed
+static void td_queue_release(ohci_ed_t* ed, bool keep_dummy)
+{
+  uint32_t td_addr = tu_align16(ed->td_head.address);
+
+  while ( td_addr )
+  {
+    ohci_td_item_t * const td = (ohci_td_item_t *) _virt_addr((void *) (uintptr_t) td_addr);
+    uint32_t const next = td->next;
+
+    if ( next == 0 && keep_dummy ) break;
+
+    td_free(td);
+    td_addr = next;
+  }
+
+  // data toggle and halted bit are kept
+  ed->td_head.address = (ed->td_head.address & 0x0Ful) | td_addr;
+  ed->td_tail         = td_addr;
+}
+
+// Number of bytes of a TD: whole remaining bytes if they fit in two 4 KB pages, otherwise multiple of max packet size
+static uint16_t gtd_chunk(uint32_t addr, uint16_t remaining, uint16_t mps)
+{
+  uint32_t const max = 0x2000u - tu_offset4k(addr);
+  if ( remaining <= max ) return remaining;
+  return (uint16_t) (max - (max % mps));
+}
+
+// Queue a transfer on a bulk/interrupt ED. The dummy TD at tail is filled with the first part and a new dummy is
+// linked last, HC only sees the transfer once tail pointer is advanced. All TDs but the last one do not accept short
+// packet: ED is halted on short packet and the rest of the transfer is removed by done_queue_isr().
+static bool gtd_queue_xfer(ohci_ed_t* ed, uint8_t* buffer, uint16_t buflen)
+{
+  uint16_t const mps = ed->max_packet_size;
+
+  // new TDs: one per part except the first (dummy), plus new dummy
+  uint32_t count = 0;
+  uint16_t offset = 0;
+  do
+  {
+    offset += gtd_chunk((uint32_t) (uintptr_t) _phys_addr(buffer + offset), buflen - offset, mps);
+    count++;
+  } while ( offset < buflen );
+
+  TU_VERIFY(gtd_available(count));
+
+  ohci_gtd_t* gtd = (ohci_gtd_t*) td_queue_tail(ed);
+  offset = 0;
+
+  while (1)
+  {
+    uint16_t const len  = gtd_chunk((uint32_t) (uintptr_t) _phys_addr(buffer + offset), buflen - offset, mps);
+    bool const     last = (offset + len >= buflen);
+    ohci_gtd_t*    next = gtd_alloc();
+
+    gtd_init(gtd, buffer + offset, len);
+    gtd->xfer_end        = last ? 1 : 0;
+    gtd->buffer_rounding = last ? 1 : 0;
+    gtd->delay_interrupt = last ? OHCI_INT_ON_COMPLETE_YES : OHCI_INT_ON_COMPLETE_NO;
+    gtd->next            = (uint32_t) (uintptr_t) _phys_addr(next);
+
+    ohci_gtd_info_t* info = &ohci_data.gtd_info[gtd - ohci_data.gtd_pool];
+    info->ed     = (uint16_t) (ed - ohci_data.ed_pool);
+    info->offset = offset;
+
+    offset += len;
+    gtd = next;
+
+    if ( last ) break;
+  }
+
+  // new dummy
+  tu_memclr(gtd, sizeof(ohci_gtd_t));
+  gtd->used = 1;
+
+  // halted ED keeps tail at head until stall is cleared
+  if ( !ed->td_head.halted ) ed->td_tail = (uint32_t) (uintptr_t) _phys_addr(gtd);
+
+  return true;
+}
+
+// Remove the remaining TDs of the transfer at head of a halted ED
+static void gtd_skip_xfer(ohci_ed_t* ed)
+{
+  uint32_t td_addr = tu_align16(ed->td_head.address);
+
+  while ( td_addr )
+  {
+    ohci_gtd_t * const gtd = (ohci_gtd_t *) _virt_addr((void *) (uintptr_t) td_addr);
+    if ( gtd->next == 0 ) break; // dummy
+
+    td_addr = gtd->next;
+
+    bool const xfer_end = gtd->xfer_end;
+    gtd_free(gtd);
+    if ( xfer_end ) break;
+  }
+
+  ed->td_head.address = (ed->td_head.address & 0x0Ful) | td_addr;
 }
 
 //--------------------------------------------------------------------+
@@ -450,8 +696,12 @@ bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const
 {
   (void) rhport;
 
-  // TODO iso support
-  TU_ASSERT(ep_desc->bmAttributes.xfer != TUSB_XFER_ISOCHRONOUS);
+  uint8_t const xfer_type = ep_desc->bmAttributes.xfer;
+
+#if !ITD_MAX
+  // isochronous requires CFG_TUH_OHCI_ITD_MAX
+  TU_ASSERT(xfer_type != TUSB_XFER_ISOCHRONOUS);
+#endif
 
   //------------- Prepare Queue Head -------------//
   ohci_ed_t * p_ed;
@@ -461,12 +711,12 @@ bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const
     p_ed = &ohci_data.control[dev_addr].ed;
   }else
   {
-    p_ed = ed_find_free();
+    p_ed = ed_alloc(dev_addr, ep_desc->bEndpointAddress);
   }
   TU_ASSERT(p_ed);
 
   ed_init( p_ed, dev_addr, tu_edpt_packet_size(ep_desc), ep_desc->bEndpointAddress,
-            ep_desc->bmAttributes.xfer, ep_desc->bInterval );
+            xfer_type, ep_desc->bInterval );
 
   // control of dev0 is used as static async head
   if ( dev_addr == 0 )
@@ -475,7 +725,52 @@ bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const
     return true;
   }
 
-  ed_list_insert( p_ed_head[ep_desc->bmAttributes.xfer], p_ed );
+  if ( ep_desc->bEndpointAddress != 0 )
+  {
+    // empty queue: head = tail = dummy TD
+    ohci_td_item_t* dummy;
+#if ITD_MAX
+    if ( xfer_type == TUSB_XFER_ISOCHRONOUS )
+    {
+      ochi_itd_t* itd = itd_alloc();
+      if ( itd )
+      {
+        tu_memclr(itd, sizeof(ochi_itd_t));
+        itd->used = 1;
+      }
+      dummy = (ohci_td_item_t*) itd;
+    }else
+#endif
+    {
+      ohci_gtd_t* gtd = gtd_alloc();
+      if ( gtd )
+      {
+        tu_memclr(gtd, sizeof(ohci_gtd_t));
+        gtd->used = 1;
+      }
+      dummy = (ohci_td_item_t*) gtd;
+    }
+
+    if ( dummy == NULL )
+    {
+      ed_index_clear(p_ed);
+      ed_free(p_ed);
+      TU_ASSERT(false);
+    }
+
+    p_ed->td_head.address = p_ed->td_tail = (uint32_t) (uintptr_t) _phys_addr(dummy);
+  }
+
+  if ( xfer_type == TUSB_XFER_ISOCHRONOUS )
+  {
+    // isochronous EDs are at the end of periodic list
+    ohci_ed_t* p_pre = p_ed_head[TUSB_XFER_ISOCHRONOUS];
+    while ( p_pre->next ) p_pre = (ohci_ed_t*) _virt_addr((void *) (uintptr_t) p_pre->next);
+    ed_list_insert(p_pre, p_ed);
+  }else
+  {
+    ed_list_insert( p_ed_head[xfer_type], p_ed );
+  }
 
   return true;
 }
@@ -488,13 +783,13 @@ bool hcd_setup_send(uint8_t rhport, uint8_t dev_addr, uint8_t const setup_packet
   ohci_gtd_t *qtd = &ohci_data.control[dev_addr].gtd;
 
   gtd_init(qtd, (uint8_t*) setup_packet, 8);
-  qtd->index           = dev_addr;
+  qtd->xfer_end        = 1;
   qtd->pid             = PID_SETUP;
   qtd->data_toggle     = GTD_DT_DATA0;
   qtd->delay_interrupt = OHCI_INT_ON_COMPLETE_YES;
 
   //------------- Attach TDs list to Control Endpoint -------------//
-  ed->td_head.address = (uint32_t) _phys_addr(qtd);
+  ed->td_head.address = (uint32_t) (uintptr_t) _phys_addr(qtd);
 
   OHCI_REG->command_status_bit.control_list_filled = 1;
 
@@ -503,8 +798,6 @@ bool hcd_setup_send(uint8_t rhport, uint8_t dev_addr, uint8_t const setup_packet
 
 bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t buflen)
 {
-  (void) rhport;
-
   uint8_t const epnum = tu_edpt_number(ep_addr);
   uint8_t const dir   = tu_edpt_dir(ep_addr);
 
@@ -515,29 +808,26 @@ bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t *
 
     gtd_init(gtd, buffer, buflen);
 
-    gtd->index           = dev_addr;
+    gtd->xfer_end        = 1;
     gtd->pid             = dir ? PID_IN : PID_OUT;
     gtd->data_toggle     = GTD_DT_DATA1; // Both Data and Ack stage start with DATA1
     gtd->delay_interrupt = OHCI_INT_ON_COMPLETE_YES;
 
-    ed->td_head.address = (uint32_t) _phys_addr(gtd);
+    ed->td_head.address = (uint32_t) (uintptr_t) _phys_addr(gtd);
 
     OHCI_REG->command_status_bit.control_list_filled = 1;
   }else
   {
     ohci_ed_t * ed = ed_from_addr(dev_addr, ep_addr);
-    ohci_gtd_t* gtd = gtd_find_free();
-
-    TU_ASSERT(gtd);
+    TU_ASSERT(ed && !ed->is_iso);
 
-    gtd_init(gtd, buffer, buflen);
-    gtd->index = ed-ohci_data.ed_pool;
-    gtd->delay_interrupt = OHCI_INT_ON_COMPLETE_YES;
+    hcd_int_disable(rhport);
+    bool const queued = gtd_queue_xfer(ed, buffer, buflen);
+    hcd_int_enable(rhport);
 
-    td_insert_to_ed(ed, gtd);
+    TU_ASSERT(queued);
 
-    tusb_xfer_type_t xfer_type = ed_get_xfer_type( ed_from_addr(dev_addr, ep_addr) );
-    if (TUSB_XFER_BULK == xfer_type) OHCI_REG->command_status_bit.bulk_list_filled = 1;
+    if (TUSB_XFER_BULK == ed_get_xfer_type(ed)) OHCI_REG->command_status_bit.bulk_list_filled = 1;
   }
 
   return true;
@@ -548,7 +838,15 @@ bool hcd_edpt_clear_stall(uint8_t dev_addr, uint8_t ep_addr)
   ohci_ed_t * const p_ed = ed_from_addr(dev_addr, ep_addr);
 
   p_ed->is_stalled = 0;
-  p_ed->td_tail    &= 0x0Ful; // set tail pointer back to NULL
+
+  // set tail pointer back to dummy TD (NULL for control)
+  if ( ed_is_pool(p_ed) )
+  {
+    p_ed->td_tail = (uint32_t) (uintptr_t) _phys_addr(td_queue_tail(p_ed));
+  }else
+  {
+    p_ed->td_tail &= 0x0Ful;
+  }
 
   p_ed->td_head.toggle = 0; // reset data toggle
   p_ed->td_head.halted = 0;
@@ -558,6 +856,212 @@ bool hcd_edpt_clear_stall(uint8_t dev_addr, uint8_t ep_addr)
   return true;
 }
 
+bool hcd_edpt_abort_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr)
+{
+  ohci_ed_t * const p_ed = ed_from_addr(dev_addr, ep_addr);
+  TU_VERIFY(p_ed);
+
+  // nothing queued: head is NULL (control) or the dummy TD
+  ohci_td_item_t const * head = (ohci_td_item_t const *) _virt_addr((void *) (uintptr_t) tu_align16(p_ed->td_head.address));
+  TU_VERIFY(head && (!ed_is_pool(p_ed) || head->next));
+
+  // Prevent Host Controller from processing this ED, the current transaction is only finished by the next frame
+  p_ed->skip = 1;
+  uint32_t const frame = hcd_frame_number(rhport);
+  while ( frame == hcd_frame_number(rhport) ) {}
+
+  // free all TDs which are not retired yet, retired ones are in the done queue and not reported anymore by usbh
+  if ( ed_is_pool(p_ed) )
+  {
+    // empty TD queue (head = tail = dummy), data toggle and halted bit are kept
+    td_queue_release(p_ed, true);
+  }else
+  {
+    gtd_free(&ohci_data.control[dev_addr].gtd);
+
+    // empty TD queue (head = tail = NULL), data toggle and halted bit are kept
+    p_ed->td_head.address &= 0x0Ful;
+    p_ed->td_tail         &= 0x0Ful;
+  }
+
+  p_ed->skip = 0;
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Isochronous
+//--------------------------------------------------------------------+
+#if ITD_MAX
+
+enum {
+  ISO_FRAME_MARGIN = 2, // frames ahead the first transfer of an idle endpoint is scheduled
+};
+
+// Number of packets an iTD carries from packets[0] at addr: up to 8 within the 4 KB page of addr and the next one
+static uint8_t itd_packet_count(uint32_t addr, tuh_iso_packet_t const* packets, uint16_t count)
+{
+  uint32_t const page0 = tu_align4k(addr);
+  uint8_t n = 0;
+
+  while ( n < OHCI_ITD_FRAME_MAX && n < count )
+  {
+    if ( addr + packets[n].length - 1 - page0 >= 0x2000 ) break;
+    addr += packets[n].length;
+    n++;
+  }
+
+  return n;
+}
+
+bool hcd_edpt_iso_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t* buffer,
+                       tuh_iso_packet_t* packets, uint16_t count)
+{
+  ohci_ed_t* ed = ed_from_addr(dev_addr, ep_addr);
+  TU_ASSERT(ed && ed->is_iso && count);
+
+  uint32_t total_bytes = 0;
+  for (uint16_t i = 0; i < count; i++)
+  {
+    // zero length packet cannot be expressed by iTD buffer layout
+    TU_ASSERT(packets[i].length && packets[i].length <= ed->max_packet_size);
+    packets[i].actual_length = 0;
+    packets[i].result        = XFER_RESULT_INVALID;
+    total_bytes += packets[i].length;
+  }
+
+  // new iTDs: one per 8 packets or two pages except the first (dummy), plus new dummy
+  uint32_t itd_count = 0;
+  for (uint16_t i = 0, offset = 0; i < count; itd_count++)
+  {
+    uint8_t const n = itd_packet_count((uint32_t) (uintptr_t) _phys_addr(buffer + offset), &packets[i], count - i);
+    for (uint8_t k = 0; k < n; k++) offset += packets[i+k].length;
+    i += n;
+  }
+
+  // IN transfer: invalidate buffer, OUT transfer: clean buffer
+  if (tu_edpt_dir(ep_addr)) {
+    hcd_dcache_invalidate(buffer, total_bytes);
+  } else {
+    hcd_dcache_clean(buffer, total_bytes);
+  }
+
+  hcd_int_disable(rhport);
+
+  if ( !itd_available(itd_count) )
+  {
+    hcd_int_enable(rhport);
+    return false;
+  }
+
+  ochi_itd_t* itd = (ochi_itd_t*) td_queue_tail(ed);
+
+  // continue in the frame after queued transfers (kept by dummy), start with a margin if endpoint is idle
+  uint16_t frame = (uint16_t) itd->starting_frame;
+  uint16_t const now = (uint16_t) hcd_frame_number(rhport);
+  bool const idle = (tu_align16(ed->td_head.address) == (uint32_t) (uintptr_t) _phys_addr(itd));
+
+  if ( idle && (int16_t) (frame - now) < ISO_FRAME_MARGIN )
+  {
+    frame = now + ISO_FRAME_MARGIN;
+  }
+
+  uint32_t offset = 0;
+  uint16_t i = 0;
+
+  while ( i < count )
+  {
+    uint32_t    addr = (uint32_t) (uintptr_t) _phys_addr(buffer + offset);
+    uint8_t const  n = itd_packet_count(addr, &packets[i], count - i);
+    bool const  last = (i + n == count);
+    ochi_itd_t* next = itd_alloc();
+
+    tu_memclr(itd, sizeof(ochi_itd_t));
+    itd->used            = 1;
+    itd->xfer_end        = last ? 1 : 0;
+    itd->starting_frame  = frame;
+    itd->frame_count     = n - 1;
+    itd->delay_interrupt = last ? OHCI_INT_ON_COMPLETE_YES : OHCI_INT_ON_COMPLETE_NO;
+    itd->condition_code  = OHCI_CCODE_NOT_ACCESSED;
+    itd->buffer_page0    = tu_align4k(addr);
+
+    // offset bit 12 selects the page of buffer end, condition code is NOT ACCESSED until HC writes the status
+    for (uint8_t k = 0; k < n; k++)
+    {
+      itd->offset_packetstatus[k] = (uint16_t) ((OHCI_CCODE_NOT_ACCESSED << 12) | (addr - itd->buffer_page0));
+      addr   += packets[i+k].length;
+      offset += packets[i+k].length;
+    }
+
+    itd->buffer_end = addr - 1;
+    itd->next       = (uint32_t) (uintptr_t) _phys_addr(next);
+
+    ohci_itd_info_t* info = &ohci_data.itd_info[itd - ohci_data.itd_pool];
+    info->packets   = &packets[i];
+    info->buffer    = buffer;
+    info->ed        = (uint16_t) (ed - ohci_data.ed_pool);
+    info->pkt_index = i;
+
+    frame += n;
+    i     += n;
+    itd    = next;
+  }
+
+  // new dummy holds the frame the next transfer continues at
+  tu_memclr(itd, sizeof(ochi_itd_t));
+  itd->used           = 1;
+  itd->starting_frame = frame;
+
+  ed->td_tail = (uint32_t) (uintptr_t) _phys_addr(itd);
+
+  hcd_int_enable(rhport);
+
+  return true;
+}
+
+// Report packet status of a retired iTD, transfer is complete with its last iTD
+static void itd_retire(ochi_itd_t* itd)
+{
+  ohci_itd_info_t const* info = &ohci_data.itd_info[itd - ohci_data.itd_pool];
+  ohci_ed_t const* ed = &ohci_data.ed_pool[info->ed];
+  bool const is_in = (ed->pid == PID_IN);
+  uint8_t const n = itd->frame_count + 1;
+
+  for (uint8_t k = 0; k < n; k++)
+  {
+    uint16_t const psw = itd->offset_packetstatus[k];
+    uint8_t const cc = psw >> 12;
+    tuh_iso_packet_t* packet = &info->packets[k];
+
+    // short packet is not an error, packets of a late iTD are not accessed
+    bool const ok = (cc == OHCI_CCODE_NO_ERROR) || (is_in && cc == OHCI_CCODE_DATA_UNDERRUN);
+
+    packet->actual_length = ok ? (is_in ? (psw & 0x07FF) : packet->length) : 0;
+    packet->result        = ok ? XFER_RESULT_SUCCESS : XFER_RESULT_FAILED;
+  }
+
+  if ( itd->xfer_end )
+  {
+    tuh_iso_packet_t const* xfer_packets = info->packets - info->pkt_index;
+    uint16_t const xfer_count = info->pkt_index + n;
+
+    uint32_t actual = 0;
+    uint32_t total  = 0;
+    for (uint16_t i = 0; i < xfer_count; i++)
+    {
+      actual += xfer_packets[i].actual_length;
+      total  += xfer_packets[i].length;
+    }
+
+    if ( is_in ) hcd_dcache_invalidate(info->buffer, total);
+
+    hcd_event_xfer_complete(ed->dev_addr, tu_edpt_addr(ed->ep_number, is_in), actual, XFER_RESULT_SUCCESS, true);
+  }
+
+  itd_free(itd);
+}
+
+#endif
 
 //--------------------------------------------------------------------+
 // OHCI Interrupt Handler
@@ -572,10 +1076,10 @@ static ohci_td_item_t* list_reverse(ohci_td_item_t* td_head)
     uint32_t next = td_head->next;
 
     // make current's item become reverse's first item
-    td_head->next = (uint32_t) td_reverse_head;
+    td_head->next = (uint32_t) (uintptr_t) td_reverse_head;
     td_reverse_head  = _phys_addr(td_head);
 
-    td_head = (ohci_td_item_t*) next; // advance to next item
+    td_head = (ohci_td_item_t*) (uintptr_t) next; // advance to next item
   }
 
   return _virt_addr(td_reverse_head);
@@ -583,17 +1087,20 @@ static ohci_td_item_t* list_reverse(ohci_td_item_t* td_head)
 
 static inline bool gtd_is_control(ohci_gtd_t const * const p_qtd)
 {
-  return ((uint32_t) p_qtd) < ((uint32_t) ohci_data.gtd_pool); // check ohci_data_t for memory layout
+  // control TDs are reserved per device in ohci_data.control[]
+  return ((uintptr_t) p_qtd >= (uintptr_t) ohci_data.control) &&
+         ((uintptr_t) p_qtd <  (uintptr_t) (ohci_data.control + TU_ARRAY_SIZE(ohci_data.control)));
 }
 
 static inline ohci_ed_t* gtd_get_ed(ohci_gtd_t const * const p_qtd)
 {
   if ( gtd_is_control(p_qtd) )
   {
-    return &ohci_data.control[p_qtd->index].ed;
+    uint32_t const daddr = ((uintptr_t) p_qtd - (uintptr_t) ohci_data.control) / sizeof(ohci_data.control[0]);
+    return &ohci_data.control[daddr].ed;
   }else
   {
-    return &ohci_data.ed_pool[p_qtd->index];
+    return &ohci_data.ed_pool[ ohci_data.gtd_info[p_qtd - ohci_data.gtd_pool].ed ];
   }
 }
 
@@ -608,49 +1115,90 @@ static inline uint32_t gtd_xfer_byte_left(uint32_t buffer_end, uint32_t current_
       tu_offset4k(buffer_end) - tu_offset4k(current_buffer) + 1;
 }
 
+// Retire a general TD, transfer is reported with its last TD or the TD it failed at
+static void gtd_retire(ohci_gtd_t* qtd)
+{
+  ohci_ed_t * const ed = gtd_get_ed(qtd);
+  bool const is_control = gtd_is_control(qtd);
+  uint8_t const ccode = qtd->condition_code;
+
+  xfer_result_t event = (ccode == OHCI_CCODE_NO_ERROR) ? XFER_RESULT_SUCCESS :
+                        (ccode == OHCI_CCODE_STALL) ? XFER_RESULT_STALLED : XFER_RESULT_FAILED;
+
+  uint32_t xferred_bytes = qtd->expected_bytes - gtd_xfer_byte_left(qtd->buffer_end, qtd->current_buffer_pointer);
+  bool xfer_end = qtd->xfer_end;
+
+  if ( !is_control )
+  {
+    xferred_bytes += ohci_data.gtd_info[qtd - ohci_data.gtd_pool].offset;
+
+    if ( (event != XFER_RESULT_SUCCESS) && !xfer_end )
+    {
+      // ED is halted at this TD: the rest of the transfer is removed
+      gtd_skip_xfer(ed);
+      xfer_end = true;
+
+      // short packet in a TD but the last one completes the transfer, ED continues with the next one
+      if ( ccode == OHCI_CCODE_DATA_UNDERRUN )
+      {
+        event = XFER_RESULT_SUCCESS;
+        ed->td_tail = (uint32_t) (uintptr_t) _phys_addr(td_queue_tail(ed));
+        ed->td_head.halted = 0;
+        if ( TUSB_XFER_BULK == ed_get_xfer_type(ed) ) OHCI_REG->command_status_bit.bulk_list_filled = 1;
+      }
+    }
+  }
+
+  if ( xfer_end )
+  {
+    // NOTE Assuming the current list is BULK and there is no other EDs in the list has queued TDs.
+    // When there is a error resulting this ED is halted, and this EP still has other queued TD
+    // --> the Bulk list only has this halted EP queueing TDs (remaining)
+    // --> Bulk list will be considered as not empty by HC !!! while there is no attempt transaction on this list
+    // --> HC will not process Control list (due to service ratio when Bulk list not empty)
+    // To walk-around this, the halted ED will have TailP = HeadP (empty list condition), when clearing halt
+    // the TailP must be set back to the dummy TD (NULL for control) for processing remaining TDs
+    if ((event != XFER_RESULT_SUCCESS))
+    {
+      ed->td_tail &= 0x0Ful;
+      ed->td_tail |= tu_align16(ed->td_head.address); // mark halted EP as empty queue
+      if ( event == XFER_RESULT_STALLED ) ed->is_stalled = 1;
+    }
+
+    uint8_t dir = (ed->ep_number == 0) ? (qtd->pid == PID_IN) : (ed->pid == PID_IN);
+
+    hcd_event_xfer_complete(ed->dev_addr, tu_edpt_addr(ed->ep_number, dir), xferred_bytes, event, true);
+  }
+
+  gtd_free(qtd);
+}
+
+// All TDs retired in a done queue write-back are processed in one pass: TDs in the middle of a transfer are released
+// without event, one completion is reported per transfer.
 static void done_queue_isr(uint8_t hostid)
 {
   (void) hostid;
 
   // done head is written in reversed order of completion --> need to reverse the done queue first
-  ohci_td_item_t* td_head = list_reverse ( (ohci_td_item_t*) tu_align16(ohci_data.hcca.done_head) );
+  ohci_td_item_t* td_head = list_reverse ( (ohci_td_item_t*) (uintptr_t) tu_align16(ohci_data.hcca.done_head) );
   ohci_data.hcca.done_head = 0;
 
   while( td_head != NULL )
   {
-    // TODO check if td_head is iso td
-    //------------- Non ISO transfer -------------//
-    ohci_gtd_t * const qtd = (ohci_gtd_t *) td_head;
-    xfer_result_t const event = (qtd->condition_code == OHCI_CCODE_NO_ERROR) ? XFER_RESULT_SUCCESS :
-                                (qtd->condition_code == OHCI_CCODE_STALL) ? XFER_RESULT_STALLED : XFER_RESULT_FAILED;
+    // next TD in done queue, link is reused by free list
+    ohci_td_item_t* const td_next = (ohci_td_item_t*) _virt_addr((void *) (uintptr_t) td_head->next);
 
-    qtd->used = 0; // free TD
-    if ( (qtd->delay_interrupt == OHCI_INT_ON_COMPLETE_YES) || (event != XFER_RESULT_SUCCESS) )
+#if ITD_MAX
+    if ( itd_is_pool(td_head) )
     {
-      ohci_ed_t * const ed  = gtd_get_ed(qtd);
-
-      uint32_t const xferred_bytes = qtd->expected_bytes - gtd_xfer_byte_left((uint32_t) qtd->buffer_end, (uint32_t) qtd->current_buffer_pointer);
-
-      // NOTE Assuming the current list is BULK and there is no other EDs in the list has queued TDs.
-      // When there is a error resulting this ED is halted, and this EP still has other queued TD
-      // --> the Bulk list only has this halted EP queueing TDs (remaining)
-      // --> Bulk list will be considered as not empty by HC !!! while there is no attempt transaction on this list
-      // --> HC will not process Control list (due to service ratio when Bulk list not empty)
-      // To walk-around this, the halted ED will have TailP = HeadP (empty list condition), when clearing halt
-      // the TailP must be set back to NULL for processing remaining TDs
-      if ((event != XFER_RESULT_SUCCESS))
-      {
-        ed->td_tail &= 0x0Ful;
-        ed->td_tail |= tu_align16(ed->td_head.address); // mark halted EP as empty queue
-        if ( event == XFER_RESULT_STALLED ) ed->is_stalled = 1;
-      }
-
-      uint8_t dir = (ed->ep_number == 0) ? (qtd->pid == PID_IN) : (ed->pid == PID_IN);
-
-      hcd_event_xfer_complete(ed->dev_addr, tu_edpt_addr(ed->ep_number, dir), xferred_bytes, event, true);
+      itd_retire((ochi_itd_t*) td_head);
+    }else
+#endif
+    {
+      gtd_retire((ohci_gtd_t*) td_head);
     }
 
-    td_head = (ohci_td_item_t*) _virt_addr((void *)td_head->next);
+    td_head = td_next;
   }
 }
 
@@ -38,12 +38,34 @@
 #define OHCI_PERIODIC_LIST (defined HOST_HCD_XFER_INTERRUPT || defined HOST_HCD_XFER_ISOCHRONOUS)
 
 // TODO merge OHCI with EHCI
-enum {
-  OHCI_MAX_ITD = 4
-};
-
 #define ED_MAX       (CFG_TUH_DEVICE_MAX*CFG_TUH_ENDPOINT_MAX)
-#define GTD_MAX      ED_MAX
+
+// General TD pool shared by bulk/interrupt endpoints. Each opened ED holds a dummy TD, a transfer takes one TD per
+// 8 KB (at least 4 KB depending on buffer alignment). Default allows one transfer of up to 4 KB queued per endpoint,
+// increase for larger transfers or deeper queues.
+#ifndef CFG_TUH_OHCI_GTD_MAX
+  #define CFG_TUH_OHCI_GTD_MAX  (2*ED_MAX)
+#endif
+
+#define GTD_MAX      CFG_TUH_OHCI_GTD_MAX
+
+// Isochronous TD pool, 0 to disable isochronous endpoints. Each opened isochronous ED holds a dummy iTD, an iTD
+// carries up to 8 packets (one per frame) within two 4 KB pages.
+#ifndef CFG_TUH_OHCI_ITD_MAX
+  #define CFG_TUH_OHCI_ITD_MAX  0
+#endif
+
+#define ITD_MAX      CFG_TUH_OHCI_ITD_MAX
+
+// ED of a non-control endpoint is looked up by device address and endpoint (1-15 IN/OUT) with a table of pool indexes
+#define ED_INDEX_DEV  (CFG_TUH_DEVICE_MAX+CFG_TUH_HUB)
+#define ED_INDEX_EP   30
+
+#if ED_MAX < 255
+typedef uint8_t ohci_ed_index_t;
+#else
+typedef uint16_t ohci_ed_index_t;
+#endif
 
 //--------------------------------------------------------------------+
 // OHCI Data Structure
@@ -70,8 +92,9 @@ typedef struct TU_ATTR_ALIGNED(16)
 {
 	// Word 0
 	uint32_t used                    : 1;
-	uint32_t index                   : 4;  // endpoint index the td belongs to, or device address in case of control xfer
-  uint32_t expected_bytes          : 13; // TODO available for hcd
+	uint32_t xfer_end                : 1;  // last TD of a transfer
+  uint32_t expected_bytes          : 14;
+  uint32_t                         : 2;  // available for hcd
 
   uint32_t buffer_rounding         : 1;
   uint32_t pid                     : 2;
@@ -81,13 +104,13 @@ typedef struct TU_ATTR_ALIGNED(16)
   volatile uint32_t condition_code : 4;
 
 	// Word 1
-	volatile uint8_t* current_buffer_pointer;
+	volatile uint32_t current_buffer_pointer;
 
-	// Word 2 : next TD
+	// Word 2 : next TD, next free TD when unused
 	volatile uint32_t next;
 
 	// Word 3
-	uint8_t* buffer_end;
+	uint32_t buffer_end;
 } ohci_gtd_t;
 
 TU_VERIFY_STATIC( sizeof(ohci_gtd_t) == 16, "size is not correct" );
@@ -108,7 +131,7 @@ typedef struct TU_ATTR_ALIGNED(16)
 	uint32_t is_stalled        : 1;
 	uint32_t                   : 2;
 
-	// Word 1
+	// Word 1: next free ED when unused (skipped)
 	uint32_t td_tail;
 
 	// Word 2
@@ -131,7 +154,9 @@ typedef struct TU_ATTR_ALIGNED(32)
 {
 	/*---------- Word 1 ----------*/
   uint32_t starting_frame          : 16;
-  uint32_t                         : 5; // can be used
+  uint32_t used                    : 1;
+  uint32_t xfer_end                : 1; // last iTD of a transfer
+  uint32_t                         : 3; // can be used
   uint32_t delay_interrupt         : 3;
   uint32_t frame_count             : 3;
   uint32_t                         : 1; // can be used
@@ -141,7 +166,7 @@ typedef struct TU_ATTR_ALIGNED(32)
 	uint32_t buffer_page0;	// 12 lsb bits can be used
 
 	/*---------- Word 3 ----------*/
-	volatile uint32_t next;
+	volatile uint32_t next; // next free iTD when unused
 
 	/*---------- Word 4 ----------*/
 	uint32_t buffer_end;
@@ -152,6 +177,23 @@ typedef struct TU_ATTR_ALIGNED(32)
 
 TU_VERIFY_STATIC( sizeof(ochi_itd_t) == 32, "size is not correct" );
 
+enum {
+  OHCI_ITD_FRAME_MAX = 8
+};
+
+// HCD data of TDs from pool
+typedef struct {
+  uint16_t ed;     // ED pool index
+  uint16_t offset; // bytes of the transfer before this TD
+} ohci_gtd_info_t;
+
+typedef struct {
+  struct tuh_iso_packet_s* packets; // first packet of this iTD
+  uint8_t* buffer;                  // transfer buffer
+  uint16_t ed;                      // ED pool index
+  uint16_t pkt_index;               // index of first packet in transfer
+} ohci_itd_info_t;
+
 // structure with member alignment required from large to small
 typedef struct TU_ATTR_ALIGNED(256)
 {
@@ -166,10 +208,26 @@ typedef struct TU_ATTR_ALIGNED(256)
     ohci_gtd_t gtd;
   }control[CFG_TUH_DEVICE_MAX+CFG_TUH_HUB+1];
 
-  //  ochi_itd_t itd[OHCI_MAX_ITD]; // itd requires alignment of 32
+#if ITD_MAX
+  ochi_itd_t itd_pool[ITD_MAX]; // itd requires alignment of 32
+#endif
   ohci_ed_t ed_pool[ED_MAX];
   ohci_gtd_t gtd_pool[GTD_MAX];
 
+  ohci_gtd_info_t gtd_info[GTD_MAX];
+#if ITD_MAX
+  ohci_itd_info_t itd_info[ITD_MAX];
+#endif
+
+  ohci_ed_index_t ed_index[ED_INDEX_DEV][ED_INDEX_EP]; // pool index + 1 of opened endpoint
+
+  // free lists linked through td_tail (ED) and next (TD)
+  ohci_ed_t* ed_free;
+  ohci_gtd_t* gtd_free;
+#if ITD_MAX
+  ochi_itd_t* itd_free;
+#endif
+
   volatile uint16_t frame_number_hi;
 
 } ohci_data_t;
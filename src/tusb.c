@@ -372,9 +372,11 @@ uint32_t tu_edpt_stream_write(tu_edpt_stream_t* s, void const *buffer, uint32_t
 // Stream Read
 //--------------------------------------------------------------------+
 
-uint32_t tu_edpt_stream_read_xfer(tu_edpt_stream_t* s)
+// reserved: bytes received in the other buffer (double buffered) which are not yet written to fifo
+static uint32_t stream_read_xfer(tu_edpt_stream_t* s, uint16_t reserved)
 {
   uint16_t available = tu_fifo_remaining(&s->ff);
+  available = (available > reserved) ? (uint16_t) (available - reserved) : 0;
 
   // Prepare for incoming data but only allow what we can store in the ring buffer.
   // TODO Actually we can still carry out the transfer, keeping count of received bytes
@@ -387,6 +389,7 @@ uint32_t tu_edpt_stream_read_xfer(tu_edpt_stream_t* s)
 
   // get available again since fifo can be changed before endpoint is claimed
   available = tu_fifo_remaining(&s->ff);
+  available = (available > reserved) ? (uint16_t) (available - reserved) : 0;
 
   if ( available >= s->ep_packetsize )
   {
@@ -405,6 +408,27 @@ uint32_t tu_edpt_stream_read_xfer(tu_edpt_stream_t* s)
   }
 }
 
+uint32_t tu_edpt_stream_read_xfer(tu_edpt_stream_t* s)
+{
+  return stream_read_xfer(s, 0);
+}
+
+void tu_edpt_stream_read_xfer_complete_offset(tu_edpt_stream_t* s, uint32_t xferred_bytes, uint32_t skip_offset)
+{
+  uint8_t* const buf = s->ep_buf;
+  uint16_t const count = (skip_offset < xferred_bytes) ? (uint16_t) (xferred_bytes - skip_offset) : 0;
+
+  if ( s->ep_buf2 )
+  {
+    // swap buffers and keep endpoint busy while the received data is copied and consumed
+    s->ep_buf  = s->ep_buf2;
+    s->ep_buf2 = buf;
+    stream_read_xfer(s, count);
+  }
+
+  if ( count ) tu_fifo_write_n(&s->ff, buf + skip_offset, count);
+}
+
 uint32_t tu_edpt_stream_read(tu_edpt_stream_t* s, void* buffer, uint32_t bufsize)
 {
   uint32_t num_read = tu_fifo_read_n(&s->ff, buffer, (uint16_t) bufsize);
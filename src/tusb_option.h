@@ -433,6 +433,10 @@
   #define CFG_TUH_MEM_ALIGN   TU_ATTR_ALIGNED(4)
 #endif
 
+// CFG_TUH_MEM_POOL_SIZE: bytes shared by endpoint buffers of class drivers (HID, CDC), defaults in usbh.c to the worst
+// case of every CFG_TUH_HID and CFG_TUH_CDC interface opened at once. Memory is only saved by defining it smaller e.g
+// CFG_TUH_DEVICE_MAX times the buffers of a typical attached device, opening an interface fails once it is exhausted.
+
 //------------- CLASS -------------//
 
 #ifndef CFG_TUH_HUB
@@ -453,6 +457,16 @@
   #define CFG_TUH_CDC_CP210X 0
 #endif
 
+#ifndef CFG_TUH_CDC_CH34X
+  // CH34X is not part of CDC class, only to re-use CDC driver API
+  #define CFG_TUH_CDC_CH34X 0
+#endif
+
+#ifndef CFG_TUH_CDC_PL2303
+  // PL2303 is not part of CDC class, only to re-use CDC driver API
+  #define CFG_TUH_CDC_PL2303 0
+#endif
+
 #ifndef CFG_TUH_HID
 #define CFG_TUH_HID    0
 #endif
@@ -473,6 +487,27 @@
 #define CFG_TUH_API_EDPT_XFER 0
 #endif
 
+// Number of isochronous streams (tuh_iso_stream_start), requires HCD support
+#ifndef CFG_TUH_ISO_STREAM_MAX
+#define CFG_TUH_ISO_STREAM_MAX 0
+#endif
+
+// Number of devices whose strings are fetched concurrently by tuh_strings_get(), 0 to disable. Fetched strings of
+// every device are kept until it is unplugged.
+#ifndef CFG_TUH_STRINGS_FETCH_MAX
+#define CFG_TUH_STRINGS_FETCH_MAX 0
+#endif
+
+// Max UTF-8 bytes of a string returned by tuh_strings_get() including terminating null, longer ones are truncated
+#ifndef CFG_TUH_STRING_MAXLEN
+#define CFG_TUH_STRING_MAXLEN 32
+#endif
+
+// Preferred language of strings returned by tuh_strings_get(), the first one supported by device is used otherwise
+#ifndef CFG_TUH_STRING_LANGID
+#define CFG_TUH_STRING_LANGID 0x0409
+#endif
+
 // Enable PIO-USB software host controller
 #ifndef CFG_TUH_RPI_PIO_USB
 #define CFG_TUH_RPI_PIO_USB 0
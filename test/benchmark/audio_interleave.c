@@ -0,0 +1,139 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+// Throughput of the type I PCM interleaving kernels against the straightforward copy of one block per memcpy(), which
+// is what the kernels replace. Output of both is compared to check they are bit-exact.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define CFG_TUD_AUDIO                             1
+#define CFG_TUD_AUDIO_FUNC_1_DESC_LEN             0
+#define CFG_TUD_AUDIO_FUNC_1_N_AS_INT             1
+#define CFG_TUD_AUDIO_FUNC_1_CTRL_BUF_SZ          64
+#define CFG_TUD_AUDIO_ENABLE_EP_OUT               1
+#define CFG_TUD_AUDIO_ENABLE_DECODING             1
+#define CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING      1
+#define CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX        STREAM_SIZE
+#define CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ     STREAM_SIZE
+#define CFG_TUD_AUDIO_FUNC_1_N_RX_SUPP_SW_FIFO    N_FF
+#define CFG_TUD_AUDIO_FUNC_1_RX_SUPP_SW_FIFO_SZ   (BLOCK_SIZE_MAX * N_FRAMES)
+#define CFG_TUD_AUDIO_FUNC_1_CHANNEL_PER_FIFO_RX  1
+
+// 1 ms of 192 kHz audio, split over two support FIFOs
+#define N_FRAMES         192
+#define N_FF             2
+#define BLOCK_SIZE_MAX   (8 * 4)
+#define STREAM_SIZE      (N_FF * BLOCK_SIZE_MAX * N_FRAMES)
+#define ITERATIONS       20000
+
+#include "class/audio/audio_device.c"
+#include "usbd_fake.h"
+
+static uint8_t stream[STREAM_SIZE];
+static uint8_t stream_ref[STREAM_SIZE];
+static uint8_t fifo[N_FF][BLOCK_SIZE_MAX * N_FRAMES];
+static uint8_t fifo_ref[N_FF][BLOCK_SIZE_MAX * N_FRAMES];
+
+static double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+static void reference_copy(uint8_t * dst, uint16_t dst_step, uint8_t const * src, uint16_t src_step, uint16_t n_blocks,
+                           uint16_t block)
+{
+  for (uint16_t i = 0; i < n_blocks; i++)
+  {
+    memcpy(dst, src, block);
+    dst += dst_step;
+    src += src_step;
+  }
+}
+
+// Decode then encode the stream, return ns per 1 ms packet
+static double run(bool kernel, uint16_t block)
+{
+  uint16_t const frame = (uint16_t) (block * N_FF);
+  uint8_t (*ff)[BLOCK_SIZE_MAX * N_FRAMES] = kernel ? fifo : fifo_ref;
+  uint8_t* out = kernel ? stream : stream_ref;
+
+  double const start = now_ns();
+  for (uint32_t it = 0; it < ITERATIONS; it++)
+  {
+    for (uint8_t k = 0; k < N_FF; k++)
+    {
+      if (kernel)
+      {
+        audiod_interleaved_copy(ff[k], block, out + k * block, frame, N_FRAMES, block);
+        audiod_interleaved_copy(out + k * block, frame, ff[k], block, N_FRAMES, block);
+      }
+      else
+      {
+        reference_copy(ff[k], block, out + k * block, frame, N_FRAMES, block);
+        reference_copy(out + k * block, frame, ff[k], block, N_FRAMES, block);
+      }
+    }
+    // keep the compiler from merging iterations
+    __asm__ volatile("" ::: "memory");
+  }
+
+  return (now_ns() - start) / ITERATIONS;
+}
+
+int main(void)
+{
+  uint8_t const sample_sizes[] = { 2, 3, 4 };
+  uint8_t const channels[]     = { 2, 4, 8 };
+  int ret = 0;
+
+  printf("%u frames, %u FIFOs, decode + encode per packet\n", N_FRAMES, N_FF);
+  printf("bits  ch/FIFO  memcpy ns  kernel ns  speedup\n");
+
+  for (uint8_t s = 0; s < TU_ARRAY_SIZE(sample_sizes); s++)
+  {
+    for (uint8_t c = 0; c < TU_ARRAY_SIZE(channels); c++)
+    {
+      uint16_t const block = (uint16_t) (sample_sizes[s] * channels[c]);
+
+      for (uint32_t i = 0; i < sizeof(stream); i++) stream[i] = stream_ref[i] = (uint8_t) (i * 7 + 3);
+
+      double const ref_ns    = run(false, block);
+      double const kernel_ns = run(true, block);
+
+      bool const exact = (memcmp(stream, stream_ref, sizeof(stream)) == 0) && (memcmp(fifo, fifo_ref, sizeof(fifo)) == 0);
+      if (!exact) ret = 1;
+
+      printf("%4u  %7u  %9.0f  %9.0f  %6.2fx%s\n", sample_sizes[s] * 8, channels[c], ref_ns, kernel_ns,
+             ref_ns / kernel_ns, exact ? "" : "  MISMATCH");
+    }
+  }
+
+  return ret;
+}
@@ -0,0 +1,144 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+// All 16 cables stream SysEx as fast as the FIFOs allow while a timing clock is sent on cable 0 every 1 ms.
+// Each frame the host completes one full-speed IN transfer. Reports throughput, fairness among cables, clock latency
+// in frames and the CPU time spent by the driver per frame.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define CFG_TUD_MIDI                    1
+#define CFG_TUD_MIDI_CABLE_MAX          16
+#define CFG_TUD_MIDI_REALTIME_PRIORITY  1
+#define CFG_TUD_MIDI_RX_BUFSIZE         64
+#define CFG_TUD_MIDI_TX_BUFSIZE         64
+#define CFG_TUD_MIDI_EP_BUFSIZE         64
+
+#define FRAME_COUNT     100000
+#define EDPT_MIDI_OUT   0x01
+#define EDPT_MIDI_IN    0x81
+
+#include "class/midi/midi_device.c"
+#include "usbd_fake.h"
+
+static uint32_t clock_frame[FRAME_COUNT];
+
+static double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+// Host completes pending IN transfer, returns number of bytes and copies them into buf
+static uint16_t host_receive(uint8_t* buf)
+{
+  usbd_fake_edpt_t* ep = usbd_fake_edpt(EDPT_MIDI_IN);
+  if (!ep->busy) return 0;
+
+  uint16_t const len = ep->total_bytes;
+  if (len) memcpy(buf, ep->buffer, len);
+  ep->busy = false;
+  midid_xfer_cb(0, EDPT_MIDI_IN, XFER_RESULT_SUCCESS, len);
+
+  return len;
+}
+
+int main(void)
+{
+  uint8_t sysex[CFG_TUD_MIDI_TX_BUFSIZE];
+  uint32_t sent[CFG_TUD_MIDI_CABLE_MAX] = { 0 };
+  uint32_t pkt_count[CFG_TUD_MIDI_CABLE_MAX] = { 0 };
+  uint32_t total_bytes = 0;
+  uint32_t clock_sent = 0, clock_received = 0;
+  uint32_t latency_max = 0, latency_sum = 0;
+
+  midid_init();
+  midid_reset(0);
+
+  midid_interface_t* midi = &_midid_itf[0];
+  midi->ep_out = EDPT_MIDI_OUT;
+  midi->ep_in  = EDPT_MIDI_IN;
+
+  double const start = now_ns();
+
+  for(uint32_t frame=0; frame<FRAME_COUNT; frame++)
+  {
+    // Application: refill SysEx of all cables, sent data continues an endless SysEx
+    for(uint8_t cable=0; cable<CFG_TUD_MIDI_CABLE_MAX; cable++)
+    {
+      for(uint32_t i=0; i<sizeof(sysex); i++) sysex[i] = (uint8_t) ((sent[cable] + i) & 0x7F);
+      if (sent[cable] == 0) sysex[0] = 0xF0;
+      sent[cable] += tud_midi_n_stream_write(0, cable, sysex, sizeof(sysex));
+    }
+
+    uint8_t const clock = MIDI_STATUS_SYSREAL_TIMING_CLOCK;
+    if (tud_midi_n_stream_write(0, 0, &clock, 1) == 1) clock_frame[clock_sent++] = frame;
+
+    // Host: complete one transfer per frame
+    uint8_t buf[CFG_TUD_MIDI_EP_BUFSIZE];
+    uint16_t const len = host_receive(buf);
+    total_bytes += len;
+
+    for(uint16_t i=0; i<len; i+=4)
+    {
+      if (buf[i+1] == MIDI_STATUS_SYSREAL_TIMING_CLOCK && (buf[i] & 0x0F) == MIDI_CIN_1BYTE_DATA)
+      {
+        uint32_t const latency = frame - clock_frame[clock_received++];
+        latency_sum += latency;
+        if (latency > latency_max) latency_max = latency;
+      }
+      else
+      {
+        pkt_count[buf[i] >> 4]++;
+      }
+    }
+  }
+
+  double const ns_per_frame = (now_ns() - start) / FRAME_COUNT;
+
+  uint32_t pkt_min = UINT32_MAX, pkt_max = 0;
+  for(uint8_t cable=0; cable<CFG_TUD_MIDI_CABLE_MAX; cable++)
+  {
+    if (pkt_count[cable] < pkt_min) pkt_min = pkt_count[cable];
+    if (pkt_count[cable] > pkt_max) pkt_max = pkt_count[cable];
+  }
+
+  printf("%u frames, %u cables\n", FRAME_COUNT, CFG_TUD_MIDI_CABLE_MAX);
+  printf("throughput     %lu bytes/s\n", (unsigned long) ((uint64_t) total_bytes * 1000 / FRAME_COUNT));
+  printf("packets/cable  %lu .. %lu\n", (unsigned long) pkt_min, (unsigned long) pkt_max);
+  printf("clock latency  avg %.3f max %lu frames\n", (double) latency_sum / clock_received, (unsigned long) latency_max);
+  printf("cpu time       %.0f ns per frame\n", ns_per_frame);
+
+  // Endpoint is saturated, cables are served fairly and clock is never delayed by more than one frame
+  bool const ok = (clock_received == clock_sent - 1) && (pkt_max - pkt_min <= CFG_TUD_MIDI_EP_BUFSIZE / 4) &&
+                  (latency_max <= 1) && (total_bytes == FRAME_COUNT * CFG_TUD_MIDI_EP_BUFSIZE);
+  if (!ok) printf("FAILED\n");
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+#include "unity.h"
+
+// The converter is built as part of the audio device driver
+#define CFG_TUD_AUDIO                       1
+#define CFG_TUD_AUDIO_FUNC_1_DESC_LEN       0
+#define CFG_TUD_AUDIO_FUNC_1_N_AS_INT       1
+#define CFG_TUD_AUDIO_FUNC_1_CTRL_BUF_SZ    64
+#define CFG_TUD_AUDIO_ENABLE_ASRC           1
+
+#include "osal/osal.h"
+#include "tusb_fifo.h"
+#include "class/audio/audio_asrc.c"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+// 48 kHz stereo 16 bit, the host writes one packet per 1 ms frame, the application reads 1 ms blocks at its own clock
+#define SAMPLE_RATE      48000
+#define N_CHANNELS       2
+#define FRAME_SIZE       (N_CHANNELS * 2)
+#define FRAMES_PER_MS    (SAMPLE_RATE / 1000)
+#define FIFO_SIZE        (8 * FRAMES_PER_MS * FRAME_SIZE)
+#define AMPLITUDE        16000
+
+static uint8_t ff_buf[FIFO_SIZE];
+static tu_fifo_t ff;
+static audio_asrc_t asrc;
+
+// Sine generator running at the host's sample clock
+static double sine_s1, sine_s2;
+
+static int16_t sine_next(void)
+{
+  // s[n] = 2*cos(w)*s[n-1] - s[n-2], w = 2*pi*1kHz/48kHz
+  double const s = 2 * 0.99144486137381 * sine_s1 - sine_s2;
+  sine_s2 = sine_s1;
+  sine_s1 = s;
+  return (int16_t) s;
+}
+
+void setUp(void)
+{
+  tu_fifo_config(&ff, ff_buf, FIFO_SIZE, 1, false);
+  TEST_ASSERT(audio_asrc_config(&asrc, N_CHANNELS, 2, FIFO_SIZE / 2));
+
+  sine_s1 = 0;
+  sine_s2 = -AMPLITUDE * 0.13052619222005; // -A*sin(w)
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+// Run the host and the application for duration_ms with the host clock deviating by ppm
+// Returns the average conversion ratio in ppm over the last quarter of the run
+static int32_t run_drift(int32_t ppm, uint32_t duration_ms)
+{
+  double host_frames = 0;
+  bool started = false;
+  int16_t last = 0;
+  int64_t ratio_sum = 0;
+  uint32_t ratio_cnt = 0;
+  uint16_t lvl_min = UINT16_MAX, lvl_max = 0;
+
+  for (uint32_t ms = 0; ms < duration_ms; ms++)
+  {
+    // Host writes all frames of this USB frame
+    host_frames += FRAMES_PER_MS * (1.0 + ppm * 1e-6);
+    int16_t pkt[(FRAMES_PER_MS + 1) * N_CHANNELS];
+    uint16_t n_pkt = 0;
+    while (host_frames >= 1.0)
+    {
+      int16_t const s = sine_next();
+      pkt[n_pkt * N_CHANNELS]     = s;
+      pkt[n_pkt * N_CHANNELS + 1] = (int16_t) -s;
+      n_pkt++;
+      host_frames -= 1.0;
+    }
+    uint16_t const n_bytes = (uint16_t) (n_pkt * FRAME_SIZE);
+    TEST_ASSERT_EQUAL_MESSAGE(n_bytes, tu_fifo_write_n(&ff, pkt, n_bytes), "EP OUT FIFO overflow");
+
+    // Application reads one block
+    int16_t out[FRAMES_PER_MS * N_CHANNELS];
+    uint16_t const n_read = audio_asrc_read(&asrc, &ff, out, FRAMES_PER_MS);
+
+    if (!started)
+    {
+      started = (n_read != 0);
+      if (started) last = out[0];
+    }
+    else
+    {
+      TEST_ASSERT_EQUAL_MESSAGE(FRAMES_PER_MS, n_read, "EP OUT FIFO underrun");
+    }
+
+    for (uint16_t i = 0; i < n_read; i++)
+    {
+      // Both channels are converted identically apart from rounding
+      TEST_ASSERT_INT_WITHIN(2, -out[i * N_CHANNELS], out[i * N_CHANNELS + 1]);
+
+      // No dropped or repeated frames: a 1 kHz sine changes at most A*2*pi/48 per sample
+      TEST_ASSERT_INT_WITHIN(AMPLITUDE * 15 / 100, last, out[i * N_CHANNELS]);
+      last = out[i * N_CHANNELS];
+    }
+
+    if (ms >= duration_ms * 3 / 4)
+    {
+      ratio_sum += (int64_t) audio_asrc_get_ratio(&asrc) - (int64_t) AUDIO_ASRC_RATIO_ONE;
+      ratio_cnt++;
+
+      uint16_t const lvl = tu_fifo_count(&ff);
+      if (lvl < lvl_min) lvl_min = lvl;
+      if (lvl > lvl_max) lvl_max = lvl;
+    }
+  }
+
+  // Level is kept around the target, the remaining ripple is caused by packets arriving every 1 ms
+  TEST_ASSERT_GREATER_THAN(FIFO_SIZE / 4, lvl_min);
+  TEST_ASSERT_LESS_THAN(FIFO_SIZE * 3 / 4, lvl_max);
+
+  return (int32_t) (ratio_sum * 1000000 / (int64_t) ratio_cnt / (int64_t) AUDIO_ASRC_RATIO_ONE);
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+void test_config(void)
+{
+  TEST_ASSERT_FALSE(audio_asrc_config(&asrc, 0, 2, 256));
+  TEST_ASSERT_FALSE(audio_asrc_config(&asrc, CFG_TUD_AUDIO_ASRC_N_CHANNELS_MAX + 1, 2, 256));
+  TEST_ASSERT_FALSE(audio_asrc_config(&asrc, 2, 1, 256));
+  TEST_ASSERT_FALSE(audio_asrc_config(&asrc, 2, 5, 256));
+  TEST_ASSERT_TRUE(audio_asrc_config(&asrc, 2, 3, 256));
+}
+
+void test_wait_for_target_level(void)
+{
+  static uint8_t const zeros[FIFO_SIZE / 2] = { 0 };
+  int16_t buf[FRAMES_PER_MS * N_CHANNELS];
+
+  tu_fifo_write_n(&ff, zeros, FIFO_SIZE / 2 - FRAME_SIZE);
+  TEST_ASSERT_EQUAL(0, audio_asrc_read(&asrc, &ff, buf, FRAMES_PER_MS));
+
+  tu_fifo_write_n(&ff, zeros, FRAME_SIZE);
+  TEST_ASSERT_EQUAL(FRAMES_PER_MS, audio_asrc_read(&asrc, &ff, buf, FRAMES_PER_MS));
+}
+
+void test_passthrough(void)
+{
+  // Without drift the ratio stays at 1.0 and a ramp is reproduced exactly
+  int16_t in[FIFO_SIZE / 4];
+  for (uint16_t i = 0; i < TU_ARRAY_SIZE(in); i++) in[i] = (int16_t) (i * 10);
+  tu_fifo_write_n(&ff, in, sizeof(in));
+
+  int16_t out[FRAMES_PER_MS * N_CHANNELS];
+  TEST_ASSERT_EQUAL(FRAMES_PER_MS, audio_asrc_read(&asrc, &ff, out, FRAMES_PER_MS));
+  TEST_ASSERT_EQUAL_UINT32(AUDIO_ASRC_RATIO_ONE, audio_asrc_get_ratio(&asrc));
+  TEST_ASSERT_EQUAL_INT16_ARRAY(in, out, TU_ARRAY_SIZE(out));
+}
+
+void test_drift_none(void)
+{
+  TEST_ASSERT_INT_WITHIN(20, 0, run_drift(0, 60000));
+}
+
+void test_drift_plus_500ppm(void)
+{
+  TEST_ASSERT_INT_WITHIN(20, 500, run_drift(500, 60000));
+}
+
+void test_drift_minus_500ppm(void)
+{
+  TEST_ASSERT_INT_WITHIN(20, -500, run_drift(-500, 60000));
+}
@@ -0,0 +1,345 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "unity.h"
+
+// Audio driver is built with type I encoding and decoding and sample format conversion. The usbd API is faked by
+// usbd_fake, the conversion kernels and the coding functions are called directly.
+#define CFG_TUD_AUDIO                             1
+#define CFG_TUD_AUDIO_FUNC_1_DESC_LEN             0
+#define CFG_TUD_AUDIO_FUNC_1_N_AS_INT             1
+#define CFG_TUD_AUDIO_FUNC_1_CTRL_BUF_SZ          64
+#define CFG_TUD_AUDIO_ENABLE_EP_IN                1
+#define CFG_TUD_AUDIO_ENABLE_ENCODING             1
+#define CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING      1
+#define CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX         64
+#define CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ      64
+#define CFG_TUD_AUDIO_FUNC_1_N_TX_SUPP_SW_FIFO    1
+#define CFG_TUD_AUDIO_FUNC_1_TX_SUPP_SW_FIFO_SZ   128
+#define CFG_TUD_AUDIO_FUNC_1_CHANNEL_PER_FIFO_TX  2
+#define CFG_TUD_AUDIO_ENABLE_EP_OUT               1
+#define CFG_TUD_AUDIO_ENABLE_DECODING             1
+#define CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING      1
+#define CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX        64
+#define CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ     64
+#define CFG_TUD_AUDIO_FUNC_1_N_RX_SUPP_SW_FIFO    2
+#define CFG_TUD_AUDIO_FUNC_1_RX_SUPP_SW_FIFO_SZ   128
+#define CFG_TUD_AUDIO_FUNC_1_CHANNEL_PER_FIFO_RX  1
+#define CFG_TUD_AUDIO_ENABLE_TYPE_I_CONVERSION    1
+
+#include "osal/osal.h"
+#include "tusb_fifo.h"
+#include "class/audio/audio_device.c"
+#include "usbd_fake.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+static audiod_function_t* audio;
+static uint8_t out[4];
+
+void setUp(void)
+{
+  audiod_init();
+  audio = &_audiod_fct[0];
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+// Convert a single sample, result is in out[]
+static void convert(uint8_t dst_format, uint8_t src_format, void const* src, uint8_t options)
+{
+  memset(out, 0xAA, sizeof(out));
+  audiod_convert_blocks(out, 4, dst_format, (uint8_t const*) src, 4, src_format, 1, 1, options, &audio->dither_state);
+}
+
+static int16_t  out_i16(void) { return (int16_t) tu_unaligned_read16(out); }
+static int32_t  out_i32(void) { return (int32_t) tu_unaligned_read32(out); }
+static float    out_f32(void) { float f; memcpy(&f, out, 4); return f; }
+static uint32_t out_i24(void) { return out[0] | ((uint32_t) out[1] << 8) | ((uint32_t) out[2] << 16); }
+
+static int16_t  i16(int16_t v) { return v; }
+static int32_t  i32(int32_t v) { return v; }
+
+//--------------------------------------------------------------------+
+// Sample conversion
+//--------------------------------------------------------------------+
+
+void test_conv_format(void)
+{
+  // No conversion if the support FIFO format matches the subslot size, 8 bit subslots are never converted
+  TEST_ASSERT_EQUAL(AUDIO_SAMPLE_FORMAT_NATIVE,      audiod_conv_format(AUDIO_SAMPLE_FORMAT_NATIVE, 2));
+  TEST_ASSERT_EQUAL(AUDIO_SAMPLE_FORMAT_NATIVE,      audiod_conv_format(AUDIO_SAMPLE_FORMAT_INT16, 2));
+  TEST_ASSERT_EQUAL(AUDIO_SAMPLE_FORMAT_NATIVE,      audiod_conv_format(AUDIO_SAMPLE_FORMAT_INT24, 3));
+  TEST_ASSERT_EQUAL(AUDIO_SAMPLE_FORMAT_NATIVE,      audiod_conv_format(AUDIO_SAMPLE_FORMAT_INT32, 4));
+  TEST_ASSERT_EQUAL(AUDIO_SAMPLE_FORMAT_NATIVE,      audiod_conv_format(AUDIO_SAMPLE_FORMAT_FLOAT32, 1));
+  TEST_ASSERT_EQUAL(AUDIO_SAMPLE_FORMAT_INT24_IN_32, audiod_conv_format(AUDIO_SAMPLE_FORMAT_INT24_IN_32, 3));
+  TEST_ASSERT_EQUAL(AUDIO_SAMPLE_FORMAT_FLOAT32,     audiod_conv_format(AUDIO_SAMPLE_FORMAT_FLOAT32, 2));
+  TEST_ASSERT_EQUAL(AUDIO_SAMPLE_FORMAT_INT32,       audiod_conv_format(AUDIO_SAMPLE_FORMAT_INT32, 2));
+}
+
+void test_int16(void)
+{
+  int16_t v = 0x1234;
+  convert(AUDIO_SAMPLE_FORMAT_INT32, AUDIO_SAMPLE_FORMAT_INT16, &v, 0);
+  TEST_ASSERT_EQUAL_HEX32(0x12340000, out_i32());
+
+  convert(AUDIO_SAMPLE_FORMAT_INT24, AUDIO_SAMPLE_FORMAT_INT16, &v, 0);
+  TEST_ASSERT_EQUAL_HEX32(0x123400, out_i24());
+  TEST_ASSERT_EQUAL_HEX8(0xAA, out[3]);
+
+  v = i16(-0x8000);
+  convert(AUDIO_SAMPLE_FORMAT_INT24_IN_32, AUDIO_SAMPLE_FORMAT_INT16, &v, 0);
+  TEST_ASSERT_EQUAL_INT32(-0x800000, out_i32());
+
+  convert(AUDIO_SAMPLE_FORMAT_FLOAT32, AUDIO_SAMPLE_FORMAT_INT16, &v, 0);
+  TEST_ASSERT_EQUAL_FLOAT(-1.0f, out_f32());
+
+  v = 0x4000;
+  convert(AUDIO_SAMPLE_FORMAT_FLOAT32, AUDIO_SAMPLE_FORMAT_INT16, &v, 0);
+  TEST_ASSERT_EQUAL_FLOAT(0.5f, out_f32());
+}
+
+void test_int24(void)
+{
+  uint8_t const pos[3] = { 0x56, 0x34, 0x12 };
+  uint8_t const neg[3] = { 0x00, 0x00, 0x80 };
+
+  convert(AUDIO_SAMPLE_FORMAT_INT24_IN_32, AUDIO_SAMPLE_FORMAT_INT24, pos, 0);
+  TEST_ASSERT_EQUAL_HEX32(0x123456, out_i32());
+
+  convert(AUDIO_SAMPLE_FORMAT_INT24_IN_32, AUDIO_SAMPLE_FORMAT_INT24, neg, 0);
+  TEST_ASSERT_EQUAL_INT32(-0x800000, out_i32());
+
+  convert(AUDIO_SAMPLE_FORMAT_INT32, AUDIO_SAMPLE_FORMAT_INT24, pos, 0);
+  TEST_ASSERT_EQUAL_HEX32(0x12345600, out_i32());
+
+  // Truncated without dither
+  convert(AUDIO_SAMPLE_FORMAT_INT16, AUDIO_SAMPLE_FORMAT_INT24, pos, 0);
+  TEST_ASSERT_EQUAL_HEX16(0x1234, out_i16());
+  TEST_ASSERT_EQUAL_HEX16(0xAAAA, tu_unaligned_read16(out + 2));
+
+  convert(AUDIO_SAMPLE_FORMAT_FLOAT32, AUDIO_SAMPLE_FORMAT_INT24, neg, 0);
+  TEST_ASSERT_EQUAL_FLOAT(-1.0f, out_f32());
+
+  // 24 bit are exactly representable
+  convert(AUDIO_SAMPLE_FORMAT_FLOAT32, AUDIO_SAMPLE_FORMAT_INT24, pos, 0);
+  TEST_ASSERT_EQUAL_FLOAT(0x123456 / 8388608.0f, out_f32());
+}
+
+void test_int24_in_32(void)
+{
+  int32_t v = 0x123456;
+  convert(AUDIO_SAMPLE_FORMAT_INT24, AUDIO_SAMPLE_FORMAT_INT24_IN_32, &v, 0);
+  TEST_ASSERT_EQUAL_HEX32(0x123456, out_i24());
+
+  convert(AUDIO_SAMPLE_FORMAT_INT32, AUDIO_SAMPLE_FORMAT_INT24_IN_32, &v, 0);
+  TEST_ASSERT_EQUAL_HEX32(0x12345600, out_i32());
+
+  v = i32(-2);
+  convert(AUDIO_SAMPLE_FORMAT_INT16, AUDIO_SAMPLE_FORMAT_INT24_IN_32, &v, 0);
+  TEST_ASSERT_EQUAL_INT16(-1, out_i16());
+}
+
+void test_int24_in_32_saturate(void)
+{
+  // Exceeding 24 bit wraps around unless saturated
+  int32_t v = 0x01000001;
+  convert(AUDIO_SAMPLE_FORMAT_INT24, AUDIO_SAMPLE_FORMAT_INT24_IN_32, &v, 0);
+  TEST_ASSERT_EQUAL_HEX32(0x000001, out_i24());
+
+  convert(AUDIO_SAMPLE_FORMAT_INT24, AUDIO_SAMPLE_FORMAT_INT24_IN_32, &v, AUDIO_SAMPLE_CONVERSION_SATURATE);
+  TEST_ASSERT_EQUAL_HEX32(0x7FFFFF, out_i24());
+
+  v = i32(-0x900000);
+  convert(AUDIO_SAMPLE_FORMAT_INT24, AUDIO_SAMPLE_FORMAT_INT24_IN_32, &v, AUDIO_SAMPLE_CONVERSION_SATURATE);
+  TEST_ASSERT_EQUAL_HEX32(0x800000, out_i24());
+
+  convert(AUDIO_SAMPLE_FORMAT_INT16, AUDIO_SAMPLE_FORMAT_INT24_IN_32, &v, AUDIO_SAMPLE_CONVERSION_SATURATE);
+  TEST_ASSERT_EQUAL_INT16(-0x8000, out_i16());
+
+  // Values within range are not touched
+  v = i32(-0x800000);
+  convert(AUDIO_SAMPLE_FORMAT_INT32, AUDIO_SAMPLE_FORMAT_INT24_IN_32, &v, AUDIO_SAMPLE_CONVERSION_SATURATE);
+  TEST_ASSERT_EQUAL_INT32(INT32_MIN, out_i32());
+}
+
+void test_int32(void)
+{
+  int32_t v = 0x12345678;
+  convert(AUDIO_SAMPLE_FORMAT_INT16, AUDIO_SAMPLE_FORMAT_INT32, &v, 0);
+  TEST_ASSERT_EQUAL_HEX16(0x1234, out_i16());
+
+  convert(AUDIO_SAMPLE_FORMAT_INT24, AUDIO_SAMPLE_FORMAT_INT32, &v, 0);
+  TEST_ASSERT_EQUAL_HEX32(0x123456, out_i24());
+
+  convert(AUDIO_SAMPLE_FORMAT_INT24_IN_32, AUDIO_SAMPLE_FORMAT_INT32, &v, 0);
+  TEST_ASSERT_EQUAL_HEX32(0x123456, out_i32());
+
+  v = INT32_MIN;
+  convert(AUDIO_SAMPLE_FORMAT_FLOAT32, AUDIO_SAMPLE_FORMAT_INT32, &v, 0);
+  TEST_ASSERT_EQUAL_FLOAT(-1.0f, out_f32());
+
+  // Truncation is towards minus infinity
+  v = i32(-1);
+  convert(AUDIO_SAMPLE_FORMAT_INT16, AUDIO_SAMPLE_FORMAT_INT32, &v, 0);
+  TEST_ASSERT_EQUAL_INT16(-1, out_i16());
+}
+
+void test_float32(void)
+{
+  float v = 0.5f;
+  convert(AUDIO_SAMPLE_FORMAT_INT16, AUDIO_SAMPLE_FORMAT_FLOAT32, &v, 0);
+  TEST_ASSERT_EQUAL_HEX16(0x4000, out_i16());
+
+  v = -0.25f;
+  convert(AUDIO_SAMPLE_FORMAT_INT24, AUDIO_SAMPLE_FORMAT_FLOAT32, &v, 0);
+  TEST_ASSERT_EQUAL_HEX32(0xE00000, out_i24());
+
+  convert(AUDIO_SAMPLE_FORMAT_INT24_IN_32, AUDIO_SAMPLE_FORMAT_FLOAT32, &v, 0);
+  TEST_ASSERT_EQUAL_INT32(-0x200000, out_i32());
+
+  convert(AUDIO_SAMPLE_FORMAT_INT32, AUDIO_SAMPLE_FORMAT_FLOAT32, &v, 0);
+  TEST_ASSERT_EQUAL_INT32(-0x20000000, out_i32());
+}
+
+void test_float32_clip(void)
+{
+  // Full scale and beyond is clipped to the maximum of the integer format
+  float const in[]      = { 1.0f, 2.0f, INFINITY, -1.0f, -3.0f, -INFINITY, NAN };
+  int32_t const expect[] = { INT32_MAX, INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN, INT32_MIN, 0 };
+
+  for (uint8_t i = 0; i < TU_ARRAY_SIZE(in); i++)
+  {
+    convert(AUDIO_SAMPLE_FORMAT_INT32, AUDIO_SAMPLE_FORMAT_FLOAT32, &in[i], 0);
+    TEST_ASSERT_EQUAL_INT32(expect[i], out_i32());
+
+    convert(AUDIO_SAMPLE_FORMAT_INT16, AUDIO_SAMPLE_FORMAT_FLOAT32, &in[i], 0);
+    TEST_ASSERT_EQUAL_INT16((int16_t) (expect[i] >> 16), out_i16());
+  }
+}
+
+void test_dither(void)
+{
+  // Half an LSB of int16: truncation always rounds down, dithering rounds up half of the time on average
+  int32_t const v = 0x12348000;
+  uint32_t n_up = 0;
+
+  for (uint32_t i = 0; i < 10000; i++)
+  {
+    convert(AUDIO_SAMPLE_FORMAT_INT16, AUDIO_SAMPLE_FORMAT_INT32, &v, AUDIO_SAMPLE_CONVERSION_DITHER);
+    TEST_ASSERT_TRUE(out_i16() == 0x1234 || out_i16() == 0x1235);
+    if (out_i16() == 0x1235) n_up++;
+  }
+  TEST_ASSERT_UINT32_WITHIN(200, 5000, n_up);
+
+  // Dither saturates instead of wrapping around at full scale
+  int32_t const max = INT32_MAX;
+  for (uint32_t i = 0; i < 100; i++)
+  {
+    convert(AUDIO_SAMPLE_FORMAT_INT16, AUDIO_SAMPLE_FORMAT_INT32, &max, AUDIO_SAMPLE_CONVERSION_DITHER);
+    TEST_ASSERT_EQUAL_INT16(INT16_MAX, out_i16());
+  }
+
+  // No dither if bit depth is not reduced
+  int16_t const v16 = 0x1234;
+  convert(AUDIO_SAMPLE_FORMAT_INT32, AUDIO_SAMPLE_FORMAT_INT16, &v16, AUDIO_SAMPLE_CONVERSION_DITHER);
+  TEST_ASSERT_EQUAL_HEX32(0x12340000, out_i32());
+}
+
+//--------------------------------------------------------------------+
+// Coding with conversion
+//--------------------------------------------------------------------+
+
+void test_decode_format_change(void)
+{
+  // Streaming 16 bit stereo, one FIFO per channel
+  audio->ep_out               = 0x01;
+  audio->n_channels_rx        = 2;
+  audio->n_bytes_per_sampe_rx = 2;
+  audio->n_ff_used_rx         = 2;
+  audiod_config_rx_supp_ff(audio);
+
+  // Change is only applied by the driver
+  TEST_ASSERT_TRUE(tud_audio_n_set_rx_support_ff_format(0, AUDIO_SAMPLE_FORMAT_FLOAT32, 0));
+  TEST_ASSERT_EQUAL(AUDIO_SAMPLE_FORMAT_NATIVE, audio->ff_conv_format_rx);
+  TEST_ASSERT_EQUAL(2, audio->n_bytes_per_sample_ff_rx);
+
+  int16_t const samples[] = { 0x4000, -0x4000, -0x8000, 0x2000, 0, 0x1000 };
+  memcpy(audio->lin_buf_out, samples, sizeof(samples));
+  TEST_ASSERT_TRUE(audiod_decode_type_I_pcm(0, audio, sizeof(samples)));
+
+  TEST_ASSERT_FALSE(audio->ff_format_changed_rx);
+  TEST_ASSERT_EQUAL(AUDIO_SAMPLE_FORMAT_FLOAT32, audio->ff_conv_format_rx);
+  TEST_ASSERT_EQUAL(4, audio->n_bytes_per_sample_ff_rx);
+
+  for (uint8_t ch = 0; ch < 2; ch++)
+  {
+    float f[3];
+    TEST_ASSERT_EQUAL(sizeof(f), tu_fifo_count(&audio->rx_supp_ff[ch]));
+    tu_fifo_read_n(&audio->rx_supp_ff[ch], f, sizeof(f));
+    for (uint8_t i = 0; i < 3; i++) TEST_ASSERT_EQUAL_FLOAT(samples[2 * i + ch] / 32768.0f, f[i]);
+  }
+}
+
+void test_encode_format_change(void)
+{
+  // Streaming 16 bit stereo from a single FIFO
+  audio->ep_in                = 0x81;
+  audio->ep_in_sz             = CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX;
+  audio->n_channels_tx        = 2;
+  audio->n_bytes_per_sampe_tx = 2;
+  audio->n_ff_used_tx         = 1;
+  audiod_config_tx_supp_ff(audio);
+
+  int16_t const native[] = { 1, 2 };
+  tu_fifo_write_n(&audio->tx_supp_ff[0], native, sizeof(native));
+
+  // Change is applied before the next packet is encoded, FIFO content of the old format is dropped
+  TEST_ASSERT_TRUE(tud_audio_n_set_tx_support_ff_format(0, AUDIO_SAMPLE_FORMAT_INT32, 0));
+  TEST_ASSERT_EQUAL(sizeof(native), tu_fifo_count(&audio->tx_supp_ff[0]));
+  TEST_ASSERT_EQUAL(0, audiod_encode_type_I_pcm(0, audio));
+  TEST_ASSERT_FALSE(audio->ff_format_changed_tx);
+  TEST_ASSERT_EQUAL(AUDIO_SAMPLE_FORMAT_INT32, audio->ff_conv_format_tx);
+
+  // Trailing half frame is kept within the FIFO
+  int32_t const samples[] = { 0x12345678, -0x40000000, 0x7FFFFFFF, INT32_MIN, 0x55550000 };
+  tu_fifo_write_n(&audio->tx_supp_ff[0], samples, sizeof(samples));
+  TEST_ASSERT_EQUAL(4 * 2, audiod_encode_type_I_pcm(0, audio));
+  TEST_ASSERT_EQUAL(4, tu_fifo_count(&audio->tx_supp_ff[0]));
+
+  int16_t const expect[] = { 0x1234, -0x4000, 0x7FFF, -0x8000 };
+  TEST_ASSERT_EQUAL_MEMORY(expect, audio->lin_buf_in, sizeof(expect));
+}
@@ -0,0 +1,170 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+
+// Audio driver is built with one OUT endpoint and type I decoding into support FIFOs, which enables the interleaving
+// kernels shared by encoding and decoding. The usbd API is faked by usbd_fake, the kernels are called directly.
+#define CFG_TUD_AUDIO                             1
+#define CFG_TUD_AUDIO_FUNC_1_DESC_LEN             0
+#define CFG_TUD_AUDIO_FUNC_1_N_AS_INT             1
+#define CFG_TUD_AUDIO_FUNC_1_CTRL_BUF_SZ          64
+#define CFG_TUD_AUDIO_ENABLE_EP_OUT               1
+#define CFG_TUD_AUDIO_ENABLE_DECODING             1
+#define CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING      1
+#define CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX        STREAM_SIZE
+#define CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ     STREAM_SIZE
+#define CFG_TUD_AUDIO_FUNC_1_N_RX_SUPP_SW_FIFO    N_FF_MAX
+#define CFG_TUD_AUDIO_FUNC_1_RX_SUPP_SW_FIFO_SZ   (BLOCK_SIZE_MAX * N_BLOCKS)
+#define CFG_TUD_AUDIO_FUNC_1_CHANNEL_PER_FIFO_RX  1
+
+// Odd number of blocks to cover the tail of the two blocks per iteration loop
+#define N_BLOCKS         7
+#define N_FF_MAX         3
+#define BLOCK_SIZE_MAX   (8 * 4)
+#define STREAM_SIZE      (N_FF_MAX * BLOCK_SIZE_MAX * N_BLOCKS)
+
+#include "osal/osal.h"
+#include "tusb_fifo.h"
+#include "class/audio/audio_device.c"
+#include "usbd_fake.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+// Buffers get one spare byte in front to check unaligned layouts too
+static uint8_t stream[STREAM_SIZE + 1];
+static uint8_t fifo[N_FF_MAX][BLOCK_SIZE_MAX * N_BLOCKS + 1];
+static uint8_t expected[STREAM_SIZE + 1];
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+// Byte j of the block of FIFO k within audio frame f
+static uint8_t pattern(uint16_t f, uint8_t k, uint16_t j)
+{
+  return (uint8_t) (f * 31 + k * 7 + j + 1);
+}
+
+// Stream is laid out as audio frames, each one holding a block of n_channels_per_ff samples of every FIFO in turn
+static void check_layout(uint8_t n_bytes_per_sample, uint8_t n_channels_per_ff, uint8_t n_ff, uint8_t offset)
+{
+  uint16_t const block = (uint16_t) (n_bytes_per_sample * n_channels_per_ff);
+  uint16_t const frame = (uint16_t) (block * n_ff);
+  uint16_t const total = (uint16_t) (frame * N_BLOCKS);
+  uint8_t* const s = stream + offset;
+
+  char msg[64];
+  snprintf(msg, sizeof(msg), "%u bytes, %u channels per FIFO, %u FIFOs, offset %u",
+           n_bytes_per_sample, n_channels_per_ff, n_ff, offset);
+
+  for (uint16_t f = 0; f < N_BLOCKS; f++)
+  {
+    for (uint8_t k = 0; k < n_ff; k++)
+    {
+      for (uint16_t j = 0; j < block; j++) expected[f * frame + k * block + j] = pattern(f, k, j);
+    }
+  }
+
+  // Decoding: every FIFO gets its blocks back to back
+  memcpy(s, expected, total);
+  for (uint8_t k = 0; k < n_ff; k++)
+  {
+    uint8_t* const dst = fifo[k] + offset;
+    memset(fifo[k], 0xAA, sizeof(fifo[k]));
+
+    uint8_t* const src_end = audiod_interleaved_copy_bytes_fast_decode(block, dst, dst + N_BLOCKS * block, s + k * block, n_ff);
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(s + k * block + total, src_end, msg);
+
+    for (uint16_t f = 0; f < N_BLOCKS; f++)
+    {
+      for (uint16_t j = 0; j < block; j++) TEST_ASSERT_EQUAL_HEX8_MESSAGE(pattern(f, k, j), dst[f * block + j], msg);
+    }
+
+    // nothing beyond the last block is touched
+    if (N_BLOCKS * block + offset < (int) sizeof(fifo[k])) TEST_ASSERT_EQUAL_HEX8_MESSAGE(0xAA, dst[N_BLOCKS * block], msg);
+  }
+
+  // Encoding: blocks of every FIFO are interleaved into the stream, bytes of the other FIFOs are kept
+  memset(stream, 0xAA, sizeof(stream));
+  for (uint8_t k = 0; k < n_ff; k++)
+  {
+    audiod_interleaved_copy(s + k * block, frame, fifo[k] + offset, block, N_BLOCKS, block);
+
+    for (uint16_t i = 0; i < total; i++)
+    {
+      bool const written = ((i % frame) / block) <= k;
+      TEST_ASSERT_EQUAL_HEX8_MESSAGE(written ? expected[i] : 0xAA, s[i], msg);
+    }
+  }
+  if (total + offset < (int) sizeof(stream)) TEST_ASSERT_EQUAL_HEX8_MESSAGE(0xAA, s[total], msg);
+}
+
+static void check_sample_size(uint8_t n_bytes_per_sample)
+{
+  // 1, 2 and several channels per FIFO, several ones fall back to memcpy() per block for unusual block sizes
+  uint8_t const channels[] = { 1, 2, 3, 4, 6, 8 };
+
+  for (uint8_t c = 0; c < TU_ARRAY_SIZE(channels); c++)
+  {
+    for (uint8_t n_ff = 1; n_ff <= N_FF_MAX; n_ff++)
+    {
+      check_layout(n_bytes_per_sample, channels[c], n_ff, 0);
+      check_layout(n_bytes_per_sample, channels[c], n_ff, 1);
+    }
+  }
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+void test_interleave_16bit(void)
+{
+  check_sample_size(2);
+}
+
+void test_interleave_24bit(void)
+{
+  check_sample_size(3);
+}
+
+void test_interleave_32bit(void)
+{
+  check_sample_size(4);
+}
@@ -0,0 +1,216 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+#include "unity.h"
+
+// Audio driver is built with one OUT endpoint and feedback endpoint without decoding, the FIFO count feedback
+// method works on the EP OUT FIFO. The usbd API is faked by usbd_fake, the controller is driven directly.
+#define CFG_TUD_AUDIO                       1
+#define CFG_TUD_AUDIO_FUNC_1_DESC_LEN       0
+#define CFG_TUD_AUDIO_FUNC_1_N_AS_INT       1
+#define CFG_TUD_AUDIO_FUNC_1_CTRL_BUF_SZ    64
+#define CFG_TUD_AUDIO_ENABLE_EP_OUT         1
+#define CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP    1
+#define CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX  ((SAMPLE_RATE / 1000 + 1) * FRAME_SIZE)
+#define CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ FIFO_SIZE
+
+// 48 kHz stereo 16 bit, the host sends one packet per 1 ms frame (full speed) or 125 us microframe (high speed)
+#define SAMPLE_RATE      48000
+#define N_CHANNELS       2
+#define FRAME_SIZE       (N_CHANNELS * 2)
+#define FRAMES_PER_MS    (SAMPLE_RATE / 1000)
+#define FIFO_SIZE        (8 * FRAMES_PER_MS * FRAME_SIZE)
+
+#include "osal/osal.h"
+#include "tusb_fifo.h"
+#include "class/audio/audio_device.c"
+#include "usbd_fake.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+static audiod_function_t* audio;
+static CFG_TUSB_MEM_ALIGN uint8_t ff_buf[FIFO_SIZE];
+static uint8_t n_packets_per_sof; // 1 for full speed, 8 microframes for high speed
+
+// Feedback value is in samples per frame (full speed) or per microframe (high speed), see audiod_set_interface()
+static void config_speed(tusb_speed_t speed)
+{
+  uint32_t const frame_div = (speed == TUSB_SPEED_FULL) ? 1000 : 8000;
+  n_packets_per_sof = (uint8_t) (frame_div / 1000);
+
+  audio->feedback.min_value      = (SAMPLE_RATE/frame_div - 1) << 16;
+  audio->feedback.max_value      = (SAMPLE_RATE/frame_div + 1) << 16;
+  audio->feedback.compute_method = AUDIO_FEEDBACK_METHOD_FIFO_COUNT;
+  TEST_ASSERT_TRUE(set_fb_params_fifo_count(audio, SAMPLE_RATE, frame_div, 0));
+}
+
+void setUp(void)
+{
+  audio = &_audiod_fct[0];
+  tu_memclr(audio, sizeof(audiod_function_t));
+
+  tu_fifo_config(&audio->ep_out_ff, ff_buf, FIFO_SIZE, 1, false);
+  config_speed(TUSB_SPEED_FULL);
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+// Run the host and the application for duration_ms with the device clock deviating by ppm from the host (SOF) clock.
+// The host sends as many samples per (micro)frame as the feedback value asks for, the application starts reading 1 ms
+// blocks at its own clock once the FIFO reached the target level. The controller is updated every SOF i.e. 1 ms.
+// Returns the average deviation of the feedback value from nominal in ppm over the last quarter of the run
+static int32_t run_drift(int32_t ppm, uint32_t duration_ms)
+{
+  uint8_t buf[(FRAMES_PER_MS + 2) * FRAME_SIZE];
+  uint32_t feedback = audio->feedback.compute.fifo_count.nominal_value;
+  uint32_t host_acc = 0; // 16.16 samples owed by host
+  double dev_frames = 0;
+  bool started = false;
+  int64_t fb_sum = 0;
+  uint32_t fb_cnt = 0;
+  uint16_t lvl_min = UINT16_MAX, lvl_max = 0;
+
+  tu_memclr(buf, sizeof(buf));
+
+  for (uint32_t ms = 0; ms < duration_ms; ms++)
+  {
+    // Host sends one packet per (micro)frame according to the last feedback value
+    for (uint8_t p = 0; p < n_packets_per_sof; p++)
+    {
+      host_acc += feedback;
+      uint16_t const n_bytes = (uint16_t) ((host_acc >> 16) * FRAME_SIZE);
+      host_acc &= 0xFFFF;
+      TEST_ASSERT_EQUAL_MESSAGE(n_bytes, tu_fifo_write_n(&audio->ep_out_ff, buf, n_bytes), "EP OUT FIFO overflow");
+    }
+
+    // Application consumes at the device clock
+    started = started || (tu_fifo_count(&audio->ep_out_ff) >= FIFO_SIZE / 2);
+    if (started)
+    {
+      dev_frames += FRAMES_PER_MS * (1.0 + ppm * 1e-6);
+      uint16_t const n_read = (uint16_t) dev_frames * FRAME_SIZE;
+      dev_frames -= (uint16_t) dev_frames;
+      TEST_ASSERT_EQUAL_MESSAGE(n_read, tu_fifo_read_n(&audio->ep_out_ff, buf, n_read), "EP OUT FIFO underrun");
+    }
+
+    // SOF
+    feedback = audiod_fb_fifo_count_update(audio);
+    TEST_ASSERT_LESS_OR_EQUAL(audio->feedback.max_value, feedback);
+    TEST_ASSERT_GREATER_OR_EQUAL(audio->feedback.min_value, feedback);
+
+    if (ms >= duration_ms * 3 / 4)
+    {
+      fb_sum += (int64_t) feedback - (int64_t) audio->feedback.compute.fifo_count.nominal_value;
+      fb_cnt++;
+
+      uint16_t const lvl = tu_fifo_count(&audio->ep_out_ff);
+      if (lvl < lvl_min) lvl_min = lvl;
+      if (lvl > lvl_max) lvl_max = lvl;
+    }
+  }
+
+  // Level is kept around the target, the remaining ripple is caused by whole frames being sent and read
+  TEST_ASSERT_INT_WITHIN(4 * FRAME_SIZE, FIFO_SIZE / 2, lvl_min);
+  TEST_ASSERT_INT_WITHIN(4 * FRAME_SIZE, FIFO_SIZE / 2, lvl_max);
+
+  return (int32_t) (fb_sum * 1000000 / (int64_t) fb_cnt / (int64_t) audio->feedback.compute.fifo_count.nominal_value);
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+void test_fifo_count_params(void)
+{
+  TEST_ASSERT_EQUAL_UINT32(FRAMES_PER_MS << 16, audio->feedback.compute.fifo_count.nominal_value);
+  TEST_ASSERT_EQUAL(FIFO_SIZE / 2, audio->feedback.compute.fifo_count.fifo_lvl_thr);
+
+  // threshold must be within the FIFO, feedback computation is disabled otherwise
+  TEST_ASSERT_FALSE(set_fb_params_fifo_count(audio, SAMPLE_RATE, 1000, FIFO_SIZE));
+  TEST_ASSERT_EQUAL(AUDIO_FEEDBACK_METHOD_DISABLED, audio->feedback.compute_method);
+
+  // high speed: samples per microframe
+  config_speed(TUSB_SPEED_HIGH);
+  TEST_ASSERT_EQUAL_UINT32((SAMPLE_RATE / 8000) << 16, audio->feedback.compute.fifo_count.nominal_value);
+}
+
+void test_fifo_count_nominal(void)
+{
+  // FIFO at target level, feedback stays at nominal value
+  uint8_t buf[FIFO_SIZE / 2] = { 0 };
+  tu_fifo_write_n(&audio->ep_out_ff, buf, FIFO_SIZE / 2);
+  for (uint32_t i = 0; i < 100; i++)
+  {
+    TEST_ASSERT_EQUAL_UINT32(FRAMES_PER_MS << 16, audiod_fb_fifo_count_update(audio));
+  }
+}
+
+void test_fifo_count_direction(void)
+{
+  // FIFO below target level: host is asked to send more, above: less
+  TEST_ASSERT_GREATER_THAN_UINT32(FRAMES_PER_MS << 16, audiod_fb_fifo_count_update(audio));
+
+  uint8_t buf[FIFO_SIZE] = { 0 };
+  tu_fifo_write_n(&audio->ep_out_ff, buf, FIFO_SIZE);
+  set_fb_params_fifo_count(audio, SAMPLE_RATE, 1000, 0);
+  TEST_ASSERT_LESS_THAN_UINT32(FRAMES_PER_MS << 16, audiod_fb_fifo_count_update(audio));
+}
+
+void test_drift_none(void)
+{
+  TEST_ASSERT_INT_WITHIN(5, 0, run_drift(0, 20000));
+}
+
+void test_drift_plus_500ppm(void)
+{
+  TEST_ASSERT_INT_WITHIN(5, 500, run_drift(500, 20000));
+}
+
+void test_drift_minus_500ppm(void)
+{
+  TEST_ASSERT_INT_WITHIN(5, -500, run_drift(-500, 20000));
+}
+
+void test_drift_high_speed_plus_500ppm(void)
+{
+  config_speed(TUSB_SPEED_HIGH);
+  TEST_ASSERT_INT_WITHIN(5, 500, run_drift(500, 20000));
+}
+
+void test_drift_high_speed_minus_500ppm(void)
+{
+  config_speed(TUSB_SPEED_HIGH);
+  TEST_ASSERT_INT_WITHIN(5, -500, run_drift(-500, 20000));
+}
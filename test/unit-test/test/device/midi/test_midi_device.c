@@ -0,0 +1,343 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+#include "unity.h"
+
+// MIDI driver is built with 16 cables and real-time priority, TX FIFOs of cables are sized down.
+// The usbd API is faked by usbd_fake, the host side is driven by the test.
+#define CFG_TUD_MIDI                    1
+#define CFG_TUD_MIDI_CABLE_MAX          16
+#define CFG_TUD_MIDI_REALTIME_PRIORITY  1
+#define CFG_TUD_MIDI_RX_BUFSIZE         64
+#define CFG_TUD_MIDI_TX_BUFSIZE         64
+#define CFG_TUD_MIDI_CABLE_TX_BUFSIZE   48
+#define CFG_TUD_MIDI_EP_BUFSIZE         64
+
+#include "osal/osal.h"
+#include "tusb_fifo.h"
+#include "class/midi/midi_device.c"
+#include "usbd_fake.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_MIDI_OUT = 0x01,
+  EDPT_MIDI_IN  = 0x81,
+};
+
+static midid_interface_t* midi;
+
+// Host sends packets to OUT endpoint
+static void host_send(uint8_t const* packets, uint16_t len)
+{
+  usbd_fake_edpt_t* ep = usbd_fake_edpt(EDPT_MIDI_OUT);
+  TEST_ASSERT_TRUE(ep->busy);
+  memcpy(ep->buffer, packets, len);
+  ep->busy = false;
+  midid_xfer_cb(0, EDPT_MIDI_OUT, XFER_RESULT_SUCCESS, len);
+}
+
+// Host completes pending IN transfer, returns number of bytes and copies them into buf
+static uint16_t host_receive(uint8_t* buf)
+{
+  usbd_fake_edpt_t* ep = usbd_fake_edpt(EDPT_MIDI_IN);
+  if (!ep->busy) return 0;
+
+  uint16_t const len = ep->total_bytes;
+  if (len) memcpy(buf, ep->buffer, len);
+  ep->busy = false;
+  midid_xfer_cb(0, EDPT_MIDI_IN, XFER_RESULT_SUCCESS, len);
+
+  return len;
+}
+
+// Keep IN endpoint busy by a dummy transfer such that everything written is queued
+static void hold_in_edpt(void)
+{
+  usbd_fake_edpt_t* ep = usbd_fake_edpt(EDPT_MIDI_IN);
+  ep->busy        = true;
+  ep->total_bytes = 0;
+}
+
+void setUp(void)
+{
+  usbd_fake_reset();
+
+  midid_init();
+  midid_reset(0);
+
+  midi = &_midid_itf[0];
+  midi->ep_out = EDPT_MIDI_OUT;
+  midi->ep_in  = EDPT_MIDI_IN;
+  _prep_out_transaction(midi);
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// RX
+//--------------------------------------------------------------------+
+
+void test_rx_per_cable(void)
+{
+  uint8_t const packets[] =
+  {
+    0x09, 0x90, 0x3C, 0x7F, // cable 0 note on
+    0x39, 0x91, 0x40, 0x7F, // cable 3 note on
+    0x08, 0x80, 0x3C, 0x00, // cable 0 note off
+    0xF9, 0x9F, 0x24, 0x64, // cable 15 note on
+  };
+  host_send(packets, sizeof(packets));
+
+  TEST_ASSERT_EQUAL(8, tud_midi_n_available(0, 0));
+  TEST_ASSERT_EQUAL(4, tud_midi_n_available(0, 3));
+  TEST_ASSERT_EQUAL(4, tud_midi_n_available(0, 15));
+  TEST_ASSERT_EQUAL(0, tud_midi_n_available(0, 1));
+
+  uint8_t buf[8];
+  TEST_ASSERT_EQUAL(3, tud_midi_n_stream_read(0, 3, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(packets + 5, buf, 3);
+
+  TEST_ASSERT_EQUAL(6, tud_midi_n_stream_read(0, 0, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(packets + 1, buf, 3);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(packets + 9, buf + 3, 3);
+
+  uint8_t packet[4];
+  TEST_ASSERT_TRUE(tud_midi_n_packet_read(0, packet));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(packets + 12, packet, 4);
+  TEST_ASSERT_FALSE(tud_midi_n_packet_read(0, packet));
+}
+
+void test_rx_realtime_first(void)
+{
+  uint8_t const packets[] =
+  {
+    0x14, 0xF0, 0x7E, 0x7F, // cable 1 SysEx start
+    0x14, 0x06, 0x01, 0x02, // cable 1 SysEx continue
+    0x1F, 0xF8, 0x00, 0x00, // cable 1 timing clock within SysEx
+    0x16, 0x03, 0xF7, 0x00, // cable 1 SysEx end
+  };
+  host_send(packets, sizeof(packets));
+
+  uint8_t packet[4];
+  TEST_ASSERT_TRUE(tud_midi_n_packet_read(0, packet));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(packets + 8, packet, 4);
+
+  uint8_t buf[16];
+  TEST_ASSERT_EQUAL(8, tud_midi_n_stream_read(0, 1, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(((uint8_t const[]) { 0xF0, 0x7E, 0x7F, 0x06, 0x01, 0x02, 0x03, 0xF7 }), buf, 8);
+}
+
+void test_rx_realtime_all_cables_first(void)
+{
+  uint8_t const packets[] =
+  {
+    0x09, 0x90, 0x3C, 0x7F, // cable 0 note on
+    0x4F, 0xFA, 0x00, 0x00, // cable 4 start
+    0x15, 0xFE, 0x00, 0x00, // cable 1 active sensing, encoded as single byte system common
+  };
+  host_send(packets, sizeof(packets));
+
+  // Real-time messages of all cables are delivered before any other packet
+  uint8_t packet[4];
+  TEST_ASSERT_TRUE(tud_midi_n_packet_read(0, packet));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(packets + 8, packet, 4);
+  TEST_ASSERT_TRUE(tud_midi_n_packet_read(0, packet));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(packets + 4, packet, 4);
+  TEST_ASSERT_TRUE(tud_midi_n_packet_read(0, packet));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(packets, packet, 4);
+}
+
+void test_rx_stream_cin(void)
+{
+  uint8_t const packets[] =
+  {
+    0x2C, 0xC2, 0x05, 0x00, // program change: 2 bytes
+    0x22, 0xF3, 0x01, 0x00, // song select: 2 bytes
+    0x23, 0xF2, 0x10, 0x20, // song position: 3 bytes
+    0x25, 0xF6, 0x00, 0x00, // tune request: 1 byte
+    0x20, 0x01, 0x02, 0x03, // reserved CIN 0: skipped
+    0x2F, 0xF8, 0x00, 0x00, // clock as single byte: 1 byte, goes first
+  };
+  host_send(packets, sizeof(packets));
+
+  uint8_t buf[16];
+  TEST_ASSERT_EQUAL(8, tud_midi_n_stream_read(0, 2, buf, 8));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(((uint8_t const[]) { 0xF8, 0xC2, 0x05, 0xF3, 0x01, 0xF2, 0x10, 0x20 }), buf, 8);
+
+  // Reading stops at the reserved packet which is dropped, bytes read so far are returned
+  TEST_ASSERT_EQUAL(1, tud_midi_n_stream_read(0, 2, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_HEX8(0xF6, buf[0]);
+  TEST_ASSERT_EQUAL(0, tud_midi_n_available(0, 2));
+  TEST_ASSERT_EQUAL(0, tud_midi_n_stream_read(0, 2, buf, sizeof(buf)));
+}
+
+void test_rx_remaining_gates_out_transfer(void)
+{
+  usbd_fake_edpt_t* ep_out = usbd_fake_edpt(EDPT_MIDI_OUT);
+
+  uint8_t const packets[] =
+  {
+    0x09, 0x90, 0x3C, 0x7F, // cable 0 note on
+    0x59, 0x95, 0x3C, 0x7F, // cable 5 note on
+  };
+  host_send(packets, sizeof(packets));
+
+  // Next transfer could carry packets of a single cable only, it needs room for a full buffer in every cable FIFO
+  TEST_ASSERT_FALSE(ep_out->busy);
+
+  uint8_t buf[3];
+  TEST_ASSERT_EQUAL(3, tud_midi_n_stream_read(0, 0, buf, sizeof(buf)));
+  TEST_ASSERT_FALSE(ep_out->busy);
+
+  TEST_ASSERT_EQUAL(3, tud_midi_n_stream_read(0, 5, buf, sizeof(buf)));
+  TEST_ASSERT_TRUE(ep_out->busy);
+}
+
+//--------------------------------------------------------------------+
+// TX
+//--------------------------------------------------------------------+
+
+void test_tx_realtime_within_sysex(void)
+{
+  hold_in_edpt();
+
+  uint8_t const sysex[] = { 0xF0, 0x7E, 0x7F, 0x06, 0xF8, 0x01, 0xF7 };
+  TEST_ASSERT_EQUAL(sizeof(sysex), tud_midi_n_stream_write(0, 2, sysex, sizeof(sysex)));
+
+  uint8_t buf[CFG_TUD_MIDI_EP_BUFSIZE];
+  TEST_ASSERT_EQUAL(0, host_receive(buf)); // completes the dummy transfer
+  TEST_ASSERT_EQUAL(12, host_receive(buf));
+
+  uint8_t const expected[] =
+  {
+    0x2F, 0xF8, 0x00, 0x00, // clock goes first
+    0x24, 0xF0, 0x7E, 0x7F,
+    0x27, 0x06, 0x01, 0xF7,
+  };
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buf, sizeof(expected));
+}
+
+void test_tx_round_robin(void)
+{
+  hold_in_edpt();
+
+  // Long SysEx on cable 0 must not delay the note on cable 5
+  uint8_t sysex[30];
+  sysex[0] = 0xF0;
+  for(uint8_t i=1; i<sizeof(sysex)-1; i++) sysex[i] = i;
+  sysex[sizeof(sysex)-1] = 0xF7;
+  TEST_ASSERT_EQUAL(sizeof(sysex), tud_midi_n_stream_write(0, 0, sysex, sizeof(sysex)));
+
+  uint8_t const note[] = { 0x95, 0x3C, 0x7F };
+  TEST_ASSERT_EQUAL(sizeof(note), tud_midi_n_stream_write(0, 5, note, sizeof(note)));
+
+  uint8_t buf[CFG_TUD_MIDI_EP_BUFSIZE];
+  host_receive(buf);
+  TEST_ASSERT_EQUAL(11*4, host_receive(buf));
+
+  TEST_ASSERT_EQUAL_HEX8(0x04, buf[0]);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(((uint8_t const[]) { 0x59, 0x95, 0x3C, 0x7F }), buf + 4, 4);
+}
+
+void test_tx_stream_cin(void)
+{
+  hold_in_edpt();
+
+  uint8_t const stream[] =
+  {
+    0xC3, 0x10,       // program change
+    0xF3, 0x01,       // song select
+    0xF2, 0x10, 0x20, // song position
+    0xF6,             // tune request
+    0x93, 0x3C, 0x7F, // note on
+    0xF8,             // clock
+  };
+  TEST_ASSERT_EQUAL(sizeof(stream), tud_midi_n_stream_write(0, 2, stream, sizeof(stream)));
+
+  uint8_t buf[CFG_TUD_MIDI_EP_BUFSIZE];
+  host_receive(buf);
+  TEST_ASSERT_EQUAL(6*4, host_receive(buf));
+
+  // Real-time message is sent first with CIN 0xF, other system messages keep their CIN
+  uint8_t const expected[] =
+  {
+    0x2F, 0xF8, 0x00, 0x00,
+    0x2C, 0xC3, 0x10, 0x00,
+    0x22, 0xF3, 0x01, 0x00,
+    0x23, 0xF2, 0x10, 0x20,
+    0x25, 0xF6, 0x00, 0x00,
+    0x29, 0x93, 0x3C, 0x7F,
+  };
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buf, sizeof(expected));
+}
+
+void test_tx_realtime_fifo_full(void)
+{
+  hold_in_edpt();
+
+  // Real-time FIFO holds 8 messages, further ones queue up behind the packets of their cable
+  uint8_t const note[] = { 0x91, 0x3C, 0x7F };
+  TEST_ASSERT_EQUAL(sizeof(note), tud_midi_n_stream_write(0, 1, note, sizeof(note)));
+
+  uint8_t clocks[CFG_TUD_MIDI_REALTIME_BUFSIZE / 4 + 2];
+  memset(clocks, MIDI_STATUS_SYSREAL_TIMING_CLOCK, sizeof(clocks));
+  TEST_ASSERT_EQUAL(sizeof(clocks), tud_midi_n_stream_write(0, 1, clocks, sizeof(clocks)));
+
+  uint8_t buf[CFG_TUD_MIDI_EP_BUFSIZE];
+  host_receive(buf);
+  TEST_ASSERT_EQUAL((sizeof(clocks) + 1) * 4, host_receive(buf));
+
+  uint8_t const clock[4] = { 0x1F, 0xF8, 0x00, 0x00 };
+  for (uint8_t i = 0; i < sizeof(clocks) + 1; i++)
+  {
+    if (i == sizeof(clocks) - 2) TEST_ASSERT_EQUAL_HEX8_ARRAY(((uint8_t const[]) { 0x19, 0x91, 0x3C, 0x7F }), buf + 4*i, 4);
+    else TEST_ASSERT_EQUAL_HEX8_ARRAY(clock, buf + 4*i, 4);
+  }
+}
+
+void test_tx_cable_bufsize(void)
+{
+  // RAM grows with the number of cables by the per cable size only
+  TEST_ASSERT_EQUAL(CFG_TUD_MIDI_CABLE_MAX * CFG_TUD_MIDI_CABLE_TX_BUFSIZE, sizeof(midi->tx_ff_buf));
+  TEST_ASSERT_EQUAL(CFG_TUD_MIDI_CABLE_MAX * CFG_TUD_MIDI_CABLE_RX_BUFSIZE, sizeof(midi->rx_ff_buf));
+
+  hold_in_edpt();
+
+  // SysEx fills the FIFO of its cable with 3 bytes per packet, other cables are not affected
+  uint8_t sysex[CFG_TUD_MIDI_CABLE_TX_BUFSIZE * 2];
+  memset(sysex, 0x11, sizeof(sysex));
+  sysex[0] = 0xF0;
+  TEST_ASSERT_EQUAL(CFG_TUD_MIDI_CABLE_TX_BUFSIZE / 4 * 3, tud_midi_n_stream_write(0, 7, sysex, sizeof(sysex)));
+  TEST_ASSERT_EQUAL(0, tud_midi_n_stream_write(0, 7, sysex + 1, 1));
+  TEST_ASSERT_EQUAL(CFG_TUD_MIDI_CABLE_TX_BUFSIZE / 4 * 3, tud_midi_n_stream_write(0, 8, sysex, sizeof(sysex)));
+}
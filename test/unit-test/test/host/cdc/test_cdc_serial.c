@@ -0,0 +1,1103 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+#include "unity.h"
+
+// CDC host is built on top of a fake usbh, which forwards requests to a register-level model of CH34x, PL2303 and
+// FTDI chips or an ACM device with their UART wired in loopback (TX to RX)
+#define CFG_TUSB_RHPORT0_MODE   (OPT_MODE_HOST | OPT_MODE_FULL_SPEED)
+#define CFG_TUH_CDC             1
+#define CFG_TUH_CDC_FTDI        1
+#define CFG_TUH_CDC_CH34X       1
+#define CFG_TUH_CDC_PL2303      1
+#define CFG_TUH_CDC_LINE_CONTROL_ON_ENUM 0x03 // DTR | RTS
+#define CFG_TUH_CDC_LINE_CODING_ON_ENUM  { 115200, CDC_LINE_CONDING_STOP_BITS_1, CDC_LINE_CODING_PARITY_NONE, 8 }
+
+#include "osal/osal.h"
+#include "tusb_fifo.h"
+#include "tusb.c"
+#include "class/cdc/cdc_host.c"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  DADDR        = 1,
+  LOOPBACK_MAX = 1024,
+  ACM_VID      = 0xCAFE,
+};
+
+typedef struct
+{
+  uint16_t vid;
+  uint16_t pid;
+  uint8_t  dev_class;
+  uint8_t  ep0_size;
+
+  // CH34x
+  uint8_t  version;
+  uint8_t  regs[256];
+  uint8_t  mcr;           // DTR/RTS bits, not inverted
+  uint8_t  msr;           // CTS/DSR/RI/DCD bits, not inverted
+
+  // PL2303
+  struct {
+    uint16_t reg;
+    uint16_t value;
+  } vendor_write[32];
+  uint8_t  vendor_write_count;
+  uint8_t  vendor_read_count;
+  uint8_t  line_coding[7];
+  uint8_t  control;
+  uint8_t  uart_state;    // also SerialState of ACM
+
+  // FTDI
+  uint16_t divisor;
+  uint8_t  ftdi_status[2]; // modem and line status preceding received data
+
+  bool     status_pending; // modem status change to report on interrupt endpoint (FTDI: bulk IN)
+
+  // ClearFeature(ENDPOINT_HALT)
+  uint8_t  clear_halt_ep;
+  uint8_t  clear_halt_count;
+
+  // UART loopback
+  uint8_t  loopback[LOOPBACK_MAX];
+  uint16_t loopback_count;
+} fake_dev_t;
+
+typedef struct
+{
+  bool     opened;
+  bool     busy;
+  bool     claimed;
+  uint8_t  xfer_type;
+  uint8_t* buffer;
+  uint16_t len;
+} fake_ep_t;
+
+static fake_dev_t dev;
+static fake_ep_t fake_ep[32];
+static uint8_t enum_buf[256];
+
+// usbh buffer pool, released when device is closed (tearDown)
+CFG_TUH_MEM_ALIGN static uint8_t pool_buf[1024];
+static uint16_t pool_used;
+static bool config_complete;
+
+static uint8_t  mounted_idx;
+static uint16_t app_state;
+static uint16_t app_changed;
+static uint8_t  app_state_count;
+
+// usbh_defer_func_ms() is invoked by timer_fire() if enabled, immediately otherwise
+static bool timer_enabled;
+static struct
+{
+  osal_task_func_t func;
+  void*            param;
+  uint32_t         delay_ms;
+} fake_timer;
+
+//--------------------------------------------------------------------+
+// Fake device
+//--------------------------------------------------------------------+
+
+static fake_ep_t* ep_get(uint8_t ep_addr)
+{
+  return &fake_ep[(tu_edpt_dir(ep_addr) << 4) | tu_edpt_number(ep_addr)];
+}
+
+// Return number of bytes of data stage, -1 to stall
+static int32_t fake_ch34x_request(tusb_control_request_t const* request, uint8_t* buffer)
+{
+  uint16_t const value = request->wValue;
+  uint16_t const index = request->wIndex;
+
+  switch ( request->bRequest )
+  {
+    case CH34X_REQ_READ_VERSION:
+      buffer[0] = dev.version;
+      buffer[1] = 0;
+      return 2;
+
+    case CH34X_REQ_SERIAL_INIT:
+      return 0;
+
+    case CH34X_REQ_WRITE_REG:
+      dev.regs[value & 0xff] = (uint8_t) (index & 0xff);
+      dev.regs[value >> 8]   = (uint8_t) (index >> 8);
+      return 0;
+
+    case CH34X_REQ_READ_REG:
+      buffer[0] = dev.regs[value & 0xff];
+      buffer[1] = dev.regs[value >> 8];
+      return 2;
+
+    case CH34X_REQ_MODEM_CTRL:
+      dev.mcr = (uint8_t) ~value & (CH34X_BIT_DTR | CH34X_BIT_RTS);
+      return 0;
+
+    default: return -1;
+  }
+}
+
+static int32_t fake_acm_request(tusb_control_request_t const* request, uint8_t* buffer)
+{
+  switch ( request->bRequest )
+  {
+    case CDC_REQUEST_SET_LINE_CODING:
+      memcpy(dev.line_coding, buffer, sizeof(dev.line_coding));
+      return 7;
+
+    case CDC_REQUEST_SET_CONTROL_LINE_STATE:
+      dev.control = (uint8_t) request->wValue;
+      return 0;
+
+    default: return -1;
+  }
+}
+
+static int32_t fake_ftdi_request(tusb_control_request_t const* request, uint8_t* buffer)
+{
+  (void) buffer;
+  TEST_ASSERT_EQUAL(TUSB_REQ_TYPE_VENDOR, request->bmRequestType_bit.type);
+
+  switch ( request->bRequest )
+  {
+    case FTDI_SIO_RESET:
+      return 0;
+
+    case FTDI_SIO_MODEM_CTRL:
+      // high byte enables change of DTR/RTS
+      TEST_ASSERT_EQUAL_HEX8(0x03, request->wValue >> 8);
+      dev.control = (uint8_t) request->wValue;
+      return 0;
+
+    case FTDI_SIO_SET_BAUD_RATE:
+      dev.divisor = request->wValue;
+      return 0;
+
+    default: return -1;
+  }
+}
+
+static int32_t fake_pl2303_request(tusb_control_request_t const* request, uint8_t* buffer)
+{
+  if ( request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR )
+  {
+    if ( request->bmRequestType_bit.direction == TUSB_DIR_IN )
+    {
+      dev.vendor_read_count++;
+      buffer[0] = 0;
+      return 1;
+    }
+
+    TEST_ASSERT_LESS_THAN(TU_ARRAY_SIZE(dev.vendor_write), dev.vendor_write_count);
+    dev.vendor_write[dev.vendor_write_count].reg   = request->wValue;
+    dev.vendor_write[dev.vendor_write_count].value = request->wIndex;
+    dev.vendor_write_count++;
+    return 0;
+  }
+
+  // class requests are the ones of ACM
+  return fake_acm_request(request, buffer);
+}
+
+static int32_t fake_request(tusb_control_request_t const* request, uint8_t* buffer)
+{
+  if ( request->bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD )
+  {
+    if ( request->bRequest == TUSB_REQ_CLEAR_FEATURE && request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_ENDPOINT )
+    {
+      TEST_ASSERT_EQUAL(TUSB_REQ_FEATURE_EDPT_HALT, request->wValue);
+      dev.clear_halt_ep = (uint8_t) request->wIndex;
+      dev.clear_halt_count++;
+      return 0;
+    }
+
+    if ( request->bRequest != TUSB_REQ_GET_DESCRIPTOR || (request->wValue >> 8) != TUSB_DESC_DEVICE ) return -1;
+
+    tusb_desc_device_t const desc_dev =
+    {
+      .bLength            = sizeof(tusb_desc_device_t),
+      .bDescriptorType    = TUSB_DESC_DEVICE,
+      .bcdUSB             = 0x0110,
+      .bDeviceClass       = dev.dev_class,
+      .bMaxPacketSize0    = dev.ep0_size,
+      .idVendor           = dev.vid,
+      .idProduct          = dev.pid,
+      .bcdDevice          = 0x0300,
+      .bNumConfigurations = 1
+    };
+
+    uint16_t const len = tu_min16(request->wLength, sizeof(desc_dev));
+    memcpy(buffer, &desc_dev, len);
+    return len;
+  }
+
+  switch ( dev.vid )
+  {
+    case TU_CH34X_VID : return fake_ch34x_request(request, buffer);
+    case TU_PL2303_VID: return fake_pl2303_request(request, buffer);
+    case TU_FTDI_VID  : return fake_ftdi_request(request, buffer);
+    default           : return fake_acm_request(request, buffer);
+  }
+}
+
+// Deliver completed transfers, return false if there is nothing to do
+static bool fake_task(void)
+{
+  // bulk OUT: UART transmits into loopback
+  for(uint8_t i=0; i<16; i++)
+  {
+    fake_ep_t* ep = &fake_ep[i];
+    if ( !ep->busy || ep->xfer_type != TUSB_XFER_BULK ) continue;
+
+    // ZLP is sent without buffer
+    TEST_ASSERT_LESS_OR_EQUAL(LOOPBACK_MAX, dev.loopback_count + ep->len);
+    if ( ep->len ) memcpy(dev.loopback + dev.loopback_count, ep->buffer, ep->len);
+    dev.loopback_count += ep->len;
+
+    ep->busy = false;
+    cdch_xfer_cb(DADDR, i, XFER_RESULT_SUCCESS, ep->len);
+    return true;
+  }
+
+  for(uint8_t i=16; i<32; i++)
+  {
+    fake_ep_t* ep = &fake_ep[i];
+    uint8_t const ep_addr = (uint8_t) (TUSB_DIR_IN_MASK | (i & 0x0f));
+    if ( !ep->busy ) continue;
+
+    bool const is_ftdi = (dev.vid == TU_FTDI_VID);
+
+    if ( ep->xfer_type == TUSB_XFER_BULK && (dev.loopback_count || (is_ftdi && dev.status_pending)) )
+    {
+      // bulk IN: UART receives from loopback, FTDI prepends modem and line status to every packet
+      uint16_t const offset = is_ftdi ? 2 : 0;
+      if ( is_ftdi )
+      {
+        memcpy(ep->buffer, dev.ftdi_status, 2);
+        dev.status_pending = false;
+      }
+
+      uint16_t const len = tu_min16(ep->len - offset, dev.loopback_count);
+      memcpy(ep->buffer + offset, dev.loopback, len);
+      memmove(dev.loopback, dev.loopback + len, dev.loopback_count - len);
+      dev.loopback_count -= len;
+
+      ep->busy = false;
+      cdch_xfer_cb(DADDR, ep_addr, XFER_RESULT_SUCCESS, offset + len);
+      return true;
+    }
+
+    if ( ep->xfer_type == TUSB_XFER_INTERRUPT && dev.status_pending )
+    {
+      uint16_t len;
+      tu_memclr(ep->buffer, ep->len);
+
+      if ( dev.vid == TU_CH34X_VID )
+      {
+        ep->buffer[0] = 0xE4;
+        ep->buffer[CH34X_STATUS_INDEX] = (uint8_t) ~dev.msr;
+        len = 4;
+      }else
+      {
+        // SerialState notification, PL2303 reports its UART state (with CTS in bit 7) the same way
+        ep->buffer[0] = 0xA1;
+        ep->buffer[1] = CDC_NOTIF_SERIAL_STATE;
+        ep->buffer[6] = 2;
+        ep->buffer[sizeof(tusb_control_request_t)] = dev.uart_state;
+        len = 10;
+      }
+
+      dev.status_pending = false;
+      ep->busy = false;
+      cdch_xfer_cb(DADDR, ep_addr, XFER_RESULT_SUCCESS, len);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void fake_run(void)
+{
+  for(uint32_t i=0; i<1000 && fake_task(); i++) {}
+}
+
+//--------------------------------------------------------------------+
+// Fake usbh
+//--------------------------------------------------------------------+
+
+bool tuh_init(uint8_t controller_id)
+{
+  (void) controller_id;
+  return true;
+}
+
+bool tuh_inited(void)
+{
+  return true;
+}
+
+bool tuh_vid_pid_get(uint8_t daddr, uint16_t* vid, uint16_t* pid)
+{
+  TEST_ASSERT_EQUAL(DADDR, daddr);
+  *vid = dev.vid;
+  *pid = dev.pid;
+  return true;
+}
+
+bool tuh_edpt_open(uint8_t daddr, tusb_desc_endpoint_t const * desc_ep)
+{
+  TEST_ASSERT_EQUAL(DADDR, daddr);
+  fake_ep_t* ep = ep_get(desc_ep->bEndpointAddress);
+  ep->opened    = true;
+  ep->xfer_type = desc_ep->bmAttributes.xfer;
+  return true;
+}
+
+bool tuh_control_xfer(tuh_xfer_t* xfer)
+{
+  TEST_ASSERT_EQUAL(DADDR, xfer->daddr);
+
+  tusb_control_request_t const* request = xfer->setup;
+  int32_t const len = fake_request(request, xfer->buffer);
+
+  tuh_xfer_t result = *xfer;
+  result.result     = (len < 0) ? XFER_RESULT_STALLED : XFER_RESULT_SUCCESS;
+  result.actual_len = (len < 0) ? 0 : (uint32_t) len;
+
+  if ( xfer->complete_cb )
+  {
+    xfer->complete_cb(&result);
+  }else if ( xfer->user_data )
+  {
+    // blocking
+    *((xfer_result_t*) xfer->user_data) = result.result;
+  }
+
+  return true;
+}
+
+bool tuh_descriptor_get_device(uint8_t daddr, void* buffer, uint16_t len, tuh_xfer_cb_t complete_cb, uintptr_t user_data)
+{
+  tusb_control_request_t const request =
+  {
+    .bmRequestType_bit =
+    {
+      .recipient = TUSB_REQ_RCPT_DEVICE,
+      .type      = TUSB_REQ_TYPE_STANDARD,
+      .direction = TUSB_DIR_IN
+    },
+    .bRequest = TUSB_REQ_GET_DESCRIPTOR,
+    .wValue   = TUSB_DESC_DEVICE << 8,
+    .wIndex   = 0,
+    .wLength  = len
+  };
+
+  tuh_xfer_t xfer =
+  {
+    .daddr       = daddr,
+    .ep_addr     = 0,
+    .setup       = &request,
+    .buffer      = buffer,
+    .complete_cb = complete_cb,
+    .user_data   = user_data
+  };
+
+  return tuh_control_xfer(&xfer);
+}
+
+uint8_t* usbh_get_enum_buf(uint8_t daddr)
+{
+  (void) daddr;
+  return enum_buf;
+}
+
+void* usbh_buf_alloc(uint8_t daddr, uint16_t size)
+{
+  TEST_ASSERT_EQUAL(DADDR, daddr);
+  size = (uint16_t) ((size + 3u) & ~3u);
+  if ( pool_used + size > sizeof(pool_buf) ) return NULL;
+
+  void* buf = &pool_buf[pool_used];
+  pool_used += size;
+  return buf;
+}
+
+void usbh_driver_set_config_complete(uint8_t daddr, uint8_t itf_num)
+{
+  TEST_ASSERT_EQUAL(DADDR, daddr);
+  // last interface of the function: ACM includes its data interface
+  TEST_ASSERT_EQUAL((dev.vid == ACM_VID) ? 1 : 0, itf_num);
+  config_complete = true;
+}
+
+bool usbh_defer_func_ms(osal_task_func_t func, void* param, uint32_t delay_ms)
+{
+  // no timer, serial state is reported immediately
+  if ( !timer_enabled ) return false;
+
+  TEST_ASSERT_NULL(fake_timer.func);
+  fake_timer.func     = func;
+  fake_timer.param    = param;
+  fake_timer.delay_ms = delay_ms;
+  return true;
+}
+
+void usbh_defer_func_cancel(osal_task_func_t func, void* param)
+{
+  if ( fake_timer.func == func && fake_timer.param == param ) fake_timer.func = NULL;
+}
+
+bool usbh_edpt_claim(uint8_t daddr, uint8_t ep_addr)
+{
+  (void) daddr;
+  fake_ep_t* ep = ep_get(ep_addr);
+  if ( ep->busy || ep->claimed ) return false;
+  ep->claimed = true;
+  return true;
+}
+
+bool usbh_edpt_release(uint8_t daddr, uint8_t ep_addr)
+{
+  (void) daddr;
+  ep_get(ep_addr)->claimed = false;
+  return true;
+}
+
+bool usbh_edpt_xfer_with_callback(uint8_t daddr, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes,
+                                  tuh_xfer_cb_t complete_cb, uintptr_t user_data)
+{
+  (void) daddr; (void) complete_cb; (void) user_data;
+  fake_ep_t* ep = ep_get(ep_addr);
+  TEST_ASSERT_TRUE(ep->opened && ep->claimed && !ep->busy);
+
+  ep->claimed = false;
+  ep->busy    = true;
+  ep->buffer  = buffer;
+  ep->len     = total_bytes;
+  return true;
+}
+
+void tuh_cdc_mount_cb(uint8_t idx)
+{
+  mounted_idx = idx;
+}
+
+void tuh_cdc_serial_state_cb(uint8_t idx, uint16_t state, uint16_t changed)
+{
+  TEST_ASSERT_EQUAL(mounted_idx, idx);
+  app_state    = state;
+  app_changed |= changed;
+  app_state_count++;
+}
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+// Baudrate the chip is running at, according to its registers
+static uint32_t ch34x_uart_baud(void)
+{
+  uint8_t const prescaler = dev.regs[CH34X_REG_PRESCALER];
+  uint8_t const ps        = prescaler & 0x03;
+  uint8_t const fact      = (prescaler >> 2) & 0x01;
+  uint32_t const div      = 256u - dev.regs[CH34X_REG_DIVISOR];
+
+  return CH34X_CLKRATE / (CH34X_CLK_DIV(ps, fact) * div);
+}
+
+static uint32_t pl2303_uart_baud(void)
+{
+  uint32_t const rate = tu_unaligned_read32(dev.line_coding);
+  if ( !(rate & PL2303_BAUD_DIVISOR) ) return rate;
+
+  uint32_t const mantissa = rate & 0x1ff;
+  uint32_t const exponent = (rate >> 9) & 0x07;
+  return (PL2303_BAUD_BASE / mantissa) >> (exponent << 1);
+}
+
+static uint8_t mount(uint16_t vid, uint16_t pid)
+{
+  static uint8_t const desc_ch34x[] =
+  {
+    9, TUSB_DESC_INTERFACE, 0, 0, 3, TUSB_CLASS_VENDOR_SPECIFIC, 0x01, 0x02, 0,
+    7, TUSB_DESC_ENDPOINT, 0x82, TUSB_XFER_BULK, U16_TO_U8S_LE(32), 0,
+    7, TUSB_DESC_ENDPOINT, 0x02, TUSB_XFER_BULK, U16_TO_U8S_LE(32), 0,
+    7, TUSB_DESC_ENDPOINT, 0x81, TUSB_XFER_INTERRUPT, U16_TO_U8S_LE(8), 1,
+  };
+
+  static uint8_t const desc_pl2303[] =
+  {
+    9, TUSB_DESC_INTERFACE, 0, 0, 3, TUSB_CLASS_VENDOR_SPECIFIC, 0x00, 0x00, 0,
+    7, TUSB_DESC_ENDPOINT, 0x81, TUSB_XFER_INTERRUPT, U16_TO_U8S_LE(10), 1,
+    7, TUSB_DESC_ENDPOINT, 0x02, TUSB_XFER_BULK, U16_TO_U8S_LE(64), 0,
+    7, TUSB_DESC_ENDPOINT, 0x83, TUSB_XFER_BULK, U16_TO_U8S_LE(64), 0,
+  };
+
+  static uint8_t const desc_ftdi[] =
+  {
+    9, TUSB_DESC_INTERFACE, 0, 0, 2, TUSB_CLASS_VENDOR_SPECIFIC, 0xff, 0xff, 0,
+    7, TUSB_DESC_ENDPOINT, 0x81, TUSB_XFER_BULK, U16_TO_U8S_LE(64), 0,
+    7, TUSB_DESC_ENDPOINT, 0x02, TUSB_XFER_BULK, U16_TO_U8S_LE(64), 0,
+  };
+
+  // control interface with header and ACM functional descriptors, followed by data interface
+  static uint8_t const desc_acm[] =
+  {
+    9, TUSB_DESC_INTERFACE, 0, 0, 1, TUSB_CLASS_CDC, CDC_COMM_SUBCLASS_ABSTRACT_CONTROL_MODEL, 0, 0,
+    5, TUSB_DESC_CS_INTERFACE, CDC_FUNC_DESC_HEADER, U16_TO_U8S_LE(0x0120),
+    4, TUSB_DESC_CS_INTERFACE, CDC_FUNC_DESC_ABSTRACT_CONTROL_MANAGEMENT, 0x02,
+    7, TUSB_DESC_ENDPOINT, 0x81, TUSB_XFER_INTERRUPT, U16_TO_U8S_LE(16), 16,
+    9, TUSB_DESC_INTERFACE, 1, 0, 2, TUSB_CLASS_CDC_DATA, 0, 0, 0,
+    7, TUSB_DESC_ENDPOINT, 0x02, TUSB_XFER_BULK, U16_TO_U8S_LE(64), 0,
+    7, TUSB_DESC_ENDPOINT, 0x83, TUSB_XFER_BULK, U16_TO_U8S_LE(64), 0,
+  };
+
+  dev.vid = vid;
+  dev.pid = pid;
+
+  uint8_t const* desc;
+  uint16_t desc_len;
+  switch ( vid )
+  {
+    case TU_CH34X_VID : desc = desc_ch34x ; desc_len = sizeof(desc_ch34x) ; break;
+    case TU_PL2303_VID: desc = desc_pl2303; desc_len = sizeof(desc_pl2303); break;
+    case TU_FTDI_VID  : desc = desc_ftdi  ; desc_len = sizeof(desc_ftdi)  ; break;
+    default           : desc = desc_acm   ; desc_len = sizeof(desc_acm)   ; break;
+  }
+
+  TEST_ASSERT_TRUE(cdch_open(0, DADDR, (tusb_desc_interface_t const*) desc, desc_len));
+  TEST_ASSERT_TRUE(cdch_set_config(DADDR, 0));
+  TEST_ASSERT_TRUE(config_complete);
+  TEST_ASSERT_TRUE(tuh_cdc_mounted(mounted_idx));
+
+  return mounted_idx;
+}
+
+static void loopback_check(uint8_t idx, uint16_t total)
+{
+  uint8_t tx[LOOPBACK_MAX];
+  uint8_t rx[LOOPBACK_MAX];
+  uint16_t rx_count = 0;
+
+  for(uint16_t i=0; i<total; i++) tx[i] = (uint8_t) (i*7 + 1);
+
+  uint16_t tx_count = 0;
+  while ( tx_count < total || rx_count < total )
+  {
+    if ( tx_count < total )
+    {
+      tx_count += (uint16_t) tuh_cdc_write(idx, tx + tx_count, total - tx_count);
+      tuh_cdc_write_flush(idx);
+    }
+
+    fake_run();
+    uint32_t const count = tuh_cdc_read(idx, rx + rx_count, sizeof(rx) - rx_count);
+    TEST_ASSERT_TRUE(count || tx_count < total || rx_count == total);
+    rx_count += (uint16_t) count;
+  }
+
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(tx, rx, total);
+}
+
+void setUp(void)
+{
+  tu_memclr(&dev, sizeof(dev));
+  tu_memclr(fake_ep, sizeof(fake_ep));
+  dev.version  = 0x31;
+  dev.ep0_size = 64;
+
+  config_complete = false;
+  mounted_idx     = TUSB_INDEX_INVALID_8;
+  app_state       = 0;
+  app_changed     = 0;
+  app_state_count = 0;
+  pool_used       = 0;
+  timer_enabled   = false;
+  tu_memclr(&fake_timer, sizeof(fake_timer));
+
+  cdch_init();
+}
+
+void tearDown(void)
+{
+  cdch_close(DADDR);
+}
+
+//--------------------------------------------------------------------+
+// CH34x
+//--------------------------------------------------------------------+
+
+void test_ch34x_mount(void)
+{
+  uint8_t const idx = mount(TU_CH34X_VID, 0x7523);
+
+  // line coding and control on enum
+  TEST_ASSERT_UINT32_WITHIN(115200/100, 115200, ch34x_uart_baud());
+  TEST_ASSERT_EQUAL_HEX8(CH34X_LCR_ENABLE_RX | CH34X_LCR_ENABLE_TX | CH34X_LCR_CS8, dev.regs[CH34X_REG_LCR]);
+  TEST_ASSERT_EQUAL_HEX8(CH34X_BIT_DTR | CH34X_BIT_RTS, dev.mcr);
+
+  // received data is not held back until a full packet
+  TEST_ASSERT_BITS_HIGH(CH34X_PRESCALER_NO_BUFFER, dev.regs[CH34X_REG_PRESCALER]);
+
+  cdc_line_coding_t line_coding;
+  TEST_ASSERT_TRUE(tuh_cdc_get_local_line_coding(idx, &line_coding));
+  TEST_ASSERT_EQUAL(115200, line_coding.bit_rate);
+  TEST_ASSERT_EQUAL(8, line_coding.data_bits);
+  TEST_ASSERT_EQUAL(CDC_LINE_CODING_PARITY_NONE, line_coding.parity);
+  TEST_ASSERT_EQUAL(CDC_LINE_CONDING_STOP_BITS_1, line_coding.stop_bits);
+  TEST_ASSERT_TRUE(tuh_cdc_connected(idx));
+}
+
+void test_ch34x_old_version(void)
+{
+  dev.version = 0x27;
+  mount(TU_CH34X_VID, 0x7523);
+
+  // no line control register, buffering bit is inverted
+  TEST_ASSERT_EQUAL_HEX8(0, dev.regs[CH34X_REG_LCR]);
+  TEST_ASSERT_BITS_LOW(CH34X_PRESCALER_NO_BUFFER, dev.regs[CH34X_REG_PRESCALER]);
+  TEST_ASSERT_UINT32_WITHIN(115200/100, 115200, ch34x_uart_baud());
+}
+
+void test_ch34x_baudrate(void)
+{
+  static uint32_t const rates[] =
+  {
+    50, 75, 110, 300, 1200, 2400, 4800, 9600, 14400, 19200, 38400, 57600, 115200, 128000, 230400, 250000,
+    460800, 500000, 921600, 1000000, 1500000, 2000000, 3000000
+  };
+
+  uint8_t const idx = mount(TU_CH34X_VID, 0x7523);
+
+  for(size_t i=0; i<TU_ARRAY_SIZE(rates); i++)
+  {
+    xfer_result_t result = XFER_RESULT_INVALID;
+    TEST_ASSERT_TRUE(tuh_cdc_set_baudrate(idx, rates[i], NULL, (uintptr_t) &result));
+    TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, result);
+
+    // within 2% is good enough for an UART
+    TEST_ASSERT_UINT32_WITHIN(rates[i]/50, rates[i], ch34x_uart_baud());
+    TEST_ASSERT_BITS_HIGH(CH34X_PRESCALER_NO_BUFFER, dev.regs[CH34X_REG_PRESCALER]);
+  }
+}
+
+static void set_baudrate_cb(tuh_xfer_t* xfer)
+{
+  *((xfer_result_t*) xfer->user_data) = xfer->result;
+}
+
+void test_ch34x_baudrate_async(void)
+{
+  uint8_t const idx = mount(TU_CH34X_VID, 0x7523);
+
+  xfer_result_t result = XFER_RESULT_INVALID;
+  TEST_ASSERT_TRUE(tuh_cdc_set_baudrate(idx, 19200, set_baudrate_cb, (uintptr_t) &result));
+  TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, result);
+
+  // requested rate is reported, not the one derived from divisor
+  cdc_line_coding_t line_coding;
+  TEST_ASSERT_TRUE(tuh_cdc_get_local_line_coding(idx, &line_coding));
+  TEST_ASSERT_EQUAL(19200, line_coding.bit_rate);
+
+  result = XFER_RESULT_INVALID;
+  TEST_ASSERT_TRUE(tuh_cdc_set_control_line_state(idx, CDC_CONTROL_LINE_STATE_RTS, set_baudrate_cb, (uintptr_t) &result));
+  TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, result);
+  TEST_ASSERT_EQUAL_HEX8(CH34X_BIT_RTS, dev.mcr);
+  TEST_ASSERT_FALSE(tuh_cdc_connected(idx));
+}
+
+void test_ch34x_loopback(void)
+{
+  uint8_t const idx = mount(TU_CH34X_VID, 0x7523);
+  loopback_check(idx, 1000);
+}
+
+void test_ch34x_modem_status(void)
+{
+  uint8_t const idx = mount(TU_CH34X_VID, 0x7523);
+
+  dev.msr = CH34X_BIT_DCD | CH34X_BIT_CTS;
+  dev.status_pending = true;
+  fake_run();
+
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD | TUH_CDC_SERIAL_STATE_CTS, tuh_cdc_get_serial_state(idx));
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD | TUH_CDC_SERIAL_STATE_CTS, app_changed);
+
+  // notification endpoint is re-armed
+  app_changed = 0;
+  dev.msr = CH34X_BIT_DSR | CH34X_BIT_CTS;
+  dev.status_pending = true;
+  fake_run();
+
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DSR | TUH_CDC_SERIAL_STATE_CTS, app_state);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_DSR, app_changed);
+}
+
+//--------------------------------------------------------------------+
+// PL2303
+//--------------------------------------------------------------------+
+
+static uint16_t pl2303_reg_value(uint16_t reg)
+{
+  for(int i=dev.vendor_write_count-1; i>=0; i--)
+  {
+    if ( dev.vendor_write[i].reg == reg ) return dev.vendor_write[i].value;
+  }
+  return 0xffff;
+}
+
+void test_pl2303_mount(void)
+{
+  uint8_t const idx = mount(TU_PL2303_VID, 0x2303);
+
+  TEST_ASSERT_EQUAL(6, dev.vendor_read_count);
+  TEST_ASSERT_EQUAL_HEX16(1, pl2303_reg_value(0x0000));
+  TEST_ASSERT_EQUAL_HEX16(0, pl2303_reg_value(0x0001));
+  TEST_ASSERT_EQUAL_HEX16(PL2303_REG2_HX, pl2303_reg_value(0x0002));
+  TEST_ASSERT_EQUAL_HEX16(0, pl2303_reg_value(0x0008));
+  TEST_ASSERT_EQUAL_HEX16(0, pl2303_reg_value(0x0009));
+
+  // standard rate is written directly
+  TEST_ASSERT_EQUAL(115200, tu_unaligned_read32(dev.line_coding));
+  TEST_ASSERT_EQUAL(8, dev.line_coding[6]);
+  TEST_ASSERT_EQUAL_HEX8(CDC_CONTROL_LINE_STATE_DTR | CDC_CONTROL_LINE_STATE_RTS, dev.control);
+
+  cdc_line_coding_t line_coding;
+  TEST_ASSERT_TRUE(tuh_cdc_get_local_line_coding(idx, &line_coding));
+  TEST_ASSERT_EQUAL(115200, line_coding.bit_rate);
+  TEST_ASSERT_EQUAL(8, line_coding.data_bits);
+  TEST_ASSERT_TRUE(tuh_cdc_connected(idx));
+}
+
+void test_pl2303_legacy(void)
+{
+  dev.dev_class = TUSB_CLASS_CDC;
+  dev.ep0_size  = 8;
+  uint8_t const idx = mount(TU_PL2303_VID, 0x2303);
+
+  TEST_ASSERT_EQUAL_HEX16(PL2303_REG2_LEGACY, pl2303_reg_value(0x0002));
+
+  // rate is limited
+  TEST_ASSERT_TRUE(tuh_cdc_set_baudrate(idx, 3000000, NULL, 0));
+  TEST_ASSERT_EQUAL(PL2303_BAUD_MAX_LEGACY, pl2303_uart_baud());
+}
+
+void test_pl2303_baudrate(void)
+{
+  static uint32_t const rates[] = { 300, 9600, 10000, 31250, 115200, 250000, 500000, 921600, 1000000, 2000000, 6000000 };
+
+  uint8_t const idx = mount(TU_PL2303_VID, 0x2303);
+
+  for(size_t i=0; i<TU_ARRAY_SIZE(rates); i++)
+  {
+    xfer_result_t result = XFER_RESULT_INVALID;
+    TEST_ASSERT_TRUE(tuh_cdc_set_baudrate(idx, rates[i], NULL, (uintptr_t) &result));
+    TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, result);
+    TEST_ASSERT_UINT32_WITHIN(rates[i]/50, rates[i], pl2303_uart_baud());
+
+    // data format is kept
+    TEST_ASSERT_EQUAL(8, dev.line_coding[6]);
+  }
+
+  // divisor is used for non-standard rate, requested rate is reported
+  xfer_result_t result = XFER_RESULT_INVALID;
+  TEST_ASSERT_TRUE(tuh_cdc_set_baudrate(idx, 250000, set_baudrate_cb, (uintptr_t) &result));
+  TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, result);
+  TEST_ASSERT_BITS_HIGH(PL2303_BAUD_DIVISOR, tu_unaligned_read32(dev.line_coding));
+
+  cdc_line_coding_t line_coding;
+  TEST_ASSERT_TRUE(tuh_cdc_get_local_line_coding(idx, &line_coding));
+  TEST_ASSERT_EQUAL(250000, line_coding.bit_rate);
+}
+
+void test_pl2303_loopback(void)
+{
+  uint8_t const idx = mount(TU_PL2303_VID, 0x2303);
+  loopback_check(idx, 1000);
+}
+
+void test_pl2303_uart_state(void)
+{
+  uint8_t const idx = mount(TU_PL2303_VID, 0x2303);
+
+  dev.uart_state = PL2303_UART_DCD | PL2303_UART_DSR | PL2303_UART_CTS | PL2303_UART_PARITY_ERROR;
+  dev.status_pending = true;
+  fake_run();
+
+  uint16_t const expected = CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_DSR | TUH_CDC_SERIAL_STATE_CTS | CDC_SERIAL_STATE_PARITY;
+  TEST_ASSERT_EQUAL_HEX16(expected, app_state);
+  TEST_ASSERT_EQUAL_HEX16(expected, app_changed);
+
+  // error is cleared once reported
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_DSR | TUH_CDC_SERIAL_STATE_CTS, tuh_cdc_get_serial_state(idx));
+}
+
+//--------------------------------------------------------------------+
+// FTDI
+//--------------------------------------------------------------------+
+
+void test_ftdi_mount(void)
+{
+  uint8_t const idx = mount(TU_FTDI_VID, 0x6001);
+
+  // 3 MHz / 115200 = 26, no fraction
+  TEST_ASSERT_EQUAL_HEX16(26, dev.divisor);
+  TEST_ASSERT_EQUAL_HEX8(CDC_CONTROL_LINE_STATE_DTR | CDC_CONTROL_LINE_STATE_RTS, dev.control);
+  TEST_ASSERT_TRUE(tuh_cdc_connected(idx));
+}
+
+void test_ftdi_loopback(void)
+{
+  uint8_t const idx = mount(TU_FTDI_VID, 0x6001);
+  loopback_check(idx, 1000);
+}
+
+void test_ftdi_status(void)
+{
+  uint8_t const idx = mount(TU_FTDI_VID, 0x6001);
+
+  dev.ftdi_status[0] = FTDI_RS0_CTS | FTDI_RS0_DSR | FTDI_RS0_RI | FTDI_RS0_RLSD;
+  dev.ftdi_status[1] = FTDI_RS_OE | FTDI_RS_FE | FTDI_RS_THRE | FTDI_RS_TEMT;
+  dev.status_pending = true;
+  fake_run();
+
+  // transmitter bits are not part of serial state, status is not received as data
+  uint16_t const levels = CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_DSR | CDC_SERIAL_STATE_RI | TUH_CDC_SERIAL_STATE_CTS;
+  TEST_ASSERT_EQUAL_HEX16(levels | CDC_SERIAL_STATE_OVERRUN | CDC_SERIAL_STATE_FRAMING, app_state);
+  TEST_ASSERT_EQUAL_HEX16(levels | CDC_SERIAL_STATE_OVERRUN | CDC_SERIAL_STATE_FRAMING, app_changed);
+  TEST_ASSERT_EQUAL(0, tuh_cdc_read_available(idx));
+
+  app_changed = 0;
+  dev.ftdi_status[0] = 0;
+  dev.ftdi_status[1] = FTDI_RS_PE | FTDI_RS_BI;
+  dev.status_pending = true;
+  fake_run();
+
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_PARITY | CDC_SERIAL_STATE_BREAK, app_state);
+  TEST_ASSERT_EQUAL_HEX16(levels | CDC_SERIAL_STATE_PARITY | CDC_SERIAL_STATE_BREAK, app_changed);
+}
+
+//--------------------------------------------------------------------+
+// ACM
+//--------------------------------------------------------------------+
+
+void test_acm_mount(void)
+{
+  uint8_t const idx = mount(ACM_VID, 0x4001);
+
+  TEST_ASSERT_EQUAL(115200, tu_unaligned_read32(dev.line_coding));
+  TEST_ASSERT_EQUAL(8, dev.line_coding[6]);
+  TEST_ASSERT_EQUAL_HEX8(CDC_CONTROL_LINE_STATE_DTR | CDC_CONTROL_LINE_STATE_RTS, dev.control);
+  TEST_ASSERT_TRUE(tuh_cdc_connected(idx));
+}
+
+void test_acm_loopback(void)
+{
+  uint8_t const idx = mount(ACM_VID, 0x4001);
+  loopback_check(idx, 1000);
+}
+
+void test_acm_serial_state(void)
+{
+  uint8_t const idx = mount(ACM_VID, 0x4001);
+
+  // reserved bit 7 is ignored, there is no CTS in SerialState
+  dev.uart_state = CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_RI | CDC_SERIAL_STATE_OVERRUN | 0x80;
+  dev.status_pending = true;
+  fake_run();
+
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_RI | CDC_SERIAL_STATE_OVERRUN, app_state);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_RI | CDC_SERIAL_STATE_OVERRUN, app_changed);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_RI, tuh_cdc_get_serial_state(idx));
+
+  // same levels without error is no change
+  dev.uart_state = CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_RI;
+  dev.status_pending = true;
+  fake_run();
+  TEST_ASSERT_EQUAL(1, app_state_count);
+
+  // notification other than SerialState is ignored
+  fake_ep_t* ep_notif = ep_get(0x81);
+  TEST_ASSERT_TRUE(ep_notif->busy);
+  ep_notif->busy = false;
+  ep_notif->buffer[1] = CDC_NOTIF_NETWORK_CONNECTION;
+  ep_notif->buffer[sizeof(tusb_control_request_t)] = 0;
+  TEST_ASSERT_TRUE(cdch_xfer_cb(DADDR, 0x81, XFER_RESULT_SUCCESS, 10));
+  TEST_ASSERT_EQUAL(1, app_state_count);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_RI, tuh_cdc_get_serial_state(idx));
+}
+
+//--------------------------------------------------------------------+
+// Serial state report
+//--------------------------------------------------------------------+
+
+static void timer_fire(void)
+{
+  TEST_ASSERT_NOT_NULL(fake_timer.func);
+  osal_task_func_t const func = fake_timer.func;
+  fake_timer.func = NULL;
+  func(fake_timer.param);
+}
+
+static void acm_serial_state(uint8_t state)
+{
+  dev.uart_state = state;
+  dev.status_pending = true;
+  fake_run();
+}
+
+// Changes within the interval are reported once
+void test_serial_state_coalesced(void)
+{
+  timer_enabled = true;
+  uint8_t const idx = mount(ACM_VID, 0x4001);
+
+  acm_serial_state(CDC_SERIAL_STATE_DCD);
+  TEST_ASSERT_NOT_NULL(fake_timer.func);
+  TEST_ASSERT_EQUAL(CFG_TUH_CDC_SERIAL_STATE_INTERVAL_MS, fake_timer.delay_ms);
+  TEST_ASSERT_EQUAL(0, app_state_count);
+
+  // state is up to date before it is reported
+  acm_serial_state(CDC_SERIAL_STATE_DSR);
+  acm_serial_state(CDC_SERIAL_STATE_DSR | CDC_SERIAL_STATE_RI);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DSR | CDC_SERIAL_STATE_RI, tuh_cdc_get_serial_state(idx));
+  TEST_ASSERT_EQUAL(0, app_state_count);
+
+  // DCD toggled within interval is still reported as changed
+  timer_fire();
+  TEST_ASSERT_EQUAL(1, app_state_count);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DSR | CDC_SERIAL_STATE_RI, app_state);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_DSR | CDC_SERIAL_STATE_RI, app_changed);
+
+  // next change starts a new interval
+  app_changed = 0;
+  acm_serial_state(CDC_SERIAL_STATE_DSR);
+  timer_fire();
+  TEST_ASSERT_EQUAL(2, app_state_count);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_RI, app_changed);
+}
+
+// Errors are latched until reported, even if the device has cleared them in the meantime
+void test_serial_state_error_latched(void)
+{
+  timer_enabled = true;
+  uint8_t const idx = mount(ACM_VID, 0x4001);
+
+  acm_serial_state(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_PARITY);
+  acm_serial_state(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_OVERRUN);
+  acm_serial_state(CDC_SERIAL_STATE_DCD);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_PARITY | CDC_SERIAL_STATE_OVERRUN,
+                          tuh_cdc_get_serial_state(idx));
+
+  timer_fire();
+  TEST_ASSERT_EQUAL(1, app_state_count);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_PARITY | CDC_SERIAL_STATE_OVERRUN, app_state);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_PARITY | CDC_SERIAL_STATE_OVERRUN, app_changed);
+
+  // cleared once reported, nothing to report if levels are unchanged
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD, tuh_cdc_get_serial_state(idx));
+  acm_serial_state(CDC_SERIAL_STATE_DCD);
+  TEST_ASSERT_NULL(fake_timer.func);
+
+  // same error again is reported again
+  acm_serial_state(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_PARITY);
+  timer_fire();
+  TEST_ASSERT_EQUAL(2, app_state_count);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_PARITY, app_state);
+}
+
+// Report scheduled for a closed device is cancelled, it must not be delivered to the next device at this address
+void test_serial_state_close(void)
+{
+  timer_enabled = true;
+  mount(ACM_VID, 0x4001);
+
+  acm_serial_state(CDC_SERIAL_STATE_DCD);
+  TEST_ASSERT_NOT_NULL(fake_timer.func);
+
+  cdch_close(DADDR);
+  TEST_ASSERT_NULL(fake_timer.func);
+
+  tu_memclr(fake_ep, sizeof(fake_ep));
+  pool_used       = 0;
+  config_complete = false;
+  uint8_t const idx = mount(ACM_VID, 0x4001);
+
+  acm_serial_state(CDC_SERIAL_STATE_DSR);
+  timer_fire();
+  TEST_ASSERT_EQUAL(1, app_state_count);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DSR, app_state);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DSR, app_changed);
+  TEST_ASSERT_EQUAL_HEX16(CDC_SERIAL_STATE_DSR, tuh_cdc_get_serial_state(idx));
+}
+
+//--------------------------------------------------------------------+
+// Transfer error
+//--------------------------------------------------------------------+
+
+// Failed transfer leaves the endpoint halted in the host controller: halt is cleared before the stream is resumed
+void test_xfer_failed_clear_halt(void)
+{
+  uint8_t const idx = mount(TU_PL2303_VID, 0x2303);
+
+  fake_ep_t* ep_in = ep_get(0x83);
+  TEST_ASSERT_TRUE(ep_in->busy);
+
+  ep_in->busy = false;
+  TEST_ASSERT_TRUE(cdch_xfer_cb(DADDR, 0x83, XFER_RESULT_FAILED, 0));
+  TEST_ASSERT_EQUAL(1, dev.clear_halt_count);
+  TEST_ASSERT_EQUAL_HEX8(0x83, dev.clear_halt_ep);
+  TEST_ASSERT_TRUE(ep_in->busy);
+
+  // data of the timed out transfer is dropped
+  fake_ep_t* ep_out = ep_get(0x02);
+  TEST_ASSERT_EQUAL(4, tuh_cdc_write(idx, "lost", 4));
+  tuh_cdc_write_flush(idx);
+  TEST_ASSERT_TRUE(ep_out->busy);
+
+  ep_out->busy = false;
+  TEST_ASSERT_TRUE(cdch_xfer_cb(DADDR, 0x02, XFER_RESULT_TIMEOUT, 0));
+  TEST_ASSERT_EQUAL(2, dev.clear_halt_count);
+  TEST_ASSERT_EQUAL_HEX8(0x02, dev.clear_halt_ep);
+
+  // notification endpoint is re-armed as well
+  fake_ep_t* ep_notif = ep_get(0x81);
+  ep_notif->busy = false;
+  TEST_ASSERT_TRUE(cdch_xfer_cb(DADDR, 0x81, XFER_RESULT_FAILED, 0));
+  TEST_ASSERT_EQUAL_HEX8(0x81, dev.clear_halt_ep);
+  TEST_ASSERT_TRUE(ep_notif->busy);
+
+  loopback_check(idx, 100);
+}
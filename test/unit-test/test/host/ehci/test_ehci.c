@@ -0,0 +1,1112 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+
+// EHCI host with ChipIdea extensions
+#define CFG_TUSB_MCU            OPT_MCU_LPC18XX
+#define CFG_TUSB_RHPORT0_MODE   (OPT_MODE_HOST | OPT_MODE_HIGH_SPEED)
+#define CFG_TUH_DEVICE_MAX      8
+#define CFG_TUH_HUB             1
+#define CFG_TUH_ENDPOINT_MAX    4
+#define CFG_TUH_EHCI_ISO_EP_MAX 2
+
+#include "portable/ehci/ehci.c"
+#include "ehci_model.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EVENT_MAX   = 128,
+  DEV_ADDR    = 1,
+  BULK_MPS    = 512,
+
+  // HID devices with interrupt IN endpoints 0x81-0x84
+  HID_ADDR    = 2,
+  HID_COUNT   = 6,
+  HID_EP_MAX  = 4,
+};
+
+static hcd_event_t events[EVENT_MAX];
+static uint32_t    event_count;
+static uint32_t    event_uframe[EVENT_MAX];
+
+// Simulated device
+static struct
+{
+  tusb_speed_t speed;
+  uint8_t  setup[8];
+  uint32_t setup_count;
+
+  uint8_t  ctrl_in[64];   // data stage of control IN
+  uint16_t ctrl_in_len;
+
+  uint32_t nak_count;     // number of transactions to NAK on data endpoints
+  uint16_t in_short;      // return short packet of this size on bulk IN, 0 for full packets
+  uint32_t in_short_at;   // return a single short packet once this many bytes are sent on bulk IN, 0 for none
+  uint32_t in_bytes;
+  uint8_t  in_seq;        // bulk IN data
+  uint8_t  out_seq;       // expected bulk OUT data
+  uint32_t out_bytes;
+  bool     stall_out;
+  bool     int_ready;     // interrupt IN has data
+  uint32_t int_xacts;
+
+  // isochronous IN (ep 4) and OUT (ep 5)
+  uint32_t iso_interval;  // expected micro frames between transactions
+  uint32_t iso_xacts;
+  uint32_t iso_last_uframe;
+  uint32_t iso_gaps;      // transactions not in the expected micro frame
+  uint32_t iso_err_at;    // fail this transaction (1-based), 0 for none
+  uint16_t iso_in_len;    // bytes returned on IN, 0 for requested length
+  uint8_t  iso_seq;
+  uint16_t iso_out_len[32];
+
+  uint32_t hid_xacts[HID_COUNT][HID_EP_MAX];
+} dev;
+
+//--------------------------------------------------------------------+
+// Stubs for usbh
+//--------------------------------------------------------------------+
+
+void hcd_event_handler(hcd_event_t const* event, bool in_isr)
+{
+  TEST_ASSERT_TRUE(in_isr);
+  TEST_ASSERT_LESS_THAN(EVENT_MAX, event_count);
+  event_uframe[event_count] = ehci_model_uframe();
+  events[event_count++] = *event;
+}
+
+void hcd_int_enable(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+void hcd_int_disable(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+void hcd_devtree_get_info(uint8_t dev_addr, hcd_devtree_info_t* devtree_info)
+{
+  (void) dev_addr;
+  devtree_info->rhport   = 0;
+  devtree_info->hub_addr = 0;
+  devtree_info->hub_port = 0;
+  devtree_info->speed    = (uint8_t) dev.speed;
+}
+
+//--------------------------------------------------------------------+
+// Simulated device
+//--------------------------------------------------------------------+
+
+static int32_t dev_xact(uint8_t dev_addr, uint8_t ep_num, uint8_t pid, uint8_t* data, uint16_t len)
+{
+  if ( ep_num == 0 )
+  {
+    switch ( pid )
+    {
+      case EHCI_PID_SETUP:
+        memcpy(dev.setup, data, 8);
+        dev.setup_count++;
+        return 8;
+
+      case EHCI_PID_IN:
+        len = tu_min16(len, dev.ctrl_in_len);
+        memcpy(data, dev.ctrl_in, len);
+        return len;
+
+      default:
+        return len;
+    }
+  }
+
+  // HID device: interrupt IN always has a report
+  if ( dev_addr != DEV_ADDR )
+  {
+    TEST_ASSERT_TRUE(dev_addr >= HID_ADDR && dev_addr < HID_ADDR + HID_COUNT);
+    TEST_ASSERT_TRUE(ep_num >= 1 && ep_num <= HID_EP_MAX && pid == EHCI_PID_IN);
+    dev.hid_xacts[dev_addr - HID_ADDR][ep_num - 1]++;
+    memset(data, dev_addr, len);
+    return len;
+  }
+
+  TEST_ASSERT_EQUAL(DEV_ADDR, dev_addr);
+
+  if ( dev.nak_count )
+  {
+    dev.nak_count--;
+    return EHCI_MODEL_NAK;
+  }
+
+  switch ( ep_num )
+  {
+    case 1: // bulk IN
+      if ( dev.in_short ) len = tu_min16(len, dev.in_short);
+      if ( dev.in_short_at && dev.in_bytes + len >= dev.in_short_at )
+      {
+        len = (uint16_t) tu_min32(len - 1, dev.in_short_at - dev.in_bytes);
+        dev.in_short_at = 0;
+      }
+      for(uint16_t i=0; i<len; i++) data[i] = dev.in_seq++;
+      dev.in_bytes += len;
+      return len;
+
+    case 2: // bulk OUT
+      if ( dev.stall_out ) return EHCI_MODEL_STALL;
+      for(uint16_t i=0; i<len; i++) TEST_ASSERT_EQUAL_HEX8(dev.out_seq++, data[i]);
+      dev.out_bytes += len;
+      return len;
+
+    case 3: // interrupt IN
+      if ( !dev.int_ready ) return EHCI_MODEL_NAK;
+      dev.int_xacts++;
+      memset(data, 0x33, len);
+      return len;
+
+    case 4: // isochronous IN
+    case 5: // isochronous OUT
+    {
+      uint32_t const uframe = ehci_model_uframe();
+      if ( dev.iso_xacts && uframe - dev.iso_last_uframe != dev.iso_interval ) dev.iso_gaps++;
+      dev.iso_last_uframe = uframe;
+      dev.iso_xacts++;
+
+      if ( dev.iso_xacts == dev.iso_err_at ) return EHCI_MODEL_XACT_ERR;
+
+      if ( ep_num == 4 )
+      {
+        if ( dev.iso_in_len ) len = tu_min16(len, dev.iso_in_len);
+        for(uint16_t i=0; i<len; i++) data[i] = dev.iso_seq++;
+      }
+      else
+      {
+        if ( dev.iso_xacts <= TU_ARRAY_SIZE(dev.iso_out_len) ) dev.iso_out_len[dev.iso_xacts-1] = len;
+        for(uint16_t i=0; i<len; i++) TEST_ASSERT_EQUAL_HEX8(dev.iso_seq++, data[i]);
+      }
+      return len;
+    }
+
+    default:
+      return EHCI_MODEL_XACT_ERR;
+  }
+}
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+static void edpt_open(uint8_t dev_addr, uint8_t ep_addr, uint8_t xfer_type, uint16_t mps, uint8_t interval)
+{
+  tusb_desc_endpoint_t const desc_ep =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = ep_addr,
+    .bmAttributes     = { .xfer = xfer_type },
+    .wMaxPacketSize   = mps,
+    .bInterval        = interval
+  };
+  TEST_ASSERT_TRUE(hcd_edpt_open(0, dev_addr, &desc_ep));
+}
+
+// Run until number of events is reached, return number of micro frames
+static uint32_t run_until_events(uint32_t count, uint32_t uframe_max)
+{
+  uint32_t const start = ehci_model_uframe();
+  while ( event_count < count && (ehci_model_uframe() - start) < uframe_max ) ehci_model_run(1);
+  TEST_ASSERT_EQUAL(count, event_count);
+  return ehci_model_uframe() - start;
+}
+
+static bool iso_open(uint8_t ep_addr, uint16_t w_max_packet_size, uint8_t interval)
+{
+  tusb_desc_endpoint_t const desc_ep =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = ep_addr,
+    .bmAttributes     = { .xfer = TUSB_XFER_ISOCHRONOUS },
+    .wMaxPacketSize   = w_max_packet_size,
+    .bInterval        = interval
+  };
+  return hcd_edpt_open(0, DEV_ADDR, &desc_ep);
+}
+
+static uint32_t iso_td_used_count(void)
+{
+  uint32_t count = 0;
+  for(uint32_t i=0; i<ITD_MAX; i++) count += ehci_data.itd_info[i].used;
+  for(uint32_t i=0; i<SITD_MAX; i++) count += ehci_data.sitd_info[i].used;
+  return count;
+}
+
+static uint32_t qtd_used_count(void)
+{
+  uint32_t count = 0;
+  for(uint32_t i=0; i<QTD_MAX; i++) count += ehci_data.qtd_info[i].used;
+  return count;
+}
+
+static void assert_xfer_event(uint32_t idx, uint8_t ep_addr, xfer_result_t result, uint32_t len)
+{
+  TEST_ASSERT_EQUAL(HCD_EVENT_XFER_COMPLETE, events[idx].event_id);
+  TEST_ASSERT_EQUAL_HEX8(ep_addr, events[idx].xfer_complete.ep_addr);
+  TEST_ASSERT_EQUAL(result, events[idx].xfer_complete.result);
+  TEST_ASSERT_EQUAL(len, events[idx].xfer_complete.len);
+}
+
+void setUp(void)
+{
+  tu_memclr(&dev, sizeof(dev));
+  dev.speed = TUSB_SPEED_HIGH;
+  event_count = 0;
+
+  ehci_model_init(dev_xact);
+  TEST_ASSERT_TRUE(ehci_init(0, (uint32_t) (uintptr_t) &ehci_model_cap_regs, (uint32_t) (uintptr_t) &ehci_model_regs));
+
+  edpt_open(DEV_ADDR, 0x00, TUSB_XFER_CONTROL, 64, 0);
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+void test_port_connect(void)
+{
+  ehci_model_port_connect(TUSB_SPEED_HIGH);
+  run_until_events(1, 16);
+
+  TEST_ASSERT_EQUAL(HCD_EVENT_DEVICE_ATTACH, events[0].event_id);
+  TEST_ASSERT_TRUE(hcd_port_connect_status(0));
+  TEST_ASSERT_EQUAL(TUSB_SPEED_HIGH, hcd_port_speed_get(0));
+
+  // port is reset by driver on attach
+  ehci_model_run(16);
+  TEST_ASSERT_TRUE(ehci_model_regs.portsc_bm.port_enabled);
+
+  ehci_model_port_disconnect();
+  run_until_events(2, 16);
+  TEST_ASSERT_EQUAL(HCD_EVENT_DEVICE_REMOVE, events[1].event_id);
+}
+
+void test_control_transfer(void)
+{
+  static uint8_t const setup[8] = { 0x80, 0x06, 0x00, 0x01, 0x00, 0x00, 18, 0x00 };
+  static uint8_t desc[18];
+
+  dev.ctrl_in_len = 18;
+  for(uint8_t i=0; i<18; i++) dev.ctrl_in[i] = i;
+
+  TEST_ASSERT_TRUE(hcd_setup_send(0, DEV_ADDR, setup));
+  run_until_events(1, 64);
+  assert_xfer_event(0, 0x00, XFER_RESULT_SUCCESS, 8);
+  TEST_ASSERT_EQUAL_MEMORY(setup, dev.setup, 8);
+
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x80, desc, sizeof(desc)));
+  run_until_events(2, 64);
+  assert_xfer_event(1, 0x80, XFER_RESULT_SUCCESS, 18);
+  TEST_ASSERT_EQUAL_MEMORY(dev.ctrl_in, desc, 18);
+
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x00, NULL, 0));
+  run_until_events(3, 64);
+  assert_xfer_event(2, 0x00, XFER_RESULT_SUCCESS, 0);
+}
+
+void test_bulk_in_nak_and_short_packet(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[4096];
+
+  edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS, 0);
+
+  dev.nak_count = 5;
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf, sizeof(buf)));
+  run_until_events(1, 64);
+  assert_xfer_event(0, 0x81, XFER_RESULT_SUCCESS, sizeof(buf));
+  for(uint32_t i=0; i<sizeof(buf); i++) TEST_ASSERT_EQUAL_HEX8((uint8_t) i, buf[i]);
+
+  // short packet completes transfer
+  dev.in_short = 100;
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf, sizeof(buf)));
+  run_until_events(2, 64);
+  assert_xfer_event(1, 0x81, XFER_RESULT_SUCCESS, 100);
+}
+
+void test_bulk_out_stall(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[1000];
+  for(uint32_t i=0; i<sizeof(buf); i++) buf[i] = (uint8_t) i;
+
+  edpt_open(DEV_ADDR, 0x02, TUSB_XFER_BULK, BULK_MPS, 0);
+
+  dev.stall_out = true;
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x02, buf, sizeof(buf)));
+  run_until_events(1, 64);
+  assert_xfer_event(0, 0x02, XFER_RESULT_STALLED, 0);
+
+  // endpoint is usable once stall is cleared
+  dev.stall_out = false;
+  TEST_ASSERT_TRUE(hcd_edpt_clear_stall(DEV_ADDR, 0x02));
+  TEST_ASSERT_FALSE(qhd_get_from_addr(DEV_ADDR, 0x02)->qtd_overlay.data_toggle);
+  TEST_ASSERT_FALSE(hcd_edpt_clear_stall(DEV_ADDR, 0x05));
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x02, buf, sizeof(buf)));
+  run_until_events(2, 64);
+  assert_xfer_event(1, 0x02, XFER_RESULT_SUCCESS, sizeof(buf));
+  TEST_ASSERT_EQUAL(sizeof(buf), dev.out_bytes);
+}
+
+void test_interrupt_polling_interval(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[8];
+
+  // high speed bInterval 7: every 2^(7-1) = 64 micro frames
+  edpt_open(DEV_ADDR, 0x83, TUSB_XFER_INTERRUPT, sizeof(buf), 7);
+  dev.int_ready = true;
+
+  for(uint32_t i=0; i<4; i++)
+  {
+    TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x83, buf, sizeof(buf)));
+    run_until_events(i+1, 200);
+    assert_xfer_event(i, 0x83, XFER_RESULT_SUCCESS, sizeof(buf));
+  }
+
+  // endpoint is polled once per interval
+  TEST_ASSERT_EQUAL(4, dev.int_xacts);
+  TEST_ASSERT_UINT32_WITHIN(8, 64, event_uframe[3] - event_uframe[2]);
+}
+
+// Full speed HID devices polled every 8 ms: split transactions are spread across frames and micro frames so that
+// every endpoint is polled exactly once per interval
+void test_interrupt_many_hid(void)
+{
+  enum { HID_EPS = HID_COUNT*HID_EP_MAX, CYCLES = 8 };
+  CFG_TUH_MEM_ALIGN static uint8_t buf[HID_COUNT][HID_EP_MAX][8];
+  uint32_t last_uframe[HID_COUNT][HID_EP_MAX] = { 0 };
+  uint32_t completed[HID_COUNT][HID_EP_MAX] = { 0 };
+  uint32_t jitter_max = 0;
+
+  dev.speed = TUSB_SPEED_FULL;
+
+  for(uint8_t d=0; d<HID_COUNT; d++)
+  {
+    for(uint8_t e=0; e<HID_EP_MAX; e++)
+    {
+      edpt_open(HID_ADDR + d, 0x81 + e, TUSB_XFER_INTERRUPT, 8, 8);
+      TEST_ASSERT_TRUE(hcd_edpt_xfer(0, HID_ADDR + d, 0x81 + e, buf[d][e], 8));
+    }
+  }
+
+  // 3 endpoints per frame, each with its own start split micro frame
+  for(uint32_t slot=0; slot<PERIOD_INTERVAL_MAX; slot++)
+  {
+    TEST_ASSERT_EQUAL(3*(8 + BW_FS_OVERHEAD), ehci_data.tt_load[slot]);
+  }
+
+  ehci_period_bandwidth_t bw;
+  ehci_period_bandwidth_get(0, &bw);
+  TEST_ASSERT_EQUAL(2*(8 + BW_HS_OVERHEAD), bw.uframe_load_max); // overlapped complete splits
+  TEST_ASSERT_EQUAL(BW_UFRAME_MAX, bw.uframe_budget);
+  TEST_ASSERT_EQUAL(3*(8 + BW_FS_OVERHEAD), bw.tt_load_max);
+  TEST_ASSERT_EQUAL(BW_TT_FRAME_MAX, bw.tt_budget);
+
+  // resubmit on completion as HID host driver does
+  for(uint32_t uframe=0; uframe < (CYCLES+1)*64; uframe++)
+  {
+    ehci_model_run(1);
+
+    for(uint32_t i=0; i<event_count; i++)
+    {
+      TEST_ASSERT_EQUAL(HCD_EVENT_XFER_COMPLETE, events[i].event_id);
+      TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, events[i].xfer_complete.result);
+
+      uint8_t const d = events[i].dev_addr - HID_ADDR;
+      uint8_t const e = tu_edpt_number(events[i].xfer_complete.ep_addr) - 1;
+      if ( completed[d][e]++ )
+      {
+        uint32_t const delta = event_uframe[i] - last_uframe[d][e];
+        jitter_max = tu_max32(jitter_max, (delta > 64) ? delta - 64 : 64 - delta);
+      }
+      last_uframe[d][e] = event_uframe[i];
+
+      TEST_ASSERT_TRUE(hcd_edpt_xfer(0, events[i].dev_addr, events[i].xfer_complete.ep_addr, buf[d][e], 8));
+    }
+    event_count = 0;
+  }
+
+  char msg[64];
+  sprintf(msg, "%u HID endpoints: max polling jitter %lu micro frames", (unsigned) HID_EPS, (unsigned long) jitter_max);
+  TEST_MESSAGE(msg);
+
+  // every endpoint is polled once per interval
+  for(uint8_t d=0; d<HID_COUNT; d++)
+  {
+    for(uint8_t e=0; e<HID_EP_MAX; e++)
+    {
+      TEST_ASSERT_UINT32_WITHIN(1, CYCLES+1, completed[d][e]);
+      TEST_ASSERT_EQUAL(completed[d][e], dev.hid_xacts[d][e]);
+    }
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(1, jitter_max);
+
+  // bandwidth is returned when devices are removed
+  for(uint8_t d=0; d<HID_COUNT; d++) hcd_device_close(0, HID_ADDR + d);
+  ehci_period_bandwidth_get(0, &bw);
+  TEST_ASSERT_EQUAL(0, bw.uframe_load_max);
+  TEST_ASSERT_EQUAL(0, bw.tt_load_max);
+}
+
+// High speed sub millisecond endpoints take alternate micro frames
+void test_interrupt_hs_sub_ms(void)
+{
+  edpt_open(DEV_ADDR, 0x81, TUSB_XFER_INTERRUPT, 64, 2);
+  edpt_open(DEV_ADDR, 0x83, TUSB_XFER_INTERRUPT, 64, 2);
+
+  uint8_t const smask1 = qhd_get_from_addr(DEV_ADDR, 0x81)->int_smask;
+  uint8_t const smask3 = qhd_get_from_addr(DEV_ADDR, 0x83)->int_smask;
+  TEST_ASSERT_EQUAL_HEX8(0xFF, smask1 | smask3);
+  TEST_ASSERT_EQUAL_HEX8(0x00, smask1 & smask3);
+
+  ehci_period_bandwidth_t bw;
+  ehci_period_bandwidth_get(0, &bw);
+  TEST_ASSERT_EQUAL(64 + BW_HS_OVERHEAD, bw.uframe_load_max);
+}
+
+void test_device_close(void)
+{
+  edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS, 0);
+  edpt_open(DEV_ADDR, 0x83, TUSB_XFER_INTERRUPT, 8, 4);
+
+  TEST_ASSERT_NOT_NULL(qhd_get_from_addr(DEV_ADDR, 0x81));
+
+  hcd_device_close(0, DEV_ADDR);
+  ehci_model_run(16);
+
+  // queue heads are released after async advance
+  for(uint32_t i=0; i<QHD_MAX; i++) TEST_ASSERT_FALSE(ehci_data.qhd_pool[i].used);
+
+  // only the head and control of dev0 are left in async list
+  ehci_qhd_t* head = qhd_async_head(0);
+  TEST_ASSERT_EQUAL_PTR(qhd_control(0), qhd_next(head));
+  TEST_ASSERT_EQUAL_PTR(head, qhd_next(qhd_control(0)));
+
+  // dummy TDs are released as well
+  TEST_ASSERT_EQUAL(0, qtd_used_count());
+}
+
+// Transfer larger than a qTD is split into a chain
+void test_bulk_in_large_transfer(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[64*1024];
+  uint8_t* const p = buf + 100; // not page aligned
+  uint16_t const len = 60000;
+
+  edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS, 0);
+  uint32_t const used = qtd_used_count();
+
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, p, len));
+  TEST_ASSERT_EQUAL(used + 4, qtd_used_count());
+
+  run_until_events(1, 200);
+  assert_xfer_event(0, 0x81, XFER_RESULT_SUCCESS, len);
+  for(uint32_t i=0; i<len; i++) TEST_ASSERT_EQUAL_HEX8((uint8_t) i, p[i]);
+
+  // TDs are freed once reported
+  TEST_ASSERT_EQUAL(used, qtd_used_count());
+}
+
+// Short packet in the middle of a chain completes the transfer, the next queued transfer follows
+void test_bulk_in_queued_short_packet(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf1[40000];
+  CFG_TUH_MEM_ALIGN static uint8_t buf2[4096];
+
+  edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS, 0);
+  uint32_t const used = qtd_used_count();
+
+  dev.in_short_at = 20000;
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf1, sizeof(buf1)));
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf2, sizeof(buf2)));
+
+  run_until_events(2, 200);
+  assert_xfer_event(0, 0x81, XFER_RESULT_SUCCESS, 20000);
+  assert_xfer_event(1, 0x81, XFER_RESULT_SUCCESS, sizeof(buf2));
+
+  for(uint32_t i=0; i<20000; i++) TEST_ASSERT_EQUAL_HEX8((uint8_t) i, buf1[i]);
+  for(uint32_t i=0; i<sizeof(buf2); i++) TEST_ASSERT_EQUAL_HEX8((uint8_t) (20000+i), buf2[i]);
+
+  TEST_ASSERT_EQUAL(used, qtd_used_count());
+}
+
+void test_bulk_in_queue_full(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[512];
+  edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS, 0);
+
+  // device has no data: queue until pool is exhausted
+  dev.nak_count = UINT32_MAX;
+  uint32_t count = 0;
+  while ( hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf, sizeof(buf)) ) count++;
+  TEST_ASSERT_EQUAL(QTD_MAX, qtd_used_count());
+  TEST_ASSERT_GREATER_THAN(1, count);
+
+  dev.nak_count = 0;
+  run_until_events(count, 200);
+  for(uint32_t i=0; i<count; i++) assert_xfer_event(i, 0x81, XFER_RESULT_SUCCESS, sizeof(buf));
+}
+
+void test_bulk_in_abort_queued(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[1024];
+  edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS, 0);
+  uint32_t const used = qtd_used_count();
+
+  dev.nak_count = UINT32_MAX;
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf, sizeof(buf)));
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf, sizeof(buf)));
+  ehci_model_run(8);
+
+  TEST_ASSERT_TRUE(hcd_edpt_abort_xfer(0, DEV_ADDR, 0x81));
+  TEST_ASSERT_FALSE(hcd_edpt_abort_xfer(0, DEV_ADDR, 0x81));
+
+  // TDs are released once the queue head is put back after async advance
+  ehci_model_run(16);
+  TEST_ASSERT_EQUAL(0, event_count);
+  TEST_ASSERT_EQUAL(used, qtd_used_count());
+  TEST_ASSERT_EQUAL(0, qhd_get_from_addr(DEV_ADDR, 0x81)->aborting);
+
+  // endpoint is usable after abort
+  dev.nak_count = 0;
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf, sizeof(buf)));
+  run_until_events(1, 64);
+  assert_xfer_event(0, 0x81, XFER_RESULT_SUCCESS, sizeof(buf));
+}
+
+static bool async_list_has(ehci_qhd_t const* qhd)
+{
+  ehci_qhd_t* head = qhd_async_head(0);
+  for(ehci_qhd_t* p = qhd_next(head); p != head; p = qhd_next(p))
+  {
+    if ( p == qhd ) return true;
+  }
+  return false;
+}
+
+// Transfer in progress is aborted: queue head is unlinked and its TDs are kept until the controller no longer caches
+// it, a transfer queued meanwhile starts once the queue head is put back
+void test_bulk_in_abort_in_progress(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf1[16384];
+  CFG_TUH_MEM_ALIGN static uint8_t buf2[4096];
+
+  edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS, 0);
+  ehci_qhd_t* qhd = qhd_get_from_addr(DEV_ADDR, 0x81);
+  uint32_t const used = qtd_used_count();
+
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf1, sizeof(buf1)));
+  ehci_model_run(1);
+  TEST_ASSERT_GREATER_THAN(0, dev.in_bytes);
+  TEST_ASSERT_LESS_THAN(sizeof(buf1), dev.in_bytes);
+
+  TEST_ASSERT_TRUE(hcd_edpt_abort_xfer(0, DEV_ADDR, 0x81));
+  TEST_ASSERT_FALSE(async_list_has(qhd));
+  TEST_ASSERT_EQUAL(used + 1, qtd_used_count());
+
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf2, sizeof(buf2)));
+  uint32_t const in_bytes = dev.in_bytes;
+
+  run_until_events(1, 64);
+  assert_xfer_event(0, 0x81, XFER_RESULT_SUCCESS, sizeof(buf2));
+  for(uint32_t i=0; i<sizeof(buf2); i++) TEST_ASSERT_EQUAL_HEX8((uint8_t) (in_bytes + i), buf2[i]);
+
+  TEST_ASSERT_TRUE(async_list_has(qhd));
+  TEST_ASSERT_EQUAL(used, qtd_used_count());
+}
+
+// Periodic queue head is put back once the frame it is unlinked in has passed
+void test_interrupt_abort(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[8];
+
+  edpt_open(DEV_ADDR, 0x83, TUSB_XFER_INTERRUPT, sizeof(buf), 4);
+  ehci_qhd_t* qhd = qhd_get_from_addr(DEV_ADDR, 0x83);
+  uint32_t const used = qtd_used_count();
+
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x83, buf, sizeof(buf)));
+  while ( ehci_model_regs.frame_index & 7 ) ehci_model_run(1);
+
+  TEST_ASSERT_TRUE(hcd_edpt_abort_xfer(0, DEV_ADDR, 0x83));
+
+  // async advance within the same frame
+  ehci_model_run(4);
+  TEST_ASSERT_EQUAL(QHD_ABORT_DOORBELL, qhd->aborting);
+  TEST_ASSERT_EQUAL(used + 1, qtd_used_count());
+
+  ehci_model_run(8);
+  TEST_ASSERT_EQUAL(0, qhd->aborting);
+  TEST_ASSERT_EQUAL(used, qtd_used_count());
+  TEST_ASSERT_EQUAL(0, event_count);
+
+  dev.int_ready = true;
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x83, buf, sizeof(buf)));
+  run_until_events(1, 64);
+  assert_xfer_event(0, 0x83, XFER_RESULT_SUCCESS, sizeof(buf));
+}
+
+// Control of dev0 is aborted like any other queue head, async list head stays
+void test_control_abort_dev0(void)
+{
+  static uint8_t const setup[8] = { 0x80, 0x06, 0x00, 0x01, 0x00, 0x00, 8, 0x00 };
+
+  edpt_open(0, 0x00, TUSB_XFER_CONTROL, 8, 0);
+
+  TEST_ASSERT_TRUE(hcd_setup_send(0, 0, setup));
+  TEST_ASSERT_TRUE(hcd_edpt_abort_xfer(0, 0, 0x00));
+  TEST_ASSERT_FALSE(async_list_has(qhd_control(0)));
+
+  ehci_model_run(16);
+  TEST_ASSERT_EQUAL(0, event_count);
+  TEST_ASSERT_EQUAL(0, dev.setup_count);
+  TEST_ASSERT_TRUE(async_list_has(qhd_control(0)));
+
+  TEST_ASSERT_TRUE(hcd_setup_send(0, 0, setup));
+  run_until_events(1, 64);
+  assert_xfer_event(0, 0x00, XFER_RESULT_SUCCESS, 8);
+}
+
+// Device is closed while a transfer is being aborted
+void test_device_close_aborting(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[512];
+  edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS, 0);
+
+  dev.nak_count = UINT32_MAX;
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf, sizeof(buf)));
+  ehci_model_run(1);
+
+  TEST_ASSERT_TRUE(hcd_edpt_abort_xfer(0, DEV_ADDR, 0x81));
+  hcd_device_close(0, DEV_ADDR);
+  TEST_ASSERT_NULL(qhd_get_from_addr(DEV_ADDR, 0x81));
+
+  ehci_model_run(16);
+  for(uint32_t i=0; i<QHD_MAX; i++) TEST_ASSERT_FALSE(ehci_data.qhd_pool[i].used);
+  TEST_ASSERT_EQUAL(0, qtd_used_count());
+  TEST_ASSERT_EQUAL(0, event_count);
+}
+
+// Bulk IN pipe with a device that always has data: a new transfer is submitted once one is reported, keeping
+// queue_depth transfers queued. Return number of bytes per second
+static uint32_t bulk_in_throughput(uint32_t queue_depth)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[4][16384];
+  edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS, 0);
+
+  uint32_t const start    = ehci_model_uframe();
+  uint32_t const duration = 8000; // 1 second
+  uint32_t const busy     = ehci_model_stats.busy_uframes;
+  uint32_t const irq      = ehci_model_stats.interrupts;
+  uint32_t bytes = 0;
+
+  for(uint32_t i=0; i<queue_depth; i++) TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf[i], sizeof(buf[i])));
+
+  uint32_t idx = 0;
+  while ( ehci_model_uframe() - start < duration )
+  {
+    ehci_model_run(1);
+    for(uint32_t i=0; i<event_count; i++)
+    {
+      assert_xfer_event(i, 0x81, XFER_RESULT_SUCCESS, sizeof(buf[0]));
+      bytes += events[i].xfer_complete.len;
+      TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf[idx], sizeof(buf[idx])));
+      idx = (idx + 1) % queue_depth;
+    }
+    event_count = 0;
+  }
+
+  char msg[120];
+  sprintf(msg, "bulk IN queue depth %lu: %lu KB/s, bus busy %lu%% of micro frames, %lu interrupts",
+          (unsigned long) queue_depth, (unsigned long) (bytes / 1024),
+          (unsigned long) ((ehci_model_stats.busy_uframes - busy) * 100 / duration),
+          (unsigned long) (ehci_model_stats.interrupts - irq));
+  TEST_MESSAGE(msg);
+
+  hcd_edpt_abort_xfer(0, DEV_ADDR, 0x81);
+  return bytes;
+}
+
+void test_bulk_in_throughput(void)
+{
+  uint32_t const single = bulk_in_throughput(1);
+
+  setUp();
+  uint32_t const queued = bulk_in_throughput(4);
+
+  // bus is idle between transfers unless the next one is already queued
+  TEST_ASSERT_GREATER_THAN(single * 2, queued);
+}
+
+// Queue heads are taken from and returned to the free list, lookup by address follows re-open
+void test_qhd_pool_reuse(void)
+{
+  uint32_t count = 0;
+  for(uint8_t daddr=1; daddr<=QHD_INDEX_DEV; daddr++)
+  {
+    for(uint8_t e=0; e<HID_EP_MAX; e++)
+    {
+      tusb_desc_endpoint_t const desc_ep =
+      {
+        .bLength          = sizeof(tusb_desc_endpoint_t),
+        .bDescriptorType  = TUSB_DESC_ENDPOINT,
+        .bEndpointAddress = 0x81 + e,
+        .bmAttributes     = { .xfer = TUSB_XFER_BULK },
+        .wMaxPacketSize   = BULK_MPS,
+      };
+      if ( !hcd_edpt_open(0, daddr, &desc_ep) ) break;
+      count++;
+
+      ehci_qhd_t const* qhd = qhd_get_from_addr(daddr, 0x81 + e);
+      TEST_ASSERT_NOT_NULL(qhd);
+      TEST_ASSERT_EQUAL(daddr, qhd->dev_addr);
+      TEST_ASSERT_EQUAL(e+1, qhd->ep_number);
+    }
+  }
+
+  // pool exhausted
+  TEST_ASSERT_EQUAL(QHD_MAX, count);
+  TEST_ASSERT_NULL(qhd_get_from_addr(DEV_ADDR, 0x01));
+
+  // closed endpoints are not found, their queue heads are reusable after async advance
+  hcd_device_close(0, HID_ADDR);
+  for(uint8_t e=0; e<HID_EP_MAX; e++) TEST_ASSERT_NULL(qhd_get_from_addr(HID_ADDR, 0x81 + e));
+  ehci_model_run(16);
+
+  for(uint8_t e=0; e<HID_EP_MAX; e++)
+  {
+    edpt_open(HID_ADDR, 0x81 + e, TUSB_XFER_INTERRUPT, 8, 4);
+    TEST_ASSERT_TRUE(qhd_get_from_addr(HID_ADDR, 0x81 + e)->int_smask);
+  }
+}
+
+// Microbenchmark of host CPU time with all endpoint queue heads and most TDs in use: endpoint lookup, TD allocation
+// and transfer submission. Completion is executed by the controller model.
+void test_lookup_benchmark(void)
+{
+  enum { LOOKUPS = 1000000, ROUNDS = 200, HID_EPS = HID_COUNT*HID_EP_MAX };
+  CFG_TUH_MEM_ALIGN static uint8_t buf[HID_COUNT][HID_EP_MAX][64];
+  char msg[100];
+
+  for(uint8_t d=0; d<HID_COUNT; d++)
+  {
+    for(uint8_t e=0; e<HID_EP_MAX; e++) edpt_open(HID_ADDR + d, 0x81 + e, TUSB_XFER_BULK, BULK_MPS, 0);
+  }
+
+  // endpoint opened last
+  uint8_t const daddr = HID_ADDR + HID_COUNT - 1;
+  ehci_qhd_t* volatile found = NULL;
+
+  clock_t start = clock();
+  for(uint32_t i=0; i<LOOKUPS; i++) found = qhd_get_from_addr(daddr, 0x80 | HID_EP_MAX);
+  clock_t const lookup_ticks = clock() - start;
+  TEST_ASSERT_EQUAL(daddr, found->dev_addr);
+
+  // only one TD left in pool
+  uint32_t const left = QTD_MAX - qtd_used_count();
+  for(uint32_t i=0; i+1<left; i++) TEST_ASSERT_NOT_NULL(qtd_alloc());
+
+  start = clock();
+  for(uint32_t i=0; i<LOOKUPS; i++)
+  {
+    ehci_qtd_t* qtd = qtd_alloc();
+    qtd_free(qtd);
+  }
+  clock_t const alloc_ticks = clock() - start;
+  TEST_ASSERT_EQUAL(QTD_MAX - 1, qtd_used_count());
+
+  setUp();
+  for(uint8_t d=0; d<HID_COUNT; d++)
+  {
+    for(uint8_t e=0; e<HID_EP_MAX; e++) edpt_open(HID_ADDR + d, 0x81 + e, TUSB_XFER_BULK, BULK_MPS, 0);
+  }
+
+  clock_t submit_ticks = 0;
+  for(uint32_t r=0; r<ROUNDS; r++)
+  {
+    start = clock();
+    for(uint8_t d=0; d<HID_COUNT; d++)
+    {
+      for(uint8_t e=0; e<HID_EP_MAX; e++)
+      {
+        TEST_ASSERT_TRUE(hcd_edpt_xfer(0, HID_ADDR + d, 0x81 + e, buf[d][e], sizeof(buf[d][e])));
+      }
+    }
+    submit_ticks += clock() - start;
+
+    run_until_events(HID_EPS, 64);
+    event_count = 0;
+  }
+
+  sprintf(msg, "%u queue heads: lookup %lu ns, TD alloc+free %lu ns, transfer submit %lu ns",
+          (unsigned) QHD_MAX,
+          (unsigned long) (lookup_ticks * (1000000000.0 / CLOCKS_PER_SEC) / LOOKUPS),
+          (unsigned long) (alloc_ticks * (1000000000.0 / CLOCKS_PER_SEC) / LOOKUPS),
+          (unsigned long) (submit_ticks * (1000000000.0 / CLOCKS_PER_SEC) / (ROUNDS * HID_EPS)));
+  TEST_MESSAGE(msg);
+}
+
+// High speed IN every micro frame: queued transfers continue without gap, resubmitted as they complete
+void test_iso_hs_in_stream(void)
+{
+  enum { PACKETS = 16, XFERS = 12 };
+  CFG_TUH_MEM_ALIGN static uint8_t buf[3][PACKETS*1024];
+  static tuh_iso_packet_t packets[3][PACKETS];
+
+  TEST_ASSERT_TRUE(iso_open(0x84, 1024, 1));
+  dev.iso_interval = 1;
+
+  for(uint32_t i=0; i<3; i++)
+  {
+    for(uint32_t p=0; p<PACKETS; p++) packets[i][p].length = 1024;
+    TEST_ASSERT_TRUE(hcd_edpt_iso_xfer(0, DEV_ADDR, 0x84, buf[i], packets[i], PACKETS));
+  }
+
+  uint8_t seq = 0;
+  uint32_t done = 0;
+  for(uint32_t uf=0; uf<XFERS*PACKETS*2 && done < XFERS; uf++)
+  {
+    ehci_model_run(1);
+    for(uint32_t e=0; e<event_count; e++, done++)
+    {
+      uint32_t const i = done % 3;
+      assert_xfer_event(e, 0x84, XFER_RESULT_SUCCESS, PACKETS*1024);
+
+      for(uint32_t p=0; p<PACKETS; p++)
+      {
+        TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, packets[i][p].result);
+        TEST_ASSERT_EQUAL(1024, packets[i][p].actual_length);
+      }
+      for(uint32_t b=0; b<sizeof(buf[i]); b++) TEST_ASSERT_EQUAL_HEX8(seq++, buf[i][b]);
+
+      TEST_ASSERT_TRUE(hcd_edpt_iso_xfer(0, DEV_ADDR, 0x84, buf[i], packets[i], PACKETS));
+    }
+    event_count = 0;
+  }
+
+  TEST_ASSERT_EQUAL(XFERS, done);
+  TEST_ASSERT_EQUAL(0, dev.iso_gaps);
+
+  // bandwidth is reserved in every micro frame
+  for(uint8_t u=0; u<8; u++) TEST_ASSERT_EQUAL(1024 + BW_HS_OVERHEAD, ehci_data.uframe_load[0][u]);
+
+  // TDs of the current and next frame are kept until their frame has passed
+  TEST_ASSERT_TRUE(hcd_edpt_abort_xfer(0, DEV_ADDR, 0x84));
+  TEST_ASSERT_LESS_OR_EQUAL(ISO_FRAME_MARGIN, iso_td_used_count());
+}
+
+// Full speed OUT through split transactions, packets of different length are contiguous in buffer
+void test_iso_fs_out_split(void)
+{
+  static uint16_t const len[8] = { 192, 100, 0, 192, 50, 192, 1, 192 };
+  CFG_TUH_MEM_ALIGN static uint8_t buf[2][8*192];
+  static tuh_iso_packet_t packets[2][8];
+
+  dev.speed = TUSB_SPEED_FULL;
+  TEST_ASSERT_TRUE(iso_open(0x05, 192, 1));
+  dev.iso_interval = 8;
+
+  // 2 start splits of 188 bytes
+  ehci_iso_ep_t const* ep = iso_ep_find(DEV_ADDR, 0x05);
+  TEST_ASSERT_EQUAL_HEX8(0x03 << ep->phase, ep->smask);
+  TEST_ASSERT_EQUAL_HEX8(0, ep->cmask);
+
+  uint8_t seq = 0;
+  uint32_t total = 0;
+  for(uint32_t i=0; i<2; i++)
+  {
+    uint32_t offset = 0;
+    for(uint32_t p=0; p<8; p++)
+    {
+      packets[i][p].length = len[p];
+      for(uint16_t b=0; b<len[p]; b++) buf[i][offset++] = seq++;
+    }
+    total = offset;
+    TEST_ASSERT_TRUE(hcd_edpt_iso_xfer(0, DEV_ADDR, 0x05, buf[i], packets[i], 8));
+  }
+
+  run_until_events(2, 32*8);
+  assert_xfer_event(0, 0x05, XFER_RESULT_SUCCESS, total);
+  assert_xfer_event(1, 0x05, XFER_RESULT_SUCCESS, total);
+
+  TEST_ASSERT_EQUAL(16, dev.iso_xacts);
+  TEST_ASSERT_EQUAL(0, dev.iso_gaps);
+  for(uint32_t p=0; p<16; p++)
+  {
+    TEST_ASSERT_EQUAL(len[p % 8], dev.iso_out_len[p]);
+    TEST_ASSERT_EQUAL(len[p % 8], packets[p / 8][p % 8].actual_length);
+    TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, packets[p / 8][p % 8].result);
+  }
+
+  // TDs are freed once their frame has passed
+  ehci_model_run(16);
+  TEST_ASSERT_EQUAL(0, iso_td_used_count());
+}
+
+// Full speed IN through split transactions with short packets and a failed transaction
+void test_iso_fs_in_split(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[4*256];
+  static tuh_iso_packet_t packets[4];
+
+  dev.speed = TUSB_SPEED_FULL;
+  TEST_ASSERT_TRUE(iso_open(0x84, 256, 1));
+
+  // start split then complete splits from 2 micro frames later
+  ehci_iso_ep_t const* ep = iso_ep_find(DEV_ADDR, 0x84);
+  TEST_ASSERT_EQUAL_HEX8(0x01 << ep->phase, ep->smask);
+  TEST_ASSERT_EQUAL_HEX8(0x07 << (ep->phase + 2), ep->cmask);
+
+  dev.iso_in_len = 100;
+  dev.iso_err_at = 2;
+  for(uint32_t p=0; p<4; p++) packets[p].length = 256;
+  TEST_ASSERT_TRUE(hcd_edpt_iso_xfer(0, DEV_ADDR, 0x84, buf, packets, 4));
+
+  run_until_events(1, 16*8);
+  assert_xfer_event(0, 0x84, XFER_RESULT_SUCCESS, 300);
+
+  TEST_ASSERT_EQUAL(XFER_RESULT_FAILED, packets[1].result);
+  TEST_ASSERT_EQUAL(0, packets[1].actual_length);
+
+  uint8_t seq = 0;
+  for(uint32_t p=0; p<4; p++)
+  {
+    if ( p == 1 ) continue;
+    TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, packets[p].result);
+    TEST_ASSERT_EQUAL(100, packets[p].actual_length);
+    for(uint32_t b=0; b<100; b++) TEST_ASSERT_EQUAL_HEX8(seq++, buf[p*256 + b]);
+  }
+
+  // idle endpoint restarts as soon as possible
+  ehci_model_run(100);
+  TEST_ASSERT_TRUE(hcd_edpt_iso_xfer(0, DEV_ADDR, 0x84, buf, packets, 4));
+  uint32_t const uframes = run_until_events(2, 16*8);
+  TEST_ASSERT_LESS_OR_EQUAL((ISO_FRAME_MARGIN + 4 + 2) * 8, uframes);
+  assert_xfer_event(1, 0x84, XFER_RESULT_SUCCESS, 400);
+}
+
+// Aborted TDs the controller may still access (current frame up to ISO_FRAME_MARGIN) are not reused before their frame
+// has passed, later ones are released right away
+void test_iso_abort(void)
+{
+  enum { PACKETS = 16 };
+  CFG_TUH_MEM_ALIGN static uint8_t buf[3][PACKETS*1024];
+  static tuh_iso_packet_t packets[3][PACKETS];
+
+  TEST_ASSERT_TRUE(iso_open(0x84, 1024, 1));
+  ehci_iso_ep_t const* ep = iso_ep_find(DEV_ADDR, 0x84);
+
+  for(uint32_t i=0; i<3; i++)
+  {
+    for(uint32_t p=0; p<PACKETS; p++) packets[i][p].length = 1024;
+    TEST_ASSERT_TRUE(hcd_edpt_iso_xfer(0, DEV_ADDR, 0x84, buf[i], packets[i], PACKETS));
+  }
+
+  // abort in the middle of the first frame
+  uint32_t const frame = ehci_data.itd_info[ep->td[ep->td_rd]].frame;
+  while ( hcd_frame_number(0) != frame || (ehci_model_regs.frame_index & 7) < 4 ) ehci_model_run(1);
+  TEST_ASSERT_EQUAL(4, dev.iso_xacts);
+
+  uint8_t kept[ISO_FRAME_MARGIN];
+  for(uint32_t i=0; i<ISO_FRAME_MARGIN; i++) kept[i] = ep->td[(ep->td_rd + i) % ISO_TD_PER_EP];
+
+  TEST_ASSERT_TRUE(hcd_edpt_abort_xfer(0, DEV_ADDR, 0x84));
+  TEST_ASSERT_EQUAL(0, ep->td_count);
+  TEST_ASSERT_EQUAL(0, event_count);
+
+  TEST_ASSERT_EQUAL(ISO_FRAME_MARGIN, iso_td_used_count());
+  for(uint32_t i=0; i<ISO_FRAME_MARGIN; i++)
+  {
+    TEST_ASSERT_TRUE(ehci_data.itd_info[kept[i]].unlinked);
+    TEST_ASSERT_EQUAL(frame + i, ehci_data.itd_info[kept[i]].frame);
+  }
+
+  // restarted stream is scheduled with other TDs
+  for(uint32_t p=0; p<PACKETS; p++) packets[0][p].length = 1024;
+  TEST_ASSERT_TRUE(hcd_edpt_iso_xfer(0, DEV_ADDR, 0x84, buf[0], packets[0], PACKETS));
+  TEST_ASSERT_NOT_EQUAL(0, ep->td_count);
+  for(uint8_t i=0; i<ep->td_count; i++)
+  {
+    uint8_t const idx = ep->td[(ep->td_rd + i) % ISO_TD_PER_EP];
+    for(uint32_t k=0; k<ISO_FRAME_MARGIN; k++) TEST_ASSERT_NOT_EQUAL(kept[k], idx);
+  }
+
+  // unlinked TDs are not executed
+  ehci_model_run(4);
+  TEST_ASSERT_EQUAL(4, dev.iso_xacts);
+
+  run_until_events(1, 16*8);
+  assert_xfer_event(0, 0x84, XFER_RESULT_SUCCESS, PACKETS*1024);
+  TEST_ASSERT_EQUAL(4 + PACKETS, dev.iso_xacts);
+
+  // kept TDs are released once their frame has passed: whole pool but the linked TDs can be allocated
+  uint32_t const linked = ep->td_count;
+  for(uint32_t i=0; i<ITD_MAX - linked; i++) TEST_ASSERT_LESS_THAN(ITD_MAX, iso_td_alloc(ehci_data.itd_info, ITD_MAX));
+  TEST_ASSERT_EQUAL(ITD_MAX, iso_td_alloc(ehci_data.itd_info, ITD_MAX));
+}
+
+// Endpoints are only opened if their bandwidth is available, reserved micro frames are balanced
+void test_iso_bandwidth(void)
+{
+  // 3 x 1024 bytes every micro frame
+  TEST_ASSERT_TRUE(iso_open(0x84, 1024 | (2 << 11), 1));
+  TEST_ASSERT_FALSE(iso_open(0x85, 1024 | (2 << 11), 1));
+  TEST_ASSERT_TRUE(iso_open(0x85, 1024, 1));
+
+  hcd_device_close(0, DEV_ADDR);
+  for(uint8_t u=0; u<8; u++) TEST_ASSERT_EQUAL(0, ehci_data.uframe_load[0][u]);
+
+  // every other micro frame: second endpoint takes the odd ones
+  TEST_ASSERT_TRUE(iso_open(0x84, 1024 | (2 << 11), 2));
+  TEST_ASSERT_TRUE(iso_open(0x85, 1024 | (2 << 11), 2));
+  TEST_ASSERT_NOT_EQUAL(iso_ep_find(DEV_ADDR, 0x84)->phase, iso_ep_find(DEV_ADDR, 0x85)->phase);
+  for(uint8_t u=0; u<8; u++) TEST_ASSERT_EQUAL(3*1024 + BW_HS_OVERHEAD, ehci_data.uframe_load[0][u]);
+
+  // re-open (alternate setting) releases previous reservation
+  TEST_ASSERT_TRUE(iso_open(0x85, 512, 2));
+  hcd_device_close(0, DEV_ADDR);
+  for(uint8_t u=0; u<8; u++) TEST_ASSERT_EQUAL(0, ehci_data.uframe_load[0][u]);
+
+  // no isochronous endpoint left
+  TEST_ASSERT_NULL(iso_ep_find(DEV_ADDR, 0x84));
+  TEST_ASSERT_NULL(iso_ep_find(DEV_ADDR, 0x85));
+}
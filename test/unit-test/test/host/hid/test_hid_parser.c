@@ -0,0 +1,532 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+
+#include "hid_device.h"
+#include "hid_parser.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+#define FIELD_MAX  32
+
+static tuh_hid_field_t fields[FIELD_MAX];
+
+// Composite keyboard + mouse, as used by most wireless receivers
+static uint8_t const desc_kbd_mouse[] =
+{
+  TUD_HID_REPORT_DESC_KEYBOARD( HID_REPORT_ID(1) ),
+  TUD_HID_REPORT_DESC_MOUSE   ( HID_REPORT_ID(2) )
+};
+
+static uint8_t const desc_gamepad[] =
+{
+  TUD_HID_REPORT_DESC_GAMEPAD()
+};
+
+// Representative of a console gamepad: unsigned 8-bit sticks, 4-bit hat, 14 buttons, vendor data and output report
+static uint8_t const desc_console_gamepad[] =
+{
+  HID_USAGE_PAGE   ( HID_USAGE_PAGE_DESKTOP     ),
+  HID_USAGE        ( HID_USAGE_DESKTOP_GAMEPAD  ),
+  HID_COLLECTION   ( HID_COLLECTION_APPLICATION ),
+    HID_REPORT_ID  ( 1 )
+    HID_USAGE        ( HID_USAGE_DESKTOP_X  ),
+    HID_USAGE        ( HID_USAGE_DESKTOP_Y  ),
+    HID_USAGE        ( HID_USAGE_DESKTOP_Z  ),
+    HID_USAGE        ( HID_USAGE_DESKTOP_RZ ),
+    HID_LOGICAL_MIN  ( 0    ),
+    HID_LOGICAL_MAX  ( 0xff ), // encoded as 1 byte i.e -1 if taken as signed
+    HID_REPORT_SIZE  ( 8    ),
+    HID_REPORT_COUNT ( 4    ),
+    HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+    HID_USAGE        ( HID_USAGE_DESKTOP_HAT_SWITCH ),
+    HID_LOGICAL_MAX  ( 7 ),
+    HID_PHYSICAL_MIN ( 0 ),
+    HID_PHYSICAL_MAX_N ( 315, 2 ),
+    HID_REPORT_SIZE  ( 4 ),
+    HID_REPORT_COUNT ( 1 ),
+    HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_NULL_STATE ),
+    HID_USAGE_PAGE   ( HID_USAGE_PAGE_BUTTON ),
+    HID_USAGE_MIN    ( 1  ),
+    HID_USAGE_MAX    ( 14 ),
+    HID_LOGICAL_MAX  ( 1  ),
+    HID_REPORT_SIZE  ( 1  ),
+    HID_REPORT_COUNT ( 14 ),
+    HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+    HID_USAGE_PAGE_N ( HID_USAGE_PAGE_VENDOR, 2 ),
+    HID_USAGE        ( 0x20 ),
+    HID_LOGICAL_MAX  ( 0x3f ),
+    HID_REPORT_SIZE  ( 6 ),
+    HID_REPORT_COUNT ( 1 ),
+    HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+    HID_USAGE_PAGE   ( HID_USAGE_PAGE_DESKTOP ),
+    HID_USAGE        ( HID_USAGE_DESKTOP_RX ),
+    HID_USAGE        ( HID_USAGE_DESKTOP_RY ),
+    HID_LOGICAL_MAX  ( 0xff ),
+    HID_REPORT_SIZE  ( 8 ),
+    HID_REPORT_COUNT ( 2 ),
+    HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+    HID_USAGE_PAGE_N ( HID_USAGE_PAGE_VENDOR, 2 ),
+    HID_USAGE        ( 0x21 ),
+    HID_REPORT_COUNT ( 54 ),
+    HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+    HID_REPORT_ID    ( 5 )
+    HID_USAGE        ( 0x22 ),
+    HID_REPORT_COUNT ( 31 ),
+    HID_OUTPUT       ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+  HID_COLLECTION_END
+};
+
+// Digitizer finger: confidence, tip switch, 2 bit padding, 4 bit contact ID, 16 bit X, Y
+#define DESC_TOUCHPAD_FINGER \
+    HID_USAGE_PAGE   ( HID_USAGE_PAGE_DIGITIZER ),\
+    HID_USAGE        ( 0x22 ), /* Finger */ \
+    HID_COLLECTION   ( HID_COLLECTION_LOGICAL ),\
+      HID_LOGICAL_MIN  ( 0 ),\
+      HID_LOGICAL_MAX  ( 1 ),\
+      HID_USAGE        ( 0x47 ), /* Confidence */ \
+      HID_USAGE        ( 0x42 ), /* Tip Switch */ \
+      HID_REPORT_SIZE  ( 1 ),\
+      HID_REPORT_COUNT ( 2 ),\
+      HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),\
+      HID_INPUT        ( HID_CONSTANT ),\
+      HID_LOGICAL_MAX  ( 15 ),\
+      HID_USAGE        ( 0x51 ), /* Contact Identifier */ \
+      HID_REPORT_SIZE  ( 4 ),\
+      HID_REPORT_COUNT ( 1 ),\
+      HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),\
+      HID_PUSH,\
+        HID_USAGE_PAGE    ( HID_USAGE_PAGE_DESKTOP ),\
+        HID_LOGICAL_MAX_N ( 4095, 2 ),\
+        HID_REPORT_SIZE   ( 16 ),\
+        HID_UNIT_EXPONENT ( 0x0e ),\
+        HID_UNIT          ( 0x11 ),\
+        HID_USAGE         ( HID_USAGE_DESKTOP_X ),\
+        HID_PHYSICAL_MAX_N( 1200, 2 ),\
+        HID_INPUT         ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),\
+        HID_USAGE         ( HID_USAGE_DESKTOP_Y ),\
+        HID_PHYSICAL_MAX_N( 800, 2 ),\
+        HID_INPUT         ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),\
+      HID_POP,\
+    HID_COLLECTION_END
+
+// Representative of a precision touchpad: 2 fingers, scan time, contact count, button and feature report
+static uint8_t const desc_touchpad[] =
+{
+  HID_USAGE_PAGE   ( HID_USAGE_PAGE_DIGITIZER   ),
+  HID_USAGE        ( 0x05                       ), // Touch Pad
+  HID_COLLECTION   ( HID_COLLECTION_APPLICATION ),
+    HID_REPORT_ID  ( 1 )
+    DESC_TOUCHPAD_FINGER,
+    DESC_TOUCHPAD_FINGER,
+    HID_UNIT_EXPONENT ( 0x0c ),
+    HID_UNIT_N        ( 0x1001, 2 ),
+    HID_LOGICAL_MAX_N ( 0xffff, 3 ),
+    HID_REPORT_SIZE   ( 16 ),
+    HID_REPORT_COUNT  ( 1 ),
+    HID_USAGE         ( 0x56 ), // Scan Time
+    HID_INPUT         ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+    HID_LOGICAL_MAX   ( 0x7f ),
+    HID_REPORT_SIZE   ( 8 ),
+    HID_USAGE         ( 0x54 ), // Contact Count
+    HID_INPUT         ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+    HID_USAGE_PAGE    ( HID_USAGE_PAGE_BUTTON ),
+    HID_USAGE         ( 1 ),
+    HID_LOGICAL_MAX   ( 1 ),
+    HID_REPORT_SIZE   ( 1 ),
+    HID_INPUT         ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+    HID_REPORT_SIZE   ( 7 ),
+    HID_INPUT         ( HID_CONSTANT ),
+    HID_REPORT_ID     ( 2 )
+    HID_USAGE_PAGE    ( HID_USAGE_PAGE_DIGITIZER ),
+    HID_USAGE         ( 0x55 ), // Contact Count Maximum
+    HID_USAGE         ( 0x59 ), // Pad Type
+    HID_LOGICAL_MAX   ( 0x0f ),
+    HID_REPORT_SIZE   ( 4 ),
+    HID_REPORT_COUNT  ( 2 ),
+    HID_FEATURE       ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+  HID_COLLECTION_END
+};
+
+void setUp(void)
+{
+  memset(fields, 0xAA, sizeof(fields));
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+static tuh_hid_field_t const* find(uint16_t count, uint8_t report_type, uint16_t usage_page, uint16_t usage, uint16_t* index)
+{
+  tuh_hid_field_t const* field = tuh_hid_field_find(fields, count, report_type, usage_page, usage, index);
+  TEST_ASSERT_NOT_NULL(field);
+  return field;
+}
+
+//--------------------------------------------------------------------+
+// Compile
+//--------------------------------------------------------------------+
+
+void test_keyboard_mouse(void)
+{
+  uint16_t const count = tuh_hid_report_compile(fields, FIELD_MAX, desc_kbd_mouse, sizeof(desc_kbd_mouse));
+
+  // keyboard: modifiers, LEDs, keycodes. Mouse: buttons, X Y, wheel, pan. Padding is not listed
+  TEST_ASSERT_EQUAL(7, count);
+
+  uint16_t index;
+  tuh_hid_field_t const* field;
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_KEYBOARD, 225, &index); // left shift
+  TEST_ASSERT_EQUAL(1, field->report_id);
+  TEST_ASSERT_EQUAL(0, field->bit_offset);
+  TEST_ASSERT_EQUAL(1, field->bit_size);
+  TEST_ASSERT_EQUAL(8, field->count);
+  TEST_ASSERT_EQUAL(224, field->usage_min);
+  TEST_ASSERT_EQUAL(231, field->usage_max);
+  TEST_ASSERT_EQUAL(1, index);
+
+  field = find(count, HID_REPORT_TYPE_OUTPUT, HID_USAGE_PAGE_LED, 2, &index);
+  TEST_ASSERT_EQUAL(0, field->bit_offset);
+  TEST_ASSERT_EQUAL(5, field->count);
+  TEST_ASSERT_EQUAL(1, index);
+
+  // keycode array after modifiers and reserved byte
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_KEYBOARD, 4, &index);
+  TEST_ASSERT_FALSE(field->flags & HID_VARIABLE);
+  TEST_ASSERT_EQUAL(16, field->bit_offset);
+  TEST_ASSERT_EQUAL(8, field->bit_size);
+  TEST_ASSERT_EQUAL(6, field->count);
+  TEST_ASSERT_EQUAL(0, field->usage_min);
+  TEST_ASSERT_EQUAL(255, field->usage_max);
+  TEST_ASSERT_EQUAL(255, field->logical_max);
+
+  // mouse offsets start from 0 for its own report ID
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_DESKTOP, HID_USAGE_DESKTOP_Y, &index);
+  TEST_ASSERT_EQUAL(2, field->report_id);
+  TEST_ASSERT_EQUAL(8, field->bit_offset);
+  TEST_ASSERT_EQUAL(2, field->count);
+  TEST_ASSERT_EQUAL(1, index);
+  TEST_ASSERT_EQUAL(-127, field->logical_min);
+  TEST_ASSERT_EQUAL(127, field->logical_max);
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_CONSUMER, HID_USAGE_CONSUMER_AC_PAN, &index);
+  TEST_ASSERT_EQUAL(32, field->bit_offset);
+
+  // values
+  uint8_t const kbd_report[] = { 1, 0x02, 0, 0x04, 0x05, 0, 0, 0, 0 };
+  uint8_t const mouse_report[] = { 2, 0x01, 0xfb, 0x0a, 0xff, 0x00 };
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_KEYBOARD, 225, &index);
+  TEST_ASSERT_EQUAL(1, tuh_hid_field_value(field, kbd_report, sizeof(kbd_report), index));
+  TEST_ASSERT_EQUAL(0, tuh_hid_field_value(field, kbd_report, sizeof(kbd_report), 0));
+  TEST_ASSERT_FALSE(tuh_hid_field_in_report(field, mouse_report, sizeof(mouse_report)));
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_DESKTOP, HID_USAGE_DESKTOP_X, &index);
+  TEST_ASSERT_EQUAL(-5, tuh_hid_field_value(field, mouse_report, sizeof(mouse_report), 0));
+  TEST_ASSERT_EQUAL(10, tuh_hid_field_value(field, mouse_report, sizeof(mouse_report), 1));
+
+  // mouse report: button 1, X Y, wheel, pan
+  int32_t values[16];
+  TEST_ASSERT_EQUAL(5+2+1+1, tuh_hid_report_decode(fields, count, mouse_report, sizeof(mouse_report), values, 16));
+  int32_t const expected[] = { 1, 0, 0, 0, 0, -5, 10, -1, 0 };
+  TEST_ASSERT_EQUAL_INT32_ARRAY(expected, values, 9);
+
+  // short report: missing elements are 0
+  TEST_ASSERT_EQUAL(0, tuh_hid_field_value(field, mouse_report, 2, 0));
+}
+
+void test_gamepad(void)
+{
+  uint16_t const count = tuh_hid_report_compile(fields, FIELD_MAX, desc_gamepad, sizeof(desc_gamepad));
+  // X Y Z, Rz, Rx Ry are runs of consecutive usages, then hat and buttons
+  TEST_ASSERT_EQUAL(5, count);
+
+  uint16_t index;
+  tuh_hid_field_t const* field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_BUTTON, 32, &index);
+  TEST_ASSERT_EQUAL(56, field->bit_offset);
+  TEST_ASSERT_EQUAL(32, field->count);
+  TEST_ASSERT_EQUAL(31, index);
+
+  uint8_t const report[] = { 0x80, 0x7f, 1, 2, 3, 4, 5, 0x01, 0x00, 0x00, 0x80 };
+  TEST_ASSERT_EQUAL(1, tuh_hid_field_value(field, report, sizeof(report), 0));
+  TEST_ASSERT_EQUAL(1, tuh_hid_field_value(field, report, sizeof(report), index));
+  TEST_ASSERT_EQUAL(0, tuh_hid_field_value(field, report, sizeof(report), 1));
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_DESKTOP, HID_USAGE_DESKTOP_X, &index);
+  TEST_ASSERT_EQUAL(-128, tuh_hid_field_value(field, report, sizeof(report), 0));
+  TEST_ASSERT_EQUAL(127, tuh_hid_field_value(field, report, sizeof(report), 1));
+}
+
+void test_console_gamepad(void)
+{
+  uint16_t const count = tuh_hid_report_compile(fields, FIELD_MAX, desc_console_gamepad, sizeof(desc_console_gamepad));
+  TEST_ASSERT_EQUAL(8, count);
+
+  uint16_t index;
+  tuh_hid_field_t const* field;
+
+  // X Y Z then Rz as separate run
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_DESKTOP, HID_USAGE_DESKTOP_Z, &index);
+  TEST_ASSERT_EQUAL(3, field->count);
+  TEST_ASSERT_EQUAL(0, field->logical_min);
+  TEST_ASSERT_EQUAL(255, field->logical_max);
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_DESKTOP, HID_USAGE_DESKTOP_HAT_SWITCH, &index);
+  TEST_ASSERT_EQUAL(32, field->bit_offset);
+  TEST_ASSERT_EQUAL(4, field->bit_size);
+  TEST_ASSERT(field->flags & HID_NULL_STATE);
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_BUTTON, 1, &index);
+  TEST_ASSERT_EQUAL(36, field->bit_offset);
+  TEST_ASSERT_EQUAL(14, field->count);
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_VENDOR, 0x20, &index);
+  TEST_ASSERT_EQUAL(50, field->bit_offset);
+  TEST_ASSERT_EQUAL(6, field->bit_size);
+
+  field = find(count, HID_REPORT_TYPE_OUTPUT, HID_USAGE_PAGE_VENDOR, 0x22, &index);
+  TEST_ASSERT_EQUAL(5, field->report_id);
+  TEST_ASSERT_EQUAL(0, field->bit_offset);
+  TEST_ASSERT_EQUAL(31, field->count);
+
+  // sticks at 0x80, hat 8 (null), buttons 2 and 14, counter 0x2a (bits straddle a byte boundary)
+  uint8_t report[64] = { 1, 0x80, 0x80, 0x80, 0x80 };
+  report[5] = 0x08 | (0x2 << 4);      // hat, button 1-4
+  report[6] = 0x00;                   // button 5-12
+  report[7] = 0x02 | ((0x2a & 0x3f) << 2); // button 13-14, counter
+  report[8] = 0x11;
+  report[9] = 0xff;
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_DESKTOP, HID_USAGE_DESKTOP_X, &index);
+  TEST_ASSERT_EQUAL(128, tuh_hid_field_value(field, report, sizeof(report), 0)); // not sign extended
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_DESKTOP, HID_USAGE_DESKTOP_HAT_SWITCH, &index);
+  TEST_ASSERT_EQUAL(8, tuh_hid_field_value(field, report, sizeof(report), 0));
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_BUTTON, 2, &index);
+  TEST_ASSERT_EQUAL(1, tuh_hid_field_value(field, report, sizeof(report), index));
+  TEST_ASSERT_EQUAL(1, tuh_hid_field_value(field, report, sizeof(report), 13));
+  TEST_ASSERT_EQUAL(0, tuh_hid_field_value(field, report, sizeof(report), 12));
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_VENDOR, 0x20, &index);
+  TEST_ASSERT_EQUAL(0x2a, tuh_hid_field_value(field, report, sizeof(report), 0));
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_DESKTOP, HID_USAGE_DESKTOP_RY, &index);
+  TEST_ASSERT_EQUAL(255, tuh_hid_field_value(field, report, sizeof(report), index));
+
+  // all input elements: 4 + 1 + 14 + 1 + 2 + 54
+  int32_t values[128];
+  TEST_ASSERT_EQUAL(76, tuh_hid_report_decode(fields, count, report, sizeof(report), values, 128));
+}
+
+void test_touchpad(void)
+{
+  uint16_t const count = tuh_hid_report_compile(fields, FIELD_MAX, desc_touchpad, sizeof(desc_touchpad));
+
+  // per finger: confidence, tip, contact ID, X, Y. Then scan time, contact count, button and 2 features
+  TEST_ASSERT_EQUAL(2*5 + 3 + 2, count);
+
+  // second finger is 40 bits after the first one
+  TEST_ASSERT_EQUAL(HID_USAGE_PAGE_DESKTOP, fields[3].usage_page);
+  TEST_ASSERT_EQUAL(HID_USAGE_DESKTOP_X, fields[3].usage_min);
+  TEST_ASSERT_EQUAL(8, fields[3].bit_offset);
+  TEST_ASSERT_EQUAL(4095, fields[3].logical_max);
+  TEST_ASSERT_EQUAL(24, fields[4].bit_offset);
+  TEST_ASSERT_EQUAL(40, fields[5].bit_offset);
+  TEST_ASSERT_EQUAL(48, fields[8].bit_offset);
+
+  // page and logical maximum are restored by Pop
+  uint16_t index;
+  tuh_hid_field_t const* field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_DIGITIZER, 0x56, &index);
+  TEST_ASSERT_EQUAL(80, field->bit_offset);
+  TEST_ASSERT_EQUAL(16, field->bit_size);
+  TEST_ASSERT_EQUAL(0xffff, field->logical_max);
+
+  field = find(count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_BUTTON, 1, &index);
+  TEST_ASSERT_EQUAL(104, field->bit_offset);
+
+  field = find(count, HID_REPORT_TYPE_FEATURE, HID_USAGE_PAGE_DIGITIZER, 0x59, &index);
+  TEST_ASSERT_EQUAL(2, field->report_id);
+  TEST_ASSERT_EQUAL(4, field->bit_offset);
+  TEST_ASSERT_EQUAL(0, index);
+  TEST_ASSERT_NULL(tuh_hid_field_find(fields, count, HID_REPORT_TYPE_INPUT, HID_USAGE_PAGE_DIGITIZER, 0x59, NULL));
+
+  // finger 1 at (0x123, 0x456) ID 3, finger 2 at (0xabc, 0x0de) ID 7 tip only, scan time 0x1234, 2 contacts, button
+  uint8_t const report[] = { 1, 0x33, 0x23, 0x01, 0x56, 0x04, 0x72, 0xbc, 0x0a, 0xde, 0x00, 0x34, 0x12, 0x02, 0x01 };
+  int32_t values[16];
+  TEST_ASSERT_EQUAL(2*5 + 3, tuh_hid_report_decode(fields, count, report, sizeof(report), values, 16));
+
+  int32_t const expected[] = { 1, 1, 3, 0x123, 0x456, 0, 1, 7, 0xabc, 0x0de, 0x1234, 2, 1 };
+  TEST_ASSERT_EQUAL_INT32_ARRAY(expected, values, 13);
+}
+
+void test_usage_repeat(void)
+{
+  // last usage applies to remaining elements: X Y Y Y
+  uint8_t const desc[] =
+  {
+    HID_USAGE_PAGE   ( HID_USAGE_PAGE_DESKTOP ),
+    HID_USAGE        ( HID_USAGE_DESKTOP_X ),
+    HID_USAGE        ( HID_USAGE_DESKTOP_Y ),
+    HID_REPORT_SIZE  ( 8 ),
+    HID_REPORT_COUNT ( 4 ),
+    HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+    // extended usage (page in upper 16 bits) overrides usage page
+    HID_USAGE_N      ( (HID_USAGE_PAGE_BUTTON << 16) | 3, 3 ),
+    HID_REPORT_COUNT ( 1 ),
+    HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+  };
+
+  uint16_t const count = tuh_hid_report_compile(fields, FIELD_MAX, desc, sizeof(desc));
+  TEST_ASSERT_EQUAL(2, count);
+  TEST_ASSERT_EQUAL(4, fields[0].count);
+  TEST_ASSERT_EQUAL(HID_USAGE_DESKTOP_Y, fields[0].usage_max);
+  TEST_ASSERT_EQUAL(HID_USAGE_PAGE_BUTTON, fields[1].usage_page);
+  TEST_ASSERT_EQUAL(3, fields[1].usage_min);
+  TEST_ASSERT_EQUAL(32, fields[1].bit_offset);
+
+  // fields that do not fit are dropped
+  TEST_ASSERT_EQUAL(1, tuh_hid_report_compile(fields, 1, desc, sizeof(desc)));
+}
+
+void test_malformed(void)
+{
+  // truncated
+  TEST_ASSERT_EQUAL(0, tuh_hid_report_compile(fields, FIELD_MAX, desc_gamepad, sizeof(desc_gamepad)-2));
+
+  // unbalanced collection
+  uint8_t const desc_collection[] = { HID_COLLECTION(HID_COLLECTION_APPLICATION), HID_COLLECTION_END, HID_COLLECTION_END };
+  TEST_ASSERT_EQUAL(0, tuh_hid_report_compile(fields, FIELD_MAX, desc_collection, sizeof(desc_collection)));
+
+  // pop without push
+  uint8_t const desc_pop[] = { HID_POP };
+  TEST_ASSERT_EQUAL(0, tuh_hid_report_compile(fields, FIELD_MAX, desc_pop, sizeof(desc_pop)));
+
+  // reserved report ID 0
+  uint8_t const desc_id[] = { HID_REPORT_ID(0) HID_REPORT_SIZE(8), HID_REPORT_COUNT(1), HID_INPUT(HID_CONSTANT) };
+  TEST_ASSERT_EQUAL(0, tuh_hid_report_compile(fields, FIELD_MAX, desc_id, sizeof(desc_id)));
+}
+
+void test_report_changed(void)
+{
+  uint16_t const count = tuh_hid_report_compile(fields, FIELD_MAX, desc_console_gamepad, sizeof(desc_console_gamepad));
+
+  // mask out the 6-bit vendor counter which changes every report
+  uint16_t masked = 0;
+  tuh_hid_field_t masked_fields[FIELD_MAX];
+  for(uint16_t i=0; i<count; i++)
+  {
+    if ( !(fields[i].usage_page == HID_USAGE_PAGE_VENDOR && fields[i].usage_min == 0x20) ) masked_fields[masked++] = fields[i];
+  }
+  TEST_ASSERT_EQUAL(count-1, masked);
+
+  uint8_t prev[64] = { 1, 0x80, 0x80, 0x80, 0x80, 0x08 };
+  uint8_t report[64];
+
+  // counter only: all bytes differ, masked fields do not
+  memcpy(report, prev, sizeof(report));
+  report[7] = (uint8_t) (report[7] + (1 << 2));
+  TEST_ASSERT_TRUE (tuh_hid_report_changed(NULL, 0, report, prev, sizeof(report)));
+  TEST_ASSERT_FALSE(tuh_hid_report_changed(masked_fields, masked, report, prev, sizeof(report)));
+
+  // button 14 shares the byte with the counter
+  report[7] |= 0x02;
+  TEST_ASSERT_TRUE(tuh_hid_report_changed(masked_fields, masked, report, prev, sizeof(report)));
+
+  // vendor data at the end of report
+  memcpy(report, prev, sizeof(report));
+  report[63] = 1;
+  TEST_ASSERT_TRUE(tuh_hid_report_changed(masked_fields, masked, report, prev, sizeof(report)));
+
+  // report with ID not in fields is compared entirely
+  uint8_t const other_prev[] = { 3, 1, 2 };
+  uint8_t const other[]      = { 3, 1, 3 };
+  TEST_ASSERT_TRUE (tuh_hid_report_changed(masked_fields, masked, other, other_prev, sizeof(other)));
+  TEST_ASSERT_FALSE(tuh_hid_report_changed(masked_fields, masked, other_prev, other_prev, sizeof(other)));
+}
+
+//--------------------------------------------------------------------+
+// Benchmark: decoding with compiled fields vs parsing descriptor for every report
+//--------------------------------------------------------------------+
+
+#define BENCH_ITERATIONS  20000
+
+static double bench_one(uint8_t const* desc, uint16_t desc_len, uint8_t const* report, uint16_t len)
+{
+  int32_t values[128];
+  volatile int32_t sink = 0;
+
+  clock_t start = clock();
+  for(uint32_t i=0; i<BENCH_ITERATIONS; i++)
+  {
+    uint16_t const count = tuh_hid_report_compile(fields, FIELD_MAX, desc, desc_len);
+    sink += tuh_hid_report_decode(fields, count, report, len, values, 128);
+  }
+  double const parse_ns = (double) (clock() - start) * 1e9 / CLOCKS_PER_SEC / BENCH_ITERATIONS;
+
+  uint16_t const count = tuh_hid_report_compile(fields, FIELD_MAX, desc, desc_len);
+  start = clock();
+  for(uint32_t i=0; i<BENCH_ITERATIONS; i++)
+  {
+    sink += tuh_hid_report_decode(fields, count, report, len, values, 128);
+  }
+  double const decode_ns = (double) (clock() - start) * 1e9 / CLOCKS_PER_SEC / BENCH_ITERATIONS;
+
+  (void) sink;
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "desc %u bytes, %u fields: parse+decode %.0f ns, decode %.0f ns per report",
+           desc_len, count, parse_ns, decode_ns);
+  TEST_MESSAGE(msg);
+
+  return parse_ns / (decode_ns > 0 ? decode_ns : 1);
+}
+
+void test_benchmark(void)
+{
+  uint8_t report[64] = { 1 };
+
+  double const ratio_gamepad  = bench_one(desc_console_gamepad, sizeof(desc_console_gamepad), report, sizeof(report));
+  double const ratio_keyboard = bench_one(desc_kbd_mouse, sizeof(desc_kbd_mouse), report, 9);
+  double const ratio_touchpad = bench_one(desc_touchpad, sizeof(desc_touchpad), report, 15);
+
+  // decoding a report with compiled fields must be well ahead of parsing the descriptor again
+  TEST_ASSERT(ratio_gamepad  > 1.5);
+  TEST_ASSERT(ratio_keyboard > 1.5);
+  TEST_ASSERT(ratio_touchpad > 1.5);
+}
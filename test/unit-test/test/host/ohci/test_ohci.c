@@ -0,0 +1,762 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+#include "unity.h"
+
+// OHCI host with 2 devices + 1 hub: 8 EDs shared by 12 general TDs and 6 isochronous TDs
+#define CFG_TUSB_MCU            OPT_MCU_LPC175X_6X
+#define CFG_TUSB_RHPORT0_MODE   OPT_MODE_HOST
+#define CFG_TUH_DEVICE_MAX      2
+#define CFG_TUH_HUB             1
+#define CFG_TUH_ENDPOINT_MAX    4
+#define CFG_TUH_OHCI_GTD_MAX    12
+#define CFG_TUH_OHCI_ITD_MAX    6
+
+// Controller registers are plain memory, see ohci_regs_access()
+static volatile void* ohci_regs_access(void);
+#define LPC_USB_BASE            ohci_regs_access()
+
+#include "portable/ohci/ohci.c"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EVENT_MAX = 16,
+  DEV_ADDR  = 1,
+  DEV2_ADDR = 2,
+  HUB_ADDR  = CFG_TUH_DEVICE_MAX + 1,
+  BULK_MPS  = 64,
+};
+
+static hcd_event_t events[EVENT_MAX];
+static uint32_t    event_count;
+
+static ohci_registers_t regs;
+static uint32_t         done_head; // TDs retired by controller, not written back to HCCA yet
+
+//--------------------------------------------------------------------+
+// Stubs for usbh
+//--------------------------------------------------------------------+
+
+void hcd_event_handler(hcd_event_t const* event, bool in_isr)
+{
+  TEST_ASSERT_TRUE(in_isr);
+  TEST_ASSERT_LESS_THAN(EVENT_MAX, event_count);
+  events[event_count++] = *event;
+}
+
+void hcd_int_enable(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+void hcd_int_disable(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+void hcd_devtree_get_info(uint8_t dev_addr, hcd_devtree_info_t* devtree_info)
+{
+  (void) dev_addr;
+  devtree_info->rhport   = 0;
+  devtree_info->hub_addr = 0;
+  devtree_info->hub_port = 0;
+  devtree_info->speed    = TUSB_SPEED_FULL;
+}
+
+//--------------------------------------------------------------------+
+// Simulated controller
+//--------------------------------------------------------------------+
+
+// Controller runs on every register access: reset completes at once and a frame passes, driver waiting for
+// the reset or the next frame does not block.
+static volatile void* ohci_regs_access(void)
+{
+  regs.command_status_bit.controller_reset = 0;
+  regs.frame_number = (regs.frame_number + 1) & 0xFFFF;
+  return &regs;
+}
+
+// Controller retires the TD at head of an ED onto done queue, ED is halted on error
+static ohci_td_item_t* hc_retire(ohci_ed_t* ed, bool halt)
+{
+  ohci_td_item_t* td = (ohci_td_item_t*) (uintptr_t) tu_align16(ed->td_head.address);
+  TEST_ASSERT_NOT_NULL(td);
+  TEST_ASSERT_NOT_EQUAL(tu_align16(ed->td_tail), (uint32_t) (uintptr_t) td);
+
+  uint32_t const next = td->next;
+  td->next  = done_head;
+  done_head = (uint32_t) (uintptr_t) td;
+
+  ed->td_head.address = (ed->td_head.address & 0x0Eul) | next | (halt ? 1 : 0);
+
+  return td;
+}
+
+// Controller retires the general TD at head of an ED with condition code and remaining bytes
+static void hc_retire_gtd(ohci_ed_t* ed, uint8_t ccode, uint16_t remaining)
+{
+  ohci_gtd_t* gtd = (ohci_gtd_t*) (uintptr_t) tu_align16(ed->td_head.address);
+
+  gtd->condition_code         = ccode;
+  gtd->current_buffer_pointer = remaining ? (gtd->buffer_end - remaining + 1) : 0;
+
+  hc_retire(ed, ccode != OHCI_CCODE_NO_ERROR);
+}
+
+// Controller writes back done queue to HCCA and raises interrupt
+static void hc_writeback_done(void)
+{
+  ohci_data.hcca.done_head = done_head;
+  done_head = 0;
+
+  regs.interrupt_enable = OHCI_INT_WRITEBACK_DONEHEAD_MASK | OHCI_INT_MASTER_ENABLE_MASK;
+  regs.interrupt_status = OHCI_INT_WRITEBACK_DONEHEAD_MASK;
+  hcd_int_handler(0);
+}
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+static bool edpt_open(uint8_t dev_addr, uint8_t ep_addr, uint8_t xfer_type, uint16_t mps)
+{
+  tusb_desc_endpoint_t const desc_ep =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = ep_addr,
+    .bmAttributes     = { .xfer = xfer_type },
+    .wMaxPacketSize   = mps,
+    .bInterval        = 1
+  };
+  return hcd_edpt_open(0, dev_addr, &desc_ep);
+}
+
+static uint32_t ed_free_count(void)
+{
+  uint32_t count = 0;
+  for(ohci_ed_t const* ed = ohci_data.ed_free; ed; ed = (ohci_ed_t const*) (uintptr_t) ed->td_tail) count++;
+  return count;
+}
+
+static uint32_t gtd_free_count(void)
+{
+  uint32_t count = 0;
+  for(ohci_gtd_t const* gtd = ohci_data.gtd_free; gtd; gtd = (ohci_gtd_t const*) (uintptr_t) gtd->next) count++;
+  return count;
+}
+
+static uint32_t itd_free_count(void)
+{
+  uint32_t count = 0;
+  for(ochi_itd_t const* itd = ohci_data.itd_free; itd; itd = (ochi_itd_t const*) (uintptr_t) itd->next) count++;
+  return count;
+}
+
+static uint32_t ed_index_count(void)
+{
+  uint32_t count = 0;
+  for(uint32_t d=0; d<ED_INDEX_DEV; d++)
+  {
+    for(uint32_t i=0; i<ED_INDEX_EP; i++) count += (ohci_data.ed_index[d][i] ? 1 : 0);
+  }
+  return count;
+}
+
+static bool ed_list_has(ohci_ed_t const* head, ohci_ed_t const* ed)
+{
+  for(ohci_ed_t const* p = head; p->next; )
+  {
+    p = (ohci_ed_t const*) (uintptr_t) p->next;
+    if ( p == ed ) return true;
+  }
+  return false;
+}
+
+static void assert_xfer_event(uint32_t idx, uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t len)
+{
+  TEST_ASSERT_EQUAL(HCD_EVENT_XFER_COMPLETE, events[idx].event_id);
+  TEST_ASSERT_EQUAL(dev_addr, events[idx].dev_addr);
+  TEST_ASSERT_EQUAL_HEX8(ep_addr, events[idx].xfer_complete.ep_addr);
+  TEST_ASSERT_EQUAL(result, events[idx].xfer_complete.result);
+  TEST_ASSERT_EQUAL(len, events[idx].xfer_complete.len);
+}
+
+void setUp(void)
+{
+  tu_memclr((void*) &regs, sizeof(regs));
+  done_head   = 0;
+  event_count = 0;
+
+  TEST_ASSERT_TRUE(hcd_init(0));
+
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x00, TUSB_XFER_CONTROL, 64));
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+void test_init_free_lists(void)
+{
+  TEST_ASSERT_EQUAL(ED_MAX, ed_free_count());
+  TEST_ASSERT_EQUAL(GTD_MAX, gtd_free_count());
+  TEST_ASSERT_EQUAL(ITD_MAX, itd_free_count());
+  TEST_ASSERT_EQUAL(0, ed_index_count());
+
+  TEST_ASSERT_EQUAL_HEX32((uintptr_t) &ohci_data.hcca, regs.hcca);
+  TEST_ASSERT_EQUAL_HEX32((uintptr_t) &ohci_data.control[0].ed, regs.control_head_ed);
+  TEST_ASSERT_EQUAL_HEX32((uintptr_t) &ohci_data.bulk_head_ed, regs.bulk_head_ed);
+
+  // control endpoint has reserved ED and TD
+  TEST_ASSERT_TRUE(ed_list_has(p_ed_head[TUSB_XFER_CONTROL], &ohci_data.control[DEV_ADDR].ed));
+}
+
+void test_edpt_open(void)
+{
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS));
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x01, TUSB_XFER_BULK, BULK_MPS));
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x8F, TUSB_XFER_INTERRUPT, 8));
+
+  ohci_ed_t* ed_in  = ed_from_addr(DEV_ADDR, 0x81);
+  ohci_ed_t* ed_out = ed_from_addr(DEV_ADDR, 0x01);
+  ohci_ed_t* ed_int = ed_from_addr(DEV_ADDR, 0x8F);
+
+  TEST_ASSERT_NOT_NULL(ed_in);
+  TEST_ASSERT_NOT_NULL(ed_out);
+  TEST_ASSERT_NOT_NULL(ed_int);
+  TEST_ASSERT_TRUE(ed_in != ed_out);
+  TEST_ASSERT_EQUAL(PID_IN, ed_in->pid);
+  TEST_ASSERT_EQUAL(PID_OUT, ed_out->pid);
+  TEST_ASSERT_EQUAL(15, ed_int->ep_number);
+
+  // index holds pool index + 1
+  TEST_ASSERT_EQUAL(ed_in - ohci_data.ed_pool + 1, ohci_data.ed_index[DEV_ADDR-1][1]);
+  TEST_ASSERT_EQUAL(ed_out - ohci_data.ed_pool + 1, ohci_data.ed_index[DEV_ADDR-1][0]);
+  TEST_ASSERT_EQUAL(ed_int - ohci_data.ed_pool + 1, ohci_data.ed_index[DEV_ADDR-1][29]);
+  TEST_ASSERT_EQUAL(3, ed_index_count());
+
+  // not opened
+  TEST_ASSERT_NULL(ed_from_addr(DEV_ADDR, 0x02));
+  TEST_ASSERT_NULL(ed_from_addr(DEV2_ADDR, 0x81));
+
+  TEST_ASSERT_TRUE(ed_list_has(p_ed_head[TUSB_XFER_BULK], ed_in));
+  TEST_ASSERT_TRUE(ed_list_has(p_ed_head[TUSB_XFER_BULK], ed_out));
+  TEST_ASSERT_TRUE(ed_list_has(p_ed_head[TUSB_XFER_INTERRUPT], ed_int));
+
+  // each ED holds a dummy TD: empty queue
+  TEST_ASSERT_EQUAL(ED_MAX - 3, ed_free_count());
+  TEST_ASSERT_EQUAL(GTD_MAX - 3, gtd_free_count());
+  TEST_ASSERT_NOT_EQUAL(0, ed_in->td_tail);
+  TEST_ASSERT_EQUAL_HEX32(ed_in->td_tail, ed_in->td_head.address);
+}
+
+void test_device_close(void)
+{
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS));
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x83, TUSB_XFER_INTERRUPT, 8));
+  TEST_ASSERT_TRUE(edpt_open(DEV2_ADDR, 0x00, TUSB_XFER_CONTROL, 64));
+  TEST_ASSERT_TRUE(edpt_open(DEV2_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS));
+
+  ohci_ed_t* ed_in  = ed_from_addr(DEV_ADDR, 0x81);
+  ohci_ed_t* ed_int = ed_from_addr(DEV_ADDR, 0x83);
+  ohci_ed_t* ed2_in = ed_from_addr(DEV2_ADDR, 0x81);
+
+  hcd_device_close(0, DEV_ADDR);
+
+  TEST_ASSERT_NULL(ed_from_addr(DEV_ADDR, 0x81));
+  TEST_ASSERT_NULL(ed_from_addr(DEV_ADDR, 0x83));
+  TEST_ASSERT_FALSE(ed_list_has(p_ed_head[TUSB_XFER_CONTROL], &ohci_data.control[DEV_ADDR].ed));
+  TEST_ASSERT_FALSE(ed_list_has(p_ed_head[TUSB_XFER_BULK], ed_in));
+  TEST_ASSERT_FALSE(ed_list_has(p_ed_head[TUSB_XFER_INTERRUPT], ed_int));
+  TEST_ASSERT_FALSE(ed_in->used);
+  TEST_ASSERT_TRUE(ed_in->skip);
+
+  // other device is untouched
+  TEST_ASSERT_EQUAL_PTR(ed2_in, ed_from_addr(DEV2_ADDR, 0x81));
+  TEST_ASSERT_TRUE(ed_list_has(p_ed_head[TUSB_XFER_CONTROL], &ohci_data.control[DEV2_ADDR].ed));
+  TEST_ASSERT_TRUE(ed_list_has(p_ed_head[TUSB_XFER_BULK], ed2_in));
+  TEST_ASSERT_EQUAL(1, ed_index_count());
+
+  // EDs and their dummy TDs are back to free lists
+  TEST_ASSERT_EQUAL(ED_MAX - 1, ed_free_count());
+  TEST_ASSERT_EQUAL(GTD_MAX - 1, gtd_free_count());
+
+  hcd_device_close(0, DEV2_ADDR);
+  TEST_ASSERT_EQUAL(ED_MAX, ed_free_count());
+  TEST_ASSERT_EQUAL(GTD_MAX, gtd_free_count());
+  TEST_ASSERT_EQUAL(0, ed_index_count());
+}
+
+// New device enumerated at the address of a closed one must not see its endpoints
+void test_reopen_same_address(void)
+{
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS));
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x02, TUSB_XFER_BULK, BULK_MPS));
+  hcd_device_close(0, DEV_ADDR);
+
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x00, TUSB_XFER_CONTROL, 64));
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x82, TUSB_XFER_INTERRUPT, 8));
+
+  TEST_ASSERT_NULL(ed_from_addr(DEV_ADDR, 0x81));
+  TEST_ASSERT_NULL(ed_from_addr(DEV_ADDR, 0x02));
+  TEST_ASSERT_NOT_NULL(ed_from_addr(DEV_ADDR, 0x82));
+  TEST_ASSERT_EQUAL(1, ed_index_count());
+
+  TEST_ASSERT_EQUAL(ED_MAX - 1, ed_free_count());
+  TEST_ASSERT_EQUAL(GTD_MAX - 1, gtd_free_count());
+}
+
+void test_hub_address(void)
+{
+  // hub address is last one with index entries
+  TEST_ASSERT_TRUE(edpt_open(HUB_ADDR, 0x81, TUSB_XFER_INTERRUPT, 1));
+  TEST_ASSERT_NOT_NULL(ed_from_addr(HUB_ADDR, 0x81));
+  TEST_ASSERT_EQUAL(ED_MAX - 1, ed_free_count());
+
+  TEST_ASSERT_FALSE(edpt_open(HUB_ADDR + 1, 0x81, TUSB_XFER_INTERRUPT, 1));
+  TEST_ASSERT_NULL(ed_from_addr(HUB_ADDR + 1, 0x81));
+  TEST_ASSERT_EQUAL(ED_MAX - 1, ed_free_count());
+  TEST_ASSERT_EQUAL(GTD_MAX - 1, gtd_free_count());
+}
+
+void test_ed_pool_exhausted(void)
+{
+  for(uint8_t i=0; i<ED_MAX; i++)
+  {
+    TEST_ASSERT_TRUE(edpt_open(1 + i % 2, 0x81 + i / 2, TUSB_XFER_BULK, BULK_MPS));
+  }
+  TEST_ASSERT_EQUAL(0, ed_free_count());
+  TEST_ASSERT_EQUAL(GTD_MAX - ED_MAX, gtd_free_count());
+
+  TEST_ASSERT_FALSE(edpt_open(DEV_ADDR, 0x01, TUSB_XFER_BULK, BULK_MPS));
+  TEST_ASSERT_NULL(ed_from_addr(DEV_ADDR, 0x01));
+  TEST_ASSERT_EQUAL(GTD_MAX - ED_MAX, gtd_free_count());
+
+  // EDs of closed device are available again
+  hcd_device_close(0, DEV2_ADDR);
+  TEST_ASSERT_EQUAL(ED_MAX / 2, ed_free_count());
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x01, TUSB_XFER_BULK, BULK_MPS));
+}
+
+// ED is released when no dummy TD is available
+void test_gtd_pool_exhausted_on_open(void)
+{
+  ohci_gtd_t* gtds[GTD_MAX];
+  for(uint32_t i=0; i<GTD_MAX; i++) TEST_ASSERT_NOT_NULL(gtds[i] = gtd_alloc());
+  TEST_ASSERT_NULL(gtd_alloc());
+
+  TEST_ASSERT_FALSE(edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS));
+  TEST_ASSERT_NULL(ed_from_addr(DEV_ADDR, 0x81));
+  TEST_ASSERT_EQUAL(0, ed_index_count());
+  TEST_ASSERT_EQUAL(ED_MAX, ed_free_count());
+  TEST_ASSERT_FALSE(ed_list_has(p_ed_head[TUSB_XFER_BULK], &ohci_data.ed_pool[0]));
+
+  for(uint32_t i=0; i<GTD_MAX; i++) gtd_free(gtds[i]);
+  TEST_ASSERT_EQUAL(GTD_MAX, gtd_free_count());
+
+  // freeing twice must not corrupt free list
+  gtd_free(gtds[0]);
+  TEST_ASSERT_EQUAL(GTD_MAX, gtd_free_count());
+
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS));
+}
+
+void test_control_transfer(void)
+{
+  static uint8_t const setup[8] = { 0x80, 0x06, 0x00, 0x01, 0x00, 0x00, 18, 0x00 };
+  CFG_TUH_MEM_ALIGN static uint8_t desc[18];
+
+  TEST_ASSERT_TRUE(hcd_setup_send(0, DEV_ADDR, setup));
+  TEST_ASSERT_TRUE(regs.command_status_bit.control_list_filled);
+  hc_retire_gtd(&ohci_data.control[DEV_ADDR].ed, OHCI_CCODE_NO_ERROR, 0);
+  hc_writeback_done();
+  TEST_ASSERT_EQUAL(1, event_count);
+  assert_xfer_event(0, DEV_ADDR, 0x00, XFER_RESULT_SUCCESS, 8);
+
+  // short data stage is not an error
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x80, desc, sizeof(desc)));
+  hc_retire_gtd(&ohci_data.control[DEV_ADDR].ed, OHCI_CCODE_NO_ERROR, 10);
+  hc_writeback_done();
+  TEST_ASSERT_EQUAL(2, event_count);
+  assert_xfer_event(1, DEV_ADDR, 0x80, XFER_RESULT_SUCCESS, 8);
+
+  // control TDs are not pooled
+  TEST_ASSERT_EQUAL(GTD_MAX, gtd_free_count());
+}
+
+//--------------------------------------------------------------------+
+// General TD queue
+//--------------------------------------------------------------------+
+
+static ohci_gtd_t* ed_head_gtd(ohci_ed_t const* ed)
+{
+  return (ohci_gtd_t*) (uintptr_t) tu_align16(ed->td_head.address);
+}
+
+// Transfer is split into TDs of up to two 4 KB pages, all but the last one are a multiple of max packet size
+void test_bulk_xfer_chunked(void)
+{
+  TU_ATTR_ALIGNED(4096) static uint8_t buf[3*4096];
+
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS));
+  ohci_ed_t* ed = ed_from_addr(DEV_ADDR, 0x81);
+
+  // dummy TD takes first part, a new TD is taken for the second part and the new dummy
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf + 100, 10000));
+  TEST_ASSERT_TRUE(regs.command_status_bit.bulk_list_filled);
+  TEST_ASSERT_EQUAL(GTD_MAX - 3, gtd_free_count());
+
+  ohci_gtd_t* gtd0 = ed_head_gtd(ed);
+  ohci_gtd_t* gtd1 = (ohci_gtd_t*) (uintptr_t) gtd0->next;
+  ohci_gtd_t* dummy = (ohci_gtd_t*) (uintptr_t) gtd1->next;
+
+  TEST_ASSERT_EQUAL(8064, gtd0->expected_bytes);
+  TEST_ASSERT_EQUAL_HEX32((uintptr_t) (buf + 100), gtd0->current_buffer_pointer);
+  TEST_ASSERT_EQUAL_HEX32((uintptr_t) (buf + 100 + 8064 - 1), gtd0->buffer_end);
+  TEST_ASSERT_FALSE(gtd0->xfer_end);
+  TEST_ASSERT_FALSE(gtd0->buffer_rounding);
+
+  TEST_ASSERT_EQUAL(10000 - 8064, gtd1->expected_bytes);
+  TEST_ASSERT_TRUE(gtd1->xfer_end);
+  TEST_ASSERT_TRUE(gtd1->buffer_rounding);
+
+  TEST_ASSERT_EQUAL(0, dummy->next);
+  TEST_ASSERT_EQUAL_HEX32((uintptr_t) dummy, ed->td_tail);
+
+  // no event until the last TD is retired
+  hc_retire_gtd(ed, OHCI_CCODE_NO_ERROR, 0);
+  hc_writeback_done();
+  TEST_ASSERT_EQUAL(0, event_count);
+  TEST_ASSERT_EQUAL(GTD_MAX - 2, gtd_free_count());
+
+  hc_retire_gtd(ed, OHCI_CCODE_NO_ERROR, 0);
+  hc_writeback_done();
+  TEST_ASSERT_EQUAL(1, event_count);
+  assert_xfer_event(0, DEV_ADDR, 0x81, XFER_RESULT_SUCCESS, 10000);
+  TEST_ASSERT_EQUAL(GTD_MAX - 1, gtd_free_count());
+
+  // page aligned: whole two pages in first TD, transfer of a single TD
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf, 8192));
+  TEST_ASSERT_EQUAL(8192, ed_head_gtd(ed)->expected_bytes);
+  TEST_ASSERT_TRUE(ed_head_gtd(ed)->xfer_end);
+  TEST_ASSERT_EQUAL(GTD_MAX - 2, gtd_free_count());
+}
+
+// Queue is limited by the gTD pool, a transfer which does not fit is rejected without changing the queue
+void test_bulk_xfer_pool_exhausted(void)
+{
+  TU_ATTR_ALIGNED(4096) static uint8_t buf[GTD_MAX][4096];
+
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS));
+  ohci_ed_t* ed = ed_from_addr(DEV_ADDR, 0x81);
+
+  uint32_t count = 0;
+  while ( gtd_free_count() > 1 )
+  {
+    TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf[count], BULK_MPS));
+    count++;
+  }
+  TEST_ASSERT_EQUAL(GTD_MAX - 2, count);
+
+  // needs 2 TDs
+  uint32_t const tail = ed->td_tail;
+  TEST_ASSERT_FALSE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf[count], 10000));
+  TEST_ASSERT_EQUAL_HEX32(tail, ed->td_tail);
+  TEST_ASSERT_EQUAL(1, gtd_free_count());
+
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf[count], BULK_MPS));
+  count++;
+  TEST_ASSERT_EQUAL(0, gtd_free_count());
+  TEST_ASSERT_FALSE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf[count], BULK_MPS));
+
+  // retired in one write-back, completed in queued order
+  for(uint32_t i=0; i<count; i++) hc_retire_gtd(ed, OHCI_CCODE_NO_ERROR, 0);
+  hc_writeback_done();
+
+  TEST_ASSERT_EQUAL(count, event_count);
+  for(uint32_t i=0; i<count; i++) assert_xfer_event(i, DEV_ADDR, 0x81, XFER_RESULT_SUCCESS, BULK_MPS);
+  TEST_ASSERT_EQUAL(GTD_MAX - 1, gtd_free_count());
+  TEST_ASSERT_EQUAL_HEX32(ed->td_tail, tu_align16(ed->td_head.address));
+}
+
+// Short packet halts ED at a TD in the middle of the transfer: rest of transfer is removed and ED continues
+void test_bulk_short_packet_queued(void)
+{
+  TU_ATTR_ALIGNED(4096) static uint8_t buf[3*4096];
+  TU_ATTR_ALIGNED(4096) static uint8_t buf2[BULK_MPS];
+
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS));
+  ohci_ed_t* ed = ed_from_addr(DEV_ADDR, 0x81);
+
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf, 10000));
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf2, sizeof(buf2)));
+  ohci_gtd_t* next_xfer = (ohci_gtd_t*) (uintptr_t) ((ohci_gtd_t*) (uintptr_t) ed_head_gtd(ed)->next)->next;
+
+  hc_retire_gtd(ed, OHCI_CCODE_DATA_UNDERRUN, 100);
+  hc_writeback_done();
+
+  TEST_ASSERT_EQUAL(1, event_count);
+  assert_xfer_event(0, DEV_ADDR, 0x81, XFER_RESULT_SUCCESS, 8192 - 100);
+  TEST_ASSERT_FALSE(ed->td_head.halted);
+  TEST_ASSERT_EQUAL_PTR(next_xfer, ed_head_gtd(ed));
+  TEST_ASSERT_EQUAL(GTD_MAX - 2, gtd_free_count());
+
+  hc_retire_gtd(ed, OHCI_CCODE_NO_ERROR, 0);
+  hc_writeback_done();
+  TEST_ASSERT_EQUAL(2, event_count);
+  assert_xfer_event(1, DEV_ADDR, 0x81, XFER_RESULT_SUCCESS, sizeof(buf2));
+  TEST_ASSERT_EQUAL(GTD_MAX - 1, gtd_free_count());
+}
+
+void test_bulk_stall(void)
+{
+  TU_ATTR_ALIGNED(4096) static uint8_t buf[3*4096];
+
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x02, TUSB_XFER_BULK, BULK_MPS));
+  ohci_ed_t* ed = ed_from_addr(DEV_ADDR, 0x02);
+
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x02, buf, 10000));
+  hc_retire_gtd(ed, OHCI_CCODE_STALL, 8192);
+  hc_writeback_done();
+
+  TEST_ASSERT_EQUAL(1, event_count);
+  assert_xfer_event(0, DEV_ADDR, 0x02, XFER_RESULT_STALLED, 0);
+  TEST_ASSERT_TRUE(ed->is_stalled);
+
+  // rest of transfer is released, halted ED is seen as empty by HC
+  TEST_ASSERT_EQUAL(GTD_MAX - 1, gtd_free_count());
+  TEST_ASSERT_TRUE(ed->td_head.halted);
+  TEST_ASSERT_EQUAL_HEX32(tu_align16(ed->td_head.address), tu_align16(ed->td_tail));
+
+  // transfer queued while halted is kept until stall is cleared
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x02, buf, BULK_MPS));
+  TEST_ASSERT_EQUAL_HEX32(tu_align16(ed->td_head.address), tu_align16(ed->td_tail));
+
+  TEST_ASSERT_TRUE(hcd_edpt_clear_stall(DEV_ADDR, 0x02));
+  TEST_ASSERT_FALSE(ed->td_head.halted);
+  TEST_ASSERT_FALSE(ed->is_stalled);
+  TEST_ASSERT_EQUAL_HEX32((uintptr_t) ed_head_gtd(ed)->next, ed->td_tail);
+
+  hc_retire_gtd(ed, OHCI_CCODE_NO_ERROR, 0);
+  hc_writeback_done();
+  assert_xfer_event(1, DEV_ADDR, 0x02, XFER_RESULT_SUCCESS, BULK_MPS);
+}
+
+void test_bulk_abort(void)
+{
+  TU_ATTR_ALIGNED(4096) static uint8_t buf[3*4096];
+
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x81, TUSB_XFER_BULK, BULK_MPS));
+  ohci_ed_t* ed = ed_from_addr(DEV_ADDR, 0x81);
+  ohci_gtd_t* dummy = ed_head_gtd(ed);
+
+  // nothing to abort
+  TEST_ASSERT_FALSE(hcd_edpt_abort_xfer(0, DEV_ADDR, 0x81));
+
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf, 10000));
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf, BULK_MPS));
+  TEST_ASSERT_EQUAL(GTD_MAX - 4, gtd_free_count());
+
+  TEST_ASSERT_TRUE(hcd_edpt_abort_xfer(0, DEV_ADDR, 0x81));
+  TEST_ASSERT_FALSE(ed->skip);
+  TEST_ASSERT_EQUAL(GTD_MAX - 1, gtd_free_count());
+
+  // new dummy is kept, ED is usable again
+  TEST_ASSERT_TRUE(ed_head_gtd(ed) != dummy);
+  TEST_ASSERT_EQUAL(0, ed_head_gtd(ed)->next);
+  TEST_ASSERT_EQUAL_HEX32(ed->td_tail, tu_align16(ed->td_head.address));
+
+  TEST_ASSERT_TRUE(hcd_edpt_xfer(0, DEV_ADDR, 0x81, buf, BULK_MPS));
+  hc_retire_gtd(ed, OHCI_CCODE_NO_ERROR, 0);
+  hc_writeback_done();
+  assert_xfer_event(0, DEV_ADDR, 0x81, XFER_RESULT_SUCCESS, BULK_MPS);
+}
+
+//--------------------------------------------------------------------+
+// Isochronous
+//--------------------------------------------------------------------+
+
+enum
+{
+  ISO_MPS     = 192,
+  ISO_PACKETS = 20, // 3 iTDs of 8, 8 and 4 packets
+};
+
+TU_ATTR_ALIGNED(4096) static uint8_t iso_buf[ISO_PACKETS * ISO_MPS];
+
+static void iso_packets_init(tuh_iso_packet_t* packets, uint16_t count)
+{
+  for(uint16_t i=0; i<count; i++) packets[i].length = ISO_MPS;
+}
+
+static ochi_itd_t* ed_head_itd(ohci_ed_t const* ed)
+{
+  return (ochi_itd_t*) (uintptr_t) tu_align16(ed->td_head.address);
+}
+
+// Controller retires the iTD at head of an ED with packet status word of each packet
+static void hc_retire_itd(ohci_ed_t* ed, uint8_t ccode, uint16_t const* psw)
+{
+  ochi_itd_t* itd = ed_head_itd(ed);
+
+  itd->condition_code = ccode;
+  for(uint8_t k=0; k<=itd->frame_count; k++) itd->offset_packetstatus[k] = psw[k];
+
+  hc_retire(ed, false);
+}
+
+void test_iso_in_xfer(void)
+{
+  static tuh_iso_packet_t packets[ISO_PACKETS];
+  iso_packets_init(packets, ISO_PACKETS);
+
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x83, TUSB_XFER_ISOCHRONOUS, ISO_MPS));
+  ohci_ed_t* ed = ed_from_addr(DEV_ADDR, 0x83);
+  TEST_ASSERT_TRUE(ed->is_iso);
+  TEST_ASSERT_EQUAL(ITD_MAX - 1, itd_free_count());
+  TEST_ASSERT_EQUAL(GTD_MAX, gtd_free_count());
+
+  // isochronous ED is at end of periodic list
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x84, TUSB_XFER_INTERRUPT, 8));
+  TEST_ASSERT_TRUE(ed_list_has(p_ed_head[TUSB_XFER_INTERRUPT], ed));
+  TEST_ASSERT_EQUAL(0, ed->next);
+
+  uint16_t const now = (uint16_t) regs.frame_number;
+  TEST_ASSERT_TRUE(hcd_edpt_iso_xfer(0, DEV_ADDR, 0x83, iso_buf, packets, ISO_PACKETS));
+  TEST_ASSERT_EQUAL(ITD_MAX - 4, itd_free_count());
+
+  // idle endpoint starts a margin ahead of the frame number read by driver (one register access), iTDs follow each other
+  ochi_itd_t const* itd = ed_head_itd(ed);
+  uint16_t const start = (uint16_t) itd->starting_frame;
+  TEST_ASSERT_EQUAL_UINT16(now + 1 + ISO_FRAME_MARGIN, start);
+
+  uint8_t const frames[] = { 8, 8, 4 };
+  uint16_t frame = start;
+  for(uint32_t i=0; i<TU_ARRAY_SIZE(frames); i++)
+  {
+    TEST_ASSERT_EQUAL(frame, itd->starting_frame);
+    TEST_ASSERT_EQUAL(frames[i] - 1, itd->frame_count);
+    TEST_ASSERT_EQUAL(i == 2, itd->xfer_end);
+    TEST_ASSERT_EQUAL_HEX32(tu_align4k((uintptr_t) iso_buf), itd->buffer_page0);
+    frame += frames[i];
+    itd = (ochi_itd_t const*) (uintptr_t) itd->next;
+  }
+
+  // dummy holds next frame
+  TEST_ASSERT_EQUAL_HEX32((uintptr_t) itd, ed->td_tail);
+  TEST_ASSERT_EQUAL(frame, itd->starting_frame);
+
+  // short packet 5, CRC error on packet 10
+  uint16_t psw[8];
+  for(uint8_t k=0; k<8; k++) psw[k] = (OHCI_CCODE_NO_ERROR << 12) | ISO_MPS;
+  psw[5] = (OHCI_CCODE_DATA_UNDERRUN << 12) | 100;
+  hc_retire_itd(ed, OHCI_CCODE_NO_ERROR, psw);
+  hc_writeback_done();
+  TEST_ASSERT_EQUAL(0, event_count);
+  TEST_ASSERT_EQUAL(ITD_MAX - 3, itd_free_count());
+
+  psw[5] = (OHCI_CCODE_NO_ERROR << 12) | ISO_MPS;
+  psw[2] = (OHCI_CCODE_CRC << 12);
+  hc_retire_itd(ed, OHCI_CCODE_CRC, psw);
+  psw[2] = (OHCI_CCODE_NO_ERROR << 12) | ISO_MPS;
+  hc_retire_itd(ed, OHCI_CCODE_NO_ERROR, psw);
+  hc_writeback_done();
+
+  TEST_ASSERT_EQUAL(1, event_count);
+  assert_xfer_event(0, DEV_ADDR, 0x83, XFER_RESULT_SUCCESS, ISO_PACKETS * ISO_MPS - (ISO_MPS - 100) - ISO_MPS);
+  TEST_ASSERT_EQUAL(ITD_MAX - 1, itd_free_count());
+
+  for(uint16_t i=0; i<ISO_PACKETS; i++)
+  {
+    uint16_t const len = (i == 5) ? 100 : (i == 10) ? 0 : ISO_MPS;
+    TEST_ASSERT_EQUAL(len, packets[i].actual_length);
+    TEST_ASSERT_EQUAL(i == 10 ? XFER_RESULT_FAILED : XFER_RESULT_SUCCESS, packets[i].result);
+  }
+}
+
+// Transfer is rejected if its iTDs do not fit, queued transfers continue frame after frame
+void test_iso_pool_exhausted(void)
+{
+  static tuh_iso_packet_t packets[2][ISO_PACKETS];
+  iso_packets_init(packets[0], ISO_PACKETS);
+  iso_packets_init(packets[1], ISO_PACKETS);
+
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x03, TUSB_XFER_ISOCHRONOUS, ISO_MPS));
+  ohci_ed_t* ed = ed_from_addr(DEV_ADDR, 0x03);
+
+  TEST_ASSERT_TRUE(hcd_edpt_iso_xfer(0, DEV_ADDR, 0x03, iso_buf, packets[0], ISO_PACKETS));
+  TEST_ASSERT_EQUAL(2, itd_free_count());
+  uint16_t const next_frame = (uint16_t) ((ochi_itd_t const*) (uintptr_t) ed->td_tail)->starting_frame;
+
+  uint32_t const tail = ed->td_tail;
+  TEST_ASSERT_FALSE(hcd_edpt_iso_xfer(0, DEV_ADDR, 0x03, iso_buf, packets[1], ISO_PACKETS));
+  TEST_ASSERT_EQUAL_HEX32(tail, ed->td_tail);
+  TEST_ASSERT_EQUAL(2, itd_free_count());
+
+  // 16 packets fit in 2 iTDs
+  TEST_ASSERT_TRUE(hcd_edpt_iso_xfer(0, DEV_ADDR, 0x03, iso_buf, packets[1], 16));
+  TEST_ASSERT_EQUAL(0, itd_free_count());
+  TEST_ASSERT_EQUAL(next_frame, ((ochi_itd_t const*) (uintptr_t) tail)->starting_frame);
+
+  // OUT: all packets are sent
+  uint16_t psw[8] = { 0 };
+  for(uint32_t i=0; i<5; i++) hc_retire_itd(ed, OHCI_CCODE_NO_ERROR, psw);
+  hc_writeback_done();
+
+  TEST_ASSERT_EQUAL(2, event_count);
+  assert_xfer_event(0, DEV_ADDR, 0x03, XFER_RESULT_SUCCESS, ISO_PACKETS * ISO_MPS);
+  assert_xfer_event(1, DEV_ADDR, 0x03, XFER_RESULT_SUCCESS, 16 * ISO_MPS);
+  TEST_ASSERT_EQUAL(ITD_MAX - 1, itd_free_count());
+}
+
+void test_iso_abort_and_close(void)
+{
+  static tuh_iso_packet_t packets[ISO_PACKETS];
+  iso_packets_init(packets, ISO_PACKETS);
+
+  TEST_ASSERT_TRUE(edpt_open(DEV_ADDR, 0x83, TUSB_XFER_ISOCHRONOUS, ISO_MPS));
+
+  TEST_ASSERT_TRUE(hcd_edpt_iso_xfer(0, DEV_ADDR, 0x83, iso_buf, packets, ISO_PACKETS));
+  TEST_ASSERT_TRUE(hcd_edpt_abort_xfer(0, DEV_ADDR, 0x83));
+  TEST_ASSERT_EQUAL(ITD_MAX - 1, itd_free_count());
+
+  TEST_ASSERT_TRUE(hcd_edpt_iso_xfer(0, DEV_ADDR, 0x83, iso_buf, packets, ISO_PACKETS));
+  hcd_device_close(0, DEV_ADDR);
+  TEST_ASSERT_EQUAL(ITD_MAX, itd_free_count());
+  TEST_ASSERT_EQUAL(GTD_MAX, gtd_free_count());
+  TEST_ASSERT_EQUAL(ED_MAX, ed_free_count());
+  TEST_ASSERT_EQUAL(0, event_count);
+}
@@ -0,0 +1,1569 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+#include "unity.h"
+
+// Host stack is built with hub support on top of a fake host controller, which simulates
+// hubs and devices with 1 ms frame resolution
+#define CFG_TUSB_RHPORT0_MODE   (OPT_MODE_HOST | OPT_MODE_FULL_SPEED)
+#define CFG_TUH_DEVICE_MAX      9
+#define CFG_TUH_HUB             2
+#define CFG_TUH_API_EDPT_XFER   1
+#define CFG_TUH_EDPT_XFER_MAX   3
+#define CFG_TUH_ISO_STREAM_MAX  2
+#define CFG_TUH_CONTROL_RETRY_MAX  2
+#define CFG_TUH_MEM_POOL_SIZE   256
+#define CFG_TUH_DESC_CACHE      2
+#define CFG_TUH_STRINGS_FETCH_MAX  1
+#define CFG_TUH_STRING_MAXLEN   8
+
+#include "osal/osal.h"
+#include "tusb_fifo.h"
+#include "tusb.c"
+#include "host/usbh.c"
+#include "host/hub.c"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  FAKE_DEV_MAX     = 12,
+  FAKE_XFER_MAX    = 32,
+  FAKE_PORT_MAX    = 7,
+  FAKE_RESET_MS    = 10,
+  FAKE_HUB_INTERVAL = 12,  // status change endpoint bInterval
+  FAKE_ROOT        = 0xFF,
+
+  PID_HUB          = 0x4000,
+  PID_STREAM       = 0x5000,
+  PID_DEVICE       = 0x6000,
+};
+
+typedef struct
+{
+  bool     used;
+  bool     attached;      // physically connected to its port
+  bool     is_default;    // responds to address 0 (port reset is complete but address is not set)
+  uint8_t  parent;        // index of parent hub, FAKE_ROOT for roothub
+  uint8_t  port;          // port on parent hub
+  uint8_t  address;
+  uint16_t pid;
+  uint16_t bcd_device;
+  uint32_t desc_requests; // GET_DESCRIPTOR other than device descriptor
+
+  // control pipe
+  tusb_control_request_t request;
+  uint8_t  response[64];
+  uint16_t response_len;
+  bool     stall;
+
+  // misbehaving device
+  bool     hang;          // NAK all transfers forever
+  bool     edpt_stall;    // stall transfers of non-control endpoints
+  uint8_t  fail_count;    // number of setup packets failing with transaction error
+  uint8_t  edpt_fail_count; // number of non-control transfers failing with transaction error
+
+  // hub only
+  uint8_t  port_count;
+  hub_status_response_t hub_status;
+  hub_port_status_response_t port_status[FAKE_PORT_MAX];
+  uint32_t reset_end[FAKE_PORT_MAX];
+} fake_dev_t;
+
+typedef struct
+{
+  bool     used;
+  bool     setup;
+  uint8_t  daddr;
+  uint8_t  ep_addr;
+  uint8_t* buffer;
+  uint16_t len;
+  uint32_t frame;         // submitted in this frame, complete in next one at the earliest
+  tuh_iso_packet_t* packets; // isochronous only
+  uint16_t count;
+} fake_xfer_t;
+
+static fake_dev_t  fake_dev[FAKE_DEV_MAX];
+static fake_xfer_t fake_xfer[FAKE_XFER_MAX];
+static uint32_t    fake_frame;
+
+static uint8_t  mounted_count;
+static uint8_t  stream_daddr;
+static uint32_t stream_count;
+static uint32_t stream_last_frame;
+static uint32_t stream_max_gap;
+CFG_TUH_MEM_ALIGN static uint8_t stream_buf[64];
+
+//--------------------------------------------------------------------+
+// Fake devices
+//--------------------------------------------------------------------+
+
+static uint8_t fake_dev_add(uint16_t pid, uint8_t parent, uint8_t port)
+{
+  for(uint8_t i=0; i<FAKE_DEV_MAX; i++)
+  {
+    fake_dev_t* dev = &fake_dev[i];
+    if ( !dev->used )
+    {
+      tu_memclr(dev, sizeof(fake_dev_t));
+      dev->used       = true;
+      dev->pid        = pid;
+      dev->parent     = parent;
+      dev->port       = port;
+      dev->port_count = (pid == PID_HUB) ? FAKE_PORT_MAX : 0;
+      return i;
+    }
+  }
+
+  TEST_FAIL_MESSAGE("too many fake devices");
+  return 0;
+}
+
+// Connect device to its port
+static void fake_dev_attach(uint8_t idx)
+{
+  fake_dev_t* dev = &fake_dev[idx];
+  dev->attached = true;
+
+  if ( dev->parent == FAKE_ROOT )
+  {
+    hcd_event_device_attach(0, false);
+  }else
+  {
+    hub_port_status_response_t* port_status = &fake_dev[dev->parent].port_status[dev->port-1];
+    port_status->status.connection = 1;
+    port_status->change.connection = 1;
+  }
+}
+
+// Disconnect device from its hub port
+static void fake_dev_detach(uint8_t idx)
+{
+  fake_dev_t* dev = &fake_dev[idx];
+  dev->attached   = false;
+  dev->is_default = false;
+
+  hub_port_status_response_t* port_status = &fake_dev[dev->parent].port_status[dev->port-1];
+  port_status->status.connection  = 0;
+  port_status->status.port_enable = 0;
+  port_status->change.connection  = 1;
+}
+
+static fake_dev_t* fake_dev_by_address(uint8_t daddr)
+{
+  for(uint8_t i=0; i<FAKE_DEV_MAX; i++)
+  {
+    fake_dev_t* dev = &fake_dev[i];
+    if ( dev->used && dev->attached )
+    {
+      if ( (daddr == 0 && dev->is_default) || (daddr != 0 && dev->address == daddr) ) return dev;
+    }
+  }
+  return NULL;
+}
+
+static void fake_respond(fake_dev_t* dev, void const* data, uint16_t len)
+{
+  dev->response_len = tu_min16(len, dev->request.wLength);
+  memcpy(dev->response, data, dev->response_len);
+}
+
+// Process setup packet, response is prepared for data stage
+static void fake_dev_request(fake_dev_t* dev, tusb_control_request_t const* request)
+{
+  dev->request      = *request;
+  dev->response_len = 0;
+  dev->stall        = false;
+
+  bool const is_hub = (dev->pid == PID_HUB);
+
+  if ( request->bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD )
+  {
+    switch ( request->bRequest )
+    {
+      case TUSB_REQ_GET_DESCRIPTOR:
+        if ( tu_u16_high(request->wValue) == TUSB_DESC_DEVICE )
+        {
+          tusb_desc_device_t const desc =
+          {
+            .bLength            = sizeof(tusb_desc_device_t),
+            .bDescriptorType    = TUSB_DESC_DEVICE,
+            .bcdUSB             = 0x0200,
+            .bDeviceClass       = is_hub ? TUSB_CLASS_HUB : 0,
+            .bMaxPacketSize0    = 64,
+            .idVendor           = 0xCAFE,
+            .idProduct          = dev->pid,
+            .bcdDevice          = dev->bcd_device,
+            .iManufacturer      = is_hub ? 0 : 3,
+            .iProduct           = is_hub ? 0 : 1,
+            .iSerialNumber      = is_hub ? 0 : 2,
+            .bNumConfigurations = 1
+          };
+          fake_respond(dev, &desc, sizeof(desc));
+        }
+        else if ( tu_u16_high(request->wValue) == TUSB_DESC_CONFIGURATION )
+        {
+          uint8_t const desc[] =
+          {
+            9, TUSB_DESC_CONFIGURATION, 9+9+7, 0, 1, 1, 0, 0x80, 50,
+            9, TUSB_DESC_INTERFACE, 0, 0, 1, is_hub ? TUSB_CLASS_HUB : TUSB_CLASS_VENDOR_SPECIFIC, 0, 0, 0,
+            7, TUSB_DESC_ENDPOINT, 0x81, is_hub ? TUSB_XFER_INTERRUPT : TUSB_XFER_BULK, 64, 0, is_hub ? FAKE_HUB_INTERVAL : 0
+          };
+          dev->desc_requests++;
+          fake_respond(dev, desc, sizeof(desc));
+        }
+        else if ( tu_u16_high(request->wValue) == TUSB_DESC_STRING )
+        {
+          // language IDs, product "Fake", serial number of the fake device index and manufacturer with
+          // characters of 2, 3 and 4 UTF-8 bytes
+          uint8_t const index = tu_u16_low(request->wValue);
+          uint16_t const desc[][5] =
+          {
+            { TUSB_DESC_STRING << 8 | 6, 0x0407, 0x0409 },
+            { TUSB_DESC_STRING << 8 | 10, 'F', 'a', 'k', 'e' },
+            { TUSB_DESC_STRING << 8 | 4, (uint16_t) ('0' + (dev - fake_dev)) },
+            { TUSB_DESC_STRING << 8 | 10, 0x00E9, 0x20AC, 0xD83D, 0xDE00 },
+          };
+          dev->desc_requests++;
+          if ( index < TU_ARRAY_SIZE(desc) ) fake_respond(dev, desc[index], desc[index][0] & 0xFF);
+          else dev->stall = true;
+        }
+        else
+        {
+          dev->stall = true;
+        }
+      break;
+
+      case TUSB_REQ_SET_ADDRESS:
+      case TUSB_REQ_SET_CONFIGURATION:
+        // address is applied after status stage
+      break;
+
+      default:
+        dev->stall = true;
+      break;
+    }
+  }
+  else if ( is_hub )
+  {
+    uint8_t const port = (uint8_t) request->wIndex;
+    hub_port_status_response_t* port_status = (port && port <= dev->port_count) ? &dev->port_status[port-1] : NULL;
+
+    switch ( request->bRequest )
+    {
+      case HUB_REQUEST_GET_DESCRIPTOR:
+      {
+        descriptor_hub_desc_t const desc =
+        {
+          .bLength         = sizeof(descriptor_hub_desc_t),
+          .bDescriptorType = 0x29,
+          .bNbrPorts       = dev->port_count,
+          .bPwrOn2PwrGood  = 1,
+          .PortPwrCtrlMask = 0xff
+        };
+        fake_respond(dev, &desc, sizeof(desc));
+      }
+      break;
+
+      case HUB_REQUEST_GET_STATUS:
+        if ( port_status )
+        {
+          fake_respond(dev, port_status, sizeof(hub_port_status_response_t));
+        }else
+        {
+          fake_respond(dev, &dev->hub_status, sizeof(hub_status_response_t));
+        }
+      break;
+
+      case HUB_REQUEST_SET_FEATURE:
+        TEST_ASSERT_NOT_NULL(port_status);
+        if ( request->wValue == HUB_FEATURE_PORT_POWER )
+        {
+          port_status->status.port_power = 1;
+        }
+        else if ( request->wValue == HUB_FEATURE_PORT_RESET )
+        {
+          port_status->status.reset = 1;
+          dev->reset_end[port-1] = fake_frame + FAKE_RESET_MS;
+        }
+      break;
+
+      case HUB_REQUEST_CLEAR_FEATURE:
+        if ( port_status && request->wValue >= HUB_FEATURE_PORT_CONNECTION_CHANGE )
+        {
+          port_status->change.value &= (uint16_t) ~(1u << (request->wValue - HUB_FEATURE_PORT_CONNECTION_CHANGE));
+        }
+        else if ( port == 0 && request->wValue <= HUB_FEATURE_HUB_OVER_CURRENT_CHANGE )
+        {
+          dev->hub_status.change.value &= (uint16_t) ~(1u << request->wValue);
+        }
+      break;
+
+      default:
+        dev->stall = true;
+      break;
+    }
+  }
+  else
+  {
+    dev->stall = true;
+  }
+}
+
+// Hub ports: complete reset after FAKE_RESET_MS
+static void fake_hub_task(fake_dev_t* hub)
+{
+  for(uint8_t p=0; p<hub->port_count; p++)
+  {
+    if ( hub->reset_end[p] && fake_frame >= hub->reset_end[p] )
+    {
+      hub->reset_end[p] = 0;
+      hub->port_status[p].status.reset       = 0;
+      hub->port_status[p].status.port_enable = 1;
+      hub->port_status[p].change.reset       = 1;
+
+      for(uint8_t i=0; i<FAKE_DEV_MAX; i++)
+      {
+        fake_dev_t* dev = &fake_dev[i];
+        if ( dev->used && dev->attached && dev->parent != FAKE_ROOT && &fake_dev[dev->parent] == hub && dev->port == p+1 )
+        {
+          dev->address    = 0;
+          dev->is_default = true;
+        }
+      }
+    }
+  }
+}
+
+// Complete a pending transfer, return false if it must stay pending
+static bool fake_xfer_complete(fake_xfer_t* xfer)
+{
+  fake_dev_t* dev = fake_dev_by_address(xfer->daddr);
+  if ( !dev ) return false; // no response e.g unplugged
+
+  if ( dev->hang ) return false;
+
+  uint8_t const epnum = tu_edpt_number(xfer->ep_addr);
+  uint32_t len = 0;
+  xfer_result_t result = XFER_RESULT_SUCCESS;
+
+  if ( epnum == 0 )
+  {
+    if ( xfer->setup && dev->fail_count )
+    {
+      dev->fail_count--;
+      result = XFER_RESULT_FAILED;
+    }
+    else if ( xfer->setup )
+    {
+      fake_dev_request(dev, (tusb_control_request_t const*) xfer->buffer);
+      len = 8;
+    }
+    else if ( dev->stall )
+    {
+      result = XFER_RESULT_STALLED;
+    }
+    else if ( xfer->len )
+    {
+      // data stage
+      if ( tu_edpt_dir(xfer->ep_addr) == TUSB_DIR_IN )
+      {
+        len = tu_min16(xfer->len, dev->response_len);
+        memcpy(xfer->buffer, dev->response, len);
+      }else
+      {
+        len = xfer->len;
+      }
+    }
+    else
+    {
+      // status stage
+      if ( dev->request.bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD && dev->request.bRequest == TUSB_REQ_SET_ADDRESS )
+      {
+        dev->address    = (uint8_t) dev->request.wValue;
+        dev->is_default = false;
+      }
+    }
+  }
+  else if ( dev->pid == PID_HUB )
+  {
+    // status change endpoint, polled every bInterval frames
+    if ( fake_frame % FAKE_HUB_INTERVAL ) return false;
+
+    uint8_t change = dev->hub_status.change.value ? 1 : 0;
+    for(uint8_t p=0; p<dev->port_count; p++)
+    {
+      if ( dev->port_status[p].change.value ) change |= (uint8_t) (1u << (p+1));
+    }
+    if ( !change ) return false;
+
+    xfer->buffer[0] = change;
+    len = 1;
+  }
+  else if ( xfer->packets )
+  {
+    // isochronous: all packets complete in one frame
+    for(uint16_t i=0; i<xfer->count; i++)
+    {
+      xfer->packets[i].actual_length = xfer->packets[i].length;
+      xfer->packets[i].result        = XFER_RESULT_SUCCESS;
+      len += xfer->packets[i].length;
+    }
+  }
+  else if ( dev->edpt_fail_count )
+  {
+    dev->edpt_fail_count--;
+    result = XFER_RESULT_FAILED;
+  }
+  else if ( dev->edpt_stall )
+  {
+    result = XFER_RESULT_STALLED;
+  }
+  else
+  {
+    // bulk data
+    len = xfer->len;
+  }
+
+  xfer->used = false;
+  hcd_event_xfer_complete(xfer->daddr, xfer->ep_addr, len, result, false);
+  return true;
+}
+
+static fake_xfer_t* fake_xfer_submit(uint8_t daddr, uint8_t ep_addr, uint8_t* buffer, uint16_t len, bool setup)
+{
+  for(uint8_t i=0; i<FAKE_XFER_MAX; i++)
+  {
+    fake_xfer_t* xfer = &fake_xfer[i];
+    if ( !xfer->used )
+    {
+      xfer->used    = true;
+      xfer->setup   = setup;
+      xfer->daddr   = daddr;
+      xfer->ep_addr = ep_addr;
+      xfer->buffer  = buffer;
+      xfer->len     = len;
+      xfer->frame   = fake_frame;
+      xfer->packets = NULL;
+      xfer->count   = 0;
+      return xfer;
+    }
+  }
+
+  TEST_FAIL_MESSAGE("too many pending transfers");
+  return NULL;
+}
+
+// Advance one frame then let usbh process the completed transfers
+static void fake_frame_run(void)
+{
+  fake_frame++;
+
+  for(uint8_t i=0; i<FAKE_DEV_MAX; i++)
+  {
+    if ( fake_dev[i].used && fake_dev[i].pid == PID_HUB ) fake_hub_task(&fake_dev[i]);
+  }
+
+  for(uint8_t i=0; i<FAKE_XFER_MAX; i++)
+  {
+    fake_xfer_t* xfer = &fake_xfer[i];
+    if ( xfer->used && xfer->frame < fake_frame ) fake_xfer_complete(xfer);
+  }
+
+  tuh_task();
+}
+
+//--------------------------------------------------------------------+
+// Fake HCD
+//--------------------------------------------------------------------+
+
+bool hcd_init(uint8_t rhport)
+{
+  (void) rhport;
+  return true;
+}
+
+void hcd_int_enable(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+void hcd_int_disable(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+uint32_t hcd_frame_number(uint8_t rhport)
+{
+  (void) rhport;
+  return fake_frame;
+}
+
+bool hcd_port_connect_status(uint8_t rhport)
+{
+  (void) rhport;
+  for(uint8_t i=0; i<FAKE_DEV_MAX; i++)
+  {
+    if ( fake_dev[i].used && fake_dev[i].parent == FAKE_ROOT ) return fake_dev[i].attached;
+  }
+  return false;
+}
+
+void hcd_port_reset(uint8_t rhport)
+{
+  (void) rhport;
+  for(uint8_t i=0; i<FAKE_DEV_MAX; i++)
+  {
+    fake_dev_t* dev = &fake_dev[i];
+    if ( dev->used && dev->parent == FAKE_ROOT )
+    {
+      dev->address    = 0;
+      dev->is_default = true;
+    }
+  }
+}
+
+void hcd_port_reset_end(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+tusb_speed_t hcd_port_speed_get(uint8_t rhport)
+{
+  (void) rhport;
+  return TUSB_SPEED_FULL;
+}
+
+void hcd_device_close(uint8_t rhport, uint8_t dev_addr)
+{
+  (void) rhport;
+  for(uint8_t i=0; i<FAKE_XFER_MAX; i++)
+  {
+    if ( fake_xfer[i].daddr == dev_addr ) fake_xfer[i].used = false;
+  }
+}
+
+bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc)
+{
+  (void) rhport;
+  (void) dev_addr;
+  (void) ep_desc;
+  return true;
+}
+
+bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t buflen)
+{
+  (void) rhport;
+  return fake_xfer_submit(dev_addr, ep_addr, buffer, buflen, false) != NULL;
+}
+
+bool hcd_edpt_iso_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t* buffer,
+                       tuh_iso_packet_t* packets, uint16_t count)
+{
+  (void) rhport;
+  fake_xfer_t* xfer = fake_xfer_submit(dev_addr, ep_addr, buffer, 0, false);
+  TEST_ASSERT_NOT_NULL(xfer);
+
+  xfer->packets = packets;
+  xfer->count   = count;
+  return true;
+}
+
+bool hcd_setup_send(uint8_t rhport, uint8_t dev_addr, uint8_t const setup_packet[8])
+{
+  (void) rhport;
+  return fake_xfer_submit(dev_addr, 0, (uint8_t*) (uintptr_t) setup_packet, 8, true) != NULL;
+}
+
+bool hcd_edpt_clear_stall(uint8_t daddr, uint8_t ep_addr)
+{
+  (void) daddr;
+  (void) ep_addr;
+  return true;
+}
+
+bool hcd_edpt_abort_xfer(uint8_t rhport, uint8_t daddr, uint8_t ep_addr)
+{
+  (void) rhport;
+
+  bool aborted = false;
+  for(uint8_t i=0; i<FAKE_XFER_MAX; i++)
+  {
+    fake_xfer_t* xfer = &fake_xfer[i];
+    // control transfer has the same pipe in both directions
+    if ( xfer->used && xfer->daddr == daddr &&
+         (xfer->ep_addr == ep_addr || (tu_edpt_number(ep_addr) == 0 && tu_edpt_number(xfer->ep_addr) == 0)) )
+    {
+      xfer->used = false;
+      aborted = true;
+    }
+  }
+
+  return aborted;
+}
+
+static uint8_t fake_xfer_pending(uint8_t daddr)
+{
+  uint8_t count = 0;
+  for(uint8_t i=0; i<FAKE_XFER_MAX; i++)
+  {
+    if ( fake_xfer[i].used && fake_xfer[i].daddr == daddr ) count++;
+  }
+  return count;
+}
+
+//--------------------------------------------------------------------+
+// Application
+//--------------------------------------------------------------------+
+
+static void stream_xfer_cb(tuh_xfer_t* xfer)
+{
+  TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, xfer->result);
+
+  if ( stream_count ) stream_max_gap = tu_max32(stream_max_gap, fake_frame - stream_last_frame);
+  stream_last_frame = fake_frame;
+  stream_count++;
+
+  TEST_ASSERT_TRUE(tuh_edpt_xfer(xfer));
+}
+
+void tuh_mount_cb(uint8_t daddr)
+{
+  mounted_count++;
+
+  uint16_t vid, pid;
+  TEST_ASSERT_TRUE(tuh_vid_pid_get(daddr, &vid, &pid));
+
+  if ( pid == PID_STREAM )
+  {
+    tusb_desc_endpoint_t const desc_ep =
+    {
+      .bLength          = sizeof(tusb_desc_endpoint_t),
+      .bDescriptorType  = TUSB_DESC_ENDPOINT,
+      .bEndpointAddress = 0x81,
+      .bmAttributes     = { .xfer = TUSB_XFER_BULK },
+      .wMaxPacketSize   = 64,
+      .bInterval        = 0
+    };
+    TEST_ASSERT_TRUE(tuh_edpt_open(daddr, &desc_ep));
+
+    tuh_xfer_t xfer =
+    {
+      .daddr       = daddr,
+      .ep_addr     = 0x81,
+      .buflen      = sizeof(stream_buf),
+      .buffer      = stream_buf,
+      .complete_cb = stream_xfer_cb,
+      .user_data   = 0
+    };
+    TEST_ASSERT_TRUE(tuh_edpt_xfer(&xfer));
+
+    stream_daddr = daddr;
+  }
+}
+
+static xfer_result_t app_result;
+static uint32_t      app_frame;
+static uint32_t      app_count;
+
+static void app_xfer_cb(tuh_xfer_t* xfer)
+{
+  app_result = xfer->result;
+  app_frame  = fake_frame;
+  app_count++;
+}
+
+// Get device descriptor of a device asynchronously
+static bool app_get_device_desc(uint8_t daddr, uint32_t timeout_ms)
+{
+  static uint8_t desc[18];
+  tusb_control_request_t const request =
+  {
+    .bmRequestType_bit =
+    {
+      .recipient = TUSB_REQ_RCPT_DEVICE,
+      .type      = TUSB_REQ_TYPE_STANDARD,
+      .direction = TUSB_DIR_IN
+    },
+    .bRequest = TUSB_REQ_GET_DESCRIPTOR,
+    .wValue   = TUSB_DESC_DEVICE << 8,
+    .wIndex   = 0,
+    .wLength  = sizeof(desc)
+  };
+
+  tuh_xfer_t xfer =
+  {
+    .daddr       = daddr,
+    .ep_addr     = 0,
+    .setup       = &request,
+    .buffer      = desc,
+    .complete_cb = app_xfer_cb,
+    .user_data   = 0,
+    .timeout_ms  = timeout_ms
+  };
+
+  return tuh_control_xfer(&xfer);
+}
+
+// Address of the mounted device with pid
+static uint8_t find_daddr(uint16_t pid)
+{
+  for(uint8_t daddr=1; daddr<=CFG_TUH_DEVICE_MAX; daddr++)
+  {
+    uint16_t vid, dev_pid;
+    if ( tuh_mounted(daddr) && tuh_vid_pid_get(daddr, &vid, &dev_pid) && dev_pid == pid ) return daddr;
+  }
+  return 0;
+}
+
+void setUp(void)
+{
+  tu_memclr(fake_dev, sizeof(fake_dev));
+  tu_memclr(fake_xfer, sizeof(fake_xfer));
+  fake_frame = 0;
+
+  mounted_count     = 0;
+  stream_daddr      = 0;
+  stream_count      = 0;
+  stream_last_frame = 0;
+  stream_max_gap    = 0;
+
+  app_result = XFER_RESULT_INVALID;
+  app_frame  = 0;
+  app_count  = 0;
+
+  // allow re-init for each test
+  _usbh_controller = TUSB_INDEX_INVALID_8;
+  TEST_ASSERT_TRUE(tuh_init(0));
+}
+
+void tearDown(void)
+{
+}
+
+// Run until mounted_count reaches count, return number of frames
+static uint32_t run_until_mounted(uint8_t count, uint32_t frame_max)
+{
+  uint32_t const start = fake_frame;
+  while ( mounted_count < count && (fake_frame - start) < frame_max ) fake_frame_run();
+  return fake_frame - start;
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+// roothub - hub A: port 1 streaming device, port 2 hub B, port 3-7 devices
+//                  hub B: port 1-3 devices
+void test_enumeration_does_not_block_streaming(void)
+{
+  uint8_t const hub_a  = fake_dev_add(PID_HUB, FAKE_ROOT, 0);
+  uint8_t const stream = fake_dev_add(PID_STREAM, hub_a, 1);
+  uint8_t const hub_b  = fake_dev_add(PID_HUB, hub_a, 2);
+
+  uint8_t devices[8];
+  for(uint8_t i=0; i<5; i++) devices[i]   = fake_dev_add((uint16_t) (PID_DEVICE + i), hub_a, (uint8_t) (3+i));
+  for(uint8_t i=0; i<3; i++) devices[5+i] = fake_dev_add((uint16_t) (PID_DEVICE + 5 + i), hub_b, (uint8_t) (1+i));
+
+  fake_dev_attach(hub_a);
+  fake_dev_attach(stream);
+  fake_dev_attach(hub_b);
+
+  // streaming device is mounted, hubs are not reported by tuh_mount_cb()
+  run_until_mounted(1, 5000);
+  TEST_ASSERT_EQUAL(1, mounted_count);
+  TEST_ASSERT_NOT_EQUAL(0, stream_daddr);
+
+  // hub B is enumerated after the streaming device
+  for(uint32_t i=0; i<2000; i++) fake_frame_run();
+  TEST_ASSERT_TRUE(tuh_mounted(CFG_TUH_DEVICE_MAX+2));
+
+  // plug all devices at once
+  for(uint8_t i=0; i<8; i++) fake_dev_attach(devices[i]);
+
+  stream_max_gap = 0;
+  uint32_t const frames = run_until_mounted(9, 20000);
+
+  char msg[100];
+  sprintf(msg, "8 devices mounted in %lu ms, max streaming gap %lu ms", (unsigned long) frames, (unsigned long) stream_max_gap);
+  TEST_MESSAGE(msg);
+
+  TEST_ASSERT_EQUAL(9, mounted_count);
+
+  // streaming data is completed every frame while devices are being enumerated
+  TEST_ASSERT_LESS_OR_EQUAL(1, stream_max_gap);
+}
+
+// Devices of a populated hub are debounced concurrently and only reset/addressed one at a time
+void test_populated_hub_enumeration(void)
+{
+  uint8_t const hub = fake_dev_add(PID_HUB, FAKE_ROOT, 0);
+  fake_dev_attach(hub);
+
+  for(uint8_t i=0; i<FAKE_PORT_MAX; i++)
+  {
+    fake_dev_attach(fake_dev_add((uint16_t) (PID_DEVICE + i), hub, (uint8_t) (1+i)));
+  }
+
+  uint32_t const frames = run_until_mounted(FAKE_PORT_MAX, 20000);
+
+  char msg[100];
+  sprintf(msg, "hub with %u devices mounted in %lu ms", FAKE_PORT_MAX, (unsigned long) frames);
+  TEST_MESSAGE(msg);
+
+  TEST_ASSERT_EQUAL(FAKE_PORT_MAX, mounted_count);
+  TEST_ASSERT_TRUE(tuh_mounted(CFG_TUH_DEVICE_MAX+1));
+
+  // hub is debounced, then all its devices at once rather than one after another
+  TEST_ASSERT_LESS_THAN(4*RESET_DELAY, frames);
+
+  // all devices got a distinct address
+  for(uint8_t daddr=1; daddr<=FAKE_PORT_MAX; daddr++) TEST_ASSERT_TRUE(tuh_mounted(daddr));
+}
+
+// Mounted devices never get a buffer which is in use by enumeration
+void test_enum_buf_of_mounted_device(void)
+{
+  _usbh_enum[0].daddr = 3;
+  TEST_ASSERT_EQUAL_PTR(_usbh_ctrl_buf[0], usbh_get_enum_buf(3));
+
+  uint8_t const* buf = usbh_get_enum_buf(1);
+  for(uint8_t idx=0; idx<CFG_TUH_ENUMERATION_MAX; idx++)
+  {
+    TEST_ASSERT_TRUE(buf + CFG_TUH_ENUMERATION_BUFSIZE <= _usbh_ctrl_buf[idx] || buf >= _usbh_ctrl_buf[idx] + CFG_TUH_ENUMERATION_BUFSIZE);
+  }
+  TEST_ASSERT_EQUAL_PTR(buf, usbh_get_enum_buf(0));
+
+  _usbh_enum[0].daddr = 0;
+}
+
+// Device unplugged before it is addressed does not stall enumeration of others
+void test_unplug_while_enumerating(void)
+{
+  uint8_t const hub = fake_dev_add(PID_HUB, FAKE_ROOT, 0);
+  fake_dev_attach(hub);
+
+  uint8_t devices[3];
+  for(uint8_t i=0; i<3; i++)
+  {
+    devices[i] = fake_dev_add((uint16_t) (PID_DEVICE + i), hub, (uint8_t) (1+i));
+    fake_dev_attach(devices[i]);
+  }
+
+  // wait until devices are being debounced
+  while ( !tuh_mounted(CFG_TUH_DEVICE_MAX+1) ) fake_frame_run();
+  for(uint32_t i=0; i<100; i++) fake_frame_run();
+
+  fake_dev_detach(devices[1]);
+
+  run_until_mounted(2, 5000);
+  for(uint32_t i=0; i<1000; i++) fake_frame_run();
+  TEST_ASSERT_EQUAL(2, mounted_count);
+
+  // plugged again
+  fake_dev_attach(devices[1]);
+  run_until_mounted(3, 5000);
+  TEST_ASSERT_EQUAL(3, mounted_count);
+}
+
+// Number of pending connection changes of a hub and its ports
+static uint8_t fake_hub_changes(uint8_t hub)
+{
+  uint8_t count = fake_dev[hub].hub_status.change.value ? 1 : 0;
+  for(uint8_t p=0; p<fake_dev[hub].port_count; p++)
+  {
+    if ( fake_dev[hub].port_status[p].change.connection ) count++;
+  }
+  return count;
+}
+
+// Changes of the hub and all its ports reported at once are processed together
+void test_hub_changes_processed_together(void)
+{
+  uint8_t const hub = fake_dev_add(PID_HUB, FAKE_ROOT, 0);
+  fake_dev_attach(hub);
+  while ( !tuh_mounted(CFG_TUH_DEVICE_MAX+1) ) fake_frame_run();
+  for(uint32_t i=0; i<100; i++) fake_frame_run();
+
+  uint8_t devices[FAKE_PORT_MAX];
+  for(uint8_t i=0; i<FAKE_PORT_MAX; i++)
+  {
+    devices[i] = fake_dev_add((uint16_t) (PID_DEVICE + i), hub, (uint8_t) (1+i));
+    fake_dev_attach(devices[i]);
+  }
+  fake_dev[hub].hub_status.change.over_current = 1;
+
+  uint32_t start = fake_frame;
+  while ( fake_hub_changes(hub) && (fake_frame - start) < 1000 ) fake_frame_run();
+  uint32_t const attach_frames = fake_frame - start;
+
+  run_until_mounted(FAKE_PORT_MAX, 20000);
+  TEST_ASSERT_EQUAL(FAKE_PORT_MAX, mounted_count);
+
+  // unplug all at once
+  for(uint8_t i=0; i<FAKE_PORT_MAX; i++) fake_dev_detach(devices[i]);
+
+  start = fake_frame;
+  while ( fake_hub_changes(hub) && (fake_frame - start) < 1000 ) fake_frame_run();
+  uint32_t const detach_frames = fake_frame - start;
+
+  for(uint32_t i=0; i<10; i++) fake_frame_run();
+  for(uint8_t daddr=1; daddr<=FAKE_PORT_MAX; daddr++) TEST_ASSERT_FALSE(tuh_mounted(daddr));
+
+  char msg[100];
+  sprintf(msg, "%u port changes acknowledged in %lu ms, %u port removals in %lu ms",
+          FAKE_PORT_MAX, (unsigned long) attach_frames, FAKE_PORT_MAX, (unsigned long) detach_frames);
+  TEST_MESSAGE(msg);
+
+  // one status poll reports all changes, then get status (3 stages) and clear feature (2 stages) of the hub and
+  // each port are queued back to back rather than waiting for the next poll in between
+  TEST_ASSERT_LESS_OR_EQUAL(FAKE_HUB_INTERVAL + (FAKE_PORT_MAX+1)*5, attach_frames);
+  TEST_ASSERT_LESS_OR_EQUAL(FAKE_HUB_INTERVAL + FAKE_PORT_MAX*5, detach_frames);
+
+  // hub is still polled
+  TEST_ASSERT_TRUE(usbh_edpt_busy(CFG_TUH_DEVICE_MAX+1, 0x81));
+}
+
+// hub with a streaming device and a device to be tested
+static fake_dev_t* setup_stream_and_device(void)
+{
+  uint8_t const hub    = fake_dev_add(PID_HUB, FAKE_ROOT, 0);
+  uint8_t const stream = fake_dev_add(PID_STREAM, hub, 1);
+  uint8_t const device = fake_dev_add(PID_DEVICE, hub, 2);
+
+  fake_dev_attach(hub);
+  fake_dev_attach(stream);
+  fake_dev_attach(device);
+
+  run_until_mounted(2, 5000);
+  TEST_ASSERT_EQUAL(2, mounted_count);
+
+  return &fake_dev[device];
+}
+
+// Control transfer of a device which does not respond times out and is retried, other devices are not affected
+void test_control_xfer_timeout(void)
+{
+  fake_dev_t* dev = setup_stream_and_device();
+  uint8_t const daddr = find_daddr(PID_DEVICE);
+  TEST_ASSERT_NOT_EQUAL(0, daddr);
+
+  dev->hang = true;
+  stream_max_gap = 0;
+
+  uint32_t const start = fake_frame;
+  TEST_ASSERT_TRUE(app_get_device_desc(daddr, 100));
+
+  for(uint32_t i=0; i<1000 && !app_count; i++) fake_frame_run();
+
+  // initial attempt and retries are all timed out
+  TEST_ASSERT_EQUAL(1, app_count);
+  TEST_ASSERT_EQUAL(XFER_RESULT_TIMEOUT, app_result);
+  TEST_ASSERT_UINT32_WITHIN(10, (CFG_TUH_CONTROL_RETRY_MAX+1)*100 + CFG_TUH_CONTROL_RETRY_MAX*CFG_TUH_CONTROL_RETRY_DELAY_MS,
+                            app_frame - start);
+  TEST_ASSERT_EQUAL(0, fake_xfer_pending(daddr));
+  TEST_ASSERT_LESS_OR_EQUAL(1, stream_max_gap);
+
+  // device recovers
+  dev->hang = false;
+  TEST_ASSERT_TRUE(app_get_device_desc(daddr, 0));
+  for(uint32_t i=0; i<10; i++) fake_frame_run();
+
+  TEST_ASSERT_EQUAL(2, app_count);
+  TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, app_result);
+}
+
+// Control transfer failed with transaction error is retried
+void test_control_xfer_retry(void)
+{
+  fake_dev_t* dev = setup_stream_and_device();
+  uint8_t const daddr = find_daddr(PID_DEVICE);
+
+  dev->fail_count = CFG_TUH_CONTROL_RETRY_MAX;
+  TEST_ASSERT_TRUE(app_get_device_desc(daddr, 0));
+  for(uint32_t i=0; i<100; i++) fake_frame_run();
+
+  TEST_ASSERT_EQUAL(1, app_count);
+  TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, app_result);
+
+  // give up once retries are exhausted
+  dev->fail_count = CFG_TUH_CONTROL_RETRY_MAX+1;
+  TEST_ASSERT_TRUE(app_get_device_desc(daddr, 0));
+  for(uint32_t i=0; i<100; i++) fake_frame_run();
+
+  TEST_ASSERT_EQUAL(2, app_count);
+  TEST_ASSERT_EQUAL(XFER_RESULT_FAILED, app_result);
+}
+
+// Endpoint transfer with deadline times out, pending transfer can be aborted
+void test_edpt_xfer_timeout_abort(void)
+{
+  fake_dev_t* dev = setup_stream_and_device();
+  uint8_t const daddr = find_daddr(PID_DEVICE);
+
+  tusb_desc_endpoint_t const desc_ep =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = 0x81,
+    .bmAttributes     = { .xfer = TUSB_XFER_BULK },
+    .wMaxPacketSize   = 64,
+    .bInterval        = 0
+  };
+  TEST_ASSERT_TRUE(tuh_edpt_open(daddr, &desc_ep));
+
+  CFG_TUH_MEM_ALIGN static uint8_t buf[64];
+  tuh_xfer_t xfer =
+  {
+    .daddr       = daddr,
+    .ep_addr     = 0x81,
+    .buflen      = sizeof(buf),
+    .buffer      = buf,
+    .complete_cb = app_xfer_cb,
+    .user_data   = 0,
+    .timeout_ms  = 50
+  };
+
+  dev->hang = true;
+
+  uint32_t const start = fake_frame;
+  TEST_ASSERT_TRUE(tuh_edpt_xfer(&xfer));
+  for(uint32_t i=0; i<100; i++) fake_frame_run();
+
+  TEST_ASSERT_EQUAL(1, app_count);
+  TEST_ASSERT_EQUAL(XFER_RESULT_TIMEOUT, app_result);
+  TEST_ASSERT_UINT32_WITHIN(2, 50, app_frame - start);
+  TEST_ASSERT_FALSE(usbh_edpt_busy(daddr, 0x81));
+  TEST_ASSERT_EQUAL(0, fake_xfer_pending(daddr));
+
+  // without timeout, transfer is pending until aborted
+  xfer.timeout_ms = 0;
+  TEST_ASSERT_TRUE(tuh_edpt_xfer(&xfer));
+  for(uint32_t i=0; i<100; i++) fake_frame_run();
+  TEST_ASSERT_EQUAL(1, app_count);
+  TEST_ASSERT_TRUE(usbh_edpt_busy(daddr, 0x81));
+
+  TEST_ASSERT_TRUE(tuh_edpt_abort_xfer(daddr, 0x81));
+  TEST_ASSERT_FALSE(tuh_edpt_abort_xfer(daddr, 0x81));
+  TEST_ASSERT_FALSE(usbh_edpt_busy(daddr, 0x81));
+  TEST_ASSERT_EQUAL(0, fake_xfer_pending(daddr));
+
+  // endpoint is usable again
+  dev->hang = false;
+  TEST_ASSERT_TRUE(tuh_edpt_xfer(&xfer));
+  for(uint32_t i=0; i<10; i++) fake_frame_run();
+  TEST_ASSERT_EQUAL(2, app_count);
+  TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, app_result);
+
+  // queued and on-going control transfers are aborted without callback
+  dev->hang = true;
+  TEST_ASSERT_TRUE(app_get_device_desc(daddr, 0));
+  TEST_ASSERT_TRUE(app_get_device_desc(daddr, 0));
+  fake_frame_run();
+  TEST_ASSERT_TRUE(tuh_edpt_abort_xfer(daddr, 0));
+  for(uint32_t i=0; i<100; i++) fake_frame_run();
+  TEST_ASSERT_EQUAL(2, app_count);
+  TEST_ASSERT_EQUAL(0, fake_xfer_pending(daddr));
+}
+
+static uint32_t queue_count;
+static uintptr_t queue_order[8];
+static xfer_result_t queue_result[8];
+static uint32_t queue_frame[8];
+static uint8_t queue_pending[8];
+static uint32_t queue_len[8];
+static uint32_t queue_calls[CFG_TUH_EDPT_XFER_MAX+1]; // per user_data
+
+static void queue_xfer_cb(tuh_xfer_t* xfer)
+{
+  TEST_ASSERT_LESS_THAN(TU_ARRAY_SIZE(queue_order), queue_count);
+  queue_order[queue_count]   = xfer->user_data;
+  queue_result[queue_count]  = xfer->result;
+  queue_frame[queue_count]   = fake_frame;
+  queue_pending[queue_count] = fake_xfer_pending(xfer->daddr);
+  queue_len[queue_count]     = xfer->actual_len;
+  queue_count++;
+
+  TEST_ASSERT_LESS_THAN(TU_ARRAY_SIZE(queue_calls), xfer->user_data);
+  queue_calls[xfer->user_data]++;
+}
+
+static bool queue_submit(uint8_t daddr, uintptr_t user_data)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[CFG_TUH_EDPT_XFER_MAX][64];
+  tuh_xfer_t xfer =
+  {
+    .daddr       = daddr,
+    .ep_addr     = 0x81,
+    .buflen      = 64,
+    .buffer      = buf[user_data % CFG_TUH_EDPT_XFER_MAX],
+    .complete_cb = queue_xfer_cb,
+    .user_data   = user_data
+  };
+  return tuh_edpt_xfer(&xfer);
+}
+
+// Transfers queued on an endpoint complete in order, the next one is submitted before invoking callback
+void test_edpt_xfer_queue(void)
+{
+  fake_dev_t* dev = setup_stream_and_device();
+  uint8_t const daddr = find_daddr(PID_DEVICE);
+
+  tusb_desc_endpoint_t const desc_ep =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = 0x81,
+    .bmAttributes     = { .xfer = TUSB_XFER_BULK },
+    .wMaxPacketSize   = 64,
+    .bInterval        = 0
+  };
+  TEST_ASSERT_TRUE(tuh_edpt_open(daddr, &desc_ep));
+
+  queue_count = 0;
+  for(uintptr_t i=1; i<=CFG_TUH_EDPT_XFER_MAX; i++) TEST_ASSERT_TRUE(queue_submit(daddr, i));
+  TEST_ASSERT_FALSE(queue_submit(daddr, 0));
+
+  // controller without queue support has one transfer at a time
+  TEST_ASSERT_EQUAL(1, fake_xfer_pending(daddr));
+
+  for(uint32_t i=0; i<10; i++) fake_frame_run();
+
+  TEST_ASSERT_EQUAL(CFG_TUH_EDPT_XFER_MAX, queue_count);
+  for(uint32_t i=0; i<CFG_TUH_EDPT_XFER_MAX; i++)
+  {
+    TEST_ASSERT_EQUAL(i+1, queue_order[i]);
+    TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, queue_result[i]);
+    TEST_ASSERT_EQUAL(i+1 < CFG_TUH_EDPT_XFER_MAX ? 1 : 0, queue_pending[i]);
+    if ( i ) TEST_ASSERT_EQUAL(queue_frame[i-1] + 1, queue_frame[i]);
+  }
+  TEST_ASSERT_FALSE(usbh_edpt_busy(daddr, 0x81));
+
+  // transfers queued after a stalled one are aborted
+  dev->edpt_stall = true;
+  queue_count = 0;
+  for(uintptr_t i=1; i<=CFG_TUH_EDPT_XFER_MAX; i++) TEST_ASSERT_TRUE(queue_submit(daddr, i));
+  for(uint32_t i=0; i<10; i++) fake_frame_run();
+
+  TEST_ASSERT_EQUAL(CFG_TUH_EDPT_XFER_MAX, queue_count);
+  TEST_ASSERT_EQUAL(XFER_RESULT_STALLED, queue_result[0]);
+  for(uint32_t i=1; i<CFG_TUH_EDPT_XFER_MAX; i++)
+  {
+    TEST_ASSERT_EQUAL(i+1, queue_order[i]);
+    TEST_ASSERT_EQUAL(XFER_RESULT_FAILED, queue_result[i]);
+  }
+  TEST_ASSERT_FALSE(usbh_edpt_busy(daddr, 0x81));
+  TEST_ASSERT_EQUAL(0, fake_xfer_pending(daddr));
+
+  // all queued transfers are aborted without callback
+  dev->edpt_stall = false;
+  dev->hang       = true;
+  queue_count = 0;
+  TEST_ASSERT_TRUE(queue_submit(daddr, 1));
+  TEST_ASSERT_TRUE(queue_submit(daddr, 2));
+  fake_frame_run();
+  TEST_ASSERT_TRUE(tuh_edpt_abort_xfer(daddr, 0x81));
+  TEST_ASSERT_FALSE(usbh_edpt_busy(daddr, 0x81));
+  TEST_ASSERT_EQUAL(0, fake_xfer_pending(daddr));
+
+  dev->hang = false;
+  for(uint32_t i=0; i<10; i++) fake_frame_run();
+  TEST_ASSERT_EQUAL(0, queue_count);
+
+  // endpoint is usable again
+  TEST_ASSERT_TRUE(queue_submit(daddr, 1));
+  for(uint32_t i=0; i<10; i++) fake_frame_run();
+  TEST_ASSERT_EQUAL(1, queue_count);
+  TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, queue_result[0]);
+}
+
+// Transaction error on the oldest transfer aborts all queued after it, each callback is invoked exactly once
+void test_edpt_xfer_queue_failed(void)
+{
+  fake_dev_t* dev = setup_stream_and_device();
+  uint8_t const daddr = find_daddr(PID_DEVICE);
+
+  tusb_desc_endpoint_t const desc_ep =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = 0x81,
+    .bmAttributes     = { .xfer = TUSB_XFER_BULK },
+    .wMaxPacketSize   = 64,
+    .bInterval        = 0
+  };
+  TEST_ASSERT_TRUE(tuh_edpt_open(daddr, &desc_ep));
+
+  dev->edpt_fail_count = 1;
+  queue_count = 0;
+  tu_memclr(queue_calls, sizeof(queue_calls));
+  for(uintptr_t i=1; i<=CFG_TUH_EDPT_XFER_MAX; i++) TEST_ASSERT_TRUE(queue_submit(daddr, i));
+  TEST_ASSERT_TRUE(usbh_edpt_busy(daddr, 0x81));
+
+  for(uint32_t i=0; i<10; i++) fake_frame_run();
+
+  TEST_ASSERT_EQUAL(CFG_TUH_EDPT_XFER_MAX, queue_count);
+  for(uint32_t i=0; i<CFG_TUH_EDPT_XFER_MAX; i++)
+  {
+    TEST_ASSERT_EQUAL(i+1, queue_order[i]);
+    TEST_ASSERT_EQUAL(XFER_RESULT_FAILED, queue_result[i]);
+    TEST_ASSERT_EQUAL(0, queue_len[i]);
+    TEST_ASSERT_EQUAL(1, queue_calls[i+1]);
+  }
+  TEST_ASSERT_EQUAL(0, queue_calls[0]);
+  TEST_ASSERT_FALSE(usbh_edpt_busy(daddr, 0x81));
+  TEST_ASSERT_EQUAL(0, fake_xfer_pending(daddr));
+
+  // endpoint is usable again
+  queue_count = 0;
+  TEST_ASSERT_TRUE(queue_submit(daddr, 1));
+  for(uint32_t i=0; i<10; i++) fake_frame_run();
+  TEST_ASSERT_EQUAL(1, queue_count);
+  TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, queue_result[0]);
+  TEST_ASSERT_EQUAL(64, queue_len[0]);
+  TEST_ASSERT_EQUAL(2, queue_calls[1]);
+}
+
+static uint32_t iso_batch_count;
+
+static void iso_stream_cb(tuh_iso_stream_t* stream, uint8_t* buffer, tuh_iso_packet_t* packets, uint16_t count)
+{
+  // batches are handed back in submission order
+  uint32_t const batch = iso_batch_count % stream->batch_count;
+  TEST_ASSERT_EQUAL_PTR(stream->buffer + batch * stream->batch_packets * stream->packet_size, buffer);
+  TEST_ASSERT_EQUAL(stream->batch_packets, count);
+
+  for(uint16_t i=0; i<count; i++)
+  {
+    TEST_ASSERT_EQUAL(stream->packet_size, packets[i].actual_length);
+    TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, packets[i].result);
+  }
+
+  iso_batch_count++;
+}
+
+// Isochronous stream keeps all its batches queued until stopped or the device is removed
+void test_iso_stream(void)
+{
+  setup_stream_and_device();
+  uint8_t const daddr = find_daddr(PID_DEVICE);
+  uint8_t const device = (uint8_t) (fake_dev_by_address(daddr) - fake_dev);
+
+  tusb_desc_endpoint_t const desc_ep =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = 0x83,
+    .bmAttributes     = { .xfer = TUSB_XFER_ISOCHRONOUS },
+    .wMaxPacketSize   = 64,
+    .bInterval        = 1
+  };
+  TEST_ASSERT_TRUE(tuh_edpt_open(daddr, &desc_ep));
+
+  CFG_TUH_MEM_ALIGN static uint8_t buf[3*4*64];
+  static tuh_iso_packet_t packets[3*4];
+  tuh_iso_stream_t stream =
+  {
+    .daddr         = daddr,
+    .ep_addr       = 0x83,
+    .packet_size   = 64,
+    .batch_count   = 3,
+    .batch_packets = 4,
+    .buffer        = buf,
+    .packets       = packets,
+    .complete_cb   = iso_stream_cb,
+  };
+
+  iso_batch_count = 0;
+  TEST_ASSERT_TRUE(tuh_iso_stream_start(&stream));
+  TEST_ASSERT_FALSE(tuh_iso_stream_start(&stream));
+  TEST_ASSERT_EQUAL(3, fake_xfer_pending(daddr));
+
+  for(uint32_t i=0; i<10; i++) fake_frame_run();
+  TEST_ASSERT_EQUAL(30, iso_batch_count);
+  TEST_ASSERT_EQUAL(3, fake_xfer_pending(daddr));
+
+  // no callback after stop
+  TEST_ASSERT_TRUE(tuh_iso_stream_stop(&stream));
+  TEST_ASSERT_FALSE(tuh_iso_stream_stop(&stream));
+  TEST_ASSERT_EQUAL(0, fake_xfer_pending(daddr));
+  for(uint32_t i=0; i<10; i++) fake_frame_run();
+  TEST_ASSERT_EQUAL(30, iso_batch_count);
+
+  // restart then unplug
+  iso_batch_count = 0;
+  TEST_ASSERT_TRUE(tuh_iso_stream_start(&stream));
+  fake_frame_run();
+  TEST_ASSERT_EQUAL(3, iso_batch_count);
+
+  fake_dev_detach(device);
+  for(uint32_t i=0; i<100; i++) fake_frame_run();
+  TEST_ASSERT_FALSE(stream.running);
+  TEST_ASSERT_FALSE(tuh_iso_stream_stop(&stream));
+}
+
+// Buffers allocated from the pool are aligned, owned by the device and released once it is unplugged
+void test_buf_pool_released_on_unplug(void)
+{
+  uint8_t const hub = fake_dev_add(PID_HUB, FAKE_ROOT, 0);
+  uint8_t const device = fake_dev_add(PID_DEVICE, hub, 1);
+  fake_dev_attach(hub);
+  fake_dev_attach(device);
+  run_until_mounted(1, 5000);
+  uint8_t const daddr = find_daddr(PID_DEVICE);
+  TEST_ASSERT_NOT_EQUAL(0, daddr);
+
+  uint8_t* buf1 = (uint8_t*) usbh_buf_alloc(daddr, 100);
+  uint8_t* buf2 = (uint8_t*) usbh_buf_alloc(daddr, 64);
+  TEST_ASSERT_NOT_NULL(buf1);
+  TEST_ASSERT_NOT_NULL(buf2);
+  TEST_ASSERT_EQUAL(0, ((uintptr_t) buf1) % CFG_TUH_MEM_POOL_ALIGN);
+  TEST_ASSERT_EQUAL_PTR(buf1 + 128, buf2); // padded to alignment
+
+  // 64 bytes left
+  TEST_ASSERT_NULL(usbh_buf_alloc(daddr, 65));
+  TEST_ASSERT_NOT_NULL(usbh_buf_alloc(daddr, 64));
+  TEST_ASSERT_NULL(usbh_buf_alloc(daddr, 1));
+
+  fake_dev_detach(device);
+  for(uint32_t i=0; i<100; i++) fake_frame_run();
+  TEST_ASSERT_FALSE(tuh_mounted(daddr));
+
+  // whole pool is available again
+  TEST_ASSERT_EQUAL_PTR(buf1, usbh_buf_alloc(daddr, CFG_TUH_MEM_POOL_SIZE));
+}
+
+//--------------------------------------------------------------------+
+// Descriptor cache
+//--------------------------------------------------------------------+
+
+static uint8_t  cache_image[sizeof(desc_cache_t)];
+static uint32_t cache_update_count;
+
+void tuh_descriptor_cache_updated_cb(void const* cache, uint32_t size)
+{
+  TEST_ASSERT_EQUAL(sizeof(cache_image), size);
+  memcpy(cache_image, cache, size);
+  cache_update_count++;
+}
+
+static uint16_t str_desc[16];
+
+static void app_get_string(uint8_t daddr, uint8_t index)
+{
+  app_count = 0;
+  TEST_ASSERT_TRUE(tuh_descriptor_get_string(daddr, index, 0x0409, str_desc, sizeof(str_desc), app_xfer_cb, 0));
+  for(uint32_t i=0; i<100 && !app_count; i++) fake_frame_run();
+  TEST_ASSERT_EQUAL(1, app_count);
+  TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, app_result);
+}
+
+// Attach a device behind a mounted hub and return its address once mounted
+static uint8_t cache_attach(uint8_t device)
+{
+  uint8_t const count = mounted_count;
+  fake_dev_attach(device);
+  run_until_mounted((uint8_t) (count + 1), 5000);
+  TEST_ASSERT_EQUAL(count + 1, mounted_count);
+  return find_daddr(PID_DEVICE);
+}
+
+static void cache_detach(uint8_t device)
+{
+  fake_dev_detach(device);
+  for(uint32_t i=0; i<100; i++) fake_frame_run();
+}
+
+// Re-attached device is configured from cached descriptors, serial number is always read from device
+void test_desc_cache_reattach(void)
+{
+  uint8_t const hub = fake_dev_add(PID_HUB, FAKE_ROOT, 0);
+  uint8_t const device = fake_dev_add(PID_DEVICE, hub, 1);
+  fake_dev_attach(hub);
+
+  uint8_t daddr = cache_attach(device);
+  TEST_ASSERT_EQUAL(2, fake_dev[device].desc_requests); // configuration 9 bytes and full
+  app_get_string(daddr, 1);
+  app_get_string(daddr, 2);
+  TEST_ASSERT_EQUAL(4, fake_dev[device].desc_requests);
+
+  cache_detach(device);
+  fake_dev[device].desc_requests = 0;
+
+  daddr = cache_attach(device);
+  TEST_ASSERT_EQUAL(0, fake_dev[device].desc_requests);
+
+  app_get_string(daddr, 1);
+  TEST_ASSERT_EQUAL(0, fake_dev[device].desc_requests);
+  TEST_ASSERT_EQUAL_UINT16('F', str_desc[1]);
+
+  app_get_string(daddr, 2);
+  TEST_ASSERT_EQUAL(1, fake_dev[device].desc_requests);
+}
+
+// Cache entry is only used if the device descriptor read from device is identical
+void test_desc_cache_device_changed(void)
+{
+  uint8_t const hub = fake_dev_add(PID_HUB, FAKE_ROOT, 0);
+  uint8_t const device = fake_dev_add(PID_DEVICE, hub, 1);
+  fake_dev_attach(hub);
+
+  cache_attach(device);
+  cache_detach(device);
+
+  // firmware update
+  fake_dev[device].bcd_device    = 0x0101;
+  fake_dev[device].desc_requests = 0;
+
+  cache_attach(device);
+  TEST_ASSERT_EQUAL(2, fake_dev[device].desc_requests);
+}
+
+// Cache saved by application is used after restart
+void test_desc_cache_restore(void)
+{
+  uint8_t const hub = fake_dev_add(PID_HUB, FAKE_ROOT, 0);
+  uint8_t const device = fake_dev_add(PID_DEVICE, hub, 1);
+  fake_dev_attach(hub);
+
+  cache_update_count = 0;
+  cache_attach(device);
+  TEST_ASSERT_NOT_EQUAL(0, cache_update_count);
+
+  // power cycle
+  tu_memclr(fake_xfer, sizeof(fake_xfer));
+  fake_dev[device].attached = false;
+  fake_dev[hub].port_status[0].status.value = 0;
+  fake_dev[hub].port_status[0].change.value = 0;
+  mounted_count = 0;
+  _usbh_controller = TUSB_INDEX_INVALID_8;
+  TEST_ASSERT_TRUE(tuh_init(0));
+  hcd_event_device_attach(0, false);
+
+  // image of another configuration is rejected
+  TEST_ASSERT_FALSE(tuh_descriptor_cache_restore(cache_image, sizeof(cache_image) - 1));
+  TEST_ASSERT_TRUE(tuh_descriptor_cache_restore(cache_image, sizeof(cache_image)));
+
+  fake_dev[hub].desc_requests    = 0;
+  fake_dev[device].desc_requests = 0;
+  for(uint32_t i=0; i<2000; i++) fake_frame_run();
+  TEST_ASSERT_TRUE(tuh_mounted(CFG_TUH_DEVICE_MAX+1));
+
+  cache_attach(device);
+  TEST_ASSERT_EQUAL(0, fake_dev[hub].desc_requests);
+  TEST_ASSERT_EQUAL(0, fake_dev[device].desc_requests);
+}
+
+//--------------------------------------------------------------------+
+// String fetch
+//--------------------------------------------------------------------+
+
+static tuh_strings_t strings_result[CFG_TUH_DEVICE_MAX + CFG_TUH_HUB + 1];
+static uint32_t      strings_count[CFG_TUH_DEVICE_MAX + CFG_TUH_HUB + 1];
+
+static void app_strings_cb(uint8_t daddr, tuh_strings_t const* strings, uintptr_t user_data)
+{
+  TEST_ASSERT_EQUAL(daddr, user_data);
+  strings_result[daddr] = *strings;
+  strings_count[daddr]++;
+}
+
+// Strings of several devices are fetched one device after another with a single context
+void test_strings_get(void)
+{
+  tu_memclr(strings_count, sizeof(strings_count));
+
+  uint8_t const hub = fake_dev_add(PID_HUB, FAKE_ROOT, 0);
+  uint8_t const dev1 = fake_dev_add(PID_DEVICE, hub, 1);
+  uint8_t const dev2 = fake_dev_add(PID_DEVICE+1, hub, 2);
+  fake_dev_attach(hub);
+  fake_dev_attach(dev1);
+  fake_dev_attach(dev2);
+  run_until_mounted(3, 5000);
+
+  uint8_t const hub_addr = CFG_TUH_DEVICE_MAX + 1;
+  uint8_t const addr1 = find_daddr(PID_DEVICE);
+  uint8_t const addr2 = find_daddr(PID_DEVICE+1);
+
+  // hub has no string, completed immediately
+  TEST_ASSERT_TRUE(tuh_strings_get(hub_addr, app_strings_cb, hub_addr));
+  TEST_ASSERT_EQUAL(1, strings_count[hub_addr]);
+  TEST_ASSERT_EQUAL(0, strings_result[hub_addr].langid);
+  TEST_ASSERT_EQUAL_STRING("", strings_result[hub_addr].product);
+
+  TEST_ASSERT_TRUE(tuh_strings_get(addr1, app_strings_cb, addr1));
+  TEST_ASSERT_TRUE(tuh_strings_get(addr2, app_strings_cb, addr2));
+  TEST_ASSERT_FALSE(tuh_strings_get(addr2, app_strings_cb, addr2));
+
+  for(uint32_t i=0; i<100; i++) fake_frame_run();
+
+  TEST_ASSERT_EQUAL(1, strings_count[addr1]);
+  TEST_ASSERT_EQUAL(1, strings_count[addr2]);
+
+  // preferred language, manufacturer truncated before the 4-byte character
+  TEST_ASSERT_EQUAL_HEX16(0x0409, strings_result[addr1].langid);
+  TEST_ASSERT_EQUAL_STRING("\xC3\xA9\xE2\x82\xAC", strings_result[addr1].manufacturer);
+  TEST_ASSERT_EQUAL_STRING("Fake", strings_result[addr1].product);
+  TEST_ASSERT_EQUAL_STRING("1", strings_result[addr1].serial);
+  TEST_ASSERT_EQUAL_STRING("2", strings_result[addr2].serial);
+
+  // fetched strings are kept
+  uint32_t const requests = fake_dev[dev1].desc_requests;
+  TEST_ASSERT_TRUE(tuh_strings_get(addr1, app_strings_cb, addr1));
+  TEST_ASSERT_EQUAL(2, strings_count[addr1]);
+  TEST_ASSERT_EQUAL(requests, fake_dev[dev1].desc_requests);
+}
+
+// Fetch of an unplugged device is dropped without callback, the next device takes over its context
+void test_strings_get_unplug(void)
+{
+  tu_memclr(strings_count, sizeof(strings_count));
+
+  uint8_t const hub = fake_dev_add(PID_HUB, FAKE_ROOT, 0);
+  uint8_t const dev1 = fake_dev_add(PID_DEVICE, hub, 1);
+  uint8_t const dev2 = fake_dev_add(PID_DEVICE+1, hub, 2);
+  fake_dev_attach(hub);
+  fake_dev_attach(dev1);
+  fake_dev_attach(dev2);
+  run_until_mounted(3, 5000);
+
+  uint8_t const addr1 = find_daddr(PID_DEVICE);
+  uint8_t const addr2 = find_daddr(PID_DEVICE+1);
+
+  TEST_ASSERT_TRUE(tuh_strings_get(addr1, app_strings_cb, addr1));
+  TEST_ASSERT_TRUE(tuh_strings_get(addr2, app_strings_cb, addr2));
+
+  // pending request of the unplugged device blocks the control pipe until it times out
+  fake_dev_detach(dev1);
+  for(uint32_t i=0; i<CFG_TUH_CONTROL_TIMEOUT_MS + 1000; i++) fake_frame_run();
+
+  TEST_ASSERT_EQUAL(0, strings_count[addr1]);
+  TEST_ASSERT_EQUAL(1, strings_count[addr2]);
+  TEST_ASSERT_EQUAL_STRING("2", strings_result[addr2].serial);
+}
@@ -0,0 +1,328 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+#include "unity.h"
+
+// Control transfers of devices on 2 root ports are run on a fake host controller. Transfers of different devices are
+// executed concurrently, each device has a single control pipe.
+#define CFG_TUSB_RHPORT0_MODE       (OPT_MODE_HOST | OPT_MODE_FULL_SPEED)
+#define CFG_TUH_DEVICE_MAX          2
+#define CFG_TUH_HUB                 1
+#define CFG_TUH_CONTROL_CONCURRENT  1
+
+#include "osal/osal.h"
+#include "tusb_fifo.h"
+#include "tusb.c"
+#include "host/usbh.c"
+#include "host/hub.c"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  DEV1_ADDR  = 1, // on root port 0
+  DEV2_ADDR  = 2, // on root port 1
+  CB_MAX     = 16,
+};
+
+// Fake device: control transfers are completed at once unless it hangs
+static struct
+{
+  bool     hang;
+  uint32_t setup_count;
+} fake_dev[CFG_TUH_DEVICE_MAX+1];
+
+static uint8_t  setup_daddr[CB_MAX]; // device of each setup packet sent by usbh, in order
+static uint32_t setup_count;
+
+static uintptr_t cb_user_data[CB_MAX]; // completed transfers, in order
+static uint8_t   cb_result[CB_MAX];
+static uint32_t  cb_count;
+
+//--------------------------------------------------------------------+
+// Fake host controller
+//--------------------------------------------------------------------+
+
+bool hcd_init(uint8_t rhport)
+{
+  (void) rhport;
+  return true;
+}
+
+void hcd_int_enable(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+void hcd_int_disable(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+uint32_t hcd_frame_number(uint8_t rhport)
+{
+  (void) rhport;
+  return 0;
+}
+
+bool hcd_port_connect_status(uint8_t rhport)
+{
+  (void) rhport;
+  return true;
+}
+
+void hcd_port_reset(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+void hcd_port_reset_end(uint8_t rhport)
+{
+  (void) rhport;
+}
+
+tusb_speed_t hcd_port_speed_get(uint8_t rhport)
+{
+  (void) rhport;
+  return TUSB_SPEED_FULL;
+}
+
+void hcd_device_close(uint8_t rhport, uint8_t dev_addr)
+{
+  (void) rhport;
+  (void) dev_addr;
+}
+
+bool hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const * ep_desc)
+{
+  (void) rhport;
+  (void) dev_addr;
+  (void) ep_desc;
+  return true;
+}
+
+// Data and status stage
+bool hcd_edpt_xfer(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t buflen)
+{
+  (void) rhport;
+  TEST_ASSERT_EQUAL(0, tu_edpt_number(ep_addr));
+
+  if ( tu_edpt_dir(ep_addr) == TUSB_DIR_IN && buflen ) memset(buffer, dev_addr, buflen);
+  if ( !fake_dev[dev_addr].hang ) hcd_event_xfer_complete(dev_addr, ep_addr, buflen, XFER_RESULT_SUCCESS, false);
+
+  return true;
+}
+
+bool hcd_setup_send(uint8_t rhport, uint8_t dev_addr, uint8_t const setup_packet[8])
+{
+  (void) rhport;
+  (void) setup_packet;
+
+  TEST_ASSERT_LESS_THAN(CB_MAX, setup_count);
+  setup_daddr[setup_count++] = dev_addr;
+  fake_dev[dev_addr].setup_count++;
+
+  if ( !fake_dev[dev_addr].hang ) hcd_event_xfer_complete(dev_addr, 0x00, 8, XFER_RESULT_SUCCESS, false);
+
+  return true;
+}
+
+bool hcd_edpt_clear_stall(uint8_t daddr, uint8_t ep_addr)
+{
+  (void) daddr;
+  (void) ep_addr;
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+static tusb_control_request_t const request_get_status =
+{
+  .bmRequestType_bit =
+  {
+    .recipient = TUSB_REQ_RCPT_DEVICE,
+    .type      = TUSB_REQ_TYPE_STANDARD,
+    .direction = TUSB_DIR_IN
+  },
+  .bRequest = TUSB_REQ_GET_STATUS,
+  .wValue   = 0,
+  .wIndex   = 0,
+  .wLength  = 2
+};
+
+static void xfer_cb(tuh_xfer_t* xfer)
+{
+  TEST_ASSERT_LESS_THAN(CB_MAX, cb_count);
+  cb_user_data[cb_count] = xfer->user_data;
+  cb_result[cb_count]    = (uint8_t) xfer->result;
+  cb_count++;
+}
+
+// Unplug device 1 once a transfer of device 2 is complete
+static void unplug_cb(tuh_xfer_t* xfer)
+{
+  xfer_cb(xfer);
+  hcd_event_device_remove(0, false);
+}
+
+static bool control_xfer(uint8_t daddr, uint8_t* buffer, tuh_xfer_cb_t complete_cb, uintptr_t user_data)
+{
+  tuh_xfer_t xfer =
+  {
+    .daddr       = daddr,
+    .ep_addr     = 0,
+    .setup       = &request_get_status,
+    .buffer      = buffer,
+    .complete_cb = complete_cb,
+    .user_data   = user_data
+  };
+  return tuh_control_xfer(&xfer);
+}
+
+static uint8_t ctrl_xfer_used_count(void)
+{
+  uint8_t count = 0;
+  for(uint8_t i=0; i<CFG_TUH_CONTROL_XFER_MAX; i++) count += (_ctrl_xfer[i].state != CTRL_XFER_FREE) ? 1 : 0;
+  return count;
+}
+
+void setUp(void)
+{
+  tu_memclr(fake_dev, sizeof(fake_dev));
+  setup_count = 0;
+  cb_count    = 0;
+
+  // allow re-init for each test
+  _usbh_controller = TUSB_INDEX_INVALID_8;
+  TEST_ASSERT_TRUE(tuh_init(0));
+
+  // devices are addressed: only control pipe is used
+  _usbh_devices[DEV1_ADDR-1].connected = 1;
+  _usbh_devices[DEV1_ADDR-1].rhport    = 0;
+  _usbh_devices[DEV2_ADDR-1].connected = 1;
+  _usbh_devices[DEV2_ADDR-1].rhport    = 1;
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+// Transfers are queued instead of failing while the control pipe is busy, and completed in submission order
+void test_control_xfer_queued(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[3][2];
+
+  fake_dev[DEV1_ADDR].hang = true;
+  TEST_ASSERT_TRUE(control_xfer(DEV1_ADDR, buf[0], xfer_cb, 0));
+  TEST_ASSERT_TRUE(control_xfer(DEV1_ADDR, buf[1], xfer_cb, 1));
+  TEST_ASSERT_TRUE(control_xfer(DEV2_ADDR, buf[2], xfer_cb, 2));
+
+  // device 2 is not blocked by device 1
+  TEST_ASSERT_EQUAL(2, setup_count);
+  TEST_ASSERT_EQUAL(DEV1_ADDR, setup_daddr[0]);
+  TEST_ASSERT_EQUAL(DEV2_ADDR, setup_daddr[1]);
+  tuh_task();
+  TEST_ASSERT_EQUAL(1, cb_count);
+  TEST_ASSERT_EQUAL(2, cb_user_data[0]);
+  TEST_ASSERT_EQUAL_HEX8(DEV2_ADDR, buf[2][0]);
+
+  // device 1 responds: second transfer is started once first one is complete
+  fake_dev[DEV1_ADDR].hang = false;
+  hcd_event_xfer_complete(DEV1_ADDR, 0x00, 8, XFER_RESULT_SUCCESS, false);
+  tuh_task();
+
+  TEST_ASSERT_EQUAL(3, cb_count);
+  TEST_ASSERT_EQUAL(0, cb_user_data[1]);
+  TEST_ASSERT_EQUAL(1, cb_user_data[2]);
+  TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, cb_result[2]);
+  TEST_ASSERT_EQUAL(2, fake_dev[DEV1_ADDR].setup_count);
+  TEST_ASSERT_EQUAL_HEX8(DEV1_ADDR, buf[1][1]);
+  TEST_ASSERT_EQUAL(0, ctrl_xfer_used_count());
+}
+
+// Submission fails only when all slots are in use, queued transfers of an unplugged device are dropped
+void test_control_xfer_pool_full(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[2];
+
+  fake_dev[DEV1_ADDR].hang = true;
+  for(uint8_t i=0; i<CFG_TUH_CONTROL_XFER_MAX; i++) TEST_ASSERT_TRUE(control_xfer(DEV1_ADDR, buf, xfer_cb, i));
+  TEST_ASSERT_FALSE(control_xfer(DEV2_ADDR, buf, xfer_cb, 0));
+  TEST_ASSERT_EQUAL(1, setup_count);
+
+  hcd_event_device_remove(0, false);
+  tuh_task();
+
+  TEST_ASSERT_EQUAL(0, cb_count);
+  TEST_ASSERT_EQUAL(0, ctrl_xfer_used_count());
+  TEST_ASSERT_EQUAL(0, _ctrl_queue_count);
+
+  TEST_ASSERT_TRUE(control_xfer(DEV2_ADDR, buf, xfer_cb, 0));
+  tuh_task();
+  TEST_ASSERT_EQUAL(1, cb_count);
+}
+
+// Blocking transfer of an unplugged device returns with XFER_RESULT_FAILED instead of waiting forever
+void test_control_xfer_blocking_unplug(void)
+{
+  CFG_TUH_MEM_ALIGN static uint8_t buf[3][2];
+
+  // device 1 is busy, device 2 completes while blocking transfer waits and unplugs device 1
+  fake_dev[DEV1_ADDR].hang = true;
+  TEST_ASSERT_TRUE(control_xfer(DEV1_ADDR, buf[0], xfer_cb, 0));
+  TEST_ASSERT_TRUE(control_xfer(DEV2_ADDR, buf[1], unplug_cb, 1));
+
+  xfer_result_t result = XFER_RESULT_INVALID;
+  tuh_xfer_t xfer =
+  {
+    .daddr       = DEV1_ADDR,
+    .ep_addr     = 0,
+    .setup       = &request_get_status,
+    .buffer      = buf[2],
+    .complete_cb = NULL,
+    .user_data   = (uintptr_t) &result
+  };
+  TEST_ASSERT_TRUE(tuh_control_xfer(&xfer));
+
+  TEST_ASSERT_EQUAL(XFER_RESULT_FAILED, xfer.result);
+  TEST_ASSERT_EQUAL(XFER_RESULT_FAILED, result);
+  TEST_ASSERT_EQUAL(0, xfer.actual_len);
+
+  // transfer in progress of unplugged device is dropped without callback
+  TEST_ASSERT_EQUAL(1, cb_count);
+  TEST_ASSERT_EQUAL(1, cb_user_data[0]);
+  TEST_ASSERT_EQUAL(1, fake_dev[DEV1_ADDR].setup_count);
+  TEST_ASSERT_EQUAL(0, ctrl_xfer_used_count());
+}
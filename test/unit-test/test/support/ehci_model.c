@@ -0,0 +1,597 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <string.h>
+#include "unity.h"
+
+#include "ehci_model.h"
+
+// hcd_int_handler() is implemented by the driver under test
+extern void hcd_int_handler(uint8_t rhport);
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  // Bus time of a micro frame and transaction overhead in high speed byte times
+  UFRAME_BUS_TIME  = 7500,
+  XACT_OVERHEAD    = 20,
+
+  PORT_RESET_UFRAMES = 8,
+  PERIOD_NODE_MAX    = 256, // loop guard of a frame list entry
+
+  PORTSC_POS_HIGHSPEED = 9,
+  PORTSC_POS_NXP_SPEED = 26,
+
+  // Words of qTD (and QHD overlay)
+  QTD_WORD_TOKEN   = 2,
+  QTD_WORD_BUFFER0 = 3,
+  QTD_TOKEN_PING   = TU_BIT(0),
+  QTD_TOKEN_TOGGLE = TU_BIT(31),
+};
+
+ehci_cap_registers_t ehci_model_cap_regs;
+ehci_registers_t     ehci_model_regs;
+ehci_model_stats_t   ehci_model_stats;
+
+static struct
+{
+  ehci_model_xact_cb_t xact_cb;
+  uint32_t uframe;
+  uint32_t int_pending;   // interrupt status not yet presented to driver
+  uint32_t int_last;      // micro frame of last interrupt
+  uint32_t port_reset_end;
+  uint32_t budget;        // bus time left in current micro frame
+  bool     data_xact;     // data transferred in current micro frame
+} _model;
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+// controller and driver share the address space
+static inline void* ptr_of(uint32_t addr)
+{
+  return (void*) (uintptr_t) addr;
+}
+
+static inline uint32_t* words_of(volatile void* p)
+{
+  return (uint32_t*) (uintptr_t) p;
+}
+
+static uint32_t framelist_size(void)
+{
+  uint32_t const cmd = ehci_model_regs.command;
+  uint32_t const bits = ((cmd >> EHCI_USBCMD_POS_FRAMELIST_SIZE) & 3) |
+                        (((cmd >> EHCI_USBCMD_POS_NXP_FRAMELIST_SIZE_MSB) & 1) << 2);
+  return 1024u >> bits;
+}
+
+// bus time of a transaction, full/low speed transactions are slower by the ratio of bit rates
+static uint32_t xact_cost(uint8_t ep_speed, uint16_t len)
+{
+  uint32_t const cost = len + XACT_OVERHEAD;
+  switch ( ep_speed )
+  {
+    case 0:  return cost * 40;  // full speed
+    case 1:  return cost * 320; // low speed
+    default: return cost;
+  }
+}
+
+// Copy between host memory described by qTD buffer pointers and a packet
+static void qtd_buffer_copy(uint32_t const* words, uint8_t* packet, uint16_t len, bool to_packet)
+{
+  uint32_t page   = (words[QTD_WORD_TOKEN] >> 12) & 7;
+  uint32_t offset = words[QTD_WORD_BUFFER0] & 0xFFF;
+
+  while ( len )
+  {
+    TEST_ASSERT_LESS_THAN_MESSAGE(5, page, "qTD buffer overrun");
+
+    uint16_t const count = (uint16_t) tu_min32(len, 4096 - offset);
+    uint8_t* mem = (uint8_t*) ptr_of((words[QTD_WORD_BUFFER0 + page] & ~0xFFFu) + offset);
+
+    if ( to_packet ) memcpy(packet, mem, count);
+    else             memcpy(mem, packet, count);
+
+    packet += count;
+    len    -= count;
+    offset  = 0;
+    page++;
+  }
+}
+
+// Advance current page and offset of overlay after n bytes
+static void qtd_buffer_advance(uint32_t* words, uint16_t n)
+{
+  uint32_t page   = (words[QTD_WORD_TOKEN] >> 12) & 7;
+  uint32_t offset = (words[QTD_WORD_BUFFER0] & 0xFFF) + n;
+
+  page   += offset >> 12;
+  offset &= 0xFFF;
+
+  words[QTD_WORD_TOKEN]   = (words[QTD_WORD_TOKEN] & ~(7u << 12)) | (page << 12);
+  words[QTD_WORD_BUFFER0] = (words[QTD_WORD_BUFFER0] & ~0xFFFu) | offset;
+}
+
+static void int_raise(uint32_t mask)
+{
+  _model.int_pending |= mask;
+}
+
+// Copy between host memory described by isochronous page pointers and a packet, a packet can cross into next page
+static void iso_buffer_copy(uint32_t const* pages, uint8_t page_count, uint8_t page, uint32_t offset,
+                            uint8_t* packet, uint16_t len, bool to_packet)
+{
+  while ( len )
+  {
+    TEST_ASSERT_LESS_THAN_MESSAGE(page_count, page, "isochronous buffer overrun");
+
+    uint16_t const count = (uint16_t) tu_min32(len, 4096 - offset);
+    uint8_t* mem = (uint8_t*) ptr_of((pages[page] & ~0xFFFu) + offset);
+
+    if ( to_packet ) memcpy(packet, mem, count);
+    else             memcpy(mem, packet, count);
+
+    packet += count;
+    len    -= count;
+    offset  = 0;
+    page++;
+  }
+}
+
+// Isochronous transaction, device may not NAK or STALL: anything but data is an error
+static int32_t iso_xact(uint8_t dev_addr, uint8_t ep_num, bool in, uint8_t* packet, uint16_t len)
+{
+  // periodic bandwidth is reserved by software, split transactions are charged high speed bus time
+  uint32_t const cost = xact_cost(2, len);
+  _model.budget = (_model.budget > cost) ? (_model.budget - cost) : 0;
+
+  ehci_model_stats.xacts++;
+  int32_t const result = _model.xact_cb(dev_addr, ep_num, in ? EHCI_PID_IN : EHCI_PID_OUT, packet, len);
+  if ( result < 0 ) return result;
+
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(len, result, "device returned more than requested");
+  ehci_model_stats.bytes += (uint32_t) result;
+  _model.data_xact = true;
+
+  return result;
+}
+
+//--------------------------------------------------------------------+
+// Queue Head
+//--------------------------------------------------------------------+
+
+// Retire overlay: write token and current offset back to qTD
+static void qhd_retire(ehci_qhd_t* qhd, bool short_packet, bool periodic)
+{
+  uint32_t* overlay = words_of(&qhd->qtd_overlay);
+  uint32_t* qtd = (uint32_t*) ptr_of(qhd->qtd_addr);
+
+  qtd[QTD_WORD_TOKEN]   = overlay[QTD_WORD_TOKEN];
+  qtd[QTD_WORD_BUFFER0] = overlay[QTD_WORD_BUFFER0];
+
+  if ( qhd->qtd_overlay.halted )
+  {
+    int_raise(EHCI_INT_MASK_ERROR);
+  }
+  else
+  {
+    if ( qhd->qtd_overlay.int_on_complete || short_packet )
+    {
+      int_raise(EHCI_INT_MASK_USB | (periodic ? EHCI_INT_MASK_NXP_PERIODIC : EHCI_INT_MASK_NXP_ASYNC));
+    }
+  }
+}
+
+// Fetch next qTD into overlay if the overlay is not active, return false if there is nothing to do
+static bool qhd_fetch(ehci_qhd_t* qhd)
+{
+  volatile ehci_qtd_t* overlay = &qhd->qtd_overlay;
+  if ( overlay->halted ) return false;
+  if ( overlay->active ) return true;
+
+  // EHCI 4.10.2: alternate next qTD is followed if previous qTD ended with a short packet
+  ehci_link_t const link = (overlay->total_bytes && !overlay->alternate.terminate) ? overlay->alternate : overlay->next;
+  if ( link.terminate ) return false;
+
+  uint32_t const addr = link.address & ~0x1Fu;
+  uint32_t const* qtd = (uint32_t const*) ptr_of(addr);
+  if ( !(qtd[QTD_WORD_TOKEN] & TU_BIT(7)) ) return false; // not active
+
+  uint32_t* ov = words_of(overlay);
+  uint32_t const keep = ov[QTD_WORD_TOKEN] & (QTD_TOKEN_PING | (qhd->data_toggle_control ? 0 : QTD_TOKEN_TOGGLE));
+  uint32_t const mask = QTD_TOKEN_PING | (qhd->data_toggle_control ? 0 : QTD_TOKEN_TOGGLE);
+
+  qhd->qtd_addr = addr;
+  for(uint32_t i=0; i<8; i++) ov[i] = qtd[i];
+  ov[QTD_WORD_TOKEN] = (ov[QTD_WORD_TOKEN] & ~mask) | keep;
+
+  return true;
+}
+
+// Execute one transaction of a queue head, return true if data was transferred (not NAKed or idle)
+static bool qhd_execute(ehci_qhd_t* qhd, bool periodic)
+{
+  if ( !qhd_fetch(qhd) ) return false;
+
+  volatile ehci_qtd_t* overlay = &qhd->qtd_overlay;
+  uint32_t* ov = words_of(overlay);
+
+  uint8_t  const pid   = (uint8_t) overlay->pid;
+  uint16_t const mps   = (uint16_t) qhd->max_packet_size;
+  uint16_t const total = (uint16_t) overlay->total_bytes;
+  uint16_t const len   = (pid == EHCI_PID_SETUP) ? 8 : tu_min16(total, mps);
+
+  uint32_t const cost = xact_cost((uint8_t) qhd->ep_speed, len);
+  if ( cost > _model.budget ) return false;
+  _model.budget -= cost;
+
+  static uint8_t packet[1024];
+  if ( pid != EHCI_PID_IN ) qtd_buffer_copy(ov, packet, len, true);
+
+  ehci_model_stats.xacts++;
+  int32_t const result = _model.xact_cb((uint8_t) qhd->dev_addr, (uint8_t) qhd->ep_number, pid, packet, len);
+
+  switch ( result )
+  {
+    case EHCI_MODEL_NAK:
+      ehci_model_stats.naks++;
+      return false;
+
+    case EHCI_MODEL_STALL:
+      overlay->halted = 1;
+      overlay->active = 0;
+      qhd_retire(qhd, false, periodic);
+      return false;
+
+    case EHCI_MODEL_XACT_ERR:
+      overlay->xact_err = 1;
+      if ( overlay->err_count ) overlay->err_count--;
+      if ( overlay->err_count == 0 )
+      {
+        overlay->halted = 1;
+        overlay->active = 0;
+        qhd_retire(qhd, false, periodic);
+      }
+      return false;
+
+    default: break;
+  }
+
+  uint16_t const count = (uint16_t) result;
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(len, count, "device returned more than requested");
+
+  if ( pid == EHCI_PID_IN ) qtd_buffer_copy(ov, packet, count, false);
+
+  qtd_buffer_advance(ov, count);
+  overlay->total_bytes = (uint32_t) (total - count) & 0x7FFF;
+  ov[QTD_WORD_TOKEN] ^= QTD_TOKEN_TOGGLE;
+
+  ehci_model_stats.bytes += count;
+  _model.data_xact = true;
+
+  bool const short_packet = (pid == EHCI_PID_IN) && (count < mps) && (overlay->total_bytes != 0);
+
+  if ( overlay->total_bytes == 0 || short_packet )
+  {
+    overlay->active = 0;
+    qhd_retire(qhd, short_packet, periodic);
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Isochronous
+//--------------------------------------------------------------------+
+
+// Execute transaction of a micro frame slot
+static void itd_execute(ehci_itd_t* itd, uint8_t uframe)
+{
+  if ( !itd->xact[uframe].active ) return;
+
+  uint32_t const* pages = itd->BufferPointer;
+  uint8_t  const dev_addr = pages[0] & 0x7F;
+  uint8_t  const ep_num   = (pages[0] >> 8) & 0xF;
+  uint16_t const mps      = pages[1] & 0x7FF;
+  bool     const in       = (pages[1] & TU_BIT(11)) != 0;
+  uint8_t  const mult     = pages[2] & 0x3;
+  uint16_t const len      = (uint16_t) itd->xact[uframe].length;
+
+  TEST_ASSERT_NOT_EQUAL_MESSAGE(0, mult, "iTD multi is zero");
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(mps*mult, len, "iTD length exceeds max packet size");
+
+  static uint8_t packet[3*1024];
+  uint8_t const page = (uint8_t) itd->xact[uframe].page_select;
+  uint32_t const offset = itd->xact[uframe].offset;
+
+  if ( !in ) iso_buffer_copy(pages, 7, page, offset, packet, len, true);
+
+  int32_t const result = iso_xact(dev_addr, ep_num, in, packet, len);
+  if ( result < 0 )
+  {
+    itd->xact[uframe].error = 1;
+    if ( in ) itd->xact[uframe].length = 0;
+  }
+  else if ( in )
+  {
+    iso_buffer_copy(pages, 7, page, offset, packet, (uint16_t) result, false);
+    itd->xact[uframe].length = (uint32_t) result;
+  }
+
+  itd->xact[uframe].active = 0;
+  if ( itd->xact[uframe].int_on_complete ) int_raise(EHCI_INT_MASK_USB | EHCI_INT_MASK_NXP_PERIODIC);
+}
+
+// Whole split transaction is executed in the first start split micro frame
+static void sitd_execute(ehci_sitd_t* sitd, uint8_t uframe)
+{
+  if ( !sitd->active || !sitd->int_smask ) return;
+  if ( uframe != (uint8_t) __builtin_ctz(sitd->int_smask) ) return;
+
+  uint32_t const pages[2] = { sitd->buffer[0], sitd->buffer[1] };
+  bool const in = sitd->direction != 0;
+  uint16_t const len = (uint16_t) sitd->total_bytes;
+
+  static uint8_t packet[1024];
+  if ( !in ) iso_buffer_copy(pages, 2, 0, pages[0] & 0xFFF, packet, len, true);
+
+  int32_t const result = iso_xact((uint8_t) sitd->dev_addr, (uint8_t) sitd->ep_number, in, packet, len);
+  if ( result < 0 )
+  {
+    sitd->xact_err = 1;
+  }
+  else
+  {
+    if ( in ) iso_buffer_copy(pages, 2, 0, pages[0] & 0xFFF, packet, (uint16_t) result, false);
+    sitd->total_bytes = (uint32_t) (len - result) & 0x3FF;
+  }
+
+  sitd->active = 0;
+  if ( sitd->int_on_complete ) int_raise(EHCI_INT_MASK_USB | EHCI_INT_MASK_NXP_PERIODIC);
+}
+
+//--------------------------------------------------------------------+
+// Schedules
+//--------------------------------------------------------------------+
+
+static void periodic_schedule(void)
+{
+  uint32_t const fl_size = framelist_size();
+  uint32_t const frame  = (ehci_model_regs.frame_index >> 3) & (fl_size - 1);
+  uint8_t  const uframe = ehci_model_regs.frame_index & 7;
+
+  ehci_link_t const* framelist = (ehci_link_t const*) ptr_of(ehci_model_regs.periodic_list_base);
+  ehci_link_t link = framelist[frame];
+
+  for(uint32_t count = 0; !link.terminate; count++)
+  {
+    TEST_ASSERT_LESS_THAN_MESSAGE(PERIOD_NODE_MAX, count, "periodic list loops");
+
+    void* node = ptr_of(link.address & ~0x1Fu);
+
+    switch ( link.type )
+    {
+      case EHCI_QTYPE_QHD:
+      {
+        ehci_qhd_t* qhd = (ehci_qhd_t*) node;
+        if ( tu_bit_test(qhd->int_smask, uframe) ) qhd_execute(qhd, true);
+        link = qhd->next;
+      }
+      break;
+
+      case EHCI_QTYPE_ITD:
+        itd_execute((ehci_itd_t*) node, uframe);
+        link = ((ehci_itd_t*) node)->next;
+      break;
+
+      case EHCI_QTYPE_SITD:
+        sitd_execute((ehci_sitd_t*) node, uframe);
+        link = ((ehci_sitd_t*) node)->next;
+      break;
+
+      default:
+        TEST_FAIL_MESSAGE("unsupported periodic element");
+      break;
+    }
+  }
+}
+
+static void async_schedule(void)
+{
+  ehci_qhd_t* qhd = (ehci_qhd_t*) ptr_of(ehci_model_regs.async_list_addr);
+  if ( !qhd ) return;
+
+  // Round-robin until the micro frame is used up or a full circle transferred nothing
+  ehci_qhd_t* idle_since = NULL;
+  for(uint32_t count = 0; _model.budget > XACT_OVERHEAD; count++)
+  {
+    TEST_ASSERT_LESS_THAN_MESSAGE(100000, count, "async list is not circular");
+
+    if ( qhd_execute(qhd, false) )
+    {
+      idle_since = NULL;
+    }
+    else if ( !idle_since )
+    {
+      idle_since = qhd;
+    }
+
+    qhd = (ehci_qhd_t*) ptr_of(qhd->next.address & ~0x1Fu);
+    if ( qhd == idle_since ) break;
+  }
+
+  // controller continues from here in next micro frame
+  ehci_model_regs.async_list_addr = (uint32_t) (uintptr_t) qhd;
+}
+
+// Move current async pointer to the queue head with head of list flag
+static void async_rewind(void)
+{
+  ehci_qhd_t* qhd = (ehci_qhd_t*) ptr_of(ehci_model_regs.async_list_addr);
+  if ( !qhd ) return;
+
+  for(uint32_t count = 0; !qhd->head_list_flag; count++)
+  {
+    TEST_ASSERT_LESS_THAN_MESSAGE(PERIOD_NODE_MAX, count, "async list has no head");
+    qhd = (ehci_qhd_t*) ptr_of(qhd->next.address & ~0x1Fu);
+  }
+
+  ehci_model_regs.async_list_addr = (uint32_t) (uintptr_t) qhd;
+}
+
+static void port_task(void)
+{
+  uint32_t portsc = ehci_model_regs.portsc;
+
+  if ( (portsc & EHCI_PORTSC_MASK_PORT_RESET) && !_model.port_reset_end )
+  {
+    _model.port_reset_end = _model.uframe + PORT_RESET_UFRAMES;
+  }
+
+  if ( _model.port_reset_end && _model.uframe >= _model.port_reset_end )
+  {
+    _model.port_reset_end = 0;
+    portsc &= ~(uint32_t) EHCI_PORTSC_MASK_PORT_RESET;
+    if ( portsc & EHCI_PORTSC_MASK_CURRENT_CONNECT_STATUS ) portsc |= EHCI_PORTSC_MASK_PORT_EANBLED;
+    ehci_model_regs.portsc = portsc;
+  }
+}
+
+static void interrupt_task(void)
+{
+  uint32_t threshold = (ehci_model_regs.command >> EHCI_USBCMD_POS_INTERRUPT_THRESHOLD) & 0xFF;
+  if ( threshold == 0 ) threshold = 1;
+
+  // EHCI 4.15: threshold only applies to transfer interrupts
+  uint32_t const xfer_mask = EHCI_INT_MASK_USB | EHCI_INT_MASK_ERROR | EHCI_INT_MASK_NXP_ASYNC | EHCI_INT_MASK_NXP_PERIODIC;
+  uint32_t const enabled = _model.int_pending & ehci_model_regs.inten;
+
+  if ( !enabled ) return;
+  if ( !(enabled & ~xfer_mask) && (_model.uframe - _model.int_last < threshold) ) return;
+
+  // present pending status, considered acknowledged once handler returns
+  ehci_model_regs.status = _model.int_pending;
+  _model.int_pending = 0;
+  _model.int_last    = _model.uframe;
+
+  ehci_model_stats.interrupts++;
+  hcd_int_handler(0);
+
+  ehci_model_regs.status = 0;
+  ehci_model_regs.portsc &= ~(uint32_t) EHCI_PORTSC_MASK_W1C;
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void ehci_model_init(ehci_model_xact_cb_t xact_cb)
+{
+  TEST_ASSERT_TRUE_MESSAGE((uintptr_t) &ehci_model_regs <= UINT32_MAX,
+                           "EHCI model requires 32-bit addressable memory, build without PIE");
+
+  tu_memclr(&_model, sizeof(_model));
+  tu_memclr(&ehci_model_stats, sizeof(ehci_model_stats));
+  tu_memclr((void*) (uintptr_t) &ehci_model_cap_regs, sizeof(ehci_model_cap_regs));
+  tu_memclr((void*) (uintptr_t) &ehci_model_regs, sizeof(ehci_model_regs));
+
+  _model.xact_cb = xact_cb;
+
+  ehci_model_cap_regs.caplength  = sizeof(ehci_cap_registers_t);
+  ehci_model_cap_regs.hciversion = 0x0100;
+  ehci_model_cap_regs.hcsparams  = 1; // 1 port, no port power control
+
+  // EHCI default: interrupt threshold 8 micro frames
+  ehci_model_regs.command = 8u << EHCI_USBCMD_POS_INTERRUPT_THRESHOLD;
+}
+
+void ehci_model_port_connect(tusb_speed_t speed)
+{
+  uint32_t portsc = ehci_model_regs.portsc & ~(3u << PORTSC_POS_NXP_SPEED) & ~TU_BIT(PORTSC_POS_HIGHSPEED);
+  portsc |= EHCI_PORTSC_MASK_CURRENT_CONNECT_STATUS | EHCI_PORTSC_MASK_CONNECT_STATUS_CHANGE;
+  portsc |= ((uint32_t) speed) << PORTSC_POS_NXP_SPEED;
+  if ( speed == TUSB_SPEED_HIGH ) portsc |= TU_BIT(PORTSC_POS_HIGHSPEED);
+
+  ehci_model_regs.portsc = portsc;
+  int_raise(EHCI_INT_MASK_PORT_CHANGE);
+}
+
+void ehci_model_port_disconnect(void)
+{
+  uint32_t portsc = ehci_model_regs.portsc;
+  portsc &= ~(uint32_t) (EHCI_PORTSC_MASK_CURRENT_CONNECT_STATUS | EHCI_PORTSC_MASK_PORT_EANBLED);
+  portsc |= EHCI_PORTSC_MASK_CONNECT_STATUS_CHANGE | EHCI_PORTSC_MASK_PORT_ENABLE_CHANGE;
+
+  ehci_model_regs.portsc = portsc;
+  int_raise(EHCI_INT_MASK_PORT_CHANGE);
+}
+
+void ehci_model_run(uint32_t uframes)
+{
+  while ( uframes-- )
+  {
+    if ( !ehci_model_regs.command_bm.run_stop ) continue;
+
+    _model.budget    = UFRAME_BUS_TIME;
+    _model.data_xact = false;
+
+    port_task();
+
+    if ( ehci_model_regs.command_bm.periodic_enable ) periodic_schedule();
+    if ( ehci_model_regs.command_bm.async_enable ) async_schedule();
+
+    if ( _model.data_xact ) ehci_model_stats.busy_uframes++;
+
+    // async advance doorbell: removed queue heads are no longer referenced after this micro frame, the controller
+    // continues from the head of the list (reached through the next pointer of a removed one as well)
+    if ( ehci_model_regs.command_bm.async_adv_doorbell )
+    {
+      ehci_model_regs.command_bm.async_adv_doorbell = 0;
+      async_rewind();
+      int_raise(EHCI_INT_MASK_ASYNC_ADVANCE);
+    }
+
+    _model.uframe++;
+    ehci_model_stats.uframes++;
+
+    uint32_t const fl_uframes = framelist_size() << 3;
+    ehci_model_regs.frame_index = (ehci_model_regs.frame_index + 1) % fl_uframes;
+    if ( ehci_model_regs.frame_index == 0 ) int_raise(EHCI_INT_MASK_FRAMELIST_ROLLOVER);
+
+    interrupt_task();
+  }
+}
+
+uint32_t ehci_model_uframe(void)
+{
+  return _model.uframe;
+}
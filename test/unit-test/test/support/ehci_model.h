@@ -0,0 +1,97 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _EHCI_MODEL_H_
+#define _EHCI_MODEL_H_
+
+#include "common/tusb_common.h"
+#include "portable/ehci/ehci.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// Behavioural model of an EHCI host controller with a single root port and the ChipIdea (NXP) extensions used by
+// ehci.c: USBINT is accompanied by the async/periodic interrupt bits, the frame list size has an extra MSB.
+//
+// Every micro frame the model walks the periodic frame list entry (active iTD slot of the micro frame, siTD, QHD with
+// S-mask bit set for the micro frame) then the async ring (round-robin, one transaction per QHD per pass) until the
+// bus time of the micro frame is used up or nothing but NAKs remain. Transactions are executed against simulated
+// devices through a callback, qTDs are fetched into and retired from the QHD overlay as specified by EHCI 4.10.
+// Interrupts are delivered to hcd_int_handler() honouring the interrupt threshold for transfer interrupts.
+//
+// Limitations:
+// - The controller shares the address space with the driver: structures and buffers must be 32-bit addressable
+//   (static data in a non-PIE executable).
+// - Write-1-to-clear writes cannot be observed on plain memory: status and port change bits presented to
+//   hcd_int_handler() are considered acknowledged once it returns.
+// - Split transactions are executed in their start-split micro frame, complete-split masks are not checked.
+//   Isochronous split transactions are charged high speed bus time only.
+
+// Result of a transaction returned by simulated device, otherwise number of bytes
+enum
+{
+  EHCI_MODEL_NAK      = -1,
+  EHCI_MODEL_STALL    = -2,
+  EHCI_MODEL_XACT_ERR = -3, // timeout, CRC error etc.
+};
+
+// Execute a transaction. SETUP/OUT: data holds len bytes sent by host, return number of bytes accepted (len).
+// IN: fill data with up to len bytes, return its count.
+typedef int32_t (*ehci_model_xact_cb_t)(uint8_t dev_addr, uint8_t ep_num, uint8_t pid, uint8_t* data, uint16_t len);
+
+typedef struct
+{
+  uint32_t uframes;
+  uint32_t interrupts;    // number of hcd_int_handler() calls
+  uint32_t xacts;         // transactions including NAKed ones
+  uint32_t naks;
+  uint32_t bytes;         // data bytes transferred
+  uint32_t busy_uframes;  // micro frames with at least one data transaction
+} ehci_model_stats_t;
+
+extern ehci_cap_registers_t ehci_model_cap_regs;
+extern ehci_registers_t     ehci_model_regs;
+extern ehci_model_stats_t   ehci_model_stats;
+
+// Reset controller, registers are passed to ehci_init()
+void ehci_model_init(ehci_model_xact_cb_t xact_cb);
+
+// Connect/disconnect device to root port
+void ehci_model_port_connect(tusb_speed_t speed);
+void ehci_model_port_disconnect(void);
+
+// Run for a number of micro frames
+void ehci_model_run(uint32_t uframes);
+
+// Current micro frame since init
+uint32_t ehci_model_uframe(void);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
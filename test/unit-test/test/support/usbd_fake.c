@@ -0,0 +1,147 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+#include "device/usbd.h"
+#include "device/usbd_pvt.h"
+
+#include "usbd_fake.h"
+
+tusb_speed_t usbd_fake_speed = TUSB_SPEED_FULL;
+
+static usbd_fake_edpt_t _edpt[TUP_DCD_ENDPOINT_MAX][2];
+
+usbd_fake_edpt_t* usbd_fake_edpt(uint8_t ep_addr)
+{
+  return &_edpt[tu_edpt_number(ep_addr)][tu_edpt_dir(ep_addr)];
+}
+
+void usbd_fake_reset(void)
+{
+  tu_memclr(_edpt, sizeof(_edpt));
+}
+
+tusb_speed_t tud_speed_get(void)
+{
+  return usbd_fake_speed;
+}
+
+bool usbd_edpt_open(uint8_t rhport, tusb_desc_endpoint_t const * desc_ep)
+{
+  (void) rhport;
+  (void) desc_ep;
+  return true;
+}
+
+void usbd_edpt_close(uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport;
+  (void) ep_addr;
+}
+
+bool usbd_edpt_claim(uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport;
+  usbd_fake_edpt_t* ep = usbd_fake_edpt(ep_addr);
+  if (ep->busy) return false;
+  ep->busy = true;
+  return true;
+}
+
+bool usbd_edpt_release(uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport;
+  usbd_fake_edpt(ep_addr)->busy = false;
+  return true;
+}
+
+bool usbd_edpt_busy(uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport;
+  return usbd_fake_edpt(ep_addr)->busy;
+}
+
+bool usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes)
+{
+  (void) rhport;
+  usbd_fake_edpt_t* ep = usbd_fake_edpt(ep_addr);
+  ep->busy        = true;
+  ep->buffer      = buffer;
+  ep->total_bytes = total_bytes;
+  return true;
+}
+
+bool usbd_edpt_xfer_fifo(uint8_t rhport, uint8_t ep_addr, tu_fifo_t * ff, uint16_t total_bytes)
+{
+  (void) rhport;
+  (void) ff;
+  usbd_fake_edpt_t* ep = usbd_fake_edpt(ep_addr);
+  ep->busy        = true;
+  ep->buffer      = NULL;
+  ep->total_bytes = total_bytes;
+  return true;
+}
+
+void usbd_edpt_stall(uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport;
+  (void) ep_addr;
+}
+
+void usbd_edpt_clear_stall(uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport;
+  (void) ep_addr;
+}
+
+bool usbd_edpt_iso_activate(uint8_t rhport, tusb_desc_endpoint_t const * desc_ep)
+{
+  (void) rhport;
+  (void) desc_ep;
+  return true;
+}
+
+void usbd_sof_enable(uint8_t rhport, bool en)
+{
+  (void) rhport;
+  (void) en;
+}
+
+bool tud_control_xfer(uint8_t rhport, tusb_control_request_t const * request, void* buffer, uint16_t len)
+{
+  (void) rhport;
+  (void) request;
+  (void) buffer;
+  (void) len;
+  return true;
+}
+
+bool tud_control_status(uint8_t rhport, tusb_control_request_t const * request)
+{
+  (void) rhport;
+  (void) request;
+  return true;
+}
@@ -0,0 +1,60 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _USBD_FAKE_H_
+#define _USBD_FAKE_H_
+
+#include "common/tusb_common.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// Endpoint and control transfer API of usbd for class driver tests which drive the driver functions directly:
+// every call succeeds. An endpoint is busy once claimed or a transfer is queued, the transfer stays pending until the
+// test completes it by clearing busy and invoking the driver's xfer callback.
+
+typedef struct
+{
+  bool busy;
+  uint8_t* buffer;      // buffer of the last transfer, NULL for FIFO transfers
+  uint16_t total_bytes; // length of the last transfer
+} usbd_fake_edpt_t;
+
+// Bus speed returned by tud_speed_get(), full speed by default
+extern tusb_speed_t usbd_fake_speed;
+
+// State of an endpoint
+usbd_fake_edpt_t* usbd_fake_edpt(uint8_t ep_addr);
+
+// Make all endpoints idle
+void usbd_fake_reset(void);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif
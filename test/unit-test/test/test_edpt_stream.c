@@ -0,0 +1,222 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+
+#include "osal/osal.h"
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "tusb_private.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+// Simulated timing (us) of a full-speed bulk IN pipe that always has data
+enum
+{
+  EP_SIZE    = 64,
+  T_BUS      = 50, // one 64-byte transfer on the bus
+  T_DISPATCH = 20, // transfer complete interrupt -> class driver callback in task
+  T_COPY     = 5,  // endpoint buffer -> fifo
+  T_APP      = 30, // application rx callback
+};
+
+static uint8_t ff_buf[4*EP_SIZE];
+static uint8_t ep_buf[EP_SIZE];
+static uint8_t ep_buf2[EP_SIZE];
+static tu_edpt_stream_t stream;
+
+static uint32_t now_us;
+
+// fake endpoint
+static struct
+{
+  bool busy;
+  bool claimed;
+  uint8_t* buf;
+  uint16_t len;
+  uint32_t start;
+} ep;
+
+static uint8_t tx_seq;
+static uint8_t rx_seq;
+
+//--------------------------------------------------------------------+
+// Fake device stack
+//--------------------------------------------------------------------+
+
+bool tud_init(uint8_t rhport)
+{
+  (void) rhport;
+  return true;
+}
+
+bool tud_inited(void)
+{
+  return true;
+}
+
+bool usbd_edpt_claim(uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport; (void) ep_addr;
+  if ( ep.busy || ep.claimed ) return false;
+  ep.claimed = true;
+  return true;
+}
+
+bool usbd_edpt_release(uint8_t rhport, uint8_t ep_addr)
+{
+  (void) rhport; (void) ep_addr;
+  ep.claimed = false;
+  return true;
+}
+
+bool usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes)
+{
+  (void) rhport; (void) ep_addr;
+  TEST_ASSERT_TRUE(ep.claimed && !ep.busy);
+
+  ep.claimed = false;
+  ep.busy    = true;
+  ep.buf     = buffer;
+  ep.len     = total_bytes;
+  ep.start   = now_us;
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+static void stream_setup(uint16_t ff_size, bool double_buffered)
+{
+  tusb_desc_endpoint_t const desc_ep =
+  {
+    .bLength          = sizeof(tusb_desc_endpoint_t),
+    .bDescriptorType  = TUSB_DESC_ENDPOINT,
+    .bEndpointAddress = 0x01,
+    .bmAttributes     = { .xfer = TUSB_XFER_BULK },
+    .wMaxPacketSize   = EP_SIZE,
+    .bInterval        = 0
+  };
+
+  tu_memclr(&stream, sizeof(stream));
+  tu_edpt_stream_init(&stream, false, false, false, ff_buf, ff_size, ep_buf, EP_SIZE);
+  if ( double_buffered ) tu_edpt_stream_set_rx_buf2(&stream, ep_buf2);
+  tu_edpt_stream_open(&stream, 0, &desc_ep);
+}
+
+// Run the pipe for duration_us, the application drains the fifo in its main loop after each callback.
+// Return throughput in bytes per ms
+static uint32_t stream_run(uint32_t duration_us)
+{
+  uint32_t bytes = 0;
+  uint32_t task_free = 0;
+
+  now_us = 0;
+  tu_edpt_stream_read_xfer(&stream);
+
+  while ( now_us < duration_us )
+  {
+    TEST_ASSERT_TRUE(ep.busy);
+
+    // device sends a full transfer of sequence numbers
+    for(uint16_t i=0; i<ep.len; i++) ep.buf[i] = tx_seq++;
+
+    now_us = tu_max32(ep.start + T_BUS + T_DISPATCH, task_free);
+    ep.busy = false;
+
+    // class driver callback: same sequence as cdch_xfer_cb()
+    tu_edpt_stream_read_xfer_complete(&stream, ep.len);
+    now_us += T_COPY;
+    now_us += T_APP;
+    tu_edpt_stream_read_xfer(&stream);
+
+    // application main loop
+    uint8_t buf[sizeof(ff_buf)];
+    uint32_t const count = tu_edpt_stream_read(&stream, buf, sizeof(buf));
+    for(uint32_t i=0; i<count; i++) TEST_ASSERT_EQUAL_HEX8(rx_seq++, buf[i]);
+    bytes += count;
+
+    task_free = now_us;
+  }
+
+  return (bytes * 1000) / now_us;
+}
+
+void setUp(void)
+{
+  tu_memclr(&ep, sizeof(ep));
+  tx_seq = rx_seq = 0;
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+void test_read_single_buffer(void)
+{
+  stream_setup(sizeof(ff_buf), false);
+  uint32_t const rate = stream_run(100000);
+
+  // pipe is idle during dispatch, copy and application callback
+  TEST_ASSERT_UINT32_WITHIN(5, EP_SIZE * 1000 / (T_BUS + T_DISPATCH + T_COPY + T_APP), rate);
+}
+
+void test_read_double_buffer(void)
+{
+  stream_setup(sizeof(ff_buf), false);
+  uint32_t const rate_single = stream_run(100000);
+
+  setUp();
+  stream_setup(sizeof(ff_buf), true);
+  uint32_t const rate_double = stream_run(100000);
+
+  char msg[96];
+  snprintf(msg, sizeof(msg), "bulk IN: single buffer %lu bytes/ms, double buffer %lu bytes/ms",
+           (unsigned long) rate_single, (unsigned long) rate_double);
+  TEST_MESSAGE(msg);
+
+  // next transfer is already queued while the previous one is copied and consumed
+  TEST_ASSERT_UINT32_WITHIN(5, EP_SIZE * 1000 / (T_BUS + T_DISPATCH), rate_double);
+  TEST_ASSERT_GREATER_THAN_UINT32(rate_single, rate_double);
+}
+
+void test_read_double_buffer_small_fifo(void)
+{
+  // fifo can only hold one transfer: no transfer is queued until data is copied, but nothing is lost
+  stream_setup(EP_SIZE, true);
+  stream_run(10000);
+  TEST_ASSERT_EQUAL(tx_seq, rx_seq);
+}